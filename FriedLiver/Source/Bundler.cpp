@@ -4,8 +4,11 @@
 #include "SiftGPU/SiftMatch.h"
 #include "SiftGPU/MatrixConversion.h"
 #include "SiftGPU/SIFTMatchFilter.h"
+#include "SiftGPU/SIFTDescriptorIndex.h"
+#include "SiftGPU/SIFTVocabularyTree.h"
 #include "CUDAImageManager.h"
 #include "CUDACache.h"
+#include "BundlerCheckpoint.h"
 
 #include "mLibCuda.h"
 #include "GlobalAppState.h"
@@ -24,6 +27,14 @@ Bundler::Bundler(unsigned int maxNumImages, unsigned int maxNumKeysPerImage,
 	m_siftIntrinsicsInv = MatrixConversion::toCUDA(siftIntrinsicsInv);
 	m_siftIntrinsics = m_siftIntrinsicsInv.getInverse();
 	m_bIsLocal = isLocal;
+	m_descriptorIndex = NULL;
+	m_vocabularyTree = NULL;
+	if (!isLocal && GlobalBundlingState::get().s_bowTopK > 0) {
+		m_vocabularyTree = new SIFTVocabularyTree(GlobalBundlingState::get().s_bowVocabularyBranching, GlobalBundlingState::get().s_bowVocabularyDepth, GlobalBundlingState::get().s_bowTrainingFrames);
+	}
+	else if (!isLocal && GlobalBundlingState::get().s_siftIndexTopK > 0) {
+		m_descriptorIndex = new SIFTDescriptorIndex(GlobalBundlingState::get().s_siftIndexNumLists, GlobalBundlingState::get().s_siftIndexNumProbes, GlobalBundlingState::get().s_siftIndexTrainingFrames);
+	}
 
 	//initialize optimizer
 	const unsigned int maxNumResiduals = MAX_MATCHES_PER_IMAGE_PAIR_FILTERED * (maxNumImages*(maxNumImages - 1)) / 2;
@@ -35,10 +46,13 @@ Bundler::Bundler(unsigned int maxNumImages, unsigned int maxNumKeysPerImage,
 	const unsigned int downSampWidth = GlobalBundlingState::get().s_downsampledWidth;
 	const unsigned int downSampHeight = GlobalBundlingState::get().s_downsampledHeight;
 	const mat4f cacheInputIntrinsics = manager->getSIFTDepthIntrinsics();
-	m_cudaCache = new CUDACache(cacheInputWidth, cacheInputHeight, downSampWidth, downSampHeight, maxNumImages, cacheInputIntrinsics);
+	m_cudaCache = new CUDACache(cacheInputWidth, cacheInputHeight, downSampWidth, downSampHeight, maxNumImages, cacheInputIntrinsics, GlobalBundlingState::get().s_cacheCompact);
+	m_denseVerify = NULL;
+	if (GlobalBundlingState::get().s_denseVerifyCPU) m_denseVerify = new DenseVerifyCPU(downSampWidth, downSampHeight);
 
 	//sparse tracking
 	m_siftManager = new SIFTImageManager(maxNumImages, maxNumKeysPerImage);
+	if (GlobalBundlingState::get().s_siftFilterCPU && GlobalBundlingState::get().s_siftFilterRANSAC) SIFTMatchFilter::init(); //RANSAC combinations, before the bundling threads share them
 
 	//trajectories
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_trajectory, sizeof(float4x4)*maxNumImages));
@@ -58,23 +72,27 @@ void Bundler::initSift(unsigned int widthSift, unsigned int heightSift, bool isL
 {
 	if (isLocal) {
 		m_sift = new SiftGPU;
-		m_sift->SetParams(widthSift, heightSift, false, 150, GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax);
+		m_sift->SetParams(widthSift, heightSift, false, 150, GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax, GlobalBundlingState::get().s_siftDetectorCPU);
+		m_sift->SetPipelinedPyramid(GlobalBundlingState::get().s_siftPipelinedPyramid);
 		m_sift->InitSiftGPU();
 	}
 	else {
 		m_sift = NULL; //don't need detection for global
 	}
 	m_siftMatcher = new SiftMatchGPU(GlobalBundlingState::get().s_maxNumKeysPerImage);
-	m_siftMatcher->InitSiftMatch();
+	m_siftMatcher->InitSiftMatch(GlobalBundlingState::get().s_siftMatcherCPU);
 }
 
 Bundler::~Bundler()
 {
 	SAFE_DELETE(m_sift);
 	SAFE_DELETE(m_siftMatcher);
+	SAFE_DELETE(m_descriptorIndex);
+	SAFE_DELETE(m_vocabularyTree);
 
 	SAFE_DELETE(m_siftManager);
 	SAFE_DELETE(m_cudaCache);
+	SAFE_DELETE(m_denseVerify);
 
 	MLIB_CUDA_SAFE_FREE(d_trajectory);
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
@@ -113,27 +131,40 @@ unsigned int Bundler::matchAndFilter()
 	if (GlobalBundlingState::get().s_enableGlobalTimings) { cudaDeviceSynchronize(); m_timer.start(); }
 	int num2 = (int)m_siftManager->getNumKeyPointsPerImage(curFrame);
 	if (num2 == 0) return (unsigned int)-1;
-
+	const bool bSelectCandidates = m_descriptorIndex != NULL || m_vocabularyTree != NULL;
+	if (bSelectCandidates) selectMatchCandidates(curFrame, startFrame, numFrames, m_matchCandidates);
+
+	// current frame is set once, all previous frames to match go through one batched call
+	std::vector<unsigned char*> batchDescriptors;
+	std::vector<int> batchNumKeys;
+	std::vector<ImagePairMatch*> batchImagePairMatches;
+	std::vector<uint2> batchKeyPointOffsets;
 	for (unsigned int prev = startFrame; prev < numFrames; prev++) {
 		if (prev == curFrame) continue;
 		uint2 keyPointOffset = make_uint2(0, 0);
 		ImagePairMatch& imagePairMatch = m_siftManager->getImagePairMatch(prev, curFrame, keyPointOffset);
 
 		SIFTImageGPU& image_i = m_siftManager->getImageGPU(prev);
-		SIFTImageGPU& image_j = m_siftManager->getImageGPU(curFrame);
 		int num1 = (int)m_siftManager->getNumKeyPointsPerImage(prev);
 
-		if (validImages[prev] == 0 || num1 == 0 || num2 == 0) {
+		if (validImages[prev] == 0 || num1 == 0 || num2 == 0 || (bSelectCandidates && m_matchCandidates[prev] == 0)) {
 			unsigned int numMatch = 0;
 			MLIB_CUDA_SAFE_CALL(cudaMemcpy(imagePairMatch.d_numMatches, &numMatch, sizeof(unsigned int), cudaMemcpyHostToDevice));
 		}
 		else {
-			m_siftMatcher->SetDescriptors(0, num1, (unsigned char*)image_i.d_keyPointDescs);
-			m_siftMatcher->SetDescriptors(1, num2, (unsigned char*)image_j.d_keyPointDescs);
-			float ratioMax = m_bIsLocal ? GlobalBundlingState::get().s_siftMatchRatioMaxLocal : GlobalBundlingState::get().s_siftMatchRatioMaxGlobal; //TODO do we need two different here?
-			m_siftMatcher->GetSiftMatch(num1, imagePairMatch, keyPointOffset, GlobalBundlingState::get().s_siftMatchThresh, ratioMax);
+			batchDescriptors.push_back((unsigned char*)image_i.d_keyPointDescs);
+			batchNumKeys.push_back(num1);
+			batchImagePairMatches.push_back(&imagePairMatch);
+			batchKeyPointOffsets.push_back(keyPointOffset);
 		}
 	}
+	if (!batchDescriptors.empty()) {
+		SIFTImageGPU& image_j = m_siftManager->getImageGPU(curFrame);
+		m_siftMatcher->SetDescriptors(1, num2, (unsigned char*)image_j.d_keyPointDescs);
+		float ratioMax = m_bIsLocal ? GlobalBundlingState::get().s_siftMatchRatioMaxLocal : GlobalBundlingState::get().s_siftMatchRatioMaxGlobal; //TODO do we need two different here?
+		m_siftMatcher->GetSiftMatchBatch((unsigned int)batchDescriptors.size(), batchDescriptors.data(), batchNumKeys.data(), batchImagePairMatches.data(), batchKeyPointOffsets.data(),
+			GlobalBundlingState::get().s_siftMatchThresh, ratioMax);
+	}
 	if (GlobalBundlingState::get().s_enableGlobalTimings) { cudaDeviceSynchronize(); m_timer.stop(); TimingLog::getFrameTiming(m_bIsLocal).timeSiftMatching = m_timer.getElapsedTimeMS(); }
 
 	unsigned int lastMatchedFrame = (unsigned int)-1;
@@ -157,9 +188,13 @@ unsigned int Bundler::matchAndFilter()
 
 		// --- filter matches
 		const unsigned int minNumMatches = m_bIsLocal ? GlobalBundlingState::get().s_minNumMatchesLocal : GlobalBundlingState::get().s_minNumMatchesGlobal;
-		//SIFTMatchFilter::ransacKeyPointMatches(siftManager, siftIntrinsicsInv, minNumMatches, GlobalBundlingState::get().s_maxKabschResidual2, false);
 		//SIFTMatchFilter::filterKeyPointMatches(siftManager, siftIntrinsicsInv, minNumMatches);
-		m_siftManager->FilterKeyPointMatchesCU(curFrame, startFrame, numFrames, m_siftIntrinsicsInv, minNumMatches, GlobalBundlingState::get().s_maxKabschResidual2);
+		if (GlobalBundlingState::get().s_siftFilterCPU && GlobalBundlingState::get().s_siftFilterRANSAC)
+			SIFTMatchFilter::ransacKeyPointMatches(m_siftManager, curFrame, startFrame, numFrames, m_siftIntrinsicsInv, minNumMatches, GlobalBundlingState::get().s_maxKabschResidual2, false);
+		else if (GlobalBundlingState::get().s_siftFilterCPU)
+			SIFTMatchFilter::filterKeyPointMatchesCPU(m_siftManager, curFrame, startFrame, numFrames, m_siftIntrinsicsInv, minNumMatches, GlobalBundlingState::get().s_maxKabschResidual2);
+		else
+			m_siftManager->FilterKeyPointMatchesCU(curFrame, startFrame, numFrames, m_siftIntrinsicsInv, minNumMatches, GlobalBundlingState::get().s_maxKabschResidual2);
 		if (GlobalBundlingState::get().s_enableGlobalTimings) { cudaDeviceSynchronize(); m_timer.stop(); TimingLog::getFrameTiming(m_bIsLocal).timeMatchFilterKeyPoint = m_timer.getElapsedTimeMS(); }
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
 		if (m_corrEvaluator) m_corrEvaluator->evaluate(m_siftManager, m_cudaCache, MatrixConversion::toMlib(m_siftIntrinsicsInv), true, false, false, "kabsch");
@@ -192,11 +227,25 @@ unsigned int Bundler::matchAndFilter()
 		// --- dense verify filter
 		if (GlobalBundlingState::get().s_enableGlobalTimings) { cudaDeviceSynchronize(); m_timer.start(); }
 		//SIFTMatchFilter::filterByDenseVerify(siftManager, cachedFrames);
-		const CUDACachedFrame* cachedFramesCUDA = m_cudaCache->getCacheFramesGPU();
-		m_siftManager->FilterMatchesByDenseVerifyCU(curFrame, startFrame, numFrames, m_cudaCache->getWidth(), m_cudaCache->getHeight(), MatrixConversion::toCUDA(m_cudaCache->getIntrinsics()),
-			cachedFramesCUDA, GlobalBundlingState::get().s_projCorrDistThres, GlobalBundlingState::get().s_projCorrNormalThres,
-			GlobalBundlingState::get().s_projCorrColorThresh, GlobalBundlingState::get().s_verifySiftErrThresh, GlobalBundlingState::get().s_verifySiftCorrThresh,
-			GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax);
+		if (m_denseVerify) {
+			DenseVerifyCPU::Params params;
+			params.distThresh = GlobalBundlingState::get().s_projCorrDistThres;
+			params.normalThresh = GlobalBundlingState::get().s_projCorrNormalThres;
+			params.errThresh = GlobalBundlingState::get().s_verifySiftErrThresh;
+			params.corrThresh = GlobalBundlingState::get().s_verifySiftCorrThresh;
+			params.depthMin = GlobalAppState::get().s_sensorDepthMin;
+			params.depthMax = GlobalAppState::get().s_sensorDepthMax;
+			params.earlyExitZ = GlobalBundlingState::get().s_denseVerifyEarlyExitZ;
+			m_denseVerify->syncFrames(m_cudaCache);
+			SIFTMatchFilter::filterByDenseVerifyCPU(m_siftManager, m_denseVerify, curFrame, startFrame, numFrames, MatrixConversion::toCUDA(m_cudaCache->getIntrinsics()), params);
+		}
+		else {
+			const CUDACachedFrame* cachedFramesCUDA = m_cudaCache->getCacheFramesGPU();
+			m_siftManager->FilterMatchesByDenseVerifyCU(curFrame, startFrame, numFrames, m_cudaCache->getWidth(), m_cudaCache->getHeight(), MatrixConversion::toCUDA(m_cudaCache->getIntrinsics()),
+				cachedFramesCUDA, GlobalBundlingState::get().s_projCorrDistThres, GlobalBundlingState::get().s_projCorrNormalThres,
+				GlobalBundlingState::get().s_projCorrColorThresh, GlobalBundlingState::get().s_verifySiftErrThresh, GlobalBundlingState::get().s_verifySiftCorrThresh,
+				GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax);
+		}
 		//0.1f, 3.0f);
 		if (GlobalBundlingState::get().s_enableGlobalTimings) { cudaDeviceSynchronize(); m_timer.stop(); TimingLog::getFrameTiming(m_bIsLocal).timeMatchFilterDenseVerify = m_timer.getElapsedTimeMS(); }
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
@@ -357,6 +406,138 @@ void Bundler::reset()
 	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_trajectory, trajectory.data(), sizeof(mat4f)*trajectory.size(), cudaMemcpyHostToDevice));
 	m_siftManager->reset();
 	m_cudaCache->reset();
+	m_optimizer.reset();
+	if (m_denseVerify) m_denseVerify->reset();
+	if (m_descriptorIndex) m_descriptorIndex->reset();
+	if (m_vocabularyTree) m_vocabularyTree->reset();
+}
+
+void Bundler::saveCheckpoint(unsigned int firstImage, CheckpointBuffer& images, CheckpointBuffer& state) const
+{
+	std::vector<unsigned int> numKeyPoints;
+	std::vector<SIFTKeyPoint> keyPoints;
+	std::vector<SIFTKeyPointDesc> keyPointDescs;
+	m_siftManager->getImages(firstImage, numKeyPoints, keyPoints, keyPointDescs);
+	images.write(firstImage);
+	images.writeVector(numKeyPoints);
+	images.writeVector(keyPoints);
+	images.writeVector(keyPointDescs);
+
+	const unsigned int numImages = m_siftManager->getNumImages();
+	const std::vector<int>& validImages = m_siftManager->getValidImages();
+	std::vector<EntryJ> correspondences;
+	std::vector<uint2> correspondenceKeyIndices;
+	m_siftManager->getGlobalCorrespondences(correspondences, correspondenceKeyIndices);
+	state.write(numImages);
+	state.write(m_siftManager->getCurrentFrame());
+	state.writeVector(std::vector<int>(validImages.begin(), validImages.begin() + numImages));
+	state.writeVector(correspondences);
+	state.writeVector(correspondenceKeyIndices);
+	state.writeList(m_siftManager->getRetryList());
+	state.writeDataGPU(d_trajectory, sizeof(float4x4)*m_siftManager->getMaxNumImages());
+	state.write(m_continueRetry);
+	state.write(m_revalidatedIdx);
+}
+
+void Bundler::loadCheckpointImages(CheckpointBuffer& images)
+{
+	unsigned int firstImage = 0;
+	std::vector<unsigned int> numKeyPoints;
+	std::vector<SIFTKeyPoint> keyPoints;
+	std::vector<SIFTKeyPointDesc> keyPointDescs;
+	images.read(firstImage);
+	images.readVector(numKeyPoints);
+	images.readVector(keyPoints);
+	images.readVector(keyPointDescs);
+	if (firstImage != m_siftManager->getNumImages()) throw MLIB_EXCEPTION("checkpoint images start at " + std::to_string(firstImage) + ", bundler has " + std::to_string(m_siftManager->getNumImages()));
+	m_siftManager->addImages(numKeyPoints, keyPoints, keyPointDescs);
+}
+
+void Bundler::loadCheckpointState(CheckpointBuffer& state)
+{
+	unsigned int numImages = 0, currentFrame = 0;
+	std::vector<int> validImages;
+	std::vector<EntryJ> correspondences;
+	std::vector<uint2> correspondenceKeyIndices;
+	std::list<unsigned int> retryList;
+	state.read(numImages);
+	state.read(currentFrame);
+	if (numImages != m_siftManager->getNumImages() || numImages != m_cudaCache->getNumFrames()) {
+		throw MLIB_EXCEPTION("checkpoint state of " + std::to_string(numImages) + " images, loaded " + std::to_string(m_siftManager->getNumImages()) + " images / " + std::to_string(m_cudaCache->getNumFrames()) + " cache frames");
+	}
+	state.readVector(validImages);
+	state.readVector(correspondences);
+	state.readVector(correspondenceKeyIndices);
+	state.readList(retryList);
+	state.readDataGPU(d_trajectory, sizeof(float4x4)*m_siftManager->getMaxNumImages());
+	state.read(m_continueRetry);
+	state.read(m_revalidatedIdx);
+
+	m_siftManager->setCurrentFrame(currentFrame);
+	m_siftManager->setValidImages(validImages);
+	m_siftManager->setGlobalCorrespondences(correspondences, correspondenceKeyIndices);
+	m_siftManager->setRetryList(retryList);
+
+	m_optimizer.reset();
+	if (m_denseVerify) m_denseVerify->reset();
+	if (m_descriptorIndex) m_descriptorIndex->reset();
+	if (m_vocabularyTree) m_vocabularyTree->reset();
+}
+
+void Bundler::selectMatchCandidates(unsigned int curFrame, unsigned int startFrame, unsigned int numFrames, std::vector<int>& candidates)
+{
+	const unsigned int numNeighbors = 5; //descriptor index votes
+	const std::vector<int>& validImages = m_siftManager->getValidImages();
+	std::vector<SIFTKeyPointDesc> descriptors;
+	auto downloadDescriptors = [&](unsigned int frame) {
+		descriptors.resize(m_siftManager->getNumKeyPointsPerImage(frame));
+		if (!descriptors.empty()) MLIB_CUDA_SAFE_CALL(cudaMemcpy(descriptors.data(), m_siftManager->getImageGPU(frame).d_keyPointDescs, sizeof(SIFTKeyPointDesc)*descriptors.size(), cudaMemcpyDeviceToHost));
+	};
+	auto containsImage = [&](unsigned int frame) {
+		return m_vocabularyTree ? m_vocabularyTree->containsImage(frame) : m_descriptorIndex->containsImage(frame);
+	};
+	auto addImage = [&](unsigned int frame) {
+		if (m_vocabularyTree) m_vocabularyTree->addImage(frame, descriptors.data(), (unsigned int)descriptors.size());
+		else m_descriptorIndex->addImage(frame, descriptors.data(), (unsigned int)descriptors.size());
+	};
+	//frames which never went through matchAndFilter (first frame)
+	for (unsigned int f = 0; f < numFrames; f++) {
+		if (f == curFrame || containsImage(f)) continue;
+		downloadDescriptors(f);
+		addImage(f);
+	}
+
+	downloadDescriptors(curFrame);
+	candidates.assign(numFrames, 1);
+	std::vector<float> scores;
+	bool valid = false;
+	unsigned int topK = 0;
+	if (m_vocabularyTree) {
+		valid = m_vocabularyTree->queryImageScores(descriptors.data(), (unsigned int)descriptors.size(), scores);
+		topK = GlobalBundlingState::get().s_bowTopK;
+	}
+	else {
+		std::vector<unsigned int> votes;
+		valid = m_descriptorIndex->queryImageVotes(descriptors.data(), (unsigned int)descriptors.size(), numNeighbors, GlobalBundlingState::get().s_siftMatchThresh, votes);
+		scores.assign(votes.begin(), votes.end());
+		topK = GlobalBundlingState::get().s_siftIndexTopK;
+	}
+	if (valid) {
+		std::vector<std::pair<float, unsigned int>> ranked; //(score, frame)
+		for (unsigned int prev = startFrame; prev < numFrames; prev++) {
+			if (prev == curFrame || validImages[prev] == 0) continue;
+			ranked.push_back(std::make_pair(prev < scores.size() ? scores[prev] : 0.0f, prev));
+		}
+		if (ranked.size() > topK) {
+			//best score first, on ties the more recent frame
+			std::partial_sort(ranked.begin(), ranked.begin() + topK, ranked.end(), std::greater<std::pair<float, unsigned int>>());
+			candidates.assign(numFrames, 0);
+			for (unsigned int i = 0; i < topK; i++) candidates[ranked[i].second] = 1;
+			const unsigned int numTemporal = std::min(curFrame, GlobalBundlingState::get().s_globalMatchTemporalNeighbors);
+			for (unsigned int i = 1; i <= numTemporal; i++) candidates[curFrame - i] = 1;
+		}
+	}
+	addImage(curFrame);
 }
 
 void Bundler::addInvalidFrame()
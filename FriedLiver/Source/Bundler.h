@@ -7,9 +7,13 @@
 
 class SiftGPU;
 class SiftMatchGPU;
+class SIFTDescriptorIndex;
+class SIFTVocabularyTree;
 class SIFTImageManager;
 class CUDACache;
+class DenseVerifyCPU;
 class CUDAImageManager;
+class CheckpointBuffer;
 
 
 #define USE_RETRY //TODO MOVE OUT TO PARAMS??
@@ -56,6 +60,16 @@ public:
 	unsigned int tryRevalidation(unsigned int curGlobalFrame, bool bIsScanDone);
 	unsigned int getRevalidatedIdx() const { return m_revalidatedIdx; }
 
+	// -- session checkpoints (OnlineBundler); the cache frames are written separately (see getCache)
+	//! the sift images [firstImage, getNumFrames()) go to images, everything that still changes with new frames or solves to state
+	void saveCheckpoint(unsigned int firstImage, CheckpointBuffer& images, CheckpointBuffer& state) const;
+	//! appends the images of a saveCheckpoint (reset() before the first)
+	void loadCheckpointImages(CheckpointBuffer& images);
+	//! after all images and cache frames are loaded; the host mirrors of the cache and the match candidate retrieval are rebuilt on demand
+	void loadCheckpointState(CheckpointBuffer& state);
+	const CUDACache* getCache() const { return m_cudaCache; }
+	CUDACache* getCache() { return m_cudaCache; }
+
 
 	// -- various logging
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
@@ -77,12 +91,17 @@ private:
 		MLIB_ASSERT(numFrames >= 1);
 		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_trajectory + numFrames, d_trajectory + numFrames - 1, sizeof(float4x4), cudaMemcpyDeviceToDevice));
 	}
+	//global only: candidates[prev] != 0 for the frames curFrame is matched against (temporal neighbors + top ranked frames of the vocabulary tree / descriptor index, or all frames while untrained); adds curFrame to the retrieval structure
+	void selectMatchCandidates(unsigned int curFrame, unsigned int startFrame, unsigned int numFrames, std::vector<int>& candidates);
 
 	//*********** SIFT *******************
 	SiftGPU*				m_sift;
 	SiftMatchGPU*			m_siftMatcher;
 	float4x4				m_siftIntrinsics;
 	float4x4				m_siftIntrinsicsInv;
+	SIFTDescriptorIndex*	m_descriptorIndex;	//NULL for the local bundler or s_siftIndexTopK == 0 (or s_bowTopK > 0)
+	SIFTVocabularyTree*		m_vocabularyTree;	//NULL for the local bundler or s_bowTopK == 0
+	std::vector<int>		m_matchCandidates;
 
 	int							m_continueRetry;
 	unsigned int				m_revalidatedIdx;
@@ -90,6 +109,7 @@ private:
 	//*********** OPTIMIZATION *******************
 	SIFTImageManager*		m_siftManager;
 	CUDACache*				m_cudaCache;
+	DenseVerifyCPU*			m_denseVerify;		//host mirror of the cache for the dense verification; NULL unless s_denseVerifyCPU
 	SBA						m_optimizer;
 
 	//*********** TRAJECTORIES *******************
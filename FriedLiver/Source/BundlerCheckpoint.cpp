@@ -0,0 +1,204 @@
+#include "stdafx.h"
+
+#include "BundlerCheckpoint.h"
+#include "CUDACache.h"
+
+#include <cstring>
+
+void CheckpointBuffer::writeData(const void* data, size_t sizeBytes)
+{
+	const size_t offset = m_data.size();
+	m_data.resize(offset + sizeBytes);
+	if (sizeBytes > 0) std::memcpy(m_data.data() + offset, data, sizeBytes);
+}
+
+void CheckpointBuffer::readData(void* data, size_t sizeBytes)
+{
+	if (sizeBytes > m_data.size() - m_readPos) throw MLIB_EXCEPTION("checkpoint buffer too short");
+	if (sizeBytes > 0) std::memcpy(data, m_data.data() + m_readPos, sizeBytes);
+	m_readPos += sizeBytes;
+}
+
+void CheckpointBuffer::writeDataGPU(const void* d_data, size_t sizeBytes)
+{
+	const size_t offset = m_data.size();
+	m_data.resize(offset + sizeBytes);
+	if (sizeBytes > 0) MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_data.data() + offset, d_data, sizeBytes, cudaMemcpyDeviceToHost));
+}
+
+void CheckpointBuffer::readDataGPU(void* d_data, size_t sizeBytes)
+{
+	if (sizeBytes > m_data.size() - m_readPos) throw MLIB_EXCEPTION("checkpoint buffer too short");
+	if (sizeBytes > 0) MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_data, m_data.data() + m_readPos, sizeBytes, cudaMemcpyHostToDevice));
+	m_readPos += sizeBytes;
+}
+
+void CheckpointBuffer::saveToFile(const std::string& filename) const
+{
+	FILE* file = fopen(filename.c_str(), "wb");
+	if (!file) throw MLIB_EXCEPTION("could not open " + filename + " for writing");
+	const UINT64 magic = BundlerCheckpoint::s_magic;
+	const UINT64 sizeBytes = m_data.size();
+	fwrite(&magic, sizeof(UINT64), 1, file);
+	fwrite(&sizeBytes, sizeof(UINT64), 1, file);
+	if (!m_data.empty()) fwrite(m_data.data(), 1, m_data.size(), file);
+	fflush(file);
+	const bool bFailed = ferror(file) != 0;
+	fclose(file);
+	if (bFailed) throw MLIB_EXCEPTION("failed writing " + filename);
+}
+
+void CheckpointBuffer::loadFromFile(const std::string& filename)
+{
+	clear();
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (!file) throw MLIB_EXCEPTION("could not open " + filename);
+	_fseeki64(file, 0, SEEK_END);
+	const UINT64 fileSize = (UINT64)_ftelli64(file);
+	_fseeki64(file, 0, SEEK_SET);
+
+	UINT64 magic = 0, sizeBytes = 0;
+	bool bValid = fread(&magic, sizeof(UINT64), 1, file) == 1 && magic == BundlerCheckpoint::s_magic
+		&& fread(&sizeBytes, sizeof(UINT64), 1, file) == 1 && sizeBytes == fileSize - 2 * sizeof(UINT64);
+	if (bValid) {
+		m_data.resize((size_t)sizeBytes);
+		bValid = m_data.empty() || fread(m_data.data(), 1, m_data.size(), file) == m_data.size();
+	}
+	fclose(file);
+	if (!bValid) {
+		clear();
+		throw MLIB_EXCEPTION("invalid or incomplete checkpoint file " + filename);
+	}
+}
+
+
+std::string BundlerCheckpoint::getDirectory(const std::string& directory)
+{
+	std::string dir = directory;
+	if (!dir.empty() && !(dir.back() == '/' || dir.back() == '\\')) dir.push_back('/');
+	return dir;
+}
+
+bool BundlerCheckpoint::loadManifest(const std::string& directory, Manifest& manifest)
+{
+	manifest = Manifest();
+	const std::string filename = getManifestFile(directory);
+	if (!util::fileExists(filename)) return false;
+
+	CheckpointBuffer buffer;
+	buffer.loadFromFile(filename);
+	unsigned int version = 0;
+	buffer.read(version);
+	if (version != s_version) throw MLIB_EXCEPTION("checkpoint " + filename + " has version " + std::to_string(version) + ", expected " + std::to_string(s_version));
+	buffer.read(manifest.checkpoint);
+	buffer.readVector(manifest.segments);
+	for (size_t i = 1; i < manifest.segments.size(); i++) {
+		const Segment& prev = manifest.segments[i - 1];
+		if (manifest.segments[i].firstFrame != prev.firstFrame + prev.numFrames) throw MLIB_EXCEPTION("corrupt checkpoint manifest " + filename);
+	}
+	return manifest.checkpoint > 0;
+}
+
+void BundlerCheckpoint::loadCache(const std::string& filename, CUDACache* cache, unsigned int firstFrame)
+{
+	CUDACacheCheckpointReader reader;
+	reader.open(filename);
+	for (unsigned int f = 0; f < reader.getNumFrames(); f++) {
+		reader.loadFrame(f, cache, firstFrame + f);
+	}
+}
+
+
+BundlerCheckpointWriter::BundlerCheckpointWriter(const std::string& directory, CUDACacheCheckpoint::COMPRESSION_TYPE cacheCompression)
+{
+	m_directory = BundlerCheckpoint::getDirectory(directory);
+	m_cacheCompression = cacheCompression;
+	if (!m_directory.empty() && !util::directoryExists(m_directory)) util::makeDirectory(m_directory);
+}
+
+BundlerCheckpointWriter::~BundlerCheckpointWriter()
+{
+	try {
+		waitForSave();
+	}
+	catch (const std::exception& e) {
+		std::cerr << "failed writing checkpoint " << m_pending.checkpoint << " to " << m_directory << ": " << e.what() << std::endl;
+	}
+}
+
+void BundlerCheckpointWriter::saveAsync(CheckpointBuffer& globalImages, const CUDACache* globalCache, const CUDACache* localCache, const CUDACache* optLocalCache, CheckpointBuffer& state)
+{
+	waitForSave();
+
+	BundlerCheckpoint::Segment segment;
+	segment.checkpoint = m_manifest.checkpoint + 1;
+	segment.firstFrame = m_manifest.getNumGlobalFrames();
+	segment.numFrames = globalCache->getNumFrames() - segment.firstFrame;
+	m_pending = m_manifest;
+	m_pending.checkpoint = segment.checkpoint;
+	m_pending.segments.push_back(segment);
+
+	m_globalImages.clear();
+	m_globalImages.swap(globalImages);
+	m_state.clear();
+	m_state.swap(state);
+
+	//the cache writers download synchronously and write on their own threads
+	const unsigned int k = m_pending.checkpoint;
+	m_globalCacheWriter.saveAsync(BundlerCheckpoint::getCacheFile(m_directory, "global", k), globalCache, m_cacheCompression, segment.firstFrame);
+	m_localCacheWriter.saveAsync(BundlerCheckpoint::getCacheFile(m_directory, "local", k), localCache, m_cacheCompression);
+	m_optLocalCacheWriter.saveAsync(BundlerCheckpoint::getCacheFile(m_directory, "optlocal", k), optLocalCache, m_cacheCompression);
+
+	m_error = std::exception_ptr();
+	m_thread = std::thread(&BundlerCheckpointWriter::writeFunc, this);
+}
+
+void BundlerCheckpointWriter::waitForSave()
+{
+	if (!m_thread.joinable()) return;
+	m_thread.join();
+	if (m_error) {
+		std::exception_ptr error = m_error;
+		m_error = std::exception_ptr();
+		std::rethrow_exception(error);
+	}
+	m_manifest = m_pending;
+}
+
+void BundlerCheckpointWriter::writeFunc()
+{
+	try {
+		const unsigned int k = m_pending.checkpoint;
+		m_globalImages.saveToFile(BundlerCheckpoint::getGlobalImagesFile(m_directory, k));
+		m_globalImages.clear();
+		m_state.saveToFile(BundlerCheckpoint::getStateFile(m_directory, k));
+		m_state.clear();
+		m_globalCacheWriter.waitForSave();
+		m_localCacheWriter.waitForSave();
+		m_optLocalCacheWriter.waitForSave();
+
+		//all files of the checkpoint are on disk: replace the manifest
+		CheckpointBuffer manifest;
+		manifest.write(BundlerCheckpoint::s_version);
+		manifest.write(m_pending.checkpoint);
+		manifest.writeVector(m_pending.segments);
+		const std::string filename = BundlerCheckpoint::getManifestFile(m_directory);
+		manifest.saveToFile(filename + ".tmp");
+		if (!MoveFileExA((filename + ".tmp").c_str(), filename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+			throw MLIB_EXCEPTION("could not replace " + filename);
+		}
+
+		//the previous checkpoint is only needed for its global segment
+		const unsigned int prev = m_manifest.checkpoint;
+		if (prev > 0 && prev != k) {
+			std::remove(BundlerCheckpoint::getStateFile(m_directory, prev).c_str());
+			std::remove(BundlerCheckpoint::getCacheFile(m_directory, "local", prev).c_str());
+			std::remove(BundlerCheckpoint::getCacheFile(m_directory, "optlocal", prev).c_str());
+		}
+	}
+	catch (...) {
+		m_globalImages.clear();
+		m_state.clear();
+		m_error = std::current_exception();
+	}
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+/************************************************************************/
+/* Session checkpoints of the OnlineBundler: the per frame data of the  */
+/* global bundler is written once in append-only segments, the state    */
+/* that still changes is rewritten with every checkpoint; a manifest    */
+/* names the last complete checkpoint                                   */
+/************************************************************************/
+
+#include "stdafx.h"
+#include "CUDACacheCheckpoint.h"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <exception>
+
+class CUDACache;
+
+//! byte stream of a checkpoint part: filled on the bundling thread (including the downloads from the GPU), written to disk by BundlerCheckpointWriter
+class CheckpointBuffer
+{
+public:
+	CheckpointBuffer() {
+		m_readPos = 0;
+	}
+
+	void clear() {
+		m_data.clear();
+		m_readPos = 0;
+	}
+	size_t size() const { return m_data.size(); }
+	void swap(CheckpointBuffer& other) {
+		m_data.swap(other.m_data);
+		std::swap(m_readPos, other.m_readPos);
+	}
+
+	void writeData(const void* data, size_t sizeBytes);
+	//! throws if the buffer has less than sizeBytes left
+	void readData(void* data, size_t sizeBytes);
+	//! from / to device memory
+	void writeDataGPU(const void* d_data, size_t sizeBytes);
+	void readDataGPU(void* d_data, size_t sizeBytes);
+
+	template<class T> void write(const T& value) { writeData(&value, sizeof(T)); }
+	template<class T> void read(T& value) { readData(&value, sizeof(T)); }
+
+	template<class T> void writeVector(const std::vector<T>& v) {
+		write((UINT64)v.size());
+		if (!v.empty()) writeData(v.data(), sizeof(T) * v.size());
+	}
+	template<class T> void readVector(std::vector<T>& v) {
+		UINT64 num = 0;
+		read(num);
+		if (num > (m_data.size() - m_readPos) / sizeof(T)) throw MLIB_EXCEPTION("checkpoint buffer too short");
+		v.resize((size_t)num);
+		if (!v.empty()) readData(v.data(), sizeof(T) * v.size());
+	}
+	template<class T> void writeList(const std::list<T>& l) {
+		writeVector(std::vector<T>(l.begin(), l.end()));
+	}
+	template<class T> void readList(std::list<T>& l) {
+		std::vector<T> v;
+		readVector(v);
+		l.assign(v.begin(), v.end());
+	}
+
+	//! the file holds a magic number, the size and the bytes; loadFromFile throws if it is missing or truncated
+	void saveToFile(const std::string& filename) const;
+	void loadFromFile(const std::string& filename);
+
+private:
+	std::vector<unsigned char>	m_data;
+	size_t						m_readPos;
+};
+
+//! files of a checkpoint directory:
+//!		checkpoint.bin						manifest: index of the last complete checkpoint and the global frame segments, replaced atomically when a checkpoint is complete
+//!		global.<k>.sift / global.<k>.cache	sift images / cache frames of the global bundler added with checkpoint k (one segment; never rewritten)
+//!		local.<k>.cache / optlocal.<k>.cache	cache frames of the local bundlers at checkpoint k
+//!		state.<k>.bin						everything else at checkpoint k; written by OnlineBundler::saveCheckpoint
+//! the files of a checkpoint except its segment are removed once the next one is complete
+struct BundlerCheckpoint {
+	static const UINT64 s_magic = 0x54504b434c444e42ull;	//"BNDLCKPT"
+	static const unsigned int s_version = 1;
+
+	struct Segment {
+		unsigned int checkpoint;
+		unsigned int firstFrame;
+		unsigned int numFrames;
+	};
+	struct Manifest {
+		Manifest() {
+			checkpoint = 0;
+		}
+		//! first frame of the next segment
+		unsigned int getNumGlobalFrames() const {
+			return segments.empty() ? 0 : segments.back().firstFrame + segments.back().numFrames;
+		}
+
+		unsigned int			checkpoint;		//0: none
+		std::vector<Segment>	segments;
+	};
+
+	static std::string getManifestFile(const std::string& directory) { return directory + "checkpoint.bin"; }
+	static std::string getStateFile(const std::string& directory, unsigned int checkpoint) { return directory + "state." + std::to_string(checkpoint) + ".bin"; }
+	static std::string getGlobalImagesFile(const std::string& directory, unsigned int checkpoint) { return directory + "global." + std::to_string(checkpoint) + ".sift"; }
+	static std::string getCacheFile(const std::string& directory, const std::string& name, unsigned int checkpoint) { return directory + name + "." + std::to_string(checkpoint) + ".cache"; }
+
+	//! appends a '/' if necessary
+	static std::string getDirectory(const std::string& directory);
+
+	//! returns false if the directory has no complete checkpoint
+	static bool loadManifest(const std::string& directory, Manifest& manifest);
+
+	//! loads all frames of a cache checkpoint into the frames [firstFrame, ...) of the cache
+	static void loadCache(const std::string& filename, CUDACache* cache, unsigned int firstFrame);
+};
+
+//! writes checkpoints on a background thread; only the downloads (and the caller filling the buffers) stall the bundling thread
+class BundlerCheckpointWriter
+{
+public:
+	BundlerCheckpointWriter(const std::string& directory, CUDACacheCheckpoint::COMPRESSION_TYPE cacheCompression);
+	//! waits for a pending checkpoint
+	~BundlerCheckpointWriter();
+
+	const std::string& getDirectory() const { return m_directory; }
+	//! the last complete checkpoint (as of the last saveAsync / waitForSave)
+	const BundlerCheckpoint::Manifest& getManifest() const { return m_manifest; }
+	//! continues the checkpoints of a restored session
+	void setManifest(const BundlerCheckpoint::Manifest& manifest) {
+		waitForSave();
+		m_manifest = manifest;
+	}
+
+	//! starts the next checkpoint: globalImages holds the global sift images [getManifest().getNumGlobalFrames(), ...), the cache frames of the same range and
+	//! the local caches are downloaded now; both buffers are taken over (swapped). a previous checkpoint is finished first (and its error rethrown)
+	void saveAsync(CheckpointBuffer& globalImages, const CUDACache* globalCache, const CUDACache* localCache, const CUDACache* optLocalCache, CheckpointBuffer& state);
+
+	//! blocks until the pending checkpoint is complete; rethrows errors of the background thread
+	void waitForSave();
+
+	bool isSaving() const {
+		return m_thread.joinable();
+	}
+
+private:
+	void writeFunc();
+
+	std::string								m_directory;
+	CUDACacheCheckpoint::COMPRESSION_TYPE	m_cacheCompression;
+	BundlerCheckpoint::Manifest				m_manifest;		//last complete checkpoint
+	BundlerCheckpoint::Manifest				m_pending;		//checkpoint being written
+
+	CheckpointBuffer						m_globalImages;
+	CheckpointBuffer						m_state;
+	CUDACacheCheckpointWriter				m_globalCacheWriter;
+	CUDACacheCheckpointWriter				m_localCacheWriter;
+	CUDACacheCheckpointWriter				m_optLocalCacheWriter;
+
+	std::thread								m_thread;
+	std::exception_ptr						m_error;
+};
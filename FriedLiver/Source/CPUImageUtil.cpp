@@ -0,0 +1,940 @@
+#include "stdafx.h"
+
+#include "CPUImageUtil.h"
+#include "ThreadPool.h"
+#include "MappedSensorData.h"
+
+#include <limits>
+#include <vector>
+#include <random>
+
+#if defined(__AVX__) || defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+bool CPUImageUtil::s_bUseSIMD = true;
+const float CPUImageUtil::s_simdTolerance = 0.000001f;
+
+namespace {
+
+	const float minf = -std::numeric_limits<float>::infinity();
+
+	//rows per parallel task; keeps the (2r+1) input rows of a filter window in cache
+	const unsigned int TILE_HEIGHT = 8;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// vector helpers (AVX if the build enables it, SSE otherwise)
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX__) || defined(__AVX2__)
+	typedef __m256 vfloat;
+	const int VEC_WIDTH = 8;
+	inline vfloat vload(const float* p)					{ return _mm256_loadu_ps(p); }
+	inline void   vstore(float* p, vfloat a)			{ _mm256_storeu_ps(p, a); }
+	inline vfloat vset(float f)							{ return _mm256_set1_ps(f); }
+	inline vfloat vadd(vfloat a, vfloat b)				{ return _mm256_add_ps(a, b); }
+	inline vfloat vsub(vfloat a, vfloat b)				{ return _mm256_sub_ps(a, b); }
+	inline vfloat vmul(vfloat a, vfloat b)				{ return _mm256_mul_ps(a, b); }
+	inline vfloat vdiv(vfloat a, vfloat b)				{ return _mm256_div_ps(a, b); }
+	inline vfloat vsqrt(vfloat a)						{ return _mm256_sqrt_ps(a); }
+	inline vfloat vand(vfloat a, vfloat b)				{ return _mm256_and_ps(a, b); }
+	inline vfloat vor(vfloat a, vfloat b)				{ return _mm256_or_ps(a, b); }
+	inline vfloat vabs(vfloat a)						{ return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	inline vfloat vcmpeq(vfloat a, vfloat b)			{ return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+	inline vfloat vcmpneq(vfloat a, vfloat b)			{ return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+	inline vfloat vcmplt(vfloat a, vfloat b)			{ return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	inline vfloat vcmpgt(vfloat a, vfloat b)			{ return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	inline vfloat vcmpge(vfloat a, vfloat b)			{ return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	//! mask ? a : b
+	inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm256_blendv_ps(b, a, mask); }
+#else
+	typedef __m128 vfloat;
+	const int VEC_WIDTH = 4;
+	inline vfloat vload(const float* p)					{ return _mm_loadu_ps(p); }
+	inline void   vstore(float* p, vfloat a)			{ _mm_storeu_ps(p, a); }
+	inline vfloat vset(float f)							{ return _mm_set1_ps(f); }
+	inline vfloat vadd(vfloat a, vfloat b)				{ return _mm_add_ps(a, b); }
+	inline vfloat vsub(vfloat a, vfloat b)				{ return _mm_sub_ps(a, b); }
+	inline vfloat vmul(vfloat a, vfloat b)				{ return _mm_mul_ps(a, b); }
+	inline vfloat vdiv(vfloat a, vfloat b)				{ return _mm_div_ps(a, b); }
+	inline vfloat vsqrt(vfloat a)						{ return _mm_sqrt_ps(a); }
+	inline vfloat vand(vfloat a, vfloat b)				{ return _mm_and_ps(a, b); }
+	inline vfloat vor(vfloat a, vfloat b)				{ return _mm_or_ps(a, b); }
+	inline vfloat vabs(vfloat a)						{ return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	inline vfloat vcmpeq(vfloat a, vfloat b)			{ return _mm_cmpeq_ps(a, b); }
+	inline vfloat vcmpneq(vfloat a, vfloat b)			{ return _mm_cmpneq_ps(a, b); }
+	inline vfloat vcmplt(vfloat a, vfloat b)			{ return _mm_cmplt_ps(a, b); }
+	inline vfloat vcmpgt(vfloat a, vfloat b)			{ return _mm_cmpgt_ps(a, b); }
+	inline vfloat vcmpge(vfloat a, vfloat b)			{ return _mm_cmpge_ps(a, b); }
+	inline vfloat vselect(vfloat mask, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+#endif
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// tiling
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	//! calls pixel(x, y) for every pixel; in rows/columns at least 'border' pixels away from the image boundary runs of VEC_WIDTH pixels go to vec(x, y) instead
+	template<typename PixelFunc, typename VecFunc>
+	void forEachPixel(unsigned int width, unsigned int height, unsigned int border, bool bUseSIMD, PixelFunc pixel, VecFunc vec)
+	{
+		const unsigned int numTiles = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+		ThreadPool::get().parallelFor(0, numTiles, [&](unsigned int tile) {
+			const unsigned int yEnd = std::min(height, (tile + 1) * TILE_HEIGHT);
+			for (unsigned int y = tile * TILE_HEIGHT; y < yEnd; y++) {
+				unsigned int x = 0;
+				if (bUseSIMD && y >= border && y + border < height && width >= 2 * border + VEC_WIDTH) {
+					for (; x < border; x++) pixel(x, y);
+					for (; x + VEC_WIDTH + border <= width; x += VEC_WIDTH) vec(x, y);
+				}
+				for (; x < width; x++) pixel(x, y);
+			}
+		});
+	}
+
+	template<typename PixelFunc>
+	void forEachPixel(unsigned int width, unsigned int height, PixelFunc pixel)
+	{
+		const unsigned int numTiles = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+		ThreadPool::get().parallelFor(0, numTiles, [&](unsigned int tile) {
+			const unsigned int yEnd = std::min(height, (tile + 1) * TILE_HEIGHT);
+			for (unsigned int y = tile * TILE_HEIGHT; y < yEnd; y++) {
+				for (unsigned int x = 0; x < width; x++) pixel(x, y);
+			}
+		});
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// shared helpers (same formulas as CUDAImageUtil.cu)
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	inline float gaussD(float sigma, int x, int y)
+	{
+		return std::exp(-((float)(x*x + y*y) / (2.0f*sigma*sigma)));
+	}
+	inline float gaussR(float sigma, float dist)
+	{
+		return (float)std::exp(-(dist*dist) / (2.0*sigma*sigma));
+	}
+
+	inline float convertToIntensity(const uchar4& c) {
+		return (0.299f*c.x + 0.587f*c.y + 0.114f*c.z) / 255.0f;
+	}
+
+	//! spatial weights of a (2r+1)x(2r+1) window, indexed [(dx + r)*(2r+1) + (dy + r)] (the summation order of the CUDA kernels)
+	void computeSpatialWeights(float sigmaD, int kernelRadius, std::vector<float>& weights)
+	{
+		const int size = 2 * kernelRadius + 1;
+		weights.resize(size*size);
+		for (int dx = -kernelRadius; dx <= kernelRadius; dx++) {
+			for (int dy = -kernelRadius; dy <= kernelRadius; dy++) {
+				weights[(dx + kernelRadius)*size + (dy + kernelRadius)] = gaussD(sigmaD, dx, dy);
+			}
+		}
+	}
+
+	//! nearest neighbor source index per output column/row (as in the CUDA resample kernels)
+	void computeResampleIndices(unsigned int outputSize, unsigned int inputSize, std::vector<unsigned int>& indices)
+	{
+		const float scale = (float)(inputSize - 1) / (float)(outputSize - 1);
+		indices.resize(outputSize);
+		for (unsigned int i = 0; i < outputSize; i++) indices[i] = (unsigned int)(i*scale + 0.5f);
+	}
+
+	template<class T, class F>
+	void resample(T* output, unsigned int outputWidth, unsigned int outputHeight, const typename F::Input* input, unsigned int inputWidth, unsigned int inputHeight, F convert)
+	{
+		std::vector<unsigned int> xInput, yInput;
+		computeResampleIndices(outputWidth, inputWidth, xInput);
+		computeResampleIndices(outputHeight, inputHeight, yInput);
+		forEachPixel(outputWidth, outputHeight, [&](unsigned int x, unsigned int y) {
+			if (xInput[x] < inputWidth && yInput[y] < inputHeight) {
+				output[y*outputWidth + x] = convert(input[yInput[y] * inputWidth + xInput[x]]);
+			}
+		});
+	}
+
+	template<class T>
+	struct Identity {
+		typedef T Input;
+		T operator()(const T& v) const { return v; }
+	};
+	struct ToIntensity {
+		typedef uchar4 Input;
+		float operator()(const uchar4& c) const { return convertToIntensity(c); }
+	};
+
+	//! 3x3 sobel on a float image; false if any of the 8 neighbors is invalid (x, y must be inner pixels)
+	inline bool sobel(const float* input, unsigned int width, unsigned int x, unsigned int y, float& resU, float& resV)
+	{
+		const float pos00 = input[(y - 1)*width + (x - 1)]; if (pos00 == minf) return false;
+		const float pos01 = input[(y - 0)*width + (x - 1)]; if (pos01 == minf) return false;
+		const float pos02 = input[(y + 1)*width + (x - 1)]; if (pos02 == minf) return false;
+		const float pos10 = input[(y - 1)*width + (x - 0)]; if (pos10 == minf) return false;
+		const float pos12 = input[(y + 1)*width + (x - 0)]; if (pos12 == minf) return false;
+		const float pos20 = input[(y - 1)*width + (x + 1)]; if (pos20 == minf) return false;
+		const float pos21 = input[(y - 0)*width + (x + 1)]; if (pos21 == minf) return false;
+		const float pos22 = input[(y + 1)*width + (x + 1)]; if (pos22 == minf) return false;
+
+		resU = (-1.0f)*pos00 + (1.0f)*pos20 +
+			(-2.0f)*pos01 + (2.0f)*pos21 +
+			(-1.0f)*pos02 + (1.0f)*pos22;
+		resV = (-1.0f)*pos00 + (-2.0f)*pos10 + (-1.0f)*pos20 +
+			(1.0f)*pos02 + (2.0f)*pos12 + (1.0f)*pos22;
+		return true;
+	}
+
+	//! vectorized sobel for VEC_WIDTH inner pixels starting at x; returns the mask of pixels with a valid neighborhood
+	inline vfloat sobel(const float* input, unsigned int width, unsigned int x, unsigned int y, vfloat& resU, vfloat& resV)
+	{
+		const vfloat vminf = vset(minf);
+		const float* r0 = input + (y - 1)*width + x;
+		const float* r1 = input + y*width + x;
+		const float* r2 = input + (y + 1)*width + x;
+		const vfloat pos00 = vload(r0 - 1), pos10 = vload(r0), pos20 = vload(r0 + 1);
+		const vfloat pos01 = vload(r1 - 1), pos21 = vload(r1 + 1);
+		const vfloat pos02 = vload(r2 - 1), pos12 = vload(r2), pos22 = vload(r2 + 1);
+
+		vfloat valid = vand(vcmpneq(pos00, vminf), vcmpneq(pos01, vminf));
+		valid = vand(valid, vand(vcmpneq(pos02, vminf), vcmpneq(pos10, vminf)));
+		valid = vand(valid, vand(vcmpneq(pos12, vminf), vcmpneq(pos20, vminf)));
+		valid = vand(valid, vand(vcmpneq(pos21, vminf), vcmpneq(pos22, vminf)));
+
+		const vfloat two = vset(2.0f);
+		resU = vadd(vadd(vadd(vadd(vsub(pos20, pos00), vmul(vset(-2.0f), pos01)), vmul(two, pos21)), vmul(vset(-1.0f), pos02)), pos22);
+		resV = vadd(vadd(vadd(vadd(vadd(vmul(vset(-1.0f), pos00), vmul(vset(-2.0f), pos10)), vmul(vset(-1.0f), pos20)), pos02), vmul(two, pos12)), pos22);
+		return valid;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Resample / Color to Intensity
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::resampleFloat(float* output, unsigned int outputWidth, unsigned int outputHeight, const float* input, unsigned int inputWidth, unsigned int inputHeight)
+{
+	resample(output, outputWidth, outputHeight, input, inputWidth, inputHeight, Identity<float>());
+}
+
+void CPUImageUtil::resampleFloat4(float4* output, unsigned int outputWidth, unsigned int outputHeight, const float4* input, unsigned int inputWidth, unsigned int inputHeight)
+{
+	resample(output, outputWidth, outputHeight, input, inputWidth, inputHeight, Identity<float4>());
+}
+
+void CPUImageUtil::resampleUCHAR4(uchar4* output, unsigned int outputWidth, unsigned int outputHeight, const uchar4* input, unsigned int inputWidth, unsigned int inputHeight)
+{
+	resample(output, outputWidth, outputHeight, input, inputWidth, inputHeight, Identity<uchar4>());
+}
+
+void CPUImageUtil::resampleToIntensity(float* output, unsigned int outputWidth, unsigned int outputHeight, const uchar4* input, unsigned int inputWidth, unsigned int inputHeight)
+{
+	resample(output, outputWidth, outputHeight, input, inputWidth, inputHeight, ToIntensity());
+}
+
+void CPUImageUtil::convertUCHAR4ToIntensityFloat(float* output, const uchar4* input, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		output[y*width + x] = convertToIntensity(input[y*width + x]);
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// derivatives
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::computeIntensityDerivatives(float2* output, const float* input, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, 1, s_bUseSIMD, [&](unsigned int x, unsigned int y) {
+		float resU, resV;
+		if (x > 0 && x < width - 1 && y > 0 && y < height - 1 && sobel(input, width, x, y, resU, resV)) {
+			output[y*width + x] = make_float2(resU / 8.0f, resV / 8.0f);
+		}
+		else {
+			output[y*width + x] = make_float2(minf, minf);
+		}
+	}, [&](unsigned int x, unsigned int y) {
+		vfloat resU, resV;
+		const vfloat valid = sobel(input, width, x, y, resU, resV);
+		const vfloat eighth = vset(8.0f), vminf = vset(minf);
+		float u[VEC_WIDTH], v[VEC_WIDTH];
+		vstore(u, vselect(valid, vdiv(resU, eighth), vminf));
+		vstore(v, vselect(valid, vdiv(resV, eighth), vminf));
+		float2* out = output + y*width + x;
+		for (int i = 0; i < VEC_WIDTH; i++) out[i] = make_float2(u[i], v[i]);
+	});
+}
+
+void CPUImageUtil::computeIntensityGradientMagnitude(float* output, const float* input, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, 1, s_bUseSIMD, [&](unsigned int x, unsigned int y) {
+		float resU, resV;
+		if (x > 0 && x < width - 1 && y > 0 && y < height - 1 && sobel(input, width, x, y, resU, resV)) {
+			output[y*width + x] = std::sqrt(resU * resU + resV * resV);
+		}
+		else {
+			output[y*width + x] = minf;
+		}
+	}, [&](unsigned int x, unsigned int y) {
+		vfloat resU, resV;
+		const vfloat valid = sobel(input, width, x, y, resU, resV);
+		vstore(output + y*width + x, vselect(valid, vsqrt(vadd(vmul(resU, resU), vmul(resV, resV))), vset(minf)));
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Convert Depth to Camera Space Positions / Normals
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::convertDepthFloatToCameraSpaceFloat4(float4* output, const float* input, const float4x4& intrinsicsInv, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		const float depth = input[y*width + x];
+		if (depth != minf) {
+			const float4 cameraSpace(intrinsicsInv*make_float4((float)x*depth, (float)y*depth, depth, depth));
+			output[y*width + x] = make_float4(cameraSpace.x, cameraSpace.y, cameraSpace.w, 1.0f);
+		}
+		else {
+			output[y*width + x] = make_float4(minf, minf, minf, minf);
+		}
+	});
+}
+
+void CPUImageUtil::computeNormals(float4* output, const float4* input, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		output[y*width + x] = make_float4(minf, minf, minf, minf);
+		if (x > 0 && x < width - 1 && y > 0 && y < height - 1) {
+			const float4 CC = input[(y + 0)*width + (x + 0)];
+			const float4 PC = input[(y + 1)*width + (x + 0)];
+			const float4 CP = input[(y + 0)*width + (x + 1)];
+			const float4 MC = input[(y - 1)*width + (x + 0)];
+			const float4 CM = input[(y + 0)*width + (x - 1)];
+
+			if (CC.x != minf && PC.x != minf && CP.x != minf && MC.x != minf && CM.x != minf) {
+				const float3 n = cross(make_float3(PC) - make_float3(MC), make_float3(CP) - make_float3(CM));
+				const float  l = length(n);
+				if (l > 0.0f) output[y*width + x] = make_float4(n / -l, 0.0f);
+			}
+		}
+	});
+}
+
+void CPUImageUtil::computeNormalsSobel(float4* output, const float4* input, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		output[y*width + x] = make_float4(minf, minf, minf, minf);
+		if (x > 0 && x < width - 1 && y > 0 && y < height - 1) {
+			const float4 pos00 = input[(y - 1)*width + (x - 1)]; if (pos00.x == minf) return;
+			const float4 pos01 = input[(y - 0)*width + (x - 1)]; if (pos01.x == minf) return;
+			const float4 pos02 = input[(y + 1)*width + (x - 1)]; if (pos02.x == minf) return;
+			const float4 pos10 = input[(y - 1)*width + (x - 0)]; if (pos10.x == minf) return;
+			const float4 pos12 = input[(y + 1)*width + (x - 0)]; if (pos12.x == minf) return;
+			const float4 pos20 = input[(y - 1)*width + (x + 1)]; if (pos20.x == minf) return;
+			const float4 pos21 = input[(y - 0)*width + (x + 1)]; if (pos21.x == minf) return;
+			const float4 pos22 = input[(y + 1)*width + (x + 1)]; if (pos22.x == minf) return;
+
+			const float4 resU = (-1.0f)*pos00 + (1.0f)*pos20 +
+				(-2.0f)*pos01 + (2.0f)*pos21 +
+				(-1.0f)*pos02 + (1.0f)*pos22;
+			const float4 resV = (-1.0f)*pos00 + (-2.0f)*pos10 + (-1.0f)*pos20 +
+				(1.0f)*pos02 + (2.0f)*pos12 + (1.0f)*pos22;
+
+			const float3 n = cross(make_float3(resU.x, resU.y, resU.z), make_float3(resV.x, resV.y, resV.z));
+			const float  l = length(n);
+			if (l > 0.0f) output[y*width + x] = make_float4(n / l, 0.0f);
+		}
+	});
+}
+
+void CPUImageUtil::convertNormalsFloat4ToUCHAR4(uchar4* output, const float4* input, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		output[y*width + x] = make_uchar4(0, 0, 0, 0);
+		float4 p = input[y*width + x];
+		if (p.x != minf) {
+			p = (p + 1.0f) / 2.0f; // -> [0, 1]
+			output[y*width + x] = make_uchar4((uchar)round(p.x * 255), (uchar)round(p.y * 255), (uchar)round(p.z * 255), 0);
+		}
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Joint Bilateral Filter
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::jointBilateralFilterColorUCHAR4(uchar4* output, uchar4* input, float* depth, float sigmaD, float sigmaR, unsigned int width, unsigned int height)
+{
+	const int kernelRadius = (int)ceil(2.0*sigmaD);
+	std::vector<float> weights;
+	computeSpatialWeights(sigmaD, kernelRadius, weights);
+	const int size = 2 * kernelRadius + 1;
+
+	forEachPixel(width, height, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		output[y*width + x] = input[y*width + x];
+
+		const float depthCenter = depth[y*width + x];
+		if (depthCenter == minf) return;
+
+		float3 sum = make_float3(0.0f, 0.0f, 0.0f);
+		float sumWeight = 0.0f;
+		for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+			for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+				const uchar4 cur = input[n*width + m];
+				const float currentDepth = depth[n*width + m];
+				if (currentDepth != minf) {
+					const float weight = weights[(m - x + kernelRadius)*size + (n - y + kernelRadius)] * gaussR(sigmaR, currentDepth - depthCenter);
+					sumWeight += weight;
+					sum += weight*make_float3(cur.x, cur.y, cur.z);
+				}
+			}
+		}
+		if (sumWeight > 0.0f) {
+			const float3 res = sum / sumWeight;
+			output[y*width + x] = make_uchar4((uchar)res.x, (uchar)res.y, (uchar)res.z, 255);
+		}
+	});
+}
+
+void CPUImageUtil::jointBilateralFilterFloat(float* output, float* input, float* depth, float sigmaD, float sigmaR, unsigned int width, unsigned int height)
+{
+	const int kernelRadius = (int)ceil(2.0*sigmaD);
+	std::vector<float> weights;
+	computeSpatialWeights(sigmaD, kernelRadius, weights);
+	const int size = 2 * kernelRadius + 1;
+
+	forEachPixel(width, height, kernelRadius, s_bUseSIMD, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		const float depthCenter = depth[y*width + x];
+		float sum = 0.0f;
+		float sumWeight = 0.0f;
+		if (depthCenter != minf) {
+			for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+				for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+					const float currentDepth = depth[n*width + m];
+					if (currentDepth != minf && fabs(depthCenter - currentDepth) < sigmaR) {
+						const float weight = weights[(m - x + kernelRadius)*size + (n - y + kernelRadius)];
+						sumWeight += weight;
+						sum += weight*input[n*width + m];
+					}
+				}
+			}
+		}
+		output[y*width + x] = sumWeight > 0.0f ? sum / sumWeight : minf;
+	}, [&](unsigned int x, unsigned int y) {
+		const vfloat vminf = vset(minf), vSigmaR = vset(sigmaR), zero = vset(0.0f);
+		const vfloat depthCenter = vload(depth + y*width + x);
+		vfloat sum = zero, sumWeight = zero;
+		for (int dx = -kernelRadius; dx <= kernelRadius; dx++) {
+			const float* w = weights.data() + (dx + kernelRadius)*size;
+			for (int dy = -kernelRadius; dy <= kernelRadius; dy++) {
+				const size_t idx = (y + dy)*width + x + dx;
+				const vfloat currentDepth = vload(depth + idx);
+				const vfloat mask = vand(vcmpneq(currentDepth, vminf), vcmplt(vabs(vsub(depthCenter, currentDepth)), vSigmaR));
+				const vfloat weight = vset(w[dy + kernelRadius]);
+				sumWeight = vadd(sumWeight, vand(mask, weight));
+				sum = vadd(sum, vand(mask, vmul(weight, vload(input + idx))));
+			}
+		}
+		const vfloat valid = vand(vcmpneq(depthCenter, vminf), vcmpgt(sumWeight, zero));
+		vstore(output + y*width + x, vselect(valid, vdiv(sum, sumWeight), vminf));
+	});
+}
+
+void CPUImageUtil::adaptiveBilateralFilterIntensity(float* output, const float* input, const float* depth, float sigmaD, float sigmaR, float adaptFactor, unsigned int width, unsigned int height)
+{
+	//per pixel kernel size: scalar
+	forEachPixel(width, height, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		output[y*width + x] = minf;
+
+		const float depthCenter = depth[y*width + x];
+		if (depthCenter == minf) return;
+
+		const float curSigma = sigmaD * adaptFactor / depthCenter;
+		const int kernelRadius = (int)ceil(2.0*curSigma);
+		float sum = 0.0f;
+		float sumWeight = 0.0f;
+		for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+			for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+				const float currentDepth = depth[n*width + m];
+				if (currentDepth != minf && fabs(depthCenter - currentDepth) < sigmaR) {
+					const float weight = gaussD(curSigma, m - x, n - y);
+					sumWeight += weight;
+					sum += weight*input[n*width + m];
+				}
+			}
+		}
+		if (sumWeight > 0.0f) output[y*width + x] = sum / sumWeight;
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Erode Depth Map
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::erodeDepthMap(float* output, float* input, int structureSize, unsigned int width, unsigned int height, float dThresh, float fracReq)
+{
+	const unsigned int sum = (2 * structureSize + 1)*(2 * structureSize + 1);
+
+	forEachPixel(width, height, structureSize, s_bUseSIMD, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		unsigned int count = 0;
+		const float oldDepth = input[y*width + x];
+		for (int i = -structureSize; i <= structureSize; i++) {
+			for (int j = -structureSize; j <= structureSize; j++) {
+				if (x + j >= 0 && x + j < (int)width && y + i >= 0 && y + i < (int)height) {
+					const float depth = input[(y + i)*width + (x + j)];
+					if (depth == minf || depth == 0.0f || fabs(depth - oldDepth) > dThresh) count++;
+				}
+			}
+		}
+		output[y*width + x] = ((float)count / (float)sum >= fracReq) ? minf : oldDepth;
+	}, [&](unsigned int x, unsigned int y) {
+		const vfloat vminf = vset(minf), zero = vset(0.0f), one = vset(1.0f), vThresh = vset(dThresh);
+		const vfloat oldDepth = vload(input + y*width + x);
+		vfloat count = zero;
+		for (int i = -structureSize; i <= structureSize; i++) {
+			const float* row = input + (y + i)*width + x;
+			for (int j = -structureSize; j <= structureSize; j++) {
+				const vfloat depth = vload(row + j);
+				const vfloat invalid = vor(vor(vcmpeq(depth, vminf), vcmpeq(depth, zero)), vcmpgt(vabs(vsub(depth, oldDepth)), vThresh));
+				count = vadd(count, vand(invalid, one));
+			}
+		}
+		const vfloat eroded = vcmpge(vdiv(count, vset((float)sum)), vset(fracReq));
+		vstore(output + y*width + x, vselect(eroded, vminf, oldDepth));
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Gauss Filter Float Map
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::gaussFilterDepthMap(float* output, const float* input, float sigmaD, float sigmaR, unsigned int width, unsigned int height)
+{
+	const int kernelRadius = (int)ceil(2.0*sigmaD);
+	std::vector<float> weights;
+	computeSpatialWeights(sigmaD, kernelRadius, weights);
+	const int size = 2 * kernelRadius + 1;
+
+	forEachPixel(width, height, kernelRadius, s_bUseSIMD, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		const float depthCenter = input[y*width + x];
+		float sum = 0.0f;
+		float sumWeight = 0.0f;
+		if (depthCenter != minf) {
+			for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+				for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+					const float currentDepth = input[n*width + m];
+					if (currentDepth != minf && fabs(depthCenter - currentDepth) < sigmaR) {
+						const float weight = weights[(m - x + kernelRadius)*size + (n - y + kernelRadius)];
+						sumWeight += weight;
+						sum += weight*currentDepth;
+					}
+				}
+			}
+		}
+		output[y*width + x] = sumWeight > 0.0f ? sum / sumWeight : minf;
+	}, [&](unsigned int x, unsigned int y) {
+		const vfloat vminf = vset(minf), vSigmaR = vset(sigmaR), zero = vset(0.0f);
+		const vfloat depthCenter = vload(input + y*width + x);
+		vfloat sum = zero, sumWeight = zero;
+		for (int dx = -kernelRadius; dx <= kernelRadius; dx++) {
+			const float* w = weights.data() + (dx + kernelRadius)*size;
+			for (int dy = -kernelRadius; dy <= kernelRadius; dy++) {
+				const vfloat currentDepth = vload(input + (y + dy)*width + x + dx);
+				const vfloat mask = vand(vcmpneq(currentDepth, vminf), vcmplt(vabs(vsub(depthCenter, currentDepth)), vSigmaR));
+				const vfloat weight = vset(w[dy + kernelRadius]);
+				sumWeight = vadd(sumWeight, vand(mask, weight));
+				sum = vadd(sum, vand(mask, vmul(weight, currentDepth)));
+			}
+		}
+		const vfloat valid = vand(vcmpneq(depthCenter, vminf), vcmpgt(sumWeight, zero));
+		vstore(output + y*width + x, vselect(valid, vdiv(sum, sumWeight), vminf));
+	});
+}
+
+void CPUImageUtil::gaussFilterIntensity(float* output, const float* input, float sigmaD, unsigned int width, unsigned int height)
+{
+	const int kernelRadius = (int)ceil(2.0*sigmaD);
+	std::vector<float> weights;
+	computeSpatialWeights(sigmaD, kernelRadius, weights);
+	const int size = 2 * kernelRadius + 1;
+
+	forEachPixel(width, height, kernelRadius, s_bUseSIMD, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		float sum = 0.0f;
+		float sumWeight = 0.0f;
+		for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+			for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+				const float weight = weights[(m - x + kernelRadius)*size + (n - y + kernelRadius)];
+				sumWeight += weight;
+				sum += weight*input[n*width + m];
+			}
+		}
+		if (sumWeight > 0.0f) output[y*width + x] = sum / sumWeight;
+	}, [&](unsigned int x, unsigned int y) {
+		vfloat sum = vset(0.0f), sumWeight = vset(0.0f);
+		for (int dx = -kernelRadius; dx <= kernelRadius; dx++) {
+			const float* w = weights.data() + (dx + kernelRadius)*size;
+			for (int dy = -kernelRadius; dy <= kernelRadius; dy++) {
+				const vfloat weight = vset(w[dy + kernelRadius]);
+				sumWeight = vadd(sumWeight, weight);
+				sum = vadd(sum, vmul(weight, vload(input + (y + dy)*width + x + dx)));
+			}
+		}
+		vstore(output + y*width + x, vdiv(sum, sumWeight));
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bilateral Grid Filter Float Map (same grid layout as CUDAImageUtil::bilateralGridFilterDepthMap)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+const int bilateralGridPad = 2;
+
+int3 getBilateralGridDims(unsigned int width, unsigned int height, float sigmaD, float sigmaR, float maxDepth)
+{
+	return make_int3((int)((width - 1) / sigmaD) + 1 + 2 * bilateralGridPad, (int)((height - 1) / sigmaD) + 1 + 2 * bilateralGridPad, (int)(maxDepth / sigmaR) + 1 + 2 * bilateralGridPad);
+}
+
+//! [1 4 6 4 1]/16 along x, y, z; result in gridHelper; Cell: float2 (depth, weight) or float4 (color, weight)
+template<class Cell>
+void blurBilateralGrid(std::vector<Cell>& grid, std::vector<Cell>& gridHelper, const int3& dims)
+{
+	const float weights[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+	auto blur = [&](std::vector<Cell>& dst, const std::vector<Cell>& src, int ax, int ay, int az) {
+		ThreadPool::get().parallelFor(0, dims.z, [&](unsigned int z) {
+			for (int y = 0; y < dims.y; y++) {
+				for (int x = 0; x < dims.x; x++) {
+					Cell sum = Cell();
+					for (int i = -2; i <= 2; i++) {
+						const int px = x + i*ax, py = y + i*ay, pz = (int)z + i*az;
+						if (px >= 0 && py >= 0 && pz >= 0 && px < dims.x && py < dims.y && pz < dims.z) {
+							sum += weights[i + 2] * src[(pz*dims.y + py)*dims.x + px];
+						}
+					}
+					dst[(z*dims.y + y)*dims.x + x] = sum;
+				}
+			}
+		});
+	};
+	blur(gridHelper, grid, 1, 0, 0);
+	blur(grid, gridHelper, 0, 1, 0);
+	blur(gridHelper, grid, 0, 0, 1);
+}
+
+} // namespace
+
+void CPUImageUtil::bilateralGridFilterDepthMap(float* output, const float* input, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height)
+{
+	const int pad = bilateralGridPad;
+	const int3 dims = getBilateralGridDims(width, height, sigmaD, sigmaR, maxDepth);
+	const int dimX = dims.x, dimY = dims.y;
+	std::vector<float2> grid(dims.x*dims.y*dims.z, make_float2(0.0f, 0.0f)), gridHelper(grid.size());
+
+	//splat (nearest cell)
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			const float depth = input[y*width + x];
+			if (depth == minf || depth > maxDepth) continue;
+			const int gx = (int)(x / sigmaD + 0.5f) + pad;
+			const int gy = (int)(y / sigmaD + 0.5f) + pad;
+			const int gz = (int)(depth / sigmaR + 0.5f) + pad;
+			float2& cell = grid[(gz*dimY + gy)*dimX + gx];
+			cell.x += depth;
+			cell.y += 1.0f;
+		}
+	}
+
+	blurBilateralGrid(grid, gridHelper, dims);
+
+	//slice (trilinear)
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		const float depth = input[y*width + x];
+		if (depth == minf || depth > maxDepth) {
+			output[y*width + x] = depth;
+			return;
+		}
+		const float fx = x / sigmaD + pad, fy = y / sigmaD + pad, fz = depth / sigmaR + pad;
+		const int x0 = (int)fx, y0 = (int)fy, z0 = (int)fz;
+		const float ax = fx - x0, ay = fy - y0, az = fz - z0;
+		float sum = 0.0f, sumWeight = 0.0f;
+		for (int k = 0; k < 8; k++) {
+			const int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+			const float w = (dx ? ax : 1.0f - ax) * (dy ? ay : 1.0f - ay) * (dz ? az : 1.0f - az);
+			const float2& v = gridHelper[((z0 + dz)*dimY + (y0 + dy))*dimX + (x0 + dx)];
+			sum += w * v.x;
+			sumWeight += w * v.y;
+		}
+		output[y*width + x] = sumWeight > 0.0f ? sum / sumWeight : minf;
+	});
+}
+
+void CPUImageUtil::bilateralGridFilterColorUCHAR4(uchar4* output, const uchar4* input, const float* depth, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height)
+{
+	const int pad = bilateralGridPad;
+	const int3 dims = getBilateralGridDims(width, height, sigmaD, sigmaR, maxDepth);
+	std::vector<float4> grid(dims.x*dims.y*dims.z, make_float4(0.0f, 0.0f, 0.0f, 0.0f)), gridHelper(grid.size());
+
+	//splat (nearest cell)
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			const float d = depth[y*width + x];
+			if (d == minf || d > maxDepth) continue;
+			const int gx = (int)(x / sigmaD + 0.5f) + pad;
+			const int gy = (int)(y / sigmaD + 0.5f) + pad;
+			const int gz = (int)(d / sigmaR + 0.5f) + pad;
+			const uchar4 color = input[y*width + x];
+			grid[(gz*dims.y + gy)*dims.x + gx] += make_float4(color.x, color.y, color.z, 1.0f);
+		}
+	}
+
+	blurBilateralGrid(grid, gridHelper, dims);
+
+	//slice (trilinear)
+	forEachPixel(width, height, [&](unsigned int x, unsigned int y) {
+		output[y*width + x] = input[y*width + x];
+		const float d = depth[y*width + x];
+		if (d == minf || d > maxDepth) return;
+		const float fx = x / sigmaD + pad, fy = y / sigmaD + pad, fz = d / sigmaR + pad;
+		const int x0 = (int)fx, y0 = (int)fy, z0 = (int)fz;
+		const float ax = fx - x0, ay = fy - y0, az = fz - z0;
+		float4 res = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+		for (int k = 0; k < 8; k++) {
+			const int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+			const float w = (dx ? ax : 1.0f - ax) * (dy ? ay : 1.0f - ay) * (dz ? az : 1.0f - az);
+			res += w * gridHelper[((z0 + dz)*dims.y + (y0 + dy))*dims.x + (x0 + dx)];
+		}
+		if (res.w > 0.0f) output[y*width + x] = make_uchar4((uchar)(res.x / res.w), (uchar)(res.y / res.w), (uchar)(res.z / res.w), 255);
+	});
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// adaptive gauss filter float map (per pixel kernel size: scalar)
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void CPUImageUtil::adaptiveGaussFilterDepthMap(float* output, const float* input, float sigmaD, float sigmaR, float adaptFactor, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		output[y*width + x] = minf;
+
+		const float depthCenter = input[y*width + x];
+		if (depthCenter == minf) return;
+
+		const float curSigma = sigmaD / depthCenter * adaptFactor;
+		const int kernelRadius = (int)ceil(2.0*curSigma);
+		float sum = 0.0f;
+		float sumWeight = 0.0f;
+		for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+			for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+				const float currentDepth = input[n*width + m];
+				if (currentDepth != minf && fabs(depthCenter - currentDepth) < sigmaR) {
+					const float weight = gaussD(curSigma, m - x, n - y);
+					sumWeight += weight;
+					sum += weight*currentDepth;
+				}
+			}
+		}
+		if (sumWeight > 0.0f) output[y*width + x] = sum / sumWeight;
+	});
+}
+
+void CPUImageUtil::adaptiveGaussFilterIntensity(float* output, const float* input, const float* depth, float sigmaD, float adaptFactor, unsigned int width, unsigned int height)
+{
+	forEachPixel(width, height, [&](unsigned int ux, unsigned int uy) {
+		const int x = (int)ux, y = (int)uy;
+		output[y*width + x] = minf; //(should not be used in the case of no valid depth)
+
+		const float depthCenter = depth[y*width + x];
+		if (depthCenter == minf) return;
+
+		const float curSigma = sigmaD / depthCenter * adaptFactor;
+		const int kernelRadius = (int)ceil(2.0*curSigma);
+		float sum = 0.0f;
+		float sumWeight = 0.0f;
+		for (int m = std::max(x - kernelRadius, 0); m <= std::min(x + kernelRadius, (int)width - 1); m++) {
+			for (int n = std::max(y - kernelRadius, 0); n <= std::min(y + kernelRadius, (int)height - 1); n++) {
+				if (depth[n*width + m] != minf) {
+					const float weight = gaussD(curSigma, m - x, n - y);
+					sumWeight += weight;
+					sum += weight*input[n*width + m];
+				}
+			}
+		}
+		if (sumWeight > 0.0f) output[y*width + x] = sum / sumWeight;
+	});
+}
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SIMD test
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+bool CPUImageUtil::testSIMD(unsigned int numImages)
+{
+	const bool bUseSIMD = s_bUseSIMD;
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+	struct Result {
+		const char* name;
+		float maxDiff;
+		unsigned int numFailed;
+	};
+	Result results[] = { { "gaussFilterDepthMap", 0.0f, 0 }, { "gaussFilterIntensity", 0.0f, 0 }, { "jointBilateralFilterFloat", 0.0f, 0 },
+		{ "erodeDepthMap", 0.0f, 0 }, { "computeIntensityDerivatives", 0.0f, 0 }, { "computeIntensityGradientMagnitude", 0.0f, 0 } };
+	auto compare = [&](Result& r, const float* simd, const float* ref, size_t num) {
+		for (size_t i = 0; i < num; i++) {
+			if ((simd[i] == minf) != (ref[i] == minf)) { r.numFailed++; continue; }
+			if (ref[i] == minf) continue;
+			const float diff = std::abs(simd[i] - ref[i]) / std::max(std::abs(ref[i]), 1.0f);
+			r.maxDiff = std::max(r.maxDiff, diff);
+			if (!(diff <= s_simdTolerance)) r.numFailed++;
+		}
+	};
+
+	for (unsigned int img = 0; img < numImages; img++) {
+		//odd sizes so that every filter has scalar tails next to the vector runs
+		const unsigned int width = 61 + 13 * (img % 8), height = 37 + 7 * (img % 5);
+		const unsigned int numPixels = width * height;
+		const float sigmaD = 1.0f + (float)(img % 3), sigmaR = 0.05f;
+		const int structureSize = 1 + (int)(img % 3);
+
+		//depth: slanted planes with steps, noise, holes and zeros; intensity: random
+		std::vector<float> depth(numPixels), intensity(numPixels);
+		const float slope = 0.002f * (float)(img % 4);
+		for (unsigned int y = 0; y < height; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				const float u = uniform(rng);
+				float d = 1.0f + slope * x + ((x / 16 + y / 16) % 2) * 0.5f + 0.01f * uniform(rng);
+				if (u < 0.08f) d = minf;
+				else if (u < 0.1f) d = 0.0f;
+				depth[y*width + x] = d;
+				intensity[y*width + x] = uniform(rng);
+			}
+		}
+
+		std::vector<float> outSIMD(numPixels), outRef(numPixels);
+		std::vector<float2> derivSIMD(numPixels), derivRef(numPixels);
+		auto run = [&](std::vector<float>& out, std::vector<float2>& deriv, unsigned int filter) {
+			std::fill(out.begin(), out.end(), 0.0f);
+			switch (filter) {
+			case 0: gaussFilterDepthMap(out.data(), depth.data(), sigmaD, sigmaR, width, height); break;
+			case 1: gaussFilterIntensity(out.data(), intensity.data(), sigmaD, width, height); break;
+			case 2: jointBilateralFilterFloat(out.data(), intensity.data(), depth.data(), sigmaD, sigmaR, width, height); break;
+			case 3: erodeDepthMap(out.data(), depth.data(), structureSize, width, height, 0.05f, 0.3f); break;
+			case 4: computeIntensityDerivatives(deriv.data(), depth.data(), width, height); break;
+			case 5: computeIntensityGradientMagnitude(out.data(), depth.data(), width, height); break;
+			}
+		};
+		for (unsigned int f = 0; f < 6; f++) {
+			s_bUseSIMD = true;	run(outSIMD, derivSIMD, f);
+			s_bUseSIMD = false;	run(outRef, derivRef, f);
+			if (f == 4) compare(results[f], (const float*)derivSIMD.data(), (const float*)derivRef.data(), 2 * numPixels);
+			else compare(results[f], outSIMD.data(), outRef.data(), numPixels);
+		}
+	}
+	s_bUseSIMD = bUseSIMD;
+
+	bool bPassed = true;
+	std::cout << "SIMD test: " << numImages << " images, vector width " << VEC_WIDTH << ", tolerance " << s_simdTolerance << std::endl;
+	for (const Result& r : results) {
+		std::cout << "\t" << r.name << ": max diff " << r.maxDiff << (r.numFailed ? ", FAILED pixels: " + std::to_string(r.numFailed) : std::string(", ok")) << std::endl;
+		if (r.numFailed > 0) bPassed = false;
+	}
+	return bPassed;
+}
+
+void CPUImageUtil::benchmarkBilateralGrid(const std::string& filename, unsigned int maxNumFrames, float depthSigmaD, float depthSigmaR, float colorSigmaD, float colorSigmaR, float maxDepth)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	const unsigned int width = data.m_depthWidth, height = data.m_depthHeight;
+	const size_t numPixels = (size_t)width*height;
+	if (numFrames == 0) throw MLIB_EXCEPTION("no frames in " + filename);
+
+	std::cout << "bilateral grid accuracy: " << filename << " (" << numFrames << " frames " << width << "x" << height << "), depth sigmaR = " << depthSigmaR << ", color sigmaR = " << colorSigmaR << std::endl;
+
+	std::vector<unsigned short> depthU16(numPixels);
+	std::vector<vec3uc> colorRaw(data.m_colorWidth*data.m_colorHeight);
+	std::vector<uchar4> colorRGBA(colorRaw.size());
+	std::vector<std::vector<float>> depth(numFrames, std::vector<float>(numPixels));
+	std::vector<std::vector<uchar4>> color(numFrames, std::vector<uchar4>(numPixels));
+	for (unsigned int f = 0; f < numFrames; f++) {
+		data.decompressDepth(f, depthU16.data());
+		for (size_t i = 0; i < numPixels; i++) {
+			depth[f][i] = depthU16[i] == 0 ? minf : (float)depthU16[i] / data.m_depthShift;
+		}
+		data.decompressColor(f, colorRaw.data());
+		for (size_t i = 0; i < colorRaw.size(); i++) colorRGBA[i] = make_uchar4(colorRaw[i].x, colorRaw[i].y, colorRaw[i].z, 255);
+		resampleUCHAR4(color[f].data(), width, height, colorRGBA.data(), data.m_colorWidth, data.m_colorHeight);
+	}
+
+	Timer timer;
+	std::vector<float> exact(numPixels), approx(numPixels);
+	const float depthSigmas[] = { depthSigmaD, 2.0f * depthSigmaD, 4.0f * depthSigmaD };
+	for (float sigmaD : depthSigmas) {
+		double timeExact = 0.0, timeApprox = 0.0, sumErr = 0.0, sumErr2 = 0.0, maxErr = 0.0;
+		size_t numValid = 0, numMismatch = 0;
+		for (unsigned int f = 0; f < numFrames; f++) {
+			timer.start();
+			gaussFilterDepthMap(exact.data(), depth[f].data(), sigmaD, depthSigmaR, width, height);
+			timer.stop();
+			timeExact += timer.getElapsedTimeMS();
+			timer.start();
+			bilateralGridFilterDepthMap(approx.data(), depth[f].data(), sigmaD, depthSigmaR, maxDepth, width, height);
+			timer.stop();
+			timeApprox += timer.getElapsedTimeMS();
+
+			for (size_t i = 0; i < numPixels; i++) {
+				if (depth[f][i] > maxDepth) continue;	//not filtered by the grid
+				const bool bValidExact = exact[i] != minf;
+				const bool bValidApprox = approx[i] != minf;
+				if (bValidExact != bValidApprox) { numMismatch++; continue; }
+				if (!bValidExact) continue;
+				const double err = std::abs(exact[i] - approx[i]);
+				sumErr += err;	sumErr2 += err*err;	maxErr = std::max(maxErr, err);
+				numValid++;
+			}
+		}
+		std::cout << "\tdepth sigmaD " << sigmaD << ":\texact " << timeExact / numFrames << " ms\tgrid " << timeApprox / numFrames << " ms"
+			<< "\terror mean " << 1000.0 * sumErr / std::max(numValid, (size_t)1) << " mm, rms " << 1000.0 * std::sqrt(sumErr2 / std::max(numValid, (size_t)1)) << " mm, max " << 1000.0 * maxErr << " mm"
+			<< "\tvalidity mismatches " << numMismatch << std::endl;
+	}
+
+	std::vector<uchar4> exactColor(numPixels), approxColor(numPixels);
+	const float colorSigmas[] = { colorSigmaD, 2.0f * colorSigmaD, 4.0f * colorSigmaD };
+	for (float sigmaD : colorSigmas) {
+		double timeExact = 0.0, timeApprox = 0.0, sumErr = 0.0, sumErr2 = 0.0;
+		int maxErr = 0;
+		size_t numValid = 0;
+		for (unsigned int f = 0; f < numFrames; f++) {
+			timer.start();
+			jointBilateralFilterColorUCHAR4(exactColor.data(), color[f].data(), depth[f].data(), sigmaD, colorSigmaR, width, height);
+			timer.stop();
+			timeExact += timer.getElapsedTimeMS();
+			timer.start();
+			bilateralGridFilterColorUCHAR4(approxColor.data(), color[f].data(), depth[f].data(), sigmaD, colorSigmaR, maxDepth, width, height);
+			timer.stop();
+			timeApprox += timer.getElapsedTimeMS();
+
+			for (size_t i = 0; i < numPixels; i++) {
+				if (depth[f][i] == minf || depth[f][i] > maxDepth) continue;	//passed through by both
+				const int err[] = { std::abs((int)exactColor[i].x - approxColor[i].x), std::abs((int)exactColor[i].y - approxColor[i].y), std::abs((int)exactColor[i].z - approxColor[i].z) };
+				for (int e : err) {
+					sumErr += e;	sumErr2 += e*e;	maxErr = std::max(maxErr, e);
+				}
+				numValid += 3;
+			}
+		}
+		std::cout << "\tcolor sigmaD " << sigmaD << ":\texact " << timeExact / numFrames << " ms\tgrid " << timeApprox / numFrames << " ms"
+			<< "\terror mean " << sumErr / std::max(numValid, (size_t)1) << ", rms " << std::sqrt(sumErr2 / std::max(numValid, (size_t)1)) << ", max " << maxErr << " (of 255)" << std::endl;
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+#ifndef CPU_IMAGE_UTIL_H
+#define CPU_IMAGE_UTIL_H
+
+/************************************************************************/
+/* Host implementation of CUDAImageUtil (same signatures, host memory); */
+/* the fixed-size filters are vectorized (SSE, AVX if enabled) and all  */
+/* kernels run on row tiles in ThreadPool::get()                        */
+/************************************************************************/
+
+#include <cuda_runtime.h>
+#include "mLibCuda.h"
+
+class CPUImageUtil {
+public:
+	template<class T> static void copy(T* output, T* input, unsigned int width, unsigned int height) {
+		memcpy(output, input, sizeof(T)*width*height);
+	}
+	static void resampleToIntensity(float* output, unsigned int outputWidth, unsigned int outputHeight, const uchar4* input, unsigned int inputWidth, unsigned int inputHeight);
+
+	static void resampleFloat4(float4* output, unsigned int outputWidth, unsigned int outputHeight, const float4* input, unsigned int inputWidth, unsigned int inputHeight);
+	static void resampleFloat(float* output, unsigned int outputWidth, unsigned int outputHeight, const float* input, unsigned int inputWidth, unsigned int inputHeight);
+	static void resampleUCHAR4(uchar4* output, unsigned int outputWidth, unsigned int outputHeight, const uchar4* input, unsigned int inputWidth, unsigned int inputHeight);
+
+	static void convertDepthFloatToCameraSpaceFloat4(float4* output, const float* input, const float4x4& intrinsicsInv, unsigned int width, unsigned int height);
+	static void computeNormals(float4* output, const float4* input, unsigned int width, unsigned int height);
+
+	static void jointBilateralFilterColorUCHAR4(uchar4* output, uchar4* input, float* depth, float sigmaD, float sigmaR, unsigned int width, unsigned int height);
+
+	static void erodeDepthMap(float* output, float* input, int structureSize, unsigned int width, unsigned int height, float dThresh, float fracReq);
+
+	static void gaussFilterDepthMap(float* output, const float* input, float sigmaD, float sigmaR, unsigned int width, unsigned int height);
+	//! approximate bilateral filter via a bilateral grid; cost does not depend on sigmaD (see CUDAImageUtil)
+	static void bilateralGridFilterDepthMap(float* output, const float* input, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height);
+	//! approximate jointBilateralFilterColorUCHAR4 on the same kind of grid (over pixels and depth); pixels with invalid depth or depth > maxDepth keep their color
+	static void bilateralGridFilterColorUCHAR4(uchar4* output, const uchar4* input, const float* depth, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height);
+	//no invalid checks!
+	static void gaussFilterIntensity(float* output, const float* input, float sigmaD, unsigned int width, unsigned int height);
+
+	static void convertUCHAR4ToIntensityFloat(float* output, const uchar4* input, unsigned int width, unsigned int height);
+
+	static void computeIntensityDerivatives(float2* output, const float* input, unsigned int width, unsigned int height);
+	static void computeIntensityGradientMagnitude(float* output, const float* input, unsigned int width, unsigned int height);
+
+	static void convertNormalsFloat4ToUCHAR4(uchar4* output, const float4* input, unsigned int width, unsigned int height);
+	static void computeNormalsSobel(float4* output, const float4* input, unsigned int width, unsigned int height);
+
+	//adaptive filtering based on depth
+	static void adaptiveGaussFilterDepthMap(float* output, const float* input, float sigmaD, float sigmaR, float adaptFactor, unsigned int width, unsigned int height);
+	static void adaptiveGaussFilterIntensity(float* output, const float* input, const float* depth, float sigmaD, float adaptFactor, unsigned int width, unsigned int height);
+
+	static void jointBilateralFilterFloat(float* output, float* input, float* depth, float sigmaD, float sigmaR, unsigned int width, unsigned int height);
+	static void adaptiveBilateralFilterIntensity(float* output, const float* input, const float* depth, float sigmaD, float sigmaR, float adaptFactor, unsigned int width, unsigned int height);
+
+	//! false: every pixel goes through the scalar reference path; the vectorized path keeps its summation order, so both produce the same output
+	//! unless the compiler contracts the scalar multiply-adds (testSIMD accepts s_simdTolerance)
+	static void setUseSIMD(bool b) {
+		s_bUseSIMD = b;
+	}
+	static bool getUseSIMD() {
+		return s_bUseSIMD;
+	}
+
+	//! runs every vectorized filter with and without SIMD on numImages random images (odd sizes, invalid pixels, depth edges) and prints the largest
+	//! difference per filter; returns false if a pixel is valid in only one of the outputs or the values differ by more than s_simdTolerance
+	//! (all kernels against the CUDAImageUtil ones: testCPUImageUtilCUDA in ComponentBenchmarks)
+	static bool testSIMD(unsigned int numImages);
+
+	//! accuracy/speed of the bilateral grid filters (depth and color) against gaussFilterDepthMap / jointBilateralFilterColorUCHAR4 on the first
+	//! maxNumFrames frames of a .sens file, each at 1x, 2x and 4x the given sigmaD (color is resampled to the depth resolution)
+	static void benchmarkBilateralGrid(const std::string& filename, unsigned int maxNumFrames, float depthSigmaD, float depthSigmaR, float colorSigmaD, float colorSigmaR, float maxDepth);
+
+	//! largest accepted difference between the vectorized and the scalar path, relative to the value (absolute below 1)
+	static const float s_simdTolerance;
+
+private:
+	static bool s_bUseSIMD;
+};
+
+#endif //CPU_IMAGE_UTIL_H
@@ -2,17 +2,20 @@
 #include "CUDACache.h"
 #include "GlobalBundlingState.h"
 #include "MatrixConversion.h"
+#include "CPUImageUtil.h"
 
-#ifdef CUDACACHE_UCHAR_NORMALS
-extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_validImages, const float4& intrinsics, const float4x4* d_transforms,
-	unsigned int numFrames, unsigned int width, unsigned int height, float* d_output, float2* d_tmp, const uchar4* d_normals);
-#else
-extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_validImages, const float4& intrinsics, const float4x4* d_transforms,
-	unsigned int numFrames, unsigned int width, unsigned int height, float* d_output, float2* d_tmp, const float4* d_normals);
+#ifndef CUDACACHE_FLOAT_NORMALS
+#error compact cache frames are encoded from the float normals
 #endif
 
-CUDACache::CUDACache(unsigned int widthDepthInput, unsigned int heightDepthInput, unsigned int widthDownSampled, unsigned int heightDownSampled, unsigned int maxNumImages, const mat4f& inputIntrinsics)
+extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_validImages, const float4& intrinsics, const float4x4* d_transforms,
+	unsigned int numFrames, unsigned int width, unsigned int height, float* d_output, float2* d_tmp, const CUDACachedFrame& baseFrame);
+extern "C" void encodeCompactCacheFrameCU(const CUDACachedFrame& frame, const float* d_depth, const float4* d_normals, const float* d_intensity);
+extern "C" void decodeCacheDepthCU(float* d_output, const CUDACachedFrame& frame);
+
+CUDACache::CUDACache(unsigned int widthDepthInput, unsigned int heightDepthInput, unsigned int widthDownSampled, unsigned int heightDownSampled, unsigned int maxNumImages, const mat4f& inputIntrinsics, bool compact /*= false*/)
 {
+	m_bCompact = compact;
 	m_width = widthDownSampled;
 	m_height = heightDownSampled;
 	m_maxNumImages = maxNumImages;
@@ -45,7 +48,8 @@ CUDACache::CUDACache(unsigned int widthDepthInput, unsigned int heightDepthInput
 void CUDACache::storeFrame(const float* d_depth, unsigned int inputDepthWidth, unsigned int inputDepthHeight,
 	const uchar4* d_color, unsigned int inputColorWidth, unsigned int inputColorHeight)
 {
-	CUDACachedFrame& frame = m_cache[m_currentFrame];
+	//compact frames are computed in the full layout and encoded
+	CUDACachedFrame& frame = m_bCompact ? m_scratchFrame : m_cache[m_currentFrame];
 	//depth
 	const float* d_inputDepth = d_depth;
 	if (m_filterDepthSigmaD > 0.0f) {
@@ -53,7 +57,7 @@ void CUDACache::storeFrame(const float* d_depth, unsigned int inputDepthWidth, u
 		d_inputDepth = d_filterHelper;
 	}
 	CUDAImageUtil::convertDepthFloatToCameraSpaceFloat4(d_helperCamPos, d_inputDepth, *(float4x4*)&m_inputIntrinsicsInv, inputDepthWidth, inputDepthHeight);
-	CUDAImageUtil::resampleFloat4(frame.d_cameraposDownsampled, m_width, m_height, d_helperCamPos, inputDepthWidth, inputDepthHeight);
+	if (!m_bCompact) CUDAImageUtil::resampleFloat4(frame.d_cameraposDownsampled, m_width, m_height, d_helperCamPos, inputDepthWidth, inputDepthHeight);
 #if defined(CUDACACHE_FLOAT_NORMALS) && defined(CUDACACHE_UCHAR_NORMALS)
 	CUDAImageUtil::computeNormals(d_helperNormals, d_helperCamPos, inputDepthWidth, inputDepthHeight);
 
@@ -80,11 +84,180 @@ void CUDACache::storeFrame(const float* d_depth, unsigned int inputDepthWidth, u
 	//if (m_filterIntensitySigma > 0.0f) CUDAImageUtil::jointBilateralFilterFloat(frame.d_intensityDownsampled, d_intensityHelper, frame.d_depthDownsampled, m_intensityFilterSigma, 0.01f, m_width, m_height);
 	//if (m_filterIntensitySigma > 0.0f) CUDAImageUtil::adaptiveBilateralFilterIntensity(frame.d_intensityDownsampled, d_intensityHelper, frame.d_depthDownsampled, m_filterIntensitySigma, 0.01f, 1.0f, m_width, m_height);
 	else std::swap(frame.d_intensityDownsampled, d_intensityHelper);
-	CUDAImageUtil::computeIntensityDerivatives(frame.d_intensityDerivsDownsampled, frame.d_intensityDownsampled, m_width, m_height);
+	if (m_bCompact) encodeCompactCacheFrameCU(m_cache[m_currentFrame], frame.d_depthDownsampled, frame.d_normalsDownsampled, frame.d_intensityDownsampled);
+	else CUDAImageUtil::computeIntensityDerivatives(frame.d_intensityDerivsDownsampled, frame.d_intensityDownsampled, m_width, m_height);
 
 	m_currentFrame++;
 }
 
+void CUDACache::setFrameFromHost(unsigned int frame, const float* depth, const float4* camPos, const float4* normals, const float* intensity, const float2* intensityDerivs)
+{
+	MLIB_ASSERT(frame < m_maxNumImages);
+	m_cache[frame].upload(depth, camPos, normals, intensity, intensityDerivs);
+	if (frame >= m_currentFrame) m_currentFrame = frame + 1;
+}
+
+size_t CUDACache::getMemoryUsage() const
+{
+	const size_t numPixels = m_width * m_height, numPixelsInput = m_inputDepthWidth * m_inputDepthHeight;
+	size_t bytes = m_maxNumImages * numPixels * CUDACachedFrame::getBytesPerPixel(m_bCompact) + m_maxNumImages * sizeof(CUDACachedFrame);
+	if (m_bCompact) bytes += numPixels * CUDACachedFrame::getBytesPerPixel(false);
+	bytes += numPixels * sizeof(float);												//d_intensityHelper
+	bytes += numPixelsInput * (sizeof(float) + 2 * sizeof(float4));					//d_filterHelper, d_helperCamPos, d_helperNormals
+	return bytes;
+}
+
+void CUDACache::copyFrame(CUDACachedFrame& dst, const CUDACachedFrame& src)
+{
+	MLIB_ASSERT(dst.isCompact() == src.isCompact() && dst.width == src.width && dst.height == src.height);
+	const size_t numPixels = dst.width * dst.height;
+	if (dst.isCompact()) {
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_depthHalf, src.d_depthHalf, sizeof(unsigned short) * numPixels, cudaMemcpyDeviceToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_intensityHalf, src.d_intensityHalf, sizeof(unsigned short) * numPixels, cudaMemcpyDeviceToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_normalsOct, src.d_normalsOct, sizeof(unsigned int) * numPixels, cudaMemcpyDeviceToDevice));
+		return;
+	}
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_depthDownsampled, src.d_depthDownsampled, sizeof(float) * numPixels, cudaMemcpyDeviceToDevice));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_cameraposDownsampled, src.d_cameraposDownsampled, sizeof(float4) * numPixels, cudaMemcpyDeviceToDevice));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_intensityDownsampled, src.d_intensityDownsampled, sizeof(float) * numPixels, cudaMemcpyDeviceToDevice));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_intensityDerivsDownsampled, src.d_intensityDerivsDownsampled, sizeof(float2) * numPixels, cudaMemcpyDeviceToDevice));
+#ifdef CUDACACHE_UCHAR_NORMALS
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_normalsDownsampledUCHAR4, src.d_normalsDownsampledUCHAR4, sizeof(uchar4) * numPixels, cudaMemcpyDeviceToDevice));
+#endif
+#ifdef CUDACACHE_FLOAT_NORMALS
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(dst.d_normalsDownsampled, src.d_normalsDownsampled, sizeof(float4) * numPixels, cudaMemcpyDeviceToDevice));
+#endif
+}
+
+void CUDACachedFrame::download(float* depth, float4* camPos, float4* normals, float* intensity, float2* intensityDerivs, uchar4* normalsUCHAR4 /*= NULL*/) const
+{
+	const unsigned int numPixels = width * height;
+	if (isCompact()) {
+		std::vector<unsigned char> data(numPixels * getBytesPerPixel(true));
+		unsigned short* depthHalf = (unsigned short*)data.data();
+		unsigned short* intensityHalf = depthHalf + numPixels;
+		unsigned int* normalsOct = (unsigned int*)(intensityHalf + numPixels);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(depthHalf, d_depthHalf, sizeof(unsigned short) * numPixels, cudaMemcpyDeviceToHost));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensityHalf, d_intensityHalf, sizeof(unsigned short) * numPixels, cudaMemcpyDeviceToHost));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(normalsOct, d_normalsOct, sizeof(unsigned int) * numPixels, cudaMemcpyDeviceToHost));
+		decodeCompact(width, height, intrinsics, data.data(), depth, camPos, normals, intensity, intensityDerivs, normalsUCHAR4);
+		return;
+	}
+	if (depth) MLIB_CUDA_SAFE_CALL(cudaMemcpy(depth, d_depthDownsampled, sizeof(float) * numPixels, cudaMemcpyDeviceToHost));
+	if (camPos) MLIB_CUDA_SAFE_CALL(cudaMemcpy(camPos, d_cameraposDownsampled, sizeof(float4) * numPixels, cudaMemcpyDeviceToHost));
+	if (intensity) MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensity, d_intensityDownsampled, sizeof(float) * numPixels, cudaMemcpyDeviceToHost));
+	if (intensityDerivs) MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensityDerivs, d_intensityDerivsDownsampled, sizeof(float2) * numPixels, cudaMemcpyDeviceToHost));
+	if (normals) MLIB_CUDA_SAFE_CALL(cudaMemcpy(normals, d_normalsDownsampled, sizeof(float4) * numPixels, cudaMemcpyDeviceToHost));
+	if (normalsUCHAR4) {
+#ifdef CUDACACHE_UCHAR_NORMALS
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(normalsUCHAR4, d_normalsDownsampledUCHAR4, sizeof(uchar4) * numPixels, cudaMemcpyDeviceToHost));
+#else
+		std::vector<float4> n(numPixels);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(n.data(), d_normalsDownsampled, sizeof(float4) * numPixels, cudaMemcpyDeviceToHost));
+		CPUImageUtil::convertNormalsFloat4ToUCHAR4(normalsUCHAR4, n.data(), width, height);
+#endif
+	}
+}
+
+void CUDACachedFrame::upload(const float* depth, const float4* camPos, const float4* normals, const float* intensity, const float2* intensityDerivs)
+{
+	const unsigned int numPixels = width * height;
+	if (isCompact()) {
+		std::vector<unsigned char> data(numPixels * getBytesPerPixel(true));
+		encodeCompact(numPixels, depth, normals, intensity, data.data());
+		const unsigned short* depthHalf = (const unsigned short*)data.data();
+		const unsigned short* intensityHalf = depthHalf + numPixels;
+		const unsigned int* normalsOct = (const unsigned int*)(intensityHalf + numPixels);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depthHalf, depthHalf, sizeof(unsigned short) * numPixels, cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensityHalf, intensityHalf, sizeof(unsigned short) * numPixels, cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_normalsOct, normalsOct, sizeof(unsigned int) * numPixels, cudaMemcpyHostToDevice));
+		return;
+	}
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depthDownsampled, depth, sizeof(float) * numPixels, cudaMemcpyHostToDevice));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_cameraposDownsampled, camPos, sizeof(float4) * numPixels, cudaMemcpyHostToDevice));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensityDownsampled, intensity, sizeof(float) * numPixels, cudaMemcpyHostToDevice));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensityDerivsDownsampled, intensityDerivs, sizeof(float2) * numPixels, cudaMemcpyHostToDevice));
+#ifdef CUDACACHE_UCHAR_NORMALS
+	std::vector<uchar4> normalsUCHAR4(numPixels);
+	CPUImageUtil::convertNormalsFloat4ToUCHAR4(normalsUCHAR4.data(), normals, width, height);
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_normalsDownsampledUCHAR4, normalsUCHAR4.data(), sizeof(uchar4) * numPixels, cudaMemcpyHostToDevice));
+#endif
+#ifdef CUDACACHE_FLOAT_NORMALS
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_normalsDownsampled, normals, sizeof(float4) * numPixels, cudaMemcpyHostToDevice));
+#endif
+}
+
+void CUDACachedFrame::encodeCompact(unsigned int numPixels, const float* depth, const float4* normals, const float* intensity, unsigned char* data)
+{
+	unsigned short* depthHalf = (unsigned short*)data;
+	unsigned short* intensityHalf = depthHalf + numPixels;
+	unsigned int* normalsOct = (unsigned int*)(intensityHalf + numPixels);
+	for (unsigned int i = 0; i < numPixels; i++) {
+		depthHalf[i] = cacheFloatToHalf(depth[i]);
+		intensityHalf[i] = cacheFloatToHalf(intensity[i]);
+		normalsOct[i] = cacheEncodeNormal(normals[i]);
+	}
+}
+
+void CUDACachedFrame::decodeCompact(unsigned int width, unsigned int height, const float4& intrinsics, const unsigned char* data,
+	float* depth, float4* camPos, float4* normals, float* intensity, float2* intensityDerivs, uchar4* normalsUCHAR4 /*= NULL*/)
+{
+	const unsigned int numPixels = width * height;
+	const unsigned short* depthHalf = (const unsigned short*)data;
+	const unsigned short* intensityHalf = depthHalf + numPixels;
+	const unsigned int* normalsOct = (const unsigned int*)(intensityHalf + numPixels);
+
+	std::vector<float> intensityHelper;
+	if (intensityDerivs && !intensity) {
+		intensityHelper.resize(numPixels);
+		intensity = intensityHelper.data();
+	}
+	std::vector<float4> normalsHelper;
+	if (normalsUCHAR4 && !normals) {
+		normalsHelper.resize(numPixels);
+		normals = normalsHelper.data();
+	}
+	for (unsigned int y = 0; y < height; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			const unsigned int idx = y * width + x;
+			const float d = cacheHalfToFloat(depthHalf[idx]);
+			if (depth) depth[idx] = d;
+			if (camPos) camPos[idx] = cacheDepthToCamera(x, y, d, intrinsics);
+			if (intensity) intensity[idx] = cacheHalfToFloat(intensityHalf[idx]);
+			if (normals) normals[idx] = cacheDecodeNormal(normalsOct[idx]);
+		}
+	}
+	if (intensityDerivs) CPUImageUtil::computeIntensityDerivatives(intensityDerivs, intensity, width, height);
+	if (normalsUCHAR4) CPUImageUtil::convertNormalsFloat4ToUCHAR4(normalsUCHAR4, normals, width, height);
+}
+
+void CUDACache::saveToFile(const std::string& filename, CUDACacheCheckpoint::COMPRESSION_TYPE compression /*= CUDACacheCheckpoint::TYPE_RAW*/) const
+{
+	CUDACacheCheckpointWriter writer;
+	writer.saveAsync(filename, this, compression);
+	writer.waitForSave();
+}
+
+void CUDACache::loadFromFile(const std::string& filename)
+{
+	CUDACacheCheckpointReader reader;
+	reader.open(filename);
+	if (reader.getWidth() != m_width || reader.getHeight() != m_height || reader.getNumFrames() > m_maxNumImages) {
+		free();
+		m_width = reader.getWidth();
+		m_height = reader.getHeight();
+		m_maxNumImages = std::max(m_maxNumImages, reader.getNumFrames());
+		alloc();
+	}
+	m_intrinsics = reader.getIntrinsics();
+	m_intrinsicsInv = m_intrinsics.getInverse();
+	updateFrameIntrinsics();
+	m_currentFrame = 0;
+	for (unsigned int f = 0; f < reader.getNumFrames(); f++) {
+		reader.loadFrame(f, this, f);
+	}
+}
+
 void CUDACache::fuseDepthFrames(CUDACache* globalCache, const int* d_validImages, const float4x4* d_transforms) const
 {
 	assert(globalCache->m_currentFrame > 0);
@@ -96,23 +269,23 @@ void CUDACache::fuseDepthFrames(CUDACache* globalCache, const int* d_validImages
 		std::cerr << "CUDACache reached max # images!" << std::endl;
 		while (1);
 	}
-	CUDACachedFrame& tmpFrame = globalCache->m_cache[globalFrameIdx + 1];
+	//a compact global frame is fused in the full layout scratch frame and encoded again
+	CUDACachedFrame& fusedFrame = globalFrame.isCompact() ? globalCache->m_scratchFrame : globalFrame;
+	float2* d_tmp = globalFrame.isCompact() ? globalCache->m_scratchFrame.d_intensityDerivsDownsampled : globalCache->m_cache[globalFrameIdx + 1].d_intensityDerivsDownsampled;
+	if (globalFrame.isCompact()) decodeCacheDepthCU(fusedFrame.d_depthDownsampled, globalFrame);
 
 	float4 intrinsics = make_float4(m_intrinsics(0, 0), m_intrinsics(1, 1), m_intrinsics(0, 2), m_intrinsics(1, 2));
+	fuseCacheFramesCU(d_cache, d_validImages, intrinsics, d_transforms, numFrames, m_width, m_height, fusedFrame.d_depthDownsampled, d_tmp, globalFrame);
+	CUDAImageUtil::convertDepthFloatToCameraSpaceFloat4(fusedFrame.d_cameraposDownsampled, fusedFrame.d_depthDownsampled, MatrixConversion::toCUDA(m_intrinsicsInv), m_width, m_height);
 #ifdef CUDACACHE_UCHAR_NORMALS
-	fuseCacheFramesCU(d_cache, d_validImages, intrinsics, d_transforms, numFrames, m_width, m_height,
-		globalFrame.d_depthDownsampled, tmpFrame.d_intensityDerivsDownsampled, globalFrame.d_normalsDownsampledUCHAR4);
-#else
-	fuseCacheFramesCU(d_cache, d_validImages, intrinsics, d_transforms, numFrames, m_width, m_height,
-		globalFrame.d_depthDownsampled, tmpFrame.d_intensityDerivsDownsampled, globalFrame.d_normalsDownsampled);
-#endif
-	CUDAImageUtil::convertDepthFloatToCameraSpaceFloat4(globalFrame.d_cameraposDownsampled, globalFrame.d_depthDownsampled, MatrixConversion::toCUDA(m_intrinsicsInv), m_width, m_height);
-#ifdef CUDACACHE_UCHAR_NORMALS
-	CUDAImageUtil::computeNormals(d_helperNormals, globalFrame.d_cameraposDownsampled, m_width, m_height);
-	CUDAImageUtil::convertNormalsFloat4ToUCHAR4(globalFrame.d_normalsDownsampledUCHAR4, d_helperNormals, m_width, m_height);
+	if (!globalFrame.isCompact()) {
+		CUDAImageUtil::computeNormals(d_helperNormals, fusedFrame.d_cameraposDownsampled, m_width, m_height);
+		CUDAImageUtil::convertNormalsFloat4ToUCHAR4(fusedFrame.d_normalsDownsampledUCHAR4, d_helperNormals, m_width, m_height);
+	}
 #endif
 #ifdef CUDACACHE_FLOAT_NORMALS
-	CUDAImageUtil::computeNormals(globalFrame.d_normalsDownsampled, globalFrame.d_cameraposDownsampled, m_width, m_height);
+	CUDAImageUtil::computeNormals(fusedFrame.d_normalsDownsampled, fusedFrame.d_cameraposDownsampled, m_width, m_height);
 	//CUDAImageUtil::convertNormalsFloat4ToUCHAR4(globalFrame.d_normalsDownsampledUCHAR4, globalFrame.d_normalsDownsampled, m_width, m_height);
 #endif
+	if (globalFrame.isCompact()) encodeCompactCacheFrameCU(globalFrame, fusedFrame.d_depthDownsampled, fusedFrame.d_normalsDownsampled, NULL);
 }
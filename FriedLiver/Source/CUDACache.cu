@@ -10,13 +10,8 @@
 
 #define MAX_DEPTH_LOCAL_FUSE 3.0f
 
-#ifdef CUDACACHE_UCHAR_NORMALS
 __global__ void fuseCacheFrames_Kernel(const CUDACachedFrame* d_frames, const int* d_validImages, const float4 intrinsics, const float4x4* d_transforms,
-	unsigned int numFrames, unsigned int width, unsigned int height, const uchar4* d_normals, const float* d_output, float2* d_tmp)
-#else
-__global__ void fuseCacheFrames_Kernel(const CUDACachedFrame* d_frames, const int* d_validImages, const float4 intrinsics, const float4x4* d_transforms,
-	unsigned int numFrames, unsigned int width, unsigned int height, const float4* d_normals, const float* d_output, float2* d_tmp)
-#endif
+	unsigned int numFrames, unsigned int width, unsigned int height, const CUDACachedFrame baseFrame, const float* d_output, float2* d_tmp)
 {
 	const unsigned int srcFrameIdx = blockIdx.x + 1; // image index to project from
 	if (d_validImages[srcFrameIdx] == 0) return;
@@ -25,18 +20,13 @@ __global__ void fuseCacheFrames_Kernel(const CUDACachedFrame* d_frames, const in
 	const unsigned int srcIdx = idx * gridDim.z + blockIdx.z;
 
 	if (srcIdx < (width * height)) {
-		const float4 srcCamPos = d_frames[srcFrameIdx].d_cameraposDownsampled[srcIdx];
+		const CUDACachedFrame& srcFrame = d_frames[srcFrameIdx];
+		const float4 srcCamPos = srcFrame.getCameraPos()[srcIdx];
 		if (srcCamPos.z != MINF && srcCamPos.z < MAX_DEPTH_LOCAL_FUSE) {
-#ifdef CUDACACHE_UCHAR_NORMALS
-			const uchar4 srcNormalUCHAR4 = d_frames[srcFrameIdx].d_normalsDownsampledUCHAR4[srcIdx];
-			if (*(int*)&srcNormalUCHAR4 != 0) {
+			const float4 srcNormalCam = srcFrame.getNormalsUCHAR4()[srcIdx];
+			if (srcNormalCam.x != MINF) {
 				const float4x4 transform = d_transforms[srcFrameIdx];
-				const float3 srcNormal = transform * make_float3(srcNormalUCHAR4.x, srcNormalUCHAR4.y, srcNormalUCHAR4.z) / 255.0f * 2.0f - 1.0f;
-#else
-			const float3 srcNormal = transform * make_float3(d_frames[srcFrameIdx].d_normalsDownsampled[srcIdx]);
-			if (srcNormal.x != MINF) {
-				const float4x4 transform = d_transforms[srcFrameIdx];
-#endif
+				const float3 srcNormal = transform.getFloat3x3() * make_float3(srcNormalCam.x, srcNormalCam.y, srcNormalCam.z);
 				const float3 tgtCamPos = transform * make_float3(srcCamPos.x, srcCamPos.y, srcCamPos.z);;
 				const float2 tgtScreenPosf = cameraToDepth(intrinsics.x, intrinsics.y, intrinsics.z, intrinsics.w, tgtCamPos);
 				const int2 tgtScreenPos = make_int2((int)roundf(tgtScreenPosf.x), (int)roundf(tgtScreenPosf.y));
@@ -44,15 +34,10 @@ __global__ void fuseCacheFrames_Kernel(const CUDACachedFrame* d_frames, const in
 					const unsigned int tgtIdx = tgtScreenPos.y * width + tgtScreenPos.x;
 					float baseDepth = d_output[tgtIdx]; //TODO try using precomputed camera space positions too
 					if (baseDepth != MINF) {
-#ifdef CUDACACHE_UCHAR_NORMALS
-						const uchar4 baseNormalUCHAR4 = d_normals[tgtIdx];
-						if (*(int*)&baseNormalUCHAR4 != 0) {
-							const float3 baseNormal = make_float3(baseNormalUCHAR4.x, baseNormalUCHAR4.y, baseNormalUCHAR4.z) / 255.0f * 2.0f - 1.0f;
-#else
-						const float3 baseNormal = make_float3(d_normals[tgtIdx]);
+						const float4 baseNormalCam = baseFrame.getNormalsUCHAR4()[tgtIdx];
 						//const float3 baseNormal = make_float3(bilinearInterpolationFloat4(tgtScreenPosf.x, tgtScreenPosf.y, d_normals, width, height));
-						if (baseNormal.x != MINF) {
-#endif
+						if (baseNormalCam.x != MINF) {
+							const float3 baseNormal = make_float3(baseNormalCam.x, baseNormalCam.y, baseNormalCam.z);
 							const float3 baseCamPos = depthToCamera(intrinsics.x, intrinsics.y, intrinsics.z, intrinsics.w, tgtScreenPos, baseDepth);
 							if (length(baseCamPos - tgtCamPos) <= 0.1f && dot(baseNormal, srcNormal) >= 0.97f) {
 								//float weight = max(0.0f, 0.5f*((1.0f - length(diff) / 0.1f) + (1.0f - camPosTgt.z / MAX_DEPTH_LOCAL_FUSE)));
@@ -87,13 +72,8 @@ __global__ void normalize_Kernel(unsigned int N, float* d_output, const float2*
 }
 
 //TODO HERE ANGIE
-#ifdef CUDACACHE_UCHAR_NORMALS
-extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_validImages, const float4& intrinsics, const float4x4* d_transforms,
-	unsigned int numFrames, unsigned int width, unsigned int height, float* d_output, float2* d_tmp, const uchar4* d_normals) 
-#elif defined(CUDACACHE_FLOAT_NORMALS)
 extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_validImages, const float4& intrinsics, const float4x4* d_transforms,
-	unsigned int numFrames, unsigned int width, unsigned int height, float* d_output, float2* d_tmp, const float4* d_normals) 
-#endif
+	unsigned int numFrames, unsigned int width, unsigned int height, float* d_output, float2* d_tmp, const CUDACachedFrame& baseFrame) 
 {
 	cutilSafeCall(cudaMemset(d_tmp, 0, sizeof(float2)*width*height)); //TODO use running average instead?
 
@@ -102,7 +82,7 @@ extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_
 
 	dim3 grid(numFrames - 1, 1, reductionGlobal); // each frame projects into first
 	dim3 block(THREADS_PER_BLOCK_X, THREADS_PER_BLOCK_Y);
-	fuseCacheFrames_Kernel << <grid, block>> >(d_frames, d_validImages, intrinsics, d_transforms, numFrames, width, height, d_normals, d_output, d_tmp);
+	fuseCacheFrames_Kernel << <grid, block>> >(d_frames, d_validImages, intrinsics, d_transforms, numFrames, width, height, baseFrame, d_output, d_tmp);
 #ifdef _DEBUG
 	cutilSafeCall(cudaDeviceSynchronize());
 	cutilCheckMsg(__FUNCTION__);
@@ -115,3 +95,41 @@ extern "C" void fuseCacheFramesCU(const CUDACachedFrame* d_frames, const int* d_
 #endif
 }
 
+__global__ void encodeCompactCacheFrame_Kernel(unsigned int N, CUDACachedFrame frame, const float* d_depth, const float4* d_normals, const float* d_intensity)
+{
+	const unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (idx < N) {
+		frame.d_depthHalf[idx] = cacheFloatToHalf(d_depth[idx]);
+		frame.d_normalsOct[idx] = cacheEncodeNormal(d_normals[idx]);
+		if (d_intensity) frame.d_intensityHalf[idx] = cacheFloatToHalf(d_intensity[idx]);
+	}
+}
+
+//! d_intensity may be NULL (keeps the intensity of the frame)
+extern "C" void encodeCompactCacheFrameCU(const CUDACachedFrame& frame, const float* d_depth, const float4* d_normals, const float* d_intensity)
+{
+	const unsigned int N = frame.width * frame.height;
+	const int threadsPerBlock = THREADS_PER_BLOCK_X * THREADS_PER_BLOCK_Y;
+	encodeCompactCacheFrame_Kernel << <(N + threadsPerBlock - 1) / threadsPerBlock, threadsPerBlock >> >(N, frame, d_depth, d_normals, d_intensity);
+#ifdef _DEBUG
+	cutilSafeCall(cudaDeviceSynchronize());
+	cutilCheckMsg(__FUNCTION__);
+#endif
+}
+
+__global__ void decodeCacheDepth_Kernel(unsigned int N, float* d_output, const CUDACachedFrame frame)
+{
+	const unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
+	if (idx < N) d_output[idx] = frame.getDepth()[idx];
+}
+
+extern "C" void decodeCacheDepthCU(float* d_output, const CUDACachedFrame& frame)
+{
+	const unsigned int N = frame.width * frame.height;
+	const int threadsPerBlock = THREADS_PER_BLOCK_X * THREADS_PER_BLOCK_Y;
+	decodeCacheDepth_Kernel << <(N + threadsPerBlock - 1) / threadsPerBlock, threadsPerBlock >> >(N, d_output, frame);
+#ifdef _DEBUG
+	cutilSafeCall(cudaDeviceSynchronize());
+	cutilCheckMsg(__FUNCTION__);
+#endif
+}
@@ -2,11 +2,13 @@
 
 #include "CUDACacheUtil.h"
 #include "CUDAImageUtil.h"
+#include "CUDACacheCheckpoint.h"
 
 class CUDACache {
 public:
 
-	CUDACache(unsigned int widthDepthInput, unsigned int heightDepthInput, unsigned int widthDownSampled, unsigned int heightDownSampled, unsigned int maxNumImages, const mat4f& inputIntrinsics);
+	//! compact: frames in the compact layout of CUDACachedFrame (s_cacheCompact), i.e. ~6x the frames or ~2.5x the resolution in the same memory
+	CUDACache(unsigned int widthDepthInput, unsigned int heightDepthInput, unsigned int widthDownSampled, unsigned int heightDownSampled, unsigned int maxNumImages, const mat4f& inputIntrinsics, bool compact = false);
 	~CUDACache() {
 		free();
 	}
@@ -22,18 +24,7 @@ public:
 	const CUDACachedFrame* getCacheFramesGPU() const { return d_cache; }
 
 	void copyCacheFrameFrom(CUDACache* other, unsigned int frameFrom) {
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_depthDownsampled, other->m_cache[frameFrom].d_depthDownsampled, sizeof(float) * m_width * m_height, cudaMemcpyDeviceToDevice));
-		//MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_colorDownsampled, other->m_cache[frameFrom].d_colorDownsampled, sizeof(uchar4) * m_width * m_height, cudaMemcpyDeviceToDevice));
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_cameraposDownsampled, other->m_cache[frameFrom].d_cameraposDownsampled, sizeof(float4) * m_width * m_height, cudaMemcpyDeviceToDevice));
-
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_intensityDownsampled, other->m_cache[frameFrom].d_intensityDownsampled, sizeof(float) * m_width * m_height, cudaMemcpyDeviceToDevice));
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_intensityDerivsDownsampled, other->m_cache[frameFrom].d_intensityDerivsDownsampled, sizeof(float2) * m_width * m_height, cudaMemcpyDeviceToDevice));
-#ifdef CUDACACHE_UCHAR_NORMALS
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_normalsDownsampledUCHAR4, other->m_cache[frameFrom].d_normalsDownsampledUCHAR4, sizeof(float) * m_width * m_height, cudaMemcpyDeviceToDevice));
-#endif
-#ifdef CUDACACHE_FLOAT_NORMALS
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[m_currentFrame].d_normalsDownsampled, other->m_cache[frameFrom].d_normalsDownsampled, sizeof(float4) * m_width * m_height, cudaMemcpyDeviceToDevice));
-#endif
+		copyFrame(m_cache[m_currentFrame], other->m_cache[frameFrom]);
 		m_currentFrame++;
 	}
 
@@ -50,96 +41,15 @@ public:
 
 	unsigned int getNumFrames() const { return m_currentFrame; }
 
-	//! warning: untested!
-	void saveToFile(const std::string& filename) const {
-		BinaryDataStreamFile s(filename, true);
-		s << m_width;
-		s << m_height;
-		s << m_intrinsics;
-		s << m_intrinsicsInv;
-		s << m_currentFrame;
-		s << m_maxNumImages;
-		//s << m_filterIntensitySigma;
-		//s << m_filterDepthSigmaD;
-		//s << m_filterDepthSigmaR;
-		DepthImage32 depth(m_width, m_height);
-		ColorImageR32G32B32A32 camPos(m_width, m_height), normals(m_width, m_height);
-		//ColorImageR8G8B8A8 color(m_width, m_height);
-		ColorImageR32 intensity(m_width, m_height);
-		BaseImage<vec2f> intensityDerivative(m_width, m_height);
-		ColorImageR32 intensityOrig(m_width, m_height);
-		for (unsigned int i = 0; i < m_currentFrame; i++) {
-			const CUDACachedFrame& f = m_cache[i];
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(depth.getData(), f.d_depthDownsampled, sizeof(float)*depth.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(camPos.getData(), f.d_cameraposDownsampled, sizeof(float4)*camPos.getNumPixels(), cudaMemcpyDeviceToHost));
-			//MLIB_CUDA_SAFE_CALL(cudaMemcpy(color.getData(), f.d_colorDownsampled, sizeof(uchar4)*color.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensity.getData(), f.d_intensityDownsampled, sizeof(float)*intensity.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensityDerivative.getData(), f.d_intensityDerivsDownsampled, sizeof(float2)*intensityDerivative.getNumPixels(), cudaMemcpyDeviceToHost));
-#ifdef CUDACACHE_UCHAR_NORMALS
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensityOrig.getData(), f.d_normalsDownsampledUCHAR4, sizeof(float)*intensityOrig.getNumPixels(), cudaMemcpyDeviceToHost));
-#endif
-#ifdef CUDACACHE_FLOAT_NORMALS
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(normals.getData(), f.d_normalsDownsampled, sizeof(float4)*normals.getNumPixels(), cudaMemcpyDeviceToHost));
-#endif
-			s << depth;
-			s << camPos;
-			s << normals;
-			//s << color;
-			s << intensity;
-			s << intensityDerivative;
-			s << intensityOrig;
-		}
-		s.close();
-	}
-	//! warning: untested!
-	void loadFromFile(const std::string& filename) {
-		unsigned int oldMaxNumImages = m_maxNumImages;
-		unsigned int oldWidth = m_width;
-		unsigned int oldHeight = m_height;
-		BinaryDataStreamFile s(filename, false);
-		s >> m_width;
-		s >> m_height;
-		s >> m_intrinsics;
-		s >> m_intrinsicsInv;
-		s >> m_currentFrame;
-		s >> m_maxNumImages;
-		//s >> m_filterIntensitySigma;
-		//s >> m_filterDepthSigmaD;
-		//s >> m_filterDepthSigmaR;
-		if (m_maxNumImages > oldMaxNumImages || m_width > oldWidth || m_height > oldHeight) {
-			free();
-			alloc();
-		}
+	bool isCompact() const { return m_bCompact; }
+	//! device memory allocated by the cache (frames, helper images at the input and the cache resolution) in bytes
+	size_t getMemoryUsage() const;
 
-		DepthImage32 depth(m_width, m_height);
-		ColorImageR32G32B32A32 camPos(m_width, m_height), normals(m_width, m_height);
-		//ColorImageR8G8B8A8 color(m_width, m_height);
-		ColorImageR32 intensity(m_width, m_height);
-		BaseImage<vec2f> intensityDerivative(m_width, m_height);
-		ColorImageR32 intensityOrig(m_width, m_height);
-		for (unsigned int i = 0; i < m_currentFrame; i++) {
-			const CUDACachedFrame& f = m_cache[i];
-			s >> depth;
-			s >> camPos;
-			s >> normals;
-			//s >> color;
-			s >> intensity;
-			s >> intensityDerivative;
-			s >> intensityOrig;
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_depthDownsampled, depth.getData(), sizeof(float)*depth.getNumPixels(), cudaMemcpyHostToDevice));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_cameraposDownsampled, camPos.getData(), sizeof(float4)*camPos.getNumPixels(), cudaMemcpyHostToDevice));
-			//MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_colorDownsampled, color.getData(), sizeof(uchar4)*color.getNumPixels(), cudaMemcpyHostToDevice));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_intensityDownsampled, intensity.getData(), sizeof(float)*intensity.getNumPixels(), cudaMemcpyHostToDevice));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_intensityDerivsDownsampled, intensityDerivative.getData(), sizeof(float2)*intensityDerivative.getNumPixels(), cudaMemcpyHostToDevice));
-#ifdef CUDACACHE_UCHAR_NORMALS
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_normalsDownsampledUCHAR4, intensityOrig.getData(), sizeof(float)*intensityOrig.getNumPixels(), cudaMemcpyHostToDevice));
-#endif
-#ifdef CUDACACHE_FLOAT_NORMALS
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(f.d_normalsDownsampled, normals.getData(), sizeof(float4)*normals.getNumPixels(), cudaMemcpyHostToDevice));
-#endif
-		}
-		s.close();
-	}
+	//! writes a CUDACacheCheckpoint of the frames [0, getNumFrames()) and waits for it (CUDACacheCheckpointWriter saves in the background)
+	void saveToFile(const std::string& filename, CUDACacheCheckpoint::COMPRESSION_TYPE compression = CUDACacheCheckpoint::TYPE_RAW) const;
+	//! loads all frames of a CUDACacheCheckpoint (CUDACacheCheckpointReader loads single frames on demand); reallocates if the checkpoint has a different
+	//! resolution or more than maxNumImages frames
+	void loadFromFile(const std::string& filename);
 
 	void printCacheImages(std::string outDir) const {
 		if (m_cache.empty()) return;
@@ -151,10 +61,7 @@ public:
 		image.setInvalidValue(vec4f(-std::numeric_limits<float>::infinity()));
 		for (unsigned int i = 0; i < m_cache.size(); i++) {
 			const CUDACachedFrame& f = m_cache[i];
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(depth.getData(), f.d_depthDownsampled, sizeof(float)*depth.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensity.getData(), f.d_intensityDownsampled, sizeof(float)*intensity.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(image8.getData(), f.d_normalsDownsampledUCHAR4, sizeof(uchar4)*image8.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(image.getData(), f.d_normalsDownsampled, sizeof(float4)*image.getNumPixels(), cudaMemcpyDeviceToHost));
+			f.download(depth.getData(), NULL, (float4*)image.getData(), intensity.getData(), NULL, (uchar4*)image8.getData());
 			for (auto& p : image) {
 				if (p.value.x != -std::numeric_limits<float>::infinity()) {
 					p.value.w = 1.0f;
@@ -165,7 +72,7 @@ public:
 			FreeImageWrapper::saveImage(outDir + std::to_string(i) + "_cache-intensity.png", intensity);
 			FreeImageWrapper::saveImage(outDir + std::to_string(i) + "_cache-normal-uchar4.png", image8);
 			FreeImageWrapper::saveImage(outDir + std::to_string(i) + "_cache-normal.png", image);
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(image.getData(), f.d_cameraposDownsampled, sizeof(float4)*image.getNumPixels(), cudaMemcpyDeviceToHost));
+			f.download(NULL, (float4*)image.getData(), NULL, NULL, NULL);
 			FreeImageWrapper::saveImage(outDir + std::to_string(i) + "_cache-campos.png", image);
 		}
 	}
@@ -176,26 +83,19 @@ public:
 	void setIntrinsics(const mat4f& inputIntrinsics, const mat4f& intrinsics) { 
 		m_inputIntrinsics = inputIntrinsics; m_inputIntrinsicsInv = inputIntrinsics.getInverse();
 		m_intrinsics = intrinsics; m_intrinsicsInv = intrinsics.getInverse();
+		updateFrameIntrinsics();
 	}
 	//!debugging only
 	void setCachedFrames(const std::vector<CUDACachedFrame>& cachedFrames) {
 		MLIB_ASSERT(cachedFrames.size() <= m_cache.size());
 		for (unsigned int i = 0; i < cachedFrames.size(); i++) {
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_depthDownsampled, cachedFrames[i].d_depthDownsampled, sizeof(float) * m_width * m_height, cudaMemcpyDeviceToDevice));
-			//MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_colorDownsampled, cachedFrames[i].d_colorDownsampled, sizeof(uchar4) * m_width * m_height, cudaMemcpyDeviceToDevice));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_cameraposDownsampled, cachedFrames[i].d_cameraposDownsampled, sizeof(float4) * m_width * m_height, cudaMemcpyDeviceToDevice));
-
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_intensityDownsampled, cachedFrames[i].d_intensityDownsampled, sizeof(float) * m_width * m_height, cudaMemcpyDeviceToDevice));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_intensityDerivsDownsampled, cachedFrames[i].d_intensityDerivsDownsampled, sizeof(float2) * m_width * m_height, cudaMemcpyDeviceToDevice));
-#ifdef CUDACACHE_UCHAR_NORMALS
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_normalsDownsampledUCHAR4, cachedFrames[i].d_normalsDownsampledUCHAR4, sizeof(float) * m_width * m_height, cudaMemcpyDeviceToDevice));
-#endif
-#ifdef CUDACACHE_FLOAT_NORMALS
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_cache[i].d_normalsDownsampled, cachedFrames[i].d_normalsDownsampled, sizeof(float4) * m_width * m_height, cudaMemcpyDeviceToDevice));
-#endif
+			copyFrame(m_cache[i], cachedFrames[i]);
 		}
 	}
 
+	//! uploads host buffers in the full layout (see CUDACachedFrame::upload) into the given frame; extends the cache if frame >= getNumFrames()
+	void setFrameFromHost(unsigned int frame, const float* depth, const float4* camPos, const float4* normals, const float* intensity, const float2* intensityDerivs);
+
 	void fuseDepthFrames(CUDACache* globalCache, const int* d_validImages, const float4x4* d_transforms) const;
 
 private:
@@ -203,10 +103,11 @@ private:
 	void alloc() {
 		m_cache.resize(m_maxNumImages);
 		for (CUDACachedFrame& f : m_cache) {
-			f.alloc(m_width, m_height);
+			f.alloc(m_width, m_height, m_bCompact);
 		}
+		if (m_bCompact) m_scratchFrame.alloc(m_width, m_height);
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_cache, sizeof(CUDACachedFrame)*m_maxNumImages));
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_cache, m_cache.data(), sizeof(CUDACachedFrame)*m_maxNumImages, cudaMemcpyHostToDevice));
+		updateFrameIntrinsics();
 
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_intensityHelper, sizeof(float)*m_width*m_height));
 
@@ -220,6 +121,7 @@ private:
 			f.free();
 		}
 		m_cache.clear();
+		if (m_bCompact) m_scratchFrame.free();
 		MLIB_CUDA_SAFE_FREE(d_cache);
 		MLIB_CUDA_SAFE_FREE(d_intensityHelper);
 		MLIB_CUDA_SAFE_FREE(d_filterHelper);
@@ -229,6 +131,19 @@ private:
 		m_currentFrame = 0;
 	}
 
+	//! the cache intrinsics in every frame (compact frames reconstruct the camera positions with them); uploads the frames to d_cache
+	void updateFrameIntrinsics() {
+		const float4 intrinsics = make_float4(m_intrinsics(0, 0), m_intrinsics(1, 1), m_intrinsics(0, 2), m_intrinsics(1, 2));
+		for (CUDACachedFrame& f : m_cache) {
+			f.intrinsics = intrinsics;
+		}
+		m_scratchFrame.intrinsics = intrinsics;
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_cache, m_cache.data(), sizeof(CUDACachedFrame)*m_maxNumImages, cudaMemcpyHostToDevice));
+	}
+
+	//! device copy between frames of the same layout
+	static void copyFrame(CUDACachedFrame& dst, const CUDACachedFrame& src);
+
 	unsigned int m_width;
 	unsigned int m_height;
 	mat4f		 m_intrinsics;
@@ -239,6 +154,8 @@ private:
 
 	std::vector < CUDACachedFrame > m_cache;
 	CUDACachedFrame*				d_cache;
+	bool							m_bCompact;
+	CUDACachedFrame					m_scratchFrame;	//full layout frame to compute compact frames in; only allocated if m_bCompact
 
 	//for hi-res compute
 	float* d_filterHelper;
@@ -0,0 +1,262 @@
+#include "stdafx.h"
+
+#include "CUDACacheCheckpoint.h"
+#include "CUDACache.h"
+
+#include <zlib.h>
+
+namespace {
+
+	//! the raw frame sections in file order
+	struct RawFrameLayout {
+		RawFrameLayout(size_t numPixels) {
+			depth = 0;
+			camPos = depth + sizeof(float) * numPixels;
+			normals = camPos + sizeof(float4) * numPixels;
+			intensity = normals + sizeof(float4) * numPixels;
+			intensityDerivs = intensity + sizeof(float) * numPixels;
+			size = intensityDerivs + sizeof(float2) * numPixels;
+		}
+		size_t depth, camPos, normals, intensity, intensityDerivs, size;
+	};
+
+	inline void copySection(void* dst, const unsigned char* raw, size_t offset, size_t sizeBytes)
+	{
+		if (dst) std::memcpy(dst, raw + offset, sizeBytes);
+	}
+}
+
+CUDACacheCheckpointWriter::CUDACacheCheckpointWriter()
+{
+	m_compression = CUDACacheCheckpoint::TYPE_RAW;
+	m_width = 0;
+	m_height = 0;
+}
+
+CUDACacheCheckpointWriter::~CUDACacheCheckpointWriter()
+{
+	try {
+		waitForSave();
+	}
+	catch (const std::exception& e) {
+		std::cerr << "failed saving " << m_filename << ": " << e.what() << std::endl;
+	}
+}
+
+void CUDACacheCheckpointWriter::saveAsync(const std::string& filename, const CUDACache* cache, CUDACacheCheckpoint::COMPRESSION_TYPE compression, unsigned int firstFrame /*= 0*/)
+{
+	waitForSave();
+
+	m_filename = filename;
+	m_compression = compression;
+	m_width = cache->getWidth();
+	m_height = cache->getHeight();
+	m_intrinsics = cache->getIntrinsics();
+
+	//only the download is synchronous
+	const size_t numPixels = m_width * m_height;
+	const RawFrameLayout layout(numPixels);
+	const std::vector<CUDACachedFrame>& cachedFrames = cache->getCacheFrames();
+	MLIB_ASSERT(firstFrame <= cache->getNumFrames());
+	m_frames.resize(cache->getNumFrames() - firstFrame);
+	for (unsigned int f = firstFrame; f < cache->getNumFrames(); f++) {
+		const CUDACachedFrame& frame = cachedFrames[f];
+		std::vector<unsigned char>& raw = m_frames[f - firstFrame];
+		raw.resize(layout.size);
+		frame.download((float*)(raw.data() + layout.depth), (float4*)(raw.data() + layout.camPos), (float4*)(raw.data() + layout.normals),
+			(float*)(raw.data() + layout.intensity), (float2*)(raw.data() + layout.intensityDerivs));
+	}
+
+	m_error = std::exception_ptr();
+	m_thread = std::thread(&CUDACacheCheckpointWriter::writeFunc, this);
+}
+
+void CUDACacheCheckpointWriter::waitForSave()
+{
+	if (m_thread.joinable()) m_thread.join();
+	if (m_error) {
+		std::exception_ptr error = m_error;
+		m_error = std::exception_ptr();
+		std::rethrow_exception(error);
+	}
+}
+
+void CUDACacheCheckpointWriter::writeFunc()
+{
+	FILE* file = NULL;
+	try {
+		file = fopen(m_filename.c_str(), "wb");
+		if (!file) throw MLIB_EXCEPTION("could not open " + m_filename + " for writing");
+
+		const UINT64 magic = CUDACacheCheckpoint::s_magic;
+		const unsigned int version = CUDACacheCheckpoint::s_version;
+		const unsigned int compression = (unsigned int)m_compression;
+		fwrite(&magic, sizeof(UINT64), 1, file);
+		fwrite(&version, sizeof(unsigned int), 1, file);
+		fwrite(&compression, sizeof(unsigned int), 1, file);
+		fwrite(&m_width, sizeof(unsigned int), 1, file);
+		fwrite(&m_height, sizeof(unsigned int), 1, file);
+		fwrite(&m_intrinsics, sizeof(mat4f), 1, file);
+		const UINT64 numFramesOffset = (UINT64)_ftelli64(file);
+		UINT64 numFrames = 0, indexOffset = 0;
+		fwrite(&numFrames, sizeof(UINT64), 1, file);
+		fwrite(&indexOffset, sizeof(UINT64), 1, file);
+
+		const size_t numPixels = m_width * m_height;
+		const RawFrameLayout layout(numPixels);
+		std::vector<unsigned char> chunk;
+		std::vector<UINT64> index;
+		for (size_t f = 0; f < m_frames.size(); f++) {
+			std::vector<unsigned char>& raw = m_frames[f];
+			if (m_compression == CUDACacheCheckpoint::TYPE_ZLIB) {
+				uLongf destLen = compressBound((uLong)raw.size());
+				chunk.resize(destLen);
+				if (compress2(chunk.data(), &destLen, raw.data(), (uLong)raw.size(), Z_BEST_SPEED) != Z_OK) throw MLIB_EXCEPTION("could not compress cache frame " + std::to_string(f));
+				chunk.resize(destLen);
+			}
+			else if (m_compression == CUDACacheCheckpoint::TYPE_COMPACT) {
+				chunk.resize(numPixels * CUDACachedFrame::getBytesPerPixel(true));
+				CUDACachedFrame::encodeCompact((unsigned int)numPixels, (const float*)(raw.data() + layout.depth), (const float4*)(raw.data() + layout.normals),
+					(const float*)(raw.data() + layout.intensity), chunk.data());
+			}
+			else {
+				chunk.swap(raw);
+			}
+			index.push_back((UINT64)_ftelli64(file));
+			index.push_back(chunk.size());
+			fwrite(chunk.data(), 1, chunk.size(), file);
+			if (ferror(file)) throw MLIB_EXCEPTION("failed writing frame " + std::to_string(f) + " to " + m_filename);
+			std::vector<unsigned char>().swap(raw);
+		}
+		m_frames.clear();
+
+		//frames and index must be on disk before the header claims them
+		indexOffset = (UINT64)_ftelli64(file);
+		if (!index.empty()) fwrite(index.data(), sizeof(UINT64), index.size(), file);
+		fflush(file);
+		numFrames = index.size() / 2;
+		_fseeki64(file, (__int64)numFramesOffset, SEEK_SET);
+		fwrite(&numFrames, sizeof(UINT64), 1, file);
+		fwrite(&indexOffset, sizeof(UINT64), 1, file);
+		fflush(file);
+		if (ferror(file)) throw MLIB_EXCEPTION("failed writing " + m_filename);
+		fclose(file);
+	}
+	catch (...) {
+		if (file) fclose(file);
+		m_frames.clear();
+		m_error = std::current_exception();
+	}
+}
+
+CUDACacheCheckpointReader::CUDACacheCheckpointReader()
+{
+	m_file = NULL;
+	m_compression = CUDACacheCheckpoint::TYPE_RAW;
+	m_width = 0;
+	m_height = 0;
+}
+
+CUDACacheCheckpointReader::~CUDACacheCheckpointReader()
+{
+	close();
+}
+
+void CUDACacheCheckpointReader::open(const std::string& filename)
+{
+	close();
+	m_filename = filename;
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (!file) throw MLIB_EXCEPTION("could not open " + filename);
+	_fseeki64(file, 0, SEEK_END);
+	const UINT64 fileSize = (UINT64)_ftelli64(file);
+	_fseeki64(file, 0, SEEK_SET);
+
+	UINT64 magic = 0, numFrames = 0, indexOffset = 0;
+	unsigned int version = 0, compression = 0;
+	bool bValid = fread(&magic, sizeof(UINT64), 1, file) == 1 && magic == CUDACacheCheckpoint::s_magic
+		&& fread(&version, sizeof(unsigned int), 1, file) == 1 && version == CUDACacheCheckpoint::s_version
+		&& fread(&compression, sizeof(unsigned int), 1, file) == 1 && compression <= CUDACacheCheckpoint::TYPE_COMPACT
+		&& fread(&m_width, sizeof(unsigned int), 1, file) == 1
+		&& fread(&m_height, sizeof(unsigned int), 1, file) == 1
+		&& fread(&m_intrinsics, sizeof(mat4f), 1, file) == 1
+		&& fread(&numFrames, sizeof(UINT64), 1, file) == 1
+		&& fread(&indexOffset, sizeof(UINT64), 1, file) == 1
+		&& indexOffset > 0 && indexOffset + numFrames * 2 * sizeof(UINT64) <= fileSize;
+	std::vector<UINT64> index(2 * (size_t)(bValid ? numFrames : 0));
+	if (bValid && numFrames > 0) {
+		_fseeki64(file, (__int64)indexOffset, SEEK_SET);
+		bValid = fread(index.data(), sizeof(UINT64), index.size(), file) == index.size();
+	}
+	for (size_t f = 0; bValid && f < (size_t)numFrames; f++) {
+		bValid = index[2 * f] + index[2 * f + 1] <= indexOffset;
+	}
+	if (!bValid) {
+		fclose(file);
+		throw MLIB_EXCEPTION("invalid or incomplete cache checkpoint " + filename + " (version " + std::to_string(version) + ")");
+	}
+
+	m_compression = (CUDACacheCheckpoint::COMPRESSION_TYPE)compression;
+	m_frameOffsets.resize((size_t)numFrames);
+	m_frameSizes.resize((size_t)numFrames);
+	for (size_t f = 0; f < (size_t)numFrames; f++) {
+		m_frameOffsets[f] = index[2 * f];
+		m_frameSizes[f] = index[2 * f + 1];
+	}
+	m_file = file;
+}
+
+void CUDACacheCheckpointReader::close()
+{
+	if (m_file) fclose(m_file);
+	m_file = NULL;
+	m_frameOffsets.clear();
+	m_frameSizes.clear();
+}
+
+void CUDACacheCheckpointReader::readFrame(unsigned int frame, float* depth, float4* camPos, float4* normals, float* intensity, float2* intensityDerivs) const
+{
+	if (!isOpen() || frame >= getNumFrames()) throw MLIB_EXCEPTION("frame " + std::to_string(frame) + " not in cache checkpoint " + m_filename);
+	std::vector<unsigned char> chunk((size_t)m_frameSizes[frame]);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		_fseeki64(m_file, (__int64)m_frameOffsets[frame], SEEK_SET);
+		if (fread(chunk.data(), 1, chunk.size(), m_file) != chunk.size()) throw MLIB_EXCEPTION("failed reading frame " + std::to_string(frame) + " of " + m_filename);
+	}
+
+	const size_t numPixels = m_width * m_height;
+	if (m_compression == CUDACacheCheckpoint::TYPE_COMPACT) {
+		if (chunk.size() != numPixels * CUDACachedFrame::getBytesPerPixel(true)) throw MLIB_EXCEPTION("corrupt frame " + std::to_string(frame) + " in " + m_filename);
+		const float4 intrinsics = make_float4(m_intrinsics(0, 0), m_intrinsics(1, 1), m_intrinsics(0, 2), m_intrinsics(1, 2));
+		CUDACachedFrame::decodeCompact(m_width, m_height, intrinsics, chunk.data(), depth, camPos, normals, intensity, intensityDerivs);
+		return;
+	}
+	const RawFrameLayout layout(numPixels);
+	if (m_compression == CUDACacheCheckpoint::TYPE_ZLIB) {
+		std::vector<unsigned char> raw(layout.size);
+		uLongf destLen = (uLongf)raw.size();
+		if (uncompress(raw.data(), &destLen, chunk.data(), (uLong)chunk.size()) != Z_OK || destLen != raw.size()) {
+			throw MLIB_EXCEPTION("corrupt frame " + std::to_string(frame) + " in " + m_filename);
+		}
+		chunk.swap(raw);
+	}
+	if (chunk.size() != layout.size) throw MLIB_EXCEPTION("corrupt frame " + std::to_string(frame) + " in " + m_filename);
+	copySection(depth, chunk.data(), layout.depth, sizeof(float) * numPixels);
+	copySection(camPos, chunk.data(), layout.camPos, sizeof(float4) * numPixels);
+	copySection(normals, chunk.data(), layout.normals, sizeof(float4) * numPixels);
+	copySection(intensity, chunk.data(), layout.intensity, sizeof(float) * numPixels);
+	copySection(intensityDerivs, chunk.data(), layout.intensityDerivs, sizeof(float2) * numPixels);
+}
+
+void CUDACacheCheckpointReader::loadFrame(unsigned int frame, CUDACache* cache, unsigned int cacheFrame) const
+{
+	if (cache->getWidth() != m_width || cache->getHeight() != m_height) {
+		throw MLIB_EXCEPTION("cache checkpoint " + m_filename + " has resolution " + std::to_string(m_width) + "x" + std::to_string(m_height));
+	}
+	const size_t numPixels = m_width * m_height;
+	std::vector<float> depth(numPixels), intensity(numPixels);
+	std::vector<float4> camPos(numPixels), normals(numPixels);
+	std::vector<float2> intensityDerivs(numPixels);
+	readFrame(frame, depth.data(), camPos.data(), normals.data(), intensity.data(), intensityDerivs.data());
+	cache->setFrameFromHost(cacheFrame, depth.data(), camPos.data(), normals.data(), intensity.data(), intensityDerivs.data());
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+/************************************************************************/
+/* Checkpoint file of a CUDACache: versioned header, one chunk per      */
+/* frame (optionally compressed) and a trailing frame index; written    */
+/* on a background thread and read back one frame at a time            */
+/************************************************************************/
+
+#include "stdafx.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <cstdio>
+
+class CUDACache;
+
+//! file layout (little endian):
+//!		header:	UINT64 magic, uint version, uint compression, uint width, uint height, mat4f intrinsics (of the cache resolution), UINT64 numFrames, UINT64 indexOffset
+//!		frames:	chunk per frame; uncompressed the chunk is depth (float), camera positions (float4), normals (float4), intensity (float), intensity derivatives (float2)
+//!		index:	UINT64 offset, UINT64 sizeBytes per frame
+//! numFrames and indexOffset are written last, so an interrupted save leaves a file that fails to open instead of one with missing frames
+struct CUDACacheCheckpoint {
+	enum COMPRESSION_TYPE {
+		TYPE_RAW = 0,
+		TYPE_ZLIB = 1,		//lossless
+		TYPE_COMPACT = 2	//compact layout of CUDACachedFrame (half depth / intensity, octahedral normals); camera positions and intensity derivatives are recomputed on load
+	};
+
+	static const UINT64 s_magic = 0x54504b4348434343ull;	//"CCCHCKPT"
+	static const unsigned int s_version = 1;
+
+	static size_t getRawFrameSize(unsigned int width, unsigned int height) {
+		return (size_t)width * height * (sizeof(float) + 2 * sizeof(float4) + sizeof(float) + sizeof(float2));
+	}
+};
+
+class CUDACacheCheckpointWriter
+{
+public:
+	CUDACacheCheckpointWriter();
+	//! waits for a pending save
+	~CUDACacheCheckpointWriter();
+
+	//! copies the frames [firstFrame, cache->getNumFrames()) to host memory and returns; compression and writing run on a background thread, so the cache may change
+	//! right after the call. a previous save is finished first (and its error rethrown). the file numbers the frames from 0 (i.e. frame i is cache frame firstFrame + i)
+	void saveAsync(const std::string& filename, const CUDACache* cache, CUDACacheCheckpoint::COMPRESSION_TYPE compression, unsigned int firstFrame = 0);
+
+	//! blocks until the pending save is on disk; rethrows errors of the background thread
+	void waitForSave();
+
+	bool isSaving() const {
+		return m_thread.joinable();
+	}
+
+private:
+	void writeFunc();
+
+	std::string								m_filename;
+	CUDACacheCheckpoint::COMPRESSION_TYPE	m_compression;
+	unsigned int							m_width;
+	unsigned int							m_height;
+	mat4f									m_intrinsics;
+	std::vector<std::vector<unsigned char>>	m_frames;	//raw frames, replaced by the compressed chunks while writing
+
+	std::thread								m_thread;
+	std::exception_ptr						m_error;
+};
+
+class CUDACacheCheckpointReader
+{
+public:
+	CUDACacheCheckpointReader();
+	~CUDACacheCheckpointReader();
+
+	//! reads the header and the frame index; the frames are only read by readFrame / loadFrame
+	void open(const std::string& filename);
+	void close();
+
+	bool isOpen() const {
+		return m_file != NULL;
+	}
+
+	unsigned int getNumFrames() const {
+		return (unsigned int)m_frameOffsets.size();
+	}
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+	const mat4f& getIntrinsics() const { return m_intrinsics; }
+	CUDACacheCheckpoint::COMPRESSION_TYPE getCompression() const { return m_compression; }
+
+	//! reads and decompresses a frame into host buffers in the CUDACachedFrame layout (getWidth() x getHeight()); safe to call from multiple threads
+	void readFrame(unsigned int frame, float* depth, float4* camPos, float4* normals, float* intensity, float2* intensityDerivs) const;
+	//! readFrame and CUDACache::setFrameFromHost into cacheFrame of the cache (same resolution)
+	void loadFrame(unsigned int frame, CUDACache* cache, unsigned int cacheFrame) const;
+
+private:
+	std::string								m_filename;
+	FILE*									m_file;
+	mutable std::mutex						m_mutex;
+	CUDACacheCheckpoint::COMPRESSION_TYPE	m_compression;
+	unsigned int							m_width;
+	unsigned int							m_height;
+	mat4f									m_intrinsics;
+	std::vector<UINT64>						m_frameOffsets;
+	std::vector<UINT64>						m_frameSizes;
+};
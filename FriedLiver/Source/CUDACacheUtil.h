@@ -7,8 +7,208 @@
 #define CUDACACHE_UCHAR_NORMALS
 #define CUDACACHE_FLOAT_NORMALS
 
+#define CUDACACHE_INVALID_NORMAL 0x80008000	//octahedral normal of an invalid pixel (snorm16 never encodes -32768)
+
+////////////////////////////////////////
+// compact layout codecs (host and device)
+////////////////////////////////////////
+
+__inline__ __host__ __device__ float cacheAsFloat(unsigned int u)
+{
+	union { unsigned int u; float f; } v;
+	v.u = u;
+	return v.f;
+}
+__inline__ __host__ __device__ unsigned int cacheAsUint(float f)
+{
+	union { unsigned int u; float f; } v;
+	v.f = f;
+	return v.u;
+}
+
+//! round to nearest even; inf (invalid depth) and nan are kept
+__inline__ __host__ __device__ unsigned short cacheFloatToHalf(float f)
+{
+#ifdef __CUDA_ARCH__
+	return __float2half_rn(f);
+#else
+	const unsigned int x = cacheAsUint(f);
+	const unsigned int sign = (x >> 16) & 0x8000;
+	const unsigned int absx = x & 0x7fffffff;
+	if (absx >= 0x7f800000) return (unsigned short)(sign | 0x7c00 | (absx > 0x7f800000 ? 0x200 : 0));
+	if (absx >= 0x477ff000) return (unsigned short)(sign | 0x7c00);	//rounds to > 65504
+	if (absx < 0x38800000) {	//half subnormal
+		if (absx < 0x33000000) return (unsigned short)sign;
+		const unsigned int mantissa = (absx & 0x7fffff) | 0x800000;
+		const unsigned int shift = 126 - (absx >> 23);
+		unsigned int h = mantissa >> shift;
+		const unsigned int rest = mantissa & ((1u << shift) - 1), half = 1u << (shift - 1);
+		if (rest > half || (rest == half && (h & 1))) h++;
+		return (unsigned short)(sign | h);
+	}
+	unsigned int h = (absx >> 13) - (112 << 10);
+	const unsigned int rest = absx & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+	return (unsigned short)(sign | h);
+#endif
+}
+
+__inline__ __host__ __device__ float cacheHalfToFloat(unsigned short h)
+{
+#ifdef __CUDA_ARCH__
+	return __half2float(h);
+#else
+	const unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+	if (exponent == 0x1f) return cacheAsFloat(sign | 0x7f800000 | (mantissa << 13));
+	if (exponent != 0) return cacheAsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+	if (mantissa == 0) return cacheAsFloat(sign);
+	//subnormal
+	exponent = 113;
+	while (!(mantissa & 0x400)) { mantissa <<= 1; exponent--; }
+	return cacheAsFloat(sign | (exponent << 23) | ((mantissa & 0x3ff) << 13));
+#endif
+}
+
+__inline__ __host__ __device__ float cacheSignNotZero(float v)
+{
+	return v < 0.0f ? -1.0f : 1.0f;
+}
+
+//! octahedral projection of the unit sphere onto [-1, 1]^2 (Meyer et al. 2010), 16 bit snorm u | v << 16
+__inline__ __host__ __device__ unsigned int cacheEncodeNormal(const float4& n)
+{
+	if (n.x == cacheAsFloat(0xff800000)) return CUDACACHE_INVALID_NORMAL;
+	const float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	float u = n.x / l1, v = n.y / l1;
+	if (n.z < 0.0f) {
+		const float uu = (1.0f - fabsf(v)) * cacheSignNotZero(u);
+		v = (1.0f - fabsf(u)) * cacheSignNotZero(v);
+		u = uu;
+	}
+	const short su = (short)floorf(fminf(fmaxf(u, -1.0f), 1.0f) * 32767.0f + 0.5f);
+	const short sv = (short)floorf(fminf(fmaxf(v, -1.0f), 1.0f) * 32767.0f + 0.5f);
+	return (unsigned int)(unsigned short)su | ((unsigned int)(unsigned short)sv << 16);
+}
+
+//! unit normal with w = 0 (as computeNormals); MINF if invalid
+__inline__ __host__ __device__ float4 cacheDecodeNormal(unsigned int e)
+{
+	if (e == CUDACACHE_INVALID_NORMAL) return make_float4(cacheAsFloat(0xff800000));
+	const float u = (float)(short)(e & 0xffff) / 32767.0f, v = (float)(short)(e >> 16) / 32767.0f;
+	float x = u, y = v;
+	const float z = 1.0f - fabsf(u) - fabsf(v);
+	if (z < 0.0f) {
+		x = (1.0f - fabsf(v)) * cacheSignNotZero(u);
+		y = (1.0f - fabsf(u)) * cacheSignNotZero(v);
+	}
+	const float invLength = 1.0f / sqrtf(x * x + y * y + z * z);
+	return make_float4(x * invLength, y * invLength, z * invLength, 0.0f);
+}
+
+//! camera space position of pixel (x, y) with intrinsics (fx, fy, cx, cy), w = 1 (as convertDepthFloatToCameraSpaceFloat4); MINF if the depth is invalid
+__inline__ __host__ __device__ float4 cacheDepthToCamera(unsigned int x, unsigned int y, float depth, const float4& intrinsics)
+{
+	if (depth == cacheAsFloat(0xff800000)) return make_float4(depth);
+	return make_float4(((float)x - intrinsics.z) / intrinsics.x * depth, ((float)y - intrinsics.w) / intrinsics.y * depth, depth, 1.0f);
+}
+
+////////////////////////////////////////
+// layout independent device access
+////////////////////////////////////////
+
+#ifdef __CUDACC__
+//! view[idx] returns what the full layout stores at pixel idx; the branch on the layout is the same for all threads of a frame
+struct CUDACachedFloatView {
+	const float*			d_data;		//full layout
+	const unsigned short*	d_dataHalf;	//compact layout
+
+	__device__ float operator[](unsigned int idx) const {
+		if (d_data) return d_data[idx];
+		return cacheHalfToFloat(d_dataHalf[idx]);
+	}
+};
+
+struct CUDACachedCameraPosView {
+	const float4*			d_data;
+	const unsigned short*	d_depthHalf;
+	unsigned int			width;
+	float4					intrinsics;
+
+	__device__ float4 operator[](unsigned int idx) const {
+		if (d_data) return d_data[idx];
+		return cacheDepthToCamera(idx % width, idx / width, cacheHalfToFloat(d_depthHalf[idx]), intrinsics);
+	}
+};
+
+//! float4 normals with w = 0, MINF if invalid
+struct CUDACachedNormalView {
+	const float4*			d_data;
+	const uchar4*			d_dataUCHAR4;
+	const unsigned int*		d_dataOct;
+
+	__device__ float4 operator[](unsigned int idx) const {
+		if (d_data) return d_data[idx];
+		if (d_dataUCHAR4) {
+			const uchar4 n = d_dataUCHAR4[idx];
+			if (*(const int*)&n == 0) return make_float4(MINF);
+			return make_float4(make_float3(n.x, n.y, n.z) / 255.0f * 2.0f - 1.0f, 0.0f);
+		}
+		return cacheDecodeNormal(d_dataOct[idx]);
+	}
+};
+
+//! compact frames recompute the sobel of computeIntensityDerivatives from the intensity
+struct CUDACachedIntensityDerivsView {
+	const float2*			d_data;
+	const unsigned short*	d_intensityHalf;
+	unsigned int			width;
+	unsigned int			height;
+
+	__device__ float2 operator[](unsigned int idx) const {
+		if (d_data) return d_data[idx];
+		const unsigned int x = idx % width, y = idx / width;
+		if (x == 0 || x >= width - 1 || y == 0 || y >= height - 1) return make_float2(MINF);
+		float p[3][3];
+		for (int dx = 0; dx < 3; dx++) {
+			for (int dy = 0; dy < 3; dy++) {
+				if (dx == 1 && dy == 1) continue;
+				p[dx][dy] = cacheHalfToFloat(d_intensityHalf[(y + dy - 1) * width + (x + dx - 1)]);
+				if (p[dx][dy] == MINF) return make_float2(MINF);
+			}
+		}
+		const float resU = ((-1.0f)*p[0][0] + (1.0f)*p[2][0] + (-2.0f)*p[0][1] + (2.0f)*p[2][1] + (-1.0f)*p[0][2] + (1.0f)*p[2][2]) / 8.0f;
+		const float resV = ((-1.0f)*p[0][0] + (-2.0f)*p[1][0] + (-1.0f)*p[2][0] + (1.0f)*p[0][2] + (2.0f)*p[1][2] + (1.0f)*p[2][2]) / 8.0f;
+		return make_float2(resU, resV);
+	}
+};
+#endif
+
 struct CUDACachedFrame {
-	void alloc(unsigned int width, unsigned int height) {
+	//! compact: half precision depth and intensity and octahedral normals (getBytesPerPixel(true) instead of getBytesPerPixel(false)); the pointers of the other layout are NULL
+	void alloc(unsigned int width, unsigned int height, bool compact = false) {
+		this->width = width;
+		this->height = height;
+		intrinsics = make_float4(0.0f);
+		d_depthDownsampled = NULL;
+		d_cameraposDownsampled = NULL;
+		d_intensityDownsampled = NULL;
+		d_intensityDerivsDownsampled = NULL;
+#ifdef CUDACACHE_UCHAR_NORMALS
+		d_normalsDownsampledUCHAR4 = NULL;
+#endif
+#ifdef CUDACACHE_FLOAT_NORMALS
+		d_normalsDownsampled = NULL;
+#endif
+		d_depthHalf = NULL;
+		d_intensityHalf = NULL;
+		d_normalsOct = NULL;
+		if (compact) {
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depthHalf, sizeof(unsigned short) * width * height));
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_intensityHalf, sizeof(unsigned short) * width * height));
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_normalsOct, sizeof(unsigned int) * width * height));
+			return;
+		}
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depthDownsampled, sizeof(float) * width * height));
 		//MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_colorDownsampled, sizeof(uchar4) * width * height));
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_cameraposDownsampled, sizeof(float4) * width * height));
@@ -33,10 +233,75 @@ struct CUDACachedFrame {
 		MLIB_CUDA_SAFE_FREE(d_normalsDownsampledUCHAR4);
 #endif
 #ifdef CUDACACHE_FLOAT_NORMALS
-		MLIB_CUDA_SAFE_FREE(d_normalsDownsampled); 
+		MLIB_CUDA_SAFE_FREE(d_normalsDownsampled);
+#endif
+		MLIB_CUDA_SAFE_FREE(d_depthHalf);
+		MLIB_CUDA_SAFE_FREE(d_intensityHalf);
+		MLIB_CUDA_SAFE_FREE(d_normalsOct);
+	}
+
+	bool isCompact() const { return d_depthHalf != NULL; }
+
+	//! device memory per pixel of either layout
+	static size_t getBytesPerPixel(bool compact) {
+		if (compact) return 2 * sizeof(unsigned short) + sizeof(unsigned int);
+		size_t bytes = sizeof(float) + sizeof(float4) + sizeof(float) + sizeof(float2);	//depth, camera position, intensity, intensity derivatives
+#ifdef CUDACACHE_UCHAR_NORMALS
+		bytes += sizeof(uchar4);
+#endif
+#ifdef CUDACACHE_FLOAT_NORMALS
+		bytes += sizeof(float4);
 #endif
+		return bytes;
 	}
 
+	//! host buffers in the full layout, any of them may be NULL; compact frames are decoded (defined in CUDACache.cpp)
+	void download(float* depth, float4* camPos, float4* normals, float* intensity, float2* intensityDerivs, uchar4* normalsUCHAR4 = NULL) const;
+	//! from host buffers in the full layout; compact frames only keep depth, normals and intensity
+	void upload(const float* depth, const float4* camPos, const float4* normals, const float* intensity, const float2* intensityDerivs);
+
+	//! a compact frame as one host buffer of getBytesPerPixel(true) per pixel: depth and intensity (half), normals (octahedral); e.g. CUDACacheCheckpoint::TYPE_COMPACT
+	static void encodeCompact(unsigned int numPixels, const float* depth, const float4* normals, const float* intensity, unsigned char* data);
+	static void decodeCompact(unsigned int width, unsigned int height, const float4& intrinsics, const unsigned char* data,
+		float* depth, float4* camPos, float4* normals, float* intensity, float2* intensityDerivs, uchar4* normalsUCHAR4 = NULL);
+
+#ifdef __CUDACC__
+	__device__ CUDACachedFloatView getDepth() const {
+		CUDACachedFloatView v = { d_depthDownsampled, d_depthHalf };
+		return v;
+	}
+	__device__ CUDACachedCameraPosView getCameraPos() const {
+		CUDACachedCameraPosView v = { d_cameraposDownsampled, d_depthHalf, width, intrinsics };
+		return v;
+	}
+	//! float normals of the full layout if available
+	__device__ CUDACachedNormalView getNormals() const {
+#if defined(CUDACACHE_FLOAT_NORMALS)
+		CUDACachedNormalView v = { d_normalsDownsampled, NULL, d_normalsOct };
+#else
+		CUDACachedNormalView v = { NULL, d_normalsDownsampledUCHAR4, d_normalsOct };
+#endif
+		return v;
+	}
+	//! uchar normals of the full layout if available
+	__device__ CUDACachedNormalView getNormalsUCHAR4() const {
+#if defined(CUDACACHE_UCHAR_NORMALS)
+		CUDACachedNormalView v = { NULL, d_normalsDownsampledUCHAR4, d_normalsOct };
+#else
+		CUDACachedNormalView v = { d_normalsDownsampled, NULL, d_normalsOct };
+#endif
+		return v;
+	}
+	__device__ CUDACachedFloatView getIntensity() const {
+		CUDACachedFloatView v = { d_intensityDownsampled, d_intensityHalf };
+		return v;
+	}
+	__device__ CUDACachedIntensityDerivsView getIntensityDerivs() const {
+		CUDACachedIntensityDerivsView v = { d_intensityDerivsDownsampled, d_intensityHalf, width, height };
+		return v;
+	}
+#endif
+
 	float* d_depthDownsampled;
 	//uchar4* d_colorDownsampled;
 	float4* d_cameraposDownsampled;
@@ -50,6 +315,15 @@ struct CUDACachedFrame {
 #ifdef CUDACACHE_FLOAT_NORMALS
 	float4* d_normalsDownsampled;
 #endif
+
+	//compact layout; camera positions and intensity derivatives are recomputed from depth / intensity
+	unsigned short* d_depthHalf;
+	unsigned short* d_intensityHalf;
+	unsigned int* d_normalsOct;		//CUDACACHE_INVALID_NORMAL if invalid
+
+	unsigned int width;
+	unsigned int height;
+	float4 intrinsics;	//fx, fy, cx, cy of the cache resolution
 };
 
 #endif //CUDA_CACHE_UTIL
\ No newline at end of file
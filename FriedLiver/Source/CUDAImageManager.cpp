@@ -21,6 +21,7 @@ Timer CUDAImageManager::s_timer;
 
 bool CUDAImageManager::process()
 {
+	m_RGBDSensor->prepareNextFrameBuffers();	//previous frame may still be referenced by m_data
 	if (!m_RGBDSensor->processDepth()) return false;	// Order is important!
 	if (!m_RGBDSensor->processColor()) return false;
 	if (m_currFrame + 1 > GlobalBundlingState::get().s_maxNumImages * GlobalBundlingState::get().s_submapSize) {
@@ -30,9 +31,15 @@ bool CUDAImageManager::process()
 
 	if (GlobalBundlingState::get().s_enableGlobalTimings) { TimingLog::addLocalFrameTiming(); cudaDeviceSynchronize(); s_timer.start(); }
 
+	//frames stored on the CPU at sensor resolution reference the sensor buffers instead of copying them
+	const bool bShareColor = !ManagedRGBDInputFrame::s_bIsOnGPU &&
+		(m_RGBDSensor->getColorWidth() == m_widthIntegration) && (m_RGBDSensor->getColorHeight() == m_heightIntegration);
+	const bool bShareDepth = !ManagedRGBDInputFrame::s_bIsOnGPU && !GlobalBundlingState::get().s_erodeSIFTdepth &&
+		(m_RGBDSensor->getDepthWidth() == m_widthIntegration) && (m_RGBDSensor->getDepthHeight() == m_heightIntegration);
+
 	m_data.push_back(ManagedRGBDInputFrame());
 	ManagedRGBDInputFrame& frame = m_data.back();
-	frame.alloc();
+	frame.alloc(!bShareDepth, !bShareColor);
 
 	////////////////////////////////////////////////////////////////////////////////////
 	// Process Color
@@ -47,7 +54,7 @@ bool CUDAImageManager::process()
 			//std::swap(frame.m_colorIntegration, d_colorInput);
 		}
 		else {
-			memcpy(frame.m_colorIntegration, m_RGBDSensor->getColorRGBX(), sizeof(uchar4)*bufferDimColorInput);
+			frame.shareColor(m_RGBDSensor->getColorRGBXShared());
 		}
 	}
 	else {
@@ -104,7 +111,12 @@ bool CUDAImageManager::process()
 			}
 		}
 	}
-	if (GlobalBundlingState::get().s_depthFilter) { //smooth
+	if (GlobalBundlingState::get().s_depthFilter && GlobalBundlingState::get().s_depthFilterMode == 1) { //smooth (approximate, cost independent of s_depthSigmaD)
+		CUDAImageUtil::bilateralGridFilterDepthMap(d_depthInputFiltered, d_depthInputRaw, d_depthFilterGrid, d_depthFilterGridHelper,
+			GlobalBundlingState::get().s_depthSigmaD, GlobalBundlingState::get().s_depthSigmaR, GlobalAppState::get().s_sensorDepthMax,
+			m_RGBDSensor->getDepthWidth(), m_RGBDSensor->getDepthHeight());
+	}
+	else if (GlobalBundlingState::get().s_depthFilter) { //smooth
 		CUDAImageUtil::gaussFilterDepthMap(d_depthInputFiltered, d_depthInputRaw, GlobalBundlingState::get().s_depthSigmaD, GlobalBundlingState::get().s_depthSigmaR,
 			m_RGBDSensor->getDepthWidth(), m_RGBDSensor->getDepthHeight());
 	}
@@ -131,7 +143,7 @@ bool CUDAImageManager::process()
 				MLIB_CUDA_SAFE_CALL(cudaMemcpy(frame.m_depthIntegration, d_depthInputFiltered, sizeof(float)*bufferDimDepthInput, cudaMemcpyDeviceToHost));
 			}
 			else {
-				memcpy(frame.m_depthIntegration, m_RGBDSensor->getDepthFloat(), sizeof(float)*bufferDimDepthInput);
+				frame.shareDepth(m_RGBDSensor->getDepthFloatShared());
 			}
 		}
 	}
@@ -4,6 +4,7 @@
 #include "CUDAImageCalibrator.h"
 #include "GlobalBundlingState.h"
 #include "TimingLog.h"
+#include "DualGPU.h"
 
 #include <cuda_runtime.h>
 
@@ -44,17 +45,32 @@ public:
 		}
 
 
-		void alloc() {
+		//! buffers that are not allocated must be provided by shareDepth/shareColor
+		void alloc(bool allocDepth = true, bool allocColor = true) {
+			m_depthIntegration = NULL;
+			m_colorIntegration = NULL;
 			if (s_bIsOnGPU) {
-				MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_depthIntegration, sizeof(float)*s_width*s_height));
-				MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_colorIntegration, sizeof(uchar4)*s_width*s_height));
+				if (allocDepth) MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_depthIntegration, sizeof(float)*s_width*s_height));
+				if (allocColor) MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_colorIntegration, sizeof(uchar4)*s_width*s_height));
 			}
 			else {
-				m_depthIntegration = new float[s_width*s_height];
-				m_colorIntegration = new uchar4[s_width*s_height];
+				if (allocDepth) m_depthIntegration = new float[s_width*s_height];
+				if (allocColor) m_colorIntegration = new uchar4[s_width*s_height];
 			}
 		}
 
+		//! references a sensor frame buffer (integration resolution, CPU storage) instead of storing a copy
+		void shareDepth(const std::shared_ptr<float>& depth) {
+			MLIB_ASSERT(!s_bIsOnGPU && !m_depthIntegration);
+			m_depthShared = depth;
+			m_depthIntegration = depth.get();
+		}
+		void shareColor(const std::shared_ptr<vec4uc>& color) {
+			MLIB_ASSERT(!s_bIsOnGPU && !m_colorIntegration);
+			m_colorShared = color;
+			m_colorIntegration = (uchar4*)color.get();
+		}
+
 
 		void free() {
 			if (s_bIsOnGPU) {
@@ -62,8 +78,10 @@ public:
 				MLIB_CUDA_SAFE_FREE(m_colorIntegration);
 			}
 			else {
-				SAFE_DELETE_ARRAY(m_depthIntegration);
-				SAFE_DELETE_ARRAY(m_colorIntegration);
+				if (m_depthShared) { m_depthShared.reset(); m_depthIntegration = NULL; }
+				else SAFE_DELETE_ARRAY(m_depthIntegration);
+				if (m_colorShared) { m_colorShared.reset(); m_colorIntegration = NULL; }
+				else SAFE_DELETE_ARRAY(m_colorIntegration);
 			}
 		}
 
@@ -122,6 +140,9 @@ public:
 		float*	m_depthIntegration;	//either on the GPU or CPU
 		uchar4*	m_colorIntegration;	//either on the GPU or CPU
 
+		std::shared_ptr<float>	m_depthShared;	//set if m_depthIntegration points into a sensor frame buffer
+		std::shared_ptr<vec4uc>	m_colorShared;	//set if m_colorIntegration points into a sensor frame buffer
+
 		static bool			s_bIsOnGPU;
 		static unsigned int s_width;
 		static unsigned int s_height;
@@ -153,6 +174,15 @@ public:
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depthInputFiltered, sizeof(float)*bufferDimDepthInput));
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_colorInput, sizeof(uchar4)*bufferDimColorInput));
 
+		d_depthFilterGrid = NULL;
+		d_depthFilterGridHelper = NULL;
+		if (GlobalBundlingState::get().s_depthFilter && GlobalBundlingState::get().s_depthFilterMode == 1) {
+			const unsigned int gridSize = CUDAImageUtil::getBilateralGridSize(m_RGBDSensor->getDepthWidth(), m_RGBDSensor->getDepthHeight(),
+				GlobalBundlingState::get().s_depthSigmaD, GlobalBundlingState::get().s_depthSigmaR, GlobalAppState::get().s_sensorDepthMax);
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depthFilterGrid, sizeof(float2)*gridSize));
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depthFilterGridHelper, sizeof(float2)*gridSize));
+		}
+
 		m_currFrame = 0;
 
 
@@ -191,6 +221,10 @@ public:
 
 		ManagedRGBDInputFrame::globalInit(getIntegrationWidth(), getIntegrationHeight(), storeFramesOnGPU);
 		m_bHasBundlingFrameRdy = false;
+
+		//the input buffers can only be handed over to bundling if both live on the same device
+		const DualGPU& dualGPU = DualGPU::get();
+		m_bSwapBundlingInput = dualGPU.getDevice(DualGPU::DEVICE_RECONSTRUCTION).getDeviceIdx() == dualGPU.getDevice(DualGPU::DEVICE_BUNDLING).getDeviceIdx();
 	}
 
 	HRESULT OnD3D11CreateDevice(ID3D11Device* device) {
@@ -205,6 +239,8 @@ public:
 		MLIB_CUDA_SAFE_FREE(d_depthInputRaw);
 		MLIB_CUDA_SAFE_FREE(d_depthInputFiltered);
 		MLIB_CUDA_SAFE_FREE(d_colorInput);
+		MLIB_CUDA_SAFE_FREE(d_depthFilterGrid);
+		MLIB_CUDA_SAFE_FREE(d_depthFilterGridHelper);
 
 		//m_imageCalibrator.OnD3D11DestroyDevice();
 
@@ -216,11 +252,19 @@ public:
 			f.free();
 		}
 		m_data.clear();
+		m_RGBDSensor->releaseUnusedFrameBuffers();
 	}
 
 	bool process();
 
-	void copyToBundling(float* d_depthRaw, float* d_depthFilt, uchar4* d_color) const {
+	//! hands the current input frame to bundling: swaps the buffers if both use the same device (the next process() writes into bundling's previous buffers), copies otherwise
+	void copyToBundling(float*& d_depthRaw, float*& d_depthFilt, uchar4*& d_color) {
+		if (m_bSwapBundlingInput) {
+			std::swap(d_depthRaw, d_depthInputRaw);
+			std::swap(d_depthFilt, d_depthInputFiltered);
+			std::swap(d_color, d_colorInput);
+			return;
+		}
 		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depthRaw, d_depthInputRaw, sizeof(float)*m_RGBDSensor->getDepthWidth()* m_RGBDSensor->getDepthHeight(), cudaMemcpyDeviceToDevice));
 		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depthFilt, d_depthInputFiltered, sizeof(float)*m_RGBDSensor->getDepthWidth()* m_RGBDSensor->getDepthHeight(), cudaMemcpyDeviceToDevice));
 		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_color, d_colorInput, sizeof(uchar4)*m_RGBDSensor->getColorWidth()*m_RGBDSensor->getColorHeight(), cudaMemcpyDeviceToDevice));
@@ -305,6 +349,7 @@ public:
 	}
 private:
 	bool m_bHasBundlingFrameRdy;
+	bool m_bSwapBundlingInput;
 
 	RGBDSensor* m_RGBDSensor;
 	CUDAImageCalibrator m_imageCalibrator;
@@ -325,6 +370,9 @@ private:
 	float*	d_depthInputRaw;
 	uchar4*	d_colorInput;
 	float*	d_depthInputFiltered;
+	//! bilateral grid of the fast depth filter (s_depthFilterMode == 1)
+	float2*	d_depthFilterGrid;
+	float2*	d_depthFilterGridHelper;
 
 	unsigned int m_widthSIFTdepth;
 	unsigned int m_heightSIFTdepth;
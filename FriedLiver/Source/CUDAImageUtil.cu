@@ -858,6 +858,174 @@ void CUDAImageUtil::gaussFilterIntensity(float* d_output, const float* d_input,
 #endif
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Bilateral Grid Filter Float Map
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define BILATERAL_GRID_PAD 2
+
+inline __host__ __device__ int3 getBilateralGridDims(unsigned int width, unsigned int height, float sigmaD, float sigmaR, float maxDepth)
+{
+	return make_int3((int)((width - 1) / sigmaD) + 1 + 2 * BILATERAL_GRID_PAD, (int)((height - 1) / sigmaD) + 1 + 2 * BILATERAL_GRID_PAD, (int)(maxDepth / sigmaR) + 1 + 2 * BILATERAL_GRID_PAD);
+}
+
+unsigned int CUDAImageUtil::getBilateralGridSize(unsigned int width, unsigned int height, float sigmaD, float sigmaR, float maxDepth)
+{
+	const int3 dims = getBilateralGridDims(width, height, sigmaD, sigmaR, maxDepth);
+	return dims.x*dims.y*dims.z;
+}
+
+__global__ void bilateralGridSplat_Kernel(float2* d_grid, const float* d_input, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height, int3 dims)
+{
+	const unsigned int x = blockIdx.x*blockDim.x + threadIdx.x;
+	const unsigned int y = blockIdx.y*blockDim.y + threadIdx.y;
+
+	if (x >= width || y >= height) return;
+
+	const float depth = d_input[y*width + x];
+	if (depth == MINF || depth > maxDepth) return;
+
+	const int gx = (int)(x / sigmaD + 0.5f) + BILATERAL_GRID_PAD;
+	const int gy = (int)(y / sigmaD + 0.5f) + BILATERAL_GRID_PAD;
+	const int gz = (int)(depth / sigmaR + 0.5f) + BILATERAL_GRID_PAD;
+	float2* cell = &d_grid[(gz*dims.y + gy)*dims.x + gx];
+	atomicAdd(&cell->x, depth);
+	atomicAdd(&cell->y, 1.0f);
+}
+
+__global__ void bilateralGridSplatColor_Kernel(float4* d_grid, const uchar4* d_input, const float* d_depth, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height, int3 dims)
+{
+	const unsigned int x = blockIdx.x*blockDim.x + threadIdx.x;
+	const unsigned int y = blockIdx.y*blockDim.y + threadIdx.y;
+
+	if (x >= width || y >= height) return;
+
+	const float depth = d_depth[y*width + x];
+	if (depth == MINF || depth > maxDepth) return;
+
+	const int gx = (int)(x / sigmaD + 0.5f) + BILATERAL_GRID_PAD;
+	const int gy = (int)(y / sigmaD + 0.5f) + BILATERAL_GRID_PAD;
+	const int gz = (int)(depth / sigmaR + 0.5f) + BILATERAL_GRID_PAD;
+	const uchar4 color = d_input[y*width + x];
+	float4* cell = &d_grid[(gz*dims.y + gy)*dims.x + gx];
+	atomicAdd(&cell->x, (float)color.x);
+	atomicAdd(&cell->y, (float)color.y);
+	atomicAdd(&cell->z, (float)color.z);
+	atomicAdd(&cell->w, 1.0f);
+}
+
+//! [1 4 6 4 1]/16 along one grid axis (gaussian with a standard deviation of one cell); T: float2 (depth, weight) or float4 (color, weight)
+template<class T>
+__global__ void bilateralGridBlur_Kernel(T* d_output, const T* d_input, int3 dims, int3 axis)
+{
+	const int x = blockIdx.x*blockDim.x + threadIdx.x;
+	const int y = blockIdx.y*blockDim.y + threadIdx.y;
+	const int z = blockIdx.z;
+
+	if (x >= dims.x || y >= dims.y) return;
+
+	const float weights[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+	T sum = T();
+	for (int i = -2; i <= 2; i++) {
+		const int3 p = make_int3(x + i*axis.x, y + i*axis.y, z + i*axis.z);
+		if (p.x >= 0 && p.y >= 0 && p.z >= 0 && p.x < dims.x && p.y < dims.y && p.z < dims.z) {
+			sum += weights[i + 2] * d_input[(p.z*dims.y + p.y)*dims.x + p.x];
+		}
+	}
+	d_output[(z*dims.y + y)*dims.x + x] = sum;
+}
+
+__global__ void bilateralGridSlice_Kernel(float* d_output, const float* d_input, const float2* d_grid, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height, int3 dims)
+{
+	const unsigned int x = blockIdx.x*blockDim.x + threadIdx.x;
+	const unsigned int y = blockIdx.y*blockDim.y + threadIdx.y;
+
+	if (x >= width || y >= height) return;
+
+	const float depth = d_input[y*width + x];
+	if (depth == MINF || depth > maxDepth) {
+		d_output[y*width + x] = depth;
+		return;
+	}
+
+	//trilinear interpolation of the blurred (sum, weight) cells
+	const float fx = x / sigmaD + BILATERAL_GRID_PAD, fy = y / sigmaD + BILATERAL_GRID_PAD, fz = depth / sigmaR + BILATERAL_GRID_PAD;
+	const int x0 = (int)fx, y0 = (int)fy, z0 = (int)fz;
+	const float ax = fx - x0, ay = fy - y0, az = fz - z0;
+	float2 res = make_float2(0.0f, 0.0f);
+	for (int k = 0; k < 8; k++) {
+		const int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+		const float w = (dx ? ax : 1.0f - ax) * (dy ? ay : 1.0f - ay) * (dz ? az : 1.0f - az);
+		res += w * d_grid[((z0 + dz)*dims.y + (y0 + dy))*dims.x + (x0 + dx)];
+	}
+	d_output[y*width + x] = res.y > 0.0f ? res.x / res.y : MINF;
+}
+
+__global__ void bilateralGridSliceColor_Kernel(uchar4* d_output, const uchar4* d_input, const float* d_depth, const float4* d_grid, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height, int3 dims)
+{
+	const unsigned int x = blockIdx.x*blockDim.x + threadIdx.x;
+	const unsigned int y = blockIdx.y*blockDim.y + threadIdx.y;
+
+	if (x >= width || y >= height) return;
+
+	d_output[y*width + x] = d_input[y*width + x];
+	const float depth = d_depth[y*width + x];
+	if (depth == MINF || depth > maxDepth) return;
+
+	const float fx = x / sigmaD + BILATERAL_GRID_PAD, fy = y / sigmaD + BILATERAL_GRID_PAD, fz = depth / sigmaR + BILATERAL_GRID_PAD;
+	const int x0 = (int)fx, y0 = (int)fy, z0 = (int)fz;
+	const float ax = fx - x0, ay = fy - y0, az = fz - z0;
+	float4 res = make_float4(0.0f, 0.0f, 0.0f, 0.0f);
+	for (int k = 0; k < 8; k++) {
+		const int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+		const float w = (dx ? ax : 1.0f - ax) * (dy ? ay : 1.0f - ay) * (dz ? az : 1.0f - az);
+		res += w * d_grid[((z0 + dz)*dims.y + (y0 + dy))*dims.x + (x0 + dx)];
+	}
+	if (res.w > 0.0f) d_output[y*width + x] = make_uchar4((uchar)(res.x / res.w), (uchar)(res.y / res.w), (uchar)(res.z / res.w), 255);
+}
+
+template<class T>
+void blurBilateralGrid(T* d_grid, T* d_gridHelper, const int3& dims)
+{
+	const dim3 gridSizeBlur((dims.x + T_PER_BLOCK - 1) / T_PER_BLOCK, (dims.y + T_PER_BLOCK - 1) / T_PER_BLOCK, dims.z);
+	const dim3 blockSize(T_PER_BLOCK, T_PER_BLOCK);
+	bilateralGridBlur_Kernel<T> << <gridSizeBlur, blockSize >> >(d_gridHelper, d_grid, dims, make_int3(1, 0, 0));
+	bilateralGridBlur_Kernel<T> << <gridSizeBlur, blockSize >> >(d_grid, d_gridHelper, dims, make_int3(0, 1, 0));
+	bilateralGridBlur_Kernel<T> << <gridSizeBlur, blockSize >> >(d_gridHelper, d_grid, dims, make_int3(0, 0, 1));
+}
+
+void CUDAImageUtil::bilateralGridFilterDepthMap(float* d_output, const float* d_input, float2* d_grid, float2* d_gridHelper, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height)
+{
+	const int3 dims = getBilateralGridDims(width, height, sigmaD, sigmaR, maxDepth);
+	MLIB_CUDA_SAFE_CALL(cudaMemset(d_grid, 0, sizeof(float2)*dims.x*dims.y*dims.z));
+
+	const dim3 gridSize((width + T_PER_BLOCK - 1) / T_PER_BLOCK, (height + T_PER_BLOCK - 1) / T_PER_BLOCK);
+	const dim3 blockSize(T_PER_BLOCK, T_PER_BLOCK);
+	bilateralGridSplat_Kernel << <gridSize, blockSize >> >(d_grid, d_input, sigmaD, sigmaR, maxDepth, width, height, dims);
+	blurBilateralGrid(d_grid, d_gridHelper, dims);
+	bilateralGridSlice_Kernel << <gridSize, blockSize >> >(d_output, d_input, d_gridHelper, sigmaD, sigmaR, maxDepth, width, height, dims);
+#ifdef _DEBUG
+	cutilSafeCall(cudaDeviceSynchronize());
+	cutilCheckMsg(__FUNCTION__);
+#endif
+}
+
+void CUDAImageUtil::bilateralGridFilterColorUCHAR4(uchar4* d_output, const uchar4* d_input, const float* d_depth, float4* d_grid, float4* d_gridHelper, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height)
+{
+	const int3 dims = getBilateralGridDims(width, height, sigmaD, sigmaR, maxDepth);
+	MLIB_CUDA_SAFE_CALL(cudaMemset(d_grid, 0, sizeof(float4)*dims.x*dims.y*dims.z));
+
+	const dim3 gridSize((width + T_PER_BLOCK - 1) / T_PER_BLOCK, (height + T_PER_BLOCK - 1) / T_PER_BLOCK);
+	const dim3 blockSize(T_PER_BLOCK, T_PER_BLOCK);
+	bilateralGridSplatColor_Kernel << <gridSize, blockSize >> >(d_grid, d_input, d_depth, sigmaD, sigmaR, maxDepth, width, height, dims);
+	blurBilateralGrid(d_grid, d_gridHelper, dims);
+	bilateralGridSliceColor_Kernel << <gridSize, blockSize >> >(d_output, d_input, d_depth, d_gridHelper, sigmaD, sigmaR, maxDepth, width, height, dims);
+#ifdef _DEBUG
+	cutilSafeCall(cudaDeviceSynchronize());
+	cutilCheckMsg(__FUNCTION__);
+#endif
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // adaptive gauss filter float map
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
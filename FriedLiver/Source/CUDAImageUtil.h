@@ -23,6 +23,12 @@ public:
 	static void erodeDepthMap(float* d_output, float* d_input, int structureSize, unsigned int width, unsigned int height, float dThresh, float fracReq);
 
 	static void gaussFilterDepthMap(float* d_output, const float* d_input, float sigmaD, float sigmaR, unsigned int width, unsigned int height);
+	//! approximate bilateral filter (bilateral grid with cells of sigmaD pixels x sigmaR meters); cost does not depend on sigmaD; depth > maxDepth is passed through
+	//! d_grid and d_gridHelper need getBilateralGridSize(...) elements
+	static void bilateralGridFilterDepthMap(float* d_output, const float* d_input, float2* d_grid, float2* d_gridHelper, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height);
+	static unsigned int getBilateralGridSize(unsigned int width, unsigned int height, float sigmaD, float sigmaR, float maxDepth);
+	//! bilateral grid version of jointBilateralFilterColorUCHAR4 (same grid over pixels and d_depth); pixels with invalid depth or depth > maxDepth keep their color
+	static void bilateralGridFilterColorUCHAR4(uchar4* d_output, const uchar4* d_input, const float* d_depth, float4* d_grid, float4* d_gridHelper, float sigmaD, float sigmaR, float maxDepth, unsigned int width, unsigned int height);
 	//no invalid checks!
 	static void gaussFilterIntensity(float* d_output, const float* d_input, float sigmaD, unsigned int width, unsigned int height);
 
@@ -0,0 +1,1215 @@
+#include "stdafx.h"
+
+#include <random>
+#include <map>
+
+#include "ComponentBenchmarks.h"
+
+#include "GlobalAppState.h"
+#include "GlobalBundlingState.h"
+#include "ThreadPool.h"
+#include "CPUImageUtil.h"
+#include "CUDAImageUtil.h"
+#include "MappedSensorData.h"
+#include "SiftGPU/SiftGPU.h"
+#include "SiftGPU/SiftCameraParams.h"
+#include "SiftGPU/SiftMatch.h"
+#include "SiftGPU/SiftMatchCPU.h"
+#include "SiftGPU/SIFTImageManager.h"
+#include "SiftGPU/SIFTMatchFilter.h"
+#include "SiftGPU/SIFTDescriptorIndex.h"
+#include "SiftGPU/SIFTVocabularyTree.h"
+#include "SiftGPU/KabschBatch.h"
+#include "SiftGPU/DenseVerifyCPU.h"
+#include "SiftGPU/MatrixConversion.h"
+#include "CUDACache.h"
+#include "Solver/CPUSolverBundling.h"
+#include "Solver/CUDASolverBundling.h"
+#include "Solver/SolverBundlingPreconditioner.h"
+
+extern "C" void updateConstantSiftCameraParams(const SiftCameraParams& params);
+extern "C" void convertMatricesToPosesCU(const float4x4* d_transforms, unsigned int numTransforms, float3* d_rot, float3* d_trans, const int* d_validImages);
+extern "C" void convertPosesToMatricesCU(const float3* d_rot, const float3* d_trans, unsigned int numImages, float4x4* d_transforms, const int* d_validImages);
+
+//! intensity (sift resolution) and depth (filtered with s_depthSigmaD / s_depthSigmaR if s_depthFilter) of frame f, as the bundler sees them
+static void loadSIFTInput(MappedSensorData& data, unsigned int f, unsigned int widthSIFT, unsigned int heightSIFT, std::vector<float>& intensity, std::vector<float>& depth)
+{
+	const unsigned int depthWidth = data.m_depthWidth, depthHeight = data.m_depthHeight;
+	std::vector<vec3uc> color(data.m_colorWidth*data.m_colorHeight);
+	std::vector<uchar4> colorRGBA(color.size());
+	std::vector<unsigned short> depthU16(depthWidth*depthHeight);
+	data.decompressColor(f, color.data());
+	for (size_t i = 0; i < color.size(); i++) colorRGBA[i] = make_uchar4(color[i].x, color[i].y, color[i].z, 255);
+	intensity.resize(widthSIFT*heightSIFT);
+	CPUImageUtil::resampleToIntensity(intensity.data(), widthSIFT, heightSIFT, colorRGBA.data(), data.m_colorWidth, data.m_colorHeight);
+	data.decompressDepth(f, depthU16.data());
+	depth.resize(depthWidth*depthHeight);
+	for (size_t i = 0; i < depth.size(); i++) {
+		depth[i] = depthU16[i] == 0 ? -std::numeric_limits<float>::infinity() : (float)depthU16[i] / data.m_depthShift;
+	}
+	if (GlobalBundlingState::get().s_depthFilter) {
+		std::vector<float> depthFilt(depth.size());
+		CPUImageUtil::gaussFilterDepthMap(depthFilt.data(), depth.data(), GlobalBundlingState::get().s_depthSigmaD, GlobalBundlingState::get().s_depthSigmaR, depthWidth, depthHeight);
+		std::swap(depth, depthFilt);
+	}
+}
+
+template<class T> static T* uploadTestImage(const std::vector<T>& image)
+{
+	T* d_image = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_image, sizeof(T)*image.size()));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_image, image.data(), sizeof(T)*image.size(), cudaMemcpyHostToDevice));
+	return d_image;
+}
+
+template<class T> static void downloadTestImage(std::vector<T>& image, const T* d_image)
+{
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(image.data(), d_image, sizeof(T)*image.size(), cudaMemcpyDeviceToHost));
+}
+
+bool testCPUImageUtilCUDA(unsigned int numImages)
+{
+	const float minf = -std::numeric_limits<float>::infinity();
+	const float tolerance = 0.001f;			//relative (absolute below 1); uchar4 outputs: 1
+	const double maxFailedFraction = 0.0001;	//the device rounds differently (fast math, atomics): a pixel next to a threshold may go the other way
+	struct Result {
+		float maxDiff;
+		size_t numFailed;
+		size_t numValues;
+	};
+	std::map<std::string, Result> results;
+	auto compare = [&](const std::string& name, const float* cpu, const float* gpu, size_t num, float tol) {
+		Result& r = results[name];
+		r.numValues += num;
+		for (size_t i = 0; i < num; i++) {
+			if ((cpu[i] == minf) != (gpu[i] == minf)) { r.numFailed++; continue; }
+			if (gpu[i] == minf) continue;
+			const float diff = tol >= 1.0f ? std::abs(cpu[i] - gpu[i]) : std::abs(cpu[i] - gpu[i]) / std::max(std::abs(gpu[i]), 1.0f);
+			r.maxDiff = std::max(r.maxDiff, diff);
+			if (!(diff <= tol)) r.numFailed++;
+		}
+	};
+	auto compareUCHAR4 = [&](const std::string& name, const std::vector<uchar4>& cpu, const std::vector<uchar4>& gpu) {
+		std::vector<float> a(4 * cpu.size()), b(4 * gpu.size());
+		for (size_t i = 0; i < cpu.size(); i++) {
+			a[4 * i + 0] = cpu[i].x;	a[4 * i + 1] = cpu[i].y;	a[4 * i + 2] = cpu[i].z;	a[4 * i + 3] = cpu[i].w;
+			b[4 * i + 0] = gpu[i].x;	b[4 * i + 1] = gpu[i].y;	b[4 * i + 2] = gpu[i].z;	b[4 * i + 3] = gpu[i].w;
+		}
+		compare(name, a.data(), b.data(), a.size(), 1.0f);
+	};
+
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+	for (unsigned int img = 0; img < numImages; img++) {
+		//odd sizes (partial CUDA blocks, scalar tails on the host); depth: slanted planes with steps, noise and holes; color / intensity: smooth gradient plus noise
+		const unsigned int width = 75 + 13 * (img % 8), height = 51 + 7 * (img % 5);
+		const unsigned int numPixels = width * height;
+		const unsigned int outWidth = width * 2 / 3, outHeight = height * 2 / 3;
+		const float sigmaD = 1.0f + (float)(img % 3), sigmaR = 0.05f, colorSigmaR = 0.1f, adaptFactor = 1.5f, maxDepth = 4.0f;
+		const int structureSize = 1 + (int)(img % 3);
+
+		std::vector<float> depth(numPixels), intensity(numPixels);
+		std::vector<uchar4> color(numPixels);
+		const float slope = 0.002f * (float)(img % 4);
+		for (unsigned int y = 0; y < height; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				const unsigned int i = y * width + x;
+				depth[i] = uniform(rng) < 0.08f ? minf : 1.0f + slope * x + ((x / 16 + y / 16) % 2) * 0.5f + 0.01f * uniform(rng);
+				intensity[i] = uniform(rng);
+				const float g = 255.0f * x / width;
+				color[i] = make_uchar4((unsigned char)math::clamp(g + 20.0f * uniform(rng), 0.0f, 255.0f), (unsigned char)(255.0f * uniform(rng)),
+					(unsigned char)math::clamp(255.0f - g, 0.0f, 255.0f), 255);
+			}
+		}
+		const float fx = 0.8f * width, fy = 0.8f * width;
+		const mat4f intrinsics(fx, 0.0f, 0.5f * width, 0.0f, 0.0f, fy, 0.5f * height, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f);
+		const float4x4 intrinsicsInv = MatrixConversion::toCUDA(intrinsics.getInverse());
+
+		float* d_depth = uploadTestImage(depth);
+		float* d_intensity = uploadTestImage(intensity);
+		uchar4* d_color = uploadTestImage(color);
+		std::vector<float> outCPU(numPixels), outGPU(numPixels);
+		std::vector<float4> float4CPU(numPixels), float4GPU(numPixels);
+		std::vector<uchar4> uchar4CPU(numPixels), uchar4GPU(numPixels);
+		std::vector<float2> float2CPU(numPixels), float2GPU(numPixels);
+		float* d_outFloat = NULL;	float4* d_outFloat4 = NULL;	uchar4* d_outUCHAR4 = NULL;	float2* d_outFloat2 = NULL;
+		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_outFloat, sizeof(float)*numPixels));
+		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_outFloat4, sizeof(float4)*numPixels));
+		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_outUCHAR4, sizeof(uchar4)*numPixels));
+		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_outFloat2, sizeof(float2)*numPixels));
+		auto compareFloat = [&](const std::string& name, size_t num) {
+			outGPU.resize(num);	downloadTestImage(outGPU, d_outFloat);
+			compare(name, outCPU.data(), outGPU.data(), num, tolerance);
+		};
+		auto compareFloat4 = [&](const std::string& name, size_t num) {
+			float4GPU.resize(num);	downloadTestImage(float4GPU, d_outFloat4);
+			compare(name, (const float*)float4CPU.data(), (const float*)float4GPU.data(), 4 * num, tolerance);
+		};
+		auto compareUCHAR4Output = [&](const std::string& name, size_t num) {
+			uchar4GPU.resize(num);	downloadTestImage(uchar4GPU, d_outUCHAR4);
+			uchar4CPU.resize(num);
+			compareUCHAR4(name, uchar4CPU, uchar4GPU);
+		};
+
+		//resampling (to 2/3 of the size)
+		CPUImageUtil::resampleToIntensity(outCPU.data(), outWidth, outHeight, color.data(), width, height);
+		CUDAImageUtil::resampleToIntensity(d_outFloat, outWidth, outHeight, d_color, width, height);
+		compareFloat("resampleToIntensity", outWidth*outHeight);
+		CPUImageUtil::resampleFloat(outCPU.data(), outWidth, outHeight, depth.data(), width, height);
+		CUDAImageUtil::resampleFloat(d_outFloat, outWidth, outHeight, d_depth, width, height);
+		compareFloat("resampleFloat", outWidth*outHeight);
+		CPUImageUtil::resampleUCHAR4(uchar4CPU.data(), outWidth, outHeight, color.data(), width, height);
+		CUDAImageUtil::resampleUCHAR4(d_outUCHAR4, outWidth, outHeight, d_color, width, height);
+		compareUCHAR4Output("resampleUCHAR4", outWidth*outHeight);
+		uchar4CPU.resize(numPixels);
+
+		//camera space positions and normals; the host results are the input of both sides
+		std::vector<float4> camPos(numPixels), normals(numPixels);
+		CPUImageUtil::convertDepthFloatToCameraSpaceFloat4(camPos.data(), depth.data(), intrinsicsInv, width, height);
+		CUDAImageUtil::convertDepthFloatToCameraSpaceFloat4(d_outFloat4, d_depth, intrinsicsInv, width, height);
+		float4CPU = camPos;
+		compareFloat4("convertDepthFloatToCameraSpaceFloat4", numPixels);
+		float4* d_camPos = uploadTestImage(camPos);
+		CPUImageUtil::resampleFloat4(float4CPU.data(), outWidth, outHeight, camPos.data(), width, height);
+		CUDAImageUtil::resampleFloat4(d_outFloat4, outWidth, outHeight, d_camPos, width, height);
+		compareFloat4("resampleFloat4", outWidth*outHeight);
+		float4CPU.resize(numPixels);
+		CPUImageUtil::computeNormals(normals.data(), camPos.data(), width, height);
+		CUDAImageUtil::computeNormals(d_outFloat4, d_camPos, width, height);
+		float4CPU = normals;
+		compareFloat4("computeNormals", numPixels);
+		CPUImageUtil::computeNormalsSobel(float4CPU.data(), camPos.data(), width, height);
+		CUDAImageUtil::computeNormalsSobel(d_outFloat4, d_camPos, width, height);
+		compareFloat4("computeNormalsSobel", numPixels);
+		float4* d_normals = uploadTestImage(normals);
+		CPUImageUtil::convertNormalsFloat4ToUCHAR4(uchar4CPU.data(), normals.data(), width, height);
+		CUDAImageUtil::convertNormalsFloat4ToUCHAR4(d_outUCHAR4, d_normals, width, height);
+		compareUCHAR4Output("convertNormalsFloat4ToUCHAR4", numPixels);
+
+		//depth filters
+		CPUImageUtil::gaussFilterDepthMap(outCPU.data(), depth.data(), sigmaD, sigmaR, width, height);
+		CUDAImageUtil::gaussFilterDepthMap(d_outFloat, d_depth, sigmaD, sigmaR, width, height);
+		compareFloat("gaussFilterDepthMap", numPixels);
+		CPUImageUtil::adaptiveGaussFilterDepthMap(outCPU.data(), depth.data(), sigmaD, sigmaR, adaptFactor, width, height);
+		CUDAImageUtil::adaptiveGaussFilterDepthMap(d_outFloat, d_depth, sigmaD, sigmaR, adaptFactor, width, height);
+		compareFloat("adaptiveGaussFilterDepthMap", numPixels);
+		CPUImageUtil::erodeDepthMap(outCPU.data(), depth.data(), structureSize, width, height, 0.05f, 0.3f);
+		CUDAImageUtil::erodeDepthMap(d_outFloat, d_depth, structureSize, width, height, 0.05f, 0.3f);
+		compareFloat("erodeDepthMap", numPixels);
+		{
+			const unsigned int gridSize = CUDAImageUtil::getBilateralGridSize(width, height, sigmaD, sigmaR, maxDepth);
+			float2* d_grid = NULL;	float2* d_gridHelper = NULL;
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_grid, sizeof(float2)*gridSize));
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_gridHelper, sizeof(float2)*gridSize));
+			CPUImageUtil::bilateralGridFilterDepthMap(outCPU.data(), depth.data(), sigmaD, sigmaR, maxDepth, width, height);
+			CUDAImageUtil::bilateralGridFilterDepthMap(d_outFloat, d_depth, d_grid, d_gridHelper, sigmaD, sigmaR, maxDepth, width, height);
+			compareFloat("bilateralGridFilterDepthMap", numPixels);
+			MLIB_CUDA_SAFE_FREE(d_grid);
+			MLIB_CUDA_SAFE_FREE(d_gridHelper);
+		}
+
+		//color / intensity filters
+		CPUImageUtil::jointBilateralFilterColorUCHAR4(uchar4CPU.data(), color.data(), depth.data(), sigmaD, sigmaR, width, height);
+		CUDAImageUtil::jointBilateralFilterColorUCHAR4(d_outUCHAR4, d_color, d_depth, sigmaD, sigmaR, width, height);
+		compareUCHAR4Output("jointBilateralFilterColorUCHAR4", numPixels);
+		{
+			const unsigned int gridSize = CUDAImageUtil::getBilateralGridSize(width, height, sigmaD, colorSigmaR, maxDepth);
+			float4* d_grid = NULL;	float4* d_gridHelper = NULL;
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_grid, sizeof(float4)*gridSize));
+			MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_gridHelper, sizeof(float4)*gridSize));
+			CPUImageUtil::bilateralGridFilterColorUCHAR4(uchar4CPU.data(), color.data(), depth.data(), sigmaD, colorSigmaR, maxDepth, width, height);
+			CUDAImageUtil::bilateralGridFilterColorUCHAR4(d_outUCHAR4, d_color, d_depth, d_grid, d_gridHelper, sigmaD, colorSigmaR, maxDepth, width, height);
+			compareUCHAR4Output("bilateralGridFilterColorUCHAR4", numPixels);
+			MLIB_CUDA_SAFE_FREE(d_grid);
+			MLIB_CUDA_SAFE_FREE(d_gridHelper);
+		}
+		CPUImageUtil::convertUCHAR4ToIntensityFloat(outCPU.data(), color.data(), width, height);
+		CUDAImageUtil::convertUCHAR4ToIntensityFloat(d_outFloat, d_color, width, height);
+		compareFloat("convertUCHAR4ToIntensityFloat", numPixels);
+		CPUImageUtil::gaussFilterIntensity(outCPU.data(), intensity.data(), sigmaD, width, height);
+		CUDAImageUtil::gaussFilterIntensity(d_outFloat, d_intensity, sigmaD, width, height);
+		compareFloat("gaussFilterIntensity", numPixels);
+		CPUImageUtil::jointBilateralFilterFloat(outCPU.data(), intensity.data(), depth.data(), sigmaD, sigmaR, width, height);
+		CUDAImageUtil::jointBilateralFilterFloat(d_outFloat, d_intensity, d_depth, sigmaD, sigmaR, width, height);
+		compareFloat("jointBilateralFilterFloat", numPixels);
+		CPUImageUtil::adaptiveGaussFilterIntensity(outCPU.data(), intensity.data(), depth.data(), sigmaD, adaptFactor, width, height);
+		CUDAImageUtil::adaptiveGaussFilterIntensity(d_outFloat, d_intensity, d_depth, sigmaD, adaptFactor, width, height);
+		compareFloat("adaptiveGaussFilterIntensity", numPixels);
+		CPUImageUtil::adaptiveBilateralFilterIntensity(outCPU.data(), intensity.data(), depth.data(), sigmaD, sigmaR, adaptFactor, width, height);
+		CUDAImageUtil::adaptiveBilateralFilterIntensity(d_outFloat, d_intensity, d_depth, sigmaD, sigmaR, adaptFactor, width, height);
+		compareFloat("adaptiveBilateralFilterIntensity", numPixels);
+		CPUImageUtil::computeIntensityGradientMagnitude(outCPU.data(), intensity.data(), width, height);
+		CUDAImageUtil::computeIntensityGradientMagnitude(d_outFloat, d_intensity, width, height);
+		compareFloat("computeIntensityGradientMagnitude", numPixels);
+		CPUImageUtil::computeIntensityDerivatives(float2CPU.data(), intensity.data(), width, height);
+		CUDAImageUtil::computeIntensityDerivatives(d_outFloat2, d_intensity, width, height);
+		downloadTestImage(float2GPU, d_outFloat2);
+		compare("computeIntensityDerivatives", (const float*)float2CPU.data(), (const float*)float2GPU.data(), 2 * numPixels, tolerance);
+
+		MLIB_CUDA_SAFE_FREE(d_depth);
+		MLIB_CUDA_SAFE_FREE(d_intensity);
+		MLIB_CUDA_SAFE_FREE(d_color);
+		MLIB_CUDA_SAFE_FREE(d_camPos);
+		MLIB_CUDA_SAFE_FREE(d_normals);
+		MLIB_CUDA_SAFE_FREE(d_outFloat);
+		MLIB_CUDA_SAFE_FREE(d_outFloat4);
+		MLIB_CUDA_SAFE_FREE(d_outUCHAR4);
+		MLIB_CUDA_SAFE_FREE(d_outFloat2);
+	}
+
+	bool bPassed = true;
+	std::cout << "CPUImageUtil vs. CUDAImageUtil: " << numImages << " images, tolerance " << tolerance << " (uchar4: 1), at most " << 100.0 * maxFailedFraction << "% failed values" << std::endl;
+	for (const auto& r : results) {
+		const bool bFailed = r.second.numFailed > maxFailedFraction * r.second.numValues;
+		std::cout << "\t" << r.first << ": max diff " << r.second.maxDiff << ", failed values " << r.second.numFailed << " of " << r.second.numValues << (bFailed ? ", FAILED" : ", ok") << std::endl;
+		if (bFailed) bPassed = false;
+	}
+	return bPassed;
+}
+
+void benchmarkSIFT(const std::string& filename, unsigned int maxNumFrames)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	if (numFrames == 0) throw MLIB_EXCEPTION("no frames in " + filename);
+	const unsigned int widthSIFT = GlobalBundlingState::get().s_widthSIFT, heightSIFT = GlobalBundlingState::get().s_heightSIFT;
+	const unsigned int depthWidth = data.m_depthWidth, depthHeight = data.m_depthHeight;
+	const unsigned int maxNumKeys = GlobalBundlingState::get().s_maxNumKeysPerImage;
+	std::cout << "sift detector benchmark: " << filename << " (" << numFrames << " frames, sift " << widthSIFT << "x" << heightSIFT << ", " << ThreadPool::get().getNumThreads() << " threads)" << std::endl;
+
+	SiftCameraParams siftCameraParams;
+	memset(&siftCameraParams, 0, sizeof(SiftCameraParams));
+	siftCameraParams.m_depthWidth = depthWidth;
+	siftCameraParams.m_depthHeight = depthHeight;
+	siftCameraParams.m_intensityWidth = widthSIFT;
+	siftCameraParams.m_intensityHeight = heightSIFT;
+	siftCameraParams.m_minKeyScale = GlobalBundlingState::get().s_minKeyScale;
+	updateConstantSiftCameraParams(siftCameraParams);
+
+	//0 = GPU, 1 = CPU, 2 = CPU without the pipelined pyramid
+	const unsigned int numBackends = 3;
+	const char* names[] = { "gpu", "cpu", "cpu (level by level)" };
+	SiftGPU* sift[numBackends];
+	SIFTImageGPU images[numBackends];
+	for (unsigned int b = 0; b < numBackends; b++) {
+		sift[b] = new SiftGPU;
+		sift[b]->SetParams(widthSIFT, heightSIFT, false, 150, GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax, b > 0);
+		sift[b]->SetPipelinedPyramid(b != 2);
+		sift[b]->InitSiftGPU();
+		MLIB_CUDA_SAFE_CALL(cudaMalloc(&images[b].d_keyPoints, sizeof(SIFTKeyPoint)*maxNumKeys));
+		MLIB_CUDA_SAFE_CALL(cudaMalloc(&images[b].d_keyPointDescs, sizeof(SIFTKeyPointDesc)*maxNumKeys));
+	}
+	float* d_intensity = NULL;	float* d_depth = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_intensity, sizeof(float)*widthSIFT*heightSIFT));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depth, sizeof(float)*depthWidth*depthHeight));
+
+	std::vector<float> depth, intensity;
+	std::vector<SIFTKeyPoint> keys[numBackends];
+	std::vector<SIFTKeyPointDesc> descs[numBackends];
+
+	Timer timer;
+	double time[numBackends] = { 0.0, 0.0, 0.0 };
+	size_t numKeysTotal[numBackends] = { 0, 0, 0 }, numRepeated = 0, numMinKeys = 0;
+	double sumDescDist = 0.0;
+	for (unsigned int f = 0; f < numFrames; f++) {
+		loadSIFTInput(data, f, widthSIFT, heightSIFT, intensity, depth);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensity, intensity.data(), sizeof(float)*intensity.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depth, depth.data(), sizeof(float)*depth.size(), cudaMemcpyHostToDevice));
+
+		for (unsigned int b = 0; b < numBackends; b++) {
+			if (f == 0) sift[b]->RunSIFT(d_intensity, d_depth);	//warm up
+			MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+			timer.start();
+			if (!sift[b]->RunSIFT(d_intensity, d_depth)) throw MLIB_EXCEPTION("Error running SIFT detection");
+			const unsigned int numKeys = std::min(sift[b]->GetKeyPointsAndDescriptorsCUDA(images[b], d_depth, maxNumKeys), maxNumKeys);
+			MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+			timer.stop();
+			time[b] += timer.getElapsedTimeMS();
+
+			keys[b].resize(numKeys);
+			descs[b].resize(numKeys);
+			if (numKeys > 0) {
+				MLIB_CUDA_SAFE_CALL(cudaMemcpy(keys[b].data(), images[b].d_keyPoints, sizeof(SIFTKeyPoint)*numKeys, cudaMemcpyDeviceToHost));
+				MLIB_CUDA_SAFE_CALL(cudaMemcpy(descs[b].data(), images[b].d_keyPointDescs, sizeof(SIFTKeyPointDesc)*numKeys, cudaMemcpyDeviceToHost));
+			}
+			numKeysTotal[b] += numKeys;
+		}
+
+		//a GPU keypoint is repeated if there is a CPU keypoint at the same scale within 1.5 pixels (the closest descriptor of those counts for the distance)
+		for (size_t i = 0; i < keys[0].size(); i++) {
+			float minDist = std::numeric_limits<float>::infinity();
+			for (size_t j = 0; j < keys[1].size(); j++) {
+				const float dx = keys[0][i].pos.x - keys[1][j].pos.x, dy = keys[0][i].pos.y - keys[1][j].pos.y;
+				if (dx*dx + dy*dy > 2.25f || std::abs(keys[0][i].scale / keys[1][j].scale - 1.0f) > 0.1f) continue;
+				float dist = 0.0f;
+				for (unsigned int k = 0; k < 128; k++) {
+					const float d = ((float)descs[0][i].feature[k] - (float)descs[1][j].feature[k]) / 512.0f;
+					dist += d*d;
+				}
+				minDist = std::min(minDist, std::sqrt(dist));
+			}
+			if (minDist != std::numeric_limits<float>::infinity()) {
+				numRepeated++;
+				sumDescDist += minDist;
+			}
+		}
+		numMinKeys += std::min(keys[0].size(), keys[1].size());
+	}
+
+	for (unsigned int b = 0; b < numBackends; b++) {
+		std::cout << "\t" << names[b] << ":\t" << time[b] / numFrames << " ms/frame\t" << (double)numKeysTotal[b] / numFrames << " keypoints/frame" << std::endl;
+	}
+	std::cout << "\tcpu/gpu time ratio " << time[1] / std::max(time[0], 1e-6) << "\tpipelined pyramid speedup " << time[2] / std::max(time[1], 1e-6)
+		<< "\trepeatability " << 100.0 * (double)std::min(numRepeated, numMinKeys) / (double)std::max(numMinKeys, (size_t)1) << "%"
+		<< "\tmean descriptor distance " << sumDescDist / (double)std::max(numRepeated, (size_t)1) << std::endl;
+
+	for (unsigned int b = 0; b < numBackends; b++) {
+		MLIB_CUDA_SAFE_FREE(images[b].d_keyPoints);
+		MLIB_CUDA_SAFE_FREE(images[b].d_keyPointDescs);
+		SAFE_DELETE(sift[b]);
+	}
+	MLIB_CUDA_SAFE_FREE(d_intensity);
+	MLIB_CUDA_SAFE_FREE(d_depth);
+}
+
+//! exact top two dot products of descriptor i of a against the num descriptors of b
+static int2 siftMatchTop2(const SIFTKeyPointDesc& a, const std::vector<SIFTKeyPointDesc>& b)
+{
+	int2 top = make_int2(0, 0);
+	for (const SIFTKeyPointDesc& d : b) {
+		int dot = 0;
+		for (unsigned int k = 0; k < 128; k++) dot += (int)a.feature[k] * (int)d.feature[k];
+		if (dot > top.x) { top.y = top.x; top.x = dot; }
+		else if (dot > top.y) top.y = dot;
+	}
+	return top;
+}
+
+//! true if the distance or ratio test of the top two dot products is decided within tol (radians)
+static bool isSiftMatchTestBorderline(int2 top, float distmax, float ratiomax, float tol)
+{
+	const double dist = std::acos(std::min(top.x / 262144.0, 1.0));
+	const double distn = std::acos(std::min(top.y / 262144.0, 1.0));
+	return std::abs(dist - distmax) <= tol || std::abs(dist - distn * ratiomax) <= tol;
+}
+
+bool testSiftMatchCPU(const std::string& filename, unsigned int maxNumFrames)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	if (numFrames < 2) throw MLIB_EXCEPTION("need at least two frames in " + filename);
+	const GlobalBundlingState& state = GlobalBundlingState::get();
+	const unsigned int widthSIFT = state.s_widthSIFT, heightSIFT = state.s_heightSIFT;
+	const unsigned int depthWidth = data.m_depthWidth, depthHeight = data.m_depthHeight;
+	const unsigned int maxNumKeys = state.s_maxNumKeysPerImage;
+	const float distmax = state.s_siftMatchThresh, ratiomax = state.s_siftMatchRatioMaxLocal;
+	//the dot products are exact integers on both sides; only acosf (a few ulp on the device) and the float ratio product can flip a test that is decided this close
+	const float tol = 1e-5f;
+	std::cout << "sift match cpu vs. gpu: " << filename << " (" << numFrames << " frames, distmax " << distmax << ", ratiomax " << ratiomax << ", tolerance " << tol << " rad)" << std::endl;
+
+	SiftCameraParams siftCameraParams;
+	memset(&siftCameraParams, 0, sizeof(SiftCameraParams));
+	siftCameraParams.m_depthWidth = depthWidth;
+	siftCameraParams.m_depthHeight = depthHeight;
+	siftCameraParams.m_intensityWidth = widthSIFT;
+	siftCameraParams.m_intensityHeight = heightSIFT;
+	siftCameraParams.m_minKeyScale = state.s_minKeyScale;
+	updateConstantSiftCameraParams(siftCameraParams);
+
+	//gpu descriptors of every frame (as the bundler matches them)
+	SiftGPU sift;
+	sift.SetParams(widthSIFT, heightSIFT, false, 150, GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax);
+	sift.InitSiftGPU();
+	SIFTImageGPU image;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&image.d_keyPoints, sizeof(SIFTKeyPoint)*maxNumKeys));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&image.d_keyPointDescs, sizeof(SIFTKeyPointDesc)*maxNumKeys));
+	float* d_intensity = NULL;	float* d_depth = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_intensity, sizeof(float)*widthSIFT*heightSIFT));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depth, sizeof(float)*depthWidth*depthHeight));
+	std::vector<float> depth, intensity;
+	std::vector<std::vector<SIFTKeyPointDesc>> descs(numFrames);
+	for (unsigned int f = 0; f < numFrames; f++) {
+		loadSIFTInput(data, f, widthSIFT, heightSIFT, intensity, depth);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensity, intensity.data(), sizeof(float)*intensity.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depth, depth.data(), sizeof(float)*depth.size(), cudaMemcpyHostToDevice));
+		if (!sift.RunSIFT(d_intensity, d_depth)) throw MLIB_EXCEPTION("Error running SIFT detection");
+		const unsigned int numKeys = std::min(sift.GetKeyPointsAndDescriptorsCUDA(image, d_depth, maxNumKeys), maxNumKeys);
+		descs[f].resize(numKeys);
+		if (numKeys > 0) MLIB_CUDA_SAFE_CALL(cudaMemcpy(descs[f].data(), image.d_keyPointDescs, sizeof(SIFTKeyPointDesc)*numKeys, cudaMemcpyDeviceToHost));
+	}
+	MLIB_CUDA_SAFE_FREE(image.d_keyPoints);
+	MLIB_CUDA_SAFE_FREE(image.d_keyPointDescs);
+	MLIB_CUDA_SAFE_FREE(d_intensity);
+	MLIB_CUDA_SAFE_FREE(d_depth);
+
+	SiftMatchGPU matcherGPU(maxNumKeys);
+	matcherGPU.InitSiftMatch();
+	SiftMatchCPU matcherCPU(maxNumKeys);
+	ImagePairMatch match;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&match.d_numMatches, sizeof(int)));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&match.d_distances, sizeof(float)*MAX_MATCHES_PER_IMAGE_PAIR_RAW));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&match.d_keyPointIndices, sizeof(uint2)*MAX_MATCHES_PER_IMAGE_PAIR_RAW));
+	unsigned char* d_descs[2] = { NULL, NULL };
+	for (unsigned int s = 0; s < 2; s++) MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_descs[s], sizeof(SIFTKeyPointDesc)*maxNumKeys));
+
+	//each frame against its predecessor and against frames 5 and 20 back (less overlap, more ratio test rejections)
+	const unsigned int offsets[] = { 1, 5, 20 };
+	std::vector<uint2> indicesGPU(MAX_MATCHES_PER_IMAGE_PAIR_RAW), indicesCPU(MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	std::vector<float> distancesGPU(MAX_MATCHES_PER_IMAGE_PAIR_RAW), distancesCPU(MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	size_t numPairs = 0, numSkipped = 0, numCommon = 0, numBorderline = 0, numMismatch = 0;
+	float maxDistanceDiff = 0.0f;
+	for (unsigned int j = 1; j < numFrames; j++) {
+		for (unsigned int o : offsets) {
+			if (o > j) continue;
+			const unsigned int i = j - o;
+			const int num[2] = { (int)descs[i].size(), (int)descs[j].size() };
+			if (num[0] == 0 || num[1] == 0) continue;
+			for (unsigned int s = 0; s < 2; s++) {
+				MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_descs[s], (s == 0 ? descs[i] : descs[j]).data(), sizeof(SIFTKeyPointDesc)*num[s], cudaMemcpyHostToDevice));
+				matcherGPU.SetDescriptors(s, num[s], d_descs[s]);
+				matcherCPU.SetDescriptorsFromCPU(s, num[s], (const unsigned char*)(s == 0 ? descs[i] : descs[j]).data());
+			}
+			matcherGPU.GetSiftMatch(MAX_MATCHES_PER_IMAGE_PAIR_RAW, match, make_uint2(0, 0), distmax, ratiomax);
+			int numGPU = 0;
+			MLIB_CUDA_SAFE_CALL(cudaMemcpy(&numGPU, match.d_numMatches, sizeof(int), cudaMemcpyDeviceToHost));
+			const unsigned int numCPU = matcherCPU.GetSiftMatchHost(indicesCPU.data(), distancesCPU.data(), MAX_MATCHES_PER_IMAGE_PAIR_RAW, make_uint2(0, 0), distmax, ratiomax);
+			//beyond the buffer the gpu keeps whichever matches won the atomic counter
+			if (numGPU > MAX_MATCHES_PER_IMAGE_PAIR_RAW || numCPU > MAX_MATCHES_PER_IMAGE_PAIR_RAW) { numSkipped++; continue; }
+			if (numGPU > 0) {
+				MLIB_CUDA_SAFE_CALL(cudaMemcpy(indicesGPU.data(), match.d_keyPointIndices, sizeof(uint2)*numGPU, cudaMemcpyDeviceToHost));
+				MLIB_CUDA_SAFE_CALL(cudaMemcpy(distancesGPU.data(), match.d_distances, sizeof(float)*numGPU, cudaMemcpyDeviceToHost));
+			}
+			numPairs++;
+
+			//gpu order depends on the atomic counter: compare as sets keyed by the index pair
+			std::map<std::pair<unsigned int, unsigned int>, float> gpu, cpu;
+			for (int m = 0; m < numGPU; m++) gpu[std::make_pair(indicesGPU[m].x, indicesGPU[m].y)] = distancesGPU[m];
+			for (unsigned int m = 0; m < numCPU; m++) cpu[std::make_pair(indicesCPU[m].x, indicesCPU[m].y)] = distancesCPU[m];
+			auto checkOneSided = [&](const std::map<std::pair<unsigned int, unsigned int>, float>& a, const std::map<std::pair<unsigned int, unsigned int>, float>& b) {
+				for (const auto& m : a) {
+					const auto it = b.find(m.first);
+					if (it != b.end()) {
+						if (&a == &gpu) {
+							numCommon++;
+							maxDistanceDiff = std::max(maxDistanceDiff, std::abs(m.second - it->second));
+						}
+						continue;
+					}
+					//the match exists on one side only: fine if its row or column test is decided within the tolerance
+					const int2 rowTop = siftMatchTop2(descs[i][m.first.first], descs[j]);
+					const int2 colTop = siftMatchTop2(descs[j][m.first.second], descs[i]);
+					if (isSiftMatchTestBorderline(rowTop, distmax, ratiomax, tol) || isSiftMatchTestBorderline(colTop, distmax, ratiomax, tol)) numBorderline++;
+					else {
+						numMismatch++;
+						std::cout << "\tframes " << i << "-" << j << ": match " << m.first.first << "-" << m.first.second << " only on the " << (&a == &gpu ? "gpu" : "cpu") << std::endl;
+					}
+				}
+			};
+			checkOneSided(gpu, cpu);
+			checkOneSided(cpu, gpu);
+		}
+	}
+
+	for (unsigned int s = 0; s < 2; s++) MLIB_CUDA_SAFE_FREE(d_descs[s]);
+	MLIB_CUDA_SAFE_FREE(match.d_numMatches);
+	MLIB_CUDA_SAFE_FREE(match.d_distances);
+	MLIB_CUDA_SAFE_FREE(match.d_keyPointIndices);
+
+	const bool bPassed = numMismatch == 0 && maxDistanceDiff <= tol;
+	std::cout << "\t" << numPairs << " image pairs (" << numSkipped << " skipped, more than " << MAX_MATCHES_PER_IMAGE_PAIR_RAW << " matches): " << numCommon << " common matches, max distance difference " << maxDistanceDiff
+		<< ", " << numBorderline << " one-sided within the tolerance, " << numMismatch << " one-sided outside" << std::endl;
+	std::cout << (bPassed ? "PASSED" : "FAILED") << std::endl;
+	return bPassed;
+}
+
+bool testSiftFilterCPU(const std::string& filename, unsigned int maxNumFrames)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	if (numFrames < 2) throw MLIB_EXCEPTION("need at least two frames in " + filename);
+	const GlobalBundlingState& state = GlobalBundlingState::get();
+	const unsigned int widthSIFT = state.s_widthSIFT, heightSIFT = state.s_heightSIFT;
+	const unsigned int maxNumKeys = state.s_maxNumKeysPerImage;
+	const unsigned int minNumMatches = state.s_minNumMatchesLocal;
+	const float maxKabschRes2 = state.s_maxKabschResidual2;
+	//the greedy filter runs the same float code on both sides, only the transforms may differ by the device's fused multiply-adds
+	const float tol = 1e-4f;
+	std::cout << "sift filter cpu vs. gpu: " << filename << " (" << numFrames << " frames, each against all previous ones, transform tolerance " << tol << ")" << std::endl;
+
+	SiftCameraParams siftCameraParams;
+	memset(&siftCameraParams, 0, sizeof(SiftCameraParams));
+	siftCameraParams.m_depthWidth = data.m_depthWidth;
+	siftCameraParams.m_depthHeight = data.m_depthHeight;
+	siftCameraParams.m_intensityWidth = widthSIFT;
+	siftCameraParams.m_intensityHeight = heightSIFT;
+	siftCameraParams.m_minKeyScale = state.s_minKeyScale;
+	updateConstantSiftCameraParams(siftCameraParams);
+	//as BundlerInputData scales the color intrinsics to the sift resolution
+	mat4f siftIntrinsics = data.m_calibrationColor.m_intrinsic;
+	siftIntrinsics._m00 *= (float)widthSIFT / (float)data.m_colorWidth;
+	siftIntrinsics._m11 *= (float)heightSIFT / (float)data.m_colorHeight;
+	siftIntrinsics._m02 *= (float)(widthSIFT - 1) / (float)(data.m_colorWidth - 1);
+	siftIntrinsics._m12 *= (float)(heightSIFT - 1) / (float)(data.m_colorHeight - 1);
+	const float4x4 siftIntrinsicsInv = MatrixConversion::toCUDA(siftIntrinsics.getInverse());
+
+	SiftGPU sift;
+	sift.SetParams(widthSIFT, heightSIFT, false, 150, GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax);
+	sift.InitSiftGPU();
+	SiftMatchGPU matcher(maxNumKeys);
+	matcher.InitSiftMatch();
+	SIFTImageManager siftManager(numFrames, maxNumKeys);
+	float* d_intensity = NULL;	float* d_depth = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_intensity, sizeof(float)*widthSIFT*heightSIFT));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depth, sizeof(float)*data.m_depthWidth*data.m_depthHeight));
+
+	std::vector<float> depth, intensity;
+	std::vector<std::vector<uint2>> indicesGPU, indicesCPU;
+	std::vector<std::vector<float>> distancesGPU, distancesCPU;
+	std::vector<float4x4> transformsGPU, transformsCPU;
+	//filtered matches and (inverse) transforms of the pairs with the previous frames
+	auto download = [&](unsigned int numPairs, std::vector<std::vector<uint2>>& indices, std::vector<std::vector<float>>& distances, std::vector<float4x4>& transformsInv) {
+		indices.resize(numPairs);	distances.resize(numPairs);	transformsInv.resize(numPairs);
+		for (unsigned int p = 0; p < numPairs; p++) siftManager.getFiltKeyPointIndicesAndMatchDistancesDEBUG(p, indices[p], distances[p]);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(transformsInv.data(), siftManager.getFiltTransformsToWorldGPU(), sizeof(float4x4)*numPairs, cudaMemcpyDeviceToHost));
+	};
+	Timer timer;
+	double timeGPU = 0.0, timeCPU = 0.0, timeRANSAC = 0.0;
+	size_t numPairs = 0, numValidPairs = 0, numValidRANSAC = 0, numMismatch = 0;
+	float maxTransformDiff = 0.0f;
+	for (unsigned int f = 0; f < numFrames; f++) {
+		loadSIFTInput(data, f, widthSIFT, heightSIFT, intensity, depth);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensity, intensity.data(), sizeof(float)*intensity.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depth, depth.data(), sizeof(float)*depth.size(), cudaMemcpyHostToDevice));
+		SIFTImageGPU& cur = siftManager.createSIFTImageGPU();
+		if (!sift.RunSIFT(d_intensity, d_depth)) throw MLIB_EXCEPTION("Error running SIFT detection");
+		siftManager.finalizeSIFTImageGPU(std::min(sift.GetKeyPointsAndDescriptorsCUDA(cur, d_depth, maxNumKeys), maxNumKeys));
+		if (f == 0) continue;
+
+		//raw matches of the frame against all previous ones, sorted as the bundler sorts them
+		const int numCur = (int)siftManager.getNumKeyPointsPerImage(f);
+		matcher.SetDescriptors(1, numCur, (unsigned char*)siftManager.getImageGPU(f).d_keyPointDescs);
+		for (unsigned int prev = 0; prev < f; prev++) {
+			uint2 keyPointOffset = make_uint2(0, 0);
+			ImagePairMatch& imagePairMatch = siftManager.getImagePairMatch(prev, f, keyPointOffset);
+			const int numPrev = (int)siftManager.getNumKeyPointsPerImage(prev);
+			if (numPrev == 0 || numCur == 0) {
+				const unsigned int numMatch = 0;
+				MLIB_CUDA_SAFE_CALL(cudaMemcpy(imagePairMatch.d_numMatches, &numMatch, sizeof(unsigned int), cudaMemcpyHostToDevice));
+				continue;
+			}
+			matcher.SetDescriptors(0, numPrev, (unsigned char*)siftManager.getImageGPU(prev).d_keyPointDescs);
+			matcher.GetSiftMatch(MAX_MATCHES_PER_IMAGE_PAIR_RAW, imagePairMatch, keyPointOffset, state.s_siftMatchThresh, state.s_siftMatchRatioMaxLocal);
+		}
+		siftManager.SortKeyPointMatchesCU(f, 0, f + 1);
+
+		MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		timer.start();
+		siftManager.FilterKeyPointMatchesCU(f, 0, f + 1, siftIntrinsicsInv, minNumMatches, maxKabschRes2);
+		MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		timer.stop();	timeGPU += timer.getElapsedTimeMS();
+		download(f, indicesGPU, distancesGPU, transformsGPU);
+		timer.start();
+		SIFTMatchFilter::filterKeyPointMatchesCPU(&siftManager, f, 0, f + 1, siftIntrinsicsInv, minNumMatches, maxKabschRes2);
+		timer.stop();	timeCPU += timer.getElapsedTimeMS();
+		download(f, indicesCPU, distancesCPU, transformsCPU);
+		for (unsigned int prev = 0; prev < f; prev++) {
+			numPairs++;
+			const size_t num = indicesGPU[prev].size();
+			bool bEqual = num == indicesCPU[prev].size();
+			for (size_t m = 0; m < num && bEqual; m++) {
+				bEqual = indicesGPU[prev][m].x == indicesCPU[prev][m].x && indicesGPU[prev][m].y == indicesCPU[prev][m].y && distancesGPU[prev][m] == distancesCPU[prev][m];
+			}
+			if (!bEqual) {
+				numMismatch++;
+				std::cout << "\tframes " << prev << "-" << f << ": " << num << " filtered matches on the gpu, " << indicesCPU[prev].size() << " on the cpu" << (num == indicesCPU[prev].size() ? " (different matches)" : "") << std::endl;
+				continue;
+			}
+			if (num == 0) continue;
+			numValidPairs++;
+			for (unsigned int i = 0; i < 16; i++) maxTransformDiff = std::max(maxTransformDiff, std::abs(transformsGPU[prev].entries[i] - transformsCPU[prev].entries[i]));
+		}
+
+		//the RANSAC filter has no device counterpart: only its runtime and how many pairs it keeps
+		timer.start();
+		SIFTMatchFilter::ransacKeyPointMatches(&siftManager, f, 0, f + 1, siftIntrinsicsInv, minNumMatches, maxKabschRes2, false);
+		timer.stop();	timeRANSAC += timer.getElapsedTimeMS();
+		std::vector<int> numRANSAC(f);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(numRANSAC.data(), siftManager.getNumFiltMatchesGPU(), sizeof(int)*f, cudaMemcpyDeviceToHost));
+		for (unsigned int prev = 0; prev < f; prev++) {
+			if (numRANSAC[prev] > 0) numValidRANSAC++;
+		}
+	}
+	MLIB_CUDA_SAFE_FREE(d_intensity);
+	MLIB_CUDA_SAFE_FREE(d_depth);
+
+	const bool bPassed = numMismatch == 0 && maxTransformDiff <= tol;
+	std::cout << "\t" << numPairs << " image pairs, " << numValidPairs << " valid on both: " << numMismatch << " differ, max transform difference " << maxTransformDiff << std::endl;
+	std::cout << "\tgpu " << timeGPU / (numFrames - 1) << " ms/frame\tcpu " << timeCPU / (numFrames - 1) << " ms/frame (" << ThreadPool::get().getNumThreads() << " threads)"
+		<< "\tcpu RANSAC " << timeRANSAC / (numFrames - 1) << " ms/frame (" << numValidRANSAC << " valid pairs)" << std::endl;
+	std::cout << (bPassed ? "PASSED" : "FAILED") << std::endl;
+	return bPassed;
+}
+
+//! candidates[i] = 1 for the previous frames i < cur which a global match with topK retrieval would try (see Bundler::selectMatchCandidates)
+static void selectBenchmarkCandidates(const std::vector<float>& scores, bool bValid, unsigned int cur, unsigned int topK, unsigned int numTemporal, std::vector<char>& candidates)
+{
+	candidates.assign(cur, 1);
+	if (!bValid || cur <= topK) return;
+	std::vector<std::pair<float, unsigned int>> ranked(cur);
+	for (unsigned int i = 0; i < cur; i++) ranked[i] = std::make_pair(i < scores.size() ? scores[i] : 0.0f, i);
+	std::partial_sort(ranked.begin(), ranked.begin() + topK, ranked.end(), std::greater<std::pair<float, unsigned int>>());
+	candidates.assign(cur, 0);
+	for (unsigned int i = 0; i < topK; i++) candidates[ranked[i].second] = 1;
+	for (unsigned int i = 1; i <= std::min(cur, numTemporal); i++) candidates[cur - i] = 1;
+}
+
+void benchmarkPlaceRecognition(const std::string& filename, unsigned int maxNumFrames)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	if (numFrames == 0) throw MLIB_EXCEPTION("no frames in " + filename);
+	const GlobalBundlingState& state = GlobalBundlingState::get();
+	const unsigned int widthSIFT = state.s_widthSIFT, heightSIFT = state.s_heightSIFT;
+	const unsigned int maxNumKeys = state.s_maxNumKeysPerImage;
+	const unsigned int keyFrameStep = std::max(state.s_submapSize, 1u);
+
+	//sift of every submap key frame
+	SiftCameraParams siftCameraParams;
+	memset(&siftCameraParams, 0, sizeof(SiftCameraParams));
+	siftCameraParams.m_depthWidth = data.m_depthWidth;
+	siftCameraParams.m_depthHeight = data.m_depthHeight;
+	siftCameraParams.m_intensityWidth = widthSIFT;
+	siftCameraParams.m_intensityHeight = heightSIFT;
+	siftCameraParams.m_minKeyScale = state.s_minKeyScale;
+	updateConstantSiftCameraParams(siftCameraParams);
+
+	SiftGPU* sift = new SiftGPU;
+	sift->SetParams(widthSIFT, heightSIFT, false, 150, GlobalAppState::get().s_sensorDepthMin, GlobalAppState::get().s_sensorDepthMax, state.s_siftDetectorCPU);
+	sift->SetPipelinedPyramid(state.s_siftPipelinedPyramid);
+	sift->InitSiftGPU();
+	SIFTImageGPU image;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&image.d_keyPoints, sizeof(SIFTKeyPoint)*maxNumKeys));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&image.d_keyPointDescs, sizeof(SIFTKeyPointDesc)*maxNumKeys));
+	float* d_intensity = NULL;	float* d_depth = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_intensity, sizeof(float)*widthSIFT*heightSIFT));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depth, sizeof(float)*data.m_depthWidth*data.m_depthHeight));
+
+	std::vector<float> depth, intensity;
+	std::vector<std::vector<SIFTKeyPointDesc>> descs;
+	for (unsigned int f = 0; f < numFrames; f += keyFrameStep) {
+		loadSIFTInput(data, f, widthSIFT, heightSIFT, intensity, depth);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_intensity, intensity.data(), sizeof(float)*intensity.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depth, depth.data(), sizeof(float)*depth.size(), cudaMemcpyHostToDevice));
+		if (!sift->RunSIFT(d_intensity, d_depth)) throw MLIB_EXCEPTION("Error running SIFT detection");
+		const unsigned int numKeys = std::min(sift->GetKeyPointsAndDescriptorsCUDA(image, d_depth, maxNumKeys), maxNumKeys);
+		descs.push_back(std::vector<SIFTKeyPointDesc>(numKeys));
+		if (numKeys > 0) MLIB_CUDA_SAFE_CALL(cudaMemcpy(descs.back().data(), image.d_keyPointDescs, sizeof(SIFTKeyPointDesc)*numKeys, cudaMemcpyDeviceToHost));
+	}
+	MLIB_CUDA_SAFE_FREE(image.d_keyPoints);
+	MLIB_CUDA_SAFE_FREE(image.d_keyPointDescs);
+	MLIB_CUDA_SAFE_FREE(d_intensity);
+	MLIB_CUDA_SAFE_FREE(d_depth);
+	SAFE_DELETE(sift);
+	const unsigned int numKeyFrames = (unsigned int)descs.size();
+	std::cout << "place recognition benchmark: " << filename << " (" << numKeyFrames << " key frames, every " << keyFrameStep << "th of " << numFrames << " frames)" << std::endl;
+
+	//exhaustive matching (as without retrieval): pairs with at least s_minNumMatchesGlobal raw matches overlap
+	SiftMatchCPU matcher(maxNumKeys);
+	std::vector<uint2> keyPointIndices(MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	std::vector<float> matchDistances(MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	std::vector<double> pairTime(numKeyFrames*numKeyFrames, 0.0);
+	std::vector<char> overlap(numKeyFrames*numKeyFrames, 0);
+	Timer timer;
+	double exhaustiveTime = 0.0;
+	size_t numOverlaps = 0, numTemporalOverlaps = 0;
+	for (unsigned int j = 1; j < numKeyFrames; j++) {
+		for (unsigned int i = 0; i < j; i++) {
+			timer.start();
+			matcher.SetDescriptorsFromCPU(0, (int)descs[i].size(), (const unsigned char*)descs[i].data());
+			matcher.SetDescriptorsFromCPU(1, (int)descs[j].size(), (const unsigned char*)descs[j].data());
+			const unsigned int numMatches = matcher.GetSiftMatchHost(keyPointIndices.data(), matchDistances.data(), MAX_MATCHES_PER_IMAGE_PAIR_RAW, make_uint2(0, 0), state.s_siftMatchThresh, state.s_siftMatchRatioMaxGlobal);
+			timer.stop();
+			pairTime[j*numKeyFrames + i] = timer.getElapsedTimeMS();
+			exhaustiveTime += pairTime[j*numKeyFrames + i];
+			if (numMatches >= state.s_minNumMatchesGlobal) {
+				overlap[j*numKeyFrames + i] = 1;
+				numOverlaps++;
+				if (j - i <= state.s_globalMatchTemporalNeighbors) numTemporalOverlaps++;
+			}
+		}
+	}
+	std::cout << "\texhaustive:\t" << exhaustiveTime << " ms\t" << numOverlaps << " overlapping pairs (" << numOverlaps - numTemporalOverlaps << " non-temporal)" << std::endl;
+
+	//0 = vocabulary tree, 1 = descriptor index; scores of every key frame against all previous ones (inserted in order as in the global bundler)
+	const unsigned int numMethods = 2;
+	const char* names[] = { "bow", "descriptor index" };
+	std::vector<std::vector<float>> scores[numMethods];
+	std::vector<char> bValid[numMethods];
+	double retrievalTime[numMethods] = { 0.0, 0.0 };
+	SIFTVocabularyTree vocabularyTree(state.s_bowVocabularyBranching, state.s_bowVocabularyDepth, state.s_bowTrainingFrames);
+	SIFTDescriptorIndex descriptorIndex(state.s_siftIndexNumLists, state.s_siftIndexNumProbes, state.s_siftIndexTrainingFrames);
+	for (unsigned int m = 0; m < numMethods; m++) {
+		scores[m].resize(numKeyFrames);
+		bValid[m].resize(numKeyFrames);
+		for (unsigned int j = 0; j < numKeyFrames; j++) {
+			const unsigned int numKeys = (unsigned int)descs[j].size();
+			timer.start();
+			if (m == 0) {
+				bValid[m][j] = vocabularyTree.queryImageScores(descs[j].data(), numKeys, scores[m][j]);
+				vocabularyTree.addImage(j, descs[j].data(), numKeys);
+			}
+			else {
+				std::vector<unsigned int> votes;
+				bValid[m][j] = descriptorIndex.queryImageVotes(descs[j].data(), numKeys, 5, state.s_siftMatchThresh, votes);
+				scores[m][j].assign(votes.begin(), votes.end());
+				descriptorIndex.addImage(j, descs[j].data(), numKeys);
+			}
+			timer.stop();
+			retrievalTime[m] += timer.getElapsedTimeMS();
+		}
+	}
+
+	std::vector<unsigned int> topKs = { 5, 10, 20, 40 };
+	if (state.s_bowTopK > 0 && std::find(topKs.begin(), topKs.end(), state.s_bowTopK) == topKs.end()) topKs.push_back(state.s_bowTopK);
+	std::vector<char> candidates;
+	for (unsigned int m = 0; m < numMethods; m++) {
+		for (unsigned int topK : topKs) {
+			double matchTime = 0.0;
+			size_t numFound = 0, numNonTemporalFound = 0;
+			for (unsigned int j = 1; j < numKeyFrames; j++) {
+				selectBenchmarkCandidates(scores[m][j], bValid[m][j] != 0, j, topK, state.s_globalMatchTemporalNeighbors, candidates);
+				for (unsigned int i = 0; i < j; i++) {
+					if (!candidates[i]) continue;
+					matchTime += pairTime[j*numKeyFrames + i];
+					if (overlap[j*numKeyFrames + i]) {
+						numFound++;
+						if (j - i > state.s_globalMatchTemporalNeighbors) numNonTemporalFound++;
+					}
+				}
+			}
+			const double time = matchTime + retrievalTime[m];
+			std::cout << "\t" << names[m] << " top " << topK << ":\trecall " << 100.0 * numFound / std::max(numOverlaps, (size_t)1) << "%"
+				<< " (non-temporal " << 100.0 * numNonTemporalFound / std::max(numOverlaps - numTemporalOverlaps, (size_t)1) << "%)"
+				<< "\t" << time << " ms (retrieval " << retrievalTime[m] << " ms)\tspeedup " << exhaustiveTime / std::max(time, 1e-6) << std::endl;
+		}
+	}
+}
+
+void benchmarkKabsch(unsigned int numProblems)
+{
+	const float conditionThresh = 100.0f;	//KABSCH_CONDITION_THRESH of the match filter
+	std::mt19937 rng(0);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+	std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+
+	//random rigid transforms on 3..32 points in a camera frustum: every 10th problem planar, every 10th noisy (1 cm)
+	std::vector<float3> source, target;
+	std::vector<unsigned int> offsets(1, 0);
+	std::vector<float4x4> groundTruth(numProblems);
+	for (unsigned int i = 0; i < numProblems; i++) {
+		const float4 q = normalize(make_float4(gauss(rng), gauss(rng), gauss(rng), gauss(rng)));	//uniform random rotation
+		float4x4& gt = groundTruth[i];
+		gt.setIdentity();
+		gt(0, 0) = 1.0f - 2.0f * (q.y * q.y + q.z * q.z);	gt(0, 1) = 2.0f * (q.x * q.y - q.w * q.z);			gt(0, 2) = 2.0f * (q.x * q.z + q.w * q.y);
+		gt(1, 0) = 2.0f * (q.x * q.y + q.w * q.z);			gt(1, 1) = 1.0f - 2.0f * (q.x * q.x + q.z * q.z);	gt(1, 2) = 2.0f * (q.y * q.z - q.w * q.x);
+		gt(2, 0) = 2.0f * (q.x * q.z - q.w * q.y);			gt(2, 1) = 2.0f * (q.y * q.z + q.w * q.x);			gt(2, 2) = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+		gt.setTranslation(make_float3(uniform(rng), uniform(rng), uniform(rng)));
+		const unsigned int numPoints = 3 + rng() % 30;
+		for (unsigned int k = 0; k < numPoints; k++) {
+			float3 p = make_float3(uniform(rng), uniform(rng), 2.0f + uniform(rng));
+			if (i % 10 == 0) p.z = 2.0f;
+			float3 q = groundTruth[i] * p;
+			if (i % 10 == 1) q += 0.01f * make_float3(gauss(rng), gauss(rng), gauss(rng));
+			source.push_back(p);
+			target.push_back(q);
+		}
+		offsets.push_back((unsigned int)source.size());
+	}
+	std::cout << "kabsch benchmark: " << numProblems << " problems, " << source.size() << " points (" << KabschBatch::getInstructionSet() << ", " << ThreadPool::get().getNumThreads() << " threads)" << std::endl;
+
+	std::vector<float4x4> transforms(numProblems), transformsScalar(numProblems);
+	std::vector<float3> singularValues(numProblems), singularValuesScalar(numProblems);
+	Timer timer;
+	timer.start();
+	KabschBatch::kabsch(numProblems, source.data(), target.data(), offsets.data(), transforms.data(), singularValues.data());
+	timer.stop();
+	const double timeBatch = timer.getElapsedTimeMS();
+	timer.start();
+	for (unsigned int i = 0; i < numProblems; i++) {
+		transformsScalar[i] = KabschBatch::kabsch(source.data() + offsets[i], target.data() + offsets[i], offsets[i + 1] - offsets[i], singularValuesScalar[i]);
+	}
+	timer.stop();
+	const double timeScalar = timer.getElapsedTimeMS();
+
+	//rotation error against the ground truth for the problems the filter would accept (noise free), orthonormality and batch vs. scalar for all
+	float maxRotationError = 0.0f, maxOrthoError = 0.0f, maxBatchDiff = 0.0f;
+	unsigned int numWellConditioned = 0, numIllConditioned = 0;
+	for (unsigned int i = 0; i < numProblems; i++) {
+		const float4x4& t = transforms[i];
+		for (unsigned int r = 0; r < 3; r++) {
+			for (unsigned int c = 0; c < 3; c++) {
+				float d = 0.0f;
+				for (unsigned int k = 0; k < 3; k++) d += t(r, k) * t(c, k);
+				maxOrthoError = std::max(maxOrthoError, std::abs(d - (r == c ? 1.0f : 0.0f)));
+			}
+		}
+		for (unsigned int e = 0; e < 12; e++) maxBatchDiff = std::max(maxBatchDiff, std::abs(t(e / 4, e % 4) - transformsScalar[i](e / 4, e % 4)));
+		if (singularValues[i].x > conditionThresh * singularValues[i].y) { numIllConditioned++; continue; }
+		if (i % 10 == 1) continue;
+		numWellConditioned++;
+		for (unsigned int r = 0; r < 3; r++) {
+			for (unsigned int c = 0; c < 3; c++) maxRotationError = std::max(maxRotationError, std::abs(t(r, c) - groundTruth[i](r, c)));
+		}
+	}
+	std::cout << "\tbatch " << 1.0e6 * timeBatch / std::max(numProblems, 1u) << " ns/problem\tscalar " << 1.0e6 * timeScalar / std::max(numProblems, 1u) << " ns/problem\tspeedup " << timeScalar / std::max(timeBatch, 1e-6) << std::endl;
+	std::cout << "\tmax rotation error " << maxRotationError << " (" << numWellConditioned << " noise free problems with cond <= " << conditionThresh << ", " << numIllConditioned << " above)"
+		<< "\tmax |R R^T - I| " << maxOrthoError << "\tmax |batch - scalar| " << maxBatchDiff << std::endl;
+}
+
+//! translation [mm] and rotation [deg] between two rigid transforms
+static void computePoseDifference(const mat4f& a, const mat4f& b, float& translation, float& rotation)
+{
+	translation = 1000.0f * (a.getTranslation() - b.getTranslation()).length();
+	const mat3f r = a.getRotation().getTranspose() * b.getRotation();
+	rotation = math::radiansToDegrees(std::acos(math::clamp(0.5f * (r(0, 0) + r(1, 1) + r(2, 2) - 1.0f), -1.0f, 1.0f)));
+}
+
+void benchmarkCompactCache(const std::string& filename, unsigned int maxNumFrames)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	if (numFrames == 0) throw MLIB_EXCEPTION("no frames in " + filename);
+	const unsigned int depthWidth = data.m_depthWidth, depthHeight = data.m_depthHeight;
+	const unsigned int width = GlobalBundlingState::get().s_downsampledWidth, height = GlobalBundlingState::get().s_downsampledHeight;
+	const unsigned int numPixels = width * height;
+	const unsigned int maxNumImages = GlobalBundlingState::get().s_maxNumImages;
+
+	//device memory of both layouts as allocated
+	size_t freeBefore, freeAfter, total;
+	MLIB_CUDA_SAFE_CALL(cudaMemGetInfo(&freeBefore, &total));
+	CUDACache cache(depthWidth, depthHeight, width, height, numFrames, data.m_calibrationDepth.m_intrinsic, false);
+	MLIB_CUDA_SAFE_CALL(cudaMemGetInfo(&freeAfter, &total));
+	const size_t allocatedFull = freeBefore - freeAfter;
+	MLIB_CUDA_SAFE_CALL(cudaMemGetInfo(&freeBefore, &total));
+	CUDACache compact(depthWidth, depthHeight, width, height, numFrames, data.m_calibrationDepth.m_intrinsic, true);
+	MLIB_CUDA_SAFE_CALL(cudaMemGetInfo(&freeAfter, &total));
+	const size_t allocatedCompact = freeBefore - freeAfter;
+
+	std::cout << "compact cache benchmark: " << filename << " (" << numFrames << " frames, " << width << "x" << height << ")" << std::endl;
+	std::cout << "\tdevice memory full " << allocatedFull / (1024.0 * 1024.0) << " MB (" << cache.getMemoryUsage() / (1024.0 * 1024.0) << " MB requested, "
+		<< CUDACachedFrame::getBytesPerPixel(false) << " B/pixel)\tcompact " << allocatedCompact / (1024.0 * 1024.0) << " MB (" << compact.getMemoryUsage() / (1024.0 * 1024.0) << " MB requested, "
+		<< CUDACachedFrame::getBytesPerPixel(true) << " B/pixel + one full layout scratch frame)" << std::endl;
+	//what fits into the frames of s_maxNumImages full layout frames
+	const double budget = (double)maxNumImages * numPixels * CUDACachedFrame::getBytesPerPixel(false);
+	const double numCompactFrames = (budget - (double)numPixels * CUDACachedFrame::getBytesPerPixel(false)) / ((double)numPixels * CUDACachedFrame::getBytesPerPixel(true));
+	const double scale = std::sqrt(budget / ((double)numPixels * (maxNumImages * CUDACachedFrame::getBytesPerPixel(true) + CUDACachedFrame::getBytesPerPixel(false))));
+	std::cout << "\tthe " << budget / (1024.0 * 1024.0) << " MB of s_maxNumImages = " << maxNumImages << " full frames hold " << (unsigned int)numCompactFrames << " compact frames or "
+		<< maxNumImages << " compact frames of " << (unsigned int)(width * scale) << "x" << (unsigned int)(height * scale) << std::endl;
+
+	//cache the frames as the bundler does
+	std::vector<vec3uc> color(data.m_colorWidth*data.m_colorHeight);
+	std::vector<uchar4> colorRGBA(color.size());
+	std::vector<unsigned short> depthU16(depthWidth*depthHeight);
+	std::vector<float> depthInput(depthWidth*depthHeight);
+	float* d_depth = NULL;	uchar4* d_color = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_depth, sizeof(float)*depthInput.size()));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_color, sizeof(uchar4)*colorRGBA.size()));
+	Timer timer;
+	double timeStore = 0.0, timeStoreCompact = 0.0;
+	for (unsigned int f = 0; f < numFrames; f++) {
+		data.decompressColor(f, color.data());
+		for (size_t i = 0; i < color.size(); i++) colorRGBA[i] = make_uchar4(color[i].x, color[i].y, color[i].z, 255);
+		data.decompressDepth(f, depthU16.data());
+		for (size_t i = 0; i < depthInput.size(); i++) {
+			depthInput[i] = depthU16[i] == 0 ? -std::numeric_limits<float>::infinity() : (float)depthU16[i] / data.m_depthShift;
+		}
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_depth, depthInput.data(), sizeof(float)*depthInput.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_color, colorRGBA.data(), sizeof(uchar4)*colorRGBA.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		timer.start();
+		cache.storeFrame(d_depth, depthWidth, depthHeight, d_color, data.m_colorWidth, data.m_colorHeight);
+		MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		timer.stop();	timeStore += timer.getElapsedTimeMS();
+		timer.start();
+		compact.storeFrame(d_depth, depthWidth, depthHeight, d_color, data.m_colorWidth, data.m_colorHeight);
+		MLIB_CUDA_SAFE_CALL(cudaDeviceSynchronize());
+		timer.stop();	timeStoreCompact += timer.getElapsedTimeMS();
+	}
+	MLIB_CUDA_SAFE_FREE(d_depth);
+	MLIB_CUDA_SAFE_FREE(d_color);
+	std::cout << "\tstoreFrame full " << timeStore / numFrames << " ms/frame\tcompact " << timeStoreCompact / numFrames << " ms/frame" << std::endl;
+
+	//per channel error of the compact frames as the kernels see them (camera positions and intensity derivatives recomputed)
+	DenseVerifyCPU verify(width, height), verifyCompact(width, height);
+	verify.syncFrames(&cache);
+	verifyCompact.syncFrames(&compact);
+	std::vector<float> depth(numPixels), intensity(numPixels), depthDec(numPixels), intensityDec(numPixels);
+	std::vector<float4> camPos(numPixels), normals(numPixels), camPosDec(numPixels), normalsDec(numPixels);
+	std::vector<float2> derivs(numPixels), derivsDec(numPixels);
+	const std::vector<CUDACachedFrame>& cachedFrames = cache.getCacheFrames();
+	const std::vector<CUDACachedFrame>& compactFrames = compact.getCacheFrames();
+	const float minf = -std::numeric_limits<float>::infinity();
+	double sumDepth = 0.0, sumCamPos = 0.0, sumNormal = 0.0, sumIntensity = 0.0, sumDerivs = 0.0;
+	float maxDepth = 0.0f, maxCamPos = 0.0f, maxNormal = 0.0f, maxIntensity = 0.0f, maxDerivs = 0.0f;
+	size_t numValid = 0, numValidNormals = 0, numMismatch = 0;
+	for (unsigned int f = 0; f < numFrames; f++) {
+		cachedFrames[f].download(depth.data(), camPos.data(), normals.data(), intensity.data(), derivs.data());
+		compactFrames[f].download(depthDec.data(), camPosDec.data(), normalsDec.data(), intensityDec.data(), derivsDec.data());
+		for (unsigned int i = 0; i < numPixels; i++) {
+			const float e = std::abs(intensity[i] - intensityDec[i]);
+			sumIntensity += e;	maxIntensity = std::max(maxIntensity, e);
+			if (derivs[i].x != minf && derivsDec[i].x != minf) {
+				const float d = std::max(std::abs(derivs[i].x - derivsDec[i].x), std::abs(derivs[i].y - derivsDec[i].y));
+				sumDerivs += d;	maxDerivs = std::max(maxDerivs, d);
+			}
+			if ((depth[i] == minf) != (depthDec[i] == minf) || (camPos[i].x == minf) != (camPosDec[i].x == minf) || (normals[i].x == minf) != (normalsDec[i].x == minf)) numMismatch++;
+			if (depth[i] != minf && depthDec[i] != minf) {
+				numValid++;
+				const float d = 1000.0f * std::abs(depth[i] - depthDec[i]);
+				sumDepth += d;	maxDepth = std::max(maxDepth, d);
+			}
+			if (camPos[i].x != minf && camPosDec[i].x != minf) {
+				const float d = 1000.0f * length(make_float3(camPos[i].x - camPosDec[i].x, camPos[i].y - camPosDec[i].y, camPos[i].z - camPosDec[i].z));
+				sumCamPos += d;	maxCamPos = std::max(maxCamPos, d);
+			}
+			if (normals[i].x != minf && normalsDec[i].x != minf) {
+				numValidNormals++;
+				const float c = normals[i].x * normalsDec[i].x + normals[i].y * normalsDec[i].y + normals[i].z * normalsDec[i].z;
+				const float d = math::radiansToDegrees(std::acos(math::clamp(c, -1.0f, 1.0f)));
+				sumNormal += d;	maxNormal = std::max(maxNormal, d);
+			}
+		}
+	}
+	const double numTotal = (double)numFrames * numPixels;
+	std::cout << "\tvalidity mismatches " << numMismatch << " of " << (size_t)numTotal << " pixels" << std::endl;
+	std::cout << "\tdepth [mm] mean " << sumDepth / std::max(numValid, (size_t)1) << " max " << maxDepth
+		<< "\tcamera position [mm] mean " << sumCamPos / std::max(numValid, (size_t)1) << " max " << maxCamPos
+		<< "\tnormal [deg] mean " << sumNormal / std::max(numValidNormals, (size_t)1) << " max " << maxNormal << std::endl;
+	std::cout << "\tintensity mean " << sumIntensity / numTotal << " max " << maxIntensity << "\tintensity derivatives mean " << sumDerivs / numTotal << " max " << maxDerivs << std::endl;
+
+	//dense verification decisions with the ground truth relative poses (exact test, no early exit)
+	DenseVerifyCPU::Params params;
+	params.distThresh = GlobalBundlingState::get().s_projCorrDistThres;
+	params.normalThresh = GlobalBundlingState::get().s_projCorrNormalThres;
+	params.errThresh = GlobalBundlingState::get().s_verifySiftErrThresh;
+	params.corrThresh = GlobalBundlingState::get().s_verifySiftCorrThresh;
+	params.depthMin = GlobalAppState::get().s_sensorDepthMin;
+	params.depthMax = GlobalAppState::get().s_sensorDepthMax;
+	params.earlyExitZ = 0.0f;
+	const float4x4 intrinsics = MatrixConversion::toCUDA(cache.getIntrinsics());
+	const unsigned int offsets[] = { 1, 5, 10, 30 };
+	for (unsigned int o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+		unsigned int numPairs = 0, numValidPairs = 0, numFlips = 0;
+		for (unsigned int model = offsets[o]; model < numFrames; model++) {
+			const unsigned int input = model - offsets[o];
+			const mat4f cameraToWorldInput = data.getCameraToWorld(input), cameraToWorldModel = data.getCameraToWorld(model);
+			if (cameraToWorldInput[0] == -std::numeric_limits<float>::infinity() || cameraToWorldModel[0] == -std::numeric_limits<float>::infinity()) continue;
+			const float4x4 transform = MatrixConversion::toCUDA(cameraToWorldModel.getInverse() * cameraToWorldInput);
+			const bool bValid = verify.verifyImagePair(input, model, transform, intrinsics, params);
+			const bool bValidCompact = verifyCompact.verifyImagePair(input, model, transform, intrinsics, params);
+			numPairs++;
+			if (bValid) numValidPairs++;
+			if (bValid != bValidCompact) numFlips++;
+		}
+		std::cout << "\tdense verification, frame offset " << offsets[o] << ": " << numFlips << " of " << numPairs << " decisions differ (" << numValidPairs << " valid)" << std::endl;
+	}
+
+	//dense only local solves (CUDASolverBundling) of consecutive windows of s_submapSize + 1 frames on both layouts, from the same perturbed ground truth poses
+	const unsigned int windowSize = std::min(GlobalBundlingState::get().s_submapSize + 1, numFrames);
+	if (windowSize < 2) return;
+	CUDACache window(depthWidth, depthHeight, width, height, windowSize, data.m_calibrationDepth.m_intrinsic, false);
+	CUDACache windowCompact(depthWidth, depthHeight, width, height, windowSize, data.m_calibrationDepth.m_intrinsic, true);
+	CUDASolverBundling solver(windowSize, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED * (windowSize*(windowSize - 1)) / 2);
+	const unsigned int numNonLinIterations = GlobalBundlingState::get().s_numLocalNonLinIterations;
+	const unsigned int numLinIterations = GlobalBundlingState::get().s_numLocalLinIterations;
+	const std::vector<float> weightsSparse(numNonLinIterations, 0.0f), weightsDenseColor(numNonLinIterations, 0.1f);
+	std::vector<float> weightsDenseDepth(numNonLinIterations);
+	for (unsigned int i = 0; i < numNonLinIterations; i++) weightsDenseDepth[i] = i + 1.0f;
+	//no sparse term: a single invalid correspondence keeps the correspondence table valid
+	EntryJ invalidCorr;	invalidCorr.setInvalid();
+	const std::vector<int> validImages(windowSize, 1);
+	EntryJ* d_corr = NULL;	int* d_validImages = NULL;	float4x4* d_transforms = NULL;	float3* d_xRot = NULL;	float3* d_xTrans = NULL;
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_corr, sizeof(EntryJ)));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_validImages, sizeof(int)*windowSize));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_transforms, sizeof(float4x4)*windowSize));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_xRot, sizeof(float3)*windowSize));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_xTrans, sizeof(float3)*windowSize));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_validImages, validImages.data(), sizeof(int)*windowSize, cudaMemcpyHostToDevice));
+	//perturbed ground truth relative to the first frame of the window (fixed by the solver) -> optimized poses
+	auto solve = [&](const CUDACache& c, const std::vector<float4x4>& initial, std::vector<mat4f>& result) {
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_corr, &invalidCorr, sizeof(EntryJ), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_transforms, initial.data(), sizeof(float4x4)*windowSize, cudaMemcpyHostToDevice));
+		convertMatricesToPosesCU(d_transforms, windowSize, d_xRot, d_xTrans, d_validImages);
+		solver.solve(d_corr, 1, d_validImages, windowSize, numNonLinIterations, numLinIterations, &c,
+			weightsSparse, weightsDenseDepth, weightsDenseColor, true, d_xRot, d_xTrans, true, false, (unsigned int)-1);
+		convertPosesToMatricesCU(d_xRot, d_xTrans, windowSize, d_transforms, d_validImages);
+		std::vector<float4x4> transforms(windowSize);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(transforms.data(), d_transforms, sizeof(float4x4)*windowSize, cudaMemcpyDeviceToHost));
+		result.resize(windowSize);
+		for (unsigned int i = 0; i < windowSize; i++) result[i] = MatrixConversion::toMlib(transforms[i]);
+	};
+	std::mt19937 rng(0);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+	std::vector<mat4f> groundTruth(windowSize), result, resultCompact;
+	std::vector<float4x4> initial(windowSize);
+	unsigned int numWindows = 0, numPoses = 0;
+	double sumTrans = 0.0, sumRot = 0.0, sumTransGT = 0.0, sumRotGT = 0.0, sumTransCompactGT = 0.0, sumRotCompactGT = 0.0;
+	float maxTrans = 0.0f, maxRot = 0.0f;
+	for (unsigned int start = 0; start + windowSize <= numFrames; start += windowSize - 1) {
+		bool bValid = true;
+		for (unsigned int i = 0; i < windowSize && bValid; i++) bValid = data.getCameraToWorld(start + i)[0] != -std::numeric_limits<float>::infinity();
+		if (!bValid) continue;
+		window.reset();	windowCompact.reset();
+		for (unsigned int i = 0; i < windowSize; i++) {
+			window.copyCacheFrameFrom(&cache, start + i);
+			windowCompact.copyCacheFrameFrom(&compact, start + i);
+			groundTruth[i] = data.getCameraToWorld(start).getInverse() * data.getCameraToWorld(start + i);
+			mat4f perturbed = groundTruth[i];
+			if (i > 0) {
+				perturbed = groundTruth[i] * mat4f::rotationZ(gauss(rng)) * mat4f::rotationY(gauss(rng)) * mat4f::rotationX(gauss(rng));	//~1 deg
+				perturbed.setTranslationVector(perturbed.getTranslation() + 0.01f * vec3f(gauss(rng), gauss(rng), gauss(rng)));		//~1 cm
+			}
+			initial[i] = MatrixConversion::toCUDA(perturbed);
+		}
+		solve(window, initial, result);
+		solve(windowCompact, initial, resultCompact);
+		numWindows++;
+		for (unsigned int i = 1; i < windowSize; i++) {
+			float t, r;
+			computePoseDifference(result[i], resultCompact[i], t, r);
+			sumTrans += t;	sumRot += r;	maxTrans = std::max(maxTrans, t);	maxRot = std::max(maxRot, r);
+			computePoseDifference(result[i], groundTruth[i], t, r);
+			sumTransGT += t;	sumRotGT += r;
+			computePoseDifference(resultCompact[i], groundTruth[i], t, r);
+			sumTransCompactGT += t;	sumRotCompactGT += r;
+			numPoses++;
+		}
+	}
+	MLIB_CUDA_SAFE_FREE(d_corr);
+	MLIB_CUDA_SAFE_FREE(d_validImages);
+	MLIB_CUDA_SAFE_FREE(d_transforms);
+	MLIB_CUDA_SAFE_FREE(d_xRot);
+	MLIB_CUDA_SAFE_FREE(d_xTrans);
+	const double n = std::max(numPoses, 1u);
+	std::cout << "\tdense solve, " << numWindows << " windows of " << windowSize << " frames: full vs. compact poses [mm] mean " << sumTrans / n << " max " << maxTrans
+		<< "\t[deg] mean " << sumRot / n << " max " << maxRot << std::endl;
+	std::cout << "\t\terror to ground truth full [mm] " << sumTransGT / n << " [deg] " << sumRotGT / n << "\tcompact [mm] " << sumTransCompactGT / n << " [deg] " << sumRotCompactGT / n << std::endl;
+}
+
+void benchmarkPreconditioners(const std::string& filename, unsigned int numProblems)
+{
+	const std::string baseFile = util::removeExtensions(filename);
+	if (!util::fileExists(baseFile + ".corrs")) throw MLIB_EXCEPTION("no recorded correspondences " + baseFile + ".corrs (key 'Z' or the offline reconstruction with s_offlineDumpGlobalCorrs)");
+	std::vector<EntryJ> correspondences;
+	{
+		BinaryDataStreamFile s(baseFile + ".corrs", false);
+		UINT64 numCorrs; s >> numCorrs;
+		correspondences.resize((size_t)numCorrs);
+		s.readData((BYTE*)correspondences.data(), sizeof(EntryJ) * correspondences.size());
+		s.close();
+	}
+	unsigned int numImages = 0;
+	for (const EntryJ& corr : correspondences) {
+		if (corr.isValid()) numImages = std::max(numImages, std::max(corr.imgIdx_i, corr.imgIdx_j) + 1);
+	}
+	if (numImages < 2) throw MLIB_EXCEPTION("no valid correspondences in " + baseFile + ".corrs");
+
+	//linearization point: recorded poses of the key frames (global image i is frame i * s_submapSize), perturbed by ~1 cm / 0.01 rad (image 0 stays fixed)
+	std::vector<float3> rotInit(numImages, make_float3(0.0f)), transInit(numImages, make_float3(0.0f));
+	if (util::fileExists(baseFile + ".traj")) {
+		std::vector<mat4f> trajectory;
+		BinaryDataStreamFile s(baseFile + ".traj", false);
+		s >> trajectory; s.close();
+		for (unsigned int i = 1; i < numImages; i++) {
+			const size_t f = (size_t)i * GlobalBundlingState::get().s_submapSize;
+			if (f >= trajectory.size() || trajectory[f](0, 0) == -std::numeric_limits<float>::infinity()) { //keep the pose of the previous image
+				rotInit[i] = rotInit[i - 1]; transInit[i] = transInit[i - 1];
+				continue;
+			}
+			const Pose pose = PoseHelper::MatrixToPose(trajectory[f]);
+			transInit[i] = make_float3(pose[0], pose[1], pose[2]);
+			rotInit[i] = make_float3(pose[3], pose[4], pose[5]);
+		}
+	}
+	else {
+		std::cout << "warning: no recorded trajectory " << baseFile << ".traj, starting from identity poses" << std::endl;
+	}
+	std::mt19937 rng(0);
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+	for (unsigned int i = 1; i < numImages; i++) {
+		transInit[i] += 0.01f * make_float3(gauss(rng), gauss(rng), gauss(rng));
+		rotInit[i] += 0.01f * make_float3(gauss(rng), gauss(rng), gauss(rng));
+	}
+
+	const unsigned int numLinIterations = GlobalBundlingState::get().s_numGlobalLinIterations;
+	const unsigned int maxLinIterations = 10 * numLinIterations;
+	const float tolerances[] = { 1e-2f, 1e-3f, 1e-4f };
+	const unsigned int numTolerances = sizeof(tolerances) / sizeof(tolerances[0]);
+	const char* names[] = { "jacobi", "block jacobi", "incomplete cholesky" };
+	const unsigned int numPreconditioners = PRECONDITIONER_INCOMPLETE_CHOLESKY + 1;
+	std::cout << "preconditioner benchmark: " << baseFile << ".corrs, " << numImages << " images, " << correspondences.size() << " correspondences (" << ThreadPool::get().getNumThreads() << " threads)" << std::endl;
+
+	CPUSolverBundling solver(numImages);
+	solver.setRecordConvergence(true);
+	const std::vector<float> weightsSparse(1, 1.0f), weightsZero(1, 0.0f);
+	std::vector<int> validImages(numImages, 1);
+	std::vector<float3> xRot(numImages), xTrans(numImages);
+	std::vector<EntryJ> problemCorrs;
+	//one sparse GN step, returns the PCG iterations
+	auto solve = [&](unsigned int n, unsigned int preconditioner, float tolerance, unsigned int maxIterations) -> unsigned int {
+		std::copy(rotInit.begin(), rotInit.begin() + n, xRot.begin());
+		std::copy(transInit.begin(), transInit.begin() + n, xTrans.begin());
+		solver.setPreconditioner(preconditioner);
+		solver.setLinearTolerance(tolerance);
+		solver.solve(problemCorrs.data(), (unsigned int)problemCorrs.size(), validImages.data(), n, 1, maxIterations, NULL,
+			weightsSparse, weightsZero, weightsZero, false, xRot.data(), xTrans.data());
+		return solver.getIterationTimings().front().numLinIterations;
+	};
+	auto printResult = [&](unsigned int numIterations) {
+		const CPUSolverBundling::IterationTiming& timing = solver.getIterationTimings().front();
+		std::cout << numIterations << " its, " << timing.timePCG << " ms (setup " << timing.timePreconditioner << " ms), energy " << solver.getConvergenceAnalysis()[1];
+	};
+
+	std::vector<unsigned int> totalIterations(numPreconditioners * numTolerances, 0);
+	for (unsigned int k = 1; k <= numProblems; k++) {
+		const unsigned int n = std::max(2u, numImages * k / numProblems);
+		problemCorrs.clear();
+		for (const EntryJ& corr : correspondences) {
+			if (corr.isValid() && corr.imgIdx_i < n && corr.imgIdx_j < n) problemCorrs.push_back(corr);
+		}
+		if (problemCorrs.empty()) continue;
+
+		std::cout << "\t" << n << " images, " << problemCorrs.size() << " correspondences: ";
+		const unsigned int its = solve(n, PRECONDITIONER_JACOBI, 0.0f, numLinIterations);
+		std::cout << "initial energy " << solver.getConvergenceAnalysis()[0] << ", jacobi (s_numGlobalLinIterations) ";
+		printResult(its);
+		std::cout << std::endl;
+		for (unsigned int t = 0; t < numTolerances; t++) {
+			std::cout << "\t\ttolerance " << tolerances[t] << ":";
+			for (unsigned int p = 0; p < numPreconditioners; p++) {
+				const unsigned int numIterations = solve(n, p, tolerances[t], maxLinIterations);
+				totalIterations[p * numTolerances + t] += numIterations;
+				std::cout << "\t" << names[p] << " ";
+				printResult(numIterations);
+				if (numIterations == maxLinIterations) std::cout << " (cap)";
+			}
+			std::cout << std::endl;
+		}
+	}
+	std::cout << "\ttotal PCG iterations over all problems:" << std::endl;
+	for (unsigned int t = 0; t < numTolerances; t++) {
+		const unsigned int itsJacobi = totalIterations[PRECONDITIONER_JACOBI * numTolerances + t];
+		std::cout << "\t\ttolerance " << tolerances[t] << ":";
+		for (unsigned int p = 0; p < numPreconditioners; p++) {
+			const unsigned int its = totalIterations[p * numTolerances + t];
+			std::cout << "\t" << names[p] << " " << its;
+			if (p != PRECONDITIONER_JACOBI) std::cout << " (" << 100.0f * (1.0f - (float)its / (float)std::max(itsJacobi, 1u)) << "% saved)";
+		}
+		std::cout << std::endl;
+	}
+}
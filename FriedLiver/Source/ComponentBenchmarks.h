@@ -0,0 +1,37 @@
+#pragma once
+
+//! benchmarks of single components of the bundling pipeline on recorded .sens files / random problems (run by ComponentBenchmarks.exe, see ComponentBenchmarksMain.cpp; the
+//! benchmarks of the lower level utilities live next to them: DepthCodec::benchmark, CPUImageUtil::benchmarkBilateralGrid)
+
+//! runs every CPUImageUtil kernel and its CUDAImageUtil counterpart on the same numImages random images (odd sizes, depth steps and holes) and compares the outputs:
+//! returns false if more than 0.01% of the values of a kernel are valid on one side only or differ by more than 1e-3 (relative; uchar4 outputs by more than 1)
+bool testCPUImageUtilCUDA(unsigned int numImages);
+
+//! runs the GPU (SiftPyramid) and CPU (SiftPyramidCPU, pipelined and level by level) SIFT detectors on the first maxNumFrames frames of a .sens file and prints their runtime, keypoint repeatability and descriptor distance
+void benchmarkSIFT(const std::string& filename, unsigned int maxNumFrames);
+
+//! matches the GPU SIFT descriptors of the first maxNumFrames frames of a .sens file (each frame against 1, 5 and 20 frames back) with SiftMatchGPU and SiftMatchCPU:
+//! returns false if a match is found by only one of them although its distance / ratio test is decided by more than 1e-5 rad, or if the distances of a common match differ by more
+bool testSiftMatchCPU(const std::string& filename, unsigned int maxNumFrames);
+
+//! matches each of the first maxNumFrames frames of a .sens file against all previous ones (SiftMatchGPU, sorted) and filters the raw matches with FilterKeyPointMatchesCU and
+//! SIFTMatchFilter::filterKeyPointMatchesCPU: returns false if the filtered matches of a pair differ or the transforms by more than 1e-4; also times ransacKeyPointMatches
+bool testSiftFilterCPU(const std::string& filename, unsigned int maxNumFrames);
+
+//! global match candidate retrieval on the submap key frames (every s_submapSize-th) of the first maxNumFrames frames of a .sens file: recall of the overlapping
+//! key frame pairs (exhaustive matching finds >= s_minNumMatchesGlobal matches) and matching time for the bag of words ranking and the descriptor index at several top-K
+void benchmarkPlaceRecognition(const std::string& filename, unsigned int maxNumFrames);
+
+//! batched (KabschBatch, SIMD lanes) against one problem at a time kabsch on numProblems random rigid transforms of 3..32 points (some planar, some noisy):
+//! runtime, rotation error against the ground truth below the filter's condition threshold, orthonormality and batch vs. scalar difference
+void benchmarkKabsch(unsigned int numProblems);
+
+//! caches the first maxNumFrames frames of a .sens file in a full and a compact CUDACache: device memory of both layouts (and what fits into the s_maxNumImages budget),
+//! storeFrame time, per channel error of the decoded frames, how many dense verification decisions (ground truth relative poses) change and how far the poses of
+//! dense local solves (perturbed ground truth, same start for both layouts) move apart
+void benchmarkCompactCache(const std::string& filename, unsigned int maxNumFrames);
+
+//! one sparse Gauss-Newton step (CPUSolverBundling) on numProblems growing prefixes of the recorded global correspondences of a .sens file (<base>.corrs / <base>.traj, key 'Z'
+//! or the offline reconstruction with s_offlineDumpGlobalCorrs), starting from the perturbed recorded poses: PCG iterations, setup and solve time and energy to reach relative residual tolerances
+//! for the Jacobi, block Jacobi and incomplete cholesky preconditioners, against the fixed s_numGlobalLinIterations Jacobi solve
+void benchmarkPreconditioners(const std::string& filename, unsigned int numProblems);
@@ -0,0 +1,105 @@
+#include "stdafx.h"
+
+#include "GlobalAppState.h"
+#include "GlobalBundlingState.h"
+#include "DualGPU.h"
+#include "ComponentBenchmarks.h"
+#include "DepthCodec.h"
+#include "SensorDataStreamWriter.h"
+#include "CPUImageUtil.h"
+
+//! entry point of ComponentBenchmarks.exe: runs one component test / benchmark, selected on the command line, and exits (1 if a test fails)
+//!		ComponentBenchmarks <name> <n> [file.sens] [fileNameDescGlobalApp fileNameDescGlobalBundling]
+//! n is the number of frames / problems / images; the .sens file defaults to s_binaryDumpSensorFile of the parameter file
+
+struct ComponentBenchmark {
+	const char* name;
+	const char* description;
+	bool bCUDA;		//needs the CUDA device
+	bool(*run)(const std::string& filename, unsigned int n);
+};
+
+static const ComponentBenchmark g_benchmarks[] = {
+	{ "depthCodec", "compares the depth compression types on the first n frames", false,
+		[](const std::string& filename, unsigned int n) { DepthCodec::benchmark(filename, n); return true; } },
+	{ "streamRecovery", "[test] records n synthetic frames and checks that copies cut off mid-frame / mid-commit are recovered with all complete frames", false,
+		[](const std::string& filename, unsigned int n) { return SensorDataStreamWriter::testRecovery("recordStreamRecoveryTest.sens", n); } },
+	{ "cpuImageUtil", "[test] compares the vectorized CPUImageUtil filters against their scalar reference on n random images", false,
+		[](const std::string& filename, unsigned int n) { return CPUImageUtil::testSIMD(n); } },
+	{ "cpuImageUtilCUDA", "[test] compares every CPUImageUtil kernel against its CUDAImageUtil counterpart on n random images", true,
+		[](const std::string& filename, unsigned int n) { return testCPUImageUtilCUDA(n); } },
+	{ "depthFilter", "accuracy / speed of the bilateral grid depth and color filters against the exact ones on the first n frames", false,
+		[](const std::string& filename, unsigned int n) {
+			CPUImageUtil::benchmarkBilateralGrid(filename, n, GlobalBundlingState::get().s_depthSigmaD, GlobalBundlingState::get().s_depthSigmaR,
+				GlobalAppState::get().s_colorSigmaD, GlobalAppState::get().s_colorSigmaR, GlobalAppState::get().s_sensorDepthMax);
+			return true;
+		} },
+	{ "sift", "keypoint repeatability and speed of the CPU and GPU SIFT detectors on the first n frames", true,
+		[](const std::string& filename, unsigned int n) { benchmarkSIFT(filename, n); return true; } },
+	{ "siftMatch", "[test] compares the match sets of SiftMatchCPU and SiftMatchGPU on the first n frames", true,
+		[](const std::string& filename, unsigned int n) { return testSiftMatchCPU(filename, n); } },
+	{ "siftFilter", "[test] compares the filtered matches and transforms of SIFTMatchFilter::filterKeyPointMatchesCPU and FilterKeyPointMatchesCU on the first n frames", true,
+		[](const std::string& filename, unsigned int n) { return testSiftFilterCPU(filename, n); } },
+	{ "placeRecognition", "recall vs. matching time of the global match candidate retrieval (s_bowTopK / s_siftIndexTopK) on the first n frames", true,
+		[](const std::string& filename, unsigned int n) { benchmarkPlaceRecognition(filename, n); return true; } },
+	{ "kabsch", "speed and accuracy of the batched kabsch solver on n random problems", false,
+		[](const std::string& filename, unsigned int n) { benchmarkKabsch(n); return true; } },
+	{ "compactCache", "memory and accuracy (dense verification, solver poses) of the compact cache layout (s_cacheCompact) on the first n frames", true,
+		[](const std::string& filename, unsigned int n) { benchmarkCompactCache(filename, n); return true; } },
+	{ "preconditioners", "PCG iterations to tolerance of the preconditioners on n prefixes of the recorded global correspondences (<sens file>.corrs / .traj)", false,
+		[](const std::string& filename, unsigned int n) { benchmarkPreconditioners(filename, n); return true; } },
+};
+
+static void printUsage()
+{
+	std::cout << "usage: ComponentBenchmarks <name> <n> [file.sens] [fileNameDescGlobalApp fileNameDescGlobalBundling]" << std::endl;
+	for (unsigned int i = 0; i < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); i++) {
+		std::cout << "\t" << g_benchmarks[i].name << ": " << g_benchmarks[i].description << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	try {
+		if (argc != 3 && argc != 4 && argc != 6) {
+			printUsage();
+			return 1;
+		}
+		const ComponentBenchmark* benchmark = NULL;
+		for (unsigned int i = 0; i < sizeof(g_benchmarks) / sizeof(g_benchmarks[0]); i++) {
+			if (std::string(argv[1]) == g_benchmarks[i].name) benchmark = &g_benchmarks[i];
+		}
+		const int n = atoi(argv[2]);
+		if (benchmark == NULL || n <= 0) {
+			printUsage();
+			return 1;
+		}
+
+		const std::string fileNameDescGlobalApp = argc == 6 ? std::string(argv[4]) : "zParametersDefault.txt";
+		const std::string fileNameDescGlobalBundling = argc == 6 ? std::string(argv[5]) : "zParametersBundlingDefault.txt";
+		ParameterFile parameterFileGlobalApp(fileNameDescGlobalApp);
+		if (argc >= 4) parameterFileGlobalApp.overrideParameter("s_binaryDumpSensorFile", std::string(argv[3]));
+		GlobalAppState::getInstance().readMembers(parameterFileGlobalApp);
+		ParameterFile parameterFileGlobalBundling(fileNameDescGlobalBundling);
+		GlobalBundlingState::getInstance().readMembers(parameterFileGlobalBundling);
+
+		if (benchmark->bCUDA) {
+			DualGPU::get().setDevice(DualGPU::DEVICE_RECONSTRUCTION);
+		}
+		std::cout << benchmark->name << " (" << n << ")" << std::endl;
+		const bool bPassed = benchmark->run(GlobalAppState::get().s_binaryDumpSensorFile, (unsigned int)n);
+		return bPassed ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Exception caught: " << e.what() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	catch (...)
+	{
+		std::cerr << "Exception caught: UNKNOWN EXCEPTION" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
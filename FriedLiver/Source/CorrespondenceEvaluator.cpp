@@ -4,6 +4,8 @@
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
 #include "CUDACache.h"
 #include "SiftVisualization.h" //for debugging
+#include "SiftGPU/KabschBatch.h"
+#include "SiftGPU/MatrixConversion.h"
 
 const std::string CorrespondenceEvaluator::splitter = ",";
 
@@ -24,16 +26,14 @@ void CorrespondenceEvaluator::computeCachedData(const SIFTImageManager* siftMana
 	const auto& cachedFrames = cudaCache->getCacheFrames();
 
 	DepthImage32 curDepth(width, height);		ColorImageR32 curIntensity(width, height);
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(curDepth.getData(), cachedFrames[curFrame].d_depthDownsampled, sizeof(float)*curDepth.getNumPixels(), cudaMemcpyDeviceToHost));
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(curIntensity.getData(), cachedFrames[curFrame].d_intensityDownsampled, sizeof(float)*curIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+	cachedFrames[curFrame].download(curDepth.getData(), NULL, NULL, curIntensity.getData(), NULL);
 
 	DepthImage32 prvDepth(width, height);		ColorImageR32 prvIntensity(width, height);		mat4f transformCurToPrv;
 	for (unsigned int i = 0; i < numFrames; i++) {
 		if (i == curFrame) continue; 
 		transformCurToPrv = m_referenceTrajectory[i].getInverse() * m_referenceTrajectory[curFrame]; //TODO still something wrong here?
 
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(prvDepth.getData(), cachedFrames[i].d_depthDownsampled, sizeof(float)*prvDepth.getNumPixels(), cudaMemcpyDeviceToHost));
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(prvIntensity.getData(), cachedFrames[i].d_intensityDownsampled, sizeof(float)*prvIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+		cachedFrames[i].download(prvDepth.getData(), NULL, NULL, prvIntensity.getData(), NULL);
 		const vec2ui overlap = computeOverlap(curDepth, curIntensity, prvDepth, prvIntensity, transformCurToPrv, 
 			cudaCache->getIntrinsics(), depthMin, depthMax, distThresh, normalThresh, colorThresh, m_minOverlapThreshForGTCorr,
 			false);
@@ -65,9 +65,12 @@ CorrEvaluation CorrespondenceEvaluator::evaluate(const SIFTImageManager* siftMan
 	const unsigned int offsetVal = filtered ? MAX_MATCHES_PER_IMAGE_PAIR_FILTERED : MAX_MATCHES_PER_IMAGE_PAIR_RAW;
 
 	CorrEvaluation eval;
+	//camera space matches of all image pairs (cur -> prv) for one kabsch batch
+	std::vector<float3> curPts, prvPts;
+	std::vector<unsigned int> ptsOffsets(1, 0);
 	//evaluate!
 	for (unsigned int p = 0; p < numFrames; p++) {
-		if (p == curFrame) continue;
+		if (p == curFrame) { ptsOffsets.push_back(ptsOffsets.back()); continue; }
 		if (m_cacheHasGTCorrByOverlap[p]) {
 			eval.numTotal++;
 			if (numMatches[p] > 0) eval.numDetected++;
@@ -83,6 +86,8 @@ CorrEvaluation CorrespondenceEvaluator::evaluate(const SIFTImageManager* siftMan
 			vec3f err = m_referenceTrajectory[p] * cp0 - m_referenceTrajectory[curFrame] * cp1; 
 			const float err2 = err.lengthSq();
 			if (err2 > maxErr2) maxErr2 = err2;
+			curPts.push_back(make_float3(cp1.x, cp1.y, cp1.z));
+			prvPts.push_back(make_float3(cp0.x, cp0.y, cp0.z));
 
 			////debugging
 			//if (err2 > m_maxProjErrorForCorrectCorr && filtered) {
@@ -115,8 +120,25 @@ CorrEvaluation CorrespondenceEvaluator::evaluate(const SIFTImageManager* siftMan
 			}
 		}
 		if (useLog && m_cacheHasGTCorrByOverlap[p] && numMatches[p] == 0) m_outStreamIncorrect << numFrames << splitter << curFrame << splitter << p << splitter << corrType << splitter << -1.0f << std::endl;
+		ptsOffsets.push_back((unsigned int)curPts.size());
 	} //each im-im corr for the current frame
-	if (useLog) m_outStreamPerFrame << numFrames << splitter << curFrame << splitter << corrType << splitter << eval.getPrecision() << splitter << eval.getRecall() << splitter << eval.numCorrect << splitter << eval.numDetected << splitter << eval.numTotal << std::endl;
+
+	//transform of the matches vs. reference transform
+	std::vector<float4x4> transforms(numFrames);
+	KabschBatch::kabsch(numFrames, curPts.data(), prvPts.data(), ptsOffsets.data(), transforms.data(), NULL);
+	for (unsigned int p = 0; p < numFrames; p++) {
+		if (ptsOffsets[p + 1] - ptsOffsets[p] < 3) continue;
+		const mat4f transformCurToPrv = m_referenceTrajectory[p].getInverse() * m_referenceTrajectory[curFrame];
+		const mat4f transform = MatrixConversion::toMlib(transforms[p]);
+		float maxErr = 0.0f;
+		for (unsigned int i = ptsOffsets[p]; i < ptsOffsets[p + 1]; i++) {
+			const vec3f cp1(curPts[i].x, curPts[i].y, curPts[i].z);
+			maxErr = std::max(maxErr, vec3f::dist(transform * cp1, transformCurToPrv * cp1));
+		}
+		eval.sumTransformErr += maxErr;
+		eval.numTransforms++;
+	}
+	if (useLog) m_outStreamPerFrame << numFrames << splitter << curFrame << splitter << corrType << splitter << eval.getPrecision() << splitter << eval.getRecall() << splitter << eval.numCorrect << splitter << eval.numDetected << splitter << eval.numTotal << splitter << eval.getMeanTransformErr() << std::endl;
 
 	if (clearCache) clearCachedData();
 
@@ -11,11 +11,15 @@ struct CorrEvaluation {
 	unsigned int numCorrect;	//#corrs found that are correct
 	unsigned int numDetected;	//#corrs found 
 	unsigned int numTotal;		//#corrs that could be found
+	float sumTransformErr;		//sum over the detected corrs (>= 3 matches) of the largest distance of a match under their kabsch transform vs. the reference
+	unsigned int numTransforms;
 
 	CorrEvaluation() {
 		numCorrect = 0;
 		numDetected = 0;
 		numTotal = 0;
+		sumTransformErr = 0.0f;
+		numTransforms = 0;
 	}
 	float getPrecision() const { 
 		if (numDetected > 0) 
@@ -27,11 +31,18 @@ struct CorrEvaluation {
 			return (float)numDetected / (float)numTotal;
 		return -std::numeric_limits<float>::infinity();
 	}
+	float getMeanTransformErr() const {
+		if (numTransforms > 0)
+			return sumTransformErr / (float)numTransforms;
+		return -std::numeric_limits<float>::infinity();
+	}
 
 	CorrEvaluation& operator+=(const CorrEvaluation& rhs) {                 
 		numCorrect += rhs.numCorrect;
 		numDetected += rhs.numDetected;
 		numTotal += rhs.numTotal;
+		sumTransformErr += rhs.sumTransformErr;
+		numTransforms += rhs.numTransforms;
 		return *this; 
 	}
 };
@@ -49,7 +60,7 @@ public:
 			m_outStreamPerFrame.open(m_logFilePrefix + "_frame.csv");
 			m_outStreamIncorrect.open(m_logFilePrefix + "_wrong.csv");
 			if (!m_outStreamPerFrame.is_open() || !m_outStreamIncorrect.is_open()) throw MLIB_EXCEPTION("[CorrespondenceEvaluator] failed to open log file(s): " + m_logFilePrefix);
-			m_outStreamPerFrame << "numFrames" << splitter << "curFrame" << splitter << "type" << splitter << "precision" << splitter << "recall" << splitter << "numCorrect" << splitter << "numDetected" << splitter << "numTotal" << std::endl;
+			m_outStreamPerFrame << "numFrames" << splitter << "curFrame" << splitter << "type" << splitter << "precision" << splitter << "recall" << splitter << "numCorrect" << splitter << "numDetected" << splitter << "numTotal" << splitter << "transformErr" << std::endl;
 			m_outStreamIncorrect << "numFrames" << splitter << "curFrame" << splitter << "matchFrame" << splitter << "type" << splitter << "err" << std::endl;
 		}
 	}
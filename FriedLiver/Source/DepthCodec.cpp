@@ -0,0 +1,326 @@
+#include "stdafx.h"
+
+#include "DepthCodec.h"
+#include "MappedSensorData.h"
+#include "SensorDataStreamWriter.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+	inline unsigned int countTrailingZeros(UINT64 x) {	//x != 0
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanForward64(&idx, x);
+		return (unsigned int)idx;
+#else
+		return (unsigned int)__builtin_ctzll(x);
+#endif
+	}
+
+	inline unsigned int bitLength(unsigned int x) {
+		if (x == 0) return 0;
+#ifdef _MSC_VER
+		unsigned long idx;
+		_BitScanReverse(&idx, x);
+		return (unsigned int)idx + 1;
+#else
+		return 32 - (unsigned int)__builtin_clz(x);
+#endif
+	}
+
+	//! LSB first bit stream
+	class BitWriter {
+	public:
+		BitWriter(std::vector<unsigned char>& out) : m_out(out), m_buffer(0), m_numBits(0) {}
+
+		//! n <= 32
+		void put(UINT64 bits, unsigned int n) {
+			m_buffer |= bits << m_numBits;
+			m_numBits += n;
+			if (m_numBits >= 32) {
+				const unsigned int v = (unsigned int)m_buffer;
+				m_out.push_back((unsigned char)v);			m_out.push_back((unsigned char)(v >> 8));
+				m_out.push_back((unsigned char)(v >> 16));	m_out.push_back((unsigned char)(v >> 24));
+				m_buffer >>= 32;
+				m_numBits -= 32;
+			}
+		}
+		void flush() {
+			while (m_numBits > 0) {
+				m_out.push_back((unsigned char)m_buffer);
+				m_buffer >>= 8;
+				m_numBits = m_numBits > 8 ? m_numBits - 8 : 0;
+			}
+		}
+	private:
+		std::vector<unsigned char>& m_out;
+		UINT64			m_buffer;
+		unsigned int	m_numBits;
+	};
+
+	class BitReader {
+	public:
+		BitReader(const unsigned char* data, UINT64 sizeBytes) : m_ptr(data), m_end(data + sizeBytes), m_buffer(0), m_numBits(0), m_numPadBytes(0) {}
+
+		//! at least 57 bits are available afterwards; reading past the end yields zeros
+		void refill() {
+			while (m_numBits <= 56) {
+				UINT64 b = 0;
+				if (m_ptr < m_end) b = *m_ptr++;
+				else m_numPadBytes++;
+				m_buffer |= b << m_numBits;
+				m_numBits += 8;
+			}
+		}
+		UINT64 peek() const {
+			return m_buffer;
+		}
+		void consume(unsigned int n) {
+			m_buffer >>= n;
+			m_numBits -= n;
+		}
+		unsigned int get(unsigned int n) {	//n <= 32
+			if (m_numBits < n) refill();
+			const unsigned int v = (unsigned int)(m_buffer & ((1ull << n) - 1));
+			consume(n);
+			return v;
+		}
+		//! number of ones before the next zero, at most maxCount (the terminating zero is consumed if found)
+		unsigned int getUnary(unsigned int maxCount) {
+			refill();
+			const UINT64 inv = ~m_buffer;
+			const unsigned int count = inv ? countTrailingZeros(inv) : 64;
+			if (count >= maxCount) {
+				consume(maxCount);
+				return maxCount;
+			}
+			consume(count + 1);
+			return count;
+		}
+		//! true if more bits were read than available
+		bool isOverrun() const {
+			return m_numPadBytes * 8 > m_numBits;
+		}
+	private:
+		const unsigned char*	m_ptr;
+		const unsigned char*	m_end;
+		UINT64			m_buffer;
+		unsigned int	m_numBits;
+		unsigned int	m_numPadBytes;
+	};
+
+	//! per context running mean of the residuals (see LOCO-I)
+	struct RiceContext {
+		unsigned int A, N;
+		RiceContext() : A(4), N(1) {}
+		unsigned int getK() const {
+			unsigned int k = 0;
+			while ((N << k) < A) k++;
+			return k;
+		}
+		void update(unsigned int u) {
+			A += u;
+			if (++N == 64) { A >>= 1; N >>= 1; }
+		}
+	};
+
+	//! LOCO-I median edge detector; a = left, b = up, c = up-left
+	inline int predict(int a, int b, int c) {
+		const int mn = std::min(a, b), mx = std::max(a, b);
+		if (c >= mx) return mn;
+		if (c <= mn) return mx;
+		return a + b - c;
+	}
+
+	inline unsigned int getContext(int a, int b, int c, unsigned int numContexts) {
+		const unsigned int activity = (unsigned int)(std::abs(a - c) + std::abs(b - c));
+		return std::min(bitLength(activity), numContexts - 1);
+	}
+
+	//! neighbors of pixel (x, y); missing ones are replaced such that the predictor returns left (first row) or up (first column)
+	inline void getNeighbors(const unsigned short* row, const unsigned short* rowUp, unsigned int x, int& a, int& b, int& c) {
+		if (!rowUp) {
+			a = b = c = (x > 0) ? row[x - 1] : 0;
+		}
+		else if (x == 0) {
+			a = b = c = rowUp[0];
+		}
+		else {
+			a = row[x - 1];	b = rowUp[x];	c = rowUp[x - 1];
+		}
+	}
+
+}
+
+void DepthCodec::compress(const unsigned short* depth, unsigned int width, unsigned int height, std::vector<unsigned char>& out)
+{
+	const size_t numPixels = (size_t)width*height;
+	out.clear();
+	out.reserve(numPixels / 2);
+	out.push_back(s_version);
+
+	//zig-zag residuals and contexts
+	std::vector<unsigned int> residuals(numPixels);
+	std::vector<unsigned char> contexts(numPixels);
+	for (unsigned int y = 0; y < height; y++) {
+		const unsigned short* row = depth + (size_t)y*width;
+		const unsigned short* rowUp = y > 0 ? row - width : NULL;
+		for (unsigned int x = 0; x < width; x++) {
+			int a, b, c;
+			getNeighbors(row, rowUp, x, a, b, c);
+			const int e = (int)row[x] - predict(a, b, c);
+			residuals[(size_t)y*width + x] = (unsigned int)((e << 1) ^ (e >> 31));
+			contexts[(size_t)y*width + x] = (unsigned char)getContext(a, b, c, s_numContexts);
+		}
+	}
+
+	BitWriter bits(out);
+	RiceContext ctx[s_numContexts];
+	auto putRice = [&](unsigned int v, unsigned int k) {
+		const unsigned int q = v >> k;
+		if (q >= s_maxUnary) {
+			bits.put((1ull << s_maxUnary) - 1, s_maxUnary);
+			bits.put(v, s_escapeBits);
+		}
+		else {
+			bits.put((1ull << q) - 1, q + 1);
+			bits.put(v & ((1u << k) - 1), k);
+		}
+	};
+
+	size_t i = 0;
+	while (i < numPixels) {
+		RiceContext& rc = ctx[contexts[i]];
+		const unsigned int k = rc.getK();
+		unsigned int u = residuals[i];
+		if (u != 0) {
+			putRice(u, k);
+			rc.update(u);
+			i++;
+			continue;
+		}
+
+		//run mode: symbol 0 followed by the run length (Elias gamma); the pixel after the run has a non-zero residual
+		putRice(0, k);
+		size_t run = 1;
+		while (i + run < numPixels && residuals[i + run] == 0) run++;
+		const unsigned int n = bitLength((unsigned int)run) - 1;
+		bits.put((1ull << n) - 1, n + 1);
+		bits.put(run & ((1ull << n) - 1), n);
+		i += run;
+		if (i < numPixels) {
+			RiceContext& rcNext = ctx[contexts[i]];
+			u = residuals[i];
+			putRice(u - 1, rcNext.getK());
+			rcNext.update(u);
+			i++;
+		}
+	}
+	bits.flush();
+}
+
+void DepthCodec::decompress(const unsigned char* data, UINT64 sizeBytes, unsigned int width, unsigned int height, unsigned short* depth)
+{
+	if (sizeBytes < 1 || data[0] != s_version) throw MLIB_EXCEPTION("invalid depth codec stream");
+
+	BitReader bits(data + 1, sizeBytes - 1);
+	RiceContext ctx[s_numContexts];
+	auto getRice = [&](unsigned int k) {
+		const unsigned int q = bits.getUnary(s_maxUnary);
+		if (q == s_maxUnary) return bits.get(s_escapeBits);
+		return (q << k) | bits.get(k);
+	};
+
+	size_t runRemaining = 0;
+	bool bAfterRun = false;
+	for (unsigned int y = 0; y < height; y++) {
+		unsigned short* row = depth + (size_t)y*width;
+		const unsigned short* rowUp = y > 0 ? row - width : NULL;
+		for (unsigned int x = 0; x < width; x++) {
+			int a, b, c;
+			getNeighbors(row, rowUp, x, a, b, c);
+			const int pred = predict(a, b, c);
+
+			unsigned int u = 0;
+			if (runRemaining > 0) {
+				runRemaining--;
+			}
+			else {
+				RiceContext& rc = ctx[getContext(a, b, c, s_numContexts)];
+				const unsigned int k = rc.getK();
+				if (bAfterRun) {
+					u = getRice(k) + 1;
+					rc.update(u);
+					bAfterRun = false;
+				}
+				else {
+					u = getRice(k);
+					if (u == 0) {
+						const unsigned int n = bits.getUnary(32);
+						if (n > 31) throw MLIB_EXCEPTION("invalid depth codec stream");
+						const size_t run = ((size_t)1 << n) | bits.get(n);
+						runRemaining = run - 1;		//includes this pixel
+						bAfterRun = true;
+					}
+					else {
+						rc.update(u);
+					}
+				}
+			}
+			const int e = (int)(u >> 1) ^ -(int)(u & 1);
+			const int v = pred + e;
+			if (v < 0 || v > 65535) throw MLIB_EXCEPTION("invalid depth codec stream");
+			row[x] = (unsigned short)v;
+		}
+	}
+	if (bits.isOverrun()) throw MLIB_EXCEPTION("truncated depth codec stream");
+}
+
+void DepthCodec::benchmark(const std::string& filename, unsigned int maxNumFrames)
+{
+	MappedSensorData data;
+	data.open(filename);
+	const unsigned int numFrames = std::min(maxNumFrames, data.getNumFrames());
+	const unsigned int width = data.m_depthWidth, height = data.m_depthHeight;
+	const size_t numPixels = (size_t)width*height;
+	if (numFrames == 0) throw MLIB_EXCEPTION("no frames in " + filename);
+
+	std::vector<unsigned short> frames(numPixels*numFrames);
+	for (unsigned int f = 0; f < numFrames; f++) {
+		data.decompressDepth(f, frames.data() + numPixels*f);
+	}
+	const double rawMB = (double)(sizeof(unsigned short)*numPixels*numFrames) / (1024.0 * 1024.0);
+	std::cout << "depth codec benchmark: " << filename << " (" << numFrames << " frames " << width << "x" << height << ")" << std::endl;
+
+	const SensorData::COMPRESSION_TYPE_DEPTH types[] = { SensorData::TYPE_RAW_USHORT, SensorData::TYPE_ZLIB_USHORT, TYPE_PREDICTIVE_RICE_USHORT };
+	const char* names[] = { "raw", "zlib", "predictive rice" };
+	std::vector<std::vector<unsigned char>> compressed(numFrames);
+	std::vector<unsigned short> decompressed(numPixels);
+	Timer timer;
+	for (unsigned int t = 0; t < 3; t++) {
+		timer.start();
+		UINT64 sizeBytes = 0;
+		for (unsigned int f = 0; f < numFrames; f++) {
+			SensorDataStreamWriter::compressDepth(frames.data() + numPixels*f, width, height, types[t], compressed[f]);
+			sizeBytes += compressed[f].size();
+		}
+		timer.stop();
+		const double encodeMS = timer.getElapsedTimeMS();
+
+		timer.start();
+		bool bLossless = true;
+		for (unsigned int f = 0; f < numFrames; f++) {
+			MappedSensorData::decompressDepth(types[t], compressed[f].data(), compressed[f].size(), width, height, decompressed.data());
+			bLossless = bLossless && memcmp(decompressed.data(), frames.data() + numPixels*f, sizeof(unsigned short)*numPixels) == 0;
+		}
+		timer.stop();
+		const double decodeMS = timer.getElapsedTimeMS();
+
+		std::cout << "\t" << names[t] << ":\t" << (double)sizeBytes / (1024.0 * 1024.0) << " MB (" << rawMB * 1024.0 * 1024.0 / (double)sizeBytes << ":1)"
+			<< "\tencode " << rawMB / (encodeMS / 1000.0) << " MB/s\tdecode " << rawMB / (decodeMS / 1000.0) << " MB/s"
+			<< (bLossless ? "" : "\tNOT LOSSLESS") << std::endl;
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+/************************************************************************/
+/* Lossless codec for 16-bit depth maps: LOCO-I style prediction and    */
+/* context-adaptive Golomb-Rice coding with a run mode for flat/invalid */
+/* regions                                                              */
+/************************************************************************/
+
+#include "stdafx.h"
+
+#include <string>
+#include <vector>
+
+class DepthCodec
+{
+public:
+	//! not part of ml::SensorData::COMPRESSION_TYPE_DEPTH; .sens files using it are only readable by this code base (MappedSensorData, SensorDataReader)
+	static const SensorData::COMPRESSION_TYPE_DEPTH TYPE_PREDICTIVE_RICE_USHORT = (SensorData::COMPRESSION_TYPE_DEPTH)16;
+
+	//! out is resized to the compressed size
+	static void compress(const unsigned short* depth, unsigned int width, unsigned int height, std::vector<unsigned char>& out);
+
+	//! throws on corrupt input
+	static void decompress(const unsigned char* data, UINT64 sizeBytes, unsigned int width, unsigned int height, unsigned short* depth);
+
+	//! compresses/decompresses the depth of the first maxNumFrames frames of a .sens file with all supported depth compression types and prints size and speed
+	static void benchmark(const std::string& filename, unsigned int maxNumFrames);
+
+private:
+	static const unsigned char s_version = 1;
+	static const unsigned int s_numContexts = 10;
+	static const unsigned int s_maxUnary = 24;		//longer codes are escaped and stored with s_escapeBits
+	static const unsigned int s_escapeBits = 17;	//zig-zag residuals are < 2^17
+};
@@ -0,0 +1,286 @@
+#include "stdafx.h"
+
+#include "CPUSceneRepHashSDF.h"
+#include "Tables.h"
+
+#include <unordered_set>
+
+const Voxel* CPUSceneRepHashSDF::getVoxel(const vec3i& virtualVoxelPos) const
+{
+	const vec3i block(floorDiv(virtualVoxelPos.x, SDF_BLOCK_SIZE), floorDiv(virtualVoxelPos.y, SDF_BLOCK_SIZE), floorDiv(virtualVoxelPos.z, SDF_BLOCK_SIZE));
+	const auto it = m_blockMap.find(block);
+	if (it == m_blockMap.end()) return NULL;
+	const vec3i local = virtualVoxelPos - block * SDF_BLOCK_SIZE;
+	return &m_blocks[it->second].data[linearizeVoxelPos(local)];
+}
+
+void CPUSceneRepHashSDF::allocBlocks(const mat4f& cameraToWorld, const mat4f& depthIntrinsicsInv, const float* depth, unsigned int width, unsigned int height, std::vector<unsigned int>& blocksToUpdate)
+{
+	const unsigned int numThreads = m_threadPool->getNumThreads() + 1;
+	const unsigned int rowsPerChunk = std::max(1u, height / (4 * numThreads));
+	const unsigned int numChunks = (height + rowsPerChunk - 1) / rowsPerChunk;
+	std::vector<std::unordered_set<vec3i, BlockHash>> chunkBlocks(numChunks);
+
+	const float blockSize = m_params.m_virtualVoxelSize * SDF_BLOCK_SIZE;
+	const vec3f camPos = cameraToWorld.getTranslation();
+
+	//walk along each ray through the truncation region [d - t, d + t] and collect the touched blocks
+	m_threadPool->parallelFor(0, numChunks, [&](unsigned int c) {
+		std::unordered_set<vec3i, BlockHash>& blocks = chunkBlocks[c];
+		const unsigned int yEnd = std::min(height, (c + 1) * rowsPerChunk);
+		for (unsigned int y = c * rowsPerChunk; y < yEnd; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				const float d = depth[y*width + x];
+				if (d == -std::numeric_limits<float>::infinity() || d == 0.0f) continue;
+				if (d >= m_params.m_maxIntegrationDistance) continue;
+
+				const float t = getTruncation(d);
+				const float minDepth = std::min(m_params.m_sensorDepthMax, d - t);
+				const float maxDepth = std::min(m_params.m_sensorDepthMax, d + t);
+				if (minDepth >= maxDepth) continue;
+
+				const vec3f rayCamera = depthIntrinsicsInv * vec3f((float)x, (float)y, 1.0f);		//point at depth 1
+				const vec3f rayWorld = cameraToWorld * rayCamera - camPos;
+				const float step = 0.5f * blockSize;
+				for (float z = minDepth; z <= maxDepth + step; z += step) {
+					blocks.insert(worldToSDFBlock(camPos + std::min(z, maxDepth) * rayWorld));
+				}
+			}
+		}
+	});
+
+	//merge (serial, only touches the hash map)
+	std::unordered_set<vec3i, BlockHash> touched;
+	for (const auto& blocks : chunkBlocks) touched.insert(blocks.begin(), blocks.end());
+
+	blocksToUpdate.clear();
+	blocksToUpdate.reserve(touched.size());
+	for (const vec3i& b : touched) {
+		auto it = m_blockMap.find(b);
+		if (it == m_blockMap.end()) {
+			const unsigned int idx = (unsigned int)m_blocks.size();
+			m_blocks.push_back(SDFBlock());
+			SDFBlock& block = m_blocks.back();
+			for (unsigned int i = 0; i < s_linBlockSize; i++) {
+				block.data[i].sdf = 0.0f;
+				block.data[i].weight = 0;
+				block.data[i].color = make_uchar4(0, 0, 0, 0);
+			}
+			m_blockPos.push_back(b);
+			it = m_blockMap.insert(std::make_pair(b, idx)).first;
+		}
+		blocksToUpdate.push_back(it->second);
+	}
+}
+
+void CPUSceneRepHashSDF::integrate(const mat4f& cameraToWorld, const mat4f& depthIntrinsics, const float* depth, const uchar4* color, unsigned int width, unsigned int height)
+{
+	std::vector<unsigned int> blocksToUpdate;
+	allocBlocks(cameraToWorld, depthIntrinsics.getInverse(), depth, width, height, blocksToUpdate);
+
+	const mat4f worldToCamera = cameraToWorld.getInverse();
+	const float fx = depthIntrinsics(0, 0);
+	const float fy = depthIntrinsics(1, 1);
+	const float mx = depthIntrinsics(0, 2);
+	const float my = depthIntrinsics(1, 2);
+
+	//same update rule as integrateDepthMapKernel, with the depth dependent sample weight (the kernel currently overrides it with 1)
+	m_threadPool->parallelFor(0, (unsigned int)blocksToUpdate.size(), [&](unsigned int b) {
+		const unsigned int blockIdx = blocksToUpdate[b];
+		SDFBlock& block = m_blocks[blockIdx];
+		const vec3i piBase = m_blockPos[blockIdx] * SDF_BLOCK_SIZE;
+
+		for (unsigned int i = 0; i < s_linBlockSize; i++) {
+			const vec3i pi = piBase + delinearizeVoxelIndex(i);
+			const vec3f pf = worldToCamera * (vec3f(pi) * m_params.m_virtualVoxelSize);
+			if (pf.z <= 0.0f) continue;
+
+			const int sx = (int)(pf.x*fx / pf.z + mx + 0.5f);
+			const int sy = (int)(pf.y*fy / pf.z + my + 0.5f);
+			if (sx < 0 || sy < 0 || sx >= (int)width || sy >= (int)height) continue;
+
+			const float d = depth[sy*width + sx];
+			if (d == -std::numeric_limits<float>::infinity() || d >= m_params.m_maxIntegrationDistance) continue;
+
+			float sdf = d - pf.z;
+			const float truncation = getTruncation(d);
+			if (std::abs(sdf) >= truncation) continue;
+			sdf = math::clamp(sdf, -truncation, truncation);
+			const float depthZeroOne = (d - m_params.m_sensorDepthMin) / (m_params.m_sensorDepthMax - m_params.m_sensorDepthMin);
+			const float weightUpdate = std::max((float)m_params.m_integrationWeightSample * 1.5f * (1.0f - depthZeroOne), 1.0f);
+
+			const uchar4& c = color[sy*width + sx];
+			Voxel& v = block.data[i];
+			vec3f res((float)c.x, (float)c.y, (float)c.z);
+			if (v.weight != 0) res = 0.2f * res + 0.8f * vec3f((float)v.color.x, (float)v.color.y, (float)v.color.z);
+			for (unsigned int k = 0; k < 3; k++) res[k] = math::clamp(std::round(res[k]), 0.0f, 254.5f);
+			v.color = make_uchar4((unsigned char)res.x, (unsigned char)res.y, (unsigned char)res.z, 255);
+
+			v.sdf = (v.sdf * (float)v.weight + sdf * weightUpdate) / ((float)v.weight + weightUpdate);
+			v.weight = std::min((float)m_params.m_integrationWeightMax, (float)v.weight + weightUpdate);
+		}
+	}, 16);
+
+	m_numIntegratedFrames++;
+}
+
+void CPUSceneRepHashSDF::extractIsoSurfaceBlock(unsigned int blockIdx, MeshDataf& mesh) const
+{
+	const float isolevel = 0.0f;
+	const vec3i piBase = m_blockPos[blockIdx] * SDF_BLOCK_SIZE;
+	const SDFBlock& block = m_blocks[blockIdx];
+
+	//corner order matches the bit layout of the cube index in MarchingCubesSDFUtil.h
+	const vec3i cornerOffsets[8] = {
+		vec3i(0, 1, 0), vec3i(1, 1, 0), vec3i(1, 0, 0), vec3i(0, 0, 0),
+		vec3i(0, 1, 1), vec3i(1, 1, 1), vec3i(1, 0, 1), vec3i(0, 0, 1)
+	};
+	const unsigned int edgeCorners[12][2] = {
+		{ 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 },
+		{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 4 },
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }
+	};
+
+	for (unsigned int i = 0; i < s_linBlockSize; i++) {
+		const vec3i local = delinearizeVoxelIndex(i);
+		const vec3i pi = piBase + local;
+
+		float dist[8];
+		vec3f pos[8];
+		vec3f col[8];
+		bool valid = true;
+		for (unsigned int k = 0; k < 8 && valid; k++) {
+			const vec3i l = local + cornerOffsets[k];
+			const Voxel* v = (l.x < SDF_BLOCK_SIZE && l.y < SDF_BLOCK_SIZE && l.z < SDF_BLOCK_SIZE) ? &block.data[linearizeVoxelPos(l)] : getVoxel(pi + cornerOffsets[k]);
+			if (!v || v->weight == 0) { valid = false; break; }
+			dist[k] = v->sdf;
+			pos[k] = vec3f(pi + cornerOffsets[k]) * m_params.m_virtualVoxelSize;
+			col[k] = vec3f(v->color.x, v->color.y, v->color.z) / 255.0f;
+		}
+		if (!valid) continue;
+
+		unsigned int cubeindex = 0;
+		for (unsigned int k = 0; k < 8; k++) {
+			if (dist[k] < isolevel) cubeindex += (1 << k);
+		}
+
+		bool bSkip = false;
+		for (unsigned int k = 0; k < 8 && !bSkip; k++) {
+			if (std::abs(dist[k]) > m_params.m_threshMarchingCubes2) bSkip = true;
+			for (unsigned int l = 0; l < 8 && !bSkip; l++) {
+				if (dist[k] * dist[l] < 0.0f) {
+					if (std::abs(dist[k]) + std::abs(dist[l]) > m_params.m_threshMarchingCubes) bSkip = true;
+				}
+				else {
+					if (std::abs(dist[k] - dist[l]) > m_params.m_threshMarchingCubes) bSkip = true;
+				}
+			}
+		}
+		if (bSkip) continue;
+		if (edgeTable[cubeindex] == 0 || edgeTable[cubeindex] == 255) continue;
+
+		vec3f vertPos[12], vertCol[12];
+		for (unsigned int e = 0; e < 12; e++) {
+			if (!(edgeTable[cubeindex] & (1 << e))) continue;
+			const unsigned int a = edgeCorners[e][0], b = edgeCorners[e][1];
+			//same as vertexInterp on the GPU
+			if (std::abs(isolevel - dist[a]) < 0.00001f || std::abs(dist[a] - dist[b]) < 0.00001f) {
+				vertPos[e] = pos[a];	vertCol[e] = col[a];
+			}
+			else if (std::abs(isolevel - dist[b]) < 0.00001f) {
+				vertPos[e] = pos[b];	vertCol[e] = col[b];
+			}
+			else {
+				const float mu = (isolevel - dist[a]) / (dist[b] - dist[a]);
+				vertPos[e] = pos[a] + mu * (pos[b] - pos[a]);
+				vertCol[e] = col[a] + mu * (col[b] - col[a]);
+			}
+		}
+
+		for (int t = 0; triTable[cubeindex][t] != -1; t += 3) {
+			for (unsigned int k = 0; k < 3; k++) {
+				const int e = triTable[cubeindex][t + k];
+				mesh.m_Vertices.push_back(vertPos[e]);
+				mesh.m_Colors.push_back(vec4f(vertCol[e], 1.0f));
+			}
+		}
+	}
+}
+
+void CPUSceneRepHashSDF::extractIsoSurface(MeshDataf& mesh) const
+{
+	const unsigned int numBlocks = getNumSDFBlocks();
+	const unsigned int numThreads = m_threadPool->getNumThreads() + 1;
+	const unsigned int blocksPerChunk = std::max(1u, numBlocks / (8 * numThreads));
+	const unsigned int numChunks = (numBlocks + blocksPerChunk - 1) / blocksPerChunk;
+
+	std::vector<MeshDataf> chunkMeshes(numChunks);
+	m_threadPool->parallelFor(0, numChunks, [&](unsigned int c) {
+		const unsigned int end = std::min(numBlocks, (c + 1) * blocksPerChunk);
+		for (unsigned int b = c * blocksPerChunk; b < end; b++) {
+			extractIsoSurfaceBlock(b, chunkMeshes[c]);
+		}
+	});
+
+	size_t numVertices = mesh.m_Vertices.size();
+	for (const MeshDataf& m : chunkMeshes) numVertices += m.m_Vertices.size();
+	mesh.m_Vertices.reserve(numVertices);
+	mesh.m_Colors.reserve(numVertices);
+	for (const MeshDataf& m : chunkMeshes) {
+		mesh.m_Vertices.insert(mesh.m_Vertices.end(), m.m_Vertices.begin(), m.m_Vertices.end());
+		mesh.m_Colors.insert(mesh.m_Colors.end(), m.m_Colors.begin(), m.m_Colors.end());
+	}
+}
+
+void CPUSceneRepHashSDF::saveMesh(const std::string& filename, const mat4f* transform /*= NULL*/, bool overwriteExistingFile /*= false*/) const
+{
+	std::string folder = util::directoryFromPath(filename);
+	if (!util::directoryExists(folder)) {
+		util::makeDirectory(folder);
+	}
+
+	std::string actualFilename = filename;
+	if (!overwriteExistingFile) {
+		while (util::fileExists(actualFilename)) {
+			std::string path = util::directoryFromPath(actualFilename);
+			std::string curr = util::fileNameFromPath(actualFilename);
+			std::string ext = util::getFileExtension(curr);
+			curr = util::removeExtensions(curr);
+			std::string base = util::getBaseBeforeNumericSuffix(curr);
+			unsigned int num = util::getNumericSuffix(curr);
+			if (num == (unsigned int)-1) {
+				num = 0;
+			}
+			actualFilename = path + base + std::to_string(num + 1) + "." + ext;
+		}
+	}
+
+	MeshDataf meshData;
+	extractIsoSurface(meshData);
+
+	//create index buffer (required for merging the triangle soup)
+	meshData.m_FaceIndicesVertices.resize(meshData.m_Vertices.size() / 3);
+	for (unsigned int i = 0; i < (unsigned int)meshData.m_Vertices.size() / 3; i++) {
+		meshData.m_FaceIndicesVertices[i][0] = 3 * i + 0;
+		meshData.m_FaceIndicesVertices[i][1] = 3 * i + 1;
+		meshData.m_FaceIndicesVertices[i][2] = 3 * i + 2;
+	}
+	std::cout << "size before:\t" << meshData.m_Vertices.size() << std::endl;
+
+	std::cout << "merging close vertices... ";
+	meshData.mergeCloseVertices(0.00001f, true);
+	std::cout << "done!" << std::endl;
+	std::cout << "removing duplicate faces... ";
+	meshData.removeDuplicateFaces();
+	std::cout << "done!" << std::endl;
+
+	std::cout << "size after:\t" << meshData.m_Vertices.size() << std::endl;
+
+	if (transform) {
+		meshData.applyTransform(*transform);
+	}
+
+	std::cout << "saving mesh (" << actualFilename << ") ...";
+	MeshIOf::saveToFile(actualFilename, meshData);
+	std::cout << "done!" << std::endl;
+}
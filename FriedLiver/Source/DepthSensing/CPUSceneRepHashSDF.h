@@ -0,0 +1,131 @@
+#pragma once
+
+/************************************************************************/
+/* CPU version of the voxel hash SDF; integrates depth frames and       */
+/* extracts the iso surface on a pool of worker threads (no GPU needed) */
+/************************************************************************/
+
+#include "GlobalAppState.h"
+#include "VoxelUtilHashSDF.h"
+#include "ThreadPool.h"
+
+#include <unordered_map>
+#include <deque>
+
+struct CPUSceneRepParams {
+	float			m_virtualVoxelSize;
+	float			m_truncation;
+	float			m_truncScale;
+	float			m_maxIntegrationDistance;
+	float			m_sensorDepthMin;
+	float			m_sensorDepthMax;
+	unsigned int	m_integrationWeightSample;
+	unsigned int	m_integrationWeightMax;
+	float			m_threshMarchingCubes;
+	float			m_threshMarchingCubes2;
+};
+
+class CPUSceneRepHashSDF
+{
+public:
+	CPUSceneRepHashSDF(const CPUSceneRepParams& params, ThreadPool* threadPool) {
+		m_params = params;
+		m_threadPool = threadPool;
+		reset();
+	}
+	~CPUSceneRepHashSDF() {
+	}
+
+	static CPUSceneRepParams parametersFromGlobalAppState(const GlobalAppState& gas) {
+		CPUSceneRepParams params;
+		params.m_virtualVoxelSize = gas.s_SDFVoxelSize;
+		params.m_truncation = gas.s_SDFTruncation;
+		params.m_truncScale = gas.s_SDFTruncationScale;
+		params.m_maxIntegrationDistance = gas.s_SDFMaxIntegrationDistance;
+		params.m_sensorDepthMin = gas.s_sensorDepthMin;
+		params.m_sensorDepthMax = gas.s_sensorDepthMax;
+		params.m_integrationWeightSample = gas.s_SDFIntegrationWeightSample;
+		params.m_integrationWeightMax = gas.s_SDFIntegrationWeightMax;
+		params.m_threshMarchingCubes = gas.s_SDFMarchingCubeThreshFactor*gas.s_SDFVoxelSize;
+		params.m_threshMarchingCubes2 = gas.s_SDFMarchingCubeThreshFactor*gas.s_SDFVoxelSize;
+		return params;
+	}
+
+	//! integrates a depth/color frame (both width x height, depth in meters with MINF as invalid) given the camera-to-world transform
+	void integrate(const mat4f& cameraToWorld, const mat4f& depthIntrinsics, const float* depth, const uchar4* color, unsigned int width, unsigned int height);
+
+	//! runs marching cubes over all allocated blocks and appends the triangle soup to mesh
+	void extractIsoSurface(MeshDataf& mesh) const;
+
+	//! extracts the iso surface, merges vertices and writes it to file
+	void saveMesh(const std::string& filename, const mat4f* transform = NULL, bool overwriteExistingFile = false) const;
+
+	void reset() {
+		m_blockMap.clear();
+		m_blockPos.clear();
+		m_blocks.clear();
+		m_numIntegratedFrames = 0;
+	}
+
+	unsigned int getNumIntegratedFrames() const {
+		return m_numIntegratedFrames;
+	}
+
+	unsigned int getNumSDFBlocks() const {
+		return (unsigned int)m_blockPos.size();
+	}
+
+private:
+	static const unsigned int s_linBlockSize = SDF_BLOCK_SIZE*SDF_BLOCK_SIZE*SDF_BLOCK_SIZE;
+
+	struct BlockHash {
+		size_t operator()(const vec3i& p) const {
+			//same hash as on the GPU
+			const int p0 = 73856093;
+			const int p1 = 19349669;
+			const int p2 = 83492791;
+			return (size_t)((p.x * p0) ^ (p.y * p1) ^ (p.z * p2));
+		}
+	};
+	typedef std::unordered_map<vec3i, unsigned int, BlockHash> BlockMap;
+
+	struct SDFBlock {
+		Voxel data[s_linBlockSize];
+	};
+
+	static vec3i delinearizeVoxelIndex(unsigned int idx) {
+		return vec3i(idx % SDF_BLOCK_SIZE, (idx % (SDF_BLOCK_SIZE * SDF_BLOCK_SIZE)) / SDF_BLOCK_SIZE, idx / (SDF_BLOCK_SIZE*SDF_BLOCK_SIZE));
+	}
+	static unsigned int linearizeVoxelPos(const vec3i& p) {
+		return p.z * SDF_BLOCK_SIZE * SDF_BLOCK_SIZE + p.y * SDF_BLOCK_SIZE + p.x;
+	}
+	static int floorDiv(int a, int b) {
+		return (a >= 0) ? a / b : -((-a + b - 1) / b);
+	}
+
+	vec3i worldToSDFBlock(const vec3f& p) const {
+		const float s = m_params.m_virtualVoxelSize * SDF_BLOCK_SIZE;
+		return vec3i((int)std::floor(p.x / s), (int)std::floor(p.y / s), (int)std::floor(p.z / s));
+	}
+
+	float getTruncation(float z) const {
+		return m_params.m_truncation + m_params.m_truncScale * z;
+	}
+
+	//! returns NULL if the voxel's block is not allocated
+	const Voxel* getVoxel(const vec3i& virtualVoxelPos) const;
+
+	//! collects all blocks within the truncation region of the given frame (allocates missing ones)
+	void allocBlocks(const mat4f& cameraToWorld, const mat4f& depthIntrinsicsInv, const float* depth, unsigned int width, unsigned int height, std::vector<unsigned int>& blocksToUpdate);
+
+	void extractIsoSurfaceBlock(unsigned int blockIdx, MeshDataf& mesh) const;
+
+	CPUSceneRepParams		m_params;
+	ThreadPool*				m_threadPool;	//managed outside
+
+	BlockMap				m_blockMap;		//block position -> index into m_blocks
+	std::vector<vec3i>		m_blockPos;
+	std::deque<SDFBlock>	m_blocks;		//deque keeps block addresses stable while growing
+
+	unsigned int			m_numIntegratedFrames;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+/************************************************************************/
+/* Pool of fixed size host frame buffers handed out as reference        */
+/* counted pointers; a buffer goes back to the pool once the last       */
+/* reference (sensor, image manager, decoder, ...) is dropped           */
+/************************************************************************/
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+template<class T>
+class FrameBufferPool
+{
+public:
+	typedef std::shared_ptr<T> Buffer;
+
+	FrameBufferPool(size_t numElements = 0) : m_state(std::make_shared<State>()) {
+		m_state->numElements = numElements;
+	}
+
+	//! changes the buffer size; buffers of the old size that are still referenced are freed on release
+	void resize(size_t numElements) {
+		std::unique_lock<std::mutex> lock(m_state->mutex);
+		m_state->freeBuffers();
+		m_state->numElements = numElements;
+	}
+
+	size_t getNumElements() const {
+		return m_state->numElements;
+	}
+
+	//! returns an unreferenced buffer (contents undefined); allocates a new one if none is free; thread-safe
+	Buffer acquire() {
+		std::shared_ptr<State> state = m_state;
+		T* data = NULL;
+		size_t numElements;
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			numElements = state->numElements;
+			if (!state->free.empty()) {
+				data = state->free.back();
+				state->free.pop_back();
+			}
+		}
+		if (!data) {
+			data = new T[numElements];
+			std::unique_lock<std::mutex> lock(state->mutex);
+			state->numAllocated++;
+		}
+		//the deleter keeps the pool state alive, so buffers may outlive the pool object
+		return Buffer(data, [state, numElements](T* p) {
+			std::unique_lock<std::mutex> lock(state->mutex);
+			if (numElements == state->numElements) {
+				state->free.push_back(p);
+			}
+			else {
+				delete[] p;
+				state->numAllocated--;
+			}
+		});
+	}
+
+	//! frees all buffers that are currently not referenced
+	void releaseUnused() {
+		std::unique_lock<std::mutex> lock(m_state->mutex);
+		m_state->freeBuffers();
+	}
+
+	//! number of buffers owned by the pool (free + referenced)
+	size_t getNumAllocated() const {
+		std::unique_lock<std::mutex> lock(m_state->mutex);
+		return m_state->numAllocated;
+	}
+	size_t getNumFree() const {
+		std::unique_lock<std::mutex> lock(m_state->mutex);
+		return m_state->free.size();
+	}
+
+private:
+	struct State {
+		State() : numElements(0), numAllocated(0) {}
+		~State() {
+			freeBuffers();
+		}
+		void freeBuffers() {
+			for (T* p : free) delete[] p;
+			numAllocated -= free.size();
+			free.clear();
+		}
+
+		std::mutex		mutex;
+		size_t			numElements;
+		size_t			numAllocated;
+		std::vector<T*>	free;
+	};
+
+	std::shared_ptr<State> m_state;
+};
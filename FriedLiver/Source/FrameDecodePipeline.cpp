@@ -0,0 +1,134 @@
+#include "stdafx.h"
+
+#include "FrameDecodePipeline.h"
+
+#include <emmintrin.h>
+
+FrameDecodePipeline::FrameDecodePipeline(DecodeFunc decodeFunc, unsigned int numFrames, FrameBufferPool<float>& depthPool, FrameBufferPool<vec4uc>& colorPool,
+	unsigned int colorWidth, unsigned int colorHeight, unsigned int depthWidth, unsigned int depthHeight,
+	float depthShift, unsigned int numThreads, unsigned int numBuffers) : m_depthPool(depthPool), m_colorPool(colorPool)
+{
+	m_decodeFunc = decodeFunc;
+	m_numFrames = numFrames;
+	m_colorWidth = colorWidth;	m_colorHeight = colorHeight;
+	m_depthWidth = depthWidth;	m_depthHeight = depthHeight;
+	m_depthShift = depthShift;
+
+	const size_t numColor = (size_t)m_colorWidth*m_colorHeight;
+	const size_t numDepth = (size_t)m_depthWidth*m_depthHeight;
+	MLIB_ASSERT(m_depthPool.getNumElements() == numDepth && (numColor == 0 || m_colorPool.getNumElements() == numColor));
+	m_slots.resize(std::max(numBuffers, 1u));
+	for (Slot& s : m_slots) {
+		s.frame = (unsigned int)-1;
+		s.bReady = false;
+		s.rawColor = numColor > 0 ? new vec3uc[numColor] : NULL;
+		s.rawDepth = new unsigned short[numDepth];
+	}
+	m_pending.resize(m_slots.size());
+
+	m_threadPool = new ThreadPool(numThreads);
+	m_nextFrame = 0;
+	for (unsigned int f = 0; f < std::min(m_numFrames, (unsigned int)m_slots.size()); f++) {
+		schedule(f);
+	}
+}
+
+FrameDecodePipeline::~FrameDecodePipeline()
+{
+	for (auto& p : m_pending) {
+		if (p.valid()) p.wait();
+	}
+	SAFE_DELETE(m_threadPool);
+
+	for (Slot& s : m_slots) {
+		SAFE_DELETE_ARRAY(s.rawColor);
+		SAFE_DELETE_ARRAY(s.rawDepth);
+	}
+}
+
+void FrameDecodePipeline::schedule(unsigned int frame)
+{
+	const unsigned int slotIdx = frame % (unsigned int)m_slots.size();
+	Slot& slot = m_slots[slotIdx];
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		slot.frame = frame;
+		slot.bReady = false;
+		slot.error = nullptr;
+	}
+	slot.depth = m_depthPool.acquire();
+	if (slot.rawColor) slot.color = m_colorPool.acquire();
+	m_pending[slotIdx] = m_threadPool->enqueue([this, &slot]() { decodeSlot(slot); });
+}
+
+void FrameDecodePipeline::decodeSlot(Slot& slot)
+{
+	std::exception_ptr error;
+	try {
+		m_decodeFunc(slot.frame, slot.rawColor, slot.rawDepth);
+		convertDepth(slot.rawDepth, slot.depth.get(), (size_t)m_depthWidth*m_depthHeight, m_depthShift);
+		if (slot.color) convertColor(slot.rawColor, slot.color.get(), (size_t)m_colorWidth*m_colorHeight);
+	}
+	catch (...) {
+		error = std::current_exception();
+	}
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		slot.error = error;
+		slot.bReady = true;
+	}
+	m_cvReady.notify_all();
+}
+
+bool FrameDecodePipeline::getNext(std::shared_ptr<float>& depth, std::shared_ptr<vec4uc>& color)
+{
+	if (m_nextFrame >= m_numFrames) return false;
+
+	Slot& slot = m_slots[m_nextFrame % m_slots.size()];
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (!(slot.frame == m_nextFrame && slot.bReady)) m_cvReady.wait(lock);
+	}
+	if (slot.error) std::rethrow_exception(slot.error);
+
+	//hand the buffers over and reuse the slot right away for the frame k ahead
+	depth = std::move(slot.depth);
+	color = std::move(slot.color);
+	slot.depth.reset();
+	slot.color.reset();
+	const unsigned int ahead = m_nextFrame + (unsigned int)m_slots.size();
+	if (ahead < m_numFrames) schedule(ahead);
+
+	m_nextFrame++;
+	return true;
+}
+
+void FrameDecodePipeline::convertDepth(const unsigned short* raw, float* depth, size_t numPixels, float depthShift)
+{
+	const __m128 shift = _mm_set1_ps(depthShift);
+	const __m128 minf = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+	const __m128i zero = _mm_setzero_si128();
+
+	size_t i = 0;
+	for (; i + 8 <= numPixels; i += 8) {
+		const __m128i d = _mm_loadu_si128((const __m128i*)(raw + i));
+		const __m128i invalid = _mm_cmpeq_epi16(d, zero);
+		const __m128 lo = _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d, zero)), shift);	//divide (not multiply by the inverse) to match the scalar path exactly
+		const __m128 hi = _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(d, zero)), shift);
+		const __m128 maskLo = _mm_castsi128_ps(_mm_unpacklo_epi16(invalid, invalid));
+		const __m128 maskHi = _mm_castsi128_ps(_mm_unpackhi_epi16(invalid, invalid));
+		_mm_storeu_ps(depth + i, _mm_or_ps(_mm_and_ps(maskLo, minf), _mm_andnot_ps(maskLo, lo)));
+		_mm_storeu_ps(depth + i + 4, _mm_or_ps(_mm_and_ps(maskHi, minf), _mm_andnot_ps(maskHi, hi)));
+	}
+	for (; i < numPixels; i++) {
+		if (raw[i] == 0) depth[i] = -std::numeric_limits<float>::infinity();
+		else depth[i] = (float)raw[i] / depthShift;
+	}
+}
+
+void FrameDecodePipeline::convertColor(const vec3uc* raw, vec4uc* color, size_t numPixels)
+{
+	for (size_t i = 0; i < numPixels; i++) {
+		color[i] = vec4uc(raw[i]);
+	}
+}
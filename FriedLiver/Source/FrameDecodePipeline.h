@@ -0,0 +1,72 @@
+#pragma once
+
+/************************************************************************/
+/* Decodes frames N+1..N+k of a sequence in parallel into pooled       */
+/* frame buffers (replaces SensorData::RGBDFrameCacheRead)              */
+/************************************************************************/
+
+#include "ThreadPool.h"
+#include "FrameBufferPool.h"
+
+#include <functional>
+#include <exception>
+
+class FrameDecodePipeline
+{
+public:
+	//! decodes the compressed frame into the given raw buffers; called concurrently from the worker threads
+	typedef std::function<void(unsigned int frame, vec3uc* color, unsigned short* depth)> DecodeFunc;
+
+	//! numThreads == 0 uses all hardware threads; color may be disabled by passing a 0 color size; converted frames are written into buffers of the given pools
+	FrameDecodePipeline(DecodeFunc decodeFunc, unsigned int numFrames, FrameBufferPool<float>& depthPool, FrameBufferPool<vec4uc>& colorPool,
+		unsigned int colorWidth, unsigned int colorHeight, unsigned int depthWidth, unsigned int depthHeight,
+		float depthShift, unsigned int numThreads, unsigned int numBuffers);
+	~FrameDecodePipeline();
+
+	//! blocks until the next frame is decoded and converted; ownership of the buffers passes to the caller (color is NULL if disabled); returns false after the last frame
+	bool getNext(std::shared_ptr<float>& depth, std::shared_ptr<vec4uc>& color);
+
+	unsigned int getNumBuffers() const {
+		return (unsigned int)m_slots.size();
+	}
+
+	//! depth[i] = raw[i] / depthShift, 0 becomes -inf (SSE2)
+	static void convertDepth(const unsigned short* raw, float* depth, size_t numPixels, float depthShift);
+
+	//! rgb -> rgbx, same result as vec4uc(vec3uc)
+	static void convertColor(const vec3uc* raw, vec4uc* color, size_t numPixels);
+
+private:
+	struct Slot {
+		unsigned int	frame;
+		bool			bReady;
+		std::exception_ptr error;
+
+		vec3uc*			rawColor;
+		unsigned short*	rawDepth;
+		std::shared_ptr<vec4uc>	color;		//acquired from the pool when the frame is scheduled
+		std::shared_ptr<float>	depth;
+	};
+
+	//! queues decoding of the given frame into its slot (frame % #slots)
+	void schedule(unsigned int frame);
+	void decodeSlot(Slot& slot);
+
+	DecodeFunc				m_decodeFunc;
+	unsigned int			m_numFrames;
+	unsigned int			m_colorWidth, m_colorHeight;
+	unsigned int			m_depthWidth, m_depthHeight;
+	float					m_depthShift;
+
+	FrameBufferPool<float>&		m_depthPool;
+	FrameBufferPool<vec4uc>&	m_colorPool;
+
+	std::vector<Slot>		m_slots;
+	unsigned int			m_nextFrame;		//next frame handed out by getNext
+
+	std::mutex				m_mutex;
+	std::condition_variable	m_cvReady;
+	std::vector<std::future<void>> m_pending;
+
+	ThreadPool*				m_threadPool;
+};
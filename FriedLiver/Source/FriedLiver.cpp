@@ -253,6 +253,15 @@ int main(int argc, char** argv)
 		dualGPU.setDevice(DualGPU::DEVICE_RECONSTRUCTION);	//main gpu
 		ConditionManager::init();
 
+		if (GlobalAppState::get().s_checkpointResume) {
+			//resuming re-reads the input up to the checkpoint, i.e. needs the offline reconstruction of a sens file
+			if (!GlobalAppState::get().s_offlineHeadless || GlobalAppState::get().s_sensorIdx != 8) throw MLIB_EXCEPTION("s_checkpointResume requires s_offlineHeadless and the SensorDataReader (s_sensorIdx = 8)");
+			BundlerCheckpoint::Manifest manifest;
+			if (!BundlerCheckpoint::loadManifest(BundlerCheckpoint::getDirectory(GlobalAppState::get().s_checkpointDirectory), manifest)) {
+				throw MLIB_EXCEPTION("no checkpoint to resume in " + GlobalAppState::get().s_checkpointDirectory);
+			}
+		}
+
 		g_RGBDSensor = getRGBDSensor();
 
 		//init the input RGBD sensor
@@ -273,7 +282,12 @@ int main(int argc, char** argv)
 		dualGPU.setDevice(DualGPU::DEVICE_RECONSTRUCTION);	//main gpu
 
 		//start depthSensing render loop
-		startDepthSensing(g_bundler, getRGBDSensor(), g_imageManager);
+		if (GlobalAppState::get().s_offlineHeadless) {
+			startOfflineReconstruction(g_bundler, getRGBDSensor(), g_imageManager);
+		}
+		else {
+			startDepthSensing(g_bundler, getRGBDSensor(), g_imageManager);
+		}
 
 		//TimingLog::printAllTimings();
 		//g_bundler->saveGlobalSiftManagerAndCacheToFile("debug/global");
@@ -301,17 +315,21 @@ int main(int argc, char** argv)
 		auto* s = getRGBDSensor();
 		SAFE_DELETE(s);
 
-		std::cout << "DONE! <<press key to exit program>>" << std::endl;
-		getchar();
+		if (!GlobalAppState::get().s_offlineHeadless) {
+			std::cout << "DONE! <<press key to exit program>>" << std::endl;
+			getchar();
+		}
 	}
 	catch (const std::exception& e)
 	{
-		MessageBoxA(NULL, e.what(), "Exception caught", MB_ICONERROR);
+		if (GlobalAppState::get().s_offlineHeadless) std::cerr << "Exception caught: " << e.what() << std::endl;
+		else MessageBoxA(NULL, e.what(), "Exception caught", MB_ICONERROR);
 		exit(EXIT_FAILURE);
 	}
 	catch (...)
 	{
-		MessageBoxA(NULL, "UNKNOWN EXCEPTION", "Exception caught", MB_ICONERROR);
+		if (GlobalAppState::get().s_offlineHeadless) std::cerr << "Exception caught: UNKNOWN EXCEPTION" << std::endl;
+		else MessageBoxA(NULL, "UNKNOWN EXCEPTION", "Exception caught", MB_ICONERROR);
 		exit(EXIT_FAILURE);
 	}
 
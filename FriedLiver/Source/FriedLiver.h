@@ -60,5 +60,7 @@
 #include "DualGPU.h"
 #include "OnlineBundler.h"
 #include "DepthSensing/DepthSensing.h"
+#include "OfflineReconstruction.h"
+#include "BundlerCheckpoint.h"
 
 
@@ -48,6 +48,9 @@
 	X(unsigned int, s_SDFIntegrationWeightMax) \
 	X(std::string, s_binaryDumpSensorFile) \
 	X(bool, s_binaryDumpSensorUseTrajectory) \
+	X(bool, s_binaryDumpSensorMemoryMapped) \
+	X(unsigned int, s_binaryDumpSensorDecodeThreads) \
+	X(unsigned int, s_binaryDumpSensorDecodeBufferSize) \
 	X(float, s_depthSigmaD) \
 	X(float, s_depthSigmaR) \
 	X(bool, s_depthFilter) \
@@ -91,8 +94,11 @@
 	X(unsigned int, s_recordDataWidth) \
 	X(unsigned int, s_recordDataHeight) \
 	X(bool, s_recordData) \
-	X(bool, s_recordCompression) \
+	X(unsigned int, s_recordCompression) \
 	X(std::string, s_recordDataFile) \
+	X(unsigned int, s_recordStreamThreads) \
+	X(unsigned int, s_recordStreamMaxFramesInFlight) \
+	X(unsigned int, s_recordStreamCommitInterval) \
 	X(bool, s_reconstructionEnabled) \
 	X(bool, s_generateVideo) \
 	X(std::string, s_generateVideoDir) \
@@ -101,7 +107,14 @@
 	X(mat4f, s_topVideoTransformWorld) \
 	X(vec4f, s_topVideoCameraPose) \
 	X(vec2f, s_topVideoMinMax) \
-	X(unsigned int, s_numSolveFramesBeforeExit)
+	X(unsigned int, s_numSolveFramesBeforeExit) \
+	X(bool, s_offlineHeadless) \
+	X(unsigned int, s_offlineNumThreads) \
+	X(bool, s_offlineDumpGlobalCorrs) \
+	X(std::string, s_checkpointDirectory) \
+	X(unsigned int, s_checkpointInterval) \
+	X(unsigned int, s_checkpointCacheCompression) \
+	X(bool, s_checkpointResume)
 
 
 #ifndef VAR_NAME
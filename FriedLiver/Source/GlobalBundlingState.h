@@ -20,19 +20,41 @@
 	X(unsigned int, s_widthSIFT) \
 	X(unsigned int, s_heightSIFT) \
 	X(unsigned int, s_maxNumKeysPerImage) \
+	X(bool, s_siftDetectorCPU) \
+	X(bool, s_siftPipelinedPyramid) \
+	X(bool, s_siftMatcherCPU) \
+	X(bool, s_siftFilterCPU) \
+	X(bool, s_siftFilterRANSAC) \
+	X(unsigned int, s_siftIndexTopK) \
+	X(unsigned int, s_siftIndexNumLists) \
+	X(unsigned int, s_siftIndexNumProbes) \
+	X(unsigned int, s_siftIndexTrainingFrames) \
+	X(unsigned int, s_bowTopK) \
+	X(unsigned int, s_bowVocabularyBranching) \
+	X(unsigned int, s_bowVocabularyDepth) \
+	X(unsigned int, s_bowTrainingFrames) \
+	X(unsigned int, s_globalMatchTemporalNeighbors) \
 	X(unsigned int, s_numLocalNonLinIterations) \
 	X(unsigned int, s_numLocalLinIterations) \
 	X(unsigned int, s_numGlobalNonLinIterations) \
 	X(unsigned int, s_numGlobalLinIterations) \
 	X(unsigned int, s_downsampledWidth) \
 	X(unsigned int, s_downsampledHeight) \
+	X(bool, s_cacheCompact) \
 	X(float, s_verifySiftErrThresh) \
 	X(float, s_verifySiftCorrThresh) \
+	X(bool, s_denseVerifyCPU) \
+	X(float, s_denseVerifyEarlyExitZ) \
 	X(float, s_projCorrDistThres) \
 	X(float, s_projCorrNormalThres) \
 	X(float, s_projCorrColorThresh) \
 	X(float, s_surfAreaPcaThresh) \
 	X(bool, s_recordSolverConvergence) \
+	X(bool, s_solverCPU) \
+	X(bool, s_solverCPUCompare) \
+	X(unsigned int, s_solverPreconditioner) \
+	X(float, s_solverLinearTolerance) \
+	X(float, s_solverEnergyTolerance) \
 	X(bool, s_erodeSIFTdepth) \
 	X(float, s_verifyOptErrThresh) \
 	X(float, s_verifyOptCorrThresh) \
@@ -41,6 +63,7 @@
 	X(float, s_depthSigmaD) \
 	X(float, s_depthSigmaR) \
 	X(bool, s_depthFilter) \
+	X(unsigned int, s_depthFilterMode) \
 	X(unsigned int, s_minNumMatchesLocal) \
 	X(unsigned int, s_minNumMatchesGlobal) \
 	X(bool, s_useComprehensiveFrameInvalidation) \
@@ -62,7 +85,8 @@
 	X(float, s_denseColorGradientMin) \
 	X(float, s_denseDepthMin) \
 	X(float, s_denseDepthMax) \
-	X(unsigned int, s_denseOverlapCheckSubsampleFactor)
+	X(unsigned int, s_denseOverlapCheckSubsampleFactor) \
+	X(unsigned int, s_maxNumDenseImPairs)
 
 using namespace ml;
 
@@ -0,0 +1,334 @@
+#include "stdafx.h"
+
+#include "MappedSensorData.h"
+#include "SensorDataStreamWriter.h"
+#include "DepthCodec.h"
+
+#include <zlib.h>
+#include <fstream>
+
+MappedSensorData::MappedSensorData()
+{
+	m_hFile = INVALID_HANDLE_VALUE;
+	m_hMapping = NULL;
+	m_data = NULL;
+	m_fileSize = 0;
+	m_firstFrameOffset = 0;
+
+	m_colorWidth = m_colorHeight = 0;
+	m_depthWidth = m_depthHeight = 0;
+	m_depthShift = 1000.0f;
+}
+
+MappedSensorData::~MappedSensorData()
+{
+	close();
+}
+
+void MappedSensorData::open(const std::string& filename, bool recoverUnfinalized /*= true*/)
+{
+	close();
+	m_filename = filename;
+
+	//shared for writing so the trajectory can be written back into the same file
+	m_hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE) throw MLIB_EXCEPTION("could not open file " + filename);
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_hFile, &fileSize)) throw MLIB_EXCEPTION("could not get file size of " + filename);
+	m_fileSize = (UINT64)fileSize.QuadPart;
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping == NULL) throw MLIB_EXCEPTION("could not create file mapping for " + filename);
+	m_data = (const unsigned char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == NULL) throw MLIB_EXCEPTION("could not map view of " + filename);
+
+	//header (see SensorData::loadFromFile)
+	UINT64 offset = 0;
+	const unsigned int version = readHeader<unsigned int>(offset);
+	if (version != 4) throw MLIB_EXCEPTION("invalid .sens version " + std::to_string(version) + " in " + filename);
+	const UINT64 strLen = readHeader<UINT64>(offset);
+	if (offset + strLen > m_fileSize) throw MLIB_EXCEPTION("unexpected end of file in " + filename);
+	m_sensorName = std::string((const char*)m_data + offset, (size_t)strLen);
+	offset += strLen;
+	m_calibrationColor.m_intrinsic = readHeader<mat4f>(offset);
+	m_calibrationColor.m_extrinsic = readHeader<mat4f>(offset);
+	m_calibrationDepth.m_intrinsic = readHeader<mat4f>(offset);
+	m_calibrationDepth.m_extrinsic = readHeader<mat4f>(offset);
+	m_colorCompressionType = readHeader<SensorData::COMPRESSION_TYPE_COLOR>(offset);
+	m_depthCompressionType = readHeader<SensorData::COMPRESSION_TYPE_DEPTH>(offset);
+	m_colorWidth = readHeader<unsigned int>(offset);
+	m_colorHeight = readHeader<unsigned int>(offset);
+	m_depthWidth = readHeader<unsigned int>(offset);
+	m_depthHeight = readHeader<unsigned int>(offset);
+	m_depthShift = readHeader<float>(offset);
+	const UINT64 numFrames = readHeader<UINT64>(offset);
+	m_firstFrameOffset = offset;
+
+	const std::string indexFile = getIndexFilename(filename);
+	bool bBuiltIndex = false;
+	if (!loadTrailingIndex(numFrames) && !loadIndex(indexFile, numFrames)) {
+		std::cout << "building frame index for " << filename << "... ";
+		buildIndex(offset, numFrames);
+		std::cout << "done!" << std::endl;
+		bBuiltIndex = true;
+	}
+
+	if (!isFinalized()) {
+		//the header only counts the frames of the last commit, anything after them is left over from the crashed recording
+		if (!recoverUnfinalized) throw MLIB_EXCEPTION("unfinalized .sens file " + filename);
+		close();
+		std::cout << "recovering unfinalized recording " << filename << "... ";
+		const UINT64 numRecovered = SensorDataStreamWriter::recover(filename);
+		std::cout << numRecovered << " frames" << std::endl;
+		open(filename, false);
+		return;
+	}
+	if (bBuiltIndex) saveIndex(indexFile);
+}
+
+void MappedSensorData::close()
+{
+	if (m_data) {
+		UnmapViewOfFile(m_data);
+		m_data = NULL;
+	}
+	if (m_hMapping) {
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE) {
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	m_fileSize = 0;
+	m_frameOffsets.clear();
+}
+
+bool MappedSensorData::loadIndex(const std::string& indexFile, UINT64 numFrames)
+{
+	std::ifstream in(indexFile, std::ios::binary);
+	if (!in.is_open()) return false;
+
+	unsigned int version = 0;
+	UINT64 fileSize = 0, numEntries = 0;
+	in.read((char*)&version, sizeof(unsigned int));
+	in.read((char*)&fileSize, sizeof(UINT64));
+	in.read((char*)&numEntries, sizeof(UINT64));
+	if (!in.good() || version != s_indexVersion || fileSize != m_fileSize || numEntries != numFrames) {
+		MLIB_WARNING("outdated frame index " + indexFile);
+		return false;
+	}
+
+	m_frameOffsets.resize((size_t)numEntries);
+	in.read((char*)m_frameOffsets.data(), sizeof(UINT64)*numEntries);
+	if (!in.good() || !isIndexValid()) {
+		m_frameOffsets.clear();
+		return false;
+	}
+	return true;
+}
+
+bool MappedSensorData::loadTrailingIndex(UINT64 numFrames)
+{
+	UINT64 footer[2];	//#entries, magic
+	if (m_fileSize < sizeof(footer)) return false;
+	memcpy(footer, m_data + m_fileSize - sizeof(footer), sizeof(footer));
+	if (footer[1] != s_trailingIndexMagic) return false;
+	//the header only counts committed frames, the index may be ahead of it (crash during a commit)
+	const UINT64 numEntries = footer[0];
+	if (numEntries < numFrames || sizeof(UINT64)*numEntries > m_fileSize - sizeof(footer)) return false;
+
+	const UINT64 indexOffset = m_fileSize - sizeof(footer) - sizeof(UINT64)*numEntries;
+	//the whole index has to be valid and directly follow the last indexed frame and an empty IMU frame count
+	m_frameOffsets.resize((size_t)numEntries);
+	if (numEntries > 0) memcpy(m_frameOffsets.data(), m_data + indexOffset, sizeof(UINT64)*numEntries);
+	UINT64 numIMUFrames = 1;
+	if (isIndexValid() && getFrameDataEnd() + sizeof(UINT64) == indexOffset) memcpy(&numIMUFrames, m_data + indexOffset - sizeof(UINT64), sizeof(UINT64));
+	if (numIMUFrames != 0) {
+		m_frameOffsets.clear();
+		return false;
+	}
+	m_frameOffsets.resize((size_t)numFrames);
+	return true;
+}
+
+bool MappedSensorData::isIndexValid() const
+{
+	if (m_frameOffsets.empty()) return true;
+	if (m_frameOffsets[0] != m_firstFrameOffset) return false;
+	for (size_t i = 1; i < m_frameOffsets.size(); i++) {
+		if (m_frameOffsets[i] < m_frameOffsets[i - 1] + sizeof(FrameHeader)) return false;
+	}
+	const UINT64 last = m_frameOffsets.back();
+	if (last + sizeof(FrameHeader) > m_fileSize) return false;
+	const FrameHeader h = getFrameHeader((unsigned int)m_frameOffsets.size() - 1);
+	return h.colorSizeBytes <= m_fileSize && h.depthSizeBytes <= m_fileSize && last + sizeof(FrameHeader) + h.colorSizeBytes + h.depthSizeBytes <= m_fileSize;
+}
+
+UINT64 MappedSensorData::getFrameDataEnd() const
+{
+	if (m_frameOffsets.empty()) return m_firstFrameOffset;
+	const FrameHeader h = getFrameHeader((unsigned int)m_frameOffsets.size() - 1);
+	return m_frameOffsets.back() + sizeof(FrameHeader) + h.colorSizeBytes + h.depthSizeBytes;
+}
+
+bool MappedSensorData::isFinalized() const
+{
+	const UINT64 end = getFrameDataEnd();
+	if (end + sizeof(UINT64) > m_fileSize) return false;
+	UINT64 numIMUFrames;
+	memcpy(&numIMUFrames, m_data + end, sizeof(UINT64));
+	if (numIMUFrames > (m_fileSize - end - sizeof(UINT64)) / sizeof(SensorData::IMUFrame)) return false;
+	const UINT64 imuEnd = end + sizeof(UINT64) + numIMUFrames * sizeof(SensorData::IMUFrame);
+	if (imuEnd == m_fileSize) return true;
+
+	//trailing index of all frames (SensorDataStreamWriter)
+	UINT64 footer[2];	//#entries, magic
+	const UINT64 numFrames = m_frameOffsets.size();
+	if (imuEnd + sizeof(UINT64)*numFrames + sizeof(footer) != m_fileSize) return false;
+	memcpy(footer, m_data + m_fileSize - sizeof(footer), sizeof(footer));
+	return footer[0] == numFrames && footer[1] == s_trailingIndexMagic;
+}
+
+void MappedSensorData::buildIndex(UINT64 firstFrameOffset, UINT64 numFrames)
+{
+	m_frameOffsets.resize((size_t)numFrames);
+	UINT64 offset = firstFrameOffset;
+	for (UINT64 i = 0; i < numFrames; i++) {
+		m_frameOffsets[i] = offset;
+		const FrameHeader h = readHeader<FrameHeader>(offset);
+		if (h.colorSizeBytes > m_fileSize || h.depthSizeBytes > m_fileSize) throw MLIB_EXCEPTION("corrupt .sens file " + m_filename + " (frame " + std::to_string(i) + ")");
+		offset += h.colorSizeBytes + h.depthSizeBytes;
+		if (offset > m_fileSize) throw MLIB_EXCEPTION("corrupt .sens file " + m_filename + " (frame " + std::to_string(i) + ")");
+	}
+}
+
+void MappedSensorData::saveIndex(const std::string& indexFile) const
+{
+	std::ofstream out(indexFile, std::ios::binary);
+	if (!out.is_open()) {
+		MLIB_WARNING("could not write frame index " + indexFile);
+		return;
+	}
+	const unsigned int version = s_indexVersion;
+	const UINT64 numEntries = m_frameOffsets.size();
+	out.write((const char*)&version, sizeof(unsigned int));
+	out.write((const char*)&m_fileSize, sizeof(UINT64));
+	out.write((const char*)&numEntries, sizeof(UINT64));
+	out.write((const char*)m_frameOffsets.data(), sizeof(UINT64)*numEntries);
+}
+
+void MappedSensorData::decompressColor(unsigned int frame, vec3uc* color) const
+{
+	const FrameHeader h = getFrameHeader(frame);
+	const unsigned char* src = getColorCompressed(frame);
+	const size_t numPixels = (size_t)m_colorWidth * (size_t)m_colorHeight;
+
+	if (m_colorCompressionType == SensorData::TYPE_RAW) {
+		if (h.colorSizeBytes != sizeof(vec3uc)*numPixels) throw MLIB_EXCEPTION("invalid raw color size in frame " + std::to_string(frame));
+		memcpy(color, src, sizeof(vec3uc)*numPixels);
+		return;
+	}
+
+	//png / jpeg
+	FIMEMORY* mem = FreeImage_OpenMemory((BYTE*)src, (DWORD)h.colorSizeBytes);
+	FREE_IMAGE_FORMAT fif = FreeImage_GetFileTypeFromMemory(mem, 0);
+	FIBITMAP* dib = FreeImage_LoadFromMemory(fif, mem, 0);
+	FreeImage_CloseMemory(mem);
+	if (!dib) throw MLIB_EXCEPTION("could not decompress color of frame " + std::to_string(frame));
+	if (FreeImage_GetBPP(dib) != 24) {
+		FIBITMAP* dib24 = FreeImage_ConvertTo24Bits(dib);
+		FreeImage_Unload(dib);
+		dib = dib24;
+	}
+	if (FreeImage_GetWidth(dib) != m_colorWidth || FreeImage_GetHeight(dib) != m_colorHeight) {
+		FreeImage_Unload(dib);
+		throw MLIB_EXCEPTION("invalid color dimensions in frame " + std::to_string(frame));
+	}
+	for (unsigned int y = 0; y < m_colorHeight; y++) {
+		const BYTE* row = FreeImage_GetScanLine(dib, m_colorHeight - 1 - y);	//free image is bottom up
+		vec3uc* dst = color + (size_t)y*m_colorWidth;
+		for (unsigned int x = 0; x < m_colorWidth; x++) {
+			dst[x] = vec3uc(row[3 * x + FI_RGBA_RED], row[3 * x + FI_RGBA_GREEN], row[3 * x + FI_RGBA_BLUE]);
+		}
+	}
+	FreeImage_Unload(dib);
+}
+
+void MappedSensorData::decompressDepth(unsigned int frame, unsigned short* depth) const
+{
+	const FrameHeader h = getFrameHeader(frame);
+	if (!decompressDepth(m_depthCompressionType, getDepthCompressed(frame), h.depthSizeBytes, m_depthWidth, m_depthHeight, depth)) {
+		throw MLIB_EXCEPTION("could not decompress depth of frame " + std::to_string(frame));
+	}
+}
+
+bool MappedSensorData::decompressDepth(SensorData::COMPRESSION_TYPE_DEPTH type, const unsigned char* src, UINT64 sizeBytes, unsigned int width, unsigned int height, unsigned short* depth)
+{
+	const size_t numBytes = sizeof(unsigned short) * (size_t)width * (size_t)height;
+
+	if (type == SensorData::TYPE_RAW_USHORT) {
+		if (sizeBytes != numBytes) return false;
+		memcpy(depth, src, numBytes);
+	}
+	else if (type == SensorData::TYPE_ZLIB_USHORT) {
+		uLongf destLen = (uLongf)numBytes;
+		if (uncompress((Bytef*)depth, &destLen, src, (uLong)sizeBytes) != Z_OK || destLen != numBytes) return false;
+	}
+	else if (type == DepthCodec::TYPE_PREDICTIVE_RICE_USHORT) {
+		try {
+			DepthCodec::decompress(src, sizeBytes, width, height, depth);
+		}
+		catch (const std::exception&) {
+			return false;
+		}
+	}
+	else {
+		throw MLIB_EXCEPTION("depth compression type " + std::to_string((int)type) + " not supported by the memory mapped reader");
+	}
+	return true;
+}
+
+void MappedSensorData::releaseFrames(unsigned int frameStart, unsigned int frameEnd) const
+{
+	frameEnd = std::min(frameEnd, getNumFrames());
+	if (frameStart >= frameEnd) return;
+
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	const UINT64 pageSize = sysInfo.dwPageSize;
+
+	const FrameHeader last = getFrameHeader(frameEnd - 1);
+	//only whole pages inside the range, neighboring frames might still be in use
+	const UINT64 begin = (m_frameOffsets[frameStart] + pageSize - 1) / pageSize * pageSize;
+	const UINT64 end = (m_frameOffsets[frameEnd - 1] + sizeof(FrameHeader) + last.colorSizeBytes + last.depthSizeBytes) / pageSize * pageSize;
+	if (end <= begin) return;
+
+	//unlocking pages that are not locked removes them from the working set
+	VirtualUnlock((LPVOID)(m_data + begin), (SIZE_T)(end - begin));
+}
+
+void MappedSensorData::saveTrajectory(const std::string& filename, const std::vector<mat4f>& trajectory) const
+{
+	if (!isOpen()) throw MLIB_EXCEPTION("no sensor data file mapped");
+
+	auto fullPath = [](const std::string& f) {
+		char buffer[MAX_PATH];
+		if (GetFullPathNameA(f.c_str(), MAX_PATH, buffer, NULL) == 0) return f;
+		return std::string(buffer);
+	};
+	if (_stricmp(fullPath(filename).c_str(), fullPath(m_filename).c_str()) != 0) {
+		if (!CopyFileA(m_filename.c_str(), filename.c_str(), FALSE)) throw MLIB_EXCEPTION("could not copy " + m_filename + " to " + filename);
+	}
+
+	std::fstream out(filename, std::ios::in | std::ios::out | std::ios::binary);
+	if (!out.is_open()) throw MLIB_EXCEPTION("could not open " + filename + " for writing");
+
+	mat4f invalidTransform; invalidTransform.setZero(-std::numeric_limits<float>::infinity());
+	for (unsigned int i = 0; i < getNumFrames(); i++) {
+		const mat4f& transform = (i < trajectory.size()) ? trajectory[i] : invalidTransform;
+		out.seekp((std::streamoff)m_frameOffsets[i]);		//camera pose is the first entry of a frame record
+		out.write((const char*)&transform, sizeof(mat4f));
+	}
+	if (!out.good()) throw MLIB_EXCEPTION("failed writing trajectory to " + filename);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+/************************************************************************/
+/* Read-only memory mapped view of a .sens file; frames are located via */
+/* a frame index (cached next to the file) and decompressed on demand   */
+/************************************************************************/
+
+#include "stdafx.h"
+
+#include <string>
+#include <vector>
+
+class MappedSensorData
+{
+public:
+	MappedSensorData();
+	~MappedSensorData();
+
+	//! maps the file and loads (or builds and caches) the frame index; only the header, the index and the end of the file are touched.
+	//! a recording left unfinalized by a crash of SensorDataStreamWriter is repaired first (SensorDataStreamWriter::recover) if recoverUnfinalized is set
+	void open(const std::string& filename, bool recoverUnfinalized = true);
+
+	void close();
+
+	bool isOpen() const {
+		return m_data != NULL;
+	}
+
+	const std::string& getFilename() const {
+		return m_filename;
+	}
+
+	unsigned int getNumFrames() const {
+		return (unsigned int)m_frameOffsets.size();
+	}
+
+	mat4f getCameraToWorld(unsigned int frame) const {
+		return getFrameHeader(frame).cameraToWorld;
+	}
+	UINT64 getTimeStampColor(unsigned int frame) const {
+		return getFrameHeader(frame).timeStampColor;
+	}
+	UINT64 getTimeStampDepth(unsigned int frame) const {
+		return getFrameHeader(frame).timeStampDepth;
+	}
+	bool hasColorData(unsigned int frame) const {
+		return getFrameHeader(frame).colorSizeBytes > 0;
+	}
+
+	//! decompresses into a pre-allocated buffer of m_colorWidth*m_colorHeight / m_depthWidth*m_depthHeight; safe to call from multiple threads
+	void decompressColor(unsigned int frame, vec3uc* color) const;
+	void decompressDepth(unsigned int frame, unsigned short* depth) const;
+
+	//! decompresses a single depth frame of the given compression type (RAW, ZLIB or DepthCodec::TYPE_PREDICTIVE_RICE_USHORT); returns false on corrupt data
+	static bool decompressDepth(SensorData::COMPRESSION_TYPE_DEPTH type, const unsigned char* src, UINT64 sizeBytes, unsigned int width, unsigned int height, unsigned short* depth);
+
+	//! same as SensorData::decompressColorAlloc / decompressDepthAlloc (free with std::free)
+	vec3uc* decompressColorAlloc(unsigned int frame) const {
+		vec3uc* res = (vec3uc*)std::malloc(sizeof(vec3uc)*m_colorWidth*m_colorHeight);
+		decompressColor(frame, res);
+		return res;
+	}
+	unsigned short* decompressDepthAlloc(unsigned int frame) const {
+		unsigned short* res = (unsigned short*)std::malloc(sizeof(unsigned short)*m_depthWidth*m_depthHeight);
+		decompressDepth(frame, res);
+		return res;
+	}
+
+	//! drops the mapped pages of frames [frameStart, frameEnd) from the working set (they stay in the file cache)
+	void releaseFrames(unsigned int frameStart, unsigned int frameEnd) const;
+
+	//! writes the trajectory into the camera poses of the given file (copies the mapped file first if it is a different one); remaining frames are set invalid
+	void saveTrajectory(const std::string& filename, const std::vector<mat4f>& trajectory) const;
+
+	//! optional frame index at the end of the file (after the IMU frame count) written by SensorDataStreamWriter: UINT64 offsets[n], UINT64 n, UINT64 magic
+	static const UINT64 s_trailingIndexMagic = 0x31584449534e4553ull;	//"SENSIDX1"
+
+	//header (same layout as ml::SensorData)
+	std::string								m_sensorName;
+	SensorData::CalibrationData				m_calibrationColor;
+	SensorData::CalibrationData				m_calibrationDepth;
+	SensorData::COMPRESSION_TYPE_COLOR		m_colorCompressionType;
+	SensorData::COMPRESSION_TYPE_DEPTH		m_depthCompressionType;
+	unsigned int	m_colorWidth;
+	unsigned int	m_colorHeight;
+	unsigned int	m_depthWidth;
+	unsigned int	m_depthHeight;
+	float			m_depthShift;
+
+private:
+	//! per frame record in the .sens file; followed by colorSizeBytes + depthSizeBytes of compressed data
+	struct FrameHeader {
+		mat4f	cameraToWorld;
+		UINT64	timeStampColor;
+		UINT64	timeStampDepth;
+		UINT64	colorSizeBytes;
+		UINT64	depthSizeBytes;
+	};
+
+	FrameHeader getFrameHeader(unsigned int frame) const {
+		MLIB_ASSERT(frame < m_frameOffsets.size());
+		FrameHeader h;
+		memcpy(&h, m_data + m_frameOffsets[frame], sizeof(FrameHeader));	//records are not aligned
+		return h;
+	}
+	const unsigned char* getColorCompressed(unsigned int frame) const {
+		return m_data + m_frameOffsets[frame] + sizeof(FrameHeader);
+	}
+	const unsigned char* getDepthCompressed(unsigned int frame) const {
+		return getColorCompressed(frame) + getFrameHeader(frame).colorSizeBytes;
+	}
+
+	template<class T>
+	T readHeader(UINT64& offset) const {
+		if (offset + sizeof(T) > m_fileSize) throw MLIB_EXCEPTION("unexpected end of file in " + m_filename);
+		T res;
+		memcpy(&res, m_data + offset, sizeof(T));
+		offset += sizeof(T);
+		return res;
+	}
+
+	static std::string getIndexFilename(const std::string& filename) {
+		return filename + ".idx";
+	}
+	bool loadIndex(const std::string& indexFile, UINT64 numFrames);
+	bool loadTrailingIndex(UINT64 numFrames);
+	//! checks that the index starts at the first frame, increases and that the last indexed frame lies inside the file
+	bool isIndexValid() const;
+	//! end of the frame data (start of the IMU frame count)
+	UINT64 getFrameDataEnd() const;
+	//! the indexed frames are followed by the IMU frames and optionally the trailing index, up to the end of the file
+	bool isFinalized() const;
+	void buildIndex(UINT64 firstFrameOffset, UINT64 numFrames);
+	void saveIndex(const std::string& indexFile) const;
+
+	static const unsigned int s_indexVersion = 1;
+
+	std::string				m_filename;
+	HANDLE					m_hFile;
+	HANDLE					m_hMapping;
+	const unsigned char*	m_data;
+	UINT64					m_fileSize;
+	UINT64					m_firstFrameOffset;
+	std::vector<UINT64>		m_frameOffsets;
+};
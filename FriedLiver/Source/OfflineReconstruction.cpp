@@ -0,0 +1,153 @@
+#include "stdafx.h"
+
+#include "OfflineReconstruction.h"
+
+#include "GlobalAppState.h"
+#include "GlobalBundlingState.h"
+#include "TrajectoryManager.h"
+#include "ConditionManager.h"
+#include "ThreadPool.h"
+#include "SensorDataReader.h"
+#include "DepthSensing/CPUSceneRepHashSDF.h"
+
+
+//! waits for the bundler to finish with the current input frame (same hand shake as in OnD3D11FrameRender); returns false once the sequence and the final solves are done
+static bool processFrame(OnlineBundler* bundler, RGBDSensor* sensor, CUDAImageManager* imageManager)
+{
+#ifdef RUN_MULTITHREADED
+	ConditionManager::lockImageManagerFrameReady(ConditionManager::Recon);
+	while (imageManager->hasBundlingFrameRdy()) { //wait until bundling is done with previous frame
+		ConditionManager::waitImageManagerFrameReady(ConditionManager::Recon);
+	}
+	bool bGotDepth = imageManager->process();
+	if (bGotDepth) {
+		imageManager->setBundlingFrameRdy();					//ready for bundling thread
+		ConditionManager::unlockAndNotifyImageManagerFrameReady(ConditionManager::Recon);
+	}
+	if (!sensor->isReceivingFrames()) { //sequence is done
+		if (bGotDepth) throw MLIB_EXCEPTION("ERROR bGotDepth = true but sequence is done");
+
+		imageManager->setBundlingFrameRdy();				// let bundling still optimize after scanning done
+		ConditionManager::unlockAndNotifyImageManagerFrameReady(ConditionManager::Recon);
+	}
+
+	ConditionManager::lockBundlerProcessedInput(ConditionManager::Recon);
+	while (!bundler->hasProcssedInputFrame()) ConditionManager::waitBundlerProcessedInput(ConditionManager::Recon);
+
+	if (!sensor->isReceivingFrames()) { // let bundling still optimize after scanning done
+		bundler->confirmProcessedInputFrame();
+		ConditionManager::unlockAndNotifyBundlerProcessedInput(ConditionManager::Recon);
+	}
+#else
+	bool bGotDepth = imageManager->process();
+	bundler->processInput();
+#endif
+
+	if (bGotDepth) {
+		mat4f transformation = mat4f::zero();
+		unsigned int frameIdx;
+		bool bGlobalTrackingLost = false;
+		bool validTransform = bundler->getCurrentIntegrationFrame(transformation, frameIdx, bGlobalTrackingLost);
+#ifdef RUN_MULTITHREADED
+		//allow bundler to process new frame
+		bundler->confirmProcessedInputFrame();
+		ConditionManager::unlockAndNotifyBundlerProcessedInput(ConditionManager::Recon);
+#endif
+		//nothing is integrated while streaming; the final trajectory is fused at the end
+		if (validTransform)	bundler->getTrajectoryManager()->addFrame(TrajectoryManager::TrajectoryFrame::NotIntegrated_WithTransform, transformation, imageManager->getCurrFrameNumber());
+		else				bundler->getTrajectoryManager()->addFrame(TrajectoryManager::TrajectoryFrame::NotIntegrated_NoTransform, mat4f::zero(-std::numeric_limits<float>::infinity()), imageManager->getCurrFrameNumber());
+	}
+
+#ifndef RUN_MULTITHREADED
+	bundler->process(GlobalBundlingState::get().s_numLocalNonLinIterations, GlobalBundlingState::get().s_numLocalLinIterations,
+		GlobalBundlingState::get().s_numGlobalNonLinIterations, GlobalBundlingState::get().s_numGlobalLinIterations);
+#endif
+
+	if (!sensor->isReceivingFrames()) {
+		static unsigned int countPastLast = 0;
+		const unsigned int endSolveFrame = (GlobalAppState::get().s_numSolveFramesBeforeExit == (unsigned int)-1) ? 1 : GlobalAppState::get().s_numSolveFramesBeforeExit + 1;
+		if (countPastLast >= endSolveFrame) return false;
+		countPastLast++;
+	}
+	return true;
+}
+
+int startOfflineReconstruction(OnlineBundler* bundler, RGBDSensor* sensor, CUDAImageManager* imageManager)
+{
+	if (GlobalAppState::get().s_bUseCameraCalibration) throw MLIB_EXCEPTION("camera calibration is not supported in offline (headless) mode");
+
+	const std::string baseFile = util::removeExtensions(GlobalAppState::get().s_binaryDumpSensorFile);
+	ThreadPool& threadPool = ThreadPool::get(GlobalAppState::get().s_offlineNumThreads);
+	std::cout << "[ offline reconstruction ] " << threadPool.getNumThreads() << " worker threads" << std::endl;
+
+	Timer t;
+	t.start();
+	if (GlobalAppState::get().s_checkpointResume) {
+		//the bundler was restored from the checkpoint; the frames up to it are only read again (they are fused at the end)
+		const unsigned int lastFrame = bundler->getCurrProcessedFrame();
+		for (unsigned int i = 0; i <= lastFrame; i++) {
+			if (!imageManager->process()) throw MLIB_EXCEPTION("sequence ended before the checkpoint frame " + std::to_string(lastFrame));
+		}
+#ifndef RUN_MULTITHREADED
+		//the solve following the checkpoint frame
+		bundler->process(GlobalBundlingState::get().s_numLocalNonLinIterations, GlobalBundlingState::get().s_numLocalLinIterations,
+			GlobalBundlingState::get().s_numGlobalNonLinIterations, GlobalBundlingState::get().s_numGlobalLinIterations);
+#endif
+	}
+	while (processFrame(bundler, sensor, imageManager)) {
+		if (ConditionManager::shouldExit()) break;
+	}
+	t.stop();
+	const double timeBundling = t.getElapsedTime();
+	const unsigned int numFrames = bundler->getTrajectoryManager()->getNumAddedFrames();
+	std::cout << "[ bundling ] " << numFrames << " frames in " << timeBundling << " s (" << (double)numFrames / timeBundling << " fps)" << std::endl;
+
+	//final trajectory
+	std::vector<mat4f> trajectory;
+	bundler->getTrajectoryManager()->getOptimizedTransforms(trajectory);
+	const unsigned int numValidTransforms = PoseHelper::countNumValidTransforms(trajectory);
+	const unsigned int numTransforms = (unsigned int)trajectory.size();
+	std::cout << "#VALID TRANSFORMS = " << numValidTransforms << std::endl;
+	PoseHelper::saveToPoseFile(baseFile + ".txt", trajectory);
+	if (GlobalAppState::get().s_offlineDumpGlobalCorrs) {
+		//input of benchmarkPreconditioners (as key 'Z')
+		bundler->saveGlobalSparseCorrsToFile(baseFile + ".corrs");
+		BinaryDataStreamFile s(baseFile + ".traj", true);
+		s << trajectory; s.close();
+	}
+	if (GlobalAppState::get().s_sensorIdx == 8) ((SensorDataReader*)sensor)->saveToFile(GlobalAppState::get().s_binaryDumpSensorFile, trajectory); //overwrite the original file
+
+	//fuse all frames with the optimized poses
+	t.start();
+	CPUSceneRepHashSDF sceneRep(CPUSceneRepHashSDF::parametersFromGlobalAppState(GlobalAppState::get()), &threadPool);
+	if (GlobalAppState::get().s_reconstructionEnabled) {
+		const unsigned int width = imageManager->getIntegrationWidth();
+		const unsigned int height = imageManager->getIntegrationHeight();
+		for (unsigned int i = 0; i < numTransforms; i++) {
+			if (trajectory[i][0] == -std::numeric_limits<float>::infinity()) continue;
+			CUDAImageManager::ManagedRGBDInputFrame& frame = imageManager->getIntegrateFrame(i);
+			sceneRep.integrate(trajectory[i], imageManager->getDepthIntrinsics(), frame.getDepthFrameCPU(), frame.getColorFrameCPU(), width, height);
+		}
+		std::cout << "[marching cubes] ";
+		sceneRep.saveMesh(baseFile + ".ply", NULL, true); //force overwrite and existing plys
+		std::cout << "done!" << std::endl;
+	}
+	t.stop();
+	const double timeFusion = t.getElapsedTime();
+	std::cout << "[ fusion ] " << sceneRep.getNumIntegratedFrames() << " frames, " << sceneRep.getNumSDFBlocks() << " blocks in " << timeFusion << " s" << std::endl;
+
+	const double fps = (double)numFrames / (timeBundling + timeFusion);
+	std::cout << "[ offline reconstruction ] " << fps << " fps total, " << fps / (threadPool.getNumThreads() + 1) << " fps per core" << std::endl;
+
+	//write out confirmation file
+	const bool valid = numValidTransforms >= (unsigned int)std::round(0.5f * numTransforms);
+	std::ofstream s(util::directoryFromPath(GlobalAppState::get().s_binaryDumpSensorFile) + "processed.txt");
+	if (valid)  s << "valid = true" << std::endl;
+	else		s << "valid = false" << std::endl;
+	s << "numSDFBlocks = " << sceneRep.getNumSDFBlocks() << std::endl;
+	s << "numValidOptTransforms = " << numValidTransforms << std::endl;
+	s << "numTransforms = " << numTransforms << std::endl;
+	s.close();
+
+	return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "RGBDSensor.h"
+#include "CUDAImageManager.h"
+#include "OnlineBundler.h"
+
+//! runs the bundling pipeline without any window / D3D device; after the sequence is done all frames are fused on the CPU with the final optimized trajectory.
+//! only the fusion and meshing run on the CPU: the bundler (SIFT, matching, solver) and the image manager still need a CUDA device
+int startOfflineReconstruction(OnlineBundler* bundler, RGBDSensor* sensor, CUDAImageManager* imageManager);
@@ -6,6 +6,7 @@
 #include "CUDAImageManager.h"
 #include "Bundler.h"
 #include "TrajectoryManager.h"
+#include "BundlerCheckpoint.h"
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
 #include "SensorDataReader.h"
 #endif
@@ -28,7 +29,7 @@ extern "C" void updateTrajectoryCU(
 
 #define ID_MARK_OFFSET 2
 
-OnlineBundler::OnlineBundler(const RGBDSensor* sensor, const CUDAImageManager* imageManager)
+OnlineBundler::OnlineBundler(const RGBDSensor* sensor, CUDAImageManager* imageManager)
 {
 	//init input data
 	m_cudaImageManager = imageManager;
@@ -78,6 +79,14 @@ OnlineBundler::OnlineBundler(const RGBDSensor* sensor, const CUDAImageManager* i
 
 	m_bHasProcessedInputFrame = false;
 	m_bExitBundlingThread = false;
+
+	m_checkpointWriter = NULL;
+	m_checkpointInterval = GlobalAppState::get().s_checkpointInterval;
+	m_numCheckpointGlobalFrames = 0;
+	if (!GlobalAppState::get().s_checkpointDirectory.empty() && m_checkpointInterval > 0) {
+		m_checkpointWriter = new BundlerCheckpointWriter(GlobalAppState::get().s_checkpointDirectory, (CUDACacheCheckpoint::COMPRESSION_TYPE)GlobalAppState::get().s_checkpointCacheCompression);
+	}
+	if (GlobalAppState::get().s_checkpointResume) loadCheckpoint();
 #ifdef EVALUATE_SPARSE_CORRESPONDENCES
 	if (GlobalAppState::get().s_sensorIdx != 8) throw MLIB_EXCEPTION("unable to evaluate sparse corrs for non sens-data input");
 	std::vector<mat4f> trajectory; 
@@ -92,6 +101,7 @@ OnlineBundler::OnlineBundler(const RGBDSensor* sensor, const CUDAImageManager* i
 
 OnlineBundler::~OnlineBundler()
 {
+	SAFE_DELETE(m_checkpointWriter);	//waits for a pending checkpoint
 	SAFE_DELETE(m_local);
 	SAFE_DELETE(m_optLocal);
 	SAFE_DELETE(m_global);
@@ -224,6 +234,12 @@ void OnlineBundler::processInput()
 	}
 
 	m_state.m_lastFrameProcessed = curFrame;
+
+	//periodic checkpoint; skipped while the optimization thread is in process()
+	if (m_checkpointWriter && mutex_process.try_lock()) {
+		std::lock_guard<std::mutex> lock(mutex_process, std::adopt_lock);
+		if (m_global->getNumFrames() >= m_numCheckpointGlobalFrames + m_checkpointInterval) saveCheckpoint();
+	}
 }
 
 bool OnlineBundler::getCurrentIntegrationFrame(mat4f& siftTransform, unsigned int& frameIdx, bool& bGlobalTrackingLost)
@@ -410,6 +426,7 @@ void OnlineBundler::optimizeGlobal(unsigned int numNonLinIterations, unsigned in
 void OnlineBundler::process(unsigned int numNonLinItersLocal, unsigned int numLinItersLocal, unsigned int numNonLinItersGlobal, unsigned int numLinItersGlobal)
 {
 	if (!m_state.m_bUseSolve) return; //solver off
+	std::lock_guard<std::mutex> lock(mutex_process);
 
 	optimizeLocal(numNonLinItersLocal, numLinItersLocal);
 	processGlobal();
@@ -472,6 +489,109 @@ void OnlineBundler::process(unsigned int numNonLinItersLocal, unsigned int numLi
 	//}
 }
 
+void OnlineBundler::saveCheckpoint()
+{
+	if (m_state.m_lastFrameProcessed < 0) return;
+	try {
+		m_checkpointWriter->waitForSave(); //the new global segment starts after the last complete checkpoint
+	}
+	catch (const std::exception& e) {
+		std::cerr << "WARNING: checkpoint failed: " << e.what() << std::endl;
+	}
+	const unsigned int maxNumImages = GlobalBundlingState::get().s_maxNumImages;
+	const unsigned int numFrames = m_state.m_lastFrameProcessed + 1;
+	const unsigned int numLocalTrajectories = std::min(maxNumImages, numFrames / m_submapSize + 1);
+
+	CheckpointBuffer globalImages, state;
+	state.write(m_submapSize);
+	state.write(maxNumImages);
+	state.write(m_state);
+	m_local->saveCheckpoint(0, state, state);
+	m_optLocal->saveCheckpoint(0, state, state);
+	m_global->saveCheckpoint(m_checkpointWriter->getManifest().getNumGlobalFrames(), globalImages, state);
+
+	state.writeDataGPU(d_completeTrajectory, sizeof(float4x4)*numFrames);
+	state.writeDataGPU(d_siftTrajectory, sizeof(float4x4)*numFrames);
+	state.writeData(m_currIntegrateTransform.data(), sizeof(mat4f)*numFrames);
+	state.writeData(m_invalidImagesList.data(), sizeof(unsigned int)*numFrames);
+	state.write(numLocalTrajectories);
+	state.writeDataGPU(d_localTrajectories, sizeof(float4x4)*(m_submapSize + 1)*numLocalTrajectories);
+	for (unsigned int i = 0; i < numLocalTrajectories; i++) state.writeVector(m_localTrajectoriesValid[i]);
+	m_trajectoryManager->saveCheckpoint(state);
+
+	try {
+		m_checkpointWriter->saveAsync(globalImages, m_global->getCache(), m_local->getCache(), m_optLocal->getCache(), state);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "WARNING: checkpoint failed: " << e.what() << std::endl;
+		return;
+	}
+	m_numCheckpointGlobalFrames = m_global->getNumFrames();
+	if (GlobalBundlingState::get().s_verbose) std::cout << "[ checkpoint ] frame " << m_state.m_lastFrameProcessed << ", " << m_numCheckpointGlobalFrames << " global frames" << std::endl;
+}
+
+void OnlineBundler::loadCheckpoint()
+{
+	const std::string directory = BundlerCheckpoint::getDirectory(GlobalAppState::get().s_checkpointDirectory);
+	BundlerCheckpoint::Manifest manifest;
+	if (!BundlerCheckpoint::loadManifest(directory, manifest)) throw MLIB_EXCEPTION("no checkpoint in " + directory);
+
+	//per frame data: global segments and the caches of the local bundlers
+	m_local->reset();
+	m_optLocal->reset();
+	m_global->reset();
+	for (const BundlerCheckpoint::Segment& segment : manifest.segments) {
+		CheckpointBuffer images;
+		images.loadFromFile(BundlerCheckpoint::getGlobalImagesFile(directory, segment.checkpoint));
+		m_global->loadCheckpointImages(images);
+		BundlerCheckpoint::loadCache(BundlerCheckpoint::getCacheFile(directory, "global", segment.checkpoint), m_global->getCache(), segment.firstFrame);
+	}
+	BundlerCheckpoint::loadCache(BundlerCheckpoint::getCacheFile(directory, "local", manifest.checkpoint), m_local->getCache(), 0);
+	BundlerCheckpoint::loadCache(BundlerCheckpoint::getCacheFile(directory, "optlocal", manifest.checkpoint), m_optLocal->getCache(), 0);
+
+	//state (same order as saveCheckpoint)
+	CheckpointBuffer state;
+	state.loadFromFile(BundlerCheckpoint::getStateFile(directory, manifest.checkpoint));
+	const unsigned int maxNumImages = GlobalBundlingState::get().s_maxNumImages;
+	unsigned int submapSize = 0, checkpointMaxNumImages = 0;
+	state.read(submapSize);
+	state.read(checkpointMaxNumImages);
+	if (submapSize != m_submapSize || checkpointMaxNumImages != maxNumImages) {
+		throw MLIB_EXCEPTION("checkpoint was written with s_submapSize = " + std::to_string(submapSize) + ", s_maxNumImages = " + std::to_string(checkpointMaxNumImages));
+	}
+	state.read(m_state);
+	m_local->loadCheckpointImages(state);
+	m_local->loadCheckpointState(state);
+	m_optLocal->loadCheckpointImages(state);
+	m_optLocal->loadCheckpointState(state);
+	m_global->loadCheckpointState(state);
+
+	const unsigned int numFrames = m_state.m_lastFrameProcessed + 1;
+	if (m_state.m_lastFrameProcessed < 0 || numFrames > m_currIntegrateTransform.size()) throw MLIB_EXCEPTION("invalid checkpoint state");
+	unsigned int numLocalTrajectories = 0;
+	state.readDataGPU(d_completeTrajectory, sizeof(float4x4)*numFrames);
+	state.readDataGPU(d_siftTrajectory, sizeof(float4x4)*numFrames);
+	state.readData(m_currIntegrateTransform.data(), sizeof(mat4f)*numFrames);
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_currIntegrateTransform, m_currIntegrateTransform.data(), sizeof(float4x4)*numFrames, cudaMemcpyHostToDevice));
+	state.readData(m_invalidImagesList.data(), sizeof(unsigned int)*numFrames);
+	state.read(numLocalTrajectories);
+	if (numLocalTrajectories > maxNumImages) throw MLIB_EXCEPTION("invalid checkpoint state");
+	state.readDataGPU(d_localTrajectories, sizeof(float4x4)*(m_submapSize + 1)*numLocalTrajectories);
+	for (unsigned int i = 0; i < numLocalTrajectories; i++) state.readVector(m_localTrajectoriesValid[i]);
+	m_trajectoryManager->loadCheckpoint(state);
+
+	//the checkpoint is taken at the end of processInput, before the last processed frame is handed to the trajectory manager
+	if (m_trajectoryManager->getNumAddedFrames() == (unsigned int)m_state.m_lastFrameProcessed) {
+		mat4f transform; unsigned int frameIdx; bool bGlobalTrackingLost;
+		if (getCurrentIntegrationFrame(transform, frameIdx, bGlobalTrackingLost))	m_trajectoryManager->addFrame(TrajectoryManager::TrajectoryFrame::NotIntegrated_WithTransform, transform, frameIdx);
+		else																		m_trajectoryManager->addFrame(TrajectoryManager::TrajectoryFrame::NotIntegrated_NoTransform, mat4f::zero(-std::numeric_limits<float>::infinity()), m_state.m_lastFrameProcessed);
+	}
+
+	if (m_checkpointWriter) m_checkpointWriter->setManifest(manifest);
+	m_numCheckpointGlobalFrames = m_global->getNumFrames();
+	std::cout << "[ checkpoint ] resumed " << directory << " after frame " << m_state.m_lastFrameProcessed << " (" << m_global->getNumFrames() << " global frames)" << std::endl;
+}
+
 void OnlineBundler::saveGlobalSparseCorrsToFile(const std::string& filename) const
 {
 	m_global->saveSparseCorrsToFile(filename);
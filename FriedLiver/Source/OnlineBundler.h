@@ -6,10 +6,11 @@ class Bundler;
 class RGBDSensor;
 class CUDAImageManager;
 class TrajectoryManager;
+class BundlerCheckpointWriter;
 
 class OnlineBundler {
 public:
-	OnlineBundler(const RGBDSensor* sensor, const CUDAImageManager* imageManager);
+	OnlineBundler(const RGBDSensor* sensor, CUDAImageManager* imageManager);
 	~OnlineBundler();
 
 
@@ -51,6 +52,11 @@ private:
 	void optimizeGlobal(unsigned int numNonLinIterations, unsigned int numLinIterations);
 
 	void updateTrajectory(unsigned int curFrame);
+
+	//! session checkpoint (s_checkpointDirectory): state and new global frames are downloaded now and written in the background; only called while process() is not running
+	void saveCheckpoint();
+	//! restores the last checkpoint of s_checkpointDirectory; processInput continues with frame getCurrProcessedFrame() + 1, so the input has to be advanced accordingly
+	void loadCheckpoint();
 	void invalidateImages(unsigned int startFrame, unsigned int endFrame = -1) {
 		if (endFrame == -1) m_invalidImagesList[startFrame] = 0;
 		else {
@@ -69,7 +75,7 @@ private:
 	//*********** for interfacing with recon ************
 	bool m_bHasProcessedInputFrame;
 	bool m_bExitBundlingThread;
-	const CUDAImageManager*		m_cudaImageManager; //managed outside
+	CUDAImageManager*			m_cudaImageManager; //managed outside (non-const: hands its input buffers to bundling)
 
 	//*********** input data ************
 	BundlerInputData			m_input;
@@ -103,5 +109,11 @@ private:
 	float4x4*					d_currIntegrateTransform;
 	std::vector<mat4f>			m_currIntegrateTransform;
 
+	//*********** CHECKPOINTS ************
+	std::mutex					mutex_process;				//held by process(); checkpoints are only taken while it is free
+	BundlerCheckpointWriter*	m_checkpointWriter;			//NULL unless s_checkpointDirectory and s_checkpointInterval are set
+	unsigned int				m_checkpointInterval;		//#global frames
+	unsigned int				m_numCheckpointGlobalFrames;	//#global frames at the last checkpoint
+
 	Timer						m_timer;
 };
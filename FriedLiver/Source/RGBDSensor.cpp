@@ -4,6 +4,9 @@
 #include "RGBDSensor.h"
 
 #include "GlobalAppState.h"
+#include "SensorDataStreamWriter.h"
+#include "MappedSensorData.h"
+#include "DepthCodec.h"
 
 //namespace stb {
 //#define STB_IMAGE_IMPLEMENTATION
@@ -17,6 +20,25 @@
 
 #include <limits>
 
+//! appends a numeric suffix to the file name until it does not exist yet
+static std::string getUniqueRecordingFilename(const std::string& filename)
+{
+	std::string actualFilename = filename;
+	while (util::fileExists(actualFilename)) {
+		std::string path = util::directoryFromPath(actualFilename);
+		std::string curr = util::fileNameFromPath(actualFilename);
+		std::string ext = util::getFileExtension(curr);
+		curr = util::removeExtensions(curr);
+		std::string base = util::getBaseBeforeNumericSuffix(curr);
+		unsigned int num = util::getNumericSuffix(curr);
+		if (num == (unsigned int)-1) {
+			num = 0;
+		}
+		actualFilename = path + base + std::to_string(num + 1) + "." + ext;
+	}
+	return actualFilename;
+}
+
 RGBDSensor::RGBDSensor()
 {
 	m_depthWidth  = 0;
@@ -34,8 +56,7 @@ RGBDSensor::RGBDSensor()
 	m_recordDataWidth = 0;
 	m_recordDataHeight = 0;
 
-	m_recordedData = NULL;
-	m_recordedDataCache = NULL;
+	m_recordedStream = NULL;
 }
 
 void RGBDSensor::init(unsigned int depthWidth, unsigned int depthHeight, unsigned int colorWidth, unsigned int colorHeight, unsigned int depthRingBufferSize)
@@ -48,32 +69,33 @@ void RGBDSensor::init(unsigned int depthWidth, unsigned int depthHeight, unsigne
 	m_colorWidth  = static_cast<LONG>(colorWidth);
 	m_colorHeight = static_cast<LONG>(colorHeight);
 
-	for (size_t i = 0; i < m_depthFloat.size(); i++) {
-		SAFE_DELETE_ARRAY(m_depthFloat[i]);
-	}
+	m_depthPool.resize(m_depthWidth*m_depthHeight);
+	m_colorPool.resize(m_colorWidth*m_colorHeight);
+
+	m_depthBuffers.resize(depthRingBufferSize);
 	m_depthFloat.resize(depthRingBufferSize);
 	for (unsigned int i = 0; i<depthRingBufferSize; i++) {
-		m_depthFloat[i] = new float[m_depthWidth*m_depthHeight];
+		m_depthBuffers[i] = m_depthPool.acquire();
+		m_depthFloat[i] = m_depthBuffers[i].get();
 	}
 
-	SAFE_DELETE_ARRAY(m_colorRGBX);
-	m_colorRGBX = new vec4uc[m_colorWidth*m_colorHeight];
+	m_colorBuffer = m_colorPool.acquire();
+	m_colorRGBX = m_colorBuffer.get();
 
 	m_recordDataWidth = GlobalAppState::get().s_recordDataWidth;
 	m_recordDataHeight = GlobalAppState::get().s_recordDataHeight;
 
-	m_bUseModernSensFilesForRecording = GlobalAppState::get().s_recordCompression;
+	m_bUseModernSensFilesForRecording = GlobalAppState::get().s_recordCompression != 0;
 
 }
 
 RGBDSensor::~RGBDSensor()
 {
-	// done with pixel data
-	SAFE_DELETE_ARRAY(m_colorRGBX);
+	// done with pixel data (buffers still referenced elsewhere are freed with the last reference)
+	m_colorBuffer.reset();
+	m_colorRGBX = NULL;
 
-	for (size_t i = 0; i < m_depthFloat.size(); i++) {
-		SAFE_DELETE_ARRAY(m_depthFloat[i]);
-	}
+	m_depthBuffers.clear();
 	m_depthFloat.clear();
 
 	reset();
@@ -194,6 +216,45 @@ const vec4uc* RGBDSensor::getColorRGBX() const {
 	return m_colorRGBX;
 }
 
+std::shared_ptr<float> RGBDSensor::getDepthFloatShared() const {
+	return m_depthBuffers[m_currentRingBufIdx];
+}
+
+std::shared_ptr<vec4uc> RGBDSensor::getColorRGBXShared() const {
+	return m_colorBuffer;
+}
+
+void RGBDSensor::prepareNextFrameBuffers()
+{
+	//only the sensor itself holds a reference -> keep writing into the same memory
+	for (size_t i = 0; i < m_depthBuffers.size(); i++) {
+		if (m_depthBuffers[i].use_count() > 1) {
+			m_depthBuffers[i] = m_depthPool.acquire();
+			m_depthFloat[i] = m_depthBuffers[i].get();
+		}
+	}
+	if (m_colorBuffer.use_count() > 1) {
+		m_colorBuffer = m_colorPool.acquire();
+		m_colorRGBX = m_colorBuffer.get();
+	}
+}
+
+void RGBDSensor::releaseUnusedFrameBuffers()
+{
+	m_depthPool.releaseUnused();
+	m_colorPool.releaseUnused();
+}
+
+void RGBDSensor::setFrameBuffers(const std::shared_ptr<float>& depth, const std::shared_ptr<vec4uc>& color)
+{
+	m_depthBuffers[m_currentRingBufIdx] = depth;
+	m_depthFloat[m_currentRingBufIdx] = depth.get();
+	if (color) {
+		m_colorBuffer = color;
+		m_colorRGBX = color.get();
+	}
+}
+
 
 unsigned int RGBDSensor::getColorWidth()  const {
 	return m_colorWidth;
@@ -227,11 +288,7 @@ void RGBDSensor::reset()
 	}
 	m_recordedPoints.clear();
 
-	SAFE_DELETE(m_recordedDataCache);
-	if (m_recordedData) {
-		m_recordedData->free();
-		SAFE_DELETE(m_recordedData);
-	}
+	SAFE_DELETE(m_recordedStream);	//leaves a valid file with all frames recorded so far
 }
 
 void RGBDSensor::savePointCloud( const std::string& filename, const mat4f& transform /*= mat4f::identity()*/ ) const
@@ -264,57 +321,32 @@ void RGBDSensor::savePointCloud( const std::string& filename, const mat4f& trans
 void RGBDSensor::recordFrame()
 {
 	if (m_bUseModernSensFilesForRecording) {
-		if (!m_recordedData) {
-			m_recordedData = new ml::SensorData;
-			m_recordedData->initDefault(
-				getColorWidth(),
-				getColorHeight(),
-				getDepthWidth(),
-				getDepthHeight(),
+		if (!m_recordedStream) {
+			//frames are compressed and written while recording; saveRecordedFramesToFile only adds the trajectory
+			const std::string& filename = GlobalAppState::get().s_recordDataFile;
+			const std::string folder = util::directoryFromPath(filename);
+			if (!folder.empty() && !util::directoryExists(folder)) {
+				util::makeDirectory(folder);
+			}
+			m_recordedStream = new SensorDataStreamWriter(getUniqueRecordingFilename(filename), getSensorName(),
 				ml::SensorData::CalibrationData(getColorIntrinsics(), getColorExtrinsics()),
 				ml::SensorData::CalibrationData(getDepthIntrinsics(), getDepthExtrinsics()),
+				getColorWidth(), getColorHeight(), getDepthWidth(), getDepthHeight(), 1000.0f,
 				ml::SensorData::TYPE_JPEG,
-				ml::SensorData::TYPE_ZLIB_USHORT,
-				1000.0f,
-				getSensorName()
-				);
-			//m_recordedData->m_sensorName = getSensorName();
-			//m_recordedData->m_calibrationColor.m_intrinsic = getColorIntrinsics();
-			//m_recordedData->m_calibrationColor.m_extrinsic = getColorExtrinsics();
-			//m_recordedData->m_calibrationDepth.m_intrinsic = getDepthIntrinsics();
-			//m_recordedData->m_calibrationDepth.m_extrinsic = getDepthExtrinsics();
-			//m_recordedData->m_colorWidth = getColorWidth();
-			//m_recordedData->m_colorHeight = getColorHeight();
-			//m_recordedData->m_depthWidth = getDepthWidth();
-			//m_recordedData->m_depthHeight = getDepthHeight();
-			//m_recordedData->m_depthShift = 1000.0f;
-		}
-		if (!m_recordedDataCache) {
-			const unsigned int cacheSize = 1000;
-			m_recordedDataCache = new ml::SensorData::RGBDFrameCacheWrite(m_recordedData, cacheSize);
+				GlobalAppState::get().s_recordCompression == 2 ? DepthCodec::TYPE_PREDICTIVE_RICE_USHORT : ml::SensorData::TYPE_ZLIB_USHORT,
+				GlobalAppState::get().s_recordStreamThreads, GlobalAppState::get().s_recordStreamMaxFramesInFlight, GlobalAppState::get().s_recordStreamCommitInterval);
+			std::cout << "recording to " << m_recordedStream->getFilename() << std::endl;
 		}
 
-		vec3uc* color = (vec3uc*)std::malloc(sizeof(vec3uc)*getColorWidth()*getColorHeight());
-		unsigned short* depth = (unsigned short*)std::malloc(sizeof(unsigned short)*getDepthWidth()*getDepthHeight());
-		for (unsigned int i = 0; i < getColorWidth()*getColorHeight(); i++) {
-			const auto* c = getColorRGBX();
-			color[i] = vec3uc(c[i].x, c[i].y, c[i].z);
-		}
-		for (unsigned int i = 0; i < getDepthWidth()*getDepthHeight(); i++) {
-			const auto* d = getDepthFloat();
-			depth[i] = (unsigned short)ml::math::round((m_recordedData->m_depthShift * d[i]));
-		}
-
-		//m_recordedData->m_frames.push_back(SensorData::RGBDFrame(color, getColorWidth(), getColorHeight(), depth, getDepthWidth(), getDepthHeight()));
-		//std::free(color); 
-		//std::free(depth);
-		m_recordedDataCache->writeNextAndFree(color, depth);
+		//the writer keeps a reference to the frame buffers until they are compressed (no copy here)
+		m_recordedStream->writeFrame(getDepthFloatShared(), getColorRGBXShared());
 	}
 	else {
 		// resample if m_recordDataWidt/height != 0
 		if ((m_recordDataWidth == 0 && m_recordDataHeight == 0) || (getDepthWidth() == m_recordDataWidth && getDepthHeight() == m_recordDataHeight)) {
-			m_recordedDepthData.push_back(m_depthFloat[m_currentRingBufIdx]);
-			m_depthFloat[m_currentRingBufIdx] = new float[getDepthWidth()*getDepthHeight()];
+			//the frame buffer is pooled (and possibly shared downstream) -> copy instead of taking ownership
+			m_recordedDepthData.push_back(new float[getDepthWidth()*getDepthHeight()]);
+			memcpy(m_recordedDepthData.back(), m_depthFloat[m_currentRingBufIdx], sizeof(float)*getDepthWidth()*getDepthHeight());
 		}
 		else {
 			m_recordedDepthData.push_back(new float[m_recordDataWidth*m_recordDataHeight]);
@@ -331,8 +363,8 @@ void RGBDSensor::recordFrame()
 		}
 
 		if ((m_recordDataWidth == 0 && m_recordDataHeight == 0) || (getColorWidth() == m_recordDataWidth && getColorHeight() == m_recordDataHeight)) {
-			m_recordedColorData.push_back(m_colorRGBX);
-			m_colorRGBX = new vec4uc[getColorWidth()*getColorHeight()];
+			m_recordedColorData.push_back(new vec4uc[getColorWidth()*getColorHeight()]);
+			memcpy(m_recordedColorData.back(), m_colorRGBX, sizeof(vec4uc)*getColorWidth()*getColorHeight());
 		}
 		else {
 			m_recordedColorData.push_back(new vec4uc[m_recordDataWidth*m_recordDataHeight]);
@@ -354,54 +386,27 @@ void RGBDSensor::saveRecordedFramesToFile(const std::string& filename, const std
 {
 	if (m_bUseModernSensFilesForRecording) {
 
-		if (!m_recordedDataCache || !m_recordedData) return;
+		if (!m_recordedStream) return;
 		if (trajectory.size() == 0) return;
 
-		SAFE_DELETE(m_recordedDataCache);		//forces cache to finish!
-		
-		unsigned int numFrames = (unsigned int)trajectory.size();
-		numFrames = std::min(numFrames, (unsigned int)m_recordedData->m_frames.size());
-
-		if (trajectory.size() > numFrames) throw MLIB_EXCEPTION("something went wrong; found more transforms than frames");
-
-		//setting the trajectory first
-		for (size_t i = 0; i < numFrames; i++) {
-			m_recordedData->m_frames[i].setCameraToWorld(trajectory[i]);
-		}
-		//free frames without a trajectory
-		if (numFrames < m_recordedData->m_frames.size()) {
-			for (size_t i = numFrames; i < m_recordedData->m_frames.size(); i++) {
-				m_recordedData->m_frames[i].free();
-			}
-			m_recordedData->m_frames.resize(numFrames);
-		}
+		const std::string recordedFile = m_recordedStream->getFilename();
+		std::cout << "finishing recording " << recordedFile << " (" << m_recordedStream->getNumFrames() << " frames) ... ";
+		m_recordedStream->close();		//writes the pending frames
+		SAFE_DELETE(m_recordedStream);
+		std::cout << "DONE!" << std::endl;
 
-		std::cout << *m_recordedData << std::endl;
-		std::cout << "dumping recorded frames ... ";
+		MappedSensorData recordedData;
+		recordedData.open(recordedFile);
+		if (trajectory.size() > recordedData.getNumFrames()) throw MLIB_EXCEPTION("something went wrong; found more transforms than frames");
 
-		std::string actualFilename = filename;
-		if (!overwriteExistingFile) {
-			while (util::fileExists(actualFilename)) {
-				std::string path = util::directoryFromPath(actualFilename);
-				std::string curr = util::fileNameFromPath(actualFilename);
-				std::string ext = util::getFileExtension(curr);
-				curr = util::removeExtensions(curr);
-				std::string base = util::getBaseBeforeNumericSuffix(curr);
-				unsigned int num = util::getNumericSuffix(curr);
-				if (num == (unsigned int)-1) {
-					num = 0;
-				}
-				actualFilename = path + base + std::to_string(num + 1) + "." + ext;
-			}
+		//poses are patched in place; frames without a transform are marked invalid
+		std::string actualFilename = recordedFile;
+		if (filename != GlobalAppState::get().s_recordDataFile) {
+			actualFilename = overwriteExistingFile ? filename : getUniqueRecordingFilename(filename);
 		}
-
-		m_recordedData->saveToFile(actualFilename);
+		std::cout << "writing trajectory to " << actualFilename << " ... ";
+		recordedData.saveTrajectory(actualFilename, trajectory);
 		std::cout << "DONE!" << std::endl;
-
-
-		m_recordedData->free();
-		SAFE_DELETE(m_recordedData);
-
 	}
 	else {
 		unsigned int numFrames = (unsigned int)trajectory.size();
@@ -4,11 +4,9 @@
 #include <cassert>
 
 #include "mLib.h"
+#include "FrameBufferPool.h"
 
-namespace ml {
-	class SensorData;
-	class RGBDFrameCacheWrite;
-}
+class SensorDataStreamWriter;
 
 
 class RGBDSensor
@@ -55,6 +53,16 @@ public:
 	vec4uc*			getColorRGBX();
 	const vec4uc*	getColorRGBX() const;
 
+	//! shared references to the current depth/color buffers; holding a reference keeps the frame alive without a copy
+	std::shared_ptr<float>	getDepthFloatShared() const;
+	std::shared_ptr<vec4uc>	getColorRGBXShared() const;
+
+	//! must be called before processDepth; buffers still referenced downstream are swapped for free ones from the pool
+	void prepareNextFrameBuffers();
+
+	//! frees pooled buffers that are no longer referenced (e.g., after the image manager dropped its frames)
+	void releaseUnusedFrameBuffers();
+
 	unsigned int getColorWidth() const;
 	unsigned int getColorHeight() const;
 	unsigned int getDepthWidth() const;
@@ -74,7 +82,7 @@ public:
 	void saveRecordedPointCloud(const std::string& filename, const std::vector<int>& validImages, const std::vector<mat4f>& trajectory);
 	void saveRecordedPointCloudDEBUG(const std::string& filename, const std::vector<int>& validImages, const std::vector<mat4f>& trajectory, unsigned int submapSize);
 
-	//! saves all previously recorded frames to file
+	//! saves all previously recorded frames to file (.sens recordings are already on disk, only the trajectory is written)
 	void saveRecordedFramesToFile(const std::string& filename, const std::vector<mat4f>& trajectory, bool overwriteExistingFile = false);
 
 	//! returns the current rigid transform; if not specified by the 'actual' sensor the identiy is returned
@@ -101,6 +109,9 @@ protected:
 	void initializeDepthExtrinsics(const mat4f& m);
 	void initializeColorExtrinsics(const mat4f& m);
 
+	//! replaces the current depth (and color if not NULL) buffer by the given ones from m_depthPool/m_colorPool
+	void setFrameBuffers(const std::shared_ptr<float>& depth, const std::shared_ptr<vec4uc>& color);
+
 	unsigned int m_currentRingBufIdx;
 
 	mat4f m_depthIntrinsics;
@@ -115,8 +126,13 @@ protected:
 	mat4f m_colorExtrinsics;
 	mat4f m_colorExtrinsicsInv;
 
-	std::vector<float*> m_depthFloat;
-	vec4uc*				m_colorRGBX;
+	std::vector<float*> m_depthFloat;		//points into m_depthBuffers
+	vec4uc*				m_colorRGBX;		//points into m_colorBuffer
+
+	FrameBufferPool<float>	m_depthPool;
+	FrameBufferPool<vec4uc>	m_colorPool;
+	std::vector<std::shared_ptr<float>>	m_depthBuffers;
+	std::shared_ptr<vec4uc>				m_colorBuffer;
 
 	LONG   m_depthWidth;
 	LONG   m_depthHeight;
@@ -145,6 +161,5 @@ private:
 	std::vector<PointCloudf> m_recordedPoints;
 
 	//new recording version
-	ml::SensorData* m_recordedData;
-	ml::SensorData::RGBDFrameCacheWrite* m_recordedDataCache;
+	SensorDataStreamWriter* m_recordedStream;
 };
@@ -22,6 +22,7 @@ SBA::SBA()
 	d_xRot = NULL;
 	d_xTrans = NULL;
 	m_solver = NULL;
+	m_solverCPU = NULL;
 
 	m_bUseComprehensiveFrameInvalidation = false;
 
@@ -97,9 +98,11 @@ bool SBA::align(SIFTImageManager* siftManager, const CUDACache* cudaCache, float
 	const int* d_validImages = siftManager->getValidImagesGPU();
 	convertMatricesToPosesCU(d_transforms, numImages, d_xRot, d_xTrans, d_validImages);
 
-	bool removed = alignCUDA(siftManager, cache, usePairwise, weightsSparse, weightsDenseDepth, weightsDenseColor, maxNumIters, numPCGits, isStart, isEnd, revalidateIdx);
+	bool removed;
+	if (m_solverCPU) removed = alignCPU(siftManager, cache, usePairwise, weightsSparse, weightsDenseDepth, weightsDenseColor, maxNumIters, numPCGits, isStart, isEnd, revalidateIdx);
+	else removed = alignCUDA(siftManager, cache, usePairwise, weightsSparse, weightsDenseDepth, weightsDenseColor, maxNumIters, numPCGits, isStart, isEnd, revalidateIdx);
 	if (recordConvergence) {
-		const std::vector<float>& conv = m_solver->getConvergenceAnalysis();
+		const std::vector<float>& conv = useCPUSolverResult() ? m_solverCPU->getConvergenceAnalysis() : m_solver->getConvergenceAnalysis();
 		m_recordedConvergence.back().insert(m_recordedConvergence.back().end(), conv.begin(), conv.end());
 	}
 
@@ -135,6 +138,77 @@ bool SBA::alignCUDA(SIFTImageManager* siftManager, const CUDACache* cudaCache, b
 	return removed;
 }
 
+bool SBA::alignCPU(SIFTImageManager* siftManager, const CUDACache* cudaCache, bool useDensePairwise, const std::vector<float>& weightsSparse, const std::vector<float>& weightsDenseDepth, const std::vector<float>& weightsDenseColor,
+	unsigned int numNonLinearIterations, unsigned int numLinearIterations, bool isStart, bool isEnd, unsigned int revalidateIdx)
+{
+	EntryJ* d_correspondences = siftManager->getGlobalCorrespondencesGPU();
+	m_numCorrespondences = siftManager->getNumGlobalCorrespondences();
+	const unsigned int numImages = siftManager->getNumImages();
+	const bool compare = GlobalBundlingState::get().s_solverCPUCompare;
+
+	m_correspondencesCPU.resize(m_numCorrespondences);
+	m_validImagesCPU.resize(numImages);
+	m_xRotCPU.resize(numImages);
+	m_xTransCPU.resize(numImages);
+	if (m_numCorrespondences > 0) MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_correspondencesCPU.data(), d_correspondences, sizeof(EntryJ) * m_numCorrespondences, cudaMemcpyDeviceToHost));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_validImagesCPU.data(), siftManager->getValidImagesGPU(), sizeof(int) * numImages, cudaMemcpyDeviceToHost));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_xRotCPU.data(), d_xRot, sizeof(float3) * numImages, cudaMemcpyDeviceToHost));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_xTransCPU.data(), d_xTrans, sizeof(float3) * numImages, cudaMemcpyDeviceToHost));
+
+	float timeGPU = 0.0f;
+	std::vector<float3> xRotGPU, xTransGPU;
+	if (compare) {
+		Timer timer;
+		cudaDeviceSynchronize(); timer.start();
+		m_solver->solve(d_correspondences, m_numCorrespondences, siftManager->getValidImagesGPU(), numImages, numNonLinearIterations, numLinearIterations,
+			cudaCache, weightsSparse, weightsDenseDepth, weightsDenseColor, useDensePairwise, d_xRot, d_xTrans, isStart, false, revalidateIdx);
+		cudaDeviceSynchronize(); timer.stop();
+		timeGPU = (float)timer.getElapsedTimeMS();
+		xRotGPU.resize(numImages);
+		xTransGPU.resize(numImages);
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(xRotGPU.data(), d_xRot, sizeof(float3) * numImages, cudaMemcpyDeviceToHost));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(xTransGPU.data(), d_xTrans, sizeof(float3) * numImages, cudaMemcpyDeviceToHost));
+	}
+
+	m_solverCPU->solve(m_correspondencesCPU.data(), m_numCorrespondences, m_validImagesCPU.data(), numImages, numNonLinearIterations, numLinearIterations,
+		cudaCache, weightsSparse, weightsDenseDepth, weightsDenseColor, useDensePairwise, m_xRotCPU.data(), m_xTransCPU.data());
+
+	if (compare) {
+		const std::vector<CPUSolverBundling::IterationTiming>& timings = m_solverCPU->getIterationTimings();
+		const std::vector<float>& convCPU = m_solverCPU->getConvergenceAnalysis();
+		const std::vector<float>& convGPU = m_solver->getConvergenceAnalysis();
+		std::cout << "[ solver compare: " << numImages << " images, " << m_numCorrespondences << " corrs ]" << std::endl;
+		for (unsigned int i = 0; i < timings.size(); i++) {
+			std::cout << "\titer " << i << ": cpu sparse " << timings[i].timeBuildSparse << " ms, dense " << timings[i].timeBuildDense << " ms, pcg " << timings[i].timePCG
+				<< " ms (" << timings[i].numLinIterations << " its) | energy gpu ";
+			if (i + 1 < convGPU.size()) std::cout << convGPU[i + 1];
+			else std::cout << "-"; //the gpu solve stopped earlier
+			std::cout << " cpu " << convCPU[i + 1] << std::endl;
+		}
+		float maxDiffRot = 0.0f, maxDiffTrans = 0.0f;
+		for (unsigned int i = 0; i < numImages; i++) {
+			if (m_validImagesCPU[i] == 0) continue;
+			const float3 dr = fabs(xRotGPU[i] - m_xRotCPU[i]), dt = fabs(xTransGPU[i] - m_xTransCPU[i]);
+			maxDiffRot = std::max(maxDiffRot, std::max(dr.x, std::max(dr.y, dr.z)));
+			maxDiffTrans = std::max(maxDiffTrans, std::max(dt.x, std::max(dt.y, dt.z)));
+		}
+		std::cout << "\ttotal: gpu " << timeGPU << " ms, cpu " << m_solverCPU->getTotalTime() << " ms | max pose diff rot " << maxDiffRot << " trans " << maxDiffTrans << std::endl;
+	}
+	if (useCPUSolverResult()) {
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_xRot, m_xRotCPU.data(), sizeof(float3) * numImages, cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_xTrans, m_xTransCPU.data(), sizeof(float3) * numImages, cudaMemcpyHostToDevice));
+	}
+	//the GPU solver keeps the correspondence table and finds the max residual for the residual removal
+	m_solver->evaluate(d_correspondences, m_numCorrespondences, numImages, weightsSparse.front(), d_xRot, d_xTrans, isStart && !compare, isEnd, revalidateIdx);
+
+	bool removed = false;
+	if (isEnd && weightsSparse.front() > 0) {
+		const unsigned int curFrame = (revalidateIdx == (unsigned int)-1) ? siftManager->getCurrentFrame() : revalidateIdx;
+		removed = removeMaxResidualCUDA(siftManager, numImages, curFrame);
+	}
+	return removed;
+}
+
 //todo debugging
 #include "GlobalAppState.h"
 
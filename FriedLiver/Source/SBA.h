@@ -8,6 +8,7 @@
 #include "PoseHelper.h"
 
 #include "Solver/CUDASolverBundling.h"
+#include "Solver/CPUSolverBundling.h"
 #include "GlobalBundlingState.h"
 
 
@@ -26,6 +27,7 @@ public:
 		MLIB_CUDA_SAFE_CALL(cudaMalloc(&d_xTrans, sizeof(EntryJ)*maxNumImages));
 
 		m_solver = new CUDASolverBundling(maxImages, maxNumResiduals);
+		if (GlobalBundlingState::get().s_solverCPU || GlobalBundlingState::get().s_solverCPUCompare) m_solverCPU = new CPUSolverBundling(maxImages);
 		m_bVerify = false;
 
 		m_bUseComprehensiveFrameInvalidation = GlobalBundlingState::get().s_useComprehensiveFrameInvalidation;
@@ -33,6 +35,7 @@ public:
 	}
 	~SBA() {
 		SAFE_DELETE(m_solver);
+		SAFE_DELETE(m_solverCPU);
 
 		MLIB_CUDA_SAFE_FREE(d_xRot);
 		MLIB_CUDA_SAFE_FREE(d_xTrans);
@@ -42,8 +45,16 @@ public:
 	bool align(SIFTImageManager* siftManager, const CUDACache* cudaCache, float4x4* d_transforms, unsigned int maxNumIters, unsigned int numPCGits,
 		bool useVerify, bool isLocal, bool recordConvergence, bool isStart, bool isEnd, bool isScanDoneOpt, unsigned int revalidateIdx = (unsigned int)-1);
 
+	//! the host solver mirrors the cached frames; call when the cache is reset
+	void reset() {
+		if (m_solverCPU) m_solverCPU->reset();
+	}
+
 	float getMaxResidual() const { return m_maxResidual; }
-	const std::vector<float>& getLinearConvergenceAnalysis() const { return m_solver->getLinearConvergenceAnalysis(); }
+	const std::vector<float>& getLinearConvergenceAnalysis() const {
+		if (useCPUSolverResult()) return m_solverCPU->getLinearConvergenceAnalysis();
+		return m_solver->getLinearConvergenceAnalysis();
+	}
 	bool useVerification() const { return m_bVerify; }
 
 	void evaluateSolverTimings() {
@@ -88,6 +99,13 @@ private:
 		unsigned int numNonLinearIterations, unsigned int numLinearIterations, bool isStart, bool isEnd,
 		unsigned int revalidateIdx);
 
+	//! solve with CPUSolverBundling (s_solverCPUCompare: also with the GPU solver, and print the comparison)
+	bool alignCPU(SIFTImageManager* siftManager, const CUDACache* cudaCache, bool useDensePairwise,
+		const std::vector<float>& weightsSparse, const std::vector<float>& weightsDenseDepth, const std::vector<float>& weightsDenseColor,
+		unsigned int numNonLinearIterations, unsigned int numLinearIterations, bool isStart, bool isEnd,
+		unsigned int revalidateIdx);
+	bool useCPUSolverResult() const { return m_solverCPU != NULL && GlobalBundlingState::get().s_solverCPU; }
+
 	bool removeMaxResidualCUDA(SIFTImageManager* siftManager, unsigned int numImages, unsigned int curFrame);
 	
 	float3*			d_xRot;
@@ -106,6 +124,11 @@ private:
 	std::mutex m_globalWeightsMutex;
 
 	CUDASolverBundling* m_solver;
+	CPUSolverBundling* m_solverCPU;
+	//host copies of the solver input for m_solverCPU
+	std::vector<EntryJ> m_correspondencesCPU;
+	std::vector<int> m_validImagesCPU;
+	std::vector<float3> m_xRotCPU, m_xTransCPU;
 
 	bool m_bUseComprehensiveFrameInvalidation;
 
@@ -6,6 +6,7 @@
 #include "GlobalBundlingState.h"
 #include "MatrixConversion.h"
 #include "PoseHelper.h"
+#include "DepthCodec.h"
 
 #ifdef SENSOR_DATA_READER
 
@@ -26,7 +27,8 @@ SensorDataReader::SensorDataReader()
 	//parameters are read from the calibration file
 
 	m_sensorData = NULL;
-	m_sensorDataCache = NULL;
+	m_mappedData = NULL;
+	m_decodePipeline = NULL;
 }
 
 SensorDataReader::~SensorDataReader()
@@ -41,6 +43,17 @@ void SensorDataReader::createFirstConnected()
 
 	std::string filename = GlobalAppState::get().s_binaryDumpSensorFile;
 
+	if (GlobalAppState::get().s_binaryDumpSensorMemoryMapped) {
+		createFirstConnectedMapped(filename);
+		createDecodePipeline();
+		return;
+	}
+
+	{
+		//repairs a recording left unfinalized by a crash (SensorDataStreamWriter) before ml::SensorData reads it
+		MappedSensorData check;
+		check.open(filename);
+	}
 	std::cout << "Start loading binary dump... ";
 	m_sensorData = new SensorData;
 	m_sensorData->loadFromFile(filename);
@@ -75,8 +88,72 @@ void SensorDataReader::createFirstConnected()
 		m_bHasColorData = false;
 	}
 
-	const unsigned int cacheSize = 10;
-	m_sensorDataCache = new ml::SensorData::RGBDFrameCacheRead(m_sensorData, cacheSize);
+	createDecodePipeline();
+}
+
+void SensorDataReader::createFirstConnectedMapped(const std::string& filename)
+{
+	std::cout << "Start mapping binary dump... ";
+	m_mappedData = new MappedSensorData;
+	m_mappedData->open(filename);
+	std::cout << "DONE!" << std::endl;
+	std::cout << m_mappedData->getNumFrames() << " frames, color " << m_mappedData->m_colorWidth << "x" << m_mappedData->m_colorHeight << ", depth " << m_mappedData->m_depthWidth << "x" << m_mappedData->m_depthHeight << std::endl;
+
+	RGBDSensor::init(m_mappedData->m_depthWidth, m_mappedData->m_depthHeight, std::max(m_mappedData->m_colorWidth, 1u), std::max(m_mappedData->m_colorHeight, 1u), 1);
+	initializeDepthIntrinsics(m_mappedData->m_calibrationDepth.m_intrinsic(0, 0), m_mappedData->m_calibrationDepth.m_intrinsic(1, 1), m_mappedData->m_calibrationDepth.m_intrinsic(0, 2), m_mappedData->m_calibrationDepth.m_intrinsic(1, 2));
+	initializeColorIntrinsics(m_mappedData->m_calibrationColor.m_intrinsic(0, 0), m_mappedData->m_calibrationColor.m_intrinsic(1, 1), m_mappedData->m_calibrationColor.m_intrinsic(0, 2), m_mappedData->m_calibrationColor.m_intrinsic(1, 2));
+
+	initializeDepthExtrinsics(m_mappedData->m_calibrationDepth.m_extrinsic);
+	initializeColorExtrinsics(m_mappedData->m_calibrationColor.m_extrinsic);
+
+	m_numFrames = m_mappedData->getNumFrames();
+	if (m_numFrames > GlobalBundlingState::get().s_maxNumImages * GlobalBundlingState::get().s_submapSize) {
+		throw MLIB_EXCEPTION("sens file #frames = " + std::to_string(m_numFrames) + ", please change param file to accommodate");
+	}
+	m_bHasColorData = m_numFrames > 0 && m_mappedData->hasColorData(0);
+}
+
+void SensorDataReader::createDecodePipeline()
+{
+	SAFE_DELETE(m_decodePipeline);
+
+	FrameDecodePipeline::DecodeFunc decodeFunc;
+	float depthShift;
+	if (m_mappedData) {
+		const MappedSensorData* data = m_mappedData;
+		decodeFunc = [data](unsigned int frame, vec3uc* color, unsigned short* depth) {
+			data->decompressDepth(frame, depth);
+			if (color) data->decompressColor(frame, color);
+			data->releaseFrames(frame, frame + 1);	//only the pages of the frames in flight stay resident
+		};
+		depthShift = m_mappedData->m_depthShift;
+	}
+	else {
+		const ml::SensorData* data = m_sensorData;
+		const size_t depthBytes = sizeof(unsigned short)*getDepthWidth()*getDepthHeight();
+		const size_t colorBytes = sizeof(vec3uc)*getColorWidth()*getColorHeight();
+		decodeFunc = [data, depthBytes, colorBytes](unsigned int frame, vec3uc* color, unsigned short* depth) {
+			if (data->m_depthCompressionType == DepthCodec::TYPE_PREDICTIVE_RICE_USHORT) {	//unknown to ml::SensorData
+				const ml::SensorData::RGBDFrame& f = data->m_frames[frame];
+				DepthCodec::decompress(f.getDepthCompressed(), f.getDepthSizeBytes(), data->m_depthWidth, data->m_depthHeight, depth);
+			}
+			else {
+				unsigned short* d = data->decompressDepthAlloc(frame);
+				memcpy(depth, d, depthBytes);
+				std::free(d);
+			}
+			if (color) {
+				vec3uc* c = data->decompressColorAlloc(frame);
+				memcpy(color, c, colorBytes);
+				std::free(c);
+			}
+		};
+		depthShift = m_sensorData->m_depthShift;
+	}
+
+	m_decodePipeline = new FrameDecodePipeline(decodeFunc, m_numFrames, m_depthPool, m_colorPool,
+		m_bHasColorData ? getColorWidth() : 0, m_bHasColorData ? getColorHeight() : 0, getDepthWidth(), getDepthHeight(), depthShift,
+		GlobalAppState::get().s_binaryDumpSensorDecodeThreads, GlobalAppState::get().s_binaryDumpSensorDecodeBufferSize);
 }
 
 bool SensorDataReader::processDepth()
@@ -88,33 +165,20 @@ bool SensorDataReader::processDepth()
 		stopReceivingFrames();
 		std::cout << "binary dump sequence complete - stopped receiving frames" << std::endl;
 		m_currFrame = 0;
+		SAFE_DELETE(m_decodePipeline);	//restarts from the first frame if play is resumed
 	}
 
 	if (GlobalAppState::get().s_playData) {
+		if (!m_decodePipeline) createDecodePipeline();
 
-		float* depth = getDepthFloat();
+		//decoding and conversion happen on the pipeline threads; the decoded buffers become the sensor's frame buffers (no copy)
+		std::shared_ptr<float> decodedDepth;	std::shared_ptr<vec4uc> decodedColor;
+		if (!m_decodePipeline->getNext(decodedDepth, decodedColor)) throw MLIB_EXCEPTION("frame decode pipeline out of frames");
 
-		//TODO check why the frame cache is not used?
-		ml::SensorData::RGBDFrameCacheRead::FrameState frameState = m_sensorDataCache->getNext();
-		//ml::SensorData::RGBDFrameCacheRead::FrameState frameState;
-		//frameState.m_colorFrame = m_sensorData->decompressColorAlloc(m_currFrame);
-		//frameState.m_depthFrame = m_sensorData->decompressDepthAlloc(m_currFrame);
-
-
-		for (unsigned int i = 0; i < getDepthWidth()*getDepthHeight(); i++) {
-			if (frameState.m_depthFrame[i] == 0) depth[i] = -std::numeric_limits<float>::infinity();
-			else depth[i] = (float)frameState.m_depthFrame[i] / m_sensorData->m_depthShift;
-		}
+		setFrameBuffers(decodedDepth, decodedColor);
 
 		incrementRingbufIdx();
 
-		if (m_bHasColorData) {
-			for (unsigned int i = 0; i < getColorWidth()*getColorHeight(); i++) {
-				m_colorRGBX[i] = vec4uc(frameState.m_colorFrame[i]);
-			}
-		}
-		frameState.free();
-
 		m_currFrame++;
 		return true;
 	}
@@ -125,12 +189,17 @@ bool SensorDataReader::processDepth()
 
 std::string SensorDataReader::getSensorName() const
 {
+	if (m_mappedData) return m_mappedData->m_sensorName;
 	return m_sensorData->m_sensorName;
 }
 
 ml::mat4f SensorDataReader::getRigidTransform(int offset) const
 {
 	unsigned int idx = m_currFrame - 1 + offset;
+	if (m_mappedData) {
+		if (idx >= m_mappedData->getNumFrames()) throw MLIB_EXCEPTION("invalid trajectory index " + std::to_string(idx));
+		return m_mappedData->getCameraToWorld(idx);
+	}
 	if (idx >= m_sensorData->m_frames.size()) throw MLIB_EXCEPTION("invalid trajectory index " + std::to_string(idx));
 	const mat4f& transform = m_sensorData->m_frames[idx].getCameraToWorld();
 	return transform;
@@ -143,7 +212,8 @@ void SensorDataReader::releaseData()
 	m_bHasColorData = false;
 
 
-	SAFE_DELETE(m_sensorDataCache);
+	SAFE_DELETE(m_decodePipeline);	//uses m_sensorData / m_mappedData
+	SAFE_DELETE(m_mappedData);
 	if (m_sensorData) {
 		m_sensorData->free();
 		SAFE_DELETE(m_sensorData);
@@ -152,6 +222,11 @@ void SensorDataReader::releaseData()
 
 void SensorDataReader::saveToFile(const std::string& filename, const std::vector<mat4f>& trajectory) const
 {
+	if (m_mappedData) {
+		//only the camera poses are rewritten
+		m_mappedData->saveTrajectory(filename, trajectory);
+		return;
+	}
 	const unsigned int numFrames = (unsigned int)std::min(trajectory.size(), m_sensorData->m_frames.size());
 	for (unsigned int i = 0; i < numFrames; i++) {
 		m_sensorData->m_frames[i].setCameraToWorld(trajectory[i]);
@@ -168,7 +243,12 @@ void SensorDataReader::saveToFile(const std::string& filename, const std::vector
 void SensorDataReader::evaluateTrajectory(const std::vector<mat4f>& trajectory) const
 {
 	std::vector<mat4f> referenceTrajectory;
-	for (const auto& f : m_sensorData->m_frames) referenceTrajectory.push_back(f.getCameraToWorld());
+	if (m_mappedData) {
+		for (unsigned int f = 0; f < m_mappedData->getNumFrames(); f++) referenceTrajectory.push_back(m_mappedData->getCameraToWorld(f));
+	}
+	else {
+		for (const auto& f : m_sensorData->m_frames) referenceTrajectory.push_back(f.getCameraToWorld());
+	}
 	const size_t numTransforms = std::min(trajectory.size(), referenceTrajectory.size());
 	// make sure reference trajectory starts at identity
 	mat4f offset = referenceTrajectory.front().getInverse();
@@ -190,6 +270,15 @@ void SensorDataReader::evaluateTrajectory(const std::vector<mat4f>& trajectory)
 void SensorDataReader::getTrajectory(std::vector<mat4f>& trajectory) const
 {
 	trajectory.clear();
+	if (m_mappedData) {
+		trajectory.resize(m_mappedData->getNumFrames());
+		for (unsigned int f = 0; f < m_mappedData->getNumFrames(); f++) {
+			trajectory[f] = m_mappedData->getCameraToWorld(f);
+			if (trajectory[f][0] == -std::numeric_limits<float>::infinity())
+				throw MLIB_EXCEPTION("ERROR invalid transform in reference trajectory");
+		}
+		return;
+	}
 	if (!m_sensorData) return;
 	trajectory.resize(m_sensorData->m_frames.size());
 	for (unsigned int f = 0; f < m_sensorData->m_frames.size(); f++) {
@@ -7,6 +7,8 @@
 
 #include "GlobalAppState.h"
 #include "RGBDSensor.h"
+#include "MappedSensorData.h"
+#include "FrameDecodePipeline.h"
 #include "stdafx.h"
 
 #ifdef SENSOR_DATA_READER
@@ -55,8 +57,15 @@ private:
 	//! deletes all allocated data
 	void releaseData();
 
+	//! maps the file instead of loading it (s_binaryDumpSensorMemoryMapped)
+	void createFirstConnectedMapped(const std::string& filename);
+
+	//! starts decoding from the first frame
+	void createDecodePipeline();
+
 	ml::SensorData* m_sensorData;
-	ml::SensorData::RGBDFrameCacheRead* m_sensorDataCache;
+	MappedSensorData* m_mappedData;		//used instead of m_sensorData if s_binaryDumpSensorMemoryMapped is enabled
+	FrameDecodePipeline* m_decodePipeline;
 
 	unsigned int	m_numFrames;
 	unsigned int	m_currFrame;
@@ -0,0 +1,464 @@
+#include "stdafx.h"
+
+#include "SensorDataStreamWriter.h"
+#include "MappedSensorData.h"
+#include "DepthCodec.h"
+
+#include <zlib.h>
+#include <io.h>
+#include <fstream>
+#include <iterator>
+
+SensorDataStreamWriter::SensorDataStreamWriter(const std::string& filename, const std::string& sensorName,
+	const SensorData::CalibrationData& calibrationColor, const SensorData::CalibrationData& calibrationDepth,
+	unsigned int colorWidth, unsigned int colorHeight, unsigned int depthWidth, unsigned int depthHeight, float depthShift,
+	SensorData::COMPRESSION_TYPE_COLOR colorCompressionType, SensorData::COMPRESSION_TYPE_DEPTH depthCompressionType,
+	unsigned int numThreads, unsigned int maxFramesInFlight, unsigned int commitInterval)
+{
+	m_filename = filename;
+	m_sensorName = sensorName;
+	m_calibrationColor = calibrationColor;
+	m_calibrationDepth = calibrationDepth;
+	m_colorWidth = colorWidth;	m_colorHeight = colorHeight;
+	m_depthWidth = depthWidth;	m_depthHeight = depthHeight;
+	m_depthShift = depthShift;
+	m_colorCompressionType = colorCompressionType;
+	m_depthCompressionType = depthCompressionType;
+	m_maxFramesInFlight = std::max(maxFramesInFlight, 1u);
+	m_commitInterval = std::max(commitInterval, 1u);
+	m_numFramesQueued = 0;
+	m_bTrailer = false;
+	m_bStop = false;
+
+	m_file = fopen(filename.c_str(), "wb+");
+	if (!m_file) throw MLIB_EXCEPTION("could not open " + filename + " for writing");
+	writeHeader();
+	m_frameDataEnd = (UINT64)_ftelli64(m_file);
+	commit();	//empty but valid file
+
+	m_threadPool = new ThreadPool(numThreads);
+	m_writerThread = std::thread(&SensorDataStreamWriter::writerFunc, this);
+}
+
+SensorDataStreamWriter::~SensorDataStreamWriter()
+{
+	try {
+		close();
+	}
+	catch (const std::exception& e) {
+		std::cerr << "failed closing " << m_filename << ": " << e.what() << std::endl;
+	}
+}
+
+void SensorDataStreamWriter::writeHeader()
+{
+	//see SensorData::saveToFile
+	const unsigned int version = 4;
+	fwrite(&version, sizeof(unsigned int), 1, m_file);
+	const UINT64 strLen = m_sensorName.size();
+	fwrite(&strLen, sizeof(UINT64), 1, m_file);
+	fwrite(m_sensorName.data(), 1, (size_t)strLen, m_file);
+	fwrite(&m_calibrationColor.m_intrinsic, sizeof(mat4f), 1, m_file);
+	fwrite(&m_calibrationColor.m_extrinsic, sizeof(mat4f), 1, m_file);
+	fwrite(&m_calibrationDepth.m_intrinsic, sizeof(mat4f), 1, m_file);
+	fwrite(&m_calibrationDepth.m_extrinsic, sizeof(mat4f), 1, m_file);
+	fwrite(&m_colorCompressionType, sizeof(SensorData::COMPRESSION_TYPE_COLOR), 1, m_file);
+	fwrite(&m_depthCompressionType, sizeof(SensorData::COMPRESSION_TYPE_DEPTH), 1, m_file);
+	fwrite(&m_colorWidth, sizeof(unsigned int), 1, m_file);
+	fwrite(&m_colorHeight, sizeof(unsigned int), 1, m_file);
+	fwrite(&m_depthWidth, sizeof(unsigned int), 1, m_file);
+	fwrite(&m_depthHeight, sizeof(unsigned int), 1, m_file);
+	fwrite(&m_depthShift, sizeof(float), 1, m_file);
+	m_numFramesOffset = (UINT64)_ftelli64(m_file);
+	MLIB_ASSERT(m_numFramesOffset == getNumFramesOffset(strLen));
+	const UINT64 numFrames = 0;
+	fwrite(&numFrames, sizeof(UINT64), 1, m_file);
+	if (ferror(m_file)) throw MLIB_EXCEPTION("failed writing header of " + m_filename);
+}
+
+void SensorDataStreamWriter::commit()
+{
+	//frames must be on disk before the header claims them; a crash in between leaves the previous state readable
+	_fseeki64(m_file, (__int64)m_frameDataEnd, SEEK_SET);
+	const UINT64 numIMUFrames = 0;
+	fwrite(&numIMUFrames, sizeof(UINT64), 1, m_file);
+	const UINT64 numFrames = m_frameOffsets.size();
+	const UINT64 magic = MappedSensorData::s_trailingIndexMagic;
+	if (numFrames > 0) fwrite(m_frameOffsets.data(), sizeof(UINT64), (size_t)numFrames, m_file);
+	fwrite(&numFrames, sizeof(UINT64), 1, m_file);
+	fwrite(&magic, sizeof(UINT64), 1, m_file);
+	fflush(m_file);
+	m_bTrailer = true;
+
+	_fseeki64(m_file, (__int64)m_numFramesOffset, SEEK_SET);
+	fwrite(&numFrames, sizeof(UINT64), 1, m_file);
+	fflush(m_file);
+	if (ferror(m_file)) throw MLIB_EXCEPTION("failed writing " + m_filename);
+}
+
+void SensorDataStreamWriter::writeFrame(const std::shared_ptr<float>& depth, const std::shared_ptr<vec4uc>& color,
+	const mat4f& cameraToWorld /*= invalidTransform()*/, UINT64 timeStampColor /*= 0*/, UINT64 timeStampDepth /*= 0*/)
+{
+	if (!isOpen()) throw MLIB_EXCEPTION("stream writer for " + m_filename + " is closed");
+
+	std::unique_ptr<Frame> frame(new Frame);
+	frame->depth = depth;
+	frame->color = color;
+	frame->cameraToWorld = cameraToWorld;
+	frame->timeStampColor = timeStampColor;
+	frame->timeStampDepth = timeStampDepth;
+	Frame* f = frame.get();
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (m_queue.size() >= m_maxFramesInFlight && !m_error) m_cvQueue.wait(lock);	//bounded memory: wait for the disk
+	if (m_error) std::rethrow_exception(m_error);
+
+	f->compressed = m_threadPool->enqueue([this, f]() { compressFrame(*f); });
+	m_queue.push_back(std::move(frame));
+	m_numFramesQueued++;
+	lock.unlock();
+	m_cvQueue.notify_all();
+}
+
+void SensorDataStreamWriter::compressFrame(Frame& frame) const
+{
+	const size_t numDepth = (size_t)m_depthWidth*m_depthHeight;
+	std::vector<unsigned short> depth(numDepth);
+	const float* src = frame.depth.get();
+	for (size_t i = 0; i < numDepth; i++) {
+		const float d = src[i] * m_depthShift;
+		depth[i] = (d > 0.0f && d < 65535.5f) ? (unsigned short)(d + 0.5f) : 0;
+	}
+	compressDepth(depth.data(), m_depthWidth, m_depthHeight, m_depthCompressionType, frame.depthCompressed);
+
+	if (frame.color) {
+		const size_t numColor = (size_t)m_colorWidth*m_colorHeight;
+		std::vector<vec3uc> color(numColor);
+		const vec4uc* c = frame.color.get();
+		for (size_t i = 0; i < numColor; i++) color[i] = vec3uc(c[i].x, c[i].y, c[i].z);
+		compressColor(color.data(), m_colorWidth, m_colorHeight, m_colorCompressionType, frame.colorCompressed);
+	}
+	//release the (pooled) frame buffers as early as possible
+	frame.depth.reset();
+	frame.color.reset();
+}
+
+void SensorDataStreamWriter::writerFunc()
+{
+	unsigned int numSinceCommit = 0;
+	while (true) {
+		Frame* frame = NULL;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while (m_queue.empty() && !m_bStop) m_cvQueue.wait(lock);
+			if (m_queue.empty()) break;		//stopped and drained
+			frame = m_queue.front().get();
+		}
+
+		try {
+			frame->compressed.get();
+
+			if (m_bTrailer) {
+				//the next frame overwrites the trailing index: cut it off first, so a crash can not leave a stale index behind (or inside) the new frames;
+				//until the next commit the file ends with the committed frames and whatever got written of the following ones
+				fflush(m_file);
+				if (_chsize_s(_fileno(m_file), (__int64)m_frameDataEnd) != 0) throw MLIB_EXCEPTION("failed truncating " + m_filename);
+				m_bTrailer = false;
+			}
+
+			//see SensorData::RGBDFrame::saveToFile
+			_fseeki64(m_file, (__int64)m_frameDataEnd, SEEK_SET);
+			const UINT64 colorSizeBytes = frame->colorCompressed.size();
+			const UINT64 depthSizeBytes = frame->depthCompressed.size();
+			fwrite(&frame->cameraToWorld, sizeof(mat4f), 1, m_file);
+			fwrite(&frame->timeStampColor, sizeof(UINT64), 1, m_file);
+			fwrite(&frame->timeStampDepth, sizeof(UINT64), 1, m_file);
+			fwrite(&colorSizeBytes, sizeof(UINT64), 1, m_file);
+			fwrite(&depthSizeBytes, sizeof(UINT64), 1, m_file);
+			if (colorSizeBytes > 0) fwrite(frame->colorCompressed.data(), 1, (size_t)colorSizeBytes, m_file);
+			if (depthSizeBytes > 0) fwrite(frame->depthCompressed.data(), 1, (size_t)depthSizeBytes, m_file);
+			if (ferror(m_file)) throw MLIB_EXCEPTION("failed writing frame " + std::to_string(m_frameOffsets.size()) + " to " + m_filename);
+
+			m_frameOffsets.push_back(m_frameDataEnd);
+			m_frameDataEnd = (UINT64)_ftelli64(m_file);
+			if (++numSinceCommit >= m_commitInterval) {
+				commit();
+				numSinceCommit = 0;
+			}
+		}
+		catch (...) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_error = std::current_exception();
+			for (auto& f : m_queue) {
+				if (f->compressed.valid()) f->compressed.wait();
+			}
+			m_queue.clear();
+			lock.unlock();
+			m_cvQueue.notify_all();
+			return;
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_queue.pop_front();
+		}
+		m_cvQueue.notify_all();
+	}
+}
+
+void SensorDataStreamWriter::close()
+{
+	if (!isOpen()) return;
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_cvQueue.notify_all();
+	if (m_writerThread.joinable()) m_writerThread.join();
+	SAFE_DELETE(m_threadPool);
+
+	std::exception_ptr error = m_error;
+	if (!error) {
+		try {
+			commit();
+		}
+		catch (...) {
+			error = std::current_exception();
+		}
+	}
+	fclose(m_file);
+	m_file = NULL;
+	if (error) std::rethrow_exception(error);
+}
+
+UINT64 SensorDataStreamWriter::recover(const std::string& filename)
+{
+	FILE* f = fopen(filename.c_str(), "rb+");
+	if (!f) throw MLIB_EXCEPTION("could not open " + filename);
+	_fseeki64(f, 0, SEEK_END);
+	const UINT64 fileSize = (UINT64)_ftelli64(f);
+
+	auto readAt = [&](UINT64 offset, void* dst, size_t size) {
+		if (offset + size > fileSize) return false;
+		_fseeki64(f, (__int64)offset, SEEK_SET);
+		return fread(dst, 1, size, f) == size;
+	};
+
+	//header
+	unsigned int version = 0;	UINT64 strLen = 0;
+	if (!readAt(0, &version, sizeof(unsigned int)) || version != 4 || !readAt(sizeof(unsigned int), &strLen, sizeof(UINT64))) {
+		fclose(f);
+		throw MLIB_EXCEPTION("invalid .sens header in " + filename);
+	}
+	const UINT64 numFramesOffset = getNumFramesOffset(strLen);
+	UINT64 numFrames = 0;
+	if (!readAt(numFramesOffset, &numFrames, sizeof(UINT64))) {
+		fclose(f);
+		throw MLIB_EXCEPTION("invalid .sens header in " + filename);
+	}
+
+	//frame records: mat4f, 2 time stamps, color size, depth size
+	const UINT64 frameHeaderSize = sizeof(mat4f) + 4 * sizeof(UINT64);
+	std::vector<UINT64> offsets;
+	UINT64 offset = numFramesOffset + sizeof(UINT64);
+	auto nextFrame = [&]() {
+		UINT64 sizes[2];
+		if (!readAt(offset + sizeof(mat4f) + 2 * sizeof(UINT64), sizes, sizeof(sizes))) return false;
+		const UINT64 end = offset + frameHeaderSize + sizes[0] + sizes[1];
+		if (sizes[0] > fileSize || sizes[1] > fileSize || end > fileSize) return false;
+		offsets.push_back(offset);
+		offset = end;
+		return true;
+	};
+	//frames claimed by the header were committed
+	for (UINT64 i = 0; i < numFrames; i++) {
+		if (!nextFrame()) {
+			fclose(f);
+			throw MLIB_EXCEPTION("corrupt .sens file " + filename + " (frame " + std::to_string(i) + ")");
+		}
+	}
+	//frames written after the last commit: keep all complete records unless the trailing index of that commit is found
+	while (true) {
+		UINT64 numIMUFrames = 1, footer[2] = { 0, 0 };		//the trailer of a commit is #IMU frames (0), the index, #frames, magic
+		const UINT64 n = offsets.size();
+		if (readAt(offset, &numIMUFrames, sizeof(UINT64)) && numIMUFrames == 0 &&
+			readAt(offset + sizeof(UINT64) * (1 + n), footer, sizeof(footer)) && footer[0] == n && footer[1] == MappedSensorData::s_trailingIndexMagic) break;
+		if (!nextFrame()) break;
+	}
+
+	numFrames = offsets.size();
+	const UINT64 numIMUFrames = 0;
+	const UINT64 magic = MappedSensorData::s_trailingIndexMagic;
+	_fseeki64(f, (__int64)offset, SEEK_SET);
+	fwrite(&numIMUFrames, sizeof(UINT64), 1, f);
+	if (numFrames > 0) fwrite(offsets.data(), sizeof(UINT64), (size_t)numFrames, f);
+	fwrite(&numFrames, sizeof(UINT64), 1, f);
+	fwrite(&magic, sizeof(UINT64), 1, f);
+	fflush(f);
+	_chsize_s(_fileno(f), _ftelli64(f));
+	_fseeki64(f, (__int64)numFramesOffset, SEEK_SET);
+	fwrite(&numFrames, sizeof(UINT64), 1, f);
+	const bool bFailed = ferror(f) != 0;
+	fclose(f);
+	if (bFailed) throw MLIB_EXCEPTION("failed writing " + filename);
+	return numFrames;
+}
+
+bool SensorDataStreamWriter::testRecovery(const std::string& filename, unsigned int numFrames)
+{
+	const unsigned int width = 64, height = 48;
+	const unsigned int numPixels = width * height;
+	const unsigned int commitInterval = 4;
+	const float depthShift = 1000.0f;
+	const std::string sensorName = "recovery test";
+	auto depthValue = [](unsigned int f, unsigned int i) { return (unsigned short)(500 + (f * 37 + i * 11) % 3000); };
+
+	{
+		SensorData::CalibrationData calibration;
+		SensorDataStreamWriter writer(filename, sensorName, calibration, calibration, width, height, width, height, depthShift,
+			SensorData::TYPE_RAW, SensorData::TYPE_ZLIB_USHORT, 0, 8, commitInterval);
+		for (unsigned int f = 0; f < numFrames; f++) {
+			std::shared_ptr<float> depth(new float[numPixels], std::default_delete<float[]>());
+			std::shared_ptr<vec4uc> color(new vec4uc[numPixels], std::default_delete<vec4uc[]>());
+			for (unsigned int i = 0; i < numPixels; i++) {
+				depth.get()[i] = (float)depthValue(f, i) / depthShift;
+				color.get()[i] = vec4uc((unsigned char)(f + i), (unsigned char)(3 * f), (unsigned char)i, 255);
+			}
+			writer.writeFrame(depth, color, mat4f::identity(), f, f);
+		}
+		writer.close();
+	}
+
+	//the finalized file and its frame layout (from the trailing index)
+	std::vector<char> file;
+	{
+		std::ifstream in(filename, std::ios::binary);
+		file.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	UINT64 footer[2];	//#entries, magic
+	if (file.size() < sizeof(footer)) throw MLIB_EXCEPTION("recovery test: could not read " + filename);
+	memcpy(footer, file.data() + file.size() - sizeof(footer), sizeof(footer));
+	if (footer[0] != numFrames || footer[1] != MappedSensorData::s_trailingIndexMagic) throw MLIB_EXCEPTION("recovery test: no trailing index in " + filename);
+	const UINT64 indexOffset = file.size() - sizeof(footer) - sizeof(UINT64)*numFrames;
+	std::vector<UINT64> offsets(numFrames + 1);
+	memcpy(offsets.data(), file.data() + indexOffset, sizeof(UINT64)*numFrames);
+	offsets[numFrames] = indexOffset - sizeof(UINT64);		//end of the frame data
+	const UINT64 numFramesOffset = getNumFramesOffset(sensorName.size());
+
+	//writes a crashed copy: the first 'size' bytes of the file, the frame count of the last commit and optionally (part of) a trailing index
+	const std::string crashFile = filename + ".crash.sens";
+	auto writeCrashFile = [&](UINT64 size, UINT64 numCommitted, UINT64 numIndexed, UINT64 trailerBytes) {
+		std::vector<char> out(file.begin(), file.begin() + (size_t)size);
+		memcpy(out.data() + numFramesOffset, &numCommitted, sizeof(UINT64));
+		std::vector<UINT64> trailer(1, 0);		//#IMU frames, index, #entries, magic
+		trailer.insert(trailer.end(), offsets.begin(), offsets.begin() + (size_t)numIndexed);
+		const UINT64 magic = MappedSensorData::s_trailingIndexMagic;
+		trailer.push_back(numIndexed);
+		trailer.push_back(magic);
+		const char* t = (const char*)trailer.data();
+		out.insert(out.end(), t, t + std::min((size_t)trailerBytes, sizeof(UINT64)*trailer.size()));
+		std::ofstream s(crashFile, std::ios::binary);
+		s.write(out.data(), out.size());
+		std::remove((crashFile + ".idx").c_str());
+	};
+	//all frames up to the crash have to be readable with the recorded depth, through the mapped and the ml::SensorData reader
+	std::vector<unsigned short> depth(numPixels);
+	auto checkCrashFile = [&](unsigned int numExpected) {
+		MappedSensorData data;
+		data.open(crashFile);
+		if (data.getNumFrames() != numExpected) return false;
+		for (unsigned int f = 0; f < numExpected; f++) {
+			data.decompressDepth(f, depth.data());
+			for (unsigned int i = 0; i < numPixels; i++) {
+				if (depth[i] != depthValue(f, i)) return false;
+			}
+		}
+		data.close();
+		SensorData sensorData;
+		sensorData.loadFromFile(crashFile);
+		return sensorData.m_frames.size() == numExpected;
+	};
+
+	unsigned int numCases = 0, numPassed = 0;
+	for (unsigned int m = 0; m < numFrames; m++) {
+		const UINT64 numCommitted = (m / commitInterval) * commitInterval;
+		const UINT64 numCommittedBefore = (m == 0) ? 0 : ((m - 1) / commitInterval) * commitInterval;
+		const UINT64 cut = offsets[m] + (offsets[m + 1] - offsets[m]) / 2;
+		struct { const char* name; UINT64 size, numCommitted, numIndexed, trailerBytes; } cases[] = {
+			{ "crash in the middle of a frame", cut, numCommitted, 0, 0 },
+			{ "crash before updating the frame count of a commit", offsets[m], numCommittedBefore, m, (UINT64)-1 },
+			{ "crash while writing the trailing index", offsets[m], numCommittedBefore, m, sizeof(UINT64) * (1 + m / 2) },
+		};
+		for (const auto& c : cases) {
+			numCases++;
+			bool bPassed = false;
+			try {
+				writeCrashFile(c.size, c.numCommitted, c.numIndexed, c.trailerBytes);
+				bPassed = checkCrashFile(m);
+			}
+			catch (const std::exception& e) {
+				std::cout << e.what() << std::endl;
+			}
+			if (bPassed) numPassed++;
+			else std::cout << "recovery test FAILED: " << c.name << " (frame " << m << ", " << c.numCommitted << " committed)" << std::endl;
+		}
+	}
+	std::remove(crashFile.c_str());
+	std::remove((crashFile + ".idx").c_str());
+	std::remove(filename.c_str());
+
+	std::cout << "recovery test: " << numPassed << " / " << numCases << " crashed files recovered (" << numFrames << " frames, commit interval " << commitInterval << ")" << std::endl;
+	return numPassed == numCases;
+}
+
+void SensorDataStreamWriter::compressColor(const vec3uc* color, unsigned int width, unsigned int height, SensorData::COMPRESSION_TYPE_COLOR type, std::vector<unsigned char>& out)
+{
+	if (type == SensorData::TYPE_RAW) {
+		out.resize(sizeof(vec3uc)*width*height);
+		memcpy(out.data(), color, out.size());
+		return;
+	}
+
+	FIBITMAP* dib = FreeImage_Allocate(width, height, 24);
+	for (unsigned int y = 0; y < height; y++) {
+		BYTE* row = FreeImage_GetScanLine(dib, height - 1 - y);	//free image is bottom up
+		const vec3uc* src = color + (size_t)y*width;
+		for (unsigned int x = 0; x < width; x++) {
+			row[3 * x + FI_RGBA_RED] = src[x].x;
+			row[3 * x + FI_RGBA_GREEN] = src[x].y;
+			row[3 * x + FI_RGBA_BLUE] = src[x].z;
+		}
+	}
+	FIMEMORY* mem = FreeImage_OpenMemory();
+	const BOOL bOk = (type == SensorData::TYPE_JPEG) ? FreeImage_SaveToMemory(FIF_JPEG, dib, mem, 90) : FreeImage_SaveToMemory(FIF_PNG, dib, mem, PNG_Z_BEST_SPEED);
+	FreeImage_Unload(dib);
+	BYTE* data = NULL;	DWORD sizeBytes = 0;
+	if (!bOk || !FreeImage_AcquireMemory(mem, &data, &sizeBytes)) {
+		FreeImage_CloseMemory(mem);
+		throw MLIB_EXCEPTION("could not compress color frame");
+	}
+	out.assign(data, data + sizeBytes);
+	FreeImage_CloseMemory(mem);
+}
+
+void SensorDataStreamWriter::compressDepth(const unsigned short* depth, unsigned int width, unsigned int height, SensorData::COMPRESSION_TYPE_DEPTH type, std::vector<unsigned char>& out)
+{
+	const size_t numBytes = sizeof(unsigned short)*width*height;
+	if (type == SensorData::TYPE_RAW_USHORT) {
+		out.resize(numBytes);
+		memcpy(out.data(), depth, numBytes);
+	}
+	else if (type == SensorData::TYPE_ZLIB_USHORT) {
+		uLongf destLen = compressBound((uLong)numBytes);
+		out.resize(destLen);
+		if (compress2(out.data(), &destLen, (const Bytef*)depth, (uLong)numBytes, Z_BEST_SPEED) != Z_OK) throw MLIB_EXCEPTION("could not compress depth frame");
+		out.resize(destLen);
+	}
+	else if (type == DepthCodec::TYPE_PREDICTIVE_RICE_USHORT) {
+		DepthCodec::compress(depth, width, height, out);
+	}
+	else {
+		throw MLIB_EXCEPTION("depth compression type " + std::to_string((int)type) + " not supported by the stream writer");
+	}
+}
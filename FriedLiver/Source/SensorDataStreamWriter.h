@@ -0,0 +1,118 @@
+#pragma once
+
+/************************************************************************/
+/* Append-only .sens writer: frames are compressed on worker threads    */
+/* and written in order while recording; the file is kept loadable      */
+/* (frame count + trailing frame index) after every commit              */
+/************************************************************************/
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdio>
+
+class SensorDataStreamWriter
+{
+public:
+	//! numThreads == 0 uses all hardware threads; at most maxFramesInFlight frames are buffered before writeFrame blocks; the header and the trailing index are updated every commitInterval frames
+	SensorDataStreamWriter(const std::string& filename, const std::string& sensorName,
+		const SensorData::CalibrationData& calibrationColor, const SensorData::CalibrationData& calibrationDepth,
+		unsigned int colorWidth, unsigned int colorHeight, unsigned int depthWidth, unsigned int depthHeight, float depthShift,
+		SensorData::COMPRESSION_TYPE_COLOR colorCompressionType, SensorData::COMPRESSION_TYPE_DEPTH depthCompressionType,
+		unsigned int numThreads, unsigned int maxFramesInFlight, unsigned int commitInterval);
+
+	//! calls close()
+	~SensorDataStreamWriter();
+
+	//! queues a frame (references the buffers until it is compressed); depth is in meters, invalid depth (<= 0, -inf) is stored as 0
+	void writeFrame(const std::shared_ptr<float>& depth, const std::shared_ptr<vec4uc>& color,
+		const mat4f& cameraToWorld = invalidTransform(), UINT64 timeStampColor = 0, UINT64 timeStampDepth = 0);
+
+	//! writes all pending frames, commits and closes the file; rethrows errors of the worker threads
+	void close();
+
+	bool isOpen() const {
+		return m_file != NULL;
+	}
+
+	const std::string& getFilename() const {
+		return m_filename;
+	}
+
+	//! number of frames queued so far
+	unsigned int getNumFrames() const {
+		return m_numFramesQueued;
+	}
+
+	//! repairs a file left behind by a crashed recording (frame count, trailing index) and returns the number of readable frames; called by
+	//! MappedSensorData::open for unfinalized files
+	static UINT64 recover(const std::string& filename);
+
+	//! records numFrames synthetic frames to filename, cuts copies of it in the middle of each frame (as left behind by a crash before / during a commit)
+	//! and checks that the recovered copies contain all complete frames with the recorded depth; returns false if any copy fails
+	static bool testRecovery(const std::string& filename, unsigned int numFrames);
+
+	//! same encodings as ml::SensorData
+	static void compressColor(const vec3uc* color, unsigned int width, unsigned int height, SensorData::COMPRESSION_TYPE_COLOR type, std::vector<unsigned char>& out);
+	static void compressDepth(const unsigned short* depth, unsigned int width, unsigned int height, SensorData::COMPRESSION_TYPE_DEPTH type, std::vector<unsigned char>& out);
+
+	static mat4f invalidTransform() {
+		mat4f m;	m.setZero(-std::numeric_limits<float>::infinity());
+		return m;
+	}
+
+private:
+	struct Frame {
+		std::shared_ptr<float>		depth;
+		std::shared_ptr<vec4uc>		color;
+		mat4f						cameraToWorld;
+		UINT64						timeStampColor;
+		UINT64						timeStampDepth;
+		std::vector<unsigned char>	colorCompressed;
+		std::vector<unsigned char>	depthCompressed;
+		std::future<void>			compressed;
+	};
+
+	void compressFrame(Frame& frame) const;
+	void writerFunc();
+	void writeHeader();
+	//! writes the trailing index at the current end of the frame data and updates the frame count in the header
+	void commit();
+	//! file offset of the frame count for a sensor name of the given length
+	static UINT64 getNumFramesOffset(UINT64 sensorNameLength) {
+		return sizeof(unsigned int) + sizeof(UINT64) + sensorNameLength + 4 * sizeof(mat4f)
+			+ sizeof(SensorData::COMPRESSION_TYPE_COLOR) + sizeof(SensorData::COMPRESSION_TYPE_DEPTH) + 4 * sizeof(unsigned int) + sizeof(float);
+	}
+
+	std::string		m_filename;
+	FILE*			m_file;
+
+	//header
+	std::string		m_sensorName;
+	SensorData::CalibrationData				m_calibrationColor;
+	SensorData::CalibrationData				m_calibrationDepth;
+	SensorData::COMPRESSION_TYPE_COLOR		m_colorCompressionType;
+	SensorData::COMPRESSION_TYPE_DEPTH		m_depthCompressionType;
+	unsigned int	m_colorWidth, m_colorHeight;
+	unsigned int	m_depthWidth, m_depthHeight;
+	float			m_depthShift;
+
+	UINT64					m_numFramesOffset;		//file offset of the frame count in the header
+	UINT64					m_frameDataEnd;			//end of the last written frame (= start of the trailing index)
+	bool					m_bTrailer;				//the trailing index of the last commit is at m_frameDataEnd
+	std::vector<UINT64>		m_frameOffsets;
+	unsigned int			m_commitInterval;
+	unsigned int			m_numFramesQueued;
+
+	ThreadPool*				m_threadPool;
+	std::thread				m_writerThread;
+	std::mutex				m_mutex;
+	std::condition_variable	m_cvQueue;				//frames queued / written
+	std::deque<std::unique_ptr<Frame>> m_queue;		//in order of writing; front is written next
+	unsigned int			m_maxFramesInFlight;
+	bool					m_bStop;
+	std::exception_ptr		m_error;
+};
@@ -14,4 +14,11 @@ extern "C" void updateConstantSiftCameraParams(const SiftCameraParams& params) {
 	cutilCheckMsg(__FUNCTION__);
 #endif
 
+}
+
+extern "C" void getConstantSiftCameraParams(SiftCameraParams& params) {
+
+	size_t size;
+	cutilSafeCall(cudaGetSymbolSize(&size, c_siftCameraParams));
+	cutilSafeCall(cudaMemcpyFromSymbol(&params, c_siftCameraParams, size, 0, cudaMemcpyDeviceToHost));
 }
\ No newline at end of file
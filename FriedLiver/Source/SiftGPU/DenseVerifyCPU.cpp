@@ -0,0 +1,202 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <emmintrin.h>
+
+#include "DenseVerifyCPU.h"
+#include "../CUDACache.h"
+
+namespace {
+
+	//pixel strides 8, 4, 2, 1
+	const unsigned int NUM_LEVELS = 4;
+	//correspondences needed before the residual is tested on a subsample
+	const unsigned int MIN_NUM_CORR_ERR_TEST = 16;
+
+	const float INVALID = -std::numeric_limits<float>::infinity();
+
+	//! upper end of the wilson score interval of a proportion p measured on n samples
+	inline double wilsonUpperBound(double p, double n, double z)
+	{
+		const double z2n = z * z / n;
+		return (p + 0.5 * z2n + z * std::sqrt(p * (1.0 - p) / n + 0.25 * z2n / n)) / (1.0 + z2n);
+	}
+}
+
+DenseVerifyCPU::DenseVerifyCPU(unsigned int width, unsigned int height)
+{
+	m_width = width;
+	m_height = height;
+	m_numFrames = 0;
+
+	m_pixelRank.resize(width * height);
+	for (unsigned int level = 0; level < NUM_LEVELS; level++) {
+		const unsigned int stride = 1 << (NUM_LEVELS - 1 - level);
+		for (unsigned int y = 0; y < height; y += stride) {
+			for (unsigned int x = 0; x < width; x += stride) {
+				if (level > 0 && x % (2 * stride) == 0 && y % (2 * stride) == 0) continue; //already in a coarser level
+				m_pixelRank[y * width + x] = (unsigned int)m_pixelOrder.size();
+				m_pixelOrder.push_back(y * width + x);
+			}
+		}
+		m_levelEnd.push_back((unsigned int)m_pixelOrder.size());
+	}
+}
+
+DenseVerifyCPU::~DenseVerifyCPU()
+{
+}
+
+void DenseVerifyCPU::syncFrames(const CUDACache* cache)
+{
+	MLIB_ASSERT(cache->getWidth() == m_width && cache->getHeight() == m_height);
+	const std::vector<CUDACachedFrame>& cachedFrames = cache->getCacheFrames();
+	const unsigned int numPixels = m_width * m_height;
+	std::vector<float> depth(numPixels);
+	std::vector<float4> camPos(numPixels), normals(numPixels);
+	for (unsigned int f = m_numFrames; f < cache->getNumFrames(); f++) {
+		const CUDACachedFrame& frame = cachedFrames[f];
+		frame.download(depth.data(), camPos.data(), normals.data(), NULL, NULL);
+		setFrame(f, depth.data(), camPos.data(), normals.data());
+	}
+}
+
+void DenseVerifyCPU::setFrame(unsigned int frame, const float* depth, const float4* camPos, const float4* normals)
+{
+	if (frame >= m_frames.size()) m_frames.resize(frame + 1);
+	Frame& f = m_frames[frame];
+	const unsigned int numPixels = m_width * m_height;
+	f.px.resize(numPixels); f.py.resize(numPixels); f.pz.resize(numPixels);
+	f.nx.resize(numPixels); f.ny.resize(numPixels); f.nz.resize(numPixels);
+	f.depth.resize(numPixels);
+	for (unsigned int i = 0; i < numPixels; i++) {
+		const unsigned int idx = m_pixelOrder[i];
+		f.px[i] = camPos[idx].x;	f.py[i] = camPos[idx].y;	f.pz[i] = camPos[idx].z;
+		f.nx[i] = normals[idx].x;	f.ny[i] = normals[idx].y;	f.nz[i] = normals[idx].z;
+		f.depth[i] = depth[idx];
+	}
+	m_numFrames = std::max(m_numFrames, frame + 1);
+}
+
+void DenseVerifyCPU::accumulate(const Frame& input, const Frame& model, const float4x4& transform, const float4x4& intrinsics, const Params& params,
+	unsigned int begin, unsigned int end, Stats& stats) const
+{
+	const float distThresh = params.distThresh, normalThresh = params.normalThresh;
+	const float depthMin = params.depthMin, depthMax = params.depthMax;
+	const float maxX = (float)m_width - 0.5f, maxY = (float)m_height - 0.5f; //(int)roundf(x) in [0, width) <=> x in (-0.5, width - 0.5)
+
+	const __m128 t00 = _mm_set1_ps(transform(0, 0)), t01 = _mm_set1_ps(transform(0, 1)), t02 = _mm_set1_ps(transform(0, 2)), t03 = _mm_set1_ps(transform(0, 3));
+	const __m128 t10 = _mm_set1_ps(transform(1, 0)), t11 = _mm_set1_ps(transform(1, 1)), t12 = _mm_set1_ps(transform(1, 2)), t13 = _mm_set1_ps(transform(1, 3));
+	const __m128 t20 = _mm_set1_ps(transform(2, 0)), t21 = _mm_set1_ps(transform(2, 1)), t22 = _mm_set1_ps(transform(2, 2)), t23 = _mm_set1_ps(transform(2, 3));
+	const __m128 k00 = _mm_set1_ps(intrinsics(0, 0)), k01 = _mm_set1_ps(intrinsics(0, 1)), k02 = _mm_set1_ps(intrinsics(0, 2));
+	const __m128 k10 = _mm_set1_ps(intrinsics(1, 0)), k11 = _mm_set1_ps(intrinsics(1, 1)), k12 = _mm_set1_ps(intrinsics(1, 2));
+	const __m128 k20 = _mm_set1_ps(intrinsics(2, 0)), k21 = _mm_set1_ps(intrinsics(2, 1)), k22 = _mm_set1_ps(intrinsics(2, 2));
+
+	// transformed points / normals and screen positions of 4 pixels
+	float tp[3][4], tn[3][4], sp[2][4];
+	for (unsigned int i = begin; i < end; i += 4) {
+		const unsigned int n = std::min(4u, end - i);
+		__m128 px, py, pz, nx, ny, nz;
+		if (n == 4) {
+			px = _mm_loadu_ps(&input.px[i]); py = _mm_loadu_ps(&input.py[i]); pz = _mm_loadu_ps(&input.pz[i]);
+			nx = _mm_loadu_ps(&input.nx[i]); ny = _mm_loadu_ps(&input.ny[i]); nz = _mm_loadu_ps(&input.nz[i]);
+		}
+		else {
+			float tail[6][4] = {};
+			for (unsigned int k = 0; k < n; k++) {
+				tail[0][k] = input.px[i + k]; tail[1][k] = input.py[i + k]; tail[2][k] = input.pz[i + k];
+				tail[3][k] = input.nx[i + k]; tail[4][k] = input.ny[i + k]; tail[5][k] = input.nz[i + k];
+			}
+			px = _mm_loadu_ps(tail[0]); py = _mm_loadu_ps(tail[1]); pz = _mm_loadu_ps(tail[2]);
+			nx = _mm_loadu_ps(tail[3]); ny = _mm_loadu_ps(tail[4]); nz = _mm_loadu_ps(tail[5]);
+		}
+		const __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t00, px), _mm_mul_ps(t01, py)), _mm_add_ps(_mm_mul_ps(t02, pz), t03));
+		const __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t10, px), _mm_mul_ps(t11, py)), _mm_add_ps(_mm_mul_ps(t12, pz), t13));
+		const __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(t20, px), _mm_mul_ps(t21, py)), _mm_add_ps(_mm_mul_ps(t22, pz), t23));
+		_mm_storeu_ps(tp[0], x); _mm_storeu_ps(tp[1], y); _mm_storeu_ps(tp[2], z);
+		_mm_storeu_ps(tn[0], _mm_add_ps(_mm_add_ps(_mm_mul_ps(t00, nx), _mm_mul_ps(t01, ny)), _mm_mul_ps(t02, nz)));
+		_mm_storeu_ps(tn[1], _mm_add_ps(_mm_add_ps(_mm_mul_ps(t10, nx), _mm_mul_ps(t11, ny)), _mm_mul_ps(t12, nz)));
+		_mm_storeu_ps(tn[2], _mm_add_ps(_mm_add_ps(_mm_mul_ps(t20, nx), _mm_mul_ps(t21, ny)), _mm_mul_ps(t22, nz)));
+		const __m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(k20, x), _mm_mul_ps(k21, y)), _mm_mul_ps(k22, z));
+		_mm_storeu_ps(sp[0], _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(k00, x), _mm_mul_ps(k01, y)), _mm_mul_ps(k02, z)), w));
+		_mm_storeu_ps(sp[1], _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(k10, x), _mm_mul_ps(k11, y)), _mm_mul_ps(k12, z)), w));
+
+		// correspondence test as computeProjError in SIFTImageManager.cu
+		for (unsigned int k = 0; k < n; k++) {
+			const float dInput = input.depth[i + k];
+			if (input.px[i + k] == INVALID || input.nx[i + k] == INVALID || !(dInput >= depthMin && dInput <= depthMax)) continue;
+			if (!(sp[0][k] > -0.5f && sp[0][k] < maxX && sp[1][k] > -0.5f && sp[1][k] < maxY)) continue;
+			const unsigned int t = m_pixelRank[(int)roundf(sp[1][k]) * m_width + (int)roundf(sp[0][k])];
+			if (model.px[t] == INVALID || model.nx[t] == INVALID) continue;
+			const float tgtDepth = model.depth[t];
+			if (!(tgtDepth >= depthMin && tgtDepth <= depthMax)) continue;
+
+			const float dx = tp[0][k] - model.px[t], dy = tp[1][k] - model.py[t], dz = tp[2][k] - model.pz[t];
+			const float d = std::sqrt(dx * dx + dy * dy + dz * dz);
+			const float dNormal = tn[0][k] * model.nx[t] + tn[1][k] * model.ny[t] + tn[2][k] * model.nz[t];
+			const bool b = tp[2][k] < tgtDepth && d > distThresh; // bad matches that are known
+			if ((dNormal >= normalThresh && d <= distThresh) || b) {
+				const float projZ = (tp[2][k] - depthMin) / (depthMax - depthMin);
+				const float weight = std::max(0.0f, 0.5f * ((1.0f - d / distThresh) + (1.0f - projZ)));
+				stats.sumResidual += d;
+				stats.sumWeight += weight;
+				stats.sumResidual2 += (double)d * d;
+				stats.sumWeight2 += (double)weight * weight;
+				stats.sumResidualWeight += (double)d * weight;
+				stats.numCorr++;
+			}
+		}
+	}
+}
+
+bool DenseVerifyCPU::verifyImagePair(unsigned int input, unsigned int model, const float4x4& transform, const float4x4& intrinsics, const Params& params,
+	unsigned int* numPixelsTested) const
+{
+	MLIB_ASSERT(input < m_numFrames && model < m_numFrames);
+	const Frame& frameInput = m_frames[input];
+	const Frame& frameModel = m_frames[model];
+	const float4x4 transformInv = transform.getInverse();
+	const double numPixels = (double)(m_width * m_height);
+
+	// a correspondence weighs at most 1 + distThresh / (2 (depthMax - depthMin)): (1 - d / distThresh) + (1 - projZ) is largest for d = 0, z = depthMin - distThresh
+	const bool bErrBound = params.distThresh < params.depthMax - params.depthMin;
+	const double maxWeight = 1.0 + 0.5 * params.distThresh / (params.depthMax - params.depthMin);
+
+	Stats stats;
+	unsigned int begin = 0;
+	for (unsigned int level = 0; level < NUM_LEVELS; level++) {
+		const unsigned int end = m_levelEnd[level];
+		accumulate(frameInput, frameModel, transform, intrinsics, params, begin, end, stats);
+		accumulate(frameModel, frameInput, transformInv, intrinsics, params, begin, end, stats);
+		begin = end;
+		if (numPixelsTested) *numPixelsTested = end;
+		if (level + 1 == NUM_LEVELS) break;
+
+		// the remaining pixels of both directions can't lift the correspondence ratio / lower the residual enough
+		const double numRemaining = 2.0 * (numPixels - end);
+		if (0.5 * (stats.numCorr + numRemaining) / numPixels < params.corrThresh) return false;
+		if (bErrBound && stats.sumResidual / (stats.sumWeight + numRemaining * maxWeight) > params.errThresh) return false;
+
+		// subsample far beyond a threshold
+		if (params.earlyExitZ > 0.0f) {
+			const double z = params.earlyExitZ;
+			if (wilsonUpperBound(0.5 * stats.numCorr / end, 2.0 * end, z) < params.corrThresh) return false;
+			if (stats.numCorr >= MIN_NUM_CORR_ERR_TEST && stats.sumWeight > 0.0) {
+				// standard error of the ratio estimate sum(d) / sum(w)
+				const double k = stats.numCorr;
+				const double err = stats.sumResidual / stats.sumWeight;
+				const double var = std::max(0.0, (stats.sumResidual2 - 2.0 * err * stats.sumResidualWeight + err * err * stats.sumWeight2) / (k - 1.0));
+				const double stdErr = std::sqrt(var / k) / (stats.sumWeight / k);
+				if (err - z * stdErr > params.errThresh) return false;
+			}
+		}
+	}
+
+	const float err = (float)(stats.sumResidual / stats.sumWeight);
+	const float corr = (float)(0.5 * stats.numCorr / numPixels);
+	return !(corr < params.corrThresh || err > params.errThresh || std::isnan(err));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#ifndef DENSE_VERIFY_CPU_H
+#define DENSE_VERIFY_CPU_H
+
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "cuda_SimpleMatrixUtil.h"
+
+class CUDACache;
+
+//! host version of the dense verification of SIFTImageManager::FilterMatchesByDenseVerifyCU: projective correspondences between two cached (downsampled)
+//! frames in both directions, mean residual and fraction of corresponding pixels against the error / correspondence thresholds.
+//! the frames are mirrored to host memory in coarse to fine pixel order (every 8th pixel in x and y, then every 4th, 2nd, all), so every level is a
+//! contiguous block of structure of arrays points / normals that is transformed and projected 4 pixels at a time. after each level an image pair is
+//! rejected if the remaining pixels can't change the decision any more (exact bounds) or, with earlyExitZ > 0, if the pixels tested so far are
+//! earlyExitZ standard errors beyond one of the thresholds; valid pairs always test all pixels
+class DenseVerifyCPU
+{
+public:
+	struct Params {
+		float distThresh;
+		float normalThresh;
+		float errThresh;
+		float corrThresh;
+		float depthMin;
+		float depthMax;
+		float earlyExitZ;	//0: only the exact bounds, i.e. the same decision as the full test
+	};
+
+	DenseVerifyCPU(unsigned int width, unsigned int height);
+	~DenseVerifyCPU();
+
+	void reset() { m_numFrames = 0; }
+	unsigned int getNumFrames() const { return m_numFrames; }
+	unsigned int getWidth() const { return m_width; }
+	unsigned int getHeight() const { return m_height; }
+
+	//! downloads the frames [getNumFrames(), cache->getNumFrames()) of the cache; cached frames are not modified after they are stored, so the
+	//! mirror only needs to catch up (call reset() whenever the cache is reset)
+	void syncFrames(const CUDACache* cache);
+	//! host buffers of the downsampled frame in image order (as in CUDACachedFrame)
+	void setFrame(unsigned int frame, const float* depth, const float4* camPos, const float4* normals);
+
+	//! transform maps the input frame to the model frame (FilterMatchesByDenseVerifyCU: the previous frame to the current one); returns false if the pair is invalid.
+	//! numPixelsTested (optional) is the number of pixels per direction evaluated before the decision
+	bool verifyImagePair(unsigned int input, unsigned int model, const float4x4& transform, const float4x4& intrinsics, const Params& params,
+		unsigned int* numPixelsTested = NULL) const;
+
+private:
+	//! structure of arrays in coarse to fine pixel order
+	struct Frame {
+		std::vector<float> px, py, pz;
+		std::vector<float> nx, ny, nz;
+		std::vector<float> depth;
+	};
+	//! sums over the correspondences of both directions
+	struct Stats {
+		Stats() : sumResidual(0.0), sumWeight(0.0), sumResidual2(0.0), sumWeight2(0.0), sumResidualWeight(0.0), numCorr(0) {}
+		double sumResidual, sumWeight;
+		double sumResidual2, sumWeight2, sumResidualWeight;
+		unsigned int numCorr;
+	};
+
+	//! projective correspondences of the pixels [begin, end) (coarse to fine order) of input in model
+	void accumulate(const Frame& input, const Frame& model, const float4x4& transform, const float4x4& intrinsics, const Params& params,
+		unsigned int begin, unsigned int end, Stats& stats) const;
+
+	unsigned int					m_width;
+	unsigned int					m_height;
+	std::vector<unsigned int>		m_pixelOrder;	//image index of the i-th pixel in coarse to fine order
+	std::vector<unsigned int>		m_pixelRank;	//position of an image index in coarse to fine order
+	std::vector<unsigned int>		m_levelEnd;
+
+	unsigned int					m_numFrames;
+	std::vector<Frame>				m_frames;
+};
+
+#endif //DENSE_VERIFY_CPU_H
@@ -0,0 +1,199 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#include "KabschBatch.h"
+#include "../ThreadPool.h"
+
+namespace {
+
+	//problems per parallel task (multiple of KabschBatch::LANES)
+	const unsigned int PROBLEMS_PER_TASK = 256;
+
+	//! KabschBatch::LANES floats; comparisons return all-ones / all-zeros lanes
+#if defined(__AVX2__)
+	struct Lanes {
+		__m256 v;
+		Lanes() {}
+		Lanes(float f) : v(_mm256_set1_ps(f)) {}
+		explicit Lanes(__m256 x) : v(x) {}
+	};
+	inline Lanes operator+(Lanes a, Lanes b) { return Lanes(_mm256_add_ps(a.v, b.v)); }
+	inline Lanes operator-(Lanes a, Lanes b) { return Lanes(_mm256_sub_ps(a.v, b.v)); }
+	inline Lanes operator*(Lanes a, Lanes b) { return Lanes(_mm256_mul_ps(a.v, b.v)); }
+	inline Lanes operator/(Lanes a, Lanes b) { return Lanes(_mm256_div_ps(a.v, b.v)); }
+	inline Lanes loadLanes(const float* p) { return Lanes(_mm256_loadu_ps(p)); }
+	inline void storeLanes(float* p, Lanes a) { _mm256_storeu_ps(p, a.v); }
+#else
+	struct Lanes {
+		__m128 v;
+		Lanes() {}
+		Lanes(float f) : v(_mm_set1_ps(f)) {}
+		explicit Lanes(__m128 x) : v(x) {}
+	};
+	inline Lanes operator+(Lanes a, Lanes b) { return Lanes(_mm_add_ps(a.v, b.v)); }
+	inline Lanes operator-(Lanes a, Lanes b) { return Lanes(_mm_sub_ps(a.v, b.v)); }
+	inline Lanes operator*(Lanes a, Lanes b) { return Lanes(_mm_mul_ps(a.v, b.v)); }
+	inline Lanes operator/(Lanes a, Lanes b) { return Lanes(_mm_div_ps(a.v, b.v)); }
+	inline Lanes loadLanes(const float* p) { return Lanes(_mm_loadu_ps(p)); }
+	inline void storeLanes(float* p, Lanes a) { _mm_storeu_ps(p, a.v); }
+#endif
+}
+
+template<> struct KabschLane<Lanes> {
+	typedef Lanes Mask;
+#if defined(__AVX2__)
+	static inline Lanes select(Lanes c, Lanes a, Lanes b) { return Lanes(_mm256_blendv_ps(b.v, a.v, c.v)); }
+	static inline Lanes less(Lanes a, Lanes b) { return Lanes(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)); }
+	static inline Lanes abs(Lanes a) { return Lanes(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v)); }
+	static inline Lanes max(Lanes a, Lanes b) { return Lanes(_mm256_max_ps(a.v, b.v)); }
+	static inline Lanes sqrt(Lanes a) { return Lanes(_mm256_sqrt_ps(a.v)); }
+	static inline Lanes rsqrtApprox(Lanes a) { return Lanes(_mm256_rsqrt_ps(a.v)); }
+#else
+	static inline Lanes select(Lanes c, Lanes a, Lanes b) { return Lanes(_mm_or_ps(_mm_and_ps(c.v, a.v), _mm_andnot_ps(c.v, b.v))); }
+	static inline Lanes less(Lanes a, Lanes b) { return Lanes(_mm_cmplt_ps(a.v, b.v)); }
+	static inline Lanes abs(Lanes a) { return Lanes(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+	static inline Lanes max(Lanes a, Lanes b) { return Lanes(_mm_max_ps(a.v, b.v)); }
+	static inline Lanes sqrt(Lanes a) { return Lanes(_mm_sqrt_ps(a.v)); }
+	static inline Lanes rsqrtApprox(Lanes a) { return Lanes(_mm_rsqrt_ps(a.v)); }
+#endif
+	//12 bit approximation refined by one newton step (the raw approximation would cost 12 bits per givens rotation); inf / nan for 0, which svd never selects
+	static inline Lanes rsqrt(Lanes a) {
+		const Lanes x = rsqrtApprox(a);
+		return x * (Lanes(1.5f) - Lanes(0.5f) * a * x * x);
+	}
+};
+
+namespace {
+
+	//! numArrays structure of arrays inputs of the problems [first, first + LANES); the last block is zero padded (the svd of 0 is well defined)
+	inline void gatherLanes(const float* const* in, unsigned int numArrays, unsigned int first, unsigned int numProblems, Lanes* out)
+	{
+		const unsigned int n = std::min(KabschBatch::LANES, numProblems - first);
+		for (unsigned int k = 0; k < numArrays; k++) {
+			if (n == KabschBatch::LANES) {
+				out[k] = loadLanes(in[k] + first);
+			}
+			else {
+				float tmp[KabschBatch::LANES] = { 0.0f };
+				std::copy(in[k] + first, in[k] + first + n, tmp);
+				out[k] = loadLanes(tmp);
+			}
+		}
+	}
+
+	inline void scatterLanes(const Lanes* in, unsigned int numArrays, unsigned int first, unsigned int numProblems, float* const* out)
+	{
+		const unsigned int n = std::min(KabschBatch::LANES, numProblems - first);
+		for (unsigned int k = 0; k < numArrays; k++) {
+			if (n == KabschBatch::LANES) {
+				storeLanes(out[k] + first, in[k]);
+			}
+			else {
+				float tmp[KabschBatch::LANES];
+				storeLanes(tmp, in[k]);
+				std::copy(tmp, tmp + n, out[k] + first);
+			}
+		}
+	}
+
+	//! flush to zero / denormals are zero for the scope: the off diagonal elements converge to ~1e-20 and their squares are denormal,
+	//! which costs microcode assists on every operation (3-5x slower overall)
+	struct FlushDenormals {
+		FlushDenormals() : m_csr(_mm_getcsr()) { _mm_setcsr(m_csr | 0x8040); }
+		~FlushDenormals() { _mm_setcsr(m_csr); }
+		unsigned int m_csr;
+	};
+
+	//! f(begin, end) on blocks of PROBLEMS_PER_TASK problems
+	template<class F>
+	void forEachTask(unsigned int numProblems, F f)
+	{
+		const unsigned int numTasks = (numProblems + PROBLEMS_PER_TASK - 1) / PROBLEMS_PER_TASK;
+		ThreadPool::get().parallelFor(0, numTasks, [&](unsigned int t) {
+			FlushDenormals flush;
+			f(t * PROBLEMS_PER_TASK, std::min((t + 1) * PROBLEMS_PER_TASK, numProblems));
+		}, 1);
+	}
+}
+
+void KabschBatch::svd(unsigned int numProblems, const float* const* a, float* const* u, float* const* s, float* const* v)
+{
+	forEachTask(numProblems, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i += LANES) {
+			Lanes la[9], lu[9], ls[3], lv[9];
+			gatherLanes(a, 9, i, numProblems, la);
+			KabschSVD::svd<Lanes>(la, lu, ls, lv);
+			scatterLanes(lu, 9, i, numProblems, u);
+			scatterLanes(ls, 3, i, numProblems, s);
+			scatterLanes(lv, 9, i, numProblems, v);
+		}
+	});
+}
+
+void KabschBatch::rotationFromCovariance(unsigned int numProblems, const float* const* h, float* const* rot, float* const* absSingularValues)
+{
+	forEachTask(numProblems, [&](unsigned int begin, unsigned int end) {
+		for (unsigned int i = begin; i < end; i += LANES) {
+			Lanes lh[9], lr[9], ls[3];
+			gatherLanes(h, 9, i, numProblems, lh);
+			KabschSVD::rotationFromCovariance<Lanes>(lh, lr, ls);
+			scatterLanes(lr, 9, i, numProblems, rot);
+			scatterLanes(ls, 3, i, numProblems, absSingularValues);
+		}
+	});
+}
+
+void KabschBatch::kabsch(unsigned int numProblems, const float3* source, const float3* target, const unsigned int* offsets, float4x4* transforms, float3* singularValues)
+{
+	forEachTask(numProblems, [&](unsigned int begin, unsigned int end) {
+		const unsigned int n = end - begin;
+		float h[9][PROBLEMS_PER_TASK], rot[9][PROBLEMS_PER_TASK], sv[3][PROBLEMS_PER_TASK];
+		float3 p0[PROBLEMS_PER_TASK], q0[PROBLEMS_PER_TASK];
+		for (unsigned int i = 0; i < n; i++) {
+			const unsigned int first = offsets[begin + i];
+			float hi[9];
+			KabschSVD::covariance(source + first, target + first, offsets[begin + i + 1] - first, p0[i], q0[i], hi);
+			for (unsigned int k = 0; k < 9; k++) h[k][i] = hi[k];
+		}
+
+		const float* hPtr[9]; float* rotPtr[9]; float* svPtr[3];
+		for (unsigned int k = 0; k < 9; k++) { hPtr[k] = h[k]; rotPtr[k] = rot[k]; }
+		for (unsigned int k = 0; k < 3; k++) svPtr[k] = sv[k];
+		for (unsigned int i = 0; i < n; i += LANES) {
+			Lanes lh[9], lr[9], ls[3];
+			gatherLanes(hPtr, 9, i, n, lh);
+			KabschSVD::rotationFromCovariance<Lanes>(lh, lr, ls);
+			scatterLanes(lr, 9, i, n, rotPtr);
+			scatterLanes(ls, 3, i, n, svPtr);
+		}
+
+		for (unsigned int i = 0; i < n; i++) {
+			float r[9];
+			for (unsigned int k = 0; k < 9; k++) r[k] = rot[k][i];
+			transforms[begin + i] = KabschSVD::toTransform(r, p0[i], q0[i]);
+			if (singularValues) singularValues[begin + i] = make_float3(sv[0][i], sv[1][i], sv[2][i]);
+		}
+	});
+}
+
+float4x4 KabschBatch::kabsch(const float3* source, const float3* target, unsigned int numPoints, float3& singularValues)
+{
+	FlushDenormals flush;
+	return KabschSVD::kabsch(source, target, numPoints, singularValues);
+}
+
+const char* KabschBatch::getInstructionSet()
+{
+#if defined(__AVX2__)
+	return "AVX2";
+#else
+	return "SSE2";
+#endif
+}
@@ -0,0 +1,275 @@
+#pragma once
+#ifndef KABSCH_BATCH_H
+#define KABSCH_BATCH_H
+
+#include <cuda_runtime.h>
+#include "cuda_SimpleMatrixUtil.h"
+
+//! 3x3 SVD (McAdams et al. 2011, "Computing the SVD of 3x3 matrices with minimal branching": jacobi eigenanalysis of A^T A with approximate givens
+//! quaternions, QR of A V) and kabsch written once for a lane type T: float on host and device, SIMD registers in KabschBatch.cpp.
+//! KabschLane<T> provides the arithmetic that is not an operator: select / less / abs / max / sqrt / rsqrt
+template<class T> struct KabschLane;
+
+template<> struct KabschLane<float> {
+	typedef bool Mask;
+	static __host__ __device__ __forceinline__ float select(bool c, float a, float b) { return c ? a : b; }
+	static __host__ __device__ __forceinline__ bool less(float a, float b) { return a < b; }
+	static __host__ __device__ __forceinline__ float abs(float a) { return fabsf(a); }
+	static __host__ __device__ __forceinline__ float max(float a, float b) { return fmaxf(a, b); }
+	static __host__ __device__ __forceinline__ float sqrt(float a) { return sqrtf(a); }
+	static __host__ __device__ __forceinline__ float rsqrt(float a) { return 1.0f / sqrtf(a); }
+};
+
+namespace KabschSVD {
+
+	//4 as in the paper leaves errors of 1e-2 in float for some well conditioned matrices, 6 converges
+	const unsigned int NUM_JACOBI_SWEEPS = 6;
+
+	template<class T> __host__ __device__ __forceinline__
+	void condSwap(typename KabschLane<T>::Mask c, T& x, T& y)
+	{
+		const T z = x;
+		x = KabschLane<T>::select(c, y, x);
+		y = KabschLane<T>::select(c, z, y);
+	}
+
+	template<class T> __host__ __device__ __forceinline__
+	void condNegSwap(typename KabschLane<T>::Mask c, T& x, T& y)
+	{
+		const T z = T(0.0f) - x;
+		x = KabschLane<T>::select(c, y, x);
+		y = KabschLane<T>::select(c, z, y);
+	}
+
+	//! one jacobi rotation on the symmetric s (lower triangle), accumulated in the quaternion q (x, y, z, w); rotates the matrix for the next pair
+	template<class T> __host__ __device__ __forceinline__
+	void jacobiConjugation(int x, int y, int z, T& s11, T& s21, T& s22, T& s31, T& s32, T& s33, T* q)
+	{
+		typedef KabschLane<T> L;
+		const T gamma(5.828427124f), cstar(0.923879532f), sstar(0.3826834323f);
+
+		T ch = T(2.0f) * (s11 - s22);
+		T sh = s21;
+		const typename L::Mask b = L::less(gamma * sh * sh, ch * ch);
+		const T w = L::rsqrt(ch * ch + sh * sh);
+		ch = L::select(b, w * ch, cstar);
+		sh = L::select(b, w * sh, sstar);
+
+		// (ch, sh) has unit length
+		const T a = ch * ch - sh * sh;
+		const T bb = T(2.0f) * sh * ch;
+
+		const T _s11 = s11, _s21 = s21, _s22 = s22, _s31 = s31, _s32 = s32, _s33 = s33;
+		s11 = a * (a * _s11 + bb * _s21) + bb * (a * _s21 + bb * _s22);
+		s21 = a * (a * _s21 - bb * _s11) + bb * (a * _s22 - bb * _s21);
+		s22 = a * (a * _s22 - bb * _s21) - bb * (a * _s21 - bb * _s11);
+		s31 = a * _s31 + bb * _s32;
+		s32 = a * _s32 - bb * _s31;
+		s33 = _s33;
+
+		T tmp[3] = { q[0] * sh, q[1] * sh, q[2] * sh };
+		sh = sh * q[3];
+		q[0] = q[0] * ch; q[1] = q[1] * ch; q[2] = q[2] * ch; q[3] = q[3] * ch;
+		q[z] = q[z] + sh;
+		q[3] = q[3] - tmp[z];
+		q[x] = q[x] + tmp[y];
+		q[y] = q[y] - tmp[x];
+
+		// cycle (1,2) -> (2,3) -> (1,3)
+		const T r11 = s22, r21 = s32, r22 = s33, r31 = s21, r32 = s31, r33 = s11;
+		s11 = r11; s21 = r21; s22 = r22; s31 = r31; s32 = r32; s33 = r33;
+	}
+
+	template<class T> __host__ __device__ __forceinline__
+	void qrGivensQuaternion(T a1, T a2, T& ch, T& sh)
+	{
+		typedef KabschLane<T> L;
+		const T epsilon(1e-6f);
+		const T rho = L::sqrt(a1 * a1 + a2 * a2);
+		sh = L::select(L::less(epsilon, rho), a2, T(0.0f));
+		ch = L::abs(a1) + L::max(rho, epsilon);
+		condSwap<T>(L::less(a1, T(0.0f)), sh, ch);
+		const T w = L::rsqrt(ch * ch + sh * sh);
+		ch = ch * w;
+		sh = sh * w;
+	}
+
+	//! a = u * diag(s) * v^T (row major 3x3); u and v are rotations, |s[0]| >= |s[1]| >= |s[2]| and only s[2] can be negative
+	template<class T> __host__ __device__ __forceinline__
+	void svd(const T* a, T* u, T* s, T* v)
+	{
+		typedef KabschLane<T> L;
+
+		// symmetric eigenanalysis of a^T a
+		T s11 = a[0] * a[0] + a[3] * a[3] + a[6] * a[6];
+		T s21 = a[1] * a[0] + a[4] * a[3] + a[7] * a[6];
+		T s22 = a[1] * a[1] + a[4] * a[4] + a[7] * a[7];
+		T s31 = a[2] * a[0] + a[5] * a[3] + a[8] * a[6];
+		T s32 = a[2] * a[1] + a[5] * a[4] + a[8] * a[7];
+		T s33 = a[2] * a[2] + a[5] * a[5] + a[8] * a[8];
+		T q[4] = { T(0.0f), T(0.0f), T(0.0f), T(1.0f) };
+		for (unsigned int i = 0; i < NUM_JACOBI_SWEEPS; i++) {
+			jacobiConjugation<T>(0, 1, 2, s11, s21, s22, s31, s32, s33, q);
+			jacobiConjugation<T>(1, 2, 0, s11, s21, s22, s31, s32, s33, q);
+			jacobiConjugation<T>(2, 0, 1, s11, s21, s22, s31, s32, s33, q);
+		}
+		// the accumulated quaternion is not exactly unit length
+		const T qn = L::rsqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		const T qx = q[0] * qn, qy = q[1] * qn, qz = q[2] * qn, qw = q[3] * qn;
+		v[0] = T(1.0f) - T(2.0f) * (qy * qy + qz * qz);	v[1] = T(2.0f) * (qx * qy - qw * qz);				v[2] = T(2.0f) * (qx * qz + qw * qy);
+		v[3] = T(2.0f) * (qx * qy + qw * qz);				v[4] = T(1.0f) - T(2.0f) * (qx * qx + qz * qz);	v[5] = T(2.0f) * (qy * qz - qw * qx);
+		v[6] = T(2.0f) * (qx * qz - qw * qy);				v[7] = T(2.0f) * (qy * qz + qw * qx);				v[8] = T(1.0f) - T(2.0f) * (qx * qx + qy * qy);
+
+		// b = a * v, columns sorted by decreasing norm (v simultaneously, negating to keep it a rotation)
+		T b[9];
+		for (unsigned int r = 0; r < 3; r++)
+			for (unsigned int c = 0; c < 3; c++)
+				b[3 * r + c] = a[3 * r + 0] * v[c] + a[3 * r + 1] * v[3 + c] + a[3 * r + 2] * v[6 + c];
+		T rho1 = b[0] * b[0] + b[3] * b[3] + b[6] * b[6];
+		T rho2 = b[1] * b[1] + b[4] * b[4] + b[7] * b[7];
+		T rho3 = b[2] * b[2] + b[5] * b[5] + b[8] * b[8];
+		typename L::Mask c = L::less(rho1, rho2);
+		for (unsigned int r = 0; r < 3; r++) { condNegSwap<T>(c, b[3 * r + 0], b[3 * r + 1]); condNegSwap<T>(c, v[3 * r + 0], v[3 * r + 1]); }
+		condSwap<T>(c, rho1, rho2);
+		c = L::less(rho1, rho3);
+		for (unsigned int r = 0; r < 3; r++) { condNegSwap<T>(c, b[3 * r + 0], b[3 * r + 2]); condNegSwap<T>(c, v[3 * r + 0], v[3 * r + 2]); }
+		condSwap<T>(c, rho1, rho3);
+		c = L::less(rho2, rho3);
+		for (unsigned int r = 0; r < 3; r++) { condNegSwap<T>(c, b[3 * r + 1], b[3 * r + 2]); condNegSwap<T>(c, v[3 * r + 1], v[3 * r + 2]); }
+
+		// QR of b with three givens rotations: u = Q, s = diag(R)
+		T ch1, sh1, ch2, sh2, ch3, sh3, ga, gb;
+		T r[9];
+		qrGivensQuaternion<T>(b[0], b[3], ch1, sh1);
+		ga = T(1.0f) - T(2.0f) * sh1 * sh1;	gb = T(2.0f) * ch1 * sh1;
+		r[0] = ga * b[0] + gb * b[3];	r[1] = ga * b[1] + gb * b[4];	r[2] = ga * b[2] + gb * b[5];
+		r[3] = ga * b[3] - gb * b[0];	r[4] = ga * b[4] - gb * b[1];	r[5] = ga * b[5] - gb * b[2];
+		r[6] = b[6];					r[7] = b[7];					r[8] = b[8];
+
+		qrGivensQuaternion<T>(r[0], r[6], ch2, sh2);
+		ga = T(1.0f) - T(2.0f) * sh2 * sh2;	gb = T(2.0f) * ch2 * sh2;
+		b[0] = ga * r[0] + gb * r[6];	b[1] = ga * r[1] + gb * r[7];	b[2] = ga * r[2] + gb * r[8];
+		b[3] = r[3];					b[4] = r[4];					b[5] = r[5];
+		b[6] = ga * r[6] - gb * r[0];	b[7] = ga * r[7] - gb * r[1];	b[8] = ga * r[8] - gb * r[2];
+
+		qrGivensQuaternion<T>(b[4], b[7], ch3, sh3);
+		ga = T(1.0f) - T(2.0f) * sh3 * sh3;	gb = T(2.0f) * ch3 * sh3;
+		s[0] = b[0];
+		s[1] = ga * b[4] + gb * b[7];
+		s[2] = ga * b[8] - gb * b[5];
+
+		const T sh12 = sh1 * sh1, sh22 = sh2 * sh2, sh32 = sh3 * sh3;
+		const T m12 = T(2.0f) * sh12 - T(1.0f), m22 = T(2.0f) * sh22 - T(1.0f), m32 = T(2.0f) * sh32 - T(1.0f);
+		u[0] = m12 * m22;
+		u[1] = T(4.0f) * ch2 * ch3 * m12 * sh2 * sh3 + T(2.0f) * ch1 * sh1 * m32;
+		u[2] = T(4.0f) * ch1 * ch3 * sh1 * sh3 - T(2.0f) * ch2 * m12 * sh2 * m32;
+		u[3] = T(2.0f) * ch1 * sh1 * (T(1.0f) - T(2.0f) * sh22);
+		u[4] = T(0.0f) - T(8.0f) * ch1 * ch2 * ch3 * sh1 * sh2 * sh3 + m12 * m32;
+		u[5] = T(4.0f) * sh1 * (ch3 * sh1 * sh3 + ch1 * ch2 * sh2 * m32) - T(2.0f) * ch3 * sh3;
+		u[6] = T(2.0f) * ch2 * sh2;
+		u[7] = T(2.0f) * ch3 * (T(1.0f) - T(2.0f) * sh22) * sh3;
+		u[8] = m22 * m32;
+	}
+
+	//! rotation maximizing trace(rot * h) for the cross covariance h = sum (p - p0)(q - q0)^T: rot = v * u^T of the signed svd (no reflection check needed);
+	//! absolute singular values of h in decreasing order
+	template<class T> __host__ __device__ __forceinline__
+	void rotationFromCovariance(const T* h, T* rot, T* absSingularValues)
+	{
+		T u[9], s[3], v[9];
+		svd<T>(h, u, s, v);
+		for (unsigned int r = 0; r < 3; r++)
+			for (unsigned int c = 0; c < 3; c++)
+				rot[3 * r + c] = v[3 * r + 0] * u[3 * c + 0] + v[3 * r + 1] * u[3 * c + 1] + v[3 * r + 2] * u[3 * c + 2];
+		for (unsigned int i = 0; i < 3; i++) absSingularValues[i] = KabschLane<T>::abs(s[i]);
+	}
+
+	//! centroids and covariance sum (p - p0)(q - q0)^T / n (row major); P is a (volatile) float3 pointer
+	template<class P> __host__ __device__ __forceinline__
+	void covariance(P source, P target, unsigned int numPoints, float3& p0, float3& q0, float* h)
+	{
+		p0 = make_float3(0.0f, 0.0f, 0.0f);
+		q0 = make_float3(0.0f, 0.0f, 0.0f);
+		for (unsigned int k = 0; k < 9; k++) h[k] = 0.0f;
+		if (numPoints == 0) return;
+		for (unsigned int i = 0; i < numPoints; i++) {
+			p0.x += source[i].x; p0.y += source[i].y; p0.z += source[i].z;
+			q0.x += target[i].x; q0.y += target[i].y; q0.z += target[i].z;
+		}
+		const float invN = 1.0f / (float)numPoints;
+		p0.x *= invN; p0.y *= invN; p0.z *= invN;
+		q0.x *= invN; q0.y *= invN; q0.z *= invN;
+		for (unsigned int i = 0; i < numPoints; i++) {
+			const float p[3] = { source[i].x - p0.x, source[i].y - p0.y, source[i].z - p0.z };
+			const float q[3] = { target[i].x - q0.x, target[i].y - q0.y, target[i].z - q0.z };
+			for (unsigned int r = 0; r < 3; r++)
+				for (unsigned int c = 0; c < 3; c++)
+					h[3 * r + c] += p[r] * q[c];
+		}
+		for (unsigned int k = 0; k < 9; k++) h[k] *= invN;
+	}
+
+	__host__ __device__ __forceinline__
+	float4x4 toTransform(const float* rot, const float3& p0, const float3& q0)
+	{
+		float4x4 ret;
+		ret.setIdentity();
+		for (unsigned int r = 0; r < 3; r++)
+			for (unsigned int c = 0; c < 3; c++)
+				ret(r, c) = rot[3 * r + c];
+		ret(0, 3) = q0.x - (rot[0] * p0.x + rot[1] * p0.y + rot[2] * p0.z);
+		ret(1, 3) = q0.y - (rot[3] * p0.x + rot[4] * p0.y + rot[5] * p0.z);
+		ret(2, 3) = q0.z - (rot[6] * p0.x + rot[7] * p0.y + rot[8] * p0.z);
+		return ret;
+	}
+
+	//! single kabsch problem (host and device): transform mapping source to target, absolute singular values of the covariance in decreasing order
+	template<class P> __host__ __device__ __forceinline__
+	float4x4 kabsch(P source, P target, unsigned int numPoints, float3& singularValues)
+	{
+		float3 p0, q0;
+		float h[9], rot[9], sv[3];
+		covariance(source, target, numPoints, p0, q0, h);
+		rotationFromCovariance<float>(h, rot, sv);
+		singularValues = make_float3(sv[0], sv[1], sv[2]);
+		return toTransform(rot, p0, q0);
+	}
+
+	//! absolute singular values of the covariance of the points in decreasing order (the condition x / y as in kabsch)
+	template<class P> __host__ __device__ __forceinline__
+	float3 covarianceSingularValues(P points, unsigned int numPoints)
+	{
+		float3 p0, q0;
+		float h[9], u[9], s[3], v[9];
+		covariance(points, points, numPoints, p0, q0, h);
+		svd<float>(h, u, s, v);
+		return make_float3(KabschLane<float>::abs(s[0]), KabschLane<float>::abs(s[1]), KabschLane<float>::abs(s[2]));
+	}
+}
+
+//! host batches of 3x3 SVD / kabsch problems in structure of arrays layout: KabschBatch::LANES problems per SIMD register (AVX2 if the build enables it, SSE2 otherwise);
+//! large batches run in parallel on ThreadPool::get(). results match KabschSVD::svd<float> (device / single problems) up to rounding
+class KabschBatch
+{
+public:
+#if defined(__AVX2__)
+	static const unsigned int LANES = 8;
+#else
+	static const unsigned int LANES = 4;
+#endif
+
+	//! a[3 * r + c][i] is A_i(r, c), same layout for u and v; see KabschSVD::svd
+	static void svd(unsigned int numProblems, const float* const* a, float* const* u, float* const* s, float* const* v);
+	//! see KabschSVD::rotationFromCovariance
+	static void rotationFromCovariance(unsigned int numProblems, const float* const* h, float* const* rot, float* const* absSingularValues);
+
+	//! problem i has the correspondences source / target[offsets[i], offsets[i + 1]); transforms[i] maps source to target, singularValues[i] are the absolute singular values
+	//! of the covariance sum (p - p0)(q - q0)^T / n in decreasing order (the condition x / y as in cuda_kabsch.h's kabsch)
+	static void kabsch(unsigned int numProblems, const float3* source, const float3* target, const unsigned int* offsets, float4x4* transforms, float3* singularValues);
+	//! single problem on the host (scalar lanes, KabschSVD::kabsch)
+	static float4x4 kabsch(const float3* source, const float3* target, unsigned int numPoints, float3& singularValues);
+
+	static const char* getInstructionSet();
+};
+
+#endif //KABSCH_BATCH_H
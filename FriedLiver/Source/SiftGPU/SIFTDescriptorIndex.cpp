@@ -0,0 +1,151 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "SIFTDescriptorIndex.h"
+#include "../ThreadPool.h"
+
+namespace {
+
+	//training set size of the coarse quantizer and the product quantizer
+	const unsigned int MAX_TRAINING_SAMPLES = 16384;
+	const unsigned int NUM_KMEANS_ITERATIONS = 8;
+	//query / insert descriptors per parallel task
+	const unsigned int DESC_TILE = 16;
+
+	struct Neighbor {
+		float dist;
+		unsigned int imageIdx;
+	};
+}
+
+SIFTDescriptorIndex::SIFTDescriptorIndex(unsigned int numLists, unsigned int numProbes, unsigned int numTrainingImages) : SIFTImageRetrieval(numTrainingImages)
+{
+	m_numLists = std::max(numLists, 1u);
+	m_numProbes = std::min(std::max(numProbes, 1u), m_numLists);
+	reset();
+}
+
+SIFTDescriptorIndex::~SIFTDescriptorIndex()
+{
+}
+
+void SIFTDescriptorIndex::reset()
+{
+	resetImages();
+	m_coarseCenters.clear();
+	m_pqCenters.clear();
+	m_lists.clear();
+	m_numDescriptors = 0;
+}
+
+void SIFTDescriptorIndex::train()
+{
+	std::vector<float> samples;
+	const unsigned int numSamples = sampleTrainingDescriptors(MAX_TRAINING_SAMPLES, samples);
+	if (numSamples == 0) return;
+
+	kMeans(samples.data(), numSamples, 128, m_numLists, NUM_KMEANS_ITERATIONS, m_coarseCenters);
+	m_numLists = (unsigned int)m_coarseCenters.size() / 128;
+	m_numProbes = std::min(m_numProbes, m_numLists);
+	m_lists.assign(m_numLists, InvertedList());
+
+	//one codebook per subspace (nested parallelFor inside kMeans is fine, the caller participates)
+	m_pqCenters.assign(PQ_NUM_SUBSPACES * PQ_NUM_CENTERS * PQ_SUBSPACE_DIM, 0.0f);
+	ThreadPool::get().parallelFor(0, PQ_NUM_SUBSPACES, [&](unsigned int sub) {
+		std::vector<float> subSamples((size_t)numSamples * PQ_SUBSPACE_DIM);
+		for (unsigned int s = 0; s < numSamples; s++) {
+			const float* src = samples.data() + (size_t)s * 128 + sub * PQ_SUBSPACE_DIM;
+			std::copy(src, src + PQ_SUBSPACE_DIM, subSamples.begin() + s * PQ_SUBSPACE_DIM);
+		}
+		std::vector<float> centers;
+		kMeans(subSamples.data(), numSamples, PQ_SUBSPACE_DIM, PQ_NUM_CENTERS, NUM_KMEANS_ITERATIONS, centers);
+		//fewer samples than centers: the remaining codes repeat the first center (on ties the encoder keeps the lower code)
+		float* dst = m_pqCenters.data() + sub * PQ_NUM_CENTERS * PQ_SUBSPACE_DIM;
+		std::copy(centers.begin(), centers.end(), dst);
+		for (size_t c = centers.size() / PQ_SUBSPACE_DIM; c < PQ_NUM_CENTERS; c++) std::copy(centers.begin(), centers.begin() + PQ_SUBSPACE_DIM, dst + c * PQ_SUBSPACE_DIM);
+	}, 1);
+	m_bTrained = true;
+}
+
+void SIFTDescriptorIndex::insert(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors)
+{
+	std::vector<unsigned int> listIndices(numDescriptors);
+	std::vector<unsigned char> codes((size_t)numDescriptors * PQ_NUM_SUBSPACES);
+	ThreadPool::get().parallelFor(0, numDescriptors, [&](unsigned int i) {
+		float d[128];
+		toFloat(descriptors[i], d);
+		listIndices[i] = findNearestCenter(d, m_coarseCenters.data(), m_numLists, 128);
+		for (unsigned int sub = 0; sub < PQ_NUM_SUBSPACES; sub++) {
+			const float* centers = m_pqCenters.data() + sub * PQ_NUM_CENTERS * PQ_SUBSPACE_DIM;
+			codes[i * PQ_NUM_SUBSPACES + sub] = (unsigned char)findNearestCenter(d + sub * PQ_SUBSPACE_DIM, centers, PQ_NUM_CENTERS, PQ_SUBSPACE_DIM);
+		}
+	}, DESC_TILE);
+
+	for (unsigned int i = 0; i < numDescriptors; i++) {
+		InvertedList& list = m_lists[listIndices[i]];
+		list.imageIndices.push_back(imageIdx);
+		list.codes.insert(list.codes.end(), codes.begin() + i * PQ_NUM_SUBSPACES, codes.begin() + (i + 1) * PQ_NUM_SUBSPACES);
+	}
+	m_numDescriptors += numDescriptors;
+}
+
+bool SIFTDescriptorIndex::queryImageVotes(const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors, unsigned int numNeighbors, float distmax, std::vector<unsigned int>& votes) const
+{
+	votes.assign(m_containsImage.size(), 0);
+	if (!m_bTrained) return false;
+	numNeighbors = std::min(std::max(numNeighbors, 1u), MAX_NEIGHBORS);
+
+	//angle between unit descriptors -> squared distance of the descriptors (normalized to 512)
+	const float maxDistSq = 2.0f * 512.0f * 512.0f * (1.0f - std::cos(std::min(distmax, 3.14159265f)));
+
+	std::vector<unsigned int> neighborImages((size_t)numDescriptors * numNeighbors, (unsigned int)-1);
+	ThreadPool::get().parallelFor(0, numDescriptors, [&](unsigned int i) {
+		float q[128];
+		toFloat(descriptors[i], q);
+
+		//numProbes nearest coarse cells
+		std::vector<std::pair<float, unsigned int>> cells(m_numLists);
+		for (unsigned int c = 0; c < m_numLists; c++) cells[c] = std::make_pair(distanceSq(q, m_coarseCenters.data() + c * 128, 128), c);
+		std::partial_sort(cells.begin(), cells.begin() + m_numProbes, cells.end());
+
+		//asymmetric distance table: query sub-vector to every PQ center
+		float table[PQ_NUM_SUBSPACES * PQ_NUM_CENTERS];
+		for (unsigned int sub = 0; sub < PQ_NUM_SUBSPACES; sub++) {
+			const float* centers = m_pqCenters.data() + sub * PQ_NUM_CENTERS * PQ_SUBSPACE_DIM;
+			for (unsigned int c = 0; c < PQ_NUM_CENTERS; c++)
+				table[sub * PQ_NUM_CENTERS + c] = distanceSq(q + sub * PQ_SUBSPACE_DIM, centers + c * PQ_SUBSPACE_DIM, PQ_SUBSPACE_DIM);
+		}
+
+		Neighbor nn[MAX_NEIGHBORS];
+		unsigned int numNN = 0;
+		for (unsigned int p = 0; p < m_numProbes; p++) {
+			const InvertedList& list = m_lists[cells[p].second];
+			const unsigned char* code = list.codes.data();
+			for (size_t e = 0; e < list.imageIndices.size(); e++, code += PQ_NUM_SUBSPACES) {
+				float d = 0.0f;
+				for (unsigned int sub = 0; sub < PQ_NUM_SUBSPACES; sub++) d += table[sub * PQ_NUM_CENTERS + code[sub]];
+				if (d >= maxDistSq || (numNN == numNeighbors && d >= nn[numNN - 1].dist)) continue;
+				//sorted insert
+				unsigned int k = numNN < numNeighbors ? numNN++ : numNN - 1;
+				while (k > 0 && nn[k - 1].dist > d) { nn[k] = nn[k - 1]; k--; }
+				nn[k].dist = d;
+				nn[k].imageIdx = list.imageIndices[e];
+			}
+		}
+		for (unsigned int k = 0; k < numNN; k++) neighborImages[(size_t)i * numNeighbors + k] = nn[k].imageIdx;
+	}, DESC_TILE);
+
+	//one vote per (query descriptor, image)
+	for (unsigned int i = 0; i < numDescriptors; i++) {
+		const unsigned int* imgs = neighborImages.data() + (size_t)i * numNeighbors;
+		for (unsigned int k = 0; k < numNeighbors && imgs[k] != (unsigned int)-1; k++) {
+			bool counted = false;
+			for (unsigned int j = 0; j < k; j++) if (imgs[j] == imgs[k]) { counted = true; break; }
+			if (!counted) votes[imgs[k]]++;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef SIFT_DESCRIPTOR_INDEX_H
+#define SIFT_DESCRIPTOR_INDEX_H
+
+#include <vector>
+
+#include "SIFTImageRetrieval.h"
+
+//! persistent approximate nearest neighbor index over the SIFT descriptors of all (global) frames: inverted file over a coarse
+//! k-means quantizer, descriptors stored as 16 byte product quantization codes (IVF-PQ, asymmetric distances).
+//! both codebooks are trained on the first numTrainingImages added images; before that, queries return false.
+//! a query visits numProbes of the numLists inverted lists per descriptor, i.e. its cost grows with (#descriptors / numLists)
+class SIFTDescriptorIndex : public SIFTImageRetrieval
+{
+public:
+	SIFTDescriptorIndex(unsigned int numLists, unsigned int numProbes, unsigned int numTrainingImages);
+	~SIFTDescriptorIndex();
+
+	//! removes all images and the trained codebooks
+	void reset();
+
+	unsigned int getNumDescriptors() const { return m_numDescriptors; }
+
+	//! every query descriptor votes once for each image among its numNeighbors approximate nearest neighbors within distmax
+	//! (angle as in SiftMatchGPU::GetSiftMatch); votes[imageIdx] is the number of query descriptors voting for the image.
+	//! returns false (and no votes) if the index is not trained yet
+	bool queryImageVotes(const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors, unsigned int numNeighbors, float distmax, std::vector<unsigned int>& votes) const;
+
+	static const unsigned int MAX_NEIGHBORS = 16;
+
+private:
+	static const unsigned int PQ_NUM_SUBSPACES = 16;
+	static const unsigned int PQ_SUBSPACE_DIM = 8;
+	static const unsigned int PQ_NUM_CENTERS = 256;
+
+	struct InvertedList {
+		std::vector<unsigned int>	imageIndices;
+		std::vector<unsigned char>	codes;			//PQ_NUM_SUBSPACES per descriptor
+	};
+
+	void train();
+	void insert(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors);
+
+	unsigned int					m_numLists;
+	unsigned int					m_numProbes;
+
+	std::vector<float>				m_coarseCenters;	//numLists x 128
+	std::vector<float>				m_pqCenters;		//[subspace][center][PQ_SUBSPACE_DIM]
+	std::vector<InvertedList>		m_lists;
+	unsigned int					m_numDescriptors;
+};
+
+#endif //SIFT_DESCRIPTOR_INDEX_H
@@ -271,6 +271,56 @@ void SIFTImageManager::loadFromFile(const std::string& s)
 	in.close();
 }
 
+void SIFTImageManager::getImages(unsigned int firstImage, std::vector<unsigned int>& numKeyPointsPerImage, std::vector<SIFTKeyPoint>& keyPoints, std::vector<SIFTKeyPointDesc>& keyPointDescs) const
+{
+	MLIB_ASSERT(firstImage <= getNumImages());
+	numKeyPointsPerImage.assign(m_numKeyPointsPerImage.begin() + firstImage, m_numKeyPointsPerImage.end());
+	const unsigned int keyOffset = firstImage < getNumImages() ? m_numKeyPointsPerImagePrefixSum[firstImage] : m_numKeyPoints;
+	keyPoints.resize(m_numKeyPoints - keyOffset);
+	keyPointDescs.resize(m_numKeyPoints - keyOffset);
+	if (keyPoints.empty()) return;
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(keyPoints.data(), d_keyPoints + keyOffset, sizeof(SIFTKeyPoint)*keyPoints.size(), cudaMemcpyDeviceToHost));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(keyPointDescs.data(), d_keyPointDescs + keyOffset, sizeof(SIFTKeyPointDesc)*keyPointDescs.size(), cudaMemcpyDeviceToHost));
+}
+
+void SIFTImageManager::addImages(const std::vector<unsigned int>& numKeyPointsPerImage, const std::vector<SIFTKeyPoint>& keyPoints, const std::vector<SIFTKeyPointDesc>& keyPointDescs)
+{
+	MLIB_ASSERT(keyPoints.size() == keyPointDescs.size());
+	MLIB_ASSERT(getNumImages() + numKeyPointsPerImage.size() <= m_maxNumImages);
+	if (!keyPoints.empty()) {
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_keyPoints + m_numKeyPoints, keyPoints.data(), sizeof(SIFTKeyPoint)*keyPoints.size(), cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_keyPointDescs + m_numKeyPoints, keyPointDescs.data(), sizeof(SIFTKeyPointDesc)*keyPointDescs.size(), cudaMemcpyHostToDevice));
+	}
+	size_t numKeys = 0;
+	for (unsigned int i = 0; i < numKeyPointsPerImage.size(); i++) {
+		createSIFTImageGPU();
+		finalizeSIFTImageGPU(numKeyPointsPerImage[i]);
+		numKeys += numKeyPointsPerImage[i];
+	}
+	if (numKeys != keyPoints.size()) throw MLIB_EXCEPTION("inconsistent key point counts");
+}
+
+void SIFTImageManager::getGlobalCorrespondences(std::vector<EntryJ>& correspondences, std::vector<uint2>& keyPointIndices) const
+{
+	correspondences.resize(m_globNumResiduals);
+	keyPointIndices.resize(m_globNumResiduals);
+	if (m_globNumResiduals == 0) return;
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(correspondences.data(), d_globMatches, sizeof(EntryJ)*m_globNumResiduals, cudaMemcpyDeviceToHost));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(keyPointIndices.data(), d_globMatchesKeyPointIndices, sizeof(uint2)*m_globNumResiduals, cudaMemcpyDeviceToHost));
+}
+
+void SIFTImageManager::setGlobalCorrespondences(const std::vector<EntryJ>& correspondences, const std::vector<uint2>& keyPointIndices)
+{
+	MLIB_ASSERT(correspondences.size() == keyPointIndices.size());
+	MLIB_ASSERT(correspondences.size() <= MAX_MATCHES_PER_IMAGE_PAIR_FILTERED * (m_maxNumImages*(m_maxNumImages - 1)) / 2);
+	m_globNumResiduals = (unsigned int)correspondences.size();
+	if (m_globNumResiduals > 0) {
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_globMatches, correspondences.data(), sizeof(EntryJ)*m_globNumResiduals, cudaMemcpyHostToDevice));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_globMatchesKeyPointIndices, keyPointIndices.data(), sizeof(uint2)*m_globNumResiduals, cudaMemcpyHostToDevice));
+	}
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(d_globNumResiduals, &m_globNumResiduals, sizeof(unsigned int), cudaMemcpyHostToDevice));
+}
+
 void SIFTImageManager::alloc()
 {
 	m_numKeyPoints = 0;
@@ -3,7 +3,6 @@
 #include "cudaUtil.h"
 #include "CUDATimer.h"
 #include "cuda_kabsch.h"
-#include "cuda_svd3.h"
 #include "cuda_surfaceArea.h"
 
 #define SORT_NUM_BLOCK_THREADS_X (MAX_MATCHES_PER_IMAGE_PAIR_RAW / 2)
@@ -414,30 +413,18 @@ void SIFTImageManager::FilterMatchesBySurfaceAreaCU(unsigned int curFrame, unsig
 
 #define FILTER_DENSE_VERIFY_THREAD_SPLIT 32
 
-#ifdef CUDACACHE_FLOAT_NORMALS
+//the images are CUDACachedFrame views (CUDACacheUtil.h), normals are float4 (MINF if invalid)
+template<class DepthT, class CamPosT, class NormalT, class ColorT>
 __device__ float3 computeProjError(unsigned int idx, unsigned int imageWidth, unsigned int imageHeight,
 	float distThresh, float normalThresh, float colorThresh, const float4x4& transform, const float4x4& intrinsics,
-	const float* d_inputDepth, const float4* d_inputCamPos, const float4* d_inputNormal, const float* d_inputColor,
-	const float* d_modelDepth, const float4* d_modelCamPos, const float4* d_modelNormal, const float* d_modelColor,
+	const DepthT& d_inputDepth, const CamPosT& d_inputCamPos, const NormalT& d_inputNormal, const ColorT& d_inputColor,
+	const DepthT& d_modelDepth, const CamPosT& d_modelCamPos, const NormalT& d_modelNormal, const ColorT& d_modelColor,
 	float sensorDepthMin, float sensorDepthMax)
-#elif defined(CUDACACHE_UCHAR_NORMALS)
-__device__ float3 computeProjError(unsigned int idx, unsigned int imageWidth, unsigned int imageHeight,
-	float distThresh, float normalThresh, float colorThresh, const float4x4& transform, const float4x4& intrinsics,
-	const float* d_inputDepth, const float4* d_inputCamPos, const uchar4* d_inputNormal, const float* d_inputColor,
-	const float* d_modelDepth, const float4* d_modelCamPos, const uchar4* d_modelNormal, const float* d_modelColor,
-	float sensorDepthMin, float sensorDepthMax)
-#endif
 {
 	float3 out = make_float3(0.0f);
 
 	float4 pInput = d_inputCamPos[idx]; // point
-#ifdef CUDACACHE_FLOAT_NORMALS
 	float4 nInput = d_inputNormal[idx]; nInput.w = 0.0f; // vector
-#else
-	float4 nInput = make_float4(MINF);
-	uchar4 nInputU4 = d_inputNormal[idx];
-	if (*(int*)(&nInputU4) != 0) nInput = make_float4(make_float3(nInputU4.x, nInputU4.y, nInputU4.z) / 255.0f * 2.0f - 1.0f, 0.0f);  // vector
-#endif
 	float dInput = d_inputDepth[idx];
 	//float cInput = d_inputColor[idx];
 
@@ -451,13 +438,7 @@ __device__ float3 computeProjError(unsigned int idx, unsigned int imageWidth, un
 		if (screenPos.x >= 0 && screenPos.y >= 0 && screenPos.x < (int)imageWidth && screenPos.y < (int)imageHeight) {
 			float4 pTarget = d_modelCamPos[screenPos.y * imageWidth + screenPos.x]; //getBestCorrespondence1x1
 			//float cTarget = d_modelColor[screenPos.y * imageWidth + screenPos.x];
-#ifdef CUDACACHE_FLOAT_NORMALS
 			float4 nTarget = d_modelNormal[screenPos.y * imageWidth + screenPos.x];
-#else
-			float4 nTarget = make_float4(MINF);
-			uchar4 nTargetU4 = d_modelNormal[idx];
-			if (*(int*)(&nTargetU4) != 0) nTarget = make_float4(make_float3(nTargetU4.x, nTargetU4.y, nTargetU4.z) / 255.0f * 2.0f - 1.0f, 0.0f);  // vector
-#endif
 			if (pTarget.x != MINF && nTarget.x != MINF) {
 				float d = length(pTransInput - pTarget);
 				float dNormal = dot(make_float3(nTransInput.x, nTransInput.y, nTransInput.z), make_float3(nTarget.x, nTarget.y, nTarget.z)); // should be able to do dot(nTransInput, nTarget)
@@ -500,21 +481,18 @@ void __global__ FilterMatchesByDenseVerifyCU_Kernel(unsigned int curImageIdx, un
 		return;
 	}
 
-	const float*  d_inputDepth = d_cachedFrames[imagePairIdx].d_depthDownsampled;
-	const float4* d_inputCamPos = d_cachedFrames[imagePairIdx].d_cameraposDownsampled;
-	const float* d_inputColor = d_cachedFrames[imagePairIdx].d_intensityDownsampled;
+	const CUDACachedFrame& inputFrame = d_cachedFrames[imagePairIdx];
+	const CUDACachedFrame& modelFrame = d_cachedFrames[curImageIdx];
+	const CUDACachedFloatView d_inputDepth = inputFrame.getDepth();
+	const CUDACachedCameraPosView d_inputCamPos = inputFrame.getCameraPos();
+	const CUDACachedFloatView d_inputColor = inputFrame.getIntensity();
 
-	const float*  d_modelDepth = d_cachedFrames[curImageIdx].d_depthDownsampled;
-	const float4* d_modelCamPos = d_cachedFrames[curImageIdx].d_cameraposDownsampled;
-	const float* d_modelColor = d_cachedFrames[curImageIdx].d_intensityDownsampled;
+	const CUDACachedFloatView d_modelDepth = modelFrame.getDepth();
+	const CUDACachedCameraPosView d_modelCamPos = modelFrame.getCameraPos();
+	const CUDACachedFloatView d_modelColor = modelFrame.getIntensity();
 	//TODO HERE ANGIE
-#ifdef CUDACACHE_FLOAT_NORMALS
-	const float4* d_inputNormal = d_cachedFrames[imagePairIdx].d_normalsDownsampled;
-	const float4* d_modelNormal = d_cachedFrames[curImageIdx].d_normalsDownsampled;
-#elif defined(CUDACACHE_UCHAR_NORMALS)
-	const uchar4* d_inputNormal = d_cachedFrames[imagePairIdx].d_normalsDownsampledUCHAR4;
-	const uchar4* d_modelNormal = d_cachedFrames[curImageIdx].d_normalsDownsampledUCHAR4;
-#endif
+	const CUDACachedNormalView d_inputNormal = inputFrame.getNormals();
+	const CUDACachedNormalView d_modelNormal = modelFrame.getNormals();
 	const float4x4 transform = d_currFilteredTransforms[imagePairIdx];
 
 
@@ -959,11 +937,11 @@ void __global__ TestSVDDebugCU_Kernel(float3x3* d_m, float3x3* d_u, float3x3* d_
 	float3x3 u, s, v;
 	s.setZero();
 	v.setZero();
-	//SVD::decompose3x3((float*)&m, (float*)&s, (float*)&v);
+	float sv[3];
 	for (unsigned int i = 0; i < 100; i++) {
-		SVD::svd(m, u, s, v);
+		KabschSVD::svd<float>((const float*)&m, (float*)&u, sv, (float*)&v);
 	}
-	//svd(m, u, s, v);
+	s(0, 0) = sv[0]; s(1, 1) = sv[1]; s(2, 2) = sv[2];
 
 	d_u[0] = u;
 	d_s[0] = s;
@@ -1045,22 +1023,18 @@ void __global__ VerifyTrajectoryCU_Kernel(unsigned int numImages, int* d_validIm
 	if (img0 >= img1) return;
 	if (d_validImages[img0] == 0 || d_validImages[img1] == 0) return; // invalid image
 
-	const float*  d_inputDepth = d_cachedFrames[img0].d_depthDownsampled;
-	const float4* d_inputCamPos = d_cachedFrames[img0].d_cameraposDownsampled;
-	const float* d_inputColor = d_cachedFrames[img0].d_intensityDownsampled;
-
-	const float*  d_modelDepth = d_cachedFrames[img1].d_depthDownsampled;
-	const float4* d_modelCamPos = d_cachedFrames[img1].d_cameraposDownsampled;
-	const float* d_modelColor = d_cachedFrames[img1].d_intensityDownsampled;
+	const CUDACachedFrame& inputFrame = d_cachedFrames[img0];
+	const CUDACachedFrame& modelFrame = d_cachedFrames[img1];
+	const CUDACachedFloatView d_inputDepth = inputFrame.getDepth();
+	const CUDACachedCameraPosView d_inputCamPos = inputFrame.getCameraPos();
+	const CUDACachedFloatView d_inputColor = inputFrame.getIntensity();
 
+	const CUDACachedFloatView d_modelDepth = modelFrame.getDepth();
+	const CUDACachedCameraPosView d_modelCamPos = modelFrame.getCameraPos();
+	const CUDACachedFloatView d_modelColor = modelFrame.getIntensity();
 	//TODO HERE ANGIE
-#ifdef CUDACACHE_FLOAT_NORMALS
-	const float4* d_inputNormal = d_cachedFrames[img0].d_normalsDownsampled;
-	const float4* d_modelNormal = d_cachedFrames[img1].d_normalsDownsampled;
-#elif defined(CUDACACHE_UCHAR_NORMALS)
-	const uchar4* d_inputNormal = d_cachedFrames[img0].d_normalsDownsampledUCHAR4;
-	const uchar4* d_modelNormal = d_cachedFrames[img1].d_normalsDownsampledUCHAR4;
-#endif
+	const CUDACachedNormalView d_inputNormal = inputFrame.getNormals();
+	const CUDACachedNormalView d_modelNormal = modelFrame.getNormals();
 
 	const float4x4 transform = d_trajectory[img1].getInverse() * d_trajectory[img0];
 
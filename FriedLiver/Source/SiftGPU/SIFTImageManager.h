@@ -80,6 +80,7 @@ public:
 
 	unsigned int getNumKeyPointsPerImage(unsigned int imageIdx) const;
 	unsigned int getMaxNumKeyPointsPerImage() const { return m_maxKeyPointsPerImage; }
+	unsigned int getMaxNumImages() const { return m_maxNumImages; }
 
 	SIFTImageGPU& createSIFTImageGPU();
 
@@ -230,7 +231,7 @@ public:
 		matchDistances.resize(numMatches);
 		if (numMatches > 0) {
 			MLIB_CUDA_SAFE_CALL(cudaMemcpy(keyPointIndices.data(), d_currFilteredMatchKeyPointIndices + imagePairIndex * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, sizeof(uint2) * numMatches, cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(matchDistances.data(), d_currFilteredMatchKeyPointIndices + imagePairIndex * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, sizeof(float) * numMatches, cudaMemcpyDeviceToHost));
+			MLIB_CUDA_SAFE_CALL(cudaMemcpy(matchDistances.data(), d_currFilteredMatchDistances + imagePairIndex * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, sizeof(float) * numMatches, cudaMemcpyDeviceToHost));
 		}
 	}
 	void getCurrMatchKeyPointIndicesDEBUG(std::vector<uint2>& keyPointIndices, std::vector<unsigned int>& numMatches, bool filtered) const
@@ -272,6 +273,21 @@ public:
 	unsigned int getCurrentFrame() const { return m_currentImage; }
 	void setCurrentFrame(unsigned int idx) { m_currentImage = idx; }
 
+	// ------- checkpoints (OnlineBundler session checkpoints)
+	//! key points and descriptors of the images [firstImage, getNumImages()); they are stored linearly, so this is a single download
+	void getImages(unsigned int firstImage, std::vector<unsigned int>& numKeyPointsPerImage, std::vector<SIFTKeyPoint>& keyPoints, std::vector<SIFTKeyPointDesc>& keyPointDescs) const;
+	//! appends images in the layout of getImages
+	void addImages(const std::vector<unsigned int>& numKeyPointsPerImage, const std::vector<SIFTKeyPoint>& keyPoints, const std::vector<SIFTKeyPointDesc>& keyPointDescs);
+	void getGlobalCorrespondences(std::vector<EntryJ>& correspondences, std::vector<uint2>& keyPointIndices) const;
+	void setGlobalCorrespondences(const std::vector<EntryJ>& correspondences, const std::vector<uint2>& keyPointIndices);
+	void setValidImages(const std::vector<int>& valid) {
+		m_validImages = valid;
+		m_validImages.resize(m_maxNumImages, 0);
+		updateGPUValidImages();
+	}
+	const std::list<unsigned int>& getRetryList() const { return m_imagesToRetry; }
+	void setRetryList(const std::list<unsigned int>& retryList) { m_imagesToRetry = retryList; }
+
 	static void TestSVDDebugCU(const float3x3& m);
 
 	void saveToFile(const std::string& s);
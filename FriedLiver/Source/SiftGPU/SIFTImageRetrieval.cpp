@@ -0,0 +1,112 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+
+#include "SIFTImageRetrieval.h"
+#include "../ThreadPool.h"
+
+SIFTImageRetrieval::SIFTImageRetrieval(unsigned int numTrainingImages)
+{
+	m_numTrainingImages = std::max(numTrainingImages, 1u);
+	m_bTrained = false;
+}
+
+SIFTImageRetrieval::~SIFTImageRetrieval()
+{
+}
+
+void SIFTImageRetrieval::resetImages()
+{
+	m_bTrained = false;
+	m_containsImage.clear();
+	m_trainingImageIndices.clear();
+	m_trainingDescriptors.clear();
+}
+
+void SIFTImageRetrieval::addImage(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors)
+{
+	if (containsImage(imageIdx)) return;
+	if (imageIdx >= m_containsImage.size()) m_containsImage.resize(imageIdx + 1, 0);
+	m_containsImage[imageIdx] = 1;
+
+	if (m_bTrained) {
+		insert(imageIdx, descriptors, numDescriptors);
+		return;
+	}
+	m_trainingImageIndices.push_back(imageIdx);
+	m_trainingDescriptors.push_back(std::vector<SIFTKeyPointDesc>(descriptors, descriptors + numDescriptors));
+	if (m_trainingImageIndices.size() >= m_numTrainingImages) {
+		train();
+		if (!m_bTrained) return; //no descriptors yet, keep buffering
+		for (unsigned int i = 0; i < m_trainingImageIndices.size(); i++)
+			insert(m_trainingImageIndices[i], m_trainingDescriptors[i].data(), (unsigned int)m_trainingDescriptors[i].size());
+		m_trainingImageIndices.clear();
+		m_trainingDescriptors.clear();
+	}
+}
+
+unsigned int SIFTImageRetrieval::sampleTrainingDescriptors(unsigned int maxNumSamples, std::vector<float>& samples) const
+{
+	unsigned int numTotal = 0;
+	for (const auto& d : m_trainingDescriptors) numTotal += (unsigned int)d.size();
+	const unsigned int numSamples = std::min(numTotal, maxNumSamples);
+	samples.resize((size_t)numSamples * 128);
+	unsigned int img = 0, offset = 0;
+	for (unsigned int s = 0; s < numSamples; s++) {
+		unsigned int idx = (unsigned int)((unsigned long long)s * numTotal / numSamples);
+		while (idx - offset >= m_trainingDescriptors[img].size()) { offset += (unsigned int)m_trainingDescriptors[img].size(); img++; }
+		toFloat(m_trainingDescriptors[img][idx - offset], samples.data() + (size_t)s * 128);
+	}
+	return numSamples;
+}
+
+unsigned int SIFTImageRetrieval::findNearestCenter(const float* point, const float* centers, unsigned int numCenters, unsigned int dim, float* distSq)
+{
+	unsigned int best = 0;
+	float bestDist = distanceSq(point, centers, dim);
+	for (unsigned int c = 1; c < numCenters; c++) {
+		const float d = distanceSq(point, centers + c * dim, dim);
+		if (d < bestDist) { bestDist = d; best = c; }
+	}
+	if (distSq) *distSq = bestDist;
+	return best;
+}
+
+void SIFTImageRetrieval::kMeans(const float* points, unsigned int numPoints, unsigned int dim, unsigned int k, unsigned int numIterations, std::vector<float>& centers)
+{
+	k = std::min(k, numPoints);
+	centers.resize(k * dim);
+	if (k == 0) return;
+	for (unsigned int c = 0; c < k; c++) {
+		const float* p = points + (size_t)((unsigned long long)c * numPoints / k) * dim;
+		std::copy(p, p + dim, centers.begin() + c * dim);
+	}
+
+	std::vector<unsigned int> assignment(numPoints);
+	std::vector<double> sums(k * dim);
+	std::vector<unsigned int> counts(k);
+	for (unsigned int it = 0; it < numIterations; it++) {
+		ThreadPool::get().parallelFor(0, numPoints, [&](unsigned int i) {
+			assignment[i] = findNearestCenter(points + (size_t)i * dim, centers.data(), k, dim);
+		}, 64);
+
+		std::fill(sums.begin(), sums.end(), 0.0);
+		std::fill(counts.begin(), counts.end(), 0u);
+		for (unsigned int i = 0; i < numPoints; i++) {
+			const unsigned int c = assignment[i];
+			const float* p = points + (size_t)i * dim;
+			for (unsigned int d = 0; d < dim; d++) sums[c * dim + d] += p[d];
+			counts[c]++;
+		}
+		for (unsigned int c = 0; c < k; c++) {
+			if (counts[c] > 0) {
+				for (unsigned int d = 0; d < dim; d++) centers[c * dim + d] = (float)(sums[c * dim + d] / counts[c]);
+			}
+			else { //empty cluster: restart at a point that moves with the iteration
+				const float* p = points + (size_t)(((unsigned long long)c * numPoints / k + it + 1) % numPoints) * dim;
+				std::copy(p, p + dim, centers.begin() + c * dim);
+			}
+		}
+	}
+}
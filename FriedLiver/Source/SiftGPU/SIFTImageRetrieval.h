@@ -0,0 +1,60 @@
+#pragma once
+#ifndef SIFT_IMAGE_RETRIEVAL_H
+#define SIFT_IMAGE_RETRIEVAL_H
+
+#include <vector>
+
+#include "SIFTImageManager.h"
+
+//! common part of the global match candidate retrieval structures (SIFTDescriptorIndex, SIFTVocabularyTree): added images are buffered until
+//! numTrainingImages are there, train() builds the codebooks from them and all buffered images are inserted; later images are inserted directly.
+//! also holds the k-means both codebooks are built with
+class SIFTImageRetrieval
+{
+public:
+	virtual ~SIFTImageRetrieval();
+
+	bool isTrained() const { return m_bTrained; }
+	bool containsImage(unsigned int imageIdx) const { return imageIdx < m_containsImage.size() && m_containsImage[imageIdx] != 0; }
+
+	//! descriptors in host memory; images are buffered until training succeeded
+	void addImage(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors);
+
+	//! lloyd iterations on numPoints x dim points, initialized with evenly strided points; centers is k x dim (k is clamped to numPoints)
+	static void kMeans(const float* points, unsigned int numPoints, unsigned int dim, unsigned int k, unsigned int numIterations, std::vector<float>& centers);
+	//! index of the nearest of the numCenters centers (squared euclidean distance)
+	static unsigned int findNearestCenter(const float* point, const float* centers, unsigned int numCenters, unsigned int dim, float* distSq = NULL);
+
+protected:
+	SIFTImageRetrieval(unsigned int numTrainingImages);
+
+	//! builds the codebooks from the buffered images and sets m_bTrained; may leave it unset (e.g. no descriptors yet) to keep buffering
+	virtual void train() = 0;
+	virtual void insert(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors) = 0;
+
+	//! removes all images (buffered or inserted) and clears m_bTrained
+	void resetImages();
+	//! evenly strided subset of at most maxNumSamples buffered descriptors, 128 floats each; returns the number of samples
+	unsigned int sampleTrainingDescriptors(unsigned int maxNumSamples, std::vector<float>& samples) const;
+
+	static inline float distanceSq(const float* a, const float* b, unsigned int dim) {
+		float d = 0.0f;
+		for (unsigned int i = 0; i < dim; i++) {
+			const float x = a[i] - b[i];
+			d += x * x;
+		}
+		return d;
+	}
+	static inline void toFloat(const SIFTKeyPointDesc& desc, float* out) {
+		for (unsigned int i = 0; i < 128; i++) out[i] = (float)desc.feature[i];
+	}
+
+	unsigned int					m_numTrainingImages;
+	bool							m_bTrained;
+	std::vector<char>				m_containsImage;
+
+	std::vector<unsigned int>					m_trainingImageIndices;
+	std::vector<std::vector<SIFTKeyPointDesc>>	m_trainingDescriptors;
+};
+
+#endif //SIFT_IMAGE_RETRIEVAL_H
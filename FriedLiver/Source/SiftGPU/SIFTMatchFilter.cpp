@@ -1,9 +1,28 @@
 #include "stdafx.h"
 #include "SIFTMatchFilter.h"
 
+#include <atomic>
+
 #include "cuda_kabschReference.h"
+#include "KabschBatch.h"
 //#include "cuda_kabsch.h"
 #include "../GlobalBundlingState.h"
+#include "../ThreadPool.h"
+
+namespace {
+
+	//combinations per parallel RANSAC task
+	const unsigned int RANSAC_HYPOTHESES_PER_TASK = 64;
+
+	struct RansacHypothesis {
+		RansacHypothesis() : numInliers(0), maxResidual(std::numeric_limits<float>::infinity()) {}
+		bool isWorseThan(unsigned int n, float res) const { return n > numInliers || (n == numInliers && res < maxResidual); }
+
+		unsigned int numInliers;
+		float maxResidual;
+		std::vector<unsigned int> indices;
+	};
+}
 
 std::vector<std::vector<unsigned int>> SIFTMatchFilter::s_combinations;
 bool SIFTMatchFilter::s_bInit;
@@ -94,6 +113,108 @@ unsigned int SIFTMatchFilter::filterImagePairKeyPointMatches(const std::vector<S
 	return numRef;
 }
 
+void SIFTMatchFilter::filterKeyPointMatchesCPU(SIFTImageManager* siftManager, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames,
+	const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxKabschRes2)
+{
+	filterImagePairsCPU(siftManager, curFrame, startFrame, numFrames, false,
+		[&](unsigned int prevFrame, const std::vector<SIFTKeyPoint>& keyPoints, uint2* keyPointIndices, float* distances, unsigned int numRawMatches, float4x4& transform) {
+		return filterKeyPointMatchesReference(keyPoints.data(), keyPointIndices, distances, numRawMatches, transform,
+			siftIntrinsicsInv, minNumMatches, maxKabschRes2, false);
+	});
+}
+
+void SIFTMatchFilter::filterImagePairsCPU(SIFTImageManager* siftManager, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames, bool bSerial,
+	const ImagePairFilter& filterImagePair)
+{
+	if (numFrames <= startFrame) return;
+	const unsigned int numPairs = numFrames - startFrame;
+
+	// counts first (like FilterKeyPointMatchesCU_Kernel, pairs without raw matches only get their count reset, the current frame is left untouched)
+	std::vector<int> numMatches(numPairs);
+	std::vector<int> numFilteredMatches(numPairs);
+	cutilSafeCall(cudaMemcpy(numMatches.data(), siftManager->d_currNumMatchesPerImagePair + startFrame, sizeof(int) * numPairs, cudaMemcpyDeviceToHost));
+	cutilSafeCall(cudaMemcpy(numFilteredMatches.data(), siftManager->d_currNumFilteredMatchesPerImagePair + startFrame, sizeof(int) * numPairs, cudaMemcpyDeviceToHost));
+	std::vector<unsigned int> pairs; // previous image of each pair to filter
+	for (unsigned int p = 0; p < numPairs; p++) {
+		if (startFrame + p == curFrame) continue;
+		if (numMatches[p] <= 0) numFilteredMatches[p] = 0;
+		else pairs.push_back(startFrame + p);
+	}
+	if (pairs.empty()) {
+		cutilSafeCall(cudaMemcpy(siftManager->d_currNumFilteredMatchesPerImagePair + startFrame, numFilteredMatches.data(), sizeof(int) * numPairs, cudaMemcpyHostToDevice));
+		return;
+	}
+
+	// only the raw matches of these pairs and the key points of the images involved; the key points are stored compactly (current image first)
+	const std::vector<unsigned int>& keyPointOffsets = siftManager->m_numKeyPointsPerImagePrefixSum;
+	std::vector<unsigned int> localKeyPointOffsets(pairs.size());
+	unsigned int numLocalKeyPoints = siftManager->getNumKeyPointsPerImage(curFrame);
+	for (unsigned int k = 0; k < pairs.size(); k++) {
+		localKeyPointOffsets[k] = numLocalKeyPoints;
+		numLocalKeyPoints += siftManager->getNumKeyPointsPerImage(pairs[k]);
+	}
+	std::vector<SIFTKeyPoint> keyPoints(numLocalKeyPoints);
+	cutilSafeCall(cudaMemcpy(keyPoints.data(), siftManager->d_keyPoints + keyPointOffsets[curFrame], sizeof(SIFTKeyPoint) * siftManager->getNumKeyPointsPerImage(curFrame), cudaMemcpyDeviceToHost));
+	std::vector<float> matchDistances(pairs.size() * MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	std::vector<uint2> matchKeyPointIndices(pairs.size() * MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	for (unsigned int k = 0; k < pairs.size(); k++) {
+		const unsigned int i = pairs[k];
+		const unsigned int numRawMatches = std::min((unsigned int)MAX_MATCHES_PER_IMAGE_PAIR_RAW, (unsigned int)numMatches[i - startFrame]);
+		cutilSafeCall(cudaMemcpy(keyPoints.data() + localKeyPointOffsets[k], siftManager->d_keyPoints + keyPointOffsets[i], sizeof(SIFTKeyPoint) * siftManager->getNumKeyPointsPerImage(i), cudaMemcpyDeviceToHost));
+		cutilSafeCall(cudaMemcpy(matchDistances.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_RAW, siftManager->d_currMatchDistances + i * MAX_MATCHES_PER_IMAGE_PAIR_RAW, sizeof(float) * numRawMatches, cudaMemcpyDeviceToHost));
+		cutilSafeCall(cudaMemcpy(matchKeyPointIndices.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_RAW, siftManager->d_currMatchKeyPointIndices + i * MAX_MATCHES_PER_IMAGE_PAIR_RAW, sizeof(uint2) * numRawMatches, cudaMemcpyDeviceToHost));
+	}
+
+	std::vector<float> filteredMatchDistances(pairs.size() * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED);
+	std::vector<uint2> filteredMatchKeyPointIndices(pairs.size() * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED);
+	std::vector<float4x4> transforms(pairs.size());
+	std::vector<float4x4> transformsInv(pairs.size());
+	auto filterPair = [&](unsigned int k) {
+		const unsigned int i = pairs[k];
+		const unsigned int numRawMatches = std::min((unsigned int)MAX_MATCHES_PER_IMAGE_PAIR_RAW, (unsigned int)numMatches[i - startFrame]);
+		uint2* keyPointIndices = matchKeyPointIndices.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_RAW;
+		float* distances = matchDistances.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_RAW;
+
+		// global key point indices -> compact buffer and back (the filter only reorders the matches)
+		const uint2 globalOffset = make_uint2(keyPointOffsets[i], keyPointOffsets[curFrame]);
+		for (unsigned int m = 0; m < numRawMatches; m++)
+			keyPointIndices[m] = make_uint2(keyPointIndices[m].x - globalOffset.x + localKeyPointOffsets[k], keyPointIndices[m].y - globalOffset.y);
+		float4x4 transform;
+		const unsigned int numFiltered = filterImagePair(i, keyPoints, keyPointIndices, distances, numRawMatches, transform);
+		numFilteredMatches[i - startFrame] = numFiltered;
+		transforms[k] = transform;
+		transformsInv[k] = transform.getInverse();
+
+		float* filteredDistances = filteredMatchDistances.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED;
+		uint2* filteredKeyPointIndices = filteredMatchKeyPointIndices.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED;
+		for (unsigned int m = 0; m < MAX_MATCHES_PER_IMAGE_PAIR_FILTERED; m++) {
+			if (m < numFiltered) {
+				filteredDistances[m] = distances[m];
+				filteredKeyPointIndices[m] = make_uint2(keyPointIndices[m].x - localKeyPointOffsets[k] + globalOffset.x, keyPointIndices[m].y + globalOffset.y);
+			}
+			else {
+				filteredDistances[m] = 999.0f;
+				filteredKeyPointIndices[m] = make_uint2((unsigned int)-1, (unsigned int)-1);
+			}
+		}
+	};
+	if (bSerial) {
+		for (unsigned int k = 0; k < pairs.size(); k++) filterPair(k);
+	}
+	else {
+		ThreadPool::get().parallelFor(0, (unsigned int)pairs.size(), filterPair, 1);
+	}
+
+	cutilSafeCall(cudaMemcpy(siftManager->d_currNumFilteredMatchesPerImagePair + startFrame, numFilteredMatches.data(), sizeof(int) * numPairs, cudaMemcpyHostToDevice));
+	for (unsigned int k = 0; k < pairs.size(); k++) {
+		const unsigned int i = pairs[k];
+		cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredMatchDistances + i * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, filteredMatchDistances.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, sizeof(float) * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, cudaMemcpyHostToDevice));
+		cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredMatchKeyPointIndices + i * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, filteredMatchKeyPointIndices.data() + k * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, sizeof(uint2) * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, cudaMemcpyHostToDevice));
+		cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredTransforms + i, transforms.data() + k, sizeof(float4x4), cudaMemcpyHostToDevice));
+		cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredTransformsInv + i, transformsInv.data() + k, sizeof(float4x4), cudaMemcpyHostToDevice));
+	}
+}
+
 void SIFTMatchFilter::filterBySurfaceArea(SIFTImageManager* siftManager, const std::vector<CUDACachedFrame>& cachedFrames,
 	const float4x4& siftIntrinsicsInv, unsigned int minNumMatches)
 {
@@ -108,12 +229,12 @@ void SIFTMatchFilter::filterBySurfaceArea(SIFTImageManager* siftManager, const s
 	std::vector<SIFTKeyPoint> keyPoints;
 	siftManager->getSIFTKeyPointsDEBUG(keyPoints);
 	ml::DepthImage32 curDepth(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curDepth.getData(), cachedFrames[curFrame].d_depthDownsampled, sizeof(float) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
+	cachedFrames[curFrame].download(curDepth.getData(), NULL, NULL, NULL, NULL);
 
 	for (unsigned int i = 0; i < curFrame; i++) { // previous frames
 		// get data
 		ml::DepthImage32 prvDepth(downSampWidth, downSampHeight);
-		cutilSafeCall(cudaMemcpy(prvDepth.getData(), cachedFrames[i].d_depthDownsampled, sizeof(float) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
+		cachedFrames[i].download(prvDepth.getData(), NULL, NULL, NULL, NULL);
 
 		std::vector<uint2> keyPointIndices;
 		siftManager->getFiltKeyPointIndicesDEBUG(i, keyPointIndices);
@@ -198,13 +319,10 @@ void SIFTMatchFilter::filterByDenseVerify(SIFTImageManager* siftManager, const s
 	// current data
 	const unsigned int curFrame = numImages - 1;
 	ml::DepthImage32 curDepth(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curDepth.getData(), cachedFrames[curFrame].d_depthDownsampled, sizeof(float) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR8G8B8A8 curIntensity(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curIntensity.getData(), cachedFrames[curFrame].d_intensityDownsampled, sizeof(uchar4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR32G32B32A32 curCamPos(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curCamPos.getData(), cachedFrames[curFrame].d_cameraposDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR32G32B32A32 curNormals(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curNormals.getData(), cachedFrames[curFrame].d_normalsDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
+	cachedFrames[curFrame].download(curDepth.getData(), (float4*)curCamPos.getData(), (float4*)curNormals.getData(), (float*)curIntensity.getData(), NULL);
 
 	// transforms
 	std::vector<float4x4> transforms(curFrame);
@@ -213,13 +331,10 @@ void SIFTMatchFilter::filterByDenseVerify(SIFTImageManager* siftManager, const s
 	for (unsigned int i = 0; i < curFrame; i++) { // previous frames
 		// get data
 		ml::DepthImage32 prvDepth(downSampWidth, downSampHeight);
-		cutilSafeCall(cudaMemcpy(prvDepth.getData(), cachedFrames[i].d_depthDownsampled, sizeof(float) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 		ml::ColorImageR8G8B8A8 prvIntensity(downSampWidth, downSampHeight);
-		cutilSafeCall(cudaMemcpy(prvIntensity.getData(), cachedFrames[i].d_intensityDownsampled, sizeof(uchar4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 		ml::ColorImageR32G32B32A32 prvCamPos(downSampWidth, downSampHeight);
-		cutilSafeCall(cudaMemcpy(prvCamPos.getData(), cachedFrames[i].d_cameraposDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 		ml::ColorImageR32G32B32A32 prvNormals(downSampWidth, downSampHeight);
-		cutilSafeCall(cudaMemcpy(prvNormals.getData(), cachedFrames[i].d_normalsDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
+		cachedFrames[i].download(prvDepth.getData(), (float4*)prvCamPos.getData(), (float4*)prvNormals.getData(), (float*)prvIntensity.getData(), NULL);
 
 		std::vector<uint2> keyPointIndices;
 		siftManager->getFiltKeyPointIndicesDEBUG(i, keyPointIndices);
@@ -241,6 +356,24 @@ void SIFTMatchFilter::filterByDenseVerify(SIFTImageManager* siftManager, const s
 #endif
 }
 
+void SIFTMatchFilter::filterByDenseVerifyCPU(SIFTImageManager* siftManager, const DenseVerifyCPU* denseVerify, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames,
+	const float4x4& intrinsics, const DenseVerifyCPU::Params& params)
+{
+	if (numFrames <= startFrame) return;
+	const unsigned int numPairs = numFrames - startFrame;
+	std::vector<int> numMatches(numPairs);
+	std::vector<float4x4> transforms(numPairs);
+	cutilSafeCall(cudaMemcpy(numMatches.data(), siftManager->d_currNumFilteredMatchesPerImagePair + startFrame, sizeof(int) * numPairs, cudaMemcpyDeviceToHost));
+	cutilSafeCall(cudaMemcpy(transforms.data(), siftManager->d_currFilteredTransforms + startFrame, sizeof(float4x4) * numPairs, cudaMemcpyDeviceToHost));
+
+	ThreadPool::get().parallelFor(0, numPairs, [&](unsigned int i) {
+		if (startFrame + i == curFrame || numMatches[i] == 0) return;
+		if (!denseVerify->verifyImagePair(startFrame + i, curFrame, transforms[i], intrinsics, params)) numMatches[i] = 0;
+	}, 1);
+
+	cutilSafeCall(cudaMemcpy(siftManager->d_currNumFilteredMatchesPerImagePair + startFrame, numMatches.data(), sizeof(int) * numPairs, cudaMemcpyHostToDevice));
+}
+
 bool SIFTMatchFilter::filterImagePairByDenseVerify(const float* inputDepth, const float4* inputCamPos, const float4* inputNormals, const float* inputColor,
 	const float* modelDepth, const float4* modelCamPos, const float4* modelNormals, const float* modelColor,
 	const float4x4& transform, unsigned int width, unsigned int height, const float4x4& depthIntrinsics, float depthMin, float depthMax)
@@ -359,11 +492,9 @@ void SIFTMatchFilter::computeCorrespondences(unsigned int width, unsigned int he
 
 }
 
-void SIFTMatchFilter::ransacKeyPointMatches(SIFTImageManager* siftManager, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2, bool debugPrint)
+void SIFTMatchFilter::ransacKeyPointMatches(SIFTImageManager* siftManager, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames,
+	const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2, bool debugPrint)
 {
-	const unsigned int numImages = siftManager->getNumImages();
-	if (numImages <= 1) return;
-
 	if (!s_bInit) {
 		std::cout << "warning: initializing combinations" << std::endl;
 		Timer t;
@@ -371,46 +502,22 @@ void SIFTMatchFilter::ransacKeyPointMatches(SIFTImageManager* siftManager, const
 		std::cout << "init: " << t.getElapsedTimeMS() << " ms" << std::endl;
 	}
 
-	// current data
-	const unsigned int curFrame = numImages - 1;
-	std::vector<SIFTKeyPoint> keyPoints;
-	siftManager->getSIFTKeyPointsDEBUG(keyPoints);
-	std::vector<float4x4> transforms(curFrame);
-	std::vector<float4x4> transformsInv(curFrame);
-
-	for (unsigned int i = 0; i < curFrame; i++) { // previous frames
-
-		std::vector<uint2> keyPointIndices;
-		std::vector<float> matchDistances;
-		siftManager->getRawKeyPointIndicesAndMatchDistancesDEBUG(i, keyPointIndices, matchDistances);
-
-		if (debugPrint) std::cout << "(" << i << ", " << curFrame << ")" << std::endl;
-		float4x4 transform;
-		unsigned int newNumMatches =
-			filterImagePairKeyPointMatchesRANSAC(keyPoints, keyPointIndices, matchDistances, transform, siftIntrinsicsInv, minNumMatches,
+	// image pairs in parallel (the hypotheses of each pair are split further); serial if debugging
+	filterImagePairsCPU(siftManager, curFrame, startFrame, numFrames, debugPrint,
+		[&](unsigned int prevFrame, const std::vector<SIFTKeyPoint>& keyPoints, uint2* keyPointIndices, float* distances, unsigned int numRawMatches, float4x4& transform) {
+		if (debugPrint) std::cout << "(" << prevFrame << ", " << curFrame << ")" << std::endl;
+		std::vector<uint2> indices(keyPointIndices, keyPointIndices + numRawMatches);
+		std::vector<float> matchDistances(distances, distances + numRawMatches);
+		const unsigned int numFiltered =
+			filterImagePairKeyPointMatchesRANSAC(keyPoints, indices, matchDistances, transform, siftIntrinsicsInv, minNumMatches,
 			maxResThresh2, (unsigned int)s_combinations[0].size(), s_combinations, debugPrint);
-
-		if (newNumMatches > 0) {
-			transforms[i] = transform;
-			transformsInv[i] = transform.getInverse();
-		}
-		else {
-			transforms[i].setValue(0.0f);
-			transformsInv[i].setValue(0.0f);
-		}
-
-		// copy back
-		cutilSafeCall(cudaMemcpy(siftManager->d_currNumFilteredMatchesPerImagePair + i, &newNumMatches, sizeof(unsigned int), cudaMemcpyHostToDevice));
-		if (newNumMatches > 0) {
-			cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredMatchKeyPointIndices + i * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, keyPointIndices.data(), sizeof(uint2) * newNumMatches, cudaMemcpyHostToDevice));
-			cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredMatchDistances + i * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, matchDistances.data(), sizeof(float) * newNumMatches, cudaMemcpyHostToDevice));
-		}
-	}
-	cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredTransforms, transforms.data(), sizeof(float4x4) * curFrame, cudaMemcpyHostToDevice));
-	cutilSafeCall(cudaMemcpy(siftManager->d_currFilteredTransformsInv, transformsInv.data(), sizeof(float4x4) * curFrame, cudaMemcpyHostToDevice));
+		if (numFiltered == 0) transform.setValue(0.0f);
+		std::copy(indices.begin(), indices.begin() + numFiltered, keyPointIndices);
+		std::copy(matchDistances.begin(), matchDistances.begin() + numFiltered, distances);
+		return numFiltered;
+	});
 }
 
-#define REFINE_RANSAC
 unsigned int SIFTMatchFilter::filterImagePairKeyPointMatchesRANSAC(const std::vector<SIFTKeyPoint>& keys, std::vector<uint2>& keyPointIndices, std::vector<float>& matchDistances,
 	float4x4& transform, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2,
 	unsigned int k, const std::vector<std::vector<unsigned int>>& combinations, bool debugPrint)
@@ -418,135 +525,166 @@ unsigned int SIFTMatchFilter::filterImagePairKeyPointMatchesRANSAC(const std::ve
 	unsigned int numRawMatches = (unsigned int)keyPointIndices.size();
 	if (numRawMatches < minNumMatches) return 0;
 
-	//const unsigned int ransacMax = 100;
-	//std::vector<float> errors(ransacMax);
-	//std::vector<vec4uc> indices(ransacMax);
-
-	//for (unsigned int i = 0; i < ransacMax; i++) {
-
-	//} // tests
-
-
-	unsigned int numValidCombs = 0;
-	unsigned int numValidStarts = 0;
-
-	// RANSAC TEST
-	unsigned int maxNumInliers = 0;
-	float bestMaxResidual = std::numeric_limits<float>::infinity();
-	std::vector<unsigned int> bestCombinationIndices;
-	for (unsigned int c = 0; c < combinations.size(); c++) {
-		std::vector<unsigned int> indices = combinations[c];
-
-		bool _DEBUGCOMB = debugPrint && indices[0] == 0 && indices[1] == 2 && indices[2] == 4 && indices[3] == 5;
-		if (_DEBUGCOMB) std::cout << "combination at " << c << std::endl;
-
-		// check if has combination
-		bool validCombination = true;
-		for (unsigned int i = 0; i < indices.size(); i++) {
-			if (indices[i] >= numRawMatches) {
-				validCombination = false;
-				break;
+	// RANSAC TEST: hypotheses run in tiles on the thread pool. the hypotheses of a tile grow in lockstep over the raw matches, all refits of one step
+	// (the seeds first) go through one KabschBatch call. each tile keeps its best and the tiles are merged in order, i.e. the result is the same as
+	// trying all combinations serially; a hypothesis stops once it cannot reach the best inlier count found so far by any tile
+	const unsigned int numCombinations = (unsigned int)combinations.size();
+	const unsigned int tileSize = debugPrint ? std::max(numCombinations, 1u) : RANSAC_HYPOTHESES_PER_TASK;
+	const unsigned int numTiles = (numCombinations + tileSize - 1) / tileSize;
+	std::vector<RansacHypothesis> tileBest(numTiles);
+	std::vector<unsigned int> tileNumValidCombs(numTiles, 0);
+	std::atomic<unsigned int> sharedMaxNumInliers(0);
+
+	ThreadPool::get().parallelFor(0, numTiles, [&](unsigned int t) {
+		const unsigned int cBegin = t * tileSize;
+		const unsigned int cEnd = std::min(cBegin + tileSize, numCombinations);
+
+		// hypotheses of the valid combinations: raw match indices and points of the inliers (seed first)
+		std::vector<std::vector<unsigned int>> indices;
+		for (unsigned int c = cBegin; c < cEnd; c++) {
+			// check if has combination
+			bool validCombination = true;
+			for (unsigned int i = 0; i < combinations[c].size(); i++) {
+				if (combinations[c][i] >= numRawMatches) {
+					validCombination = false;
+					break;
+				}
 			}
+			if (validCombination) indices.push_back(combinations[c]);
 		}
-		if (!validCombination) continue;
-		numValidCombs++;
-
-		std::vector<float3> srcPts(MAX_MATCHES_PER_IMAGE_PAIR_FILTERED), tgtPts(MAX_MATCHES_PER_IMAGE_PAIR_FILTERED);
-		getKeySourceAndTargetPointsByIndices(keys.data(), keyPointIndices.data(), indices.data(), k, srcPts.data(), tgtPts.data(), siftIntrinsicsInv);
-		unsigned int curNumMatches = k;
-		float3 eigenvalues; float4x4 transformEstimate;
-		float curMaxResidual = computeKabschReprojError(srcPts.data(), tgtPts.data(), curNumMatches, eigenvalues, transformEstimate);
-		if (_DEBUGCOMB) {
-			std::cout << "src pts:" << std::endl;
-			for (unsigned int i = 0; i < curNumMatches; i++) std::cout << "\t" << srcPts[i].x << " " << srcPts[i].y << " " << srcPts[i].z << std::endl;
-			std::cout << "tgt pts:" << std::endl;
-			for (unsigned int i = 0; i < curNumMatches; i++) std::cout << "\t" << tgtPts[i].x << " " << tgtPts[i].y << " " << tgtPts[i].z << std::endl;
-			std::cout << "max res = " << curMaxResidual << "(cond = " << eigenvalues.x / eigenvalues.y << ")" << std::endl;
-			getchar();
+		const unsigned int numHypotheses = (unsigned int)indices.size();
+		tileNumValidCombs[t] = numHypotheses;
+		if (numHypotheses == 0) return;
+		std::vector<float3> srcPts(numHypotheses * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED), tgtPts(numHypotheses * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED);
+		std::vector<unsigned int> numInliers(numHypotheses, k);
+		std::vector<float> maxResidual(numHypotheses, 0.0f);
+		std::vector<char> active(numHypotheses, 1), dropped(numHypotheses, 0);
+		for (unsigned int h = 0; h < numHypotheses; h++) {
+			getKeySourceAndTargetPointsByIndices(keys.data(), keyPointIndices.data(), indices[h].data(), k,
+				srcPts.data() + h * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, tgtPts.data() + h * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, siftIntrinsicsInv);
 		}
 
-		numValidStarts++;
+		// batch of the current step: hypothesis, points (inliers + candidate) and kabsch result of each problem
+		std::vector<unsigned int> batch, batchOffsets;
+		std::vector<float3> batchSrcPts, batchTgtPts, batchSingularValues;
+		std::vector<float4x4> batchTransforms;
+		auto addToBatch = [&](unsigned int h, const float3* src, const float3* tgt) {
+			const float3* hSrc = srcPts.data() + h * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED;
+			const float3* hTgt = tgtPts.data() + h * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED;
+			batch.push_back(h);
+			batchSrcPts.insert(batchSrcPts.end(), hSrc, hSrc + numInliers[h]);
+			batchTgtPts.insert(batchTgtPts.end(), hTgt, hTgt + numInliers[h]);
+			if (src) { batchSrcPts.push_back(*src); batchTgtPts.push_back(*tgt); }
+			batchOffsets.push_back((unsigned int)batchSrcPts.size());
+		};
+		// max kabsch residual of each problem
+		auto solveBatch = [&](std::vector<float>& residuals) {
+			const unsigned int numProblems = (unsigned int)batch.size();
+			batchTransforms.resize(numProblems);	batchSingularValues.resize(numProblems);
+			KabschBatch::kabsch(numProblems, batchSrcPts.data(), batchTgtPts.data(), batchOffsets.data(), batchTransforms.data(), batchSingularValues.data());
+			residuals.assign(numProblems, 0.0f);
+			for (unsigned int b = 0; b < numProblems; b++) {
+				for (unsigned int i = batchOffsets[b]; i < batchOffsets[b + 1]; i++) {
+					float3 d = batchTransforms[b] * batchSrcPts[i] - batchTgtPts[i];
+					residuals[b] = std::max(residuals[b], dot(d, d));
+				}
+			}
+		};
+		auto clearBatch = [&]() {
+			batch.clear();	batchSrcPts.clear();	batchTgtPts.clear();
+			batchOffsets.assign(1, 0);
+		};
+
+		std::vector<float> residuals;
+		clearBatch();
+		for (unsigned int h = 0; h < numHypotheses; h++) addToBatch(h, NULL, NULL);
+		solveBatch(residuals);
+		for (unsigned int h = 0; h < numHypotheses; h++) maxResidual[h] = residuals[h];
 
-		std::vector<bool> marker(numRawMatches, false);
-		for (unsigned int i = 0; i < indices.size(); i++) marker[indices[i]] = true;
 		// collect inliers
-		for (unsigned int m = 0; m < numRawMatches; m++) {
-			if (curNumMatches == MAX_MATCHES_PER_IMAGE_PAIR_FILTERED) break;
-			if (marker[m]) continue;
-
-			// don't add if within +/- 5 pix
+		unsigned int numActive = numHypotheses;
+		for (unsigned int m = 0; m < numRawMatches && numActive > 0; m++) {
+			const unsigned int bestNumInliers = sharedMaxNumInliers.load();
+			float3 src, tgt;
+			getKeySourceAndTargetPointsForIndex(keys.data(), keyPointIndices.data(), m, &src, &tgt, siftIntrinsicsInv);
 			const float2& potential0 = keys[keyPointIndices[m].x].pos;
 			const float2& potential1 = keys[keyPointIndices[m].y].pos;
-			bool add = true;
-			for (unsigned int p = 0; p < curNumMatches; p++) {
-				if (length(potential0 - keys[keyPointIndices[indices[p]].x].pos) <= 5.0f ||
-					length(potential1 - keys[keyPointIndices[indices[p]].y].pos) <= 5.0f) {
-					add = false;
-					break;
+			clearBatch();
+			for (unsigned int h = 0; h < numHypotheses; h++) {
+				if (!active[h]) continue;
+				if (numInliers[h] == MAX_MATCHES_PER_IMAGE_PAIR_FILTERED) {
+					active[h] = 0;	numActive--;
+					continue;
 				}
+				if (numInliers[h] + (numRawMatches - m) < bestNumInliers) { // can't even tie the best hypothesis anymore
+					active[h] = 0;	dropped[h] = 1;	numActive--;
+					continue;
+				}
+				if (std::find(indices[h].begin(), indices[h].begin() + k, m) != indices[h].begin() + k) continue;
+
+				// don't add if within +/- 5 pix
+				bool add = true;
+				for (unsigned int p = 0; p < numInliers[h]; p++) {
+					if (length(potential0 - keys[keyPointIndices[indices[h][p]].x].pos) <= 5.0f ||
+						length(potential1 - keys[keyPointIndices[indices[h][p]].y].pos) <= 5.0f) {
+						add = false;
+						break;
+					}
+				}
+				if (add) addToBatch(h, &src, &tgt);
 			}
-			if (!add) {
-				if (_DEBUGCOMB) printf("match %d too close to previous\n", m);
-				continue;
-			}
-
-			getKeySourceAndTargetPointsForIndex(keys.data(), keyPointIndices.data(), m, srcPts.data() + curNumMatches, tgtPts.data() + curNumMatches, siftIntrinsicsInv);
-#ifdef REFINE_RANSAC
-			// refine transform
-			float curRes2 = computeKabschReprojError(srcPts.data(), tgtPts.data(), curNumMatches + 1, eigenvalues, transformEstimate);
-			if (_DEBUGCOMB) {
-				std::cout << m << std::endl;
-				std::cout << "src pts:" << std::endl;
-				for (unsigned int i = 0; i < curNumMatches + 1; i++) std::cout << "\t" << srcPts[i].x << " " << srcPts[i].y << " " << srcPts[i].z << std::endl;
-				std::cout << "tgt pts:" << std::endl;
-				for (unsigned int i = 0; i < curNumMatches + 1; i++) std::cout << "\t" << tgtPts[i].x << " " << tgtPts[i].y << " " << tgtPts[i].z << std::endl;
-				std::cout << "max res = " << curRes2 << "(cond = " << eigenvalues.x / eigenvalues.y << ")" << std::endl;
-				getchar();
-			}
-#else 
-			float3 d = transformEstimate * srcPts[curNumMatches] - tgtPts[curNumMatches];
-			float curRes2 = dot(d, d);
-#endif
-			//if (debugPrint && c == 0) {
-			//	std::cout << "m = " << m << ", cur # matches = " << curNumMatches << ", new res = " << std::sqrt(curRes2) << std::endl;
-			//}
-
-			//if (eigenvalues.x / eigenvalues.y <= KABSCH_CONDITION_THRESH && curRes2 <= maxResThresh2) { // inlier
-			if (curRes2 <= maxResThresh2) { // inlier
-				curNumMatches++;
-				indices.push_back(m);
-#ifdef REFINE_RANSAC
-				curMaxResidual = curRes2;
-#else
-				if (curRes2 > curMaxResidual) curMaxResidual = curRes2;
-#endif
+			if (batch.empty()) continue;
+
+			// refine transforms
+			solveBatch(residuals);
+			for (unsigned int b = 0; b < batch.size(); b++) {
+				//if (batchSingularValues[b].x / batchSingularValues[b].y <= KABSCH_CONDITION_THRESH && residuals[b] <= maxResThresh2) { // inlier
+				if (residuals[b] <= maxResThresh2) { // inlier
+					const unsigned int h = batch[b];
+					srcPts[h * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED + numInliers[h]] = src;
+					tgtPts[h * MAX_MATCHES_PER_IMAGE_PAIR_FILTERED + numInliers[h]] = tgt;
+					numInliers[h]++;
+					indices[h].push_back(m);
+					maxResidual[h] = residuals[b];
+				}
 			}
 		}
-		if (_DEBUGCOMB) {
-			printf("cur #matches %d vs %d, cur res %f vs %f\n", curNumMatches, maxNumInliers, curMaxResidual, bestMaxResidual);
-			printf("cur match set:"); for (unsigned int i = 0; i < curNumMatches; i++) printf(" %d", indices[i]); printf("\n");
-			printf("cur best match set:"); for (unsigned int i = 0; i < bestCombinationIndices.size(); i++) printf(" %d", bestCombinationIndices[i]); printf("\n");
-		}
-		if (curNumMatches > maxNumInliers || (curNumMatches == maxNumInliers && curMaxResidual < bestMaxResidual)) {
-			maxNumInliers = curNumMatches;
-			bestCombinationIndices = indices;
-			bestMaxResidual = curMaxResidual;
 
-			if (_DEBUGCOMB) std::cout << "POTENTIAL MATCH" << std::endl;
+		RansacHypothesis& best = tileBest[t];
+		for (unsigned int h = 0; h < numHypotheses; h++) {
+			if (dropped[h] || !best.isWorseThan(numInliers[h], maxResidual[h])) continue;
+			best.numInliers = numInliers[h];
+			best.maxResidual = maxResidual[h];
+			best.indices = indices[h];
 			if (debugPrint) {
-				std::cout << "adding potential match set (" << curNumMatches << ") res " << curMaxResidual << ", cond " << (eigenvalues.x / eigenvalues.y) << std::endl;
+				std::cout << "adding potential match set (" << numInliers[h] << ") res " << maxResidual[h] << std::endl;
 				std::cout << "\t";
-				for (unsigned int i = 0; i < indices.size(); i++) std::cout << " " << indices[i];
+				for (unsigned int i = 0; i < indices[h].size(); i++) std::cout << " " << indices[h][i];
 				std::cout << std::endl;
 			}
 		}
+		unsigned int shared = sharedMaxNumInliers.load();
+		while (shared < best.numInliers && !sharedMaxNumInliers.compare_exchange_weak(shared, best.numInliers));
+	}, 1);
+
+	unsigned int numValidCombs = 0;
+	unsigned int maxNumInliers = 0;
+	float bestMaxResidual = std::numeric_limits<float>::infinity();
+	std::vector<unsigned int> bestCombinationIndices;
+	for (unsigned int t = 0; t < numTiles; t++) { // in order: on ties the lower combination wins
+		numValidCombs += tileNumValidCombs[t];
+		const RansacHypothesis& h = tileBest[t];
+		if (h.numInliers > maxNumInliers || (h.numInliers == maxNumInliers && h.maxResidual < bestMaxResidual)) {
+			maxNumInliers = h.numInliers;
+			bestMaxResidual = h.maxResidual;
+			bestCombinationIndices = h.indices;
+		}
 	}
 
 	if (debugPrint) {
-		std::cout << "#valid com = " << numValidCombs << ", #valid starts = " << numValidStarts << std::endl;
+		std::cout << "#valid com = " << numValidCombs << std::endl;
 		std::cout << "#raw matches = " << numRawMatches << ", max # inliers = " << maxNumInliers << std::endl;
 	}
-
 	if (maxNumInliers >= minNumMatches) {
 		std::vector<float3> srcPts(MAX_MATCHES_PER_IMAGE_PAIR_FILTERED), tgtPts(MAX_MATCHES_PER_IMAGE_PAIR_FILTERED);
 		getKeySourceAndTargetPointsByIndices(keys.data(), keyPointIndices.data(), bestCombinationIndices.data(), maxNumInliers, srcPts.data(), tgtPts.data(), siftIntrinsicsInv);
@@ -728,23 +866,17 @@ void SIFTMatchFilter::visualizeProjError(SIFTImageManager* siftManager, const ve
 
 	// current data
 	ml::DepthImage32 curDepth(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curDepth.getData(), cachedFrames[imageIndices.y].d_depthDownsampled, sizeof(float) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR8G8B8A8 curIntensity(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curIntensity.getData(), cachedFrames[imageIndices.y].d_intensityDownsampled, sizeof(uchar4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR32G32B32A32 curCamPos(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curCamPos.getData(), cachedFrames[imageIndices.y].d_cameraposDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR32G32B32A32 curNormals(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(curNormals.getData(), cachedFrames[imageIndices.y].d_normalsDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
+	cachedFrames[imageIndices.y].download(curDepth.getData(), (float4*)curCamPos.getData(), (float4*)curNormals.getData(), (float*)curIntensity.getData(), NULL);
 
 	// prev data
 	ml::DepthImage32 prvDepth(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(prvDepth.getData(), cachedFrames[imageIndices.x].d_depthDownsampled, sizeof(float) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR8G8B8A8 prvIntensity(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(prvIntensity.getData(), cachedFrames[imageIndices.x].d_intensityDownsampled, sizeof(uchar4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR32G32B32A32 prvCamPos(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(prvCamPos.getData(), cachedFrames[imageIndices.x].d_cameraposDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
 	ml::ColorImageR32G32B32A32 prvNormals(downSampWidth, downSampHeight);
-	cutilSafeCall(cudaMemcpy(prvNormals.getData(), cachedFrames[imageIndices.x].d_normalsDownsampled, sizeof(float4) * downSampWidth * downSampHeight, cudaMemcpyDeviceToHost));
+	cachedFrames[imageIndices.x].download(prvDepth.getData(), (float4*)prvCamPos.getData(), (float4*)prvNormals.getData(), (float*)prvIntensity.getData(), NULL);
 
 	std::vector<uint2> keyPointIndices;
 	siftManager->getFiltKeyPointIndicesDEBUG(imageIndices.x, keyPointIndices);
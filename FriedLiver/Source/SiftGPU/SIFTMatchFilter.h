@@ -2,7 +2,10 @@
 #ifndef SIFT_MATCH_FILTER_H
 #define SIFT_MATCH_FILTER_H
 
+#include <functional>
+
 #include "SIFTImageManager.h"
+#include "DenseVerifyCPU.h"
 #include "../CUDACache.h"
 
 class SIFTMatchFilter
@@ -14,12 +17,23 @@ public:
 	static void filterKeyPointMatchesDEBUG(unsigned int curFrame, SIFTImageManager* siftManager, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2, bool printDebug);
 	static void ransacKeyPointMatchesDEBUG(unsigned int curFrame, SIFTImageManager* siftManager, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2, bool debugPrint);
 
-	static void ransacKeyPointMatches(SIFTImageManager* siftManager, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2, bool debugPrint);
+	//! RANSAC over the 4-combinations of the 20 best raw matches (s_siftFilterRANSAC, expects the raw matches sorted by SortKeyPointMatchesCU): the image
+	//! pairs [startFrame, numFrames) and the hypotheses of each pair run in parallel on ThreadPool::get(), the results go to the FilterKeyPointMatchesCU buffers
+	static void ransacKeyPointMatches(SIFTImageManager* siftManager, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames,
+		const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2, bool debugPrint);
 	static void filterKeyPointMatches(SIFTImageManager* siftManager, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches);
+	//! host version of SIFTImageManager::FilterKeyPointMatchesCU (same greedy kabsch filter, expects the raw matches sorted by SortKeyPointMatchesCU):
+	//! the image pairs [startFrame, numFrames) are filtered in parallel on ThreadPool::get(), the results go to the same device buffers
+	static void filterKeyPointMatchesCPU(SIFTImageManager* siftManager, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames,
+		const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxKabschRes2);
 
 	static void filterBySurfaceArea(SIFTImageManager* siftManager, const std::vector<CUDACachedFrame>& cachedFrames, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches);
 
 	static void filterByDenseVerify(SIFTImageManager* siftManager, const std::vector<CUDACachedFrame>& cachedFrames, const float4x4& depthIntrinsics, float depthMin, float depthMax);
+	//! host version of SIFTImageManager::FilterMatchesByDenseVerifyCU on the frames mirrored by denseVerify (synced with the cache): the image pairs
+	//! [startFrame, numFrames) with filtered matches are verified in parallel on ThreadPool::get(), invalid pairs get 0 matches in the device buffers
+	static void filterByDenseVerifyCPU(SIFTImageManager* siftManager, const DenseVerifyCPU* denseVerify, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames,
+		const float4x4& intrinsics, const DenseVerifyCPU::Params& params);
 
 	static void visualizeProjError(SIFTImageManager* siftManager, const vec2ui& imageIndices, const std::vector<CUDACachedFrame>& cachedFrames,
 		const float4x4& depthIntrinsics, const float4x4& transformCurToPrv, float depthMin, float depthMax);
@@ -73,6 +87,13 @@ private:
 		}
 	}
 
+	//! (previous image, key points of the pair, raw matches -> filtered matches in place, transform) -> #filtered matches
+	typedef std::function<unsigned int(unsigned int, const std::vector<SIFTKeyPoint>&, uint2*, float*, unsigned int, float4x4&)> ImagePairFilter;
+	//! downloads the raw matches of the image pairs [startFrame, numFrames) and the key points they index (current image first), filters the pairs
+	//! in parallel (serially if bSerial) and uploads the filtered matches and transforms as FilterKeyPointMatchesCU_Kernel writes them
+	static void filterImagePairsCPU(SIFTImageManager* siftManager, unsigned int curFrame, unsigned int startFrame, unsigned int numFrames, bool bSerial,
+		const ImagePairFilter& filterImagePair);
+
 	static unsigned int filterImagePairKeyPointMatchesRANSAC(const std::vector<SIFTKeyPoint>& keys, std::vector<uint2>& keyPointIndices, std::vector<float>& matchDistances, float4x4& transform, const float4x4& siftIntrinsicsInv, unsigned int minNumMatches, float maxResThresh2,
 		unsigned int k, const std::vector<std::vector<unsigned int>>& combinations, bool debugPrint);
 
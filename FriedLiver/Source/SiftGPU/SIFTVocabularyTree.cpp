@@ -0,0 +1,181 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include "SIFTVocabularyTree.h"
+#include "../ThreadPool.h"
+
+namespace {
+
+	const unsigned int MAX_TRAINING_SAMPLES = 32768;
+	const unsigned int NUM_KMEANS_ITERATIONS = 8;
+	const unsigned int MAX_NUM_WORDS = 1 << 20;
+	//descriptors per parallel task
+	const unsigned int DESC_TILE = 32;
+}
+
+SIFTVocabularyTree::SIFTVocabularyTree(unsigned int branching, unsigned int depth, unsigned int numTrainingImages) : SIFTImageRetrieval(std::max(numTrainingImages, 2u)) //idf needs more than one image
+{
+	//a single child per node would never split the descriptors (and the heap layout of the nodes divides by branching - 1)
+	if (branching < 2) throw MLIB_EXCEPTION("vocabulary tree branching must be at least 2 (s_bowVocabularyBranching = " + std::to_string(branching) + ")");
+	m_branching = branching;
+	m_depth = std::max(depth, 1u);
+	while (m_depth > 1 && std::pow((double)m_branching, (double)m_depth) > MAX_NUM_WORDS) m_depth--;
+	reset();
+}
+
+SIFTVocabularyTree::~SIFTVocabularyTree()
+{
+}
+
+void SIFTVocabularyTree::reset()
+{
+	resetImages();
+	m_numWords = 0;
+	m_firstLeaf = 0;
+	m_nodeCenters.clear();
+	m_idf.clear();
+	m_invertedFile.clear();
+}
+
+void SIFTVocabularyTree::train()
+{
+	if (m_branching < 2) throw MLIB_EXCEPTION("vocabulary tree branching must be at least 2");
+	std::vector<float> samples;
+	const unsigned int numSamples = sampleTrainingDescriptors(MAX_TRAINING_SAMPLES, samples);
+	if (numSamples == 0) return;
+
+	unsigned int levelSize = 1;
+	for (unsigned int l = 0; l < m_depth; l++) levelSize *= m_branching;
+	m_numWords = levelSize;
+	m_firstLeaf = (m_numWords - 1) / (m_branching - 1);
+	const unsigned int numNodes = m_firstLeaf + m_numWords;
+	m_nodeCenters.assign((size_t)numNodes * 128, 0.0f);
+
+	//root: mean of all samples
+	for (unsigned int s = 0; s < numSamples; s++)
+		for (unsigned int d = 0; d < 128; d++) m_nodeCenters[d] += samples[(size_t)s * 128 + d] / numSamples;
+
+	//top down, all nodes of a level in parallel: k-means on the samples of the node gives the centers of its children
+	std::vector<std::vector<unsigned int>> nodeSamples(1);
+	nodeSamples[0].resize(numSamples);
+	for (unsigned int s = 0; s < numSamples; s++) nodeSamples[0][s] = s;
+	unsigned int firstNode = 0;
+	for (unsigned int l = 0; l < m_depth; l++) {
+		std::vector<std::vector<unsigned int>> childSamples(nodeSamples.size() * m_branching);
+		ThreadPool::get().parallelFor(0, (unsigned int)nodeSamples.size(), [&](unsigned int i) {
+			const unsigned int node = firstNode + i;
+			const unsigned int firstChild = node * m_branching + 1;
+			float* childCenters = m_nodeCenters.data() + (size_t)firstChild * 128;
+			const std::vector<unsigned int>& indices = nodeSamples[i];
+			if (indices.empty()) { //no samples left: the children repeat the node center
+				for (unsigned int c = 0; c < m_branching; c++) std::copy(m_nodeCenters.begin() + node * 128, m_nodeCenters.begin() + (node + 1) * 128, childCenters + c * 128);
+				return;
+			}
+			std::vector<float> points(indices.size() * 128);
+			for (size_t s = 0; s < indices.size(); s++) std::copy(samples.begin() + (size_t)indices[s] * 128, samples.begin() + ((size_t)indices[s] + 1) * 128, points.begin() + s * 128);
+			std::vector<float> centers;
+			kMeans(points.data(), (unsigned int)indices.size(), 128, m_branching, NUM_KMEANS_ITERATIONS, centers);
+			//fewer samples than children: the remaining children repeat the first one (on ties the lower child wins)
+			const unsigned int k = (unsigned int)centers.size() / 128;
+			std::copy(centers.begin(), centers.end(), childCenters);
+			for (unsigned int c = k; c < m_branching; c++) std::copy(centers.begin(), centers.begin() + 128, childCenters + c * 128);
+
+			for (size_t s = 0; s < indices.size(); s++) {
+				const unsigned int c = findNearestCenter(points.data() + s * 128, childCenters, m_branching, 128);
+				childSamples[i * m_branching + c].push_back(indices[s]);
+			}
+		}, 1);
+		nodeSamples.swap(childSamples);
+		firstNode = firstNode * m_branching + 1;
+	}
+
+	//idf from the training images
+	const unsigned int numImages = (unsigned int)m_trainingDescriptors.size();
+	std::vector<unsigned int> numImagesWithWord(m_numWords, 0);
+	std::vector<unsigned int> imageWords;
+	for (unsigned int i = 0; i < numImages; i++) {
+		const std::vector<SIFTKeyPointDesc>& descs = m_trainingDescriptors[i];
+		imageWords.resize(descs.size());
+		ThreadPool::get().parallelFor(0, (unsigned int)descs.size(), [&](unsigned int k) {
+			float d[128];
+			toFloat(descs[k], d);
+			imageWords[k] = quantize(d);
+		}, DESC_TILE);
+		std::sort(imageWords.begin(), imageWords.end());
+		imageWords.erase(std::unique(imageWords.begin(), imageWords.end()), imageWords.end());
+		for (unsigned int w : imageWords) numImagesWithWord[w]++;
+	}
+	m_idf.resize(m_numWords);
+	for (unsigned int w = 0; w < m_numWords; w++) m_idf[w] = std::log((float)numImages / (float)std::max(numImagesWithWord[w], 1u));
+
+	m_invertedFile.assign(m_numWords, std::vector<WordEntry>());
+	m_bTrained = true;
+}
+
+unsigned int SIFTVocabularyTree::quantize(const float* descriptor) const
+{
+	unsigned int node = 0;
+	for (unsigned int l = 0; l < m_depth; l++) {
+		const unsigned int firstChild = node * m_branching + 1;
+		node = firstChild + findNearestCenter(descriptor, m_nodeCenters.data() + (size_t)firstChild * 128, m_branching, 128);
+	}
+	return node - m_firstLeaf;
+}
+
+void SIFTVocabularyTree::computeBowVector(const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors, std::vector<std::pair<unsigned int, float>>& bow) const
+{
+	bow.clear();
+	if (numDescriptors == 0) return;
+	std::vector<unsigned int> words(numDescriptors);
+	ThreadPool::get().parallelFor(0, numDescriptors, [&](unsigned int i) {
+		float d[128];
+		toFloat(descriptors[i], d);
+		words[i] = quantize(d);
+	}, DESC_TILE);
+	std::sort(words.begin(), words.end());
+
+	float sum = 0.0f;
+	for (unsigned int i = 0; i < numDescriptors;) {
+		unsigned int j = i + 1;
+		while (j < numDescriptors && words[j] == words[i]) j++;
+		const float weight = (float)(j - i) / (float)numDescriptors * m_idf[words[i]];
+		if (weight > 0.0f) {
+			bow.push_back(std::make_pair(words[i], weight));
+			sum += weight;
+		}
+		i = j;
+	}
+	if (sum > 0.0f) {
+		for (auto& b : bow) b.second /= sum;
+	}
+}
+
+void SIFTVocabularyTree::insert(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors)
+{
+	std::vector<std::pair<unsigned int, float>> bow;
+	computeBowVector(descriptors, numDescriptors, bow);
+	for (const auto& b : bow) {
+		WordEntry e;
+		e.imageIdx = imageIdx;
+		e.weight = b.second;
+		m_invertedFile[b.first].push_back(e);
+	}
+}
+
+bool SIFTVocabularyTree::queryImageScores(const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors, std::vector<float>& scores) const
+{
+	scores.assign(m_containsImage.size(), 0.0f);
+	if (!m_bTrained) return false;
+
+	std::vector<std::pair<unsigned int, float>> bow;
+	computeBowVector(descriptors, numDescriptors, bow);
+	//L1 score 1 - 0.5 * |q - v|_1 of normalized non-negative vectors = sum over the common words of min(q_w, v_w)
+	for (const auto& b : bow) {
+		const std::vector<WordEntry>& entries = m_invertedFile[b.first];
+		for (const WordEntry& e : entries) scores[e.imageIdx] += std::min(b.second, e.weight);
+	}
+	return true;
+}
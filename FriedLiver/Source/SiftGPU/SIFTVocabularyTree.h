@@ -0,0 +1,49 @@
+#pragma once
+#ifndef SIFT_VOCABULARY_TREE_H
+#define SIFT_VOCABULARY_TREE_H
+
+#include <vector>
+
+#include "SIFTImageRetrieval.h"
+
+//! bag of visual words image retrieval: hierarchical k-means vocabulary (branching^depth words) over the SIFT descriptors,
+//! tf-idf weighted, L1 normalized word histograms in an inverted file and the L1 similarity score (Nister and Stewenius 2006, DBoW2).
+//! vocabulary and idf weights are built from the first numTrainingImages added images; before that, queries return false.
+//! branching < 2 throws
+class SIFTVocabularyTree : public SIFTImageRetrieval
+{
+public:
+	SIFTVocabularyTree(unsigned int branching, unsigned int depth, unsigned int numTrainingImages);
+	~SIFTVocabularyTree();
+
+	//! removes all images and the vocabulary
+	void reset();
+
+	unsigned int getNumWords() const { return m_numWords; }
+
+	//! scores[imageIdx] in [0, 1] (1: identical word histograms) for all added images; returns false (all scores 0) if not trained yet
+	bool queryImageScores(const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors, std::vector<float>& scores) const;
+
+private:
+	struct WordEntry {
+		unsigned int imageIdx;
+		float weight;
+	};
+
+	void train();
+	unsigned int quantize(const float* descriptor) const;
+	//! sorted (word, normalized tf-idf weight) pairs of an image
+	void computeBowVector(const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors, std::vector<std::pair<unsigned int, float>>& bow) const;
+	void insert(unsigned int imageIdx, const SIFTKeyPointDesc* descriptors, unsigned int numDescriptors);
+
+	unsigned int					m_branching;
+	unsigned int					m_depth;
+
+	unsigned int					m_numWords;
+	unsigned int					m_firstLeaf;		//nodes in heap order (children of n: n * branching + 1 ...), leaves are the words
+	std::vector<float>				m_nodeCenters;		//128 per node
+	std::vector<float>				m_idf;
+	std::vector<std::vector<WordEntry>>	m_invertedFile;	//[word]
+};
+
+#endif //SIFT_VOCABULARY_TREE_H
@@ -37,6 +37,7 @@ using namespace std;
 #include "GlobalUtil.h"
 #include "SiftGPU.h"
 #include "SiftPyramid.h"
+#include "SiftPyramidCPU.h"
 #include "ProgramCU.h"
 
 
@@ -53,11 +54,15 @@ SiftGPU::SiftGPU()
 	_image_loaded = 0;
 	_current = 0;
 	_pyramid = NULL;
+	_pyramidCPU = NULL;
+	_useCPU = false;
+	_pipelinedPyramid = true;
 }
 
 SiftGPU::~SiftGPU()
 {
 	if (_pyramid) delete _pyramid;
+	if (_pyramidCPU) delete _pyramidCPU;
 }
 
 
@@ -68,7 +73,13 @@ void SiftGPU::InitSiftGPU()
 	//Parse sift parameters
 	ParseSiftParam();
 
-	_pyramid = new SiftPyramid(*this);
+	if (_useCPU) {
+		_pyramidCPU = new SiftPyramidCPU(*this);
+		_pyramidCPU->setPipelined(_pipelinedPyramid);
+	}
+	else {
+		_pyramid = new SiftPyramid(*this);
+	}
 
 	if ((GlobalUtil::_InitPyramidWidth & 0xfffffffc) != GlobalUtil::_InitPyramidWidth) {
 		std::cout << "ERROR: image width must be a multiple of 4" << std::endl;
@@ -77,7 +88,8 @@ void SiftGPU::InitSiftGPU()
 
 	if (GlobalUtil::_InitPyramidWidth > 0 && GlobalUtil::_InitPyramidHeight > 0)
 	{
-		_pyramid->InitPyramid(GlobalUtil::_InitPyramidWidth, GlobalUtil::_InitPyramidHeight);
+		if (_useCPU)	_pyramidCPU->InitPyramid(GlobalUtil::_InitPyramidWidth, GlobalUtil::_InitPyramidHeight);
+		else			_pyramid->InitPyramid(GlobalUtil::_InitPyramidWidth, GlobalUtil::_InitPyramidHeight);
 	}
 
 	_initialized = 1;
@@ -91,6 +103,11 @@ int SiftGPU::RunSIFT(float* d_colorData, const float* d_depthData)
 
 	if (d_colorData != NULL)
 	{
+		if (_useCPU) {
+			if (!_pyramidCPU->isAllocated()) return 0;
+			_pyramidCPU->RunSIFT(d_colorData, d_depthData);
+			return 1;
+		}
 		if (!_pyramid->isAllocated()) return 0;
 
 		//process the image
@@ -221,8 +238,10 @@ void SiftGPU::PrintUsage()
 		<< "\n";
 }
 
-void SiftGPU::SetParams(unsigned int siftWidth, unsigned int siftHeight, bool enableTiming, unsigned int featureCountThreshold, float siftDepthMin, float siftDepthMax)
+void SiftGPU::SetParams(unsigned int siftWidth, unsigned int siftHeight, bool enableTiming, unsigned int featureCountThreshold, float siftDepthMin, float siftDepthMax, bool useCPU /*= false*/)
 {
+	_useCPU = useCPU;
+
 	GlobalUtil::_SiftDepthMin = siftDepthMin;
 	GlobalUtil::_SiftDepthMax = siftDepthMax;
 
@@ -260,12 +279,19 @@ float SiftParam::GetLevelSigma(int lev)
 
 int SiftGPU::GetFeatureNum()
 {
+	if (_useCPU) return _pyramidCPU->GetFeatureNum();
 	return _pyramid->GetFeatureNum();
 }
 
 
 unsigned int SiftGPU::GetKeyPointsAndDescriptorsCUDA(SIFTImageGPU& siftImage, const float* d_depthData, unsigned int maxNumKeyPoints /*= (unsigned int)-1*/)
 {
+	if (_useCPU) {
+		//keypoint depths were already looked up in RunSIFT
+		_pyramidCPU->GetKeyPointsCUDA((float4*)siftImage.d_keyPoints, maxNumKeyPoints);
+		_pyramidCPU->GetFeatureVectorCUDA((unsigned char*)siftImage.d_keyPointDescs, maxNumKeyPoints);
+		return _pyramidCPU->GetFeatureNum();
+	}
 	_pyramid->GetKeyPointsCUDA((float4*)siftImage.d_keyPoints, d_depthData, maxNumKeyPoints);
 	_pyramid->GetFeatureVectorCUDA((unsigned char*)siftImage.d_keyPointDescs, maxNumKeyPoints);
 	return _pyramid->GetFeatureNum();
@@ -273,12 +299,14 @@ unsigned int SiftGPU::GetKeyPointsAndDescriptorsCUDA(SIFTImageGPU& siftImage, co
 
 void SiftGPU::GetKeyPointsCUDA(SiftKeypoint* d_keypoints, float* d_depthData, unsigned int maxNumKeyPoints /*= (unsigned int)-1*/)
 {
-	_pyramid->GetKeyPointsCUDA((float4*)d_keypoints, d_depthData, maxNumKeyPoints);
+	if (_useCPU)	_pyramidCPU->GetKeyPointsCUDA((float4*)d_keypoints, maxNumKeyPoints);
+	else			_pyramid->GetKeyPointsCUDA((float4*)d_keypoints, d_depthData, maxNumKeyPoints);
 }
 
 void SiftGPU::GetDescriptorsCUDA(unsigned char* d_descriptors, unsigned int maxNumKeyPoints /*= (unsigned int)-1*/)
 {
-	_pyramid->GetFeatureVectorCUDA(d_descriptors, maxNumKeyPoints);
+	if (_useCPU)	_pyramidCPU->GetFeatureVectorCUDA(d_descriptors, maxNumKeyPoints);
+	else			_pyramid->GetFeatureVectorCUDA(d_descriptors, maxNumKeyPoints);
 }
 
 //void SiftGPU::CopyFeatureVectorToCPU(SiftKeypoint * keys, float * descriptors)
@@ -298,6 +326,10 @@ void SiftGPU::GetDescriptorsCUDA(unsigned char* d_descriptors, unsigned int maxN
 
 int SiftGPU::AllocatePyramid(int width, int height)
 {
+	if (_useCPU) {
+		_pyramidCPU->InitPyramid(width, height);
+		return _pyramidCPU->getPyramidHeight() == height && width == _pyramidCPU->getPyramidWidth();
+	}
 	_pyramid->setOctaveMin(GlobalUtil::_octave_min_default);
 	if (GlobalUtil::_octave_min_default >= 0)
 	{
@@ -316,7 +348,8 @@ int SiftGPU::AllocatePyramid(int width, int height)
 
 void SiftGPU::EvaluateTimings()
 {
-	_pyramid->EvaluateTimings();
+	if (_useCPU)	_pyramidCPU->EvaluateTimings();
+	else			_pyramid->EvaluateTimings();
 }
 
 SiftGPU* CreateNewSiftGPU()
@@ -74,6 +74,7 @@ public:
 };
 
 class SiftPyramid;
+class SiftPyramidCPU;
 class ImageList;
 ////////////////////////////////////////////////////////////////
 //class SIftGPU
@@ -108,8 +109,11 @@ public:
 
 	//Copy the SIFT result to two vectors
 	// void CopyFeatureVectorToCPU(SiftKeypoint * keys, float * descriptors);
-	//parse SiftGPU parameters
-	 void SetParams(unsigned int siftWidth, unsigned int siftHeight, bool enableTiming, unsigned int featureCountThreshold, float siftDepthMin, float siftDepthMax);
+	//parse SiftGPU parameters (useCPU: detect on the host with SiftPyramidCPU, input and output stay in device memory)
+	 void SetParams(unsigned int siftWidth, unsigned int siftHeight, bool enableTiming, unsigned int featureCountThreshold, float siftDepthMin, float siftDepthMax, bool useCPU = false);
+
+	//SiftPyramidCPU only: overlap levels, detection and octaves (default) or run level by level; call before InitSiftGPU
+	 void SetPipelinedPyramid(bool b) { _pipelinedPyramid = b; }
 
 	int RunSIFT(float* d_colorData, const float* d_depthData);
 	//set the active pyramid...dropped function
@@ -133,6 +137,10 @@ private:
 	int		_image_loaded;
 	//the SiftPyramid
 	SiftPyramid *  _pyramid;
+	//host pyramid used instead of _pyramid if _useCPU
+	SiftPyramidCPU * _pyramidCPU;
+	bool	_useCPU;
+	bool	_pipelinedPyramid;
 	//print out the command line options
 	static void PrintUsage();
 
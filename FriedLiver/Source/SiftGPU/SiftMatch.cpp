@@ -33,6 +33,7 @@ using namespace std;
 
 #include "GlobalUtil.h"
 #include "SiftMatch.h"
+#include "SiftMatchCPU.h"
 
 #include "CuTexImage.h"
 #include "ProgramCU.h"
@@ -50,6 +51,7 @@ SiftMatchGPU::SiftMatchGPU(int max_sift)
 	d_rowMatchDistances = NULL;
 
 	_timer = new CUDATimer();
+	_matcherCPU = NULL;
 }
 
 SiftMatchGPU::~SiftMatchGPU()
@@ -57,10 +59,11 @@ SiftMatchGPU::~SiftMatchGPU()
 	if (d_rowMatchDistances) cutilSafeCall(cudaFree(d_rowMatchDistances));
 
 	if (_timer) delete _timer;
+	if (_matcherCPU) delete _matcherCPU;
 }
 
 
-void SiftMatchGPU::InitSiftMatch()
+void SiftMatchGPU::InitSiftMatch(bool useCPU /*= false*/)
 {
 	//if (!CheckCudaDevice(GlobalUtil::_DeviceIndex)) {
 	//	std::cout << "ERROR checking cuda device" << std::endl;
@@ -70,6 +73,10 @@ void SiftMatchGPU::InitSiftMatch()
 	if (_initialized) return;
 	_initialized = 1;
 
+	if (useCPU) {
+		_matcherCPU = new SiftMatchCPU(_max_sift);
+		return;
+	}
 	cutilSafeCall(cudaMalloc(&d_rowMatchDistances, sizeof(float) * 4096));
 }
 
@@ -99,6 +106,10 @@ void SiftMatchGPU::SetDescriptors(int index, int num, unsigned char* d_descripto
 	_id_sift[index] = id;
 	if (num > _max_sift) num = _max_sift;
 	_num_sift[index] = num;
+	if (_matcherCPU) {
+		_matcherCPU->SetDescriptors(index, num, d_descriptors);
+		return;
+	}
 	_texDes[index].setImageData(8 * num, 1, 4, d_descriptors);
 }
 
@@ -113,6 +124,10 @@ void SiftMatchGPU::SetDescriptorsFromCPU(int index, int num, const unsigned char
 	_id_sift[index] = id;
 	if (num > _max_sift) num = _max_sift;
 	_num_sift[index] = num;
+	if (_matcherCPU) {
+		_matcherCPU->SetDescriptorsFromCPU(index, num, descriptors);
+		return;
+	}
 	_texDes[index].InitTexture(8 * num, 1, 4);
 	_texDes[index].CopyFromHost((void*)descriptors);
 }
@@ -163,6 +178,10 @@ void SiftMatchGPU::GetSiftMatch(int max_match, ImagePairMatch& imagePairMatch, u
 		cudaMemset(imagePairMatch.d_numMatches, 0, sizeof(int));
 		return;
 	}
+	if (_matcherCPU) {
+		_matcherCPU->GetSiftMatch(max_match, imagePairMatch, keyPointOffset, distmax, ratiomax, mutual_best_match);
+		return;
+	}
 	if (GlobalUtil::_EnableDetailedTimings) {
 		_timer->startEvent("MultiplyDescriptor");
 	}
@@ -173,6 +192,22 @@ void SiftMatchGPU::GetSiftMatch(int max_match, ImagePairMatch& imagePairMatch, u
 	GetBestMatch(max_match, imagePairMatch, distmax, ratiomax, keyPointOffset);//, mutual_best_match);
 }
 
+void SiftMatchGPU::GetSiftMatchBatch(unsigned int numSets, unsigned char* const* d_descriptors, const int* num, ImagePairMatch* const* imagePairMatches, const uint2* keyPointOffsets,
+	float distmax, float ratiomax, int mutual_best_match)
+{
+	if (_initialized == 0 || _num_sift[1] <= 0) {
+		for (unsigned int i = 0; i < numSets; i++) cudaMemset(imagePairMatches[i]->d_numMatches, 0, sizeof(int));
+		return;
+	}
+	if (_matcherCPU) {
+		_matcherCPU->GetSiftMatchBatch(numSets, d_descriptors, num, imagePairMatches, keyPointOffsets, distmax, ratiomax, mutual_best_match);
+		return;
+	}
+	for (unsigned int i = 0; i < numSets; i++) {
+		SetDescriptors(0, num[i], d_descriptors[i]);
+		GetSiftMatch(num[i], *imagePairMatches[i], keyPointOffsets[i], distmax, ratiomax, mutual_best_match);
+	}
+}
 
 void SiftMatchGPU::GetBestMatch(int max_match, ImagePairMatch& imagePairMatch,  float distmax, float ratiomax, uint2 keyPointOffset)//, int mbm)
 {
@@ -7,6 +7,7 @@
 
 
 class CUDATimer;
+class SiftMatchCPU;
 
 ///matcher export
 //This is a gpu-based sift match implementation. 
@@ -19,7 +20,8 @@ public:
 	//desctructor
 	 ~SiftMatchGPU();
 
-	void InitSiftMatch();
+	//useCPU: match on the host with SiftMatchCPU (same matches up to acosf rounding at the thresholds, descriptors and results stay in device memory)
+	void InitSiftMatch(bool useCPU = false);
 
 	//Specifiy descriptors to match, index = [0/1] for two features sets respectively
 	//Option1, use float descriptors, and they be already normalized to 1.0
@@ -46,6 +48,19 @@ public:
 		float ratiomax = 0.8f,	//maximum distance ratio
 		int mutual_best_match = 1); //mutual best match or one way
 
+	//match the features of index 1 (e.g. the current frame) against numSets feature sets (unsigned char device descriptors as in SetDescriptors)
+	//set i goes to imagePairMatches[i] with keyPointOffsets[i]; the same matches as SetDescriptors(0, ...) + GetSiftMatch per set.
+	//the host matcher does all sets in one blocked pass; the kernels run per set but share the index 1 texture
+	void GetSiftMatchBatch(
+		unsigned int numSets,
+		unsigned char* const* d_descriptors,
+		const int* num,
+		ImagePairMatch* const* imagePairMatches,
+		const uint2* keyPointOffsets,
+		float distmax = 0.7f,
+		float ratiomax = 0.8f,
+		int mutual_best_match = 1);
+
 	void EvaluateTimings();
 
 	//two functions for guded matching, two constraints can be used 
@@ -88,6 +103,9 @@ private:
 	std::vector<int> sift_buffer;
 
 	CUDATimer* _timer;
+
+	//host matcher used instead of the kernels if set
+	SiftMatchCPU* _matcherCPU;
 };
 
 
@@ -0,0 +1,302 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+
+#include "SiftMatchCPU.h"
+#include "../ThreadPool.h"
+
+namespace {
+
+	//rows of the first set per parallel task
+	const int ROW_TILE = 16;
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// 16 bit multiply-add (AVX2 if the build enables it, SSE2 otherwise); 255 * 255 * 2 fits into the 32 bit lanes, so the dot products are exact
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX2__)
+	typedef __m256i vint;
+	const int VEC_SHORTS = 16;
+	inline vint vzero()									{ return _mm256_setzero_si256(); }
+	inline vint vload(const short* p)					{ return _mm256_loadu_si256((const __m256i*)p); }
+	inline vint vmadd(vint acc, vint a, vint b)			{ return _mm256_add_epi32(acc, _mm256_madd_epi16(a, b)); }
+	inline __m128i vfold(vint a)						{ return _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)); }
+#else
+	typedef __m128i vint;
+	const int VEC_SHORTS = 8;
+	inline vint vzero()									{ return _mm_setzero_si128(); }
+	inline vint vload(const short* p)					{ return _mm_loadu_si128((const __m128i*)p); }
+	inline vint vmadd(vint acc, vint a, vint b)			{ return _mm_add_epi32(acc, _mm_madd_epi16(a, b)); }
+	inline __m128i vfold(vint a)						{ return a; }
+#endif
+
+	//! [sum(a0), sum(a1), sum(a2), sum(a3)]
+	inline __m128i hsum4(__m128i a0, __m128i a1, __m128i a2, __m128i a3)
+	{
+		const __m128i s01 = _mm_add_epi32(_mm_unpacklo_epi32(a0, a1), _mm_unpackhi_epi32(a0, a1));
+		const __m128i s23 = _mm_add_epi32(_mm_unpacklo_epi32(a2, a3), _mm_unpackhi_epi32(a2, a3));
+		return _mm_add_epi32(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+	}
+
+	//! dot products of the descriptors a0, a1 with the four consecutive descriptors at b (MultiplyDescriptor_Kernel)
+	inline void dot2x4(const short* a0, const short* a1, const short* b, int* d0, int* d1)
+	{
+		vint acc00 = vzero(), acc01 = vzero(), acc02 = vzero(), acc03 = vzero();
+		vint acc10 = vzero(), acc11 = vzero(), acc12 = vzero(), acc13 = vzero();
+		for (int o = 0; o < 128; o += VEC_SHORTS) {
+			const vint x0 = vload(a0 + o), x1 = vload(a1 + o);
+			vint y = vload(b + o);
+			acc00 = vmadd(acc00, x0, y);	acc10 = vmadd(acc10, x1, y);
+			y = vload(b + 128 + o);
+			acc01 = vmadd(acc01, x0, y);	acc11 = vmadd(acc11, x1, y);
+			y = vload(b + 256 + o);
+			acc02 = vmadd(acc02, x0, y);	acc12 = vmadd(acc12, x1, y);
+			y = vload(b + 384 + o);
+			acc03 = vmadd(acc03, x0, y);	acc13 = vmadd(acc13, x1, y);
+		}
+		_mm_storeu_si128((__m128i*)d0, hsum4(vfold(acc00), vfold(acc01), vfold(acc02), vfold(acc03)));
+		_mm_storeu_si128((__m128i*)d1, hsum4(vfold(acc10), vfold(acc11), vfold(acc12), vfold(acc13)));
+	}
+
+	inline float dotToDistance(int dot)
+	{
+		return std::acos(std::min(dot * 0.000003814697265625f, 1.0f));
+	}
+}
+
+SiftMatchCPU::SiftMatchCPU(int max_sift)
+{
+	m_maxNum = max_sift <= 0 ? 4096 : ((max_sift + 31) / 32 * 32);
+	m_num[0] = m_num[1] = 0;
+	m_numRowTiles = 0;
+	m_hostKeyPointIndices.resize(MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	m_hostMatchDistances.resize(MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+}
+
+SiftMatchCPU::~SiftMatchCPU()
+{
+}
+
+void SiftMatchCPU::SetDescriptors(int index, int num, const unsigned char* d_descriptors)
+{
+	if (num > m_maxNum) num = m_maxNum;
+	m_hostBuffer.resize(128 * std::max(num, 0));
+	if (num > 0) cutilSafeCall(cudaMemcpy(m_hostBuffer.data(), d_descriptors, m_hostBuffer.size(), cudaMemcpyDeviceToHost));
+	SetDescriptorsFromCPU(index, num, m_hostBuffer.data());
+}
+
+void SiftMatchCPU::SetDescriptorsFromCPU(int index, int num, const unsigned char* descriptors)
+{
+	if (index > 1) index = 1;
+	if (index < 0) index = 0;
+	if (num > m_maxNum) num = m_maxNum;
+	if (num < 0) num = 0;
+	m_num[index] = num;
+
+	//padded to a multiple of 4 with zero descriptors (a zero dot product never becomes a best or second best match)
+	const int numPadded = (num + 3) & ~3;
+	std::vector<short>& desc = m_descriptors[index];
+	desc.assign(128 * numPadded, 0);
+	for (int i = 0; i < 128 * num; i++) desc[i] = descriptors[i];
+}
+
+void SiftMatchCPU::MatchRowTile(const short* desc1, int rowBegin, int rowEnd, const short* desc2, int num2, float distmax, float ratiomax, int* rowMatch, float* rowMatchDistances, Top2* colTop)
+{
+	const Top2 init = { 0, -1, 0 };
+	const int num2Padded = (num2 + 3) & ~3;
+	std::fill(colTop, colTop + num2, init);
+
+	for (int i = rowBegin; i < rowEnd; i += 2) {
+		const bool hasRow1 = i + 1 < rowEnd;
+		Top2 rowTop[2] = { init, init };
+		for (int j = 0; j < num2Padded; j += 4) {
+			int d[2][4];
+			dot2x4(desc1 + 128 * i, desc1 + 128 * (i + 1), desc2 + 128 * j, d[0], d[1]);
+			const int n = std::min(4, num2 - j);
+			for (int r = 0; r < (hasRow1 ? 2 : 1); r++) {
+				for (int k = 0; k < n; k++) {
+					const int v = d[r][k];
+					//strict comparisons: on ties the lower index wins (as in the GPU reductions)
+					if (v > rowTop[r].x) { rowTop[r].z = rowTop[r].x; rowTop[r].x = v; rowTop[r].y = j + k; }
+					else if (v > rowTop[r].z) rowTop[r].z = v;
+					Top2& c = colTop[j + k];
+					if (v > c.x) { c.z = c.x; c.x = v; c.y = i + r; }
+					else if (v > c.z) c.z = v;
+				}
+			}
+		}
+
+		//RowMatch_Kernel
+		for (int r = 0; r < (hasRow1 ? 2 : 1); r++) {
+			const float dist = dotToDistance(rowTop[r].x);
+			const float distn = dotToDistance(rowTop[r].z);
+			rowMatch[i + r] = (dist < distmax) && (dist < distn * ratiomax) ? rowTop[r].y : -1;
+			rowMatchDistances[i + r] = dist;
+		}
+	}
+}
+
+unsigned int SiftMatchCPU::CollectMatches(int num1, int num2, const Top2* colPartial, unsigned int numRowTiles, const int* rowMatch, const float* rowMatchDistances,
+	uint2* keyPointIndices, float* matchDistances, unsigned int maxNumMatches, uint2 keyPointOffset, float distmax, float ratiomax, int mutual_best_match)
+{
+	unsigned int numMatches = 0;
+	if (mutual_best_match) {
+		//ColMatch_Kernel: merge the per-tile column maxima, ratio test, keep the match if it is also the best of its row
+		for (int j = 0; j < num2; j++) {
+			Top2 t = colPartial[j];
+			for (unsigned int tile = 1; tile < numRowTiles; tile++) {
+				const Top2& p = colPartial[tile * num2 + j];
+				if (t.x < p.x) {
+					t.z = std::max(t.x, p.z);
+					t.x = p.x;
+					t.y = p.y;
+				}
+				else {
+					t.z = std::max(t.z, p.x);
+				}
+			}
+			const float dist = dotToDistance(t.x);
+			const float distn = dotToDistance(t.z);
+			const int f1 = (dist < distmax) && (dist < distn * ratiomax) ? t.y : -1;
+			if (f1 >= 0 && rowMatch[f1] == j) {
+				if (numMatches < maxNumMatches) {
+					keyPointIndices[numMatches] = make_uint2(f1 + keyPointOffset.x, j + keyPointOffset.y);
+					matchDistances[numMatches] = rowMatchDistances[f1];
+				}
+				numMatches++;
+			}
+		}
+	}
+	else {
+		for (int i = 0; i < num1; i++) {
+			if (rowMatch[i] < 0) continue;
+			if (numMatches < maxNumMatches) {
+				keyPointIndices[numMatches] = make_uint2(i + keyPointOffset.x, rowMatch[i] + keyPointOffset.y);
+				matchDistances[numMatches] = rowMatchDistances[i];
+			}
+			numMatches++;
+		}
+	}
+	return numMatches;
+}
+
+void SiftMatchCPU::MultiplyDescriptors(float distmax, float ratiomax)
+{
+	const int num1 = m_num[0], num2 = m_num[1];
+	m_numRowTiles = (unsigned int)(num1 + ROW_TILE - 1) / ROW_TILE;
+	m_rowMatch.resize(num1);
+	m_rowMatchDistances.resize(num1);
+	m_colPartial.resize(m_numRowTiles * num2);
+
+	const short* desc1 = m_descriptors[0].data();
+	const short* desc2 = m_descriptors[1].data();
+	ThreadPool::get().parallelFor(0, m_numRowTiles, [&](unsigned int tile) {
+		const int rowBegin = (int)tile * ROW_TILE, rowEnd = std::min(rowBegin + ROW_TILE, num1);
+		MatchRowTile(desc1, rowBegin, rowEnd, desc2, num2, distmax, ratiomax, m_rowMatch.data(), m_rowMatchDistances.data(), m_colPartial.data() + tile * num2);
+	});
+}
+
+unsigned int SiftMatchCPU::GetSiftMatchHost(uint2* keyPointIndices, float* matchDistances, unsigned int maxNumMatches, uint2 keyPointOffset, float distmax, float ratiomax, int mutual_best_match)
+{
+	const int num1 = m_num[0], num2 = m_num[1];
+	if (num1 <= 0 || num2 <= 0) return 0;
+
+	MultiplyDescriptors(distmax, ratiomax);
+	return CollectMatches(num1, num2, m_colPartial.data(), m_numRowTiles, m_rowMatch.data(), m_rowMatchDistances.data(), keyPointIndices, matchDistances, maxNumMatches, keyPointOffset, distmax, ratiomax, mutual_best_match);
+}
+
+void SiftMatchCPU::GetSiftMatchBatchHost(unsigned int numSets, const unsigned char* descriptors, const unsigned int* setOffsets, unsigned int* numMatches, uint2* keyPointIndices, float* matchDistances,
+	unsigned int maxNumMatches, const uint2* keyPointOffsets, float distmax, float ratiomax, int mutual_best_match)
+{
+	const int num2 = m_num[1];
+	if (numSets == 0) return;
+	if (num2 <= 0) {
+		std::fill(numMatches, numMatches + numSets, 0u);
+		return;
+	}
+
+	//sets padded to a multiple of 4 rows (dot2x4 reads row pairs); rows and row tiles of all sets in one array each
+	std::vector<unsigned int> paddedOffsets(numSets + 1, 0), tileOffsets(numSets + 1, 0);
+	for (unsigned int s = 0; s < numSets; s++) {
+		const int num1 = std::min((int)(setOffsets[s + 1] - setOffsets[s]), m_maxNum);
+		paddedOffsets[s + 1] = paddedOffsets[s] + ((num1 + 3) & ~3);
+		tileOffsets[s + 1] = tileOffsets[s] + (num1 + ROW_TILE - 1) / ROW_TILE;
+	}
+	const unsigned int numTiles = tileOffsets[numSets];
+	m_batchDescriptors.assign(128 * (size_t)paddedOffsets[numSets], 0);
+	m_rowMatch.resize(paddedOffsets[numSets]);
+	m_rowMatchDistances.resize(paddedOffsets[numSets]);
+	m_colPartial.resize((size_t)numTiles * num2);
+
+	ThreadPool::get().parallelFor(0, numSets, [&](unsigned int s) {
+		const int num1 = std::min((int)(setOffsets[s + 1] - setOffsets[s]), m_maxNum);
+		const unsigned char* src = descriptors + 128 * (size_t)setOffsets[s];
+		short* dst = m_batchDescriptors.data() + 128 * (size_t)paddedOffsets[s];
+		for (int i = 0; i < 128 * num1; i++) dst[i] = src[i];
+	});
+
+	//one pass over the row tiles of all sets; every tile streams the (cache resident) current frame
+	const short* desc2 = m_descriptors[1].data();
+	ThreadPool::get().parallelFor(0, numTiles, [&](unsigned int tile) {
+		const unsigned int s = (unsigned int)(std::upper_bound(tileOffsets.begin(), tileOffsets.end(), tile) - tileOffsets.begin()) - 1;
+		const int num1 = std::min((int)(setOffsets[s + 1] - setOffsets[s]), m_maxNum);
+		const int rowBegin = (int)(tile - tileOffsets[s]) * ROW_TILE, rowEnd = std::min(rowBegin + ROW_TILE, num1);
+		MatchRowTile(m_batchDescriptors.data() + 128 * (size_t)paddedOffsets[s], rowBegin, rowEnd, desc2, num2, distmax, ratiomax,
+			m_rowMatch.data() + paddedOffsets[s], m_rowMatchDistances.data() + paddedOffsets[s], m_colPartial.data() + (size_t)tile * num2);
+	});
+
+	ThreadPool::get().parallelFor(0, numSets, [&](unsigned int s) {
+		const int num1 = std::min((int)(setOffsets[s + 1] - setOffsets[s]), m_maxNum);
+		numMatches[s] = num1 <= 0 ? 0 : CollectMatches(num1, num2, m_colPartial.data() + (size_t)tileOffsets[s] * num2, tileOffsets[s + 1] - tileOffsets[s],
+			m_rowMatch.data() + paddedOffsets[s], m_rowMatchDistances.data() + paddedOffsets[s], keyPointIndices + (size_t)s * maxNumMatches, matchDistances + (size_t)s * maxNumMatches,
+			maxNumMatches, keyPointOffsets[s], distmax, ratiomax, mutual_best_match);
+	});
+}
+
+void SiftMatchCPU::GetSiftMatchBatch(unsigned int numSets, unsigned char* const* d_descriptors, const int* num, ImagePairMatch* const* imagePairMatches, const uint2* keyPointOffsets,
+	float distmax, float ratiomax, int mutual_best_match)
+{
+	m_batchOffsets.resize(numSets + 1);
+	m_batchOffsets[0] = 0;
+	for (unsigned int s = 0; s < numSets; s++) m_batchOffsets[s + 1] = m_batchOffsets[s] + (unsigned int)std::min(std::max(num[s], 0), m_maxNum);
+	m_hostBuffer.resize(128 * (size_t)m_batchOffsets[numSets]);
+	for (unsigned int s = 0; s < numSets; s++) {
+		const size_t size = 128 * (size_t)(m_batchOffsets[s + 1] - m_batchOffsets[s]);
+		if (size > 0) cutilSafeCall(cudaMemcpy(m_hostBuffer.data() + 128 * (size_t)m_batchOffsets[s], d_descriptors[s], size, cudaMemcpyDeviceToHost));
+	}
+
+	m_batchNumMatches.resize(numSets);
+	m_hostKeyPointIndices.resize((size_t)numSets * MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	m_hostMatchDistances.resize((size_t)numSets * MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	GetSiftMatchBatchHost(numSets, m_hostBuffer.data(), m_batchOffsets.data(), m_batchNumMatches.data(), m_hostKeyPointIndices.data(), m_hostMatchDistances.data(),
+		MAX_MATCHES_PER_IMAGE_PAIR_RAW, keyPointOffsets, distmax, ratiomax, mutual_best_match);
+
+	for (unsigned int s = 0; s < numSets; s++) {
+		const int numMatches = (int)m_batchNumMatches[s];
+		const int numWritten = std::min(numMatches, MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+		cutilSafeCall(cudaMemcpy(imagePairMatches[s]->d_numMatches, &numMatches, sizeof(int), cudaMemcpyHostToDevice));
+		if (numWritten > 0) {
+			cutilSafeCall(cudaMemcpy(imagePairMatches[s]->d_keyPointIndices, m_hostKeyPointIndices.data() + (size_t)s * MAX_MATCHES_PER_IMAGE_PAIR_RAW, sizeof(uint2) * numWritten, cudaMemcpyHostToDevice));
+			cutilSafeCall(cudaMemcpy(imagePairMatches[s]->d_distances, m_hostMatchDistances.data() + (size_t)s * MAX_MATCHES_PER_IMAGE_PAIR_RAW, sizeof(float) * numWritten, cudaMemcpyHostToDevice));
+		}
+	}
+}
+
+void SiftMatchCPU::GetSiftMatch(int max_match, ImagePairMatch& imagePairMatch, uint2 keyPointOffset, float distmax, float ratiomax, int mutual_best_match)
+{
+	const int numMatches = (int)GetSiftMatchHost(m_hostKeyPointIndices.data(), m_hostMatchDistances.data(), MAX_MATCHES_PER_IMAGE_PAIR_RAW, keyPointOffset, distmax, ratiomax, mutual_best_match);
+	const int numWritten = std::min(numMatches, MAX_MATCHES_PER_IMAGE_PAIR_RAW);
+	cutilSafeCall(cudaMemcpy(imagePairMatch.d_numMatches, &numMatches, sizeof(int), cudaMemcpyHostToDevice));
+	if (numWritten > 0) {
+		cutilSafeCall(cudaMemcpy(imagePairMatch.d_keyPointIndices, m_hostKeyPointIndices.data(), sizeof(uint2) * numWritten, cudaMemcpyHostToDevice));
+		cutilSafeCall(cudaMemcpy(imagePairMatch.d_distances, m_hostMatchDistances.data(), sizeof(float) * numWritten, cudaMemcpyHostToDevice));
+	}
+}
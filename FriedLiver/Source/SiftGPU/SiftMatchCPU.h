@@ -0,0 +1,70 @@
+#pragma once
+#ifndef SIFT_MATCH_CPU_H
+#define SIFT_MATCH_CPU_H
+
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "SIFTImageManager.h"
+
+//! host version of SiftMatchGPU: exact integer descriptor dot products (SSE2 pmaddwd, AVX2 if the build enables it),
+//! followed by the same mutual best match and distance ratio test as RowMatch_Kernel / ColMatch_Kernel. the dot products are the same integers as on the
+//! device; a match can only differ where acosf rounds a distance / ratio test that is decided within a few ulp (checked by testSiftMatchCPU)
+//! rows of the first set are processed in parallel on ThreadPool::get(); matches are emitted in order of the second set
+class SiftMatchCPU
+{
+public:
+	SiftMatchCPU(int max_sift = 4096);
+	~SiftMatchCPU();
+
+	//! unsigned char descriptors, normalized to 512; device memory (as SiftMatchGPU::SetDescriptors) or host memory
+	void SetDescriptors(int index, int num, const unsigned char* d_descriptors);
+	void SetDescriptorsFromCPU(int index, int num, const unsigned char* descriptors);
+
+	//! same semantics as SiftMatchGPU::GetSiftMatch; the result is written to the device buffers of imagePairMatch
+	void GetSiftMatch(int max_match, ImagePairMatch& imagePairMatch, uint2 keyPointOffset, float distmax = 0.7f, float ratiomax = 0.8f, int mutual_best_match = 1);
+	//! returns the number of matches; only the first maxNumMatches are written (the GPU counter behaves the same)
+	unsigned int GetSiftMatchHost(uint2* keyPointIndices, float* matchDistances, unsigned int maxNumMatches, uint2 keyPointOffset, float distmax = 0.7f, float ratiomax = 0.8f, int mutual_best_match = 1);
+
+	//! matches set 1 (SetDescriptors(1, ...), the current frame) against numSets descriptor sets in one pass: the row tiles of all sets run concurrently
+	//! while set 1 stays in cache. per set the same result as SetDescriptors(0, num[i], d_descriptors[i]) + GetSiftMatch(..., imagePairMatches[i], keyPointOffsets[i], ...)
+	void GetSiftMatchBatch(unsigned int numSets, unsigned char* const* d_descriptors, const int* num, ImagePairMatch* const* imagePairMatches, const uint2* keyPointOffsets,
+		float distmax = 0.7f, float ratiomax = 0.8f, int mutual_best_match = 1);
+	//! host version: set i has the descriptors [setOffsets[i], setOffsets[i + 1]) of descriptors; numMatches[i] is its match count,
+	//! its first maxNumMatches matches are written to keyPointIndices / matchDistances + i * maxNumMatches
+	void GetSiftMatchBatchHost(unsigned int numSets, const unsigned char* descriptors, const unsigned int* setOffsets, unsigned int* numMatches, uint2* keyPointIndices, float* matchDistances,
+		unsigned int maxNumMatches, const uint2* keyPointOffsets, float distmax = 0.7f, float ratiomax = 0.8f, int mutual_best_match = 1);
+
+	int getNumDescriptors(int index) const { return m_num[index]; }
+
+private:
+	//! best (x), index of best (y), second best (z) dot product
+	struct Top2 {
+		int x, y, z;
+	};
+
+	void MultiplyDescriptors(float distmax, float ratiomax);
+	//! rows [rowBegin, rowEnd) of desc1 (padded to a multiple of 4) against the num2 descriptors of desc2: row matches (RowMatch_Kernel) and the column maxima of the tile
+	static void MatchRowTile(const short* desc1, int rowBegin, int rowEnd, const short* desc2, int num2, float distmax, float ratiomax, int* rowMatch, float* rowMatchDistances, Top2* colTop);
+	//! merges the column maxima of numRowTiles tiles (ColMatch_Kernel) and writes the (mutual) matches; returns the number of matches
+	static unsigned int CollectMatches(int num1, int num2, const Top2* colPartial, unsigned int numRowTiles, const int* rowMatch, const float* rowMatchDistances,
+		uint2* keyPointIndices, float* matchDistances, unsigned int maxNumMatches, uint2 keyPointOffset, float distmax, float ratiomax, int mutual_best_match);
+
+	int								m_maxNum;
+	int								m_num[2];
+	std::vector<short>				m_descriptors[2];	//widened to 16 bit, 128 per feature
+
+	std::vector<int>				m_rowMatch;			//best feature of set 1 per feature of set 0 (-1 if the ratio test fails)
+	std::vector<float>				m_rowMatchDistances;
+	std::vector<Top2>				m_colPartial;		//[row tile * num1 + col]
+	unsigned int					m_numRowTiles;
+
+	std::vector<unsigned char>		m_hostBuffer;
+	std::vector<short>				m_batchDescriptors;	//all sets of GetSiftMatchBatchHost, each padded to a multiple of 4
+	std::vector<unsigned int>		m_batchOffsets;
+	std::vector<unsigned int>		m_batchNumMatches;
+	std::vector<uint2>				m_hostKeyPointIndices;
+	std::vector<float>				m_hostMatchDistances;
+};
+
+#endif //SIFT_MATCH_CPU_H
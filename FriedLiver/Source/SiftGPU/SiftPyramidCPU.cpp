@@ -0,0 +1,779 @@
+#include "stdafx.h"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include <limits>
+#include <emmintrin.h>
+
+#include "SiftPyramidCPU.h"
+#include "SiftGPU.h"
+#include "ProgramCU.h"
+#include "../ThreadPool.h"
+
+extern "C" void getConstantSiftCameraParams(SiftCameraParams& params);
+
+namespace {
+
+	const float PI = 3.14159265358979323846f;
+
+	//rows per parallel task
+	const int TILE_HEIGHT = 8;
+
+	//! calls f(yBegin, yEnd) for tiles of TILE_HEIGHT rows in parallel
+	template<typename F>
+	void forEachRowTile(int rowBegin, int rowEnd, F f)
+	{
+		if (rowEnd <= rowBegin) return;
+		const unsigned int numTiles = (unsigned int)(rowEnd - rowBegin + TILE_HEIGHT - 1) / TILE_HEIGHT;
+		ThreadPool::get().parallelFor(0, numTiles, [&](unsigned int tile) {
+			const int yBegin = rowBegin + (int)tile * TILE_HEIGHT;
+			f(yBegin, std::min(rowEnd, yBegin + TILE_HEIGHT));
+		});
+	}
+
+	inline int roundToInt(float f) {
+		return (int)std::floor(f + 0.5f);
+	}
+
+	inline __m128 abs4(__m128 a) {
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+	}
+
+	//! one row of the 3x3x3 extremum test (READ_CMP_DOG_DATA in ProgramCU.cu, including its order dependence)
+	inline bool compareRow(const float* row, float v, float& nmax, float& nmin)
+	{
+		if (v > nmax) {
+			nmax = std::max(nmax, std::max(row[-1], std::max(row[0], row[1])));
+			return !(v < nmax);
+		}
+		nmin = std::min(nmin, std::min(row[-1], std::min(row[0], row[1])));
+		return !(v > nmin);
+	}
+
+	//! ComputeKEY_Kernel without subpixel localization; edgeThreshold is already (r+1)^2/r
+	inline bool isKeyPoint(const float* dogP, const float* dog, const float* dogN, int width, int idx, float dogThreshold, float edgeThreshold)
+	{
+		const float v = dog[idx];
+		if (std::fabs(v) <= dogThreshold) return false;
+
+		const float* r0 = dog + idx - width;
+		const float* r1 = dog + idx;
+		const float* r2 = dog + idx + width;
+		float nmax = std::max(r1[-1], r1[1]);
+		float nmin = std::min(r1[-1], r1[1]);
+		if (v <= nmax && v >= nmin) return false;
+		if (!compareRow(r0, v, nmax, nmin)) return false;
+		if (!compareRow(r2, v, nmax, nmin)) return false;
+
+		//edge suppression
+		const float vx2 = v * 2.0f;
+		const float fxx = r1[-1] + r1[1] - vx2;
+		const float fyy = r0[0] + r2[0] - vx2;
+		const float fxy = 0.25f * (r2[1] + r0[-1] - r2[-1] - r0[1]);
+		const float temp1 = fxx * fyy - fxy * fxy;
+		const float temp2 = (fxx + fyy) * (fxx + fyy);
+		if (temp1 <= 0 || temp2 > edgeThreshold * temp1) return false;
+
+		for (int i = -1; i <= 1; i++) {
+			if (!compareRow(dogP + idx + i * width, v, nmax, nmin)) return false;
+		}
+		for (int i = -1; i <= 1; i++) {
+			if (!compareRow(dogN + idx + i * width, v, nmax, nmin)) return false;
+		}
+		return true;
+	}
+}
+
+SiftPyramidCPU::SiftPyramidCPU(SiftParam& sp) : m_param(sp)
+{
+	m_allocated = false;
+	m_pyramidWidth = m_pyramidHeight = 0;
+	m_octaveNum = 0;
+	m_levelNum = 0;
+	for (unsigned int i = 0; i < TIMING_NUM; i++) m_timings[i] = 0.0;
+	m_numTimedFrames = 0;
+	m_pipelined = true;
+	m_inputColor = m_inputDepth = NULL;
+}
+
+SiftPyramidCPU::~SiftPyramidCPU()
+{
+}
+
+void SiftPyramidCPU::InitPyramid(int w, int h)
+{
+	w = w & 0xfffffffc;
+	if (m_allocated && w == m_pyramidWidth && h == m_pyramidHeight) return;
+	if (GlobalUtil::_octave_min_default != 0) {
+		std::cout << "ERROR: SiftPyramidCPU only supports first octave 0" << std::endl;
+		return;
+	}
+
+	m_pyramidWidth = w;
+	m_pyramidHeight = h;
+	m_octaveNum = GlobalUtil::_octave_num_default;
+	if (m_octaveNum < 1) m_octaveNum = std::max(1, (int)floor(log(double(std::min(w, h))) / log(2.0)) - 3);
+	m_levelNum = m_param._level_num;
+
+	//same kernels as ProgramCU::InitFilterKernels
+	std::vector<float> sigmas;
+	sigmas.push_back(m_param.GetInitialSmoothSigma(0));
+	for (int i = m_param._level_min + 1; i <= m_param._level_max; i++) sigmas.push_back(m_param._sigma[i - m_param._level_min - 1]);
+	m_filterKernels.resize(sigmas.size());
+	for (size_t i = 0; i < sigmas.size(); i++) {
+		float kernel[64];
+		int width;
+		ProgramCU::CreateFilterKernel(sigmas[i], kernel, width);
+		m_filterKernels[i].assign(kernel, kernel + width);
+	}
+
+	m_octaveWidth.resize(m_octaveNum);
+	m_octaveHeight.resize(m_octaveNum);
+	m_gaussian.resize(m_octaveNum * m_levelNum);
+	m_dog.resize(m_octaveNum * m_levelNum);
+	m_gradient.resize(m_octaveNum * m_levelNum);
+	const int numFeatureLevels = m_octaveNum * m_param._dog_level_num;
+	m_levelCandidates.resize(numFeatureLevels);
+	m_levelFeatures.resize(numFeatureLevels);
+	m_levelMaxFeatures.resize(numFeatureLevels);
+	for (int i = 0; i < m_octaveNum; i++) {
+		const int wa = (((w >> i) + 3) / 4) * 4;
+		const int ha = h >> i;
+		m_octaveWidth[i] = wa;
+		m_octaveHeight[i] = ha;
+		for (int j = 0; j < m_levelNum; j++) {
+			m_gaussian[i * m_levelNum + j].resize(wa * ha);
+			if (j > 0) m_dog[i * m_levelNum + j].resize(wa * ha);
+			m_gradient[i * m_levelNum + j].clear();		//allocated on demand
+		}
+		int fmax = int(wa * ha * GlobalUtil::_MaxFeaturePercent);
+		if (fmax > GlobalUtil::_MaxLevelFeatureNum) fmax = GlobalUtil::_MaxLevelFeatureNum;
+		else if (fmax < 32) fmax = 32;
+		for (int j = 0; j < m_param._dog_level_num; j++) m_levelMaxFeatures[i * m_param._dog_level_num + j] = fmax;
+	}
+	m_filterBuffers.resize(m_octaveNum);
+	for (int i = 0; i < m_octaveNum; i++) m_filterBuffers[i].resize(m_octaveWidth[i] * m_octaveHeight[i]);
+	m_hostColor.resize(w * h);
+
+	m_allocated = true;
+}
+
+void SiftPyramidCPU::RunSIFT(const float* d_colorData, const float* d_depthData)
+{
+	SiftCameraParams params;
+	getConstantSiftCameraParams(params);
+
+	m_hostDepth.resize(params.m_depthWidth * params.m_depthHeight);
+	cutilSafeCall(cudaMemcpy(m_hostColor.data(), d_colorData, sizeof(float) * m_hostColor.size(), cudaMemcpyDeviceToHost));
+	cutilSafeCall(cudaMemcpy(m_hostDepth.data(), d_depthData, sizeof(float) * m_hostDepth.size(), cudaMemcpyDeviceToHost));
+
+	RunSIFTHost(m_hostColor.data(), m_hostDepth.data(), params);
+}
+
+void SiftPyramidCPU::RunSIFTHost(const float* colorData, const float* depthData, const SiftCameraParams& params)
+{
+	Timer timer;
+	double t[TIMING_NUM];
+
+	m_inputColor = colorData;
+	m_inputDepth = depthData;
+	m_cameraParams = params;
+
+	timer.start();
+	if (m_pipelined) {
+		BuildPyramidPipelined();	//includes the keypoint detection
+		timer.stop(); t[TIMING_BUILD_PYRAMID] = timer.getElapsedTimeMS();
+		timer.start();
+	}
+	else {
+		BuildPyramid();
+		timer.stop(); t[TIMING_BUILD_PYRAMID] = timer.getElapsedTimeMS();
+		timer.start();
+		DetectKeypoints();
+	}
+	LimitFeatureCount();
+	timer.stop(); t[TIMING_DETECT_KEYPOINTS] = timer.getElapsedTimeMS();
+
+	timer.start();
+	ComputeGradients(params.m_minKeyScale);
+	GetFeatureOrientations(params);
+	timer.stop(); t[TIMING_ORIENTATIONS] = timer.getElapsedTimeMS();
+
+	timer.start();
+	GetFeatureDescriptors();
+	CreateKeyPointList(depthData, params);
+	timer.stop(); t[TIMING_DESCRIPTORS] = timer.getElapsedTimeMS();
+
+	if (GlobalUtil::_EnableDetailedTimings) {
+		for (unsigned int i = 0; i < TIMING_NUM; i++) m_timings[i] += t[i];
+		m_numTimedFrames++;
+	}
+}
+
+void SiftPyramidCPU::FilterRowsH(float* dst, const float* src, int width, int yBegin, int yEnd, unsigned int filterIndex) const
+{
+	//FilterH
+	const std::vector<float>& kernel = m_filterKernels[filterIndex];
+	const int kernelWidth = (int)kernel.size();
+	const int r = kernelWidth / 2;
+	std::vector<float> padded(width + 2 * r);
+	for (int y = yBegin; y < yEnd; y++) {
+		const float* srcRow = src + y * width;
+		float* dstRow = dst + y * width;
+		for (int i = 0; i < r; i++) {
+			padded[i] = srcRow[0];
+			padded[width + r + i] = srcRow[width - 1];
+		}
+		std::copy(srcRow, srcRow + width, padded.begin() + r);
+
+		const float* p = padded.data();
+		int x = 0;
+		for (; x + 4 <= width; x += 4) {
+			__m128 acc = _mm_setzero_ps();
+			for (int i = 0; i < kernelWidth; i++) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(p + x + i), _mm_set1_ps(kernel[i])));
+			_mm_storeu_ps(dstRow + x, acc);
+		}
+		for (; x < width; x++) {
+			float value = 0;
+			for (int i = 0; i < kernelWidth; i++) value += p[x + i] * kernel[i];
+			dstRow[x] = value;
+		}
+	}
+}
+
+void SiftPyramidCPU::FilterRowsV(float* dst, const float* src, int width, int height, int yBegin, int yEnd, unsigned int filterIndex) const
+{
+	//FilterV
+	const std::vector<float>& kernel = m_filterKernels[filterIndex];
+	const int kernelWidth = (int)kernel.size();
+	const int r = kernelWidth / 2;
+	std::vector<const float*> rows(kernelWidth);
+	for (int y = yBegin; y < yEnd; y++) {
+		for (int i = 0; i < kernelWidth; i++) rows[i] = src + std::min(std::max(y - r + i, 0), height - 1) * width;
+		float* dstRow = dst + y * width;
+		int x = 0;
+		for (; x + 4 <= width; x += 4) {
+			__m128 acc = _mm_setzero_ps();
+			for (int i = 0; i < kernelWidth; i++) acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(rows[i] + x), _mm_set1_ps(kernel[i])));
+			_mm_storeu_ps(dstRow + x, acc);
+		}
+		for (; x < width; x++) {
+			float value = 0;
+			for (int i = 0; i < kernelWidth; i++) value += rows[i][x] * kernel[i];
+			dstRow[x] = value;
+		}
+	}
+}
+
+void SiftPyramidCPU::SampleRows(int octave, int yBegin, int yEnd)
+{
+	//SampleImageD from level_ds of the previous octave
+	const float* src = getGaussian(octave - 1, m_param._level_ds - m_param._level_min);
+	const int srcWidth = m_octaveWidth[octave - 1];
+	const int width = m_octaveWidth[octave];
+	float* dst = getGaussian(octave, 0);
+	for (int y = yBegin; y < yEnd; y++) {
+		const float* srcRow = src + (2 * y) * srcWidth;
+		for (int x = 0; x < width; x++) dst[y * width + x] = srcRow[std::min(2 * x, srcWidth - 1)];
+	}
+}
+
+void SiftPyramidCPU::ComputeDOGRows(int octave, int level, int yBegin, int yEnd)
+{
+	const int width = m_octaveWidth[octave];
+	const float* gc = getGaussian(octave, level);
+	const float* gp = getGaussian(octave, level - 1);
+	float* dog = getDOG(octave, level);
+	int idx = yBegin * width;
+	const int idxEnd = yEnd * width;
+	for (; idx + 4 <= idxEnd; idx += 4) _mm_storeu_ps(dog + idx, _mm_sub_ps(_mm_loadu_ps(gc + idx), _mm_loadu_ps(gp + idx)));
+	for (; idx < idxEnd; idx++) dog[idx] = gc[idx] - gp[idx];
+}
+
+void SiftPyramidCPU::DetectRows(int octave, int level, int yBegin, int yEnd, std::vector<Candidate>& candidates)
+{
+	const SiftCameraParams& params = m_cameraParams;
+	const float keyLocOffset = GlobalUtil::_LoweOrigin ? 0 : 0.5f;
+	const float keyLocScale = (float)(1 << octave);
+	const float dogThreshold = m_param._dog_threshold;
+	const float edgeThreshold = (m_param._edge_threshold + 1) * (m_param._edge_threshold + 1) / m_param._edge_threshold;
+	const float depthScaleX = (float)(params.m_depthWidth - 1) / (float)(params.m_intensityWidth - 1);
+	const float depthScaleY = (float)(params.m_depthHeight - 1) / (float)(params.m_intensityHeight - 1);
+	const float depthMin = GlobalUtil::_SiftDepthMin, depthMax = GlobalUtil::_SiftDepthMax;
+	const float minusInf = -std::numeric_limits<float>::infinity();
+
+	const int width = m_octaveWidth[octave];
+	const float* dogP = getDOG(octave, level + 1);
+	const float* dog = getDOG(octave, level + 2);
+	const float* dogN = getDOG(octave, level + 3);
+	const int colBegin = 1, colEnd = width - 2;
+
+	auto testPixel = [&](int col, int row) {
+		const int idx = row * width + col;
+		if (!isKeyPoint(dogP, dog, dogN, width, idx, dogThreshold, edgeThreshold)) return;
+		//check if has valid depth
+		const int depthx = roundToInt((keyLocScale * (float)col + keyLocOffset) * depthScaleX);
+		const int depthy = roundToInt((keyLocScale * (float)row + keyLocOffset) * depthScaleY);
+		if (depthx < 0 || depthx >= (int)params.m_depthWidth || depthy < 0 || depthy >= (int)params.m_depthHeight) return;
+		const float depth = m_inputDepth[depthy * params.m_depthWidth + depthx];
+		if (depth == minusInf || depth < depthMin || depth > depthMax) return;
+		Candidate c;
+		c.col = col;	c.row = row;
+		candidates.push_back(c);
+	};
+
+	const __m128 thresh = _mm_set1_ps(dogThreshold);
+	for (int row = yBegin; row < yEnd; row++) {
+		const float* r = dog + row * width;
+		int col = colBegin;
+		//pre-test (threshold and horizontal neighbors) on 4 pixels at once
+		for (; col + 4 <= colEnd; col += 4) {
+			const __m128 v = _mm_loadu_ps(r + col);
+			const __m128 left = _mm_loadu_ps(r + col - 1);
+			const __m128 right = _mm_loadu_ps(r + col + 1);
+			const __m128 extremum = _mm_or_ps(_mm_cmpgt_ps(v, _mm_max_ps(left, right)), _mm_cmplt_ps(v, _mm_min_ps(left, right)));
+			const int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpgt_ps(abs4(v), thresh), extremum));
+			if (mask == 0) continue;
+			for (int k = 0; k < 4; k++) {
+				if (mask & (1 << k)) testPixel(col + k, row);
+			}
+		}
+		for (; col < colEnd; col++) testPixel(col, row);
+	}
+}
+
+void SiftPyramidCPU::RunRowJobs(std::vector<RowJob>& jobs)
+{
+	unsigned int numTiles = 0;
+	for (RowJob& job : jobs) {
+		job.firstTile = numTiles;
+		job.numTiles = job.rowEnd > job.rowBegin ? (unsigned int)(job.rowEnd - job.rowBegin + TILE_HEIGHT - 1) / TILE_HEIGHT : 0;
+		if (job.type == JOB_DETECT) job.tileCandidates.assign(job.numTiles, std::vector<Candidate>());
+		numTiles += job.numTiles;
+	}
+
+	ThreadPool::get().parallelFor(0, numTiles, [&](unsigned int tile) {
+		size_t k = 0;
+		while (tile >= jobs[k].firstTile + jobs[k].numTiles) k++;
+		RowJob& job = jobs[k];
+		const unsigned int t = tile - job.firstTile;
+		const int yBegin = job.rowBegin + (int)t * TILE_HEIGHT;
+		const int yEnd = std::min(job.rowEnd, yBegin + TILE_HEIGHT);
+		const int width = m_octaveWidth[job.octave], height = m_octaveHeight[job.octave];
+		switch (job.type) {
+		case JOB_FILTER_H:
+			FilterRowsH(m_filterBuffers[job.octave].data(), job.octave == 0 && job.level == 0 ? m_inputColor : getGaussian(job.octave, job.level - 1), width, yBegin, yEnd, job.level);
+			break;
+		case JOB_FILTER_V:
+			FilterRowsV(getGaussian(job.octave, job.level), m_filterBuffers[job.octave].data(), width, height, yBegin, yEnd, job.level);
+			break;
+		case JOB_SAMPLE:
+			SampleRows(job.octave, yBegin, yEnd);
+			break;
+		case JOB_DOG:
+			ComputeDOGRows(job.octave, job.level, yBegin, yEnd);
+			break;
+		case JOB_DETECT:
+			DetectRows(job.octave, job.level, yBegin, yEnd, job.tileCandidates[t]);
+			break;
+		}
+	});
+
+	//tiles are concatenated in raster order, so the candidate lists do not depend on the scheduling
+	for (RowJob& job : jobs) {
+		if (job.type != JOB_DETECT) continue;
+		const int levelIdx = job.octave * m_param._dog_level_num + job.level;
+		std::vector<Candidate>& levelCandidates = m_levelCandidates[levelIdx];
+		levelCandidates.clear();
+		for (const auto& tc : job.tileCandidates) {
+			levelCandidates.insert(levelCandidates.end(), tc.begin(), tc.end());
+		}
+		if ((int)levelCandidates.size() > m_levelMaxFeatures[levelIdx]) levelCandidates.resize(m_levelMaxFeatures[levelIdx]);
+	}
+}
+
+void SiftPyramidCPU::RunRowJob(RowJobType type, int octave, int level, int rowBegin, int rowEnd)
+{
+	std::vector<RowJob> jobs(1, RowJob(type, octave, level, rowBegin, rowEnd));
+	RunRowJobs(jobs);
+}
+
+void SiftPyramidCPU::BuildPyramid()
+{
+	for (int i = 0; i < m_octaveNum; i++) {
+		const int height = m_octaveHeight[i];
+		if (i == 0) {
+			RunRowJob(JOB_FILTER_H, i, 0, 0, height);
+			RunRowJob(JOB_FILTER_V, i, 0, 0, height);
+		}
+		else {
+			RunRowJob(JOB_SAMPLE, i, 0, 0, height);
+		}
+		for (int j = 1; j < m_levelNum; j++) {
+			RunRowJob(JOB_FILTER_H, i, j, 0, height);
+			RunRowJob(JOB_FILTER_V, i, j, 0, height);
+		}
+
+		//DoG for all levels (the extremum test needs the neighboring levels)
+		for (int j = 1; j < m_levelNum; j++) {
+			RunRowJob(JOB_DOG, i, j, 0, height);
+		}
+	}
+}
+
+void SiftPyramidCPU::DetectKeypoints()
+{
+	for (int i = 0; i < m_octaveNum; i++) {
+		for (int j = 0; j < m_param._dog_level_num; j++) {
+			RunRowJob(JOB_DETECT, i, j, 1, m_octaveHeight[i] - 2);
+		}
+	}
+}
+
+void SiftPyramidCPU::BuildPyramidPipelined()
+{
+	//octave i + 1 only needs level level_ds of octave i, so it starts (levelDS + 1) steps after octave i.
+	//in the step that blurs level k, the DoG of level k - 1 and the extrema of DoG level k - 2 run alongside.
+	//each step is two parallelFor calls over the row tiles of all jobs that are ready.
+	const int levelDS = m_param._level_ds - m_param._level_min;
+	const int numSteps = (m_octaveNum - 1) * (levelDS + 1) + m_levelNum + 1;
+	std::vector<RowJob> phase0, phase1;
+	for (int step = 0; step < numSteps; step++) {
+		phase0.clear();
+		phase1.clear();
+		for (int i = 0; i < m_octaveNum; i++) {
+			const int k = step - i * (levelDS + 1);
+			if (k < 0) break;
+			const int height = m_octaveHeight[i];
+
+			//phase 0: horizontal blur / downsampling of level k, DoG of level k - 1
+			//phase 1: vertical blur of level k, extrema of DoG level k - 2 (needs DoG levels k - 3 .. k - 1)
+			if (k < m_levelNum) {
+				if (i > 0 && k == 0) {
+					phase0.push_back(RowJob(JOB_SAMPLE, i, 0, 0, height));
+				}
+				else {
+					phase0.push_back(RowJob(JOB_FILTER_H, i, k, 0, height));
+					phase1.push_back(RowJob(JOB_FILTER_V, i, k, 0, height));
+				}
+			}
+			const int d = k - 1;
+			if (d >= 1 && d < m_levelNum) phase0.push_back(RowJob(JOB_DOG, i, d, 0, height));
+			const int j = d - 3;
+			if (j >= 0 && j < m_param._dog_level_num) phase1.push_back(RowJob(JOB_DETECT, i, j, 1, height - 2));
+		}
+		RunRowJobs(phase0);
+		RunRowJobs(phase1);
+	}
+}
+
+void SiftPyramidCPU::LimitFeatureCount()
+{
+	//skip the lowest levels to reduce number of features (SiftPyramid::LimitFeatureCount, truncate method 0)
+	if (GlobalUtil::_FeatureCountThreshold <= 0) return;
+	const int n = m_octaveNum * m_param._dog_level_num;
+	int featureNum = 0;
+	for (int i = 0; i < n; i++) featureNum += (int)m_levelCandidates[i].size();
+	for (int i = 0; i < n && featureNum - (int)m_levelCandidates[i].size() > GlobalUtil::_FeatureCountThreshold; i++) {
+		featureNum -= (int)m_levelCandidates[i].size();
+		m_levelCandidates[i].clear();
+	}
+}
+
+void SiftPyramidCPU::ComputeGradients(float minKeyScale)
+{
+	for (int i = 0; i < m_octaveNum; i++) {
+		const int width = m_octaveWidth[i], height = m_octaveHeight[i];
+		for (int j = 0; j < m_param._dog_level_num; j++) {
+			//only levels whose keypoints survive LimitFeatureCount and the minimum key scale
+			std::vector<float2>& got = m_gradient[i * m_levelNum + j + 1];
+			if (m_levelCandidates[i * m_param._dog_level_num + j].empty()) continue;
+			if (m_param.GetLevelSigma(j + m_param._level_min + 1) * (float)(1 << i) < minKeyScale) continue;
+			got.resize(width * height);
+
+			const float* gus = getGaussian(i, j + 1);
+			forEachRowTile(0, height, [&](int yBegin, int yEnd) {
+				for (int y = yBegin; y < yEnd; y++) {
+					const float* rowP = gus + std::max(y - 1, 0) * width;
+					const float* row = gus + y * width;
+					const float* rowN = gus + std::min(y + 1, height - 1) * width;
+					for (int x = 0; x < width; x++) {
+						const float dx = row[std::min(x + 1, width - 1)] - row[std::max(x - 1, 0)];
+						const float dy = rowN[x] - rowP[x];
+						const float grd = 0.5f * std::sqrt(dx * dx + dy * dy);
+						const float rot = (grd == 0.0f ? 0.0f : std::atan2(dy, dx));
+						got[y * width + x] = make_float2(grd, rot);
+					}
+				}
+			});
+		}
+	}
+}
+
+void SiftPyramidCPU::ComputeOrientations(const Candidate& c, const float2* got, int width, int height, float sigma, float& rot0, float& rot1, int& count) const
+{
+	const float tenDegreePerRadius = 5.7295779513082320876798154814105f;
+	const float kx = c.col + 0.5f, ky = c.row + 0.5f;
+	const float gsigma = sigma * 1.5f;
+	const float win = std::fabs(sigma) * 1.5f * 2.0f;
+	const float distThreshold = win * win + 0.5f;
+	const float factor = -0.5f / (gsigma * gsigma);
+	const float xmin = std::max(1.5f, std::floor(kx - win) + 0.5f);
+	const float ymin = std::max(1.5f, std::floor(ky - win) + 0.5f);
+	const float xmax = std::min(width - 1.5f, std::floor(kx + win) + 0.5f);
+	const float ymax = std::min(height - 1.5f, std::floor(ky + win) + 0.5f);
+
+	float vote[36];
+	std::fill(vote, vote + 36, 0.0f);
+	for (float y = ymin; y <= ymax; y += 1.0f) {
+		const float2* row = got + (int)y * width;
+		const float dy = y - ky;
+		for (float x = xmin; x <= xmax; x += 1.0f) {
+			const float dx = x - kx;
+			const float sqDist = dx * dx + dy * dy;
+			if (sqDist < distThreshold) {
+				const float2& g = row[(int)x];
+				const float weight = g.x * std::exp(sqDist * factor);
+				int oidx = (int)std::floor(g.y * tenDegreePerRadius);
+				if (oidx < 0) oidx += 36;
+				vote[std::min(oidx, 35)] += weight;
+			}
+		}
+	}
+
+	//filter the vote
+	float voteTmp[36];
+	for (int it = 0; it < 6; it++) {
+		for (int k = 0; k < 36; k++) voteTmp[k] = (vote[(k + 35) % 36] + vote[k] + vote[(k + 1) % 36]) * (1.0f / 3.0f);
+		std::copy(voteTmp, voteTmp + 36, vote);
+	}
+
+	float maxVote = 0.0f;
+	for (int k = 0; k < 36; k++) maxVote = std::max(maxVote, vote[k]);
+	const float voteThreshold = maxVote * 0.8f;
+
+	//two highest peaks (ties resolve to the lower bin, as the reduction in ComputeOrientation_Kernel)
+	int peak[2] = { -1, -1 };
+	for (int k = 0; k < 36; k++) {
+		const float m = vote[(k + 35) % 36], p = vote[(k + 1) % 36];
+		if (!(vote[k] > voteThreshold && vote[k] > m && vote[k] > p)) continue;
+		if (peak[0] < 0 || vote[k] > vote[peak[0]]) {
+			peak[1] = peak[0];
+			peak[0] = k;
+		}
+		else if (peak[1] < 0 || vote[k] > vote[peak[1]]) {
+			peak[1] = k;
+		}
+	}
+	count = 0;
+	float rot[2] = { 0.0f, 0.0f };
+	for (int i = 0; i < 2; i++) {
+		if (peak[i] < 0) break;
+		const int k = peak[i];
+		const float m = vote[(k + 35) % 36], p = vote[(k + 1) % 36];
+		const float di = 0.5f * (p - m) / (2.0f * vote[k] - p - m);
+		rot[i] = k + di + 0.5f;
+		count++;
+	}
+	rot0 = rot[0];
+	rot1 = rot[1];
+}
+
+void SiftPyramidCPU::GetFeatureOrientations(const SiftCameraParams& params)
+{
+	const float factor = (float)(2.0 * 3.14159265358979323846 / 65535.0);
+
+	for (int i = 0; i < m_octaveNum; i++) {
+		const int width = m_octaveWidth[i], height = m_octaveHeight[i];
+		const float keyLocScale = (float)(1 << i);
+		for (int j = 0; j < m_param._dog_level_num; j++) {
+			const int levelIdx = i * m_param._dog_level_num + j;
+			const std::vector<Candidate>& candidates = m_levelCandidates[levelIdx];
+			std::vector<Feature>& features = m_levelFeatures[levelIdx];
+			features.clear();
+
+			const float sigma = m_param.GetLevelSigma(j + m_param._level_min + 1);
+			//keypoints that are too small are dropped by ReshapeFeatureList anyway
+			if (candidates.empty() || sigma * keyLocScale < params.m_minKeyScale) continue;
+
+			//packed orientations as in ComputeOrientation_Kernel (65535 = none)
+			std::vector<unsigned short> orientations(2 * candidates.size());
+			const float2* got = getGradient(i, j + 1);
+			ThreadPool::get().parallelFor(0, (unsigned int)candidates.size(), [&](unsigned int c) {
+				float rot0, rot1;
+				int count;
+				ComputeOrientations(candidates[c], got, width, height, sigma, rot0, rot1, count);
+				unsigned short us[2] = { 65535, 65535 };
+				for (int k = 0; k < count; k++) {
+					float fr = (k == 0 ? rot0 : rot1) / 36.0f;
+					if (fr < 0) fr += 1.0f;
+					us[k] = (unsigned short)std::floor(fr * 65535.0f);
+				}
+				orientations[2 * c + 0] = us[0];
+				orientations[2 * c + 1] = us[1];
+			}, 16);
+
+			//ReshapeFeatureList: one feature per orientation
+			const size_t maxNumFeatures = (size_t)m_levelMaxFeatures[levelIdx];
+			for (size_t c = 0; c < candidates.size() && features.size() < maxNumFeatures; c++) {
+				const unsigned short us0 = orientations[2 * c + 0], us1 = orientations[2 * c + 1];
+				if (us0 == 65535) continue;
+				Feature f;
+				f.x = candidates[c].col + 0.5f;
+				f.y = candidates[c].row + 0.5f;
+				f.sigma = sigma;
+				f.orientation = factor * us0;
+				features.push_back(f);
+				if (us1 != 65535 && us1 != us0 && features.size() < maxNumFeatures) {
+					f.orientation = factor * us1;
+					features.push_back(f);
+				}
+			}
+		}
+	}
+
+	//LimitFeatureCount(1)
+	if (GlobalUtil::_FeatureCountThreshold > 0) {
+		const int n = m_octaveNum * m_param._dog_level_num;
+		int featureNum = 0;
+		for (int i = 0; i < n; i++) featureNum += (int)m_levelFeatures[i].size();
+		for (int i = 0; i < n && featureNum - (int)m_levelFeatures[i].size() > GlobalUtil::_FeatureCountThreshold; i++) {
+			featureNum -= (int)m_levelFeatures[i].size();
+			m_levelFeatures[i].clear();
+		}
+	}
+}
+
+void SiftPyramidCPU::ComputeDescriptor(const Feature& f, const float2* got, int width, int height, float* des) const
+{
+	const float rpi = 4.0f / PI;
+	const float spt = std::fabs(f.sigma * 3.0f);
+	const float s = std::sin(f.orientation), c = std::cos(f.orientation);
+	const float anglef = f.orientation > PI ? f.orientation - 2.0f * PI : f.orientation;
+	const float cspt = c * spt, sspt = s * spt;
+	const float crspt = c / spt, srspt = s / spt;
+	const float bsz = std::fabs(cspt) + std::fabs(sspt);
+
+	std::fill(des, des + 128, 0.0f);
+	for (int bidx = 0; bidx < 16; bidx++) {
+		const int ix = bidx & 0x3, iy = bidx >> 2;
+		const float offsetX = ix - 1.5f, offsetY = iy - 1.5f;
+		const float ptX = cspt * offsetX - sspt * offsetY + f.x;
+		const float ptY = cspt * offsetY + sspt * offsetX + f.y;
+		const float xmin = std::max(1.5f, std::floor(ptX - bsz) + 0.5f);
+		const float ymin = std::max(1.5f, std::floor(ptY - bsz) + 0.5f);
+		const float xmax = std::min(width - 1.5f, std::floor(ptX + bsz) + 0.5f);
+		const float ymax = std::min(height - 1.5f, std::floor(ptY + bsz) + 0.5f);
+		float* d = des + bidx * 8;
+
+		for (float y = ymin; y <= ymax; y += 1.0f) {
+			const float2* row = got + (int)y * width;
+			const float dy = y - ptY;
+			for (float x = xmin; x <= xmax; x += 1.0f) {
+				const float dx = x - ptX;
+				const float nx = crspt * dx + srspt * dy;
+				const float ny = crspt * dy - srspt * dx;
+				const float nxn = std::fabs(nx), nyn = std::fabs(ny);
+				if (nxn < 1.0f && nyn < 1.0f) {
+					const float2& cc = row[(int)x];
+					const float dnx = nx + offsetX, dny = ny + offsetY;
+					const float ww = std::exp(-0.125f * (dnx * dnx + dny * dny));
+					const float weight = ww * (1.0f - nxn) * (1.0f - nyn) * cc.x;
+					float theta = (anglef - cc.y) * rpi;
+					if (theta < 0) theta += 8.0f;
+					const float fo = std::floor(theta);
+					const int fidx = (int)fo & 0x7;
+					d[fidx] += (fo + 1.0f - theta) * weight;
+					d[(fidx + 1) & 0x7] += (theta - fo) * weight;
+				}
+			}
+		}
+	}
+
+	if (GlobalUtil::_NormalizedSIFT) {
+		float norm = 0.0f;
+		for (int k = 0; k < 128; k++) norm += des[k] * des[k];
+		if (norm == 0.0f) return;
+		norm = 1.0f / std::sqrt(norm);
+		for (int k = 0; k < 128; k++) des[k] = std::min(0.2f, des[k] * norm);
+		norm = 0.0f;
+		for (int k = 0; k < 128; k++) norm += des[k] * des[k];
+		norm = 1.0f / std::sqrt(norm);
+		for (int k = 0; k < 128; k++) des[k] *= norm;
+	}
+}
+
+void SiftPyramidCPU::GetFeatureDescriptors()
+{
+	unsigned int numFeatures = 0;
+	for (const auto& lf : m_levelFeatures) numFeatures += (unsigned int)lf.size();
+	m_descriptors.resize(numFeatures);
+
+	unsigned int offset = 0;
+	for (int i = 0; i < m_octaveNum; i++) {
+		const int width = m_octaveWidth[i], height = m_octaveHeight[i];
+		for (int j = 0; j < m_param._dog_level_num; j++) {
+			const std::vector<Feature>& features = m_levelFeatures[i * m_param._dog_level_num + j];
+			if (features.empty()) continue;
+			const float2* got = getGradient(i, j + 1);
+			SIFTKeyPointDesc* out = m_descriptors.data() + offset;
+			ThreadPool::get().parallelFor(0, (unsigned int)features.size(), [&](unsigned int f) {
+				float des[128];
+				ComputeDescriptor(features[f], got, width, height, des);
+				//ConvertDescriptorToUChar
+				for (int k = 0; k < 128; k++) out[f].feature[k] = (unsigned char)int(512 * des[k] + 0.5f);
+			}, 8);
+			offset += (unsigned int)features.size();
+		}
+	}
+}
+
+void SiftPyramidCPU::CreateKeyPointList(const float* depthData, const SiftCameraParams& params)
+{
+	const float keyLocOffset = GlobalUtil::_LoweOrigin ? 0 : 0.5f;
+	const float depthScaleX = (float)(params.m_depthWidth - 1) / (float)(params.m_intensityWidth - 1);
+	const float depthScaleY = (float)(params.m_depthHeight - 1) / (float)(params.m_intensityHeight - 1);
+
+	m_keyPoints.clear();
+	for (int i = 0; i < m_octaveNum; i++) {
+		const float keyLocScale = (float)(1 << i);
+		for (int j = 0; j < m_param._dog_level_num; j++) {
+			for (const Feature& f : m_levelFeatures[i * m_param._dog_level_num + j]) {
+				SIFTKeyPoint key;
+				key.pos = make_float2(keyLocScale * (f.x - 0.5f) + keyLocOffset, keyLocScale * (f.y - 0.5f) + keyLocOffset);
+				key.scale = keyLocScale * f.sigma;
+				const int depthX = roundToInt(key.pos.x * depthScaleX);
+				const int depthY = roundToInt(key.pos.y * depthScaleY);
+				key.depth = depthData[depthY * params.m_depthWidth + depthX];	//checked in DetectKeypoints
+				m_keyPoints.push_back(key);
+			}
+		}
+	}
+}
+
+void SiftPyramidCPU::GetKeyPointsCUDA(float4* d_keypoints, unsigned int maxNumKeyPoints)
+{
+	const unsigned int num = std::min((unsigned int)m_keyPoints.size(), maxNumKeyPoints);
+	if (num > 0) cutilSafeCall(cudaMemcpy(d_keypoints, m_keyPoints.data(), sizeof(SIFTKeyPoint) * num, cudaMemcpyHostToDevice));
+}
+
+void SiftPyramidCPU::GetFeatureVectorCUDA(unsigned char* d_descriptor, unsigned int maxNumKeyPoints)
+{
+	const unsigned int num = std::min((unsigned int)m_descriptors.size(), maxNumKeyPoints);
+	if (num > 0) cutilSafeCall(cudaMemcpy(d_descriptor, m_descriptors.data(), sizeof(SIFTKeyPointDesc) * num, cudaMemcpyHostToDevice));
+}
+
+void SiftPyramidCPU::EvaluateTimings()
+{
+	if (!GlobalUtil::_EnableDetailedTimings || m_numTimedFrames == 0) {
+		std::cout << "Error timings not enabled" << std::endl;
+		return;
+	}
+	const char* names[TIMING_NUM] = { m_pipelined ? "BuildPyramid+DetectKeypoints" : "BuildPyramid", m_pipelined ? "LimitFeatureCount" : "DetectKeypoints", "GetFeatureOrientations", "GetFeatureDescriptors" };
+	std::cout << "SiftPyramidCPU timings (" << m_numTimedFrames << " frames, " << ThreadPool::get().getNumThreads() << " threads, " << (m_pipelined ? "pipelined" : "level by level") << ")" << std::endl;
+	for (unsigned int i = 0; i < TIMING_NUM; i++) {
+		std::cout << "\t" << names[i] << ": " << m_timings[i] / m_numTimedFrames << " ms" << std::endl;
+	}
+}
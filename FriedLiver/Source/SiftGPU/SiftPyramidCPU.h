@@ -0,0 +1,136 @@
+#pragma once
+#ifndef SIFT_PYRAMID_CPU_H
+#define SIFT_PYRAMID_CPU_H
+
+#include <vector>
+#include <string>
+#include <cuda_runtime.h>
+
+#include "GlobalUtil.h"
+#include "SiftCameraParams.h"
+#include "SIFTImageManager.h"
+
+class SiftParam;
+
+//! host version of SiftPyramid: same pyramid, DoG, keypoint, orientation and descriptor stages as the ProgramCU kernels
+//! (no subpixel localization, up to two orientations per keypoint); rows and keypoints are processed in parallel on ThreadPool::get(), the filters use SSE
+//! unlike the GPU path the feature lists are deterministic (raster order per level instead of atomic append order)
+class SiftPyramidCPU : public GlobalUtil
+{
+public:
+	SiftPyramidCPU(SiftParam& sp);
+	~SiftPyramidCPU();
+
+	//! allocates the pyramid for w x h input images (octave count as in SiftPyramid::ResizePyramid)
+	void InitPyramid(int w, int h);
+	bool isAllocated() const { return m_allocated; }
+	int getPyramidWidth() const { return m_pyramidWidth; }
+	int getPyramidHeight() const { return m_pyramidHeight; }
+
+	//! true (default): independent pyramid levels, DoG/extrema detection and octaves run concurrently (BuildPyramidPipelined);
+	//! false: level by level as SiftPyramid. both produce the same features
+	void setPipelined(bool b) { m_pipelined = b; }
+	bool isPipelined() const { return m_pipelined; }
+
+	//! input in device memory (as SiftPyramid::RunSIFT); downloaded and processed on the host with the current sift camera params
+	void RunSIFT(const float* d_colorData, const float* d_depthData);
+	//! input in host memory; colorData has the pyramid size, depthData params.m_depthWidth x params.m_depthHeight
+	void RunSIFTHost(const float* colorData, const float* depthData, const SiftCameraParams& params);
+
+	int GetFeatureNum() const { return (int)m_keyPoints.size(); }
+
+	//! copy the first min(GetFeatureNum(), maxNumKeyPoints) keypoints / descriptors of the last RunSIFT to device memory (same layout as SiftPyramid::GetKeyPointsCUDA / GetFeatureVectorCUDA)
+	void GetKeyPointsCUDA(float4* d_keypoints, unsigned int maxNumKeyPoints);
+	void GetFeatureVectorCUDA(unsigned char* d_descriptor, unsigned int maxNumKeyPoints);
+
+	const std::vector<SIFTKeyPoint>& getKeyPoints() const { return m_keyPoints; }
+	const std::vector<SIFTKeyPointDesc>& getDescriptors() const { return m_descriptors; }
+
+	void EvaluateTimings();
+
+private:
+	struct Feature {
+		float x, y, sigma, orientation;	//x, y in pixel centers of the octave (col + 0.5)
+	};
+	struct Candidate {
+		int col, row;
+	};
+	enum RowJobType {
+		JOB_FILTER_H = 0,	//level - 1 (or the input) -> filter buffer of the octave
+		JOB_FILTER_V,		//filter buffer -> level
+		JOB_SAMPLE,			//level 0 from level_ds of the previous octave
+		JOB_DOG,
+		JOB_DETECT			//extrema of DoG level (level = feature level 0 .. dog_level_num - 1)
+	};
+	//! one pass over the rows of an image; RunRowJobs splits all jobs of a batch into row tiles
+	struct RowJob {
+		RowJob(RowJobType t, int o, int l, int r0, int r1) : type(t), octave(o), level(l), rowBegin(r0), rowEnd(r1), firstTile(0), numTiles(0) {}
+		RowJobType type;
+		int octave, level;
+		int rowBegin, rowEnd;
+		unsigned int firstTile, numTiles;
+		std::vector<std::vector<Candidate>> tileCandidates;	//JOB_DETECT
+	};
+	enum {
+		TIMING_BUILD_PYRAMID = 0,
+		TIMING_DETECT_KEYPOINTS,
+		TIMING_ORIENTATIONS,
+		TIMING_DESCRIPTORS,
+		TIMING_NUM
+	};
+
+	float* getGaussian(int octave, int level) { return m_gaussian[octave * m_levelNum + level].data(); }
+	float* getDOG(int octave, int level) { return m_dog[octave * m_levelNum + level].data(); }
+	float2* getGradient(int octave, int level) { return m_gradient[octave * m_levelNum + level].data(); }
+
+	void BuildPyramid();
+	void DetectKeypoints();
+	void BuildPyramidPipelined();
+	void LimitFeatureCount();
+	void ComputeGradients(float minKeyScale);
+	void GetFeatureOrientations(const SiftCameraParams& params);
+	void GetFeatureDescriptors();
+	void CreateKeyPointList(const float* depthData, const SiftCameraParams& params);
+
+	//! runs all jobs of the batch concurrently (the jobs must not depend on each other)
+	void RunRowJobs(std::vector<RowJob>& jobs);
+	void RunRowJob(RowJobType type, int octave, int level, int rowBegin, int rowEnd);
+	//! separable gaussian with clamp to edge (ProgramCU::FilterImage), rows [yBegin, yEnd)
+	void FilterRowsH(float* dst, const float* src, int width, int yBegin, int yEnd, unsigned int filterIndex) const;
+	void FilterRowsV(float* dst, const float* src, int width, int height, int yBegin, int yEnd, unsigned int filterIndex) const;
+	void SampleRows(int octave, int yBegin, int yEnd);
+	void ComputeDOGRows(int octave, int level, int yBegin, int yEnd);
+	void DetectRows(int octave, int level, int yBegin, int yEnd, std::vector<Candidate>& candidates);
+	void ComputeOrientations(const Candidate& c, const float2* got, int width, int height, float sigma, float& rot0, float& rot1, int& count) const;
+	void ComputeDescriptor(const Feature& f, const float2* got, int width, int height, float* des) const;
+
+	SiftParam&						m_param;
+	bool							m_allocated;
+	int								m_pyramidWidth, m_pyramidHeight;
+	int								m_octaveNum, m_levelNum;
+	std::vector<int>				m_octaveWidth, m_octaveHeight;
+
+	std::vector<std::vector<float>>	m_filterKernels;	//[0]: initial smoothing, [j + 1]: level j -> j + 1
+	std::vector<std::vector<float>>	m_filterBuffers;	//[octave]
+	bool							m_pipelined;
+
+	std::vector<std::vector<float>>	m_gaussian;			//[octave * levelNum + level]
+	std::vector<std::vector<float>>	m_dog;
+	std::vector<std::vector<float2>> m_gradient;		//(magnitude, orientation); only levels with features
+
+	std::vector<std::vector<Candidate>>	m_levelCandidates;	//[octave * dogLevelNum + level]
+	std::vector<std::vector<Feature>>	m_levelFeatures;
+	std::vector<int>					m_levelMaxFeatures;
+
+	std::vector<float>				m_hostColor, m_hostDepth;
+	const float*					m_inputColor;		//inputs of the current RunSIFTHost
+	const float*					m_inputDepth;
+	SiftCameraParams				m_cameraParams;
+	std::vector<SIFTKeyPoint>		m_keyPoints;
+	std::vector<SIFTKeyPointDesc>	m_descriptors;
+
+	double							m_timings[TIMING_NUM];
+	unsigned int					m_numTimedFrames;
+};
+
+#endif //SIFT_PYRAMID_CPU_H
@@ -89,4 +89,321 @@ __host__ __device__ inline float2 computeEigenVector(const float2x2& aTa, float
 }
 
 
+//! jacobi eigen decomposition of a symmetric 3x3 matrix (numerical recipes)
+class MYEIGEN {
+public:
+
+	static inline bool __device__ __host__ eigenSystem(const float3x3& m, float3& eigenvalues, float3& ev0, float3& ev1, float3& ev2, bool sort = true) {
+		float* evs[3] = { (float*)&ev0, (float*)&ev1, (float*)&ev2 };
+		return eigenSystem<3>((const float*)&m, (float*)&eigenvalues, evs, sort);
+	}
+
+	//static inline bool __device__ __host__ eigenSystem3x3(const float3x3& m, float3& eigenvalues, float3& ev0, float3& ev1, float3& ev2, bool sort = true) {
+
+	//	float3x3 eigenvectors;
+	//	bool res = eigenSystem3x3(m, (float*)&eigenvalues, eigenvectors, sort);
+	//	ev0 = eigenvectors.getRow(0);
+	//	ev1 = eigenvectors.getRow(1);
+	//	ev2 = eigenvectors.getRow(2);
+	//	return res;
+	//}
+private:
+
+
+	//static inline bool __device__ __host__ eigenSystem3x3(const float3x3& m, float* eigenvalues, float3x3& eigenvectors, bool sort = true) {
+
+	//	int num_of_required_jabobi_rotations;
+	//	float3x3 input = m;
+	//	if (!jacobi3(input.entries2, eigenvalues, eigenvectors.entries2, &num_of_required_jabobi_rotations)) {
+	//		return false;
+	//	}
+
+	//	if (sort) {
+	//		//simple selection sort
+	//		for (unsigned int i = 0; i < 3; i++) {
+	//			float currMax = 0.0f;
+	//			unsigned int currMaxIdx = (unsigned int)-1;
+	//			for (unsigned int j = i; j < 3; j++) {
+	//				if (fabsf(eigenvalues[j]) > currMax) {
+	//					currMax = fabsf(eigenvalues[j]);
+	//					currMaxIdx = j;
+	//				}
+	//			}
+
+	//			if (currMaxIdx != i && currMaxIdx != (unsigned int)-1) {
+	//				swap(eigenvalues[i], eigenvalues[currMaxIdx]);
+	//				for (unsigned int j = 0; j < 3; j++) {
+	//					//swap(eigenvectors(i, j), eigenvectors(currMaxIdx, j));
+	//					swap(eigenvectors(i,j), eigenvectors(currMaxIdx,j));
+	//				}
+	//			}
+	//		}
+	//	}
+
+	//	return true;
+	//}
+
+
+
+	template<unsigned int n>
+	static inline bool __device__ __host__ eigenSystem(const float* m, float* eigenvalues, float** eigenvectors, bool sort = true) {
+		//TODO ONLY WORKS for n==3
+		float tmpCV0[n + 1], tmpCV1[n + 1], tmpCV2[n + 1], tmpCV3[n + 1];
+		float* tmpCV[n + 1] = { tmpCV0, tmpCV1, tmpCV2, tmpCV3 };
+		float** CV = tmpCV;
+
+		float tmpLambda[n + 1];
+		float* lambda = tmpLambda;
+
+		float tmpV0[n + 1], tmpV1[n + 1], tmpV2[n + 1], tmpV3[n + 1];
+		float* tmpV[n + 1] = { tmpV0, tmpV1, tmpV2, tmpV3 };
+		float** v = tmpV;
+
+		for (unsigned int i = 0; i < n; i++) {
+			for (unsigned int j = 0; j < n; j++) {
+				CV[i + 1][j + 1] = m[i + n*j];
+			}
+		}
+
+		int num_of_required_jabobi_rotations;
+
+		if (!jacobi<n>(CV, lambda, v, &num_of_required_jabobi_rotations)) {
+			return false;
+		}
+
+		for (unsigned int i = 0; i < n; i++) {
+			eigenvalues[i] = lambda[i + 1];
+			for (unsigned int j = 0; j < n; j++) {
+				eigenvectors[i][j] = v[i + 1][j + 1];
+			}
+		}
+
+		if (sort) {
+			//simple selection sort
+			for (unsigned int i = 0; i < n; i++) {
+				float currMax = 0.0f;
+				unsigned int currMaxIdx = (unsigned int)-1;
+				for (unsigned int j = i; j < n; j++) {
+					if (fabsf(eigenvalues[j]) > currMax) {
+						currMax = fabsf(eigenvalues[j]);
+						currMaxIdx = j;
+					}
+				}
+
+				if (currMaxIdx != i && currMaxIdx != (unsigned int)-1) {
+					swap(eigenvalues[i], eigenvalues[currMaxIdx]);
+					for (unsigned int j = 0; j < n; j++) {
+						//swap(eigenvectors(i, j), eigenvectors(currMaxIdx, j));
+						swap(eigenvectors[i][j], eigenvectors[currMaxIdx][j]);
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	template<class T>
+	__host__ __device__ inline static void swap(T& a, T& b) {
+		T tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+#define CUDA_SVD_ROTATE(a,i,j,k,l) {g=a[i][j];h=a[k][l];a[i][j]=g-s*(h+g*tau);a[k][l]=h+s*(g-h*tau); }
+
+
+	template<unsigned int n>
+	static inline __device__ __host__ bool jacobi(float **a, float d[], float **v, int *nrot) {
+		int j, iq, ip, i;
+		float tresh, theta, tau, t, sm, s, h, g, c;
+		float b[n + 1];
+		float z[n + 1];
+
+		for (ip = 1; ip <= n; ip++) {
+			for (iq = 1; iq <= n; iq++) v[ip][iq] = (float)0.0;
+			v[ip][ip] = (float)1.0;
+		}
+		for (ip = 1; ip <= n; ip++) {
+			b[ip] = d[ip] = a[ip][ip];
+			z[ip] = (float)0.0;
+		}
+		*nrot = 0;
+		for (i = 1; i <= 50; i++) {
+			sm = (float)0.0;
+			for (ip = 1; ip <= n - 1; ip++) {
+				for (iq = ip + 1; iq <= n; iq++)
+					sm += fabs(a[ip][iq]);
+			}
+			if (sm == 0.0) {
+				return true;
+			}
+			if (i < 4)
+				tresh = (float)0.2*sm / (n*n);
+			else
+				tresh = (float)0.0;
+			for (ip = 1; ip <= n - 1; ip++) {
+				for (iq = ip + 1; iq <= n; iq++) {
+					g = (float)100.0*fabs(a[ip][iq]);
+					if (i > 4 && (float)(fabs(d[ip]) + g) == (float)fabs(d[ip]) && (float)(fabs(d[iq]) + g) == (float)fabs(d[iq]))
+						a[ip][iq] = (float)0.0;
+					else if (fabs(a[ip][iq]) > tresh) {
+						h = d[iq] - d[ip];
+						if ((float)(fabs(h) + g) == (float)fabs(h))
+							t = (a[ip][iq]) / h;
+						else {
+							theta = (float)0.5*h / (a[ip][iq]);
+							t = (float)1.0 / (fabs(theta) + sqrt((float)1.0 + theta*theta));
+							if (theta < 0.0)
+								t = -t;
+						}
+						c = (float)1.0 / sqrt(1 + t*t);
+						s = t*c;
+						tau = s / ((float)1.0 + c);
+						h = t*a[ip][iq];
+						z[ip] -= (float)h;
+						z[iq] += (float)h;
+						d[ip] -= (float)h;
+						d[iq] += (float)h;
+						a[ip][iq] = (float)0.0;
+						for (j = 1; j <= ip - 1; j++) {
+							CUDA_SVD_ROTATE(a, j, ip, j, iq);
+						}
+						for (j = ip + 1; j <= iq - 1; j++) {
+							CUDA_SVD_ROTATE(a, ip, j, j, iq);
+						}
+						for (j = iq + 1; j <= n; j++) {
+							CUDA_SVD_ROTATE(a, ip, j, iq, j);
+						}
+						for (j = 1; j <= n; j++) {
+							CUDA_SVD_ROTATE(v, j, ip, j, iq);
+						}
+						++(*nrot);
+					}
+				}
+			}
+			for (ip = 1; ip <= n; ip++) {
+				b[ip] += z[ip];
+				d[ip] = b[ip];
+				z[ip] = (float)0.0;
+			}
+		}
+		return false;
+	}
+
+
+
+	//static inline __device__ __host__ bool jacobi3(float a[3][3], float d[3], float v[3][3], int* n_rot)
+	//{
+	//	int count, k, i, j;
+	//	float tresh, theta, tau, t, sum, s, h, g, c, b[3], z[3];
+
+	//	/*Initialize v to the identity matrix.*/
+	//	for (i = 0; i < 3; i++)
+	//	{
+	//		for (j = 0; j < 3; j++)
+	//			v[i][j] = 0.0f;
+	//		v[i][i] = 1.0f;
+	//	}
+
+	//	/* Initialize b and d to the diagonal of a */
+	//	for (i = 0; i < 3; i++)
+	//		b[i] = d[i] = a[i][i];
+
+	//	/* z will accumulate terms */
+	//	for (i = 0; i < 3; i++)
+	//		z[i] = 0.0f;
+
+	//	*n_rot = 0;
+
+	//	/* 50 tries */
+	//	for (count = 0; count < 50; count++)
+	//	{
+
+	//		/* sum off-diagonal elements */
+	//		sum = 0.0f;
+	//		for (i = 0; i < 2; i++)
+	//		{
+	//			for (j = i + 1; j < 3; j++)
+	//				sum += fabs(a[i][j]);
+	//		}
+
+	//		/* if converged to machine underflow */
+	//		if (sum == 0.0)
+	//			return(1);
+
+	//		/* on 1st three sweeps... */
+	//		if (count < 3)
+	//			tresh = sum * 0.2f / 9.0f;
+	//		else
+	//			tresh = 0.0f;
+
+	//		for (i = 0; i < 2; i++)
+	//		{
+	//			for (j = i + 1; j < 3; j++)
+	//			{
+	//				g = 100.0f * fabs(a[i][j]);
+
+	//				/*  after four sweeps, skip the rotation if
+	//				*   the off-diagonal element is small
+	//				*/
+	//				if (count > 3 && fabs(d[i]) + g == fabs(d[i])
+	//					&& fabs(d[j]) + g == fabs(d[j]))
+	//				{
+	//					a[i][j] = 0.0f;
+	//				}
+	//				else if (fabs(a[i][j]) > tresh)
+	//				{
+	//					h = d[j] - d[i];
+
+	//					if (fabs(h) + g == fabs(h))
+	//					{
+	//						t = a[i][j] / h;
+	//					}
+	//					else
+	//					{
+	//						theta = 0.5f * h / (a[i][j]);
+	//						t = 1.0f / (fabs(theta) +
+	//							sqrtf(1.0f + theta*theta));
+	//						if (theta < 0.0f)
+	//							t = -t;
+	//					}
+
+	//					c = 1.0f / sqrtf(1 + t*t);
+	//					s = t * c;
+	//					tau = s / (1.0f + c);
+	//					h = t * a[i][j];
+
+	//					z[i] -= h;
+	//					z[j] += h;
+	//					d[i] -= h;
+	//					d[j] += h;
+
+	//					a[i][j] = 0.0;
+
+	//					for (k = 0; k <= i - 1; k++)
+	//						CUDA_SVD_ROTATE(a, k, i, k, j)
+	//						for (k = i + 1; k <= j - 1; k++)
+	//							CUDA_SVD_ROTATE(a, i, k, k, j)
+	//							for (k = j + 1; k < 3; k++)
+	//								CUDA_SVD_ROTATE(a, i, k, j, k)
+	//								for (k = 0; k < 3; k++)
+	//									CUDA_SVD_ROTATE(v, k, i, k, j)
+	//									++(*n_rot);
+	//				}
+	//			}
+	//		}
+
+	//		for (i = 0; i < 3; i++)
+	//		{
+	//			b[i] += z[i];
+	//			d[i] = b[i];
+	//			z[i] = 0.0;
+	//		}
+	//	}
+	//	return false;
+	//}
+
+};
+
 #endif //_EIGENVALUEDECOMPOSITION_H_
\ No newline at end of file
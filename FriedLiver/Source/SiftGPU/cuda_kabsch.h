@@ -4,9 +4,8 @@
 #define CUDA_KABSCH_H
 
 #include "GlobalDefines.h"
-#include "cuda_svd3.h"
-#include "cuda_SVD.h"
 #include "cuda_EigenValue.h"
+#include "KabschBatch.h"
 #include "SIFTImageManager.h"
 
 __host__ __device__ float3x3 cov(volatile float3* source, unsigned numPoints) {
@@ -64,217 +63,14 @@ __host__ __device__ float debugResidual(volatile float3* source, volatile float3
 	return res;
 }
 
-__host__ __device__ void swapTwo(float& a, float& b) {
-	float tmp = a;
-	a = b;
-	b = tmp;
-}
-
 __host__ __device__ float4x4 kabsch(volatile float3* source, volatile float3* target, unsigned numPoints, float3& evs) {
-
-	// centroids
-	matNxM<3, 1> p0;	p0.setZero();
-	matNxM<3, 1> q0;	q0.setZero();
-	
-	for (unsigned int i = 0; i < numPoints; i++) {
-		p0 = p0 + matNxM<3, 1>((volatile const float*)&source[i]);
-		q0 = q0 + matNxM<3, 1>((volatile const float*)&target[i]);
-	}
-
-	p0 = p0 / (float)numPoints;
-	q0 = q0 / (float)numPoints;
-
-	matNxM<3, 3> V;	V.setZero();	//covariance matrix	
-	for (unsigned int i = 0; i < numPoints; i++) {
-		const matNxM<3, 1> p((volatile const float*)&source[i]);
-		const matNxM<3, 1> q((volatile const float*)&target[i]);
-		V += (p - p0) * (q - q0).getTranspose();
-	}
-	V /= (float)numPoints;
-
-	//matNxM<3, 1> S;
-	matNxM<3, 3> W;
-
-	//((float3x3*)&V)->print();
-	//matNxM<3, 3> orig = V;
-	//float resGT = 0.0f;
-	//if (true)
-	//{
-	//	SVD::decompose3x3((float*)V.getPointer(), (float*)W.getPointer(), (float*)S.getPointer());
-	//	//printf("V:\n");
-	//	//((float3x3*)&V)->print();
-	//	//printf("W:\n");
-	//	//((float3x3*)&W)->print();
-
-	//	matNxM<3, 3> I; I.setIdentity();
-	//	if ((V * W.getTranspose()).det() < 0) {
-	//		I(3 - 1, 3 - 1) = -1;
-	//	}
-
-	//	matNxM<3, 3> resRot = W * I * V.getTranspose();
-	//	matNxM<3, 1> resTrans = q0 - resRot*p0;
-
-	//	float4x4 ret;
-	//	for (unsigned int i = 0; i < 3; i++) {
-	//		for (unsigned int j = 0; j < 3; j++) {
-	//			ret(i, j) = resRot(i, j);
-	//		}
-	//	}
-	//	ret(3, 0) = ret(3, 1) = ret(3, 2) = 0;	ret(3, 3) = 1;
-	//	ret(0, 3) = resTrans(0);
-	//	ret(1, 3) = resTrans(1);
-	//	ret(2, 3) = resTrans(2);
-
-	//	resGT = debugResidual(source, target, numPoints, ret);
-	//	//printf("GT\n");
-	//	//ret.print();
-	//}
-
-	//SVD::decompose3x3((float*)V.getPointer(), (float*)W.getPointer(), (float*)&evs);
-	svd(V, W, *(matNxM<3, 1>*)&evs);
-	if (evs.x < evs.y) swapTwo(evs.x, evs.y);
-	if (evs.y < evs.z) swapTwo(evs.y, evs.z);
-	if (evs.x < evs.y) swapTwo(evs.x, evs.y);
-
-	//printf("V_:\n");
-	//((float3x3*)&V_)->print();
-	//printf("W_:\n");
-	//((float3x3*)&W)->print();
-	//printf("[%.3f %.3f %.3f] [%.3f %.3f %.3f]\n", S(0, 0), S(1, 0), S(2, 0), s_(0, 0), s_(1, 0), s_(2, 0));
-
-
-	//// sort eigenvalues
-	//if (S(0) > S(1) && S(0) > S(2)) {
-	//	evs.x = S(0);
-	//	if (S(1) > S(2)) {
-	//		evs.y = S(1);
-	//		evs.z = S(2);
-	//	}
-	//	else {
-	//		evs.y = S(2);
-	//		evs.z = S(1);
-	//	}
-	//}
-	//else if (S(1) > S(0) && S(1) > S(2)) {
-	//	evs.x = S(1);
-	//	if (S(0) > S(2)) {
-	//		evs.y = S(0);
-	//		evs.z = S(2);
-	//	}
-	//	else {
-	//		evs.y = S(2);
-	//		evs.z = S(0);
-	//	}
-	//}
-	//else {
-	//	evs.x = S(2);
-	//	if (S(1) > S(2)) {
-	//		evs.y = S(1);
-	//		evs.z = S(2);
-	//	}
-	//	else{
-	//		evs.y = S(2);
-	//		evs.z = S(1);
-	//	}
-	//}
-
-	matNxM<3, 3> I; I.setIdentity();
-	if ((V * W.getTranspose()).det() < 0) {
-		I(3 - 1, 3 - 1) = -1;
-	}
-
-	matNxM<3, 3> resRot = W * I * V.getTranspose();
-	matNxM<3, 1> resTrans = q0 - resRot*p0;
-
-	float4x4 ret;
-	for (unsigned int i = 0; i < 3; i++) {
-		for (unsigned int j = 0; j < 3; j++) {
-			ret(i, j) = resRot(i, j);
-		}
-	}
-	ret(3, 0) = ret(3, 1) = ret(3, 2) = 0;	ret(3, 3) = 1;
-	ret(0, 3) = resTrans(0);
-	ret(1, 3) = resTrans(1);
-	ret(2, 3) = resTrans(2);
-
-	//float resFast = debugResidual(source, target, numPoints, ret);
-	////if (resFast*1.1f < resGT*1.0f) {
-	//if (resFast*1.0f > resGT*1.10f) {
-	////if (true) {
-	//	//printf("Fast\n");
-	//	//ret.print();
-	//	printf("resCmp: [%.6f %.6f] [n=%d]\n", resGT, resFast, numPoints);
-	//	//((float3x3*)&orig)->print();
-	//	printf("[%.3f %.3f %.3f] [%.3f %.3f %.3f]\n", S(0, 0), S(1, 0), S(2, 0), s_(0, 0), s_(1, 0), s_(2, 0));
-	//}
-	return ret;
+	return KabschSVD::kabsch(source, target, numPoints, evs);
 }
 
 __host__ __device__ float3 covarianceSVD(volatile float3* source, unsigned numPoints) {
-
-	matNxM<3, 1> p0;	p0.setZero();
-	for (unsigned int i = 0; i < numPoints; i++) {
-		p0 = p0 + matNxM<3, 1>((volatile const float*)&source[i]);
-	}
-	p0 = p0 / (float)numPoints;
-
-	matNxM<3, 3> V;	V.setZero();	//covariance matrix	
-	for (unsigned int i = 0; i < numPoints; i++) {
-		const matNxM<3, 1> p((volatile const float*)&source[i]);
-		V += (p - p0) * (p - p0).getTranspose();
-	}
-	V /= (float)numPoints;
-
-	float3 _s = computeEigenValues(*(float3x3*)&V);
-	return _s;
-
-	//matNxM<3, 1> S;
-	//matNxM<3, 3> W;
-	////SVD::decompose3x3((float*)V.getPointer(), (float*)W.getPointer(), (float*)S.getPointer());
-	//svd(V, W, S);
-	////printf("[%.3f %.3f %.3f] [%.3f %.3f %.3f]\n", S(0, 0), S(1, 0), S(2, 0), _s.x, _s.y, _s.z);
-	//
-
-	//float3 evs = make_float3(0.0f);
-	//// sort eigenvalues
-	//if (S(0) > S(1) && S(0) > S(2)) {
-	//	evs.x = S(0);
-	//	if (S(1) > S(2)) {
-	//		evs.y = S(1);
-	//		evs.z = S(2);
-	//	}
-	//	else {
-	//		evs.y = S(2);
-	//		evs.z = S(1);
-	//	}
-	//}
-	//else if (S(1) > S(0) && S(1) > S(2)) {
-	//	evs.x = S(1);
-	//	if (S(0) > S(2)) {
-	//		evs.y = S(0);
-	//		evs.z = S(2);
-	//	}
-	//	else {
-	//		evs.y = S(2);
-	//		evs.z = S(0);
-	//	}
-	//}
-	//else {
-	//	evs.x = S(2);
-	//	if (S(1) > S(2)) {
-	//		evs.y = S(1);
-	//		evs.z = S(2);
-	//	}
-	//	else{
-	//		evs.y = S(2);
-	//		evs.z = S(1);
-	//	}
-	//}
-
-	//return evs;
+	return KabschSVD::covarianceSingularValues(source, numPoints);
 }
 
-//!!!todo params or defines???
 #define MATCH_FILTER_PIXEL_DIST_THRESH 5
 #define KABSCH_CONDITION_THRESH 100.0f
 
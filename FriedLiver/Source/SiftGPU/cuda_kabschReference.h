@@ -5,7 +5,8 @@
 
 #include "GlobalDefines.h"
 
-#include "cuda_SVD.h"
+#include "cuda_EigenValue.h"
+#include "KabschBatch.h"
 #include "cuda_SimpleMatrixUtil.h"
 #include "SIFTImageManager.h"
 
@@ -85,220 +86,11 @@ __host__ __device__ float3 pcaReference(volatile float3* source, unsigned numPoi
 }
 
 __host__ __device__ float4x4 kabschReference(volatile float3* source, volatile float3* target, unsigned numPoints, float3& evs) {
-
-	matNxM<3, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> P; 
-	matNxM<3, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> Q;
-	matNxM<MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, 1> weights;
-
-	float sumWeights = 0.0f;
-	for (unsigned int i = 0; i < numPoints; i++) {
-		P(0, i) = source[i].x;
-		P(1, i) = source[i].y;
-		P(2, i) = source[i].z;
-
-		Q(0, i) = target[i].x;
-		Q(1, i) = target[i].y;
-		Q(2, i) = target[i].z;
-
-		weights(i) = 1.0f;
-		sumWeights += weights(i);
-	}
-
-	for (unsigned int i = numPoints; i < MAX_MATCHES_PER_IMAGE_PAIR_FILTERED; i++) {
-		P(0, i) = 0.0f;
-		P(1, i) = 0.0f;
-		P(2, i) = 0.0f;
-		  
-		Q(0, i) = 0.0f;
-		Q(1, i) = 0.0f;
-		Q(2, i) = 0.0f;
-
-		weights(i) = 0.0f;
-	}
-
-	weights /= sumWeights;
-
-	// centroids
-	matNxM<3, 1> p0 = P * weights;
-	matNxM<3, 1> q0 = Q * weights;
-
-	matNxM<1, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> v1;
-	for (unsigned int i = 0; i < numPoints; i++) {
-		v1(i) = 1.0f;
-	}
-	for (unsigned int i = numPoints; i < MAX_MATCHES_PER_IMAGE_PAIR_FILTERED; i++) {
-		v1(i) = 0.0f;
-	}
-
-	matNxM<3, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> P_centered = P - p0 * v1;
-	matNxM<3, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> Q_centered = Q - q0 * v1;
-
-
-	matNxM<3, 3> C = P_centered * matNxM<MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED>::getDiagonalMatrix(weights) * Q_centered.getTranspose();
-	//matNxM<3, 3> V, S, W, I;
-	//I.setIdentity();
-	//svd(C, V, S, W);
-
-	matNxM<3, 3> V = C;
-	matNxM<3, 1> S;
-	matNxM<3, 3> W;
-	matNxM<3, 3> I; I.setIdentity();
-	SVD::decompose3x3((float*)V.getPointer(), (float*)W.getPointer(), (float*)S.getPointer());
-
-	// SVD
-	//Eigen::Matrix3d _C = MatrixConversion::MatToEig(C).cast<double>();
-	//Eigen::JacobiSVD<Eigen::Matrix3d> svd(_C, Eigen::ComputeFullU | Eigen::ComputeFullV);
-	//Eigen::Matrix3d _V = svd.matrixU();
-	//Eigen::Vector3d _S = svd.singularValues();
-	//Eigen::Matrix3d _W = svd.matrixV();
-	//Eigen::Matrix3d _I = Eigen::Matrix3d::Identity();
-	//if ((_V * _W.transpose()).determinant() < 0)
-	//	_I(3 - 1, 3 - 1) = -1;
-	//Eigen::Matrix3d _resRot = _W * _I * _V.transpose();
-
-	//V = MatrixConversion::toCUDA(_V);
-	//W = MatrixConversion::toCUDA(_W);
-	//S.setZero(); S(0) = _S(0);	S(1) = _S(1);	S(2) = _S(2);
-
-	// sort eigenvalues
-	if (S(0) > S(1) && S(0) > S(2)) {
-		evs.x = S(0);
-		if (S(1) > S(2)) {
-			evs.y = S(1);
-			evs.z = S(2);
-		}
-		else {
-			evs.y = S(2);
-			evs.z = S(1);
-		}
-	}
-	else if (S(1) > S(0) && S(1) > S(2)) {
-		evs.x = S(1);
-		if (S(0) > S(2)) {
-			evs.y = S(0);
-			evs.z = S(2);
-		}
-		else {
-			evs.y = S(2);
-			evs.z = S(0);
-		}
-	}
-	else {
-		evs.x = S(2);
-		if (S(1) > S(2)) {
-			evs.y = S(1);
-			evs.z = S(2);
-		}
-		else{
-			evs.y = S(2);
-			evs.z = S(1);
-		}
-	}
-
-	if ((V * W.getTranspose()).det() < 0) {
-		I(3 - 1, 3 - 1) = -1;
-	}
-
-	matNxM<3, 3> resRot = W * I * V.getTranspose();
-	//matNxM<3, 3> resRot = MatrixConversion::toCUDA(_resRot.cast<float>());
-	matNxM<3, 1> resTrans = q0 - resRot*p0;
-
-	float4x4 ret;
-	for (unsigned int i = 0; i < 3; i++) {
-		for (unsigned int j = 0; j < 3; j++) {
-			ret(i, j) = resRot(i, j);
-		}
-	}
-	ret(3, 0) = ret(3, 1) = ret(3, 2) = 0;	ret(3, 3) = 1;
-	ret(0, 3) = resTrans(0);
-	ret(1, 3) = resTrans(1);
-	ret(2, 3) = resTrans(2);
-	return ret;
+	return KabschSVD::kabsch(source, target, numPoints, evs);
 }
 
 __host__ __device__ float3 covarianceSVDReference(volatile float3* source, unsigned numPoints) {
-
-	float3 evs = make_float3(0.0f, 0.0f, 0.0f);
-	matNxM<3, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> P;
-	matNxM<MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, 1> weights;
-
-	float sumWeights = 0.0f;
-	for (unsigned int i = 0; i < numPoints; i++) {
-		P(0, i) = source[i].x;
-		P(1, i) = source[i].y;
-		P(2, i) = source[i].z;
-
-		weights(i) = 1.0f;
-		sumWeights += weights(i);
-	}
-
-	for (unsigned int i = numPoints; i < MAX_MATCHES_PER_IMAGE_PAIR_FILTERED; i++) {
-		P(0, i) = 0.0f;
-		P(1, i) = 0.0f;
-		P(2, i) = 0.0f;
-
-		weights(i) = 0.0f;
-	}
-
-	weights /= sumWeights;
-
-	// centroids
-	matNxM<3, 1> p0 = P * weights;
-
-	matNxM<1, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> v1;
-	for (unsigned int i = 0; i < numPoints; i++) {
-		v1(i) = 1.0f;
-	}
-	for (unsigned int i = numPoints; i < MAX_MATCHES_PER_IMAGE_PAIR_FILTERED; i++) {
-		v1(i) = 0.0f;
-	}
-
-	matNxM<3, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED> P_centered = P - p0 * v1;
-
-
-	matNxM<3, 3> C = P_centered * matNxM<MAX_MATCHES_PER_IMAGE_PAIR_FILTERED, MAX_MATCHES_PER_IMAGE_PAIR_FILTERED>::getDiagonalMatrix(weights) * P_centered.getTranspose();
-	matNxM<3, 3> V = C;
-	matNxM<3, 1> S;
-	matNxM<3, 3> W;
-	matNxM<3, 3> I; I.setIdentity();
-	SVD::decompose3x3((float*)V.getPointer(), (float*)W.getPointer(), (float*)S.getPointer());
-
-	// sort eigenvalues
-	if (S(0) > S(1) && S(0) > S(2)) {
-		evs.x = S(0);
-		if (S(1) > S(2)) {
-			evs.y = S(1);
-			evs.z = S(2);
-		}
-		else {
-			evs.y = S(2);
-			evs.z = S(1);
-		}
-	}
-	else if (S(1) > S(0) && S(1) > S(2)) {
-		evs.x = S(1);
-		if (S(0) > S(2)) {
-			evs.y = S(0);
-			evs.z = S(2);
-		}
-		else {
-			evs.y = S(2);
-			evs.z = S(0);
-		}
-	}
-	else {
-		evs.x = S(2);
-		if (S(1) > S(2)) {
-			evs.y = S(1);
-			evs.z = S(2);
-		}
-		else{
-			evs.y = S(2);
-			evs.z = S(1);
-		}
-	}
-
-	return evs;
+	return KabschSVD::covarianceSingularValues(source, numPoints);
 }
 
 __host__ __device__ float computeKabschReprojError(float3* srcPts, float3* tgtPts, unsigned int numMatches, float3& eigenvalues, float4x4& transformEstimate) {
@@ -10,7 +10,7 @@ void SiftVisualization::printKey(const std::string& filename, const CUDACache* c
 {
 	const std::vector<CUDACachedFrame>& frames = cudaCache->getCacheFrames();
 	ColorImageR32 intensityImage(cudaCache->getWidth(), cudaCache->getHeight());
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensityImage.getData(), frames[frame].d_intensityDownsampled, sizeof(float)*intensityImage.getNumPixels(), cudaMemcpyDeviceToHost));
+	frames[frame].download(NULL, NULL, NULL, intensityImage.getData(), NULL);
 	ColorImageR8G8B8 image(intensityImage);
 	image.resize(GlobalBundlingState::get().s_widthSIFT, GlobalBundlingState::get().s_heightSIFT);
 
@@ -186,11 +186,11 @@ void SiftVisualization::printMatch(const std::string& filename, const SIFTImageM
 	const std::vector<CUDACachedFrame>& cachedFrames = cudaCache->getCacheFrames();
 
 	ColorImageR32 xIntensity(cudaCache->getWidth(), cudaCache->getHeight());
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(xIntensity.getData(), cachedFrames[imageIndices.x].d_intensityDownsampled, sizeof(float) * xIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+	cachedFrames[imageIndices.x].download(NULL, NULL, NULL, xIntensity.getData(), NULL);
 	ColorImageR8G8B8 xImage; convertIntensityToRGB(xIntensity, xImage);
 	xImage.resize(widthSIFT, heightSIFT);
 	ColorImageR32 yIntensity(cudaCache->getWidth(), cudaCache->getHeight());
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(yIntensity.getData(), cachedFrames[imageIndices.y].d_intensityDownsampled, sizeof(float) * yIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+	cachedFrames[imageIndices.y].download(NULL, NULL, NULL, yIntensity.getData(), NULL);
 	ColorImageR8G8B8 yImage; convertIntensityToRGB(yIntensity, yImage);
 	yImage.resize(widthSIFT, heightSIFT);
 
@@ -224,11 +224,11 @@ void SiftVisualization::printMatch(const std::string& filename, const CUDACache*
 	const std::vector<CUDACachedFrame>& cachedFrames = cudaCache->getCacheFrames();
 
 	ColorImageR32 xIntensity(cudaCache->getWidth(), cudaCache->getHeight());
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(xIntensity.getData(), cachedFrames[imageIndices.x].d_intensityDownsampled, sizeof(float) * xIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+	cachedFrames[imageIndices.x].download(NULL, NULL, NULL, xIntensity.getData(), NULL);
 	ColorImageR8G8B8 xImage; convertIntensityToRGB(xIntensity, xImage);
 	xImage.resize(widthSIFT, heightSIFT);
 	ColorImageR32 yIntensity(cudaCache->getWidth(), cudaCache->getHeight());
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(yIntensity.getData(), cachedFrames[imageIndices.y].d_intensityDownsampled, sizeof(float) * yIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+	cachedFrames[imageIndices.y].download(NULL, NULL, NULL, yIntensity.getData(), NULL);
 	ColorImageR8G8B8 yImage; convertIntensityToRGB(yIntensity, yImage);
 	yImage.resize(widthSIFT, heightSIFT);
 
@@ -333,8 +333,7 @@ void SiftVisualization::printCurrentMatches(const std::string& outPath, const SI
 	//TODO get color cpu for these functions
 	const std::vector<CUDACachedFrame>& cachedFrames = cudaCache->getCacheFrames();
 	ColorImageR32 curIntensity(cudaCache->getWidth(), cudaCache->getHeight());
-	MLIB_CUDA_SAFE_CALL(cudaMemcpy(curIntensity.getData(), cachedFrames[curFrame].d_intensityDownsampled,
-		sizeof(float) * curIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+	cachedFrames[curFrame].download(NULL, NULL, NULL, curIntensity.getData(), NULL);
 	ColorImageR8G8B8 curImage; convertIntensityToRGB(curIntensity, curImage);
 	curImage.resize(widthSIFT, heightSIFT);
 
@@ -343,8 +342,7 @@ void SiftVisualization::printCurrentMatches(const std::string& outPath, const SI
 		if (prev == curFrame) continue;
 
 		ColorImageR32 prevIntensity(cudaCache->getWidth(), cudaCache->getHeight());
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(prevIntensity.getData(), cachedFrames[prev].d_intensityDownsampled,
-			sizeof(float) * prevIntensity.getNumPixels(), cudaMemcpyDeviceToHost));
+		cachedFrames[prev].download(NULL, NULL, NULL, prevIntensity.getData(), NULL);
 		ColorImageR8G8B8 prevImage; convertIntensityToRGB(prevIntensity, prevImage);
 		prevImage.resize(widthSIFT, heightSIFT);
 
@@ -417,8 +415,7 @@ void SiftVisualization::saveImPairToPointCloud(const std::string& prefix, const
 	for (unsigned int i = 0; i < 2; i++) {
 		mat4f transform = transforms[i];
 		unsigned int f = imageIndices[i];
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(camPosition.getData(), cachedFrames[f].d_cameraposDownsampled, sizeof(float4)*camPosition.getNumPixels(), cudaMemcpyDeviceToHost));
-		MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensity.getData(), cachedFrames[f].d_intensityDownsampled, sizeof(float)*intensity.getNumPixels(), cudaMemcpyDeviceToHost));
+		cachedFrames[f].download(NULL, (float4*)camPosition.getData(), NULL, intensity.getData(), NULL);
 
 		PointCloudf framePc;
 
@@ -659,12 +656,11 @@ void SiftVisualization::saveToPointCloud(const std::string& filename, const CUDA
 	std::list<PointCloudf> pcs; std::vector<unsigned int> frameIdxs;
 	for (unsigned int i = 0; i < numFrames; i++) {
 		if (trajectory[i][0] != -std::numeric_limits<float>::infinity()) {
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(camPos.getData(), cachedFrames[i].d_cameraposDownsampled, sizeof(float4)*camPos.getNumPixels(), cudaMemcpyDeviceToHost));
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(intensity.getData(), cachedFrames[i].d_intensityDownsampled, sizeof(float)*intensity.getNumPixels(), cudaMemcpyDeviceToHost));
+			cachedFrames[i].download(NULL, (float4*)camPos.getData(), NULL, intensity.getData(), NULL);
 			convertIntensityToRGB(intensity, color);
 #ifndef CUDACACHE_UCHAR_NORMALS
 			normals.allocate(width, height);
-			MLIB_CUDA_SAFE_CALL(cudaMemcpy(normals.getData(), cachedFrames[i].d_normalsDownsampled, sizeof(float4)*normals.getNumPixels(), cudaMemcpyDeviceToHost));
+			cachedFrames[i].download(NULL, NULL, (float4*)normals.getData(), NULL, NULL);
 #endif
 
 			pcs.push_back(PointCloudf());
@@ -0,0 +1,843 @@
+
+#include "stdafx.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <limits>
+
+#include "CPUSolverBundling.h"
+#include "SolverBundlingOverlapIndex.h"
+#include "SolverBundlingPreconditioner.h"
+#include "SolverBundlingConstants.h"
+#include "LieDerivUtil.h"
+#include "../GlobalBundlingState.h"
+#include "../CUDACache.h"
+#include "../ThreadPool.h"
+
+#if !defined(CUDACACHE_UCHAR_NORMALS) || !defined(CUDACACHE_FLOAT_NORMALS)
+#error CPUSolverBundling needs both the uchar and the float normals of the cache
+#endif
+#ifndef USE_LIE_SPACE
+#error CPUSolverBundling only implements the lie space parametrization
+#endif
+
+namespace {
+
+	const float INVALID = -std::numeric_limits<float>::infinity();
+	const float EPSILON = 0.000001f;
+
+	const unsigned int ENERGY_CHUNK_SIZE = 4096;
+	//incomplete cholesky: attempts with a 10x larger diagonal shift each before falling back to block jacobi
+	const unsigned int IC_MAX_ATTEMPTS = 4;
+
+	inline float invertDiagonal(float v)
+	{
+		return v > EPSILON ? 1.0f / v : 1.0f;
+	}
+
+	//! derivative of the sparse residual TI * pos_i - TJ * pos_j wrt the pose with world point worldP (sign -1 for j)
+	inline void evalSparseJacobian(const float3& worldP, float sign, float (*J)[6])
+	{
+		const float3 dAlpha = evalLie_dAlpha(worldP);
+		const float3 dBeta = evalLie_dBeta(worldP);
+		const float3 dGamma = evalLie_dGamma(worldP);
+		const float rot[3][3] = { { dAlpha.x, dBeta.x, dGamma.x }, { dAlpha.y, dBeta.y, dGamma.y }, { dAlpha.z, dBeta.z, dGamma.z } };
+		for (unsigned int r = 0; r < 3; r++) {
+			for (unsigned int c = 0; c < 3; c++) {
+				J[r][c] = (r == c) ? sign : 0.0f;
+				J[r][3 + c] = sign * rot[r][c];
+			}
+		}
+	}
+
+	//! block += w * A^T B for R rows of A, B
+	template<unsigned int R>
+	inline void addJtJ(float* block, const float (*A)[6], const float (*B)[6], float w)
+	{
+		for (unsigned int r = 0; r < 6; r++) {
+			for (unsigned int c = 0; c < 6; c++) {
+				float v = 0.0f;
+				for (unsigned int k = 0; k < R; k++) v += A[k][r] * B[k][c];
+				block[r * 6 + c] += w * v;
+			}
+		}
+	}
+	//! C -= A * B^T of 6x6 blocks
+	inline void subtractABt(float* C, const float* A, const float* B)
+	{
+		for (unsigned int r = 0; r < 6; r++) {
+			for (unsigned int c = 0; c < 6; c++) {
+				float v = 0.0f;
+				for (unsigned int k = 0; k < 6; k++) v += A[r * 6 + k] * B[c * 6 + k];
+				C[r * 6 + c] -= v;
+			}
+		}
+	}
+	//! jtr += w * J^T res
+	template<unsigned int R>
+	inline void addJtr(float* jtr, const float (*J)[6], const float* res, float w)
+	{
+		for (unsigned int c = 0; c < 6; c++) {
+			float v = 0.0f;
+			for (unsigned int k = 0; k < R; k++) v += J[k][c] * res[k];
+			jtr[c] += w * v;
+		}
+	}
+
+	//! CUDACameraUtil.h; intrinsics fx, fy, cx, cy
+	inline float3 depthToCamera(const float4& intrinsics, int x, int y, float depth)
+	{
+		const float u = ((float)x - intrinsics.z) / intrinsics.x;
+		const float v = ((float)y - intrinsics.w) / intrinsics.y;
+		return make_float3(depth * u, depth * v, depth);
+	}
+	inline float2 cameraToDepth(const float4& intrinsics, const float3& pos)
+	{
+		return make_float2(pos.x * intrinsics.x / pos.z + intrinsics.z, pos.y * intrinsics.y / pos.z + intrinsics.w);
+	}
+
+	inline bool isValidSample(float v) { return v != INVALID; }
+	inline bool isValidSample(const float2& v) { return v.x != INVALID; }
+	inline bool isValidSample(const float4& v) { return v.x != INVALID; }
+
+	//! bilinearInterpolationFloat* of ICPUtil.h: invalid samples are skipped, false if there is no valid sample
+	template<typename T>
+	inline bool bilinearInterpolation(float x, float y, const T* input, unsigned int width, unsigned int height, T& result)
+	{
+		const int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+		const float alpha = x - (float)x0, beta = y - (float)y0;
+		T s[2]; float w[2];
+		for (int k = 0; k < 2; k++) {
+			s[k] = T(); w[k] = 0.0f;
+			const unsigned int py = (unsigned int)(y0 + k); //negative coordinates fail the bounds check
+			for (int l = 0; l < 2; l++) {
+				const unsigned int px = (unsigned int)(x0 + l);
+				if (px >= width || py >= height) continue;
+				const T& v = input[py * width + px];
+				if (!isValidSample(v)) continue;
+				const float a = (l == 0) ? 1.0f - alpha : alpha;
+				s[k] += a * v;
+				w[k] += a;
+			}
+		}
+		T ss = T(); float ww = 0.0f;
+		if (w[0] > 0.0f) { ss += (1.0f - beta) * (s[0] / w[0]); ww += 1.0f - beta; }
+		if (w[1] > 0.0f) { ss += beta * (s[1] / w[1]); ww += beta; }
+		if (ww == 0.0f) return false;
+		result = ss / ww;
+		return true;
+	}
+
+	inline float3 decodeNormal(const uchar4& n)
+	{
+		return make_float3(n.x / 255.0f * 2.0f - 1.0f, n.y / 255.0f * 2.0f - 1.0f, n.z / 255.0f * 2.0f - 1.0f);
+	}
+	inline bool isValidNormal(const uchar4& n)
+	{
+		return n.x != 0 || n.y != 0 || n.z != 0 || n.w != 0;
+	}
+}
+
+CPUSolverBundling::CPUSolverBundling(unsigned int maxNumberOfImages)
+{
+	m_maxNumberOfImages = maxNumberOfImages;
+	m_maxNumDenseImPairs = std::min(maxNumberOfImages * (maxNumberOfImages - 1) / 2, GlobalBundlingState::get().s_maxNumDenseImPairs);
+	m_bRecordConvergence = GlobalBundlingState::get().s_recordSolverConvergence || GlobalBundlingState::get().s_solverCPUCompare;
+	setPreconditioner(GlobalBundlingState::get().s_solverPreconditioner);
+	m_linearTolerance = GlobalBundlingState::get().s_solverLinearTolerance;
+	m_energyTolerance = GlobalBundlingState::get().s_solverEnergyTolerance;
+
+	m_defaultParams.verifyOptDistThresh = 0.02f;
+	m_defaultParams.verifyOptPercentThresh = 0.05f;
+	m_defaultParams.highResidualThresh = std::numeric_limits<float>::infinity();
+	m_defaultParams.denseDistThresh = GlobalBundlingState::get().s_denseDistThresh;
+	m_defaultParams.denseNormalThresh = GlobalBundlingState::get().s_denseNormalThresh;
+	m_defaultParams.denseColorThresh = GlobalBundlingState::get().s_denseColorThresh;
+	m_defaultParams.denseColorGradientMin = GlobalBundlingState::get().s_denseColorGradientMin;
+	m_defaultParams.denseDepthMin = GlobalBundlingState::get().s_denseDepthMin;
+	m_defaultParams.denseDepthMax = GlobalBundlingState::get().s_denseDepthMax;
+	m_defaultParams.denseOverlapCheckSubsampleFactor = GlobalBundlingState::get().s_denseOverlapCheckSubsampleFactor;
+
+	m_width = 0;
+	m_height = 0;
+	m_intrinsics = make_float4(INVALID);
+	m_numCachedFrames = 0;
+	m_totalTime = 0.0f;
+}
+
+CPUSolverBundling::~CPUSolverBundling()
+{
+}
+
+void CPUSolverBundling::setPreconditioner(unsigned int preconditioner)
+{
+	if (preconditioner > PRECONDITIONER_INCOMPLETE_CHOLESKY) throw MLIB_EXCEPTION("unknown preconditioner " + std::to_string(preconditioner));
+	m_preconditioner = preconditioner;
+}
+
+void CPUSolverBundling::syncFrames(const CUDACache* cache)
+{
+	if (m_numCachedFrames == 0) {
+		m_width = cache->getWidth();
+		m_height = cache->getHeight();
+		const mat4f& intrinsics = cache->getIntrinsics();
+		m_intrinsics = make_float4(intrinsics(0, 0), intrinsics(1, 1), intrinsics(0, 2), intrinsics(1, 2));
+	}
+	MLIB_ASSERT(cache->getWidth() == m_width && cache->getHeight() == m_height);
+
+	const unsigned int numPixels = m_width * m_height;
+	const std::vector<CUDACachedFrame>& cacheFrames = cache->getCacheFrames();
+	if (m_frames.size() < cache->getNumFrames()) m_frames.resize(cache->getNumFrames());
+	for (unsigned int f = m_numCachedFrames; f < cache->getNumFrames(); f++) {
+		const CUDACachedFrame& src = cacheFrames[f];
+		CachedFrame& dst = m_frames[f];
+		dst.depth.resize(numPixels);
+		dst.camPos.resize(numPixels);
+		dst.normals.resize(numPixels);
+		dst.normalsUCHAR4.resize(numPixels);
+		dst.intensity.resize(numPixels);
+		dst.intensityDerivs.resize(numPixels);
+		src.download(dst.depth.data(), dst.camPos.data(), dst.normals.data(), dst.intensity.data(), dst.intensityDerivs.data(), dst.normalsUCHAR4.data());
+	}
+	m_numCachedFrames = cache->getNumFrames();
+}
+
+void CPUSolverBundling::solve(const EntryJ* correspondences, unsigned int numberOfCorrespondences, const int* validImages, unsigned int numberOfImages,
+	unsigned int nNonLinearIterations, unsigned int nLinearIterations, const CUDACache* cudaCache,
+	const std::vector<float>& weightsSparse, const std::vector<float>& weightsDenseDepth, const std::vector<float>& weightsDenseColor, bool usePairwiseDense,
+	float3* xRot, float3* xTrans)
+{
+	Timer timerTotal;
+	timerTotal.start();
+
+	nNonLinearIterations = std::min(nNonLinearIterations, (unsigned int)weightsSparse.size());
+	MLIB_ASSERT(numberOfImages > 1 && nNonLinearIterations > 0 && numberOfImages <= m_maxNumberOfImages);
+
+	SolverParameters parameters = m_defaultParams;
+	parameters.nNonLinearIterations = nNonLinearIterations;
+	parameters.nLinIterations = nLinearIterations;
+	parameters.useDenseDepthAllPairwise = usePairwiseDense;
+	if (cudaCache) {
+		syncFrames(cudaCache);
+		MLIB_ASSERT(m_numCachedFrames >= numberOfImages && m_width / parameters.denseOverlapCheckSubsampleFactor > 8);
+	}
+
+	m_convergence.clear();
+	m_linConvergence.clear();
+	m_iterationTimings.clear();
+	//the energy (sparse + dense) at the linearization point of each non-linear iteration decides the early out on m_energyTolerance;
+	//energies are only compared between iterations with the same weights (as solveBundlingStub)
+	const bool useEnergyTolerance = m_energyTolerance > 0.0f;
+	float lastEnergy = -1.0f;
+	float3 lastWeights = make_float3(-1.0f);	//sparse, dense depth, dense color of lastEnergy
+	if (m_bRecordConvergence) m_convergence.push_back(evalSparseEnergy(correspondences, numberOfCorrespondences, numberOfImages, weightsSparse.front(), xRot, xTrans));
+
+	groupCorrespondences(correspondences, numberOfCorrespondences, numberOfImages);
+	m_transforms.resize(numberOfImages);
+	m_transformInverses.resize(numberOfImages);
+
+	Timer timer;
+	for (unsigned int nIter = 0; nIter < nNonLinearIterations; nIter++) {
+		parameters.weightSparse = weightsSparse[nIter];
+		parameters.weightDenseDepth = weightsDenseDepth[nIter];
+		parameters.weightDenseColor = weightsDenseColor[nIter];
+		parameters.useDense = cudaCache != NULL && (parameters.weightDenseDepth > 0 || parameters.weightDenseColor > 0);
+
+		IterationTiming timing;
+		timer.start();
+		ThreadPool::get().parallelFor(0, numberOfImages, [&](unsigned int i) {
+			m_transforms[i] = poseToMatrix(xRot[i], xTrans[i]);
+			m_transformInverses[i] = m_transforms[i].getInverse();
+		}, 16);
+		buildSparseSystem(correspondences, numberOfImages);
+		timer.stop();
+		timing.timeBuildSparse = (float)timer.getElapsedTimeMS();
+
+		timer.start();
+		float denseEnergy = 0.0f;
+		if (parameters.useDense) parameters.useDense = buildDenseSystem(validImages, numberOfImages, parameters, denseEnergy);
+		timer.stop();
+		timing.timeBuildDense = (float)timer.getElapsedTimeMS();
+
+		if (useEnergyTolerance) { //relative change of the energy in the last iteration
+			const float3 weights = make_float3(parameters.weightSparse, parameters.useDense ? parameters.weightDenseDepth : 0.0f, parameters.useDense ? parameters.weightDenseColor : 0.0f);
+			float energy = parameters.useDense ? denseEnergy : 0.0f;
+			if (parameters.weightSparse > 0.0f) energy += evalSparseEnergy(correspondences, numberOfCorrespondences, numberOfImages, parameters.weightSparse, xRot, xTrans);
+			const bool sameWeights = weights.x == lastWeights.x && weights.y == lastWeights.y && weights.z == lastWeights.z;
+			if (sameWeights && lastEnergy >= 0.0f && std::fabs(lastEnergy - energy) <= m_energyTolerance * lastEnergy) break;
+			lastEnergy = energy;
+			lastWeights = weights;
+		}
+
+		timer.start();
+		solveLinearSystem(numberOfImages, nLinearIterations, parameters.weightSparse, parameters.weightSparse > 0.0f, parameters.useDense, xRot, xTrans, timing);
+		timer.stop();
+		timing.timePCG = (float)timer.getElapsedTimeMS();
+		m_iterationTimings.push_back(timing);
+
+		if (m_bRecordConvergence) m_convergence.push_back(evalSparseEnergy(correspondences, numberOfCorrespondences, numberOfImages, parameters.weightSparse, xRot, xTrans));
+
+		//early out on the largest update of the valid images
+		if (nIter < nNonLinearIterations - 1) {
+			float maxDelta = 0.0f;
+			for (unsigned int x = 1; x < numberOfImages; x++) {
+				if (validImages[x] == 0) continue;
+				const float3 r = fabs(m_deltaRot[x]), t = fabs(m_deltaTrans[x]);
+				maxDelta = std::max(maxDelta, std::max(std::max(std::max(r.x, r.y), std::max(r.z, t.x)), std::max(t.y, t.z)));
+			}
+			if (maxDelta < GN_CONVERGENCE_THRESH) break;
+		}
+	}
+
+	timerTotal.stop();
+	m_totalTime = (float)timerTotal.getElapsedTimeMS();
+}
+
+void CPUSolverBundling::groupCorrespondences(const EntryJ* correspondences, unsigned int numberOfCorrespondences, unsigned int numberOfImages)
+{
+	m_sparsePairs.clear();
+	m_sparsePairRuns.clear();
+	for (unsigned int c = 0; c < numberOfCorrespondences; c++) {
+		const EntryJ& corr = correspondences[c];
+		if (!corr.isValid() || corr.imgIdx_i == corr.imgIdx_j) continue;
+		MLIB_ASSERT(corr.imgIdx_i < numberOfImages && corr.imgIdx_j < numberOfImages);
+		const uint2 pair = make_uint2(std::min(corr.imgIdx_i, corr.imgIdx_j), std::max(corr.imgIdx_i, corr.imgIdx_j));
+		if (m_sparsePairs.empty() || m_sparsePairs.back().x != pair.x || m_sparsePairs.back().y != pair.y) {
+			m_sparsePairs.push_back(pair);
+			m_sparsePairRuns.push_back(c);
+		}
+	}
+	m_sparsePairRuns.push_back(numberOfCorrespondences);
+}
+
+void CPUSolverBundling::buildSparseSystem(const EntryJ* correspondences, unsigned int numberOfImages)
+{
+	const unsigned int numPairs = (unsigned int)m_sparsePairs.size();
+	const std::vector<float> pairWeights(numPairs, 1.0f);
+	m_sparseBlocks.init(numberOfImages, m_sparsePairs, pairWeights);
+	m_pairSystems.resize(numPairs);
+
+	ThreadPool::get().parallelFor(0, numPairs, [&](unsigned int p) {
+		PairSystem& system = m_pairSystems[p];
+		std::fill(&system.JtJ[0][0], &system.JtJ[0][0] + 2 * DENSE_JTJ_BLOCK_SIZE, 0.0f);
+		std::fill(&system.Jtr[0][0], &system.Jtr[0][0] + 2 * 6, 0.0f);
+		float* offDiag = m_sparseBlocks.getOffDiagBlock(p);
+		const uint2& pair = m_sparsePairs[p];
+		for (unsigned int c = m_sparsePairRuns[p]; c < m_sparsePairRuns[p + 1]; c++) {
+			const EntryJ& corr = correspondences[c];
+			if (!corr.isValid() || corr.imgIdx_i == corr.imgIdx_j) continue;
+			const float3 worldPosI = m_transforms[corr.imgIdx_i] * corr.pos_i;
+			const float3 worldPosJ = m_transforms[corr.imgIdx_j] * corr.pos_j;
+			const float3 r = worldPosI - worldPosJ;
+			const float res[3] = { r.x, r.y, r.z };
+			float Ji[3][6], Jj[3][6];
+			evalSparseJacobian(worldPosI, 1.0f, Ji);
+			evalSparseJacobian(worldPosJ, -1.0f, Jj);
+			const float (*Jx)[6] = (corr.imgIdx_i == pair.x) ? Ji : Jj;
+			const float (*Jy)[6] = (corr.imgIdx_i == pair.x) ? Jj : Ji;
+			addJtJ<3>(system.JtJ[0], Jx, Jx, 1.0f);
+			addJtJ<3>(system.JtJ[1], Jy, Jy, 1.0f);
+			addJtJ<3>(offDiag, Jy, Jx, 1.0f);
+			addJtr<3>(system.Jtr[0], Jx, res, 1.0f);
+			addJtr<3>(system.Jtr[1], Jy, res, 1.0f);
+		}
+	}, 16);
+	reducePairSystems(numberOfImages, m_sparsePairs, pairWeights, m_sparseBlocks, m_sparseJtr);
+
+	//Jacobi preconditioner of the GPU solver: unweighted, sparse term only
+	m_precondTrans.resize(numberOfImages);
+	m_precondRot.resize(numberOfImages);
+	for (unsigned int x = 0; x < numberOfImages; x++) {
+		const float* block = m_sparseBlocks.getDiagBlock(x);
+		m_precondTrans[x] = make_float3(invertDiagonal(block[0]), invertDiagonal(block[7]), invertDiagonal(block[14]));
+		m_precondRot[x] = make_float3(invertDiagonal(block[21]), invertDiagonal(block[28]), invertDiagonal(block[35]));
+	}
+}
+
+bool CPUSolverBundling::buildDenseSystem(const int* validImages, unsigned int numberOfImages, const SolverParameters& parameters, float& energy)
+{
+	energy = 0.0f;
+	std::vector<uint2> pairs;
+	findOverlappingImages(validImages, numberOfImages, parameters, pairs);
+	if (pairs.empty()) {
+		std::cout << "warning: no overlapping images for dense solve" << std::endl;
+		return false;
+	}
+	const unsigned int numPairs = (unsigned int)pairs.size();
+	std::vector<float> pairWeights(numPairs);
+	ThreadPool::get().parallelFor(0, numPairs, [&](unsigned int p) {
+		pairWeights[p] = computePairWeight(pairs[p].x, pairs[p].y, parameters);
+	});
+
+	m_denseBlocks.init(numberOfImages, pairs, pairWeights);
+	m_pairSystems.resize(numPairs);
+	ThreadPool::get().parallelFor(0, numPairs, [&](unsigned int p) {
+		if (pairWeights[p] == 0.0f) return;
+		PairSystem& system = m_pairSystems[p];
+		std::fill(&system.JtJ[0][0], &system.JtJ[0][0] + 2 * DENSE_JTJ_BLOCK_SIZE, 0.0f);
+		std::fill(&system.Jtr[0][0], &system.Jtr[0][0] + 2 * 6, 0.0f);
+		system.energy = 0.0f;
+		accumulateDensePair(pairs[p].x, pairs[p].y, pairWeights[p], parameters, system, m_denseBlocks.getOffDiagBlock(p));
+	});
+	reducePairSystems(numberOfImages, pairs, pairWeights, m_denseBlocks, m_denseJtr);
+	for (unsigned int p = 0; p < numPairs; p++) {
+		if (pairWeights[p] > 0.0f) energy += m_pairSystems[p].energy;
+	}
+	return true;
+}
+
+void CPUSolverBundling::findOverlappingImages(const int* validImages, unsigned int numberOfImages, const SolverParameters& parameters, std::vector<uint2>& pairs) const
+{
+	const unsigned int numPixels = m_width * m_height;
+	const float3 viewDir = normalize(make_float3(1.0f, 1.0f, 1.0f));
+
+	std::vector<uint2> candidates;
+	if (parameters.useDenseDepthAllPairwise) {
+		std::vector<float3> imageBounds(3 * numberOfImages);
+		ThreadPool::get().parallelFor(0, numberOfImages, [&](unsigned int i) {
+			float3 bmin = make_float3(FLT_MAX), bmax = make_float3(-FLT_MAX);
+			if (validImages[i] != 0) {
+				const float* depth = m_frames[i].depth.data();
+				for (unsigned int idx = 0; idx < numPixels; idx++) {
+					if (!(depth[idx] > parameters.denseDepthMin && depth[idx] < parameters.denseDepthMax)) continue;
+					const float3 worldPos = m_transforms[i] * depthToCamera(m_intrinsics, idx % m_width, idx / m_width, depth[idx]);
+					bmin = fminf(bmin, worldPos);
+					bmax = fmaxf(bmax, worldPos);
+				}
+			}
+			imageBounds[3 * i] = bmin;
+			imageBounds[3 * i + 1] = bmax;
+			imageBounds[3 * i + 2] = m_transforms[i].getFloat3x3() * viewDir;
+		}, 4);
+		const std::vector<int> valid(validImages, validImages + numberOfImages);
+		SolverBundlingOverlapIndex::findCandidatePairs(imageBounds, valid, numberOfImages, parameters.denseDistThresh, cosf(DENSE_OVERLAP_MAX_ANGLE), candidates);
+	}
+	else {
+		for (unsigned int i = 0; i + 1 < numberOfImages; i++) candidates.push_back(make_uint2(i, i + 1));
+	}
+
+	//sampled depth correspondences between the candidates
+	const unsigned int subsample = parameters.denseOverlapCheckSubsampleFactor;
+	const unsigned int subWidth = m_width / subsample;
+	std::vector<unsigned char> overlap(candidates.size(), 0);
+	ThreadPool::get().parallelFor(0, (unsigned int)candidates.size(), [&](unsigned int c) {
+		const unsigned int i = candidates[c].x, j = candidates[c].y;
+		if (validImages[i] == 0 || validImages[j] == 0) return;
+		const float4x4 transform = m_transformInverses[i] * m_transforms[j];
+		if (!(std::acos(clamp(dot(viewDir, transform.getFloat3x3() * viewDir), -1.0f, 1.0f)) < DENSE_OVERLAP_MAX_ANGLE)) return;
+
+		const float* depthTgt = m_frames[i].depth.data();
+		const float* depthSrc = m_frames[j].depth.data();
+		unsigned int count = 0;
+		for (unsigned int s = 0; s < DENSE_OVERLAP_NUM_SAMPLES; s++) {
+			const unsigned int x = (s % subWidth) * subsample, y = (s / subWidth) * subsample;
+			const unsigned int idx = y * m_width + x;
+			if (idx >= numPixels) continue;
+			const float3 camPosSrc = depthToCamera(m_intrinsics, x, y, depthSrc[idx]);
+			if (!(camPosSrc.z > parameters.denseDepthMin && camPosSrc.z < parameters.denseDepthMax)) continue;
+			const float3 camPosSrcToTgt = transform * camPosSrc;
+			const float2 screenPos = cameraToDepth(m_intrinsics, camPosSrcToTgt);
+			const int tx = (int)roundf(screenPos.x), ty = (int)roundf(screenPos.y);
+			if (tx < 0 || ty < 0 || tx >= (int)m_width || ty >= (int)m_height) continue;
+			const float3 camPosTgt = depthToCamera(m_intrinsics, tx, ty, depthTgt[ty * m_width + tx]);
+			if (!(camPosTgt.z > parameters.denseDepthMin && camPosTgt.z < parameters.denseDepthMax)) continue;
+			if (length(camPosSrcToTgt - camPosTgt) <= parameters.denseDistThresh) count++;
+		}
+		overlap[c] = count > DENSE_OVERLAP_MIN_CORR ? 1 : 0;
+	}, 16);
+
+	pairs.clear();
+	for (size_t c = 0; c < candidates.size(); c++) {
+		if (overlap[c]) pairs.push_back(candidates[c]);
+	}
+	if (pairs.size() > m_maxNumDenseImPairs) {
+		std::cout << "warning: " << pairs.size() << " overlapping images for dense solve, only using the first " << m_maxNumDenseImPairs << " (s_maxNumDenseImPairs)" << std::endl;
+		pairs.resize(m_maxNumDenseImPairs);
+	}
+}
+
+float CPUSolverBundling::computePairWeight(unsigned int i, unsigned int j, const SolverParameters& parameters) const
+{
+	const float4x4 transform = m_transformInverses[i] * m_transforms[j];
+	const float3x3 rotation = transform.getFloat3x3();
+	const CachedFrame& tgt = m_frames[i];
+	const CachedFrame& src = m_frames[j];
+
+	unsigned int count = 0;
+	const unsigned int numPixels = m_width * m_height;
+	for (unsigned int idx = 0; idx < numPixels; idx++) {
+		const float3 camPosSrc = depthToCamera(m_intrinsics, idx % m_width, idx / m_width, src.depth[idx]);
+		if (!(camPosSrc.z > parameters.denseDepthMin && camPosSrc.z < parameters.denseDepthMax)) continue;
+		if (!isValidNormal(src.normalsUCHAR4[idx])) continue;
+		const float3 camPosSrcToTgt = transform * camPosSrc;
+		const float2 screenPos = cameraToDepth(m_intrinsics, camPosSrcToTgt);
+		const int tx = (int)roundf(screenPos.x), ty = (int)roundf(screenPos.y);
+		if (tx < 0 || ty < 0 || tx >= (int)m_width || ty >= (int)m_height) continue;
+		const unsigned int tgtIdx = ty * m_width + tx;
+		const float3 camPosTgt = depthToCamera(m_intrinsics, tx, ty, tgt.depth[tgtIdx]);
+		if (!(camPosTgt.z > parameters.denseDepthMin && camPosTgt.z < parameters.denseDepthMax)) continue;
+		if (!isValidNormal(tgt.normalsUCHAR4[tgtIdx])) continue;
+		const float dNormal = dot(rotation * decodeNormal(src.normalsUCHAR4[idx]), decodeNormal(tgt.normalsUCHAR4[tgtIdx]));
+		if (dNormal >= parameters.denseNormalThresh && length(camPosSrcToTgt - camPosTgt) <= parameters.denseDistThresh) count++;
+	}
+	if (count < DENSE_PAIR_MIN_CORR) return 0.0f;
+	return 1.0f / std::min(logf((float)count), 9.0f);
+}
+
+void CPUSolverBundling::accumulateDensePair(unsigned int i, unsigned int j, float pairWeight, const SolverParameters& parameters, PairSystem& system, float* offDiagBlock) const
+{
+	const float4x4& transform_i = m_transforms[i];
+	const float4x4& transform_j = m_transforms[j];
+	const float4x4& invTransform_i = m_transformInverses[i];
+	const float4x4& invTransform_j = m_transformInverses[j];
+	const float4x4 transform = invTransform_i * transform_j;
+	const float3x3 rotation = transform.getFloat3x3();
+	const bool useDepth = parameters.weightDenseDepth > 0.0f;
+	const bool useColor = !useDepth || parameters.weightDenseColor > 0.0f;
+
+	const CachedFrame& tgt = m_frames[i];
+	const CachedFrame& src = m_frames[j];
+	const unsigned int numPixels = m_width * m_height;
+	for (unsigned int srcIdx = 0; srcIdx < numPixels; srcIdx++) {
+		const float4& cposj = src.camPos[srcIdx];
+		if (!(cposj.z > parameters.denseDepthMin && cposj.z < parameters.denseDepthMax)) continue;
+		const float4& nrmj = src.normals[srcIdx];
+		if (nrmj.x == INVALID) continue;
+		const float3 camPosSrc = make_float3(cposj.x, cposj.y, cposj.z);
+		const float3 normalSrcToTgt = rotation * make_float3(nrmj.x, nrmj.y, nrmj.z);
+		const float3 camPosSrcToTgt = transform * camPosSrc;
+		const float2 screenPos = cameraToDepth(m_intrinsics, camPosSrcToTgt);
+		const int tx = (int)roundf(screenPos.x), ty = (int)roundf(screenPos.y);
+		if (tx < 0 || ty < 0 || tx >= (int)m_width || ty >= (int)m_height) continue;
+		float4 cposi, nrmi;
+		if (!bilinearInterpolation(screenPos.x, screenPos.y, tgt.camPos.data(), m_width, m_height, cposi)) continue;
+		if (!(cposi.z > parameters.denseDepthMin && cposi.z < parameters.denseDepthMax)) continue;
+		if (!bilinearInterpolation(screenPos.x, screenPos.y, tgt.normals.data(), m_width, m_height, nrmi)) continue;
+		const float3 camPosTgt = make_float3(cposi.x, cposi.y, cposi.z);
+		const float3 normalTgt = make_float3(nrmi.x, nrmi.y, nrmi.z);
+		if (!(dot(normalSrcToTgt, normalTgt) >= parameters.denseNormalThresh && length(camPosSrcToTgt - camPosTgt) <= parameters.denseDistThresh)) continue;
+
+		//the pose derivatives are shared by the depth and the color term (zero for the fixed image 0)
+		matNxM<3, 6> jacI, jacJ;
+		jacI.setZero(); jacJ.setZero();
+		if (i > 0) jacI = evalLie_derivI(invTransform_j, transform_i, camPosSrc);
+		if (j > 0) jacJ = evalLie_derivJ(invTransform_i, transform_j, camPosSrc);
+
+		if (useDepth) {
+			const float res = dot(camPosTgt - camPosSrcToTgt, normalTgt);
+			const float w = parameters.weightDenseDepth * pairWeight * std::pow(std::max(0.0f, 1.0f - camPosTgt.z / 2.0f), 2.5f);
+			float Ji[1][6], Jj[1][6];
+			for (unsigned int k = 0; k < 6; k++) {
+				Ji[0][k] = -dot(make_float3(jacI(0, k), jacI(1, k), jacI(2, k)), normalTgt);
+				Jj[0][k] = dot(make_float3(jacJ(0, k), jacJ(1, k), jacJ(2, k)), normalTgt);
+			}
+			addJtJ<1>(system.JtJ[0], Ji, Ji, w);
+			addJtJ<1>(system.JtJ[1], Jj, Jj, w);
+			addJtJ<1>(offDiagBlock, Jj, Ji, w);
+			addJtr<1>(system.Jtr[0], Ji, &res, w);
+			addJtr<1>(system.Jtr[1], Jj, &res, w);
+			system.energy += w * res * res;
+		}
+		if (useColor) {
+			float2 intensityDeriv; float intensityTgt;
+			if (!bilinearInterpolation(screenPos.x, screenPos.y, tgt.intensityDerivs.data(), m_width, m_height, intensityDeriv)) continue;
+			if (!bilinearInterpolation(screenPos.x, screenPos.y, tgt.intensity.data(), m_width, m_height, intensityTgt)) continue;
+			const float res = intensityTgt - src.intensity[srcIdx];
+			if (!(std::fabs(res) < parameters.denseColorThresh && length(intensityDeriv) > parameters.denseColorGradientMin)) continue;
+			const float w = parameters.weightDenseColor * pairWeight * std::max(0.0f, 1.0f - std::fabs(res) / (1.15f * parameters.denseColorThresh));
+
+			//intensity gradient * dCameraToScreen (ICPUtil.h)
+			const float z2 = camPosSrcToTgt.z * camPosSrcToTgt.z;
+			const float d00 = m_intrinsics.x / camPosSrcToTgt.z, d02 = -m_intrinsics.x * camPosSrcToTgt.x / z2;
+			const float d11 = m_intrinsics.y / camPosSrcToTgt.z, d12 = -m_intrinsics.y * camPosSrcToTgt.y / z2;
+			float Ji[1][6], Jj[1][6];
+			for (unsigned int k = 0; k < 6; k++) {
+				Ji[0][k] = intensityDeriv.x * (d00 * jacI(0, k) + d02 * jacI(2, k)) + intensityDeriv.y * (d11 * jacI(1, k) + d12 * jacI(2, k));
+				Jj[0][k] = intensityDeriv.x * (d00 * jacJ(0, k) + d02 * jacJ(2, k)) + intensityDeriv.y * (d11 * jacJ(1, k) + d12 * jacJ(2, k));
+			}
+			addJtJ<1>(system.JtJ[0], Ji, Ji, w);
+			addJtJ<1>(system.JtJ[1], Jj, Jj, w);
+			addJtJ<1>(offDiagBlock, Jj, Ji, w);
+			addJtr<1>(system.Jtr[0], Ji, &res, w);
+			addJtr<1>(system.Jtr[1], Jj, &res, w);
+			system.energy += w * res * res;
+		}
+	}
+}
+
+void CPUSolverBundling::reducePairSystems(unsigned int numberOfImages, const std::vector<uint2>& pairs, const std::vector<float>& pairWeights,
+	SolverBundlingDenseBlocks& blocks, std::vector<float>& jtr) const
+{
+	std::vector<int> rowOffsets, rowPairs;
+	SolverBundlingDenseBlocks::buildRows(numberOfImages, pairs.data(), pairWeights.data(), (unsigned int)pairs.size(), rowOffsets, rowPairs);
+	jtr.assign(6 * numberOfImages, 0.0f);
+	//each image sums its pairs in pair order
+	ThreadPool::get().parallelFor(0, numberOfImages, [&](unsigned int i) {
+		float* block = blocks.getDiagBlock(i);
+		for (int k = rowOffsets[i]; k < rowOffsets[i + 1]; k++) {
+			const int p = rowPairs[k];
+			const unsigned int side = (pairs[p].x == i) ? 0 : 1;
+			const PairSystem& system = m_pairSystems[p];
+			for (unsigned int e = 0; e < DENSE_JTJ_BLOCK_SIZE; e++) block[e] += system.JtJ[side][e];
+			for (unsigned int e = 0; e < 6; e++) jtr[6 * i + e] += system.Jtr[side][e];
+		}
+	}, 16);
+}
+
+void CPUSolverBundling::buildPreconditioner(unsigned int numberOfImages, float weightSparse, bool useSparse, bool useDense)
+{
+	m_icRowOffsets.clear();
+	if (m_preconditioner == PRECONDITIONER_JACOBI) return;
+	if (m_preconditioner == PRECONDITIONER_INCOMPLETE_CHOLESKY) {
+		float shift = PRECONDITIONER_DAMPING;
+		for (unsigned int attempt = 0; attempt < IC_MAX_ATTEMPTS; attempt++, shift *= 10.0f) {
+			if (factorIncompleteCholesky(numberOfImages, weightSparse, useSparse, useDense, shift)) return;
+		}
+		std::cout << "warning: incomplete cholesky preconditioner failed, using block jacobi" << std::endl;
+		m_icRowOffsets.clear();
+	}
+
+	m_precondBlocks.resize(DENSE_JTJ_BLOCK_SIZE * numberOfImages);
+	ThreadPool::get().parallelFor(1, numberOfImages, [&](unsigned int x) {
+		float* block = m_precondBlocks.data() + DENSE_JTJ_BLOCK_SIZE * x;
+		const float* sparseBlock = m_sparseBlocks.getDiagBlock(x);
+		const float* denseBlock = useDense ? m_denseBlocks.getDiagBlock(x) : NULL;
+		for (unsigned int e = 0; e < DENSE_JTJ_BLOCK_SIZE; e++)
+			block[e] = (useSparse ? weightSparse * sparseBlock[e] : 0.0f) + (useDense ? denseBlock[e] : 0.0f);
+		factorPreconditionerBlock(block);
+	}, 64);
+}
+
+bool CPUSolverBundling::factorIncompleteCholesky(unsigned int numberOfImages, float weightSparse, bool useSparse, bool useDense, float shift)
+{
+	//lower off-diagonal blocks A_yx, x < y, of the weighted system; a pair may occur several times (sparse runs, sparse and dense)
+	struct Entry {
+		unsigned int row, col;
+		const float* block;
+		float weight;
+	};
+	std::vector<Entry> entries;
+	if (useSparse) {
+		for (unsigned int p = 0; p < (unsigned int)m_sparsePairs.size(); p++) {
+			if (m_sparsePairs[p].x == 0) continue; //image 0 is fixed
+			const Entry e = { m_sparsePairs[p].y, m_sparsePairs[p].x, m_sparseBlocks.getOffDiagBlock(p), weightSparse };
+			entries.push_back(e);
+		}
+	}
+	if (useDense) {
+		for (unsigned int p = 0; p < m_denseBlocks.getNumPairs(); p++) {
+			const uint2& pair = m_denseBlocks.getPair(p);
+			const float* block = m_denseBlocks.getOffDiagBlock(p);
+			if (pair.x == 0 || std::all_of(block, block + DENSE_JTJ_BLOCK_SIZE, [](float v) { return v == 0.0f; })) continue; //no dense correspondences
+			const Entry e = { pair.y, pair.x, block, 1.0f };
+			entries.push_back(e);
+		}
+	}
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.row < b.row || (a.row == b.row && a.col < b.col); });
+
+	m_icRowOffsets.assign(numberOfImages + 1, 0);
+	m_icCols.clear();
+	m_icBlocks.clear();
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry& e = entries[i];
+		if (i == 0 || e.row != entries[i - 1].row || e.col != entries[i - 1].col) {
+			m_icCols.push_back(e.col);
+			m_icBlocks.resize(m_icBlocks.size() + DENSE_JTJ_BLOCK_SIZE, 0.0f);
+			m_icRowOffsets[e.row + 1]++;
+		}
+		float* block = m_icBlocks.data() + m_icBlocks.size() - DENSE_JTJ_BLOCK_SIZE;
+		for (unsigned int k = 0; k < DENSE_JTJ_BLOCK_SIZE; k++) block[k] += e.weight * e.block[k];
+	}
+	for (unsigned int j = 0; j < numberOfImages; j++) m_icRowOffsets[j + 1] += m_icRowOffsets[j];
+
+	//left looking by rows: L_jk = (A_jk - sum_m L_jm L_km^T) L_kk^-T, L_jj = chol(A_jj - sum_k L_jk L_jk^T), fill-in outside the pattern is dropped
+	m_precondBlocks.assign(DENSE_JTJ_BLOCK_SIZE * numberOfImages, 0.0f);
+	for (unsigned int j = 1; j < numberOfImages; j++) {
+		for (int a = m_icRowOffsets[j]; a < m_icRowOffsets[j + 1]; a++) {
+			const unsigned int k = m_icCols[a];
+			float* Ljk = m_icBlocks.data() + DENSE_JTJ_BLOCK_SIZE * a;
+			int ia = m_icRowOffsets[j], ib = m_icRowOffsets[k];
+			while (ia < a && ib < m_icRowOffsets[k + 1]) {
+				if (m_icCols[ia] < m_icCols[ib]) ia++;
+				else if (m_icCols[ia] > m_icCols[ib]) ib++;
+				else {
+					subtractABt(Ljk, m_icBlocks.data() + DENSE_JTJ_BLOCK_SIZE * ia, m_icBlocks.data() + DENSE_JTJ_BLOCK_SIZE * ib);
+					ia++; ib++;
+				}
+			}
+			const float* Lkk = m_precondBlocks.data() + DENSE_JTJ_BLOCK_SIZE * k;
+			for (unsigned int r = 0; r < 6; r++) solveLowerBlock6(Lkk, Ljk + 6 * r);
+		}
+
+		float* Ljj = m_precondBlocks.data() + DENSE_JTJ_BLOCK_SIZE * j;
+		const float* sparseBlock = m_sparseBlocks.getDiagBlock(j);
+		const float* denseBlock = useDense ? m_denseBlocks.getDiagBlock(j) : NULL;
+		for (unsigned int e = 0; e < DENSE_JTJ_BLOCK_SIZE; e++)
+			Ljj[e] = (useSparse ? weightSparse * sparseBlock[e] : 0.0f) + (useDense ? denseBlock[e] : 0.0f);
+		for (unsigned int r = 0; r < 6; r++) {
+			float& d = Ljj[r * 6 + r];
+			d = (d > PRECONDITIONER_MIN_DIAG) ? d * (1.0f + shift) : 1.0f;
+		}
+		for (int a = m_icRowOffsets[j]; a < m_icRowOffsets[j + 1]; a++) {
+			const float* Ljk = m_icBlocks.data() + DENSE_JTJ_BLOCK_SIZE * a;
+			subtractABt(Ljj, Ljk, Ljk);
+		}
+		if (!choleskyBlock6(Ljj)) return false;
+	}
+	return true;
+}
+
+void CPUSolverBundling::applyPreconditioner(unsigned int numberOfImages, const std::vector<float3>& rTrans, const std::vector<float3>& rRot,
+	std::vector<float3>& zTrans, std::vector<float3>& zRot)
+{
+	if (m_preconditioner == PRECONDITIONER_JACOBI) {
+		for (unsigned int x = 1; x < numberOfImages; x++) {
+			zTrans[x] = m_precondTrans[x] * rTrans[x];
+			zRot[x] = m_precondRot[x] * rRot[x];
+		}
+	}
+	else if (m_icRowOffsets.empty()) { //block jacobi (or incomplete cholesky fallback)
+		ThreadPool::get().parallelFor(1, numberOfImages, [&](unsigned int x) {
+			applyPreconditionerBlock(m_precondBlocks.data() + DENSE_JTJ_BLOCK_SIZE * x, rTrans[x], rRot[x], zTrans[x], zRot[x]);
+		}, 256);
+	}
+	else {
+		//L y = r by rows, then L^T z = y by columns (scattering each solved z_j to its row entries)
+		m_icWork.assign(6 * numberOfImages, 0.0f);
+		for (unsigned int j = 1; j < numberOfImages; j++) {
+			float* y = m_icWork.data() + 6 * j;
+			y[0] = rTrans[j].x; y[1] = rTrans[j].y; y[2] = rTrans[j].z;
+			y[3] = rRot[j].x; y[4] = rRot[j].y; y[5] = rRot[j].z;
+			for (int a = m_icRowOffsets[j]; a < m_icRowOffsets[j + 1]; a++) {
+				const float* Ljk = m_icBlocks.data() + DENSE_JTJ_BLOCK_SIZE * a;
+				const float* yk = m_icWork.data() + 6 * m_icCols[a];
+				for (unsigned int r = 0; r < 6; r++) {
+					for (unsigned int c = 0; c < 6; c++) y[r] -= Ljk[r * 6 + c] * yk[c];
+				}
+			}
+			solveLowerBlock6(m_precondBlocks.data() + DENSE_JTJ_BLOCK_SIZE * j, y);
+		}
+		for (unsigned int j = numberOfImages - 1; j > 0; j--) {
+			float* z = m_icWork.data() + 6 * j;
+			solveUpperBlock6(m_precondBlocks.data() + DENSE_JTJ_BLOCK_SIZE * j, z);
+			for (int a = m_icRowOffsets[j]; a < m_icRowOffsets[j + 1]; a++) {
+				const float* Ljk = m_icBlocks.data() + DENSE_JTJ_BLOCK_SIZE * a;
+				float* zk = m_icWork.data() + 6 * m_icCols[a];
+				for (unsigned int c = 0; c < 6; c++) {
+					for (unsigned int r = 0; r < 6; r++) zk[c] -= Ljk[r * 6 + c] * z[r];
+				}
+			}
+			zTrans[j] = make_float3(z[0], z[1], z[2]);
+			zRot[j] = make_float3(z[3], z[4], z[5]);
+		}
+	}
+}
+
+void CPUSolverBundling::solveLinearSystem(unsigned int numberOfImages, unsigned int nLinearIterations, float weightSparse, bool useSparse, bool useDense,
+	float3* xRot, float3* xTrans, IterationTiming& timing)
+{
+	Timer timer;
+	timer.start();
+	buildPreconditioner(numberOfImages, weightSparse, useSparse, useDense);
+	timer.stop();
+	timing.timePreconditioner = (float)timer.getElapsedTimeMS();
+
+	const float3 zero = make_float3(0.0f, 0.0f, 0.0f);
+	m_deltaTrans.assign(numberOfImages, zero);	m_deltaRot.assign(numberOfImages, zero);
+	m_rTrans.assign(numberOfImages, zero);		m_rRot.assign(numberOfImages, zero);
+	m_zTrans.assign(numberOfImages, zero);		m_zRot.assign(numberOfImages, zero);
+	m_pTrans.assign(numberOfImages, zero);		m_pRot.assign(numberOfImages, zero);
+	m_ApTrans.resize(numberOfImages);			m_ApRot.resize(numberOfImages);
+
+	//r = -J^T F, p = M^-1 r (image 0 is fixed)
+	for (unsigned int x = 1; x < numberOfImages; x++) {
+		const float* sparseJtr = m_sparseJtr.data() + 6 * x;
+		float3 rTrans = -weightSparse * make_float3(sparseJtr[0], sparseJtr[1], sparseJtr[2]);
+		float3 rRot = -weightSparse * make_float3(sparseJtr[3], sparseJtr[4], sparseJtr[5]);
+		if (useDense) {
+			const float* denseJtr = m_denseJtr.data() + 6 * x;
+			rTrans -= make_float3(denseJtr[0], denseJtr[1], denseJtr[2]);
+			rRot -= make_float3(denseJtr[3], denseJtr[4], denseJtr[5]);
+		}
+		m_rTrans[x] = rTrans;
+		m_rRot[x] = rRot;
+	}
+	applyPreconditioner(numberOfImages, m_rTrans, m_rRot, m_pTrans, m_pRot);
+	double rDotzOld = 0.0, rDotrInit = 0.0;
+	for (unsigned int x = 1; x < numberOfImages; x++) {
+		rDotzOld += dot(m_rTrans[x], m_pTrans[x]) + dot(m_rRot[x], m_pRot[x]);
+		rDotrInit += dot(m_rTrans[x], m_rTrans[x]) + dot(m_rRot[x], m_rRot[x]);
+	}
+	const double rDotrTarget = (double)m_linearTolerance * (double)m_linearTolerance * rDotrInit;
+
+	for (unsigned int it = 0; it < nLinearIterations; it++) {
+		std::fill(m_ApTrans.begin(), m_ApTrans.end(), zero);
+		std::fill(m_ApRot.begin(), m_ApRot.end(), zero);
+		if (useSparse) {
+			m_sparseBlocks.multiply(m_pTrans, m_pRot, m_ApTrans, m_ApRot);
+			for (unsigned int x = 1; x < numberOfImages; x++) {
+				m_ApTrans[x] *= weightSparse;
+				m_ApRot[x] *= weightSparse;
+			}
+		}
+		if (useDense) m_denseBlocks.multiply(m_pTrans, m_pRot, m_ApTrans, m_ApRot);
+
+		double pAp = 0.0;
+		for (unsigned int x = 1; x < numberOfImages; x++) pAp += dot(m_pTrans[x], m_ApTrans[x]) + dot(m_pRot[x], m_ApRot[x]);
+		const float alpha = (pAp > EPSILON) ? (float)(rDotzOld / pAp) : 0.0f;
+
+		double rDotr = 0.0;
+		for (unsigned int x = 1; x < numberOfImages; x++) {
+			m_deltaTrans[x] += alpha * m_pTrans[x];
+			m_deltaRot[x] += alpha * m_pRot[x];
+			m_rTrans[x] -= alpha * m_ApTrans[x];
+			m_rRot[x] -= alpha * m_ApRot[x];
+			rDotr += dot(m_rTrans[x], m_rTrans[x]) + dot(m_rRot[x], m_rRot[x]);
+		}
+		applyPreconditioner(numberOfImages, m_rTrans, m_rRot, m_zTrans, m_zRot);
+		double rDotzNew = 0.0;
+		for (unsigned int x = 1; x < numberOfImages; x++) rDotzNew += dot(m_zTrans[x], m_rTrans[x]) + dot(m_zRot[x], m_rRot[x]);
+		const float beta = (rDotzOld > EPSILON) ? (float)(rDotzNew / rDotzOld) : 0.0f;
+		for (unsigned int x = 1; x < numberOfImages; x++) {
+			m_pTrans[x] = m_zTrans[x] + beta * m_pTrans[x];
+			m_pRot[x] = m_zRot[x] + beta * m_pRot[x];
+		}
+		rDotzOld = rDotzNew;
+		if (m_bRecordConvergence) m_linConvergence.push_back((float)rDotzNew);
+
+		const bool converged = m_linearTolerance > 0.0f && rDotr <= rDotrTarget;
+		if (it + 1 == nLinearIterations || std::fabs(pAp) < PCG_EARLY_OUT_THRESH || converged) {
+			for (unsigned int x = 1; x < numberOfImages; x++)
+				matrixToPose(poseToMatrix(m_deltaRot[x], m_deltaTrans[x]) * m_transforms[x], xRot[x], xTrans[x]);
+			timing.numLinIterations = it + 1;
+			return;
+		}
+	}
+	timing.numLinIterations = 0;
+}
+
+float CPUSolverBundling::evalSparseEnergy(const EntryJ* correspondences, unsigned int numberOfCorrespondences, unsigned int numberOfImages, float weightSparse,
+	const float3* xRot, const float3* xTrans) const
+{
+	std::vector<float4x4> transforms(numberOfImages);
+	for (unsigned int i = 0; i < numberOfImages; i++) transforms[i] = poseToMatrix(xRot[i], xTrans[i]);
+
+	//fixed chunks summed in order: same value for any number of threads
+	const unsigned int numChunks = (numberOfCorrespondences + ENERGY_CHUNK_SIZE - 1) / ENERGY_CHUNK_SIZE;
+	std::vector<double> chunkSums(numChunks, 0.0);
+	ThreadPool::get().parallelFor(0, numChunks, [&](unsigned int k) {
+		const unsigned int end = std::min((k + 1) * ENERGY_CHUNK_SIZE, numberOfCorrespondences);
+		double sum = 0.0;
+		for (unsigned int c = k * ENERGY_CHUNK_SIZE; c < end; c++) {
+			const EntryJ& corr = correspondences[c];
+			if (!corr.isValid()) continue;
+			const float3 r = transforms[corr.imgIdx_i] * corr.pos_i - transforms[corr.imgIdx_j] * corr.pos_j;
+			sum += dot(r, r);
+		}
+		chunkSums[k] = sum;
+	});
+	double energy = 0.0;
+	for (unsigned int k = 0; k < numChunks; k++) energy += chunkSums[k];
+	return (float)(weightSparse * energy);
+}
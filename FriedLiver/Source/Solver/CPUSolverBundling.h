@@ -0,0 +1,161 @@
+#pragma once
+
+#ifndef _CPU_SOLVER_BUNDLING_
+#define _CPU_SOLVER_BUNDLING_
+
+#include <vector>
+#include <cuda_runtime.h>
+
+#include "SolverBundlingParameters.h"
+#include "SolverBundlingState.h"
+#include "SolverBundlingDenseBlocks.h"
+#include "../SiftGPU/cuda_SimpleMatrixUtil.h"
+
+class CUDACache;
+
+//! host version of CUDASolverBundling::solve (Lie parametrization): Gauss-Newton over the same sparse (correspondences) and dense (depth / color of
+//! the cached frames) terms with the same per iteration weights, preconditioned PCG and stopping rules, on host copies of the input.
+//! the normal equations are assembled once per non-linear iteration as 6x6 blocks (one per image and one per image pair, SolverBundlingDenseBlocks),
+//! so a PCG iteration is a block sparse product instead of a pass over all correspondences and dense pixels. the assembly runs on the ThreadPool
+//! over the image pairs (each pair accumulates into its own blocks), the per image blocks are then summed over the images in parallel, so the
+//! result does not depend on the number of threads. besides the Jacobi preconditioner of the GPU, the assembled blocks allow block Jacobi and a
+//! block incomplete cholesky preconditioner (SolverBundlingPreconditioner.h)
+class CPUSolverBundling
+{
+public:
+	//! timings in ms of one non-linear iteration
+	struct IterationTiming {
+		float timeBuildSparse;
+		float timeBuildDense;
+		float timePCG;
+		float timePreconditioner;	//setup of the preconditioner, part of timePCG
+		unsigned int numLinIterations;
+	};
+
+	CPUSolverBundling(unsigned int maxNumberOfImages);
+	~CPUSolverBundling();
+
+	//! host mirror of the cached frames used by the dense terms: downloads the frames [getNumCachedFrames(), cache->getNumFrames()); cached frames
+	//! are not modified after they are stored, so the mirror only needs to catch up (call reset() whenever the cache is reset)
+	void syncFrames(const CUDACache* cache);
+	void reset() { m_numCachedFrames = 0; }
+	unsigned int getNumCachedFrames() const { return m_numCachedFrames; }
+
+	//! same arguments as CUDASolverBundling::solve on host data (cudaCache == NULL: no dense terms, otherwise its frames are synced first);
+	//! xRot / xTrans hold the initial poses and receive the optimized ones
+	void solve(const EntryJ* correspondences, unsigned int numberOfCorrespondences, const int* validImages, unsigned int numberOfImages,
+		unsigned int nNonLinearIterations, unsigned int nLinearIterations, const CUDACache* cudaCache,
+		const std::vector<float>& weightsSparse, const std::vector<float>& weightsDenseDepth, const std::vector<float>& weightsDenseColor, bool usePairwiseDense,
+		float3* xRot, float3* xTrans);
+
+	//! PRECONDITIONER_* (SolverBundlingPreconditioner.h), default s_solverPreconditioner
+	void setPreconditioner(unsigned int preconditioner);
+	unsigned int getPreconditioner() const { return m_preconditioner; }
+	//! > 0: the PCG also stops once |r| <= tolerance * |r_0| (the linear iteration count stays the upper bound), default s_solverLinearTolerance
+	void setLinearTolerance(float tolerance) { m_linearTolerance = tolerance; }
+	//! > 0: the non-linear iterations stop once the relative change of the energy (sparse + dense) is below, default s_solverEnergyTolerance
+	void setEnergyTolerance(float tolerance) { m_energyTolerance = tolerance; }
+	void setRecordConvergence(bool b) { m_bRecordConvergence = b; }
+
+	//! sparse energy before and after each non-linear iteration that ran (as CUDASolverBundling::getConvergenceAnalysis)
+	const std::vector<float>& getConvergenceAnalysis() const { return m_convergence; }
+	//! r^T z per linear iteration, concatenated over the non-linear iterations
+	const std::vector<float>& getLinearConvergenceAnalysis() const { return m_linConvergence; }
+	//! timings of the non-linear iterations of the last solve
+	const std::vector<IterationTiming>& getIterationTimings() const { return m_iterationTimings; }
+	float getTotalTime() const { return m_totalTime; }
+
+private:
+	//! downsampled frame of the cache
+	struct CachedFrame {
+		std::vector<float>	depth;
+		std::vector<float4>	camPos;
+		std::vector<float4>	normals;
+		std::vector<uchar4>	normalsUCHAR4;
+		std::vector<float>	intensity;
+		std::vector<float2>	intensityDerivs;
+	};
+	//! contribution of one image pair (x, y) to the diagonal blocks and J^T r of its images; the off-diagonal block is accumulated in place
+	struct PairSystem {
+		float JtJ[2][DENSE_JTJ_BLOCK_SIZE];
+		float Jtr[2][6];
+		float energy;	//weighted squared residuals
+	};
+
+	//! runs of valid correspondences of the same image pair; a pair may have several runs, each adds its own off-diagonal block
+	void groupCorrespondences(const EntryJ* correspondences, unsigned int numberOfCorrespondences, unsigned int numberOfImages);
+	//! unweighted J^T J / J^T r of the sparse term at the current transforms and the Jacobi preconditioner of the GPU solver (diagonal of J^T J)
+	void buildSparseSystem(const EntryJ* correspondences, unsigned int numberOfImages);
+	//! weighted J^T J / J^T r and energy of the dense terms; false if there are no overlapping image pairs (as BuildDenseSystem)
+	bool buildDenseSystem(const int* validImages, unsigned int numberOfImages, const SolverParameters& parameters, float& energy);
+	//! overlapping image pairs (FindImageImageCorr_Kernel), pairwise: candidates of SolverBundlingOverlapIndex, otherwise consecutive images
+	void findOverlappingImages(const int* validImages, unsigned int numberOfImages, const SolverParameters& parameters, std::vector<uint2>& pairs) const;
+	//! pair weight from the number of dense correspondences (FindDenseCorrespondences_Kernel, WeightDenseCorrespondences_Kernel)
+	float computePairWeight(unsigned int i, unsigned int j, const SolverParameters& parameters) const;
+	//! dense depth / color rows of the pixels of j projected into i
+	void accumulateDensePair(unsigned int i, unsigned int j, float pairWeight, const SolverParameters& parameters, PairSystem& system, float* offDiagBlock) const;
+	//! sums the pair contributions into the diagonal blocks and J^T r of the images (parallel over the images)
+	void reducePairSystems(unsigned int numberOfImages, const std::vector<uint2>& pairs, const std::vector<float>& pairWeights,
+		SolverBundlingDenseBlocks& blocks, std::vector<float>& jtr) const;
+
+	//! block preconditioners of the weighted system (the Jacobi one is built with the sparse system)
+	void buildPreconditioner(unsigned int numberOfImages, float weightSparse, bool useSparse, bool useDense);
+	//! block IC(0) on the pattern of the sparse and dense image pairs; false if the factorization breaks down
+	bool factorIncompleteCholesky(unsigned int numberOfImages, float weightSparse, bool useSparse, bool useDense, float shift);
+	//! z = M^-1 r for the variables > 0
+	void applyPreconditioner(unsigned int numberOfImages, const std::vector<float3>& rTrans, const std::vector<float3>& rRot,
+		std::vector<float3>& zTrans, std::vector<float3>& zRot);
+	//! PCG on the assembled system (PCGInit_Kernel*, PCGStep_Kernel*), applies the update to xRot / xTrans; sets the number of iterations and
+	//! the preconditioner setup time of timing
+	void solveLinearSystem(unsigned int numberOfImages, unsigned int nLinearIterations, float weightSparse, bool useSparse, bool useDense,
+		float3* xRot, float3* xTrans, IterationTiming& timing);
+	//! sum of weightSparse * |r|^2 over the valid correspondences (EvalResidual)
+	float evalSparseEnergy(const EntryJ* correspondences, unsigned int numberOfCorrespondences, unsigned int numberOfImages, float weightSparse,
+		const float3* xRot, const float3* xTrans) const;
+
+	unsigned int					m_maxNumberOfImages;
+	unsigned int					m_maxNumDenseImPairs;
+	SolverParameters				m_defaultParams;
+	bool							m_bRecordConvergence;
+	unsigned int					m_preconditioner;
+	float							m_linearTolerance;
+	float							m_energyTolerance;
+
+	//cache mirror
+	unsigned int					m_width;
+	unsigned int					m_height;
+	float4							m_intrinsics;	//fx, fy, cx, cy
+	unsigned int					m_numCachedFrames;
+	std::vector<CachedFrame>		m_frames;
+
+	//per solve / non-linear iteration
+	std::vector<float4x4>			m_transforms;
+	std::vector<float4x4>			m_transformInverses;
+	std::vector<uint2>				m_sparsePairs;
+	std::vector<unsigned int>		m_sparsePairRuns;	//correspondence range [m_sparsePairRuns[p], m_sparsePairRuns[p + 1]) of run p
+	std::vector<PairSystem>			m_pairSystems;
+	SolverBundlingDenseBlocks		m_sparseBlocks;
+	std::vector<float>				m_sparseJtr;
+	SolverBundlingDenseBlocks		m_denseBlocks;
+	std::vector<float>				m_denseJtr;
+
+	//PCG state, trans / rot per image
+	std::vector<float3>				m_precondTrans, m_precondRot;
+	std::vector<float>				m_precondBlocks;	//block jacobi: factored diagonal blocks, incomplete cholesky: diagonal blocks of L
+	std::vector<int>				m_icRowOffsets;		//incomplete cholesky: off-diagonal blocks L_jk, k < j, of row j in [m_icRowOffsets[j], m_icRowOffsets[j + 1])
+	std::vector<unsigned int>		m_icCols;
+	std::vector<float>				m_icBlocks;
+	std::vector<float>				m_icWork;
+	std::vector<float3>				m_deltaTrans, m_deltaRot;
+	std::vector<float3>				m_rTrans, m_rRot;
+	std::vector<float3>				m_zTrans, m_zRot;
+	std::vector<float3>				m_pTrans, m_pRot;
+	std::vector<float3>				m_ApTrans, m_ApRot;
+
+	std::vector<float>				m_convergence;
+	std::vector<float>				m_linConvergence;
+	std::vector<IterationTiming>	m_iterationTimings;
+	float							m_totalTime;
+};
+
+#endif
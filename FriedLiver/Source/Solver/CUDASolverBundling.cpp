@@ -1,13 +1,16 @@
 
 #include "stdafx.h"
 #include "CUDASolverBundling.h"
+#include "SolverBundlingDenseBlocks.h"
+#include "SolverBundlingPreconditioner.h"
 #include "../GlobalBundlingState.h"
 #include "../CUDACache.h"
 #include "../SiftGPU/MatrixConversion.h"
 
 extern "C" void evalMaxResidual(SolverInput& input, SolverState& state, SolverStateAnalysis& analysis, SolverParameters& parameters, CUDATimer* timer);
 extern "C" void buildVariablesToCorrespondencesTableCUDA(EntryJ* d_correspondences, unsigned int numberOfCorrespondences, unsigned int maxNumCorrespondencesPerImage, int* d_variablesToCorrespondences, int* d_numEntriesPerRow, CUDATimer* timer);
-extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, SolverParameters& parameters, SolverStateAnalysis& analysis, float* convergenceAnalysis, CUDATimer* timer);
+extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, SolverParameters& parameters, SolverStateAnalysis& analysis,
+	std::vector<float>* convergenceAnalysis, std::vector<float>* linConvergenceAnalysis, CUDATimer* timer);
 
 extern "C" int countHighResiduals(SolverInput& input, SolverState& state, SolverParameters& parameters, CUDATimer* timer);
 
@@ -28,7 +31,7 @@ CUDASolverBundling::CUDASolverBundling(unsigned int maxNumberOfImages, unsigned
 	m_timer = NULL;
 	//m_timer = new CUDATimer();
 	//if (GlobalBundlingState::get().s_enableDetailedTimings) m_timer = new CUDATimer();
-	m_bRecordConvergence = GlobalBundlingState::get().s_recordSolverConvergence;
+	m_bRecordConvergence = GlobalBundlingState::get().s_recordSolverConvergence || GlobalBundlingState::get().s_solverCPUCompare;
 
 	//TODO PARAMS
 	const unsigned int submapSize = GlobalBundlingState::get().s_submapSize;
@@ -50,10 +53,11 @@ CUDASolverBundling::CUDASolverBundling(unsigned int maxNumberOfImages, unsigned
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_Jp, sizeof(float3)*maxNumResiduals));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_Ap_XRot, sizeof(float3)*numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_Ap_XTrans, sizeof(float3)*numberOfVariables));
-	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_scanAlpha, sizeof(float) * 2));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_scanAlpha, sizeof(float) * 3));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_rDotzOld, sizeof(float) *numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_precondionerRot, sizeof(float3)*numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_precondionerTrans, sizeof(float3)*numberOfVariables));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_precondionerBlocks, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_sumResidual, sizeof(float)));
 	unsigned int n = (maxNumResiduals + THREADS_PER_BLOCK - 1) / THREADS_PER_BLOCK;
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverExtra.d_maxResidual, sizeof(float) * n));
@@ -66,12 +70,18 @@ CUDASolverBundling::CUDASolverBundling(unsigned int maxNumberOfImages, unsigned
 
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_countHighResidual, sizeof(int)));
 
-	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseJtJ, sizeof(float) * 36 * numberOfVariables * numberOfVariables));
+	//dense JtJ blocks scale with the overlapping image pairs (capped), not with the number of images squared
+	m_maxNumDenseImPairs = std::min(m_maxNumberOfImages * (m_maxNumberOfImages - 1) / 2, GlobalBundlingState::get().s_maxNumDenseImPairs);
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseJtJDiag, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * numberOfVariables));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseJtJOffDiag, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * m_maxNumDenseImPairs));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseJtJRowOffsets, sizeof(int) * (numberOfVariables + 1)));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseJtJRowPairs, sizeof(int) * 2 * m_maxNumDenseImPairs));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseJtr, sizeof(float) * 6 * numberOfVariables));
-	m_maxNumDenseImPairs = m_maxNumberOfImages * (m_maxNumberOfImages - 1) / 2;
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseCorrCounts, sizeof(float) * m_maxNumDenseImPairs));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseOverlappingImages, sizeof(uint2) * m_maxNumDenseImPairs));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_numDenseOverlappingImages, sizeof(int)));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseImageBounds, sizeof(float3) * 3 * m_maxNumberOfImages));
+	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_denseCandidatePairs, sizeof(uint2) * m_maxNumDenseImPairs));
 
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_corrCount, sizeof(int)));
 	MLIB_CUDA_SAFE_CALL(cudaMalloc(&m_solverState.d_corrCountColor, sizeof(int)));
@@ -98,6 +108,22 @@ CUDASolverBundling::CUDASolverBundling(unsigned int maxNumberOfImages, unsigned
 	m_defaultParams.denseDepthMin = GlobalBundlingState::get().s_denseDepthMin;
 	m_defaultParams.denseDepthMax = GlobalBundlingState::get().s_denseDepthMax;
 	m_defaultParams.denseOverlapCheckSubsampleFactor = GlobalBundlingState::get().s_denseOverlapCheckSubsampleFactor;
+	m_defaultParams.preconditioner = GlobalBundlingState::get().s_solverPreconditioner;
+#ifndef USE_LIE_SPACE
+	if (m_defaultParams.preconditioner != PRECONDITIONER_JACOBI) {
+		//the blocks are built in the variable order of the lie parametrization
+		std::cout << "warning: block preconditioners need USE_LIE_SPACE, using jacobi" << std::endl;
+		m_defaultParams.preconditioner = PRECONDITIONER_JACOBI;
+	}
+#endif
+	if (m_defaultParams.preconditioner == PRECONDITIONER_INCOMPLETE_CHOLESKY) {
+		//the triangular solves of the incomplete factorization are sequential over the images
+		std::cout << "warning: incomplete cholesky preconditioner only supported by the CPU solver, using block jacobi" << std::endl;
+		m_defaultParams.preconditioner = PRECONDITIONER_BLOCK_JACOBI;
+	}
+	MLIB_ASSERT(m_defaultParams.preconditioner <= PRECONDITIONER_BLOCK_JACOBI);
+	m_defaultParams.linearTolerance = GlobalBundlingState::get().s_solverLinearTolerance;
+	m_defaultParams.energyTolerance = GlobalBundlingState::get().s_solverEnergyTolerance;
 
 	//!!!DEBUGGING
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_deltaRot, -1, sizeof(float3)*numberOfVariables));
@@ -111,21 +137,27 @@ CUDASolverBundling::CUDASolverBundling(unsigned int maxNumberOfImages, unsigned
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_Jp, -1, sizeof(float3)*maxNumResiduals));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_Ap_XRot, -1, sizeof(float3)*numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_Ap_XTrans, -1, sizeof(float3)*numberOfVariables));
-	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_scanAlpha, -1, sizeof(float) * 2));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_scanAlpha, -1, sizeof(float) * 3));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_rDotzOld, -1, sizeof(float) *numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_precondionerRot, -1, sizeof(float3)*numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_precondionerTrans, -1, sizeof(float3)*numberOfVariables));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_precondionerBlocks, -1, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_sumResidual, -1, sizeof(float)));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverExtra.d_maxResidual, -1, sizeof(float) * n));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverExtra.d_maxResidualIndex, -1, sizeof(int) * n));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(d_variablesToCorrespondences, -1, sizeof(int)*m_maxNumberOfImages*m_maxCorrPerImage));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(d_numEntriesPerRow, -1, sizeof(int)*m_maxNumberOfImages));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_countHighResidual, -1, sizeof(int)));
-	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseJtJ, -1, sizeof(float) * 36 * numberOfVariables * numberOfVariables));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseJtJDiag, -1, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * numberOfVariables));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseJtJOffDiag, -1, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * m_maxNumDenseImPairs));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseJtJRowOffsets, -1, sizeof(int) * (numberOfVariables + 1)));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseJtJRowPairs, -1, sizeof(int) * 2 * m_maxNumDenseImPairs));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseJtr, -1, sizeof(float) * 6 * numberOfVariables));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseCorrCounts, -1, sizeof(float) * m_maxNumDenseImPairs));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseOverlappingImages, -1, sizeof(uint2) * m_maxNumDenseImPairs));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_numDenseOverlappingImages, -1, sizeof(int)));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseImageBounds, -1, sizeof(float3) * 3 * m_maxNumberOfImages));
+	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_denseCandidatePairs, -1, sizeof(uint2) * m_maxNumDenseImPairs));
 
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_corrCount, -1, sizeof(int)));
 	MLIB_CUDA_SAFE_CALL(cudaMemset(m_solverState.d_corrCountColor, -1, sizeof(int)));
@@ -156,6 +188,7 @@ CUDASolverBundling::~CUDASolverBundling()
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_rDotzOld);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_precondionerRot);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_precondionerTrans);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_precondionerBlocks);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_sumResidual);
 	MLIB_CUDA_SAFE_FREE(m_solverExtra.d_maxResidual);
 	MLIB_CUDA_SAFE_FREE(m_solverExtra.d_maxResidualIndex);
@@ -167,13 +200,19 @@ CUDASolverBundling::~CUDASolverBundling()
 
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_countHighResidual);
 
-	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseJtJ);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseJtJDiag);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseJtJOffDiag);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseJtJRowOffsets);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseJtJRowPairs);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseJtr);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseCorrCounts);
 
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_xTransforms);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_xTransformInverses);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseOverlappingImages);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_numDenseOverlappingImages);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseImageBounds);
+	MLIB_CUDA_SAFE_FREE(m_solverState.d_denseCandidatePairs);
 
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_corrCount);
 	MLIB_CUDA_SAFE_FREE(m_solverState.d_sumResidualColor);
@@ -197,11 +236,8 @@ void CUDASolverBundling::solve(EntryJ* d_correspondences, unsigned int numberOfC
 		std::cerr << "WARNING: #corr (" << numberOfCorrespondences << ") exceeded limit (" << m_maxCorrPerImage << "*" << m_maxNumberOfImages << "), please increase max #corr per image in the GAS" << std::endl;
 	}
 
-	float* convergence = NULL;
-	if (m_bRecordConvergence) {
-		m_convergence.resize(nNonLinearIterations + 1, -1.0f);
-		convergence = m_convergence.data();
-	}
+	m_convergence.clear();
+	m_linConvergence.clear();
 
 	m_solverState.d_xRot = d_rotationAnglesUnknowns;
 	m_solverState.d_xTrans = d_translationUnknowns;
@@ -270,7 +306,7 @@ void CUDASolverBundling::solve(EntryJ* d_correspondences, unsigned int numberOfC
 	//	cudaCache->printCacheImages("debug/cache/");
 	//	int a = 5;
 	//}
-	solveBundlingStub(solverInput, m_solverState, parameters, m_solverExtra, convergence, m_timer);
+	solveBundlingStub(solverInput, m_solverState, parameters, m_solverExtra, m_bRecordConvergence ? &m_convergence : NULL, m_bRecordConvergence ? &m_linConvergence : NULL, m_timer);
 
 	if (findMaxResidual) {
 		computeMaxResidual(solverInput, parameters, revalidateIdx);
@@ -283,6 +319,35 @@ void CUDASolverBundling::solve(EntryJ* d_correspondences, unsigned int numberOfC
 	}
 }
 
+void CUDASolverBundling::evaluate(EntryJ* d_correspondences, unsigned int numberOfCorrespondences, unsigned int numberOfImages, float weightSparse,
+	float3* d_rotationAnglesUnknowns, float3* d_translationUnknowns,
+	bool rebuildJT, bool findMaxResidual, unsigned int revalidateIdx)
+{
+	m_solverState.d_xRot = d_rotationAnglesUnknowns;
+	m_solverState.d_xTrans = d_translationUnknowns;
+
+	SolverParameters parameters = m_defaultParams;
+	parameters.verifyOptDistThresh = m_verifyOptDistThresh;
+	parameters.verifyOptPercentThresh = m_verifyOptPercentThresh;
+	parameters.highResidualThresh = std::numeric_limits<float>::infinity();
+	parameters.weightSparse = weightSparse;
+
+	//only the sparse part of the input is used
+	SolverInput solverInput;
+	memset(&solverInput, 0, sizeof(SolverInput));
+	solverInput.d_correspondences = d_correspondences;
+	solverInput.d_variablesToCorrespondences = d_variablesToCorrespondences;
+	solverInput.d_numEntriesPerRow = d_numEntriesPerRow;
+	solverInput.numberOfImages = numberOfImages;
+	solverInput.numberOfCorrespondences = numberOfCorrespondences;
+	solverInput.maxNumberOfImages = m_maxNumberOfImages;
+	solverInput.maxCorrPerImage = m_maxCorrPerImage;
+	solverInput.maxNumDenseImPairs = m_maxNumDenseImPairs;
+
+	if (rebuildJT) buildVariablesToCorrespondencesTable(d_correspondences, numberOfCorrespondences);
+	if (findMaxResidual) computeMaxResidual(solverInput, parameters, revalidateIdx);
+}
+
 void CUDASolverBundling::buildVariablesToCorrespondencesTable(EntryJ* d_correspondences, unsigned int numberOfCorrespondences)
 {
 	cutilSafeCall(cudaMemset(d_numEntriesPerRow, 0, sizeof(int)*m_maxNumberOfImages));
@@ -384,7 +449,7 @@ void CUDASolverBundling::computeMaxResidual(SolverInput& solverInput, SolverPara
 
 					////one extra solve
 					//parameters.nNonLinearIterations = 1;
-					//solveBundlingStub(solverInput, m_solverState, parameters, m_solverExtra, NULL, m_timer);
+					//solveBundlingStub(solverInput, m_solverState, parameters, m_solverExtra, NULL, NULL, m_timer);
 
 					////!!!debugging
 					//{
@@ -30,7 +30,13 @@ public:
 		const std::vector<float>& weightsSparse, const std::vector<float>& weightsDenseDepth, const std::vector<float>& weightsDenseColor, bool usePairwiseDense,
 		float3* d_rotationAnglesUnknowns, float3* d_translationUnknowns,
 		bool rebuildJT, bool findMaxResidual, unsigned int revalidateIdx);
+	//! the bookkeeping of solve (correspondence table, max residual) for poses optimized elsewhere (CPUSolverBundling)
+	void evaluate(EntryJ* d_correspondences, unsigned int numberOfCorrespondences, unsigned int numberOfImages, float weightSparse,
+		float3* d_rotationAnglesUnknowns, float3* d_translationUnknowns,
+		bool rebuildJT, bool findMaxResidual, unsigned int revalidateIdx);
+	//! sparse energy before and after each non-linear iteration that ran (s_recordSolverConvergence)
 	const std::vector<float>& getConvergenceAnalysis() const { return m_convergence; }
+	//! r^T z per PCG iteration, concatenated over the non-linear iterations (s_recordSolverConvergence)
 	const std::vector<float>& getLinearConvergenceAnalysis() const { return m_linConvergence; }
 
 	void getMaxResidual(float& max, int& index) const {
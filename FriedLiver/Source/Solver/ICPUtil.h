@@ -24,7 +24,9 @@ inline __device__ mat2x3 dCameraToScreen(const float3& p, float fx, float fy)
 	return res;
 }
 
-inline __device__ float2 bilinearInterpolationFloat2(float x, float y, const float2* d_input, unsigned int imageWidth, unsigned int imageHeight)
+//! ImageT: device pointer or a CUDACachedFrame view (CUDACacheUtil.h)
+template<class ImageT>
+inline __device__ float2 bilinearInterpolationFloat2(float x, float y, const ImageT& d_input, unsigned int imageWidth, unsigned int imageHeight)
 {
 	const int2 p00 = make_int2(floor(x), floor(y));
 	const int2 p01 = p00 + make_int2(0.0f, 1.0f);
@@ -53,7 +55,8 @@ inline __device__ float2 bilinearInterpolationFloat2(float x, float y, const flo
 	else		  return make_float2(MINF);
 }
 
-inline __device__ float bilinearInterpolationFloat(float x, float y, const float* d_input, unsigned int imageWidth, unsigned int imageHeight)
+template<class ImageT>
+inline __device__ float bilinearInterpolationFloat(float x, float y, const ImageT& d_input, unsigned int imageWidth, unsigned int imageHeight)
 {
 	const int2 p00 = make_int2(floor(x), floor(y));
 	const int2 p01 = p00 + make_int2(0.0f, 1.0f);
@@ -81,7 +84,8 @@ inline __device__ float bilinearInterpolationFloat(float x, float y, const float
 	if (ww > 0.0f) return ss / ww;
 	else		  return MINF; 
 }
-inline __device__ float4 bilinearInterpolationFloat4(float x, float y, const float4* d_input, unsigned int imageWidth, unsigned int imageHeight)
+template<class ImageT>
+inline __device__ float4 bilinearInterpolationFloat4(float x, float y, const ImageT& d_input, unsigned int imageWidth, unsigned int imageHeight)
 {
 	const int2 p00 = make_int2(floor(x), floor(y));
 	const int2 p01 = p00 + make_int2(0.0f, 1.0f);
@@ -6,7 +6,9 @@
 
 #include <cutil_inline.h>
 #include <cutil_math.h>
+#ifdef __CUDACC__
 #include <device_functions.h>
+#endif
 #include <math_constants.h>
 
 #include "../../SiftGPU/cuda_SimpleMatrixUtil.h"
@@ -16,7 +18,7 @@
 
 //! compute a rotation exponential using the Rodrigues Formula.
 //		rotation axis w (theta = |w|); A = sin(theta) / theta; B = (1 - cos(theta)) / theta^2
-__inline__ __device__ void rodrigues_so3_exp(const float3& w, float A, float B, float3x3& R)
+__inline__ __host__ __device__ void rodrigues_so3_exp(const float3& w, float A, float B, float3x3& R)
 {
 	{
 		const float wx2 = w.x * w.x;
@@ -47,7 +49,7 @@ __inline__ __device__ void rodrigues_so3_exp(const float3& w, float A, float B,
 }
 
 //! exponentiate a vector in the Lie algebra to generate a new SO3(a 3x3 rotation matrix).
-__inline__ __device__ float3x3 exp_rotation(const float3& w)
+__inline__ __host__ __device__ float3x3 exp_rotation(const float3& w)
 {
 	const float theta_sq = dot(w, w);
 	const float theta = std::sqrt(theta_sq);
@@ -76,7 +78,7 @@ __inline__ __device__ float3x3 exp_rotation(const float3& w)
 }
 
 //! logarithm of the 3x3 rotation matrix, generating the corresponding vector in the Lie Algebra
-__inline__ __device__ float3 ln_rotation(const float3x3& rotation)
+__inline__ __host__ __device__ float3 ln_rotation(const float3x3& rotation)
 {
 	float3 result; // skew symm matrix = (R - R^T) * angle / (2 * sin(angle))
 
@@ -132,7 +134,7 @@ __inline__ __device__ float3 ln_rotation(const float3x3& rotation)
 	return result;
 }
 
-__inline__ __device__ void matrixToPose(const float4x4& matrix, float3& rot, float3& trans)
+__inline__ __host__ __device__ void matrixToPose(const float4x4& matrix, float3& rot, float3& trans)
 {	
 	const float3x3 R = matrix.getFloat3x3();
 	const float3 t = matrix.getTranslation();
@@ -157,7 +159,7 @@ __inline__ __device__ void matrixToPose(const float4x4& matrix, float3& rot, flo
 	trans *= 1.0f / (2 * shtot);
 }
 
-__inline__ __device__ void poseToMatrix(const float3& rot, const float3& trans, float4x4& matrix)
+__inline__ __host__ __device__ void poseToMatrix(const float3& rot, const float3& trans, float4x4& matrix)
 {
 	matrix.setIdentity();
 
@@ -206,14 +208,14 @@ __inline__ __device__ void poseToMatrix(const float3& rot, const float3& trans,
 	matrix.m34 = translation.z;
 }
 
-__inline__ __device__ float4x4 poseToMatrix(const float3& rot, const float3& trans)
+__inline__ __host__ __device__ float4x4 poseToMatrix(const float3& rot, const float3& trans)
 {
 	float4x4 res;
 	poseToMatrix(rot, trans, res);
 	return res;
 }
 
-__inline__ __device__ float3x3 VectorToSkewSymmetricMatrix(const float3& v) {
+__inline__ __host__ __device__ float3x3 VectorToSkewSymmetricMatrix(const float3& v) {
 	float3x3 res; res.setZero();
 	res(1, 0) = v.z;
 	res(2, 0) = -v.y;
@@ -228,15 +230,15 @@ __inline__ __device__ float3x3 VectorToSkewSymmetricMatrix(const float3& v) {
 // deriv wrt e^e * T * p; pTransformed = T * p [alpha,beta,gamma,tx,ty,tz]
 /////////////////////////////////////////////////////////////////////////
 
-__inline__ __device__ float3 evalLie_dAlpha(const float3& pTransformed)
+__inline__ __host__ __device__ float3 evalLie_dAlpha(const float3& pTransformed)
 {
 	return make_float3(0.0f, -pTransformed.z, pTransformed.y);
 }
-__inline__ __device__ float3 evalLie_dBeta(const float3& pTransformed)
+__inline__ __host__ __device__ float3 evalLie_dBeta(const float3& pTransformed)
 {
 	return make_float3(pTransformed.z, 0.0f, -pTransformed.x);
 }
-__inline__ __device__ float3 evalLie_dGamma(const float3& pTransformed)
+__inline__ __host__ __device__ float3 evalLie_dGamma(const float3& pTransformed)
 {
 	return make_float3(-pTransformed.y, pTransformed.x, 0.0f);
 }
@@ -244,7 +246,7 @@ __inline__ __device__ float3 evalLie_dGamma(const float3& pTransformed)
 /////////////////////////////////////////////////////////////////////////
 // deriv for Ti: (A * e^e * D)^{-1} * p; A = Tj^{-1}; D = Ti
 /////////////////////////////////////////////////////////////////////////
-__inline__ __device__ matNxM<3, 6> evalLie_derivI(const float4x4& A, const float4x4& D, const float3& p)
+__inline__ __host__ __device__ matNxM<3, 6> evalLie_derivI(const float4x4& A, const float4x4& D, const float3& p)
 {
 	matNxM<3, 12> j0; matNxM<12, 6> j1;
 	const float4x4 transform = A * D;
@@ -274,7 +276,7 @@ __inline__ __device__ matNxM<3, 6> evalLie_derivI(const float4x4& A, const float
 /////////////////////////////////////////////////////////////////////////
 // deriv for Tj: (A * e^e * D) * p; A = Ti^{-1}; D = Tj
 /////////////////////////////////////////////////////////////////////////
-__inline__ __device__ matNxM<3, 6> evalLie_derivJ(const float4x4& A, const float4x4& D, const float3& p)
+__inline__ __host__ __device__ matNxM<3, 6> evalLie_derivJ(const float4x4& A, const float4x4& D, const float3& p)
 {
 	float3 dr1 = make_float3(D(0, 0), D(0, 1), D(0, 2));	//rows of D (rotation part)
 	float3 dr2 = make_float3(D(1, 0), D(1, 1), D(1, 2));
@@ -298,7 +300,7 @@ __inline__ __device__ matNxM<3, 6> evalLie_derivJ(const float4x4& A, const float
 // Lie Update
 /////////////////////////////////////////////////////////////////////////
 
-__inline__ __device__ void computeLieUpdate(const float3& updateW, const float3& updateT, const float3& curW, const float3& curT,
+__inline__ __host__ __device__ void computeLieUpdate(const float3& updateW, const float3& updateT, const float3& curW, const float3& curT,
 	float3& newW, float3& newT)
 {
 	const float4x4 update = poseToMatrix(updateW, updateT);
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <algorithm>
+#include <cfloat>
 
 ////for debug purposes
 //#define PRINT_RESIDUALS_SPARSE
@@ -13,6 +15,9 @@
 #include "SolverBundlingEquations.h"
 #include "SolverBundlingEquationsLie.h"
 #include "SolverBundlingDenseUtil.h"
+#include "SolverBundlingOverlapIndex.h"
+#include "SolverBundlingPreconditioner.h"
+#include "SolverBundlingConstants.h"
 #include "../../SiftGPU/CUDATimer.h"
 
 #include <conio.h>
@@ -20,20 +25,60 @@
 #define THREADS_PER_BLOCK_DENSE_DEPTH 128
 #define THREADS_PER_BLOCK_DENSE_DEPTH_FLIP 64
 
-#define THREADS_PER_BLOCK_DENSE_OVERLAP 512
+#define THREADS_PER_BLOCK_DENSE_OVERLAP DENSE_OVERLAP_NUM_SAMPLES
 
 
 /////////////////////////////////////////////////////////////////////////
 // Dense Depth Term
 /////////////////////////////////////////////////////////////////////////
+//world space bounds of the cached depth and viewing direction (see computeAngleDiff) per image, for the overlap candidates
+__global__ void ComputeImageBounds_Kernel(SolverInput input, SolverState state, SolverParameters parameters)
+{
+	const unsigned int i = blockIdx.x;
+	const unsigned int tidx = threadIdx.x;
+#ifdef USE_LIE_SPACE
+	const float4x4 transform = state.d_xTransforms[i];
+#else
+	const float4x4 transform = evalRtMat(state.d_xRot[i], state.d_xTrans[i]);
+#endif
+	float3 bmin = make_float3(FLT_MAX);
+	float3 bmax = make_float3(-FLT_MAX);
+	const unsigned int numPixels = input.denseDepthWidth * input.denseDepthHeight;
+	for (unsigned int idx = tidx; idx < numPixels; idx += THREADS_PER_BLOCK_DENSE_OVERLAP) {
+		const float depth = input.d_cacheFrames[i].getDepth()[idx];
+		if (depth > parameters.denseDepthMin && depth < parameters.denseDepthMax) {
+			const int2 loc = make_int2(idx % input.denseDepthWidth, idx / input.denseDepthWidth);
+			const float3 worldPos = transform * depthToCamera(input.intrinsics.x, input.intrinsics.y, input.intrinsics.z, input.intrinsics.w, loc, depth);
+			bmin = fminf(bmin, worldPos);
+			bmax = fmaxf(bmax, worldPos);
+		}
+	}
+	__shared__ float3 s_min[THREADS_PER_BLOCK_DENSE_OVERLAP];
+	__shared__ float3 s_max[THREADS_PER_BLOCK_DENSE_OVERLAP];
+	s_min[tidx] = bmin;	s_max[tidx] = bmax;
+	__syncthreads();
+	for (unsigned int stride = THREADS_PER_BLOCK_DENSE_OVERLAP / 2; stride > 0; stride /= 2) {
+		if (tidx < stride) {
+			s_min[tidx] = fminf(s_min[tidx], s_min[tidx + stride]);
+			s_max[tidx] = fmaxf(s_max[tidx], s_max[tidx + stride]);
+		}
+		__syncthreads();
+	}
+	if (tidx == 0) {
+		state.d_denseImageBounds[3 * i + 0] = s_min[0];
+		state.d_denseImageBounds[3 * i + 1] = s_max[0];
+		state.d_denseImageBounds[3 * i + 2] = transform.getFloat3x3() * normalize(make_float3(1.0f, 1.0f, 1.0f));
+	}
+}
+
 template<bool usePairwise>
-__global__ void FindImageImageCorr_Kernel(SolverInput input, SolverState state, SolverParameters parameters)
+__global__ void FindImageImageCorr_Kernel(SolverInput input, SolverState state, SolverParameters parameters, const uint2* d_candidatePairs)
 {
 	// image indices
 	unsigned int i, j; // project from j to i
 	if (usePairwise) {
-		i = blockIdx.x; j = blockIdx.y; // all pairwise
-		if (i >= j) return;
+		const uint2 imageIndices = d_candidatePairs[blockIdx.x]; // proposed by SolverBundlingOverlapIndex
+		i = imageIndices.x; j = imageIndices.y;
 	}
 	else {
 		i = blockIdx.x; j = i + 1; // frame-to-frame
@@ -57,35 +102,37 @@ __global__ void FindImageImageCorr_Kernel(SolverInput input, SolverState state,
 #endif
 		//if (!computeAngleDiff(transform, 1.0f)) return; //~60 degrees //TODO HERE ANGIE
 		//if (!computeAngleDiff(transform, 0.8f)) return; //~45 degrees
-		if (!computeAngleDiff(transform, 0.52f)) return; //~30 degrees
+		if (!computeAngleDiff(transform, DENSE_OVERLAP_MAX_ANGLE)) return; //~30 degrees
 
 		// find correspondence
 		__shared__ int foundCorr[1]; foundCorr[0] = 0;
 		__syncthreads();
 		if (findDenseCorr(idx, input.denseDepthWidth, input.denseDepthHeight,
 			parameters.denseDistThresh, transform, input.intrinsics,
-			input.d_cacheFrames[i].d_depthDownsampled, input.d_cacheFrames[j].d_depthDownsampled,
+			input.d_cacheFrames[i].getDepth(), input.d_cacheFrames[j].getDepth(),
 			parameters.denseDepthMin, parameters.denseDepthMax)) { //i tgt, j src		//TODO PARAMS
 			atomicAdd(foundCorr, 1);
 		} // found correspondence
 		__syncthreads();
 		if (tidx == 0) {
-			if (foundCorr[0] > 10) { //TODO PARAMS
+			if (foundCorr[0] > DENSE_OVERLAP_MIN_CORR) { //TODO PARAMS
 				int addr = atomicAdd(state.d_numDenseOverlappingImages, 1);
-				state.d_denseOverlappingImages[addr] = make_uint2(i, j);
+				if ((unsigned int)addr < input.maxNumDenseImPairs) state.d_denseOverlappingImages[addr] = make_uint2(i, j);
 			}
 		}
 	} // valid image pixel
 }
 
-__global__ void FlipJtJ_Kernel(unsigned int total, unsigned int dim, float* d_JtJ)
+//copies the lower to the upper triangle of the diagonal blocks
+__global__ void FlipJtJ_Kernel(unsigned int total, float* d_JtJDiag)
 {
 	const unsigned int idx = blockIdx.x * blockDim.x + threadIdx.x;
 	if (idx < total) {
-		const unsigned int x = idx % dim;
-		const unsigned int y = idx / dim;
+		float* block = d_JtJDiag + (idx / DENSE_JTJ_BLOCK_SIZE) * DENSE_JTJ_BLOCK_SIZE;
+		const unsigned int x = idx % 6;
+		const unsigned int y = (idx % DENSE_JTJ_BLOCK_SIZE) / 6;
 		if (x > y) {
-			d_JtJ[y * dim + x] = d_JtJ[x * dim + y];
+			block[y * 6 + x] = block[x * 6 + y];
 		}
 	}
 }
@@ -113,19 +160,11 @@ __global__ void FindDenseCorrespondences_Kernel(SolverInput input, SolverState s
 		s_count[0] = 0;
 		int count = 0.0f;
 		//TODO HERE ANGIE
-#ifdef CUDACACHE_UCHAR_NORMALS
-		if (findDenseCorr(gidx, input.denseDepthWidth, input.denseDepthHeight,
-			parameters.denseDistThresh, parameters.denseNormalThresh, transform, input.intrinsics,
-			input.d_cacheFrames[i].d_depthDownsampled, input.d_cacheFrames[i].d_normalsDownsampledUCHAR4,
-			input.d_cacheFrames[j].d_depthDownsampled, input.d_cacheFrames[j].d_normalsDownsampledUCHAR4,
-			parameters.denseDepthMin, parameters.denseDepthMax)) { //i tgt, j src
-#elif defined(CUDACACHE_FLOAT_NORMALS)
 		if (findDenseCorr(gidx, input.denseDepthWidth, input.denseDepthHeight,
 			parameters.denseDistThresh, parameters.denseNormalThresh, transform, input.intrinsics,
-			input.d_cacheFrames[i].d_depthDownsampled, input.d_cacheFrames[i].d_normalsDownsampled,
-			input.d_cacheFrames[j].d_depthDownsampled, input.d_cacheFrames[j].d_normalsDownsampled,
+			input.d_cacheFrames[i].getDepth(), input.d_cacheFrames[i].getNormalsUCHAR4(),
+			input.d_cacheFrames[j].getDepth(), input.d_cacheFrames[j].getNormalsUCHAR4(),
 			parameters.denseDepthMin, parameters.denseDepthMax)) { //i tgt, j src
-#endif
 //#ifdef CUDACACHE_UCHAR_NORMALS
 //		if (findDenseCorr(gidx, input.denseDepthWidth, input.denseDepthHeight,
 //			parameters.denseDistThresh, parameters.denseNormalThresh, transform, input.intrinsics,
@@ -167,7 +206,7 @@ __global__ void WeightDenseCorrespondences_Kernel(unsigned int N, SolverState st
 		float x = state.d_denseCorrCounts[idx];
 		if (x > 0) {
 			//if (x < 3200) state.d_denseCorrCounts[idx] = 0; //don't consider too small #corr //TODO PARAMS
-			if (x < 800) state.d_denseCorrCounts[idx] = 0; //don't consider too small #corr //TODO PARAMS
+			if (x < DENSE_PAIR_MIN_CORR) state.d_denseCorrCounts[idx] = 0; //don't consider too small #corr //TODO PARAMS
 			//if (x < 400) state.d_denseCorrCounts[idx] = 0; //don't consider too small #corr //TODO PARAMS
 			//if (x < 200) state.d_denseCorrCounts[idx] = 0; //don't consider too small #corr //TODO PARAMS //TODO EVAL DEBUG
 			else {
@@ -179,6 +218,16 @@ __global__ void WeightDenseCorrespondences_Kernel(unsigned int N, SolverState st
 	}
 }
 
+//! the weighted dense residuals are summed while building the dense system (dense energy of the non-linear early out)
+__host__ __device__ inline bool sumDenseResiduals(const SolverParameters& parameters)
+{
+#ifdef PRINT_RESIDUALS_DENSE
+	return true;
+#else
+	return parameters.energyTolerance > 0.0f;
+#endif
+}
+
 template<bool useDepth, bool useColor>
 __global__ void BuildDenseSystem_Kernel(SolverInput input, SolverState state, SolverParameters parameters)
 {
@@ -215,19 +264,11 @@ __global__ void BuildDenseSystem_Kernel(SolverInput input, SolverState state, So
 		// find correspondence
 		float3 camPosSrc; float3 camPosSrcToTgt; float3 camPosTgt; float3 normalTgt; float2 tgtScreenPos;
 		//TODO HERE ANGIE
-#ifdef CUDACACHE_FLOAT_NORMALS
-		bool foundCorr = findDenseCorr(srcIdx, input.denseDepthWidth, input.denseDepthHeight,
-			parameters.denseDistThresh, parameters.denseNormalThresh, transform, input.intrinsics,
-			input.d_cacheFrames[i].d_cameraposDownsampled, input.d_cacheFrames[i].d_normalsDownsampled,
-			input.d_cacheFrames[j].d_cameraposDownsampled, input.d_cacheFrames[j].d_normalsDownsampled,
-			parameters.denseDepthMin, parameters.denseDepthMax, camPosSrc, camPosSrcToTgt, tgtScreenPos, camPosTgt, normalTgt); //i tgt, j src
-#elif defined(CUDACACHE_UCHAR_NORMALS)
 		bool foundCorr = findDenseCorr(srcIdx, input.denseDepthWidth, input.denseDepthHeight,
 			parameters.denseDistThresh, parameters.denseNormalThresh, transform, input.intrinsics,
-			input.d_cacheFrames[i].d_cameraposDownsampled, input.d_cacheFrames[i].d_normalsDownsampledUCHAR4,
-			input.d_cacheFrames[j].d_cameraposDownsampled, input.d_cacheFrames[j].d_normalsDownsampledUCHAR4,
+			input.d_cacheFrames[i].getCameraPos(), input.d_cacheFrames[i].getNormals(),
+			input.d_cacheFrames[j].getCameraPos(), input.d_cacheFrames[j].getNormals(),
 			parameters.denseDepthMin, parameters.denseDepthMax, camPosSrc, camPosSrcToTgt, tgtScreenPos, camPosTgt, normalTgt); //i tgt, j src
-#endif
 //#ifdef CUDACACHE_UCHAR_NORMALS
 //		bool foundCorr = findDenseCorr(srcIdx, input.denseDepthWidth, input.denseDepthHeight,
 //			parameters.denseDistThresh, parameters.denseNormalThresh, transform, input.intrinsics,
@@ -269,18 +310,18 @@ __global__ void BuildDenseSystem_Kernel(SolverInput input, SolverState state, So
 				if (j > 0) computeJacobianBlockRow_j(depthJacBlockRow_j, state.d_xRot[j], state.d_xTrans[j], invTransform_i, camPosSrc, normalTgt);
 #endif
 			}
-			addToLocalSystem(foundCorr, state.d_denseJtJ, state.d_denseJtr, input.numberOfImages * 6,
+			addToLocalSystem(foundCorr, state.d_denseJtJDiag, state.d_denseJtJOffDiag + imPairIdx * DENSE_JTJ_BLOCK_SIZE, state.d_denseJtr,
 				depthJacBlockRow_i, depthJacBlockRow_j, i, j, depthRes, depthWeight, idx
-				, state.d_sumResidual, state.d_corrCount);
-			//addToLocalSystemBrute(foundCorr, state.d_denseJtJ, state.d_denseJtr, input.numberOfImages * 6,
+				, sumDenseResiduals(parameters) ? state.d_sumResidual : NULL, state.d_corrCount);
+			//addToLocalSystemBrute(foundCorr, state.d_denseJtJDiag, state.d_denseJtJOffDiag + imPairIdx * DENSE_JTJ_BLOCK_SIZE, state.d_denseJtr,
 			//	depthJacBlockRow_i, depthJacBlockRow_j, i, j, depthRes, depthWeight, idx);
 		}
 		if (useColor) {
 			bool foundCorrColor = false;
 			if (foundCorr) {
-				const float2 intensityDerivTgt = bilinearInterpolationFloat2(tgtScreenPos.x, tgtScreenPos.y, input.d_cacheFrames[i].d_intensityDerivsDownsampled, input.denseDepthWidth, input.denseDepthHeight);
-				const float intensityTgt = bilinearInterpolationFloat(tgtScreenPos.x, tgtScreenPos.y, input.d_cacheFrames[i].d_intensityDownsampled, input.denseDepthWidth, input.denseDepthHeight);
-				colorRes = intensityTgt - input.d_cacheFrames[j].d_intensityDownsampled[srcIdx];
+				const float2 intensityDerivTgt = bilinearInterpolationFloat2(tgtScreenPos.x, tgtScreenPos.y, input.d_cacheFrames[i].getIntensityDerivs(), input.denseDepthWidth, input.denseDepthHeight);
+				const float intensityTgt = bilinearInterpolationFloat(tgtScreenPos.x, tgtScreenPos.y, input.d_cacheFrames[i].getIntensity(), input.denseDepthWidth, input.denseDepthHeight);
+				colorRes = intensityTgt - input.d_cacheFrames[j].getIntensity()[srcIdx];
 				foundCorrColor = (intensityDerivTgt.x != MINF && abs(colorRes) < parameters.denseColorThresh && length(intensityDerivTgt) > parameters.denseColorGradientMin);
 				if (foundCorrColor) {
 					const float2 focalLength = make_float2(input.intrinsics.x, input.intrinsics.y);
@@ -296,10 +337,10 @@ __global__ void BuildDenseSystem_Kernel(SolverInput input, SolverState state, So
 					//colorWeight = parameters.weightDenseColor * imPairWeight * max(0.0f, 0.5f*(1.0f - abs(colorRes) / parameters.denseColorThresh) + 0.5f*max(0.0f, (1.0f - camPosTgt.z / 1.0f)));
 				}
 			}
-			addToLocalSystem(foundCorrColor, state.d_denseJtJ, state.d_denseJtr, input.numberOfImages * 6,
+			addToLocalSystem(foundCorrColor, state.d_denseJtJDiag, state.d_denseJtJOffDiag + imPairIdx * DENSE_JTJ_BLOCK_SIZE, state.d_denseJtr,
 				colorJacBlockRow_i, colorJacBlockRow_j, i, j, colorRes, colorWeight, idx
-				, state.d_sumResidualColor, state.d_corrCountColor);
-			//addToLocalSystemBrute(foundCorrColor, state.d_denseJtJ, state.d_denseJtr, input.numberOfImages * 6,
+				, sumDenseResiduals(parameters) ? state.d_sumResidualColor : NULL, state.d_corrCountColor);
+			//addToLocalSystemBrute(foundCorrColor, state.d_denseJtJDiag, state.d_denseJtJOffDiag + imPairIdx * DENSE_JTJ_BLOCK_SIZE, state.d_denseJtr,
 			//	colorJacBlockRow_i, colorJacBlockRow_j, i, j, colorRes, colorWeight, idx);
 		}
 	} // valid image pixel
@@ -309,18 +350,16 @@ bool BuildDenseSystem(const SolverInput& input, SolverState& state, SolverParame
 {
 	const unsigned int N = input.numberOfImages;
 	const int sizeJtr = 6 * N;
-	const int sizeJtJ = sizeJtr * sizeJtr;
+	const int sizeJtJDiag = DENSE_JTJ_BLOCK_SIZE * N;
 
-#ifdef PRINT_RESIDUALS_DENSE
-	cutilSafeCall(cudaMemset(state.d_corrCount, 0, sizeof(int)));
-	cutilSafeCall(cudaMemset(state.d_sumResidual, 0, sizeof(float)));
-	cutilSafeCall(cudaMemset(state.d_corrCountColor, 0, sizeof(int)));
-	cutilSafeCall(cudaMemset(state.d_sumResidualColor, 0, sizeof(float)));
-#endif
+	if (sumDenseResiduals(parameters)) {
+		cutilSafeCall(cudaMemset(state.d_corrCount, 0, sizeof(int)));
+		cutilSafeCall(cudaMemset(state.d_sumResidual, 0, sizeof(float)));
+		cutilSafeCall(cudaMemset(state.d_corrCountColor, 0, sizeof(int)));
+		cutilSafeCall(cudaMemset(state.d_sumResidualColor, 0, sizeof(float)));
+	}
 
-	const unsigned int maxDenseImPairs = input.numberOfImages * (input.numberOfImages - 1) / 2;
-	cutilSafeCall(cudaMemset(state.d_denseCorrCounts, 0, sizeof(float) * maxDenseImPairs));
-	cutilSafeCall(cudaMemset(state.d_denseJtJ, 0, sizeof(float) * sizeJtJ));
+	cutilSafeCall(cudaMemset(state.d_denseJtJDiag, 0, sizeof(float) * sizeJtJDiag));
 	cutilSafeCall(cudaMemset(state.d_denseJtr, 0, sizeof(float) * sizeJtr));
 	cutilSafeCall(cudaMemset(state.d_numDenseOverlappingImages, 0, sizeof(int)));
 #ifdef _DEBUG
@@ -328,25 +367,54 @@ bool BuildDenseSystem(const SolverInput& input, SolverState& state, SolverParame
 	cutilCheckMsg(__FUNCTION__);
 #endif
 
-	dim3 gridImImOverlap;
-	if (parameters.useDenseDepthAllPairwise) gridImImOverlap = dim3(N, N, 1); // pairwise
-	else gridImImOverlap = dim3(N - 1, 1, 1); // for frame-to-frame
-
 	if (timer) timer->startEvent("BuildDenseDepthSystem - find image corr");
-	if (parameters.useDenseDepthAllPairwise) FindImageImageCorr_Kernel<true> << < gridImImOverlap, THREADS_PER_BLOCK_DENSE_OVERLAP >> >(input, state, parameters);
-	else									 FindImageImageCorr_Kernel<false> << < gridImImOverlap, THREADS_PER_BLOCK_DENSE_OVERLAP >> >(input, state, parameters);
+	if (parameters.useDenseDepthAllPairwise) {
+		// pairwise: only the pairs with intersecting bounds and similar viewing directions are checked, not all N(N-1)/2
+		ComputeImageBounds_Kernel << < N, THREADS_PER_BLOCK_DENSE_OVERLAP >> >(input, state, parameters);
 #ifdef _DEBUG
-	cutilSafeCall(cudaDeviceSynchronize());
-	cutilCheckMsg(__FUNCTION__);
+		cutilSafeCall(cudaDeviceSynchronize());
+		cutilCheckMsg(__FUNCTION__);
+#endif
+		std::vector<float3> imageBounds(3 * N);
+		std::vector<int> validImages(N);
+		cutilSafeCall(cudaMemcpy(imageBounds.data(), state.d_denseImageBounds, sizeof(float3) * 3 * N, cudaMemcpyDeviceToHost));
+		cutilSafeCall(cudaMemcpy(validImages.data(), input.d_validImages, sizeof(int) * N, cudaMemcpyDeviceToHost));
+		std::vector<uint2> candidatePairs;
+		SolverBundlingOverlapIndex::findCandidatePairs(imageBounds, validImages, N, parameters.denseDistThresh, cosf(DENSE_OVERLAP_MAX_ANGLE), candidatePairs);
+
+		const unsigned int maxNumCandidates = std::min(input.maxNumDenseImPairs, 65535u); //max grid size
+		for (size_t offset = 0; offset < candidatePairs.size(); offset += maxNumCandidates) {
+			const unsigned int numCandidates = (unsigned int)std::min(candidatePairs.size() - offset, (size_t)maxNumCandidates);
+			cutilSafeCall(cudaMemcpy(state.d_denseCandidatePairs, candidatePairs.data() + offset, sizeof(uint2) * numCandidates, cudaMemcpyHostToDevice));
+			FindImageImageCorr_Kernel<true> << < numCandidates, THREADS_PER_BLOCK_DENSE_OVERLAP >> >(input, state, parameters, state.d_denseCandidatePairs);
+#ifdef _DEBUG
+			cutilSafeCall(cudaDeviceSynchronize());
+			cutilCheckMsg(__FUNCTION__);
+#endif
+		}
+	}
+	else {
+		FindImageImageCorr_Kernel<false> << < N - 1, THREADS_PER_BLOCK_DENSE_OVERLAP >> >(input, state, parameters, NULL); // for frame-to-frame
+#ifdef _DEBUG
+		cutilSafeCall(cudaDeviceSynchronize());
+		cutilCheckMsg(__FUNCTION__);
 #endif
+	}
 	if (timer) timer->endEvent();
 
 	int numOverlapImagePairs;
 	cutilSafeCall(cudaMemcpy(&numOverlapImagePairs, state.d_numDenseOverlappingImages, sizeof(int), cudaMemcpyDeviceToHost));
+	if (numOverlapImagePairs > (int)input.maxNumDenseImPairs) {
+		printf("warning: %d overlapping images for dense solve, only using the first %d (s_maxNumDenseImPairs)\n", numOverlapImagePairs, input.maxNumDenseImPairs);
+		numOverlapImagePairs = input.maxNumDenseImPairs;
+		cutilSafeCall(cudaMemcpy(state.d_numDenseOverlappingImages, &numOverlapImagePairs, sizeof(int), cudaMemcpyHostToDevice));
+	}
 	if (numOverlapImagePairs == 0) {
 		printf("warning: no overlapping images for dense solve\n");
 		return false;
 	}
+	cutilSafeCall(cudaMemset(state.d_denseCorrCounts, 0, sizeof(float) * numOverlapImagePairs));
+	cutilSafeCall(cudaMemset(state.d_denseJtJOffDiag, 0, sizeof(float) * DENSE_JTJ_BLOCK_SIZE * numOverlapImagePairs));
 	const int reductionGlobal = (input.denseDepthWidth*input.denseDepthHeight + THREADS_PER_BLOCK_DENSE_DEPTH - 1) / THREADS_PER_BLOCK_DENSE_DEPTH;
 	dim3 grid(numOverlapImagePairs, reductionGlobal);
 	//if (N > 11) printf("num overlap image pairs = %d\n", numOverlapImagePairs); //debugging only
@@ -395,15 +463,26 @@ bool BuildDenseSystem(const SolverInput& input, SolverState& state, SolverParame
 	//}
 
 	int wgrid = (numOverlapImagePairs + THREADS_PER_BLOCK_DENSE_DEPTH_FLIP - 1) / THREADS_PER_BLOCK_DENSE_DEPTH_FLIP;
-	WeightDenseCorrespondences_Kernel << < wgrid, THREADS_PER_BLOCK_DENSE_DEPTH_FLIP >> >(maxDenseImPairs, state);
+	WeightDenseCorrespondences_Kernel << < wgrid, THREADS_PER_BLOCK_DENSE_DEPTH_FLIP >> >(numOverlapImagePairs, state);
 #ifdef _DEBUG
 	cutilSafeCall(cudaDeviceSynchronize());
 	cutilCheckMsg(__FUNCTION__);
 #endif
+	{
+		// rows of the JtJ blocks; pairs with weight 0 add nothing
+		std::vector<uint2> imageIndices(numOverlapImagePairs);
+		std::vector<float> imPairWeights(numOverlapImagePairs);
+		cutilSafeCall(cudaMemcpy(imageIndices.data(), state.d_denseOverlappingImages, sizeof(uint2)*numOverlapImagePairs, cudaMemcpyDeviceToHost));
+		cutilSafeCall(cudaMemcpy(imPairWeights.data(), state.d_denseCorrCounts, sizeof(float)*numOverlapImagePairs, cudaMemcpyDeviceToHost));
+		std::vector<int> rowOffsets, rowPairs;
+		SolverBundlingDenseBlocks::buildRows(N, imageIndices.data(), imPairWeights.data(), numOverlapImagePairs, rowOffsets, rowPairs);
+		cutilSafeCall(cudaMemcpy(state.d_denseJtJRowOffsets, rowOffsets.data(), sizeof(int)*rowOffsets.size(), cudaMemcpyHostToDevice));
+		if (!rowPairs.empty()) cutilSafeCall(cudaMemcpy(state.d_denseJtJRowPairs, rowPairs.data(), sizeof(int)*rowPairs.size(), cudaMemcpyHostToDevice));
+	}
 	////debugging
-	//cutilSafeCall(cudaMemcpy(denseCorrCounts, state.d_denseCorrCounts, sizeof(float)*maxDenseImPairs, cudaMemcpyDeviceToHost));
+	//cutilSafeCall(cudaMemcpy(denseCorrCounts, state.d_denseCorrCounts, sizeof(float)*numOverlapImagePairs, cudaMemcpyDeviceToHost));
 	//totalCount = 0;
-	//for (unsigned int i = 0; i < maxDenseImPairs; i++) { if (denseCorrCounts[i] > 0.0f) totalCount++; }
+	//for (unsigned int i = 0; i < numOverlapImagePairs; i++) { if (denseCorrCounts[i] > 0.0f) totalCount++; }
 	//printf("total count = %d\n", totalCount);
 	//if (denseCorrCounts) delete[] denseCorrCounts;
 	////debugging
@@ -427,16 +506,14 @@ bool BuildDenseSystem(const SolverInput& input, SolverState& state, SolverParame
 	//float* h_JtJ = NULL;
 	//float* h_Jtr = NULL;
 	//if (debugPrint) {
-	//	h_JtJ = new float[sizeJtJ];
+	//	h_JtJ = new float[sizeJtJDiag];
 	//	h_Jtr = new float[sizeJtr];
-	//	cutilSafeCall(cudaMemcpy(h_JtJ, state.d_denseJtJ, sizeof(float) * sizeJtJ, cudaMemcpyDeviceToHost));
+	//	cutilSafeCall(cudaMemcpy(h_JtJ, state.d_denseJtJDiag, sizeof(float) * sizeJtJDiag, cudaMemcpyDeviceToHost));
 	//	cutilSafeCall(cudaMemcpy(h_Jtr, state.d_denseJtr, sizeof(float) * sizeJtr, cudaMemcpyDeviceToHost));
-	//	printf("JtJ:\n");
-	//	//for (unsigned int i = 0; i < 6 * N; i++) {
-	//	//	for (unsigned int j = 0; j < 6 * N; j++)
-	//	for (unsigned int i = 6 * 1; i < 6 * 2; i++) {
-	//		for (unsigned int j = 6 * 1; j < 6 * 2; j++)
-	//			printf(" %f,", h_JtJ[j * 6 * N + i]);
+	//	printf("JtJ (diagonal block 1):\n");
+	//	for (unsigned int i = 0; i < 6; i++) {
+	//		for (unsigned int j = 0; j < 6; j++)
+	//			printf(" %f,", h_JtJ[DENSE_JTJ_BLOCK_SIZE * 1 + j * 6 + i]);
 	//		printf("\n");
 	//	}
 	//	printf("Jtr:\n");
@@ -460,8 +537,8 @@ bool BuildDenseSystem(const SolverInput& input, SolverState& state, SolverParame
 		printf("\tdense color: weights * residual = %f * %f = %f\t[#corr = %d]\n", parameters.weightDenseColor, sumResidual / parameters.weightDenseColor, sumResidual, corrCount);
 	}
 #endif
-	const unsigned int flipgrid = (sizeJtJ + THREADS_PER_BLOCK_DENSE_DEPTH_FLIP - 1) / THREADS_PER_BLOCK_DENSE_DEPTH_FLIP;
-	FlipJtJ_Kernel << <flipgrid, THREADS_PER_BLOCK_DENSE_DEPTH_FLIP >> >(sizeJtJ, sizeJtr, state.d_denseJtJ);
+	const unsigned int flipgrid = (sizeJtJDiag + THREADS_PER_BLOCK_DENSE_DEPTH_FLIP - 1) / THREADS_PER_BLOCK_DENSE_DEPTH_FLIP;
+	FlipJtJ_Kernel << <flipgrid, THREADS_PER_BLOCK_DENSE_DEPTH_FLIP >> >(sizeJtJDiag, state.d_denseJtJDiag);
 #ifdef _DEBUG
 	cutilSafeCall(cudaDeviceSynchronize());
 	cutilCheckMsg(__FUNCTION__);
@@ -470,6 +547,15 @@ bool BuildDenseSystem(const SolverInput& input, SolverState& state, SolverParame
 	return true;
 }
 
+//! weighted dense energy at the linearization point of the last BuildDenseSystem (needs sumDenseResiduals)
+float EvalDenseResidual(const SolverState& state, const SolverParameters& parameters)
+{
+	float sumResidual = 0.0f, sumResidualColor = 0.0f;
+	if (parameters.weightDenseDepth > 0.0f) cutilSafeCall(cudaMemcpy(&sumResidual, state.d_sumResidual, sizeof(float), cudaMemcpyDeviceToHost));
+	if (parameters.weightDenseColor > 0.0f) cutilSafeCall(cudaMemcpy(&sumResidualColor, state.d_sumResidualColor, sizeof(float), cudaMemcpyDeviceToHost));
+	return sumResidual + sumResidualColor;
+}
+
 //todo more efficient?? (there are multiple per image-image...)
 //get high residuals
 __global__ void collectHighResidualsDevice(SolverInput input, SolverState state, SolverStateAnalysis analysis, SolverParameters parameters, unsigned int maxNumHighResiduals)
@@ -752,13 +838,13 @@ float EvalGNConvergence(SolverInput& input, SolverState& state, SolverStateAnaly
 // http://en.wikipedia.org/wiki/Conjugate_gradient_method
 // This code is an implementation of their PCG pseudo code
 
-template<bool useDense>
+template<bool useDense, bool blockPreconditioner>
 __global__ void PCGInit_Kernel1(SolverInput input, SolverState state, SolverParameters parameters)
 {
 	const unsigned int N = input.numberOfImages;
 	const int x = blockIdx.x * blockDim.x + threadIdx.x;
 
-	float d = 0.0f;
+	float d = 0.0f, rr = 0.0f;
 	if (x > 0 && x < N)
 	{
 		float3 resRot, resTrans;
@@ -767,22 +853,34 @@ __global__ void PCGInit_Kernel1(SolverInput input, SolverState state, SolverPara
 		state.d_rRot[x] = resRot;											// store for next iteration
 		state.d_rTrans[x] = resTrans;										// store for next iteration
 
-		const float3 pRot = state.d_precondionerRot[x] * resRot;			// apply preconditioner M^-1
+		float3 pRot, pTrans;
+#ifdef USE_LIE_SPACE
+		if (blockPreconditioner) {
+			evalPreconditionerBlockDevice<useDense>(x, input, state, parameters);
+			applyPreconditionerBlock(state.d_precondionerBlocks + x * DENSE_JTJ_BLOCK_SIZE, resTrans, resRot, pTrans, pRot);	// apply preconditioner M^-1
+		}
+		else
+#endif
+		{
+			pRot = state.d_precondionerRot[x] * resRot;						// apply preconditioner M^-1
+			pTrans = state.d_precondionerTrans[x] * resTrans;				// apply preconditioner M^-1
+		}
 		state.d_pRot[x] = pRot;
-
-		const float3 pTrans = state.d_precondionerTrans[x] * resTrans;		// apply preconditioner M^-1
 		state.d_pTrans[x] = pTrans;
 
 		d = dot(resRot, pRot) + dot(resTrans, pTrans);						// x-th term of nomimator for computing alpha and denominator for computing beta
+		rr = dot(resRot, resRot) + dot(resTrans, resTrans);					// x-th term of |r_0|^2 for the linear tolerance
 
 		state.d_Ap_XRot[x] = make_float3(0.0f, 0.0f, 0.0f);
 		state.d_Ap_XTrans[x] = make_float3(0.0f, 0.0f, 0.0f);
 	}
 
 	d = warpReduce(d);
+	rr = warpReduce(rr);
 	if (threadIdx.x % WARP_SIZE == 0)
 	{
 		atomicAdd(state.d_scanAlpha, d);
+		atomicAdd(&state.d_scanAlpha[2], rr);
 	}
 }
 
@@ -793,7 +891,8 @@ __global__ void PCGInit_Kernel2(unsigned int N, SolverState state)
 	if (x > 0 && x < N) state.d_rDotzOld[x] = state.d_scanAlpha[0];				// store result for next kernel call
 }
 
-void Initialization(SolverInput& input, SolverState& state, SolverParameters& parameters, CUDATimer* timer)
+//! returns |r_0|^2
+float Initialization(SolverInput& input, SolverState& state, SolverParameters& parameters, CUDATimer* timer)
 {
 	const unsigned int N = input.numberOfImages;
 
@@ -812,14 +911,20 @@ void Initialization(SolverInput& input, SolverState& state, SolverParameters& pa
 	//float3* rTrans = new float3[input.numberOfImages];
 	//!!!DEBUGGING
 
-	cutilSafeCall(cudaMemset(state.d_scanAlpha, 0, sizeof(float)));
+	cutilSafeCall(cudaMemset(state.d_scanAlpha, 0, sizeof(float) * 3));
 #ifdef _DEBUG
 	cutilSafeCall(cudaDeviceSynchronize());
 	cutilCheckMsg(__FUNCTION__);
 #endif		
 
-	if (parameters.useDense) PCGInit_Kernel1<true> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state, parameters);
-	else PCGInit_Kernel1<false> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state, parameters);
+	if (parameters.preconditioner == PRECONDITIONER_BLOCK_JACOBI) {
+		if (parameters.useDense) PCGInit_Kernel1<true, true> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state, parameters);
+		else PCGInit_Kernel1<false, true> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state, parameters);
+	}
+	else {
+		if (parameters.useDense) PCGInit_Kernel1<true, false> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state, parameters);
+		else PCGInit_Kernel1<false, false> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state, parameters);
+	}
 #ifdef _DEBUG
 	cutilSafeCall(cudaDeviceSynchronize());
 	cutilCheckMsg(__FUNCTION__);
@@ -840,12 +945,16 @@ void Initialization(SolverInput& input, SolverState& state, SolverParameters& pa
 	cutilCheckMsg(__FUNCTION__);
 #endif
 
+	float rDotr = 0.0f;
+	if (parameters.linearTolerance > 0.0f) cutilSafeCall(cudaMemcpy(&rDotr, &state.d_scanAlpha[2], sizeof(float), cudaMemcpyDeviceToHost));
+
 	if (timer) timer->endEvent();
 
 	//float scanAlpha;
 	//cutilSafeCall(cudaMemcpy(&scanAlpha, state.d_scanAlpha, sizeof(float), cudaMemcpyDeviceToHost));
 	//if (rRot) delete[] rRot;
 	//if (rTrans) delete[] rTrans;
+	return rDotr;
 }
 
 /////////////////////////////////////////////////////////////////////////
@@ -861,7 +970,7 @@ __global__ void PCGStep_Kernel_Dense_Brute(SolverInput input, SolverState state,
 	if (x > 0 && x < N)
 	{
 		float3 rot, trans;
-		applyJTJDenseBruteDevice(x, state, state.d_denseJtJ, input.numberOfImages, rot, trans); // A x p_k  => J^T x J x p_k 
+		applyJTJDenseBruteDevice(x, state, rot, trans); // A x p_k  => J^T x J x p_k 
 
 		state.d_Ap_XRot[x] += rot;
 		state.d_Ap_XTrans[x] += trans;
@@ -876,7 +985,7 @@ __global__ void PCGStep_Kernel_Dense(SolverInput input, SolverState state, Solve
 	if (x > 0 && x < N)
 	{
 		float3 rot, trans;
-		applyJTJDenseDevice(x, state, state.d_denseJtJ, input.numberOfImages, rot, trans, threadIdx.x);			// A x p_k  => J^T x J x p_k 
+		applyJTJDenseDevice(x, state, rot, trans, threadIdx.x);			// A x p_k  => J^T x J x p_k 
 
 		if (lane == 0)
 		{
@@ -945,6 +1054,7 @@ __global__ void PCGStep_Kernel1b(SolverInput input, SolverState state, SolverPar
 	}
 }
 
+template<bool blockPreconditioner>
 __global__ void PCGStep_Kernel2(SolverInput input, SolverState state)
 {
 	const unsigned int N = input.numberOfImages;
@@ -952,7 +1062,7 @@ __global__ void PCGStep_Kernel2(SolverInput input, SolverState state)
 
 	const float dotProduct = state.d_scanAlpha[0];
 
-	float b = 0.0f;
+	float b = 0.0f, rr = 0.0f;
 	if (x > 0 && x < N)
 	{
 		float alpha = 0.0f;
@@ -967,18 +1077,29 @@ __global__ void PCGStep_Kernel2(SolverInput input, SolverState state)
 		float3 rTrans = state.d_rTrans[x] - alpha*state.d_Ap_XTrans[x];				// update residuum
 		state.d_rTrans[x] = rTrans;													// store for next kernel call
 
-		float3 zRot = state.d_precondionerRot[x] * rRot;							// apply preconditioner M^-1
+		float3 zRot, zTrans;
+#ifdef USE_LIE_SPACE
+		if (blockPreconditioner) {
+			applyPreconditionerBlock(state.d_precondionerBlocks + x * DENSE_JTJ_BLOCK_SIZE, rTrans, rRot, zTrans, zRot);	// apply preconditioner M^-1
+		}
+		else
+#endif
+		{
+			zRot = state.d_precondionerRot[x] * rRot;								// apply preconditioner M^-1
+			zTrans = state.d_precondionerTrans[x] * rTrans;							// apply preconditioner M^-1
+		}
 		state.d_zRot[x] = zRot;														// save for next kernel call
-
-		float3 zTrans = state.d_precondionerTrans[x] * rTrans;						// apply preconditioner M^-1
 		state.d_zTrans[x] = zTrans;													// save for next kernel call
 
 		b = dot(zRot, rRot) + dot(zTrans, rTrans);									// compute x-th term of the nominator of beta
+		rr = dot(rRot, rRot) + dot(rTrans, rTrans);									// x-th term of |r|^2 for the linear tolerance
 	}
 	b = warpReduce(b);
+	rr = warpReduce(rr);
 	if (threadIdx.x % WARP_SIZE == 0)
 	{
 		atomicAdd(&state.d_scanAlpha[1], b);
+		atomicAdd(&state.d_scanAlpha[2], rr);
 	}
 }
 
@@ -1021,8 +1142,11 @@ __global__ void PCGStep_Kernel3(SolverInput input, SolverState state)
 	}
 }
 
+//! rDotrTarget: stops once |r|^2 falls below (< 0: no linear tolerance)
+//! linConvergenceAnalysis: if not NULL, r^T z of the iteration is appended
 template<bool useSparse, bool useDense>
-bool PCGIteration(SolverInput& input, SolverState& state, SolverParameters& parameters, SolverStateAnalysis& analysis, bool lastIteration, CUDATimer *timer)
+bool PCGIteration(SolverInput& input, SolverState& state, SolverParameters& parameters, SolverStateAnalysis& analysis, bool lastIteration, float rDotrTarget,
+	std::vector<float>* linConvergenceAnalysis, CUDATimer *timer)
 {
 	const unsigned int N = input.numberOfImages;	// Number of block variables
 
@@ -1036,7 +1160,7 @@ bool PCGIteration(SolverInput& input, SolverState& state, SolverParameters& para
 	}
 	if (timer) timer->startEvent("PCGIteration");
 
-	cutilSafeCall(cudaMemset(state.d_scanAlpha, 0, sizeof(float) * 2));
+	cutilSafeCall(cudaMemset(state.d_scanAlpha, 0, sizeof(float) * 3));
 
 	// sparse part
 	if (useSparse) {
@@ -1080,16 +1204,23 @@ bool PCGIteration(SolverInput& input, SolverState& state, SolverParameters& para
 	cutilCheckMsg(__FUNCTION__);
 #endif
 
-	PCGStep_Kernel2 << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state);
+	if (parameters.preconditioner == PRECONDITIONER_BLOCK_JACOBI) PCGStep_Kernel2<true> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state);
+	else PCGStep_Kernel2<false> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state);
 #ifdef _DEBUG
 	cutilSafeCall(cudaDeviceSynchronize());
 	cutilCheckMsg(__FUNCTION__);
 #endif
+	float scanAlpha[3];
+	if (linConvergenceAnalysis) {
+		cutilSafeCall(cudaMemcpy(scanAlpha, state.d_scanAlpha, sizeof(float) * 3, cudaMemcpyDeviceToHost));
+		linConvergenceAnalysis->push_back(scanAlpha[1]); // r^T z
+	}
 #ifdef ENABLE_EARLY_OUT //for convergence
-	float scanAlpha; cutilSafeCall(cudaMemcpy(&scanAlpha, state.d_scanAlpha, sizeof(float), cudaMemcpyDeviceToHost));
-	//if (fabs(scanAlpha) < 0.00005f) lastIteration = true;  //todo check this part
-	//if (fabs(scanAlpha) < 1e-6) lastIteration = true;  //todo check this part
-	if (fabs(scanAlpha) < 5e-7) { lastIteration = true; }  //todo check this part
+	if (!linConvergenceAnalysis) cutilSafeCall(cudaMemcpy(scanAlpha, state.d_scanAlpha, sizeof(float) * 3, cudaMemcpyDeviceToHost));
+	//if (fabs(scanAlpha[0]) < 0.00005f) lastIteration = true;  //todo check this part
+	//if (fabs(scanAlpha[0]) < 1e-6) lastIteration = true;  //todo check this part
+	if (fabs(scanAlpha[0]) < PCG_EARLY_OUT_THRESH) { lastIteration = true; }  //todo check this part
+	if (scanAlpha[2] <= rDotrTarget) { lastIteration = true; }	// |r| <= linearTolerance * |r_0|
 #endif
 	if (lastIteration) {
 		PCGStep_Kernel3<true> << <blocksPerGrid, THREADS_PER_BLOCK >> >(input, state);
@@ -1134,12 +1265,17 @@ void convertLiePosesToMatricesCU(const float3* d_rot, const float3* d_trans, uns
 // Main GN Solver Loop
 ////////////////////////////////////////////////////////////////////
 
-extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, SolverParameters& parameters, SolverStateAnalysis& analysis, float* convergenceAnalysis, CUDATimer *timer)
+//! convergenceAnalysis: if not NULL, receives the sparse energy before and after each non-linear iteration that ran
+//! linConvergenceAnalysis: if not NULL, receives r^T z of each linear iteration, concatenated over the non-linear iterations
+extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, SolverParameters& parameters, SolverStateAnalysis& analysis,
+	std::vector<float>* convergenceAnalysis, std::vector<float>* linConvergenceAnalysis, CUDATimer *timer)
 {
-	if (convergenceAnalysis) {
-		float initialResidual = EvalResidual(input, state, parameters, timer);
-		convergenceAnalysis[0] = initialResidual; // initial residual
-	}
+	// the energy (sparse + dense) at the linearization point of each non-linear iteration decides the early out on energyTolerance;
+	// energies are only compared between iterations with the same weights
+	const bool useEnergyTolerance = parameters.energyTolerance > 0.0f;
+	float lastEnergy = -1.0f;
+	float3 lastWeights = make_float3(-1.0f);	// sparse, dense depth, dense color of lastEnergy
+	if (convergenceAnalysis) convergenceAnalysis->push_back(EvalResidual(input, state, parameters, timer)); // initial residual
 
 	//!!!DEBUGGING
 #ifdef PRINT_RESIDUALS_SPARSE
@@ -1165,16 +1301,30 @@ extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, Solver
 		convertLiePosesToMatricesCU(state.d_xRot, state.d_xTrans, input.numberOfImages, state.d_xTransforms, state.d_xTransformInverses);
 #endif
 		if (parameters.useDense) parameters.useDense = BuildDenseSystem(input, state, parameters, timer); //don't solve dense if no overlapping frames found
-		Initialization(input, state, parameters, timer);
+#ifdef ENABLE_EARLY_OUT //convergence
+		if (useEnergyTolerance) { // relative change of the energy in the last iteration
+			const float3 weights = make_float3(parameters.weightSparse, parameters.useDense ? parameters.weightDenseDepth : 0.0f, parameters.useDense ? parameters.weightDenseColor : 0.0f);
+			float energy = 0.0f;
+			if (parameters.useDense) energy += EvalDenseResidual(state, parameters); // before EvalResidual, which reuses d_sumResidual
+			if (parameters.weightSparse > 0.0f) energy += EvalResidual(input, state, parameters, timer);
+			const bool sameWeights = weights.x == lastWeights.x && weights.y == lastWeights.y && weights.z == lastWeights.z;
+			if (sameWeights && lastEnergy >= 0.0f && fabs(lastEnergy - energy) <= parameters.energyTolerance * lastEnergy) break;
+			lastEnergy = energy;
+			lastWeights = weights;
+		}
+#endif
+		const float rDotrInit = Initialization(input, state, parameters, timer);
+		const float rDotrTarget = (parameters.linearTolerance > 0.0f) ? parameters.linearTolerance * parameters.linearTolerance * rDotrInit : -1.0f;
 
+		// nLinIterations is the upper bound, the PCG stops early on the linear tolerance / ENABLE_EARLY_OUT
 		if (parameters.weightSparse > 0.0f) {
 			if (parameters.useDense) {
 				for (unsigned int linIter = 0; linIter < parameters.nLinIterations; linIter++)
-					if (PCGIteration<true, true>(input, state, parameters, analysis, linIter == parameters.nLinIterations - 1, timer)) { break; }
+					if (PCGIteration<true, true>(input, state, parameters, analysis, linIter == parameters.nLinIterations - 1, rDotrTarget, linConvergenceAnalysis, timer)) { break; }
 			}
 			else {
 				for (unsigned int linIter = 0; linIter < parameters.nLinIterations; linIter++)
-					if (PCGIteration<true, false>(input, state, parameters, analysis, linIter == parameters.nLinIterations - 1, timer)) {
+					if (PCGIteration<true, false>(input, state, parameters, analysis, linIter == parameters.nLinIterations - 1, rDotrTarget, linConvergenceAnalysis, timer)) {
 						//totalLinIters += (linIter+1); numLin++; 
 						break;
 					}
@@ -1182,7 +1332,7 @@ extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, Solver
 		}
 		else {
 			for (unsigned int linIter = 0; linIter < parameters.nLinIterations; linIter++)
-				if (PCGIteration<false, true>(input, state, parameters, analysis, linIter == parameters.nLinIterations - 1, timer)) break;
+				if (PCGIteration<false, true>(input, state, parameters, analysis, linIter == parameters.nLinIterations - 1, rDotrTarget, linConvergenceAnalysis, timer)) break;
 		}
 		//!!!debugging
 		//cutilSafeCall(cudaMemcpy(xRot, state.d_xRot, sizeof(float3)*input.numberOfImages, cudaMemcpyDeviceToHost));
@@ -1194,16 +1344,13 @@ extern "C" void solveBundlingStub(SolverInput& input, SolverState& state, Solver
 			printf("[niter %d] weight * sparse = %f*%f = %f\t[#corr = %d]\n", nIter, parameters.weightSparse, residual / parameters.weightSparse, residual, input.numberOfCorrespondences);
 		}
 #endif
-		if (convergenceAnalysis) {
-			float residual = EvalResidual(input, state, parameters, timer);
-			convergenceAnalysis[nIter + 1] = residual;
-		}
+		if (convergenceAnalysis) convergenceAnalysis->push_back(EvalResidual(input, state, parameters, timer));
 
 		//if (timer) timer->evaluate(true);
 
 #ifdef ENABLE_EARLY_OUT //convergence
 		//if (nIter < parameters.nNonLinearIterations - 1 && EvalGNConvergence(input, state, analysis, timer) < 0.01f) { //!!! TODO CHECK HOW THESE GENERALIZE
-		if (nIter < parameters.nNonLinearIterations - 1 && EvalGNConvergence(input, state, analysis, timer) < 0.005f) { //0.001?
+		if (nIter < parameters.nNonLinearIterations - 1 && EvalGNConvergence(input, state, analysis, timer) < GN_CONVERGENCE_THRESH) { //0.001?
 		//if (nIter < parameters.nNonLinearIterations - 1 && EvalGNConvergence(input, state, analysis, timer) < 0.001f) { 
 			//if (!parameters.useDense) { totalNonLinIters += (nIter+1); numNonLin++; }
 			break;
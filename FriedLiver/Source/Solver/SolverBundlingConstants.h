@@ -0,0 +1,18 @@
+#pragma once
+
+#ifndef _SOLVER_CONSTANTS_
+#define _SOLVER_CONSTANTS_
+
+////////////////////////////////////////
+// fixed thresholds of SolverBundling.cu, shared with CPUSolverBundling
+////////////////////////////////////////
+
+#define DENSE_OVERLAP_MAX_ANGLE 0.52f			// ~30 degrees; image pairs with a larger relative rotation get no dense terms
+#define DENSE_OVERLAP_NUM_SAMPLES 512			// pixels tested per image pair in the overlap check (one block of FindImageImageCorr_Kernel)
+#define DENSE_OVERLAP_MIN_CORR 10				// overlap check: more sampled correspondences than this make the pair dense
+#define DENSE_PAIR_MIN_CORR 800					// dense pairs with fewer correspondences are dropped (WeightDenseCorrespondences_Kernel)
+
+#define GN_CONVERGENCE_THRESH 0.005f			// gauss-newton stops once the largest pose update is below this
+#define PCG_EARLY_OUT_THRESH 5e-7f				// pcg stops once |p^T A p| is below this (ENABLE_EARLY_OUT)
+
+#endif //_SOLVER_CONSTANTS_
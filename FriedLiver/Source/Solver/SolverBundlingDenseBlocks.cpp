@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "SolverBundlingDenseBlocks.h"
+#include "SolverBundlingState.h"
+#include "../ThreadPool.h"
+
+void SolverBundlingDenseBlocks::buildRows(unsigned int numImages, const uint2* pairs, const float* pairWeights, unsigned int numPairs,
+	std::vector<int>& rowOffsets, std::vector<int>& rowPairs)
+{
+	rowOffsets.assign(numImages + 1, 0);
+	for (unsigned int p = 0; p < numPairs; p++) {
+		if (pairWeights[p] == 0.0f) continue;
+		rowOffsets[pairs[p].x + 1]++;
+		rowOffsets[pairs[p].y + 1]++;
+	}
+	for (unsigned int i = 0; i < numImages; i++) rowOffsets[i + 1] += rowOffsets[i];
+
+	rowPairs.resize(rowOffsets[numImages]);
+	std::vector<int> fill(rowOffsets.begin(), rowOffsets.end() - 1);
+	for (unsigned int p = 0; p < numPairs; p++) {
+		if (pairWeights[p] == 0.0f) continue;
+		rowPairs[fill[pairs[p].x]++] = (int)p;
+		rowPairs[fill[pairs[p].y]++] = (int)p;
+	}
+}
+
+void SolverBundlingDenseBlocks::init(unsigned int numImages, const std::vector<uint2>& pairs, const std::vector<float>& pairWeights)
+{
+	MLIB_ASSERT(pairs.size() == pairWeights.size());
+	m_numImages = numImages;
+	m_pairs = pairs;
+	m_diag.assign(DENSE_JTJ_BLOCK_SIZE * numImages, 0.0f);
+	m_offDiag.assign(DENSE_JTJ_BLOCK_SIZE * pairs.size(), 0.0f);
+	buildRows(numImages, m_pairs.data(), pairWeights.data(), (unsigned int)m_pairs.size(), m_rowOffsets, m_rowPairs);
+}
+
+void SolverBundlingDenseBlocks::download(const SolverState& state, unsigned int numImages)
+{
+	int numPairs = 0;
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(&numPairs, state.d_numDenseOverlappingImages, sizeof(int), cudaMemcpyDeviceToHost));
+	m_numImages = numImages;
+	m_pairs.resize(numPairs);
+	m_diag.resize(DENSE_JTJ_BLOCK_SIZE * numImages);
+	m_offDiag.resize(DENSE_JTJ_BLOCK_SIZE * numPairs);
+	m_rowOffsets.resize(numImages + 1);
+	if (numPairs > 0) {
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_pairs.data(), state.d_denseOverlappingImages, sizeof(uint2) * numPairs, cudaMemcpyDeviceToHost));
+		MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_offDiag.data(), state.d_denseJtJOffDiag, sizeof(float) * m_offDiag.size(), cudaMemcpyDeviceToHost));
+	}
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_diag.data(), state.d_denseJtJDiag, sizeof(float) * m_diag.size(), cudaMemcpyDeviceToHost));
+	MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_rowOffsets.data(), state.d_denseJtJRowOffsets, sizeof(int) * m_rowOffsets.size(), cudaMemcpyDeviceToHost));
+	m_rowPairs.resize(m_rowOffsets.back());
+	if (!m_rowPairs.empty()) MLIB_CUDA_SAFE_CALL(cudaMemcpy(m_rowPairs.data(), state.d_denseJtJRowPairs, sizeof(int) * m_rowPairs.size(), cudaMemcpyDeviceToHost));
+}
+
+void SolverBundlingDenseBlocks::symmetrize()
+{
+	for (unsigned int i = 0; i < m_numImages; i++) {
+		float* block = getDiagBlock(i);
+		for (unsigned int r = 0; r < 6; r++) {
+			for (unsigned int c = r + 1; c < 6; c++) block[r * 6 + c] = block[c * 6 + r];
+		}
+	}
+}
+
+void SolverBundlingDenseBlocks::multiply(const std::vector<float3>& pTrans, const std::vector<float3>& pRot, std::vector<float3>& outTrans, std::vector<float3>& outRot) const
+{
+	MLIB_ASSERT(pTrans.size() >= m_numImages && pRot.size() >= m_numImages && outTrans.size() >= m_numImages && outRot.size() >= m_numImages);
+	//rows are independent: each task writes only its own output
+	ThreadPool::get().parallelFor(1, m_numImages, [&](unsigned int i) {
+		float3 trans = make_float3(0.0f, 0.0f, 0.0f);
+		float3 rot = make_float3(0.0f, 0.0f, 0.0f);
+		applyDenseJtJBlock(m_diag.data() + DENSE_JTJ_BLOCK_SIZE * i, false, pTrans[i], pRot[i], trans, rot);
+		for (int k = m_rowOffsets[i]; k < m_rowOffsets[i + 1]; k++) {
+			const int p = m_rowPairs[k];
+			const bool transposed = (m_pairs[p].x == i);
+			const unsigned int other = transposed ? m_pairs[p].y : m_pairs[p].x;
+			if (other > 0) applyDenseJtJBlock(m_offDiag.data() + DENSE_JTJ_BLOCK_SIZE * p, transposed, pTrans[other], pRot[other], trans, rot);
+		}
+		outTrans[i] += trans;
+		outRot[i] += rot;
+	}, 16);
+}
+
+size_t SolverBundlingDenseBlocks::getMemoryUsage() const
+{
+	return sizeof(uint2) * m_pairs.size() + sizeof(float) * (m_diag.size() + m_offDiag.size()) + sizeof(int) * (m_rowOffsets.size() + m_rowPairs.size());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef _SOLVER_DENSE_BLOCKS_
+#define _SOLVER_DENSE_BLOCKS_
+
+#include <cutil_math.h>
+#include <vector>
+
+struct SolverState;
+
+////////////////////////////////////////
+// block sparse JtJ of the dense depth / color term
+////////////////////////////////////////
+
+//! 6x6 blocks, row major, variables (trans xyz, rot xyz) as in d_denseJtr. one diagonal block per image and one off-diagonal block per overlapping
+//! image pair (i, j), i < j, indexed like d_denseOverlappingImages: it holds the rows of j and the columns of i, the block (i, j) is its transpose.
+//! the off-diagonal blocks of each row are listed by pair index in compressed row form (row offsets, pair indices)
+#define DENSE_JTJ_BLOCK_SIZE 36
+
+//! outTrans/outRot += block * p (transposed: block^T * p)
+__inline__ __host__ __device__ void applyDenseJtJBlock(const float* block, bool transposed, const float3& pTrans, const float3& pRot, float3& outTrans, float3& outRot)
+{
+	const float p[6] = { pTrans.x, pTrans.y, pTrans.z, pRot.x, pRot.y, pRot.z };
+	float o[6];
+	for (unsigned int r = 0; r < 6; r++) {
+		o[r] = 0.0f;
+		for (unsigned int c = 0; c < 6; c++) o[r] += (transposed ? block[c * 6 + r] : block[r * 6 + c]) * p[c];
+	}
+	outTrans += make_float3(o[0], o[1], o[2]);
+	outRot += make_float3(o[3], o[4], o[5]);
+}
+
+//! host version of the dense term system, e.g. for a CPU solve or to check the GPU system
+class SolverBundlingDenseBlocks
+{
+public:
+	SolverBundlingDenseBlocks() {
+		m_numImages = 0;
+	}
+
+	//! row structure of the pairs with a non-zero weight (the others add nothing to the system); rowOffsets has numImages + 1 entries
+	static void buildRows(unsigned int numImages, const uint2* pairs, const float* pairWeights, unsigned int numPairs,
+		std::vector<int>& rowOffsets, std::vector<int>& rowPairs);
+
+	//! sets the pairs and zeros all blocks
+	void init(unsigned int numImages, const std::vector<uint2>& pairs, const std::vector<float>& pairWeights);
+	//! host copy of the system of the last BuildDenseSystem
+	void download(const SolverState& state, unsigned int numImages);
+
+	unsigned int getNumImages() const { return m_numImages; }
+	unsigned int getNumPairs() const { return (unsigned int)m_pairs.size(); }
+	const uint2& getPair(unsigned int p) const { return m_pairs[p]; }
+	float* getDiagBlock(unsigned int i) { return m_diag.data() + DENSE_JTJ_BLOCK_SIZE * i; }
+	float* getOffDiagBlock(unsigned int p) { return m_offDiag.data() + DENSE_JTJ_BLOCK_SIZE * p; }
+
+	//! copies the lower triangle of the diagonal blocks to the upper one (only the lower one is accumulated)
+	void symmetrize();
+
+	//! outTrans/outRot[i] += (JtJ p)[i] for the variables i > 0; parallel over the rows (ThreadPool)
+	void multiply(const std::vector<float3>& pTrans, const std::vector<float3>& pRot, std::vector<float3>& outTrans, std::vector<float3>& outRot) const;
+
+	size_t getMemoryUsage() const;
+
+private:
+	unsigned int		m_numImages;
+	std::vector<uint2>	m_pairs;
+	std::vector<float>	m_diag;
+	std::vector<float>	m_offDiag;
+	std::vector<int>	m_rowOffsets;
+	std::vector<int>	m_rowPairs;
+};
+
+#endif
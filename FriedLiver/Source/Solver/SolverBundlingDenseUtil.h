@@ -9,6 +9,7 @@
 #include "../SiftGPU/cuda_SimpleMatrixUtil.h"
 #include "ICPUtil.h" //for the bilinear...
 #include "../CUDACameraUtil.h"
+#include "SolverBundlingDenseBlocks.h"
 
 //#include "SolverBundlingUtil.h"
 //#include "SolverBundlingState.h"
@@ -18,10 +19,13 @@
 // build jtj/jtr
 ////////////////////////////////////////
 
+//the images are device pointers or CUDACachedFrame views (CUDACacheUtil.h)
+
 //for pre-filter, no need for normal threshold
+template<class DepthT>
 __inline__ __device__ bool findDenseCorr(unsigned int idx, unsigned int imageWidth, unsigned int imageHeight,
 	float distThresh, const float4x4& transform, const float4& intrinsics,
-	const float* tgtDepth, const float* srcDepth, float depthMin, float depthMax)
+	const DepthT& tgtDepth, const DepthT& srcDepth, float depthMin, float depthMax)
 {
 	unsigned int x = idx % imageWidth;		unsigned int y = idx / imageWidth;
 	const float3 cposj = depthToCamera(intrinsics.x, intrinsics.y, intrinsics.z, intrinsics.w, make_int2(x, y), srcDepth[idx]);
@@ -41,9 +45,10 @@ __inline__ __device__ bool findDenseCorr(unsigned int idx, unsigned int imageWid
 	return false;
 }
 
+template<class DepthT, class NormalT>
 __inline__ __device__ bool findDenseCorr(unsigned int idx, unsigned int imageWidth, unsigned int imageHeight,
 	float distThresh, float normalThresh, const float4x4& transform, const float4& intrinsics,
-	const float* tgtDepth, const float4* tgtNormals, const float* srcDepth, const float4* srcNormals,
+	const DepthT& tgtDepth, const NormalT& tgtNormals, const DepthT& srcDepth, const NormalT& srcNormals,
 	float depthMin, float depthMax)
 {
 	unsigned int x = idx % imageWidth;		unsigned int y = idx / imageWidth;
@@ -76,9 +81,10 @@ __inline__ __device__ bool findDenseCorr(unsigned int idx, unsigned int imageWid
 
 
 //using camera positions
+template<class CamPosT, class NormalT>
 __device__ bool findDenseCorr(unsigned int idx, unsigned int imageWidth, unsigned int imageHeight,
 	float distThresh, float normalThresh, const float4x4& transform, const float4& intrinsics,
-	const float4* tgtCamPos, const float4* tgtNormals, const float4* srcCamPos, const float4* srcNormals,
+	const CamPosT& tgtCamPos, const NormalT& tgtNormals, const CamPosT& srcCamPos, const NormalT& srcNormals,
 	float depthMin, float depthMax, float3& camPosSrc, float3& camPosSrcToTgt, float2& tgtScreenPosf, float3& camPosTgt, float3& normalTgt)
 {
 	const float4 cposj = srcCamPos[idx];
@@ -226,11 +232,15 @@ __device__ bool findDenseCorr(unsigned int idx, unsigned int imageWidth, unsigne
 // build jtj/jtr
 ////////////////////////////////////////
 
-__inline__ __device__ void addToLocalSystem(bool isValidCorr, float* d_JtJ, float* d_Jtr, unsigned int dim, const matNxM<1, 6>& jacobianBlockRow_i, const matNxM<1, 6>& jacobianBlockRow_j,
+//d_JtJDiag: diagonal blocks, d_JtJBlock_ji: off-diagonal block of the image pair (see SolverBundlingDenseBlocks.h)
+//d_sumResidual / d_numCorr: if not NULL, the weighted squared residual and the correspondence are summed (dense energy)
+__inline__ __device__ void addToLocalSystem(bool isValidCorr, float* d_JtJDiag, float* d_JtJBlock_ji, float* d_Jtr, const matNxM<1, 6>& jacobianBlockRow_i, const matNxM<1, 6>& jacobianBlockRow_j,
 	unsigned int vi, unsigned int vj, float residual, float weight, unsigned int tidx
-	, float* d_sumResidualDEBUG, int* d_numCorrDEBUG)
+	, float* d_sumResidual, int* d_numCorr)
 {
-	//fill in bottom half (vi < vj) -> x < y
+	float* d_JtJ_ii = d_JtJDiag + vi * DENSE_JTJ_BLOCK_SIZE;
+	float* d_JtJ_jj = d_JtJDiag + vj * DENSE_JTJ_BLOCK_SIZE;
+	//fill in bottom half of the diagonal blocks, all of the (vj, vi) block
 	for (unsigned int i = 0; i < 6; i++) {
 		for (unsigned int j = i; j < 6; j++) {
 			float dii = 0.0f;	float djj = 0.0f;	float dij = 0.0f;	float dji = 0.0f;
@@ -261,10 +271,10 @@ __inline__ __device__ void addToLocalSystem(bool isValidCorr, float* d_JtJ, floa
 			}
 			__syncthreads();
 			if (tidx == 0) {
-				atomicAdd(&d_JtJ[(vi * 6 + j)*dim + (vi * 6 + i)], s_partJtJ[0]);
-				atomicAdd(&d_JtJ[(vj * 6 + j)*dim + (vj * 6 + i)], s_partJtJ[1]);
-				atomicAdd(&d_JtJ[(vj * 6 + j)*dim + (vi * 6 + i)], s_partJtJ[2]);
-				atomicAdd(&d_JtJ[(vj * 6 + i)*dim + (vi * 6 + j)], s_partJtJ[3]);
+				atomicAdd(&d_JtJ_ii[j * 6 + i], s_partJtJ[0]);
+				atomicAdd(&d_JtJ_jj[j * 6 + i], s_partJtJ[1]);
+				atomicAdd(&d_JtJBlock_ji[j * 6 + i], s_partJtJ[2]);
+				atomicAdd(&d_JtJBlock_ji[i * 6 + j], s_partJtJ[3]);
 			}
 		}
 		float jtri = 0.0f;	float jtrj = 0.0f;
@@ -286,37 +296,37 @@ __inline__ __device__ void addToLocalSystem(bool isValidCorr, float* d_JtJ, floa
 			atomicAdd(&d_Jtr[vj * 6 + i], s_partJtr[1]);
 		}
 	}
-#ifdef PRINT_RESIDUALS_DENSE
-	float res = 0.0f;		int num = 0;
-	if (isValidCorr) { res = weight * residual * residual;     num = 1; }
-	res = warpReduce(res);						num = warpReduce(num);
-	if (tidx % WARP_SIZE == 0) {
-		atomicAdd(d_sumResidualDEBUG, res);
-		atomicAdd(d_numCorrDEBUG, num);
+	if (d_sumResidual) {
+		float res = 0.0f;		int num = 0;
+		if (isValidCorr) { res = weight * residual * residual;     num = 1; }
+		res = warpReduce(res);						num = warpReduce(num);
+		if (tidx % WARP_SIZE == 0) {
+			atomicAdd(d_sumResidual, res);
+			atomicAdd(d_numCorr, num);
+		}
 	}
-#endif
 }
-__inline__ __device__ void addToLocalSystemBrute(bool foundCorr, float* d_JtJ, float* d_Jtr, unsigned int dim, const matNxM<1, 6>& jacobianBlockRow_i, const matNxM<1, 6>& jacobianBlockRow_j,
+__inline__ __device__ void addToLocalSystemBrute(bool foundCorr, float* d_JtJDiag, float* d_JtJBlock_ji, float* d_Jtr, const matNxM<1, 6>& jacobianBlockRow_i, const matNxM<1, 6>& jacobianBlockRow_j,
 	unsigned int vi, unsigned int vj, float residual, float weight, unsigned int threadIdx)
 {
 	if (foundCorr) {
-		//fill in bottom half (vi < vj) -> x < y
+		//fill in bottom half of the diagonal blocks, all of the (vj, vi) block
 		for (unsigned int i = 0; i < 6; i++) {
 			for (unsigned int j = i; j < 6; j++) {
 				if (vi > 0) {
 					float dii = jacobianBlockRow_i(i) * jacobianBlockRow_i(j) * weight;
-					atomicAdd(&d_JtJ[(vi * 6 + j)*dim + (vi * 6 + i)], dii);
+					atomicAdd(&d_JtJDiag[vi * DENSE_JTJ_BLOCK_SIZE + j * 6 + i], dii);
 				}
 				if (vj > 0) {
 					float djj = jacobianBlockRow_j(i) * jacobianBlockRow_j(j) * weight;
-					atomicAdd(&d_JtJ[(vj * 6 + j)*dim + (vj * 6 + i)], djj);
+					atomicAdd(&d_JtJDiag[vj * DENSE_JTJ_BLOCK_SIZE + j * 6 + i], djj);
 				}
 				if (vi > 0 && vj > 0) {
 					float dij = jacobianBlockRow_i(i) * jacobianBlockRow_j(j) * weight;
-					atomicAdd(&d_JtJ[(vj * 6 + j)*dim + (vi * 6 + i)], dij);
+					atomicAdd(&d_JtJBlock_ji[j * 6 + i], dij);
 					if (i != j)	{
 						float dji = jacobianBlockRow_i(j) * jacobianBlockRow_j(i) * weight;
-						atomicAdd(&d_JtJ[(vj * 6 + i)*dim + (vi * 6 + j)], dji);
+						atomicAdd(&d_JtJBlock_ji[i * 6 + j], dji);
 					}
 				}
 			}
@@ -330,80 +340,40 @@ __inline__ __device__ void addToLocalSystemBrute(bool foundCorr, float* d_JtJ, f
 // multiply jtj
 ////////////////////////////////////////
 
-//inefficient version
-__inline__ __device__ void applyJTJDenseBruteDevice(unsigned int variableIdx, SolverState& state, float* d_JtJ, unsigned int N, float3& outRot, float3& outTrans)
+//one thread per variable
+__inline__ __device__ void applyJTJDenseBruteDevice(unsigned int variableIdx, SolverState& state, float3& outRot, float3& outTrans)
 {
 	// Compute J^T*d_Jp here
 	outRot = make_float3(0.0f, 0.0f, 0.0f);
 	outTrans = make_float3(0.0f, 0.0f, 0.0f);
 
-	const unsigned int dim = 6 * N;
-
-	unsigned int baseVarIdx = variableIdx * 6;
-	for (unsigned int i = 1; i < N; i++) // iterate through (6) row(s) of JtJ and all of p (i = 0 not a variable)
-	{
-		// (row, col) = vars, i
-		unsigned int baseIdx = 6 * i;
-
-		float3x3 block00(
-			d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 2]);
-		float3x3 block01(
-			d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 5]);
-		float3x3 block10(
-			d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 2]);
-		float3x3 block11(
-			d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 5]);
-
-		//outRot += block00 * state.d_pRot[i] + block01 * state.d_pTrans[i];
-		//outTrans += block10 * state.d_pRot[i] + block11 * state.d_pTrans[i];
-		outTrans += block00 * state.d_pTrans[i] + block01 * state.d_pRot[i];
-		outRot += block10 * state.d_pTrans[i] + block11 * state.d_pRot[i];
+	applyDenseJtJBlock(state.d_denseJtJDiag + variableIdx * DENSE_JTJ_BLOCK_SIZE, false, state.d_pTrans[variableIdx], state.d_pRot[variableIdx], outTrans, outRot);
+	for (int k = state.d_denseJtJRowOffsets[variableIdx]; k < state.d_denseJtJRowOffsets[variableIdx + 1]; k++) {
+		const int pairIdx = state.d_denseJtJRowPairs[k];
+		const uint2 imageIndices = state.d_denseOverlappingImages[pairIdx];
+		const bool transposed = (imageIndices.x == variableIdx); //block (j, i) is stored
+		const unsigned int i = transposed ? imageIndices.y : imageIndices.x;
+		if (i > 0) applyDenseJtJBlock(state.d_denseJtJOffDiag + pairIdx * DENSE_JTJ_BLOCK_SIZE, transposed, state.d_pTrans[i], state.d_pRot[i], outTrans, outRot);
 	}
 }
-__inline__ __device__ void applyJTJDenseDevice(unsigned int variableIdx, SolverState& state, float* d_JtJ, unsigned int N, float3& outRot, float3& outTrans, unsigned int threadIdx)
+//one block of THREADS_PER_BLOCK_JT_DENSE threads per variable, over the blocks of its row
+__inline__ __device__ void applyJTJDenseDevice(unsigned int variableIdx, SolverState& state, float3& outRot, float3& outTrans, unsigned int threadIdx)
 {
 	// Compute J^T*d_Jp here
 	outRot = make_float3(0.0f, 0.0f, 0.0f);
 	outTrans = make_float3(0.0f, 0.0f, 0.0f);
 
-	const unsigned int dim = 6 * N;
-
-	unsigned int baseVarIdx = variableIdx * 6;
-	unsigned int i = (threadIdx > 0) ? threadIdx : THREADS_PER_BLOCK_JT_DENSE;
-	for (; i < N; i += THREADS_PER_BLOCK_JT_DENSE) // iterate through (6) row(s) of JtJ
+	if (threadIdx == 0) {
+		applyDenseJtJBlock(state.d_denseJtJDiag + variableIdx * DENSE_JTJ_BLOCK_SIZE, false, state.d_pTrans[variableIdx], state.d_pRot[variableIdx], outTrans, outRot);
+	}
+	const int rowEnd = state.d_denseJtJRowOffsets[variableIdx + 1];
+	for (int k = state.d_denseJtJRowOffsets[variableIdx] + threadIdx; k < rowEnd; k += THREADS_PER_BLOCK_JT_DENSE) // iterate through the (6) row(s) of JtJ
 	{
-		// (row, col) = vars, i
-		unsigned int baseIdx = 6 * i;
-
-		float3x3 block00(
-			d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 2]);
-		float3x3 block01(
-			d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 0)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 1)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 2)* dim + baseIdx + 5]);
-		float3x3 block10(
-			d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 2],
-			d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 0], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 1], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 2]);
-		float3x3 block11(
-			d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 3)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 4)* dim + baseIdx + 5],
-			d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 3], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 4], d_JtJ[(baseVarIdx + 5)* dim + baseIdx + 5]);
-
-		//outRot += block00 * state.d_pRot[i] + block01 * state.d_pTrans[i];
-		//outTrans += block10 * state.d_pRot[i] + block11 * state.d_pTrans[i];
-		outTrans += block00 * state.d_pTrans[i] + block01 * state.d_pRot[i];
-		outRot += block10 * state.d_pTrans[i] + block11 * state.d_pRot[i];
+		const int pairIdx = state.d_denseJtJRowPairs[k];
+		const uint2 imageIndices = state.d_denseOverlappingImages[pairIdx];
+		const bool transposed = (imageIndices.x == variableIdx); //block (j, i) is stored
+		const unsigned int i = transposed ? imageIndices.y : imageIndices.x;
+		if (i > 0) applyDenseJtJBlock(state.d_denseJtJOffDiag + pairIdx * DENSE_JTJ_BLOCK_SIZE, transposed, state.d_pTrans[i], state.d_pRot[i], outTrans, outRot);
 	}
 
 	outRot.x = warpReduce(outRot.x);	 outRot.y = warpReduce(outRot.y);	  outRot.z = warpReduce(outRot.z);
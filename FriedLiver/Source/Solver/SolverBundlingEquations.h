@@ -123,14 +123,9 @@ __inline__ __device__ void evalMinusJTFDevice(unsigned int variableIdx, SolverIn
 		resRot -= make_float3(state.d_denseJtr[rotIndices.x], state.d_denseJtr[rotIndices.y], state.d_denseJtr[rotIndices.z]); //minus since -Jtf, weight already built in
 		resTrans -= make_float3(state.d_denseJtr[transIndices.x], state.d_denseJtr[transIndices.y], state.d_denseJtr[transIndices.z]); //minus since -Jtf, weight already built in
 		//// preconditioner
-		//pRot += make_float3(
-		//	state.d_denseJtJ[rotIndices.x * input.numberOfImages * 6 + rotIndices.x],
-		//	state.d_denseJtJ[rotIndices.y * input.numberOfImages * 6 + rotIndices.y],
-		//	state.d_denseJtJ[rotIndices.z * input.numberOfImages * 6 + rotIndices.z]);
-		//pTrans += make_float3(
-		//	state.d_denseJtJ[transIndices.x * input.numberOfImages * 6 + transIndices.x],
-		//	state.d_denseJtJ[transIndices.y * input.numberOfImages * 6 + transIndices.y],
-		//	state.d_denseJtJ[transIndices.z * input.numberOfImages * 6 + transIndices.z]);
+		//const float* denseJtJ = state.d_denseJtJDiag + variableIdx * DENSE_JTJ_BLOCK_SIZE;
+		//pRot += make_float3(denseJtJ[3 * 6 + 3], denseJtJ[4 * 6 + 4], denseJtJ[5 * 6 + 5]);
+		//pTrans += make_float3(denseJtJ[0 * 6 + 0], denseJtJ[1 * 6 + 1], denseJtJ[2 * 6 + 2]);
 	}// end dense part
 
 	// Preconditioner depends on last solution P(input.d_x)
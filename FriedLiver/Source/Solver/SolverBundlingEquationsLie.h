@@ -17,6 +17,8 @@
 #include "SolverBundlingUtil.h"
 #include "SolverBundlingState.h"
 #include "SolverBundlingParameters.h"
+#include "SolverBundlingDenseBlocks.h"
+#include "SolverBundlingPreconditioner.h"
 
 #include "ICPUtil.h"
 #include "LieDerivUtil.h"
@@ -117,14 +119,9 @@ __inline__ __device__ void evalMinusJTFDevice(unsigned int variableIdx, SolverIn
 		resRot -= make_float3(state.d_denseJtr[rotIndices.x], state.d_denseJtr[rotIndices.y], state.d_denseJtr[rotIndices.z]); //minus since -Jtf, weight already built in
 		resTrans -= make_float3(state.d_denseJtr[transIndices.x], state.d_denseJtr[transIndices.y], state.d_denseJtr[transIndices.z]); //minus since -Jtf, weight already built in
 		//// preconditioner
-		//pRot += make_float3(
-		//	state.d_denseJtJ[rotIndices.x * input.numberOfImages * 6 + rotIndices.x],
-		//	state.d_denseJtJ[rotIndices.y * input.numberOfImages * 6 + rotIndices.y],
-		//	state.d_denseJtJ[rotIndices.z * input.numberOfImages * 6 + rotIndices.z]);
-		//pTrans += make_float3(
-		//	state.d_denseJtJ[transIndices.x * input.numberOfImages * 6 + transIndices.x],
-		//	state.d_denseJtJ[transIndices.y * input.numberOfImages * 6 + transIndices.y],
-		//	state.d_denseJtJ[transIndices.z * input.numberOfImages * 6 + transIndices.z]);
+		//const float* denseJtJ = state.d_denseJtJDiag + variableIdx * DENSE_JTJ_BLOCK_SIZE;
+		//pRot += make_float3(denseJtJ[3 * 6 + 3], denseJtJ[4 * 6 + 4], denseJtJ[5 * 6 + 5]);
+		//pTrans += make_float3(denseJtJ[0 * 6 + 0], denseJtJ[1 * 6 + 1], denseJtJ[2 * 6 + 2]);
 	}
 
 	// Preconditioner depends on last solution P(input.d_x)
@@ -147,6 +144,45 @@ __inline__ __device__ void evalMinusJTFDevice(unsigned int variableIdx, SolverIn
 	else					      state.d_precondionerTrans[variableIdx].z = 1.0f;
 }
 
+////////////////////////////////////////
+// block Jacobi preconditioner: factors the 6x6 diagonal block of the weighted J^T J (sparse + dense) of the variable
+////////////////////////////////////////
+
+template<bool useDense>
+__inline__ __device__ void evalPreconditionerBlockDevice(unsigned int variableIdx, SolverInput& input, SolverState& state, SolverParameters& parameters)
+{
+	// sparse J = sign * [I | dAlpha dBeta dGamma]: only the lower triangle is needed for the factorization
+	float block[DENSE_JTJ_BLOCK_SIZE];
+	for (unsigned int i = 0; i < DENSE_JTJ_BLOCK_SIZE; i++) block[i] = 0.0f;
+
+	int N = min(input.d_numEntriesPerRow[variableIdx], input.maxCorrPerImage);
+	for (int i = 0; i < N; i++)
+	{
+		int corrIdx = input.d_variablesToCorrespondences[variableIdx*input.maxCorrPerImage + i];
+		const EntryJ& corr = input.d_correspondences[corrIdx];
+		if (corr.isValid()) {
+			const float3 worldP = (variableIdx != corr.imgIdx_i) ? state.d_xTransforms[corr.imgIdx_j] * corr.pos_j : state.d_xTransforms[corr.imgIdx_i] * corr.pos_i;
+			const float3 d[3] = { evalLie_dAlpha(worldP), evalLie_dBeta(worldP), evalLie_dGamma(worldP) };
+			for (unsigned int r = 0; r < 3; r++) {
+				block[r * 6 + r] += 1.0f;
+				block[(3 + r) * 6 + 0] += d[r].x;
+				block[(3 + r) * 6 + 1] += d[r].y;
+				block[(3 + r) * 6 + 2] += d[r].z;
+				for (unsigned int c = 0; c <= r; c++) block[(3 + r) * 6 + 3 + c] += dot(d[r], d[c]);
+			}
+		}
+	}
+	for (unsigned int i = 0; i < DENSE_JTJ_BLOCK_SIZE; i++) block[i] *= parameters.weightSparse;
+	if (useDense) { // weight already built in
+		const float* denseJtJ = state.d_denseJtJDiag + variableIdx * DENSE_JTJ_BLOCK_SIZE;
+		for (unsigned int i = 0; i < DENSE_JTJ_BLOCK_SIZE; i++) block[i] += denseJtJ[i];
+	}
+	factorPreconditionerBlock(block);
+
+	float* out = state.d_precondionerBlocks + variableIdx * DENSE_JTJ_BLOCK_SIZE;
+	for (unsigned int i = 0; i < DENSE_JTJ_BLOCK_SIZE; i++) out[i] = block[i];
+}
+
 ////////////////////////////////////////
 // applyJT : this function is called per variable and evaluates each residual influencing that variable (i.e., each energy term per variable)
 ////////////////////////////////////////
@@ -0,0 +1,59 @@
+#include "stdafx.h"
+#include "SolverBundlingOverlapIndex.h"
+
+#include <algorithm>
+
+void SolverBundlingOverlapIndex::findCandidatePairs(const std::vector<float3>& imageBounds, const std::vector<int>& validImages, unsigned int numImages,
+	float distThresh, float cosMaxAngle, std::vector<uint2>& pairs)
+{
+	MLIB_ASSERT(imageBounds.size() >= 3 * numImages && validImages.size() >= numImages);
+	pairs.clear();
+
+	struct Box {
+		float3 bmin, bmax, dir;
+		unsigned int image;
+	};
+	std::vector<Box> boxes;
+	boxes.reserve(numImages);
+	float3 sceneMin = make_float3(std::numeric_limits<float>::infinity());
+	float3 sceneMax = make_float3(-std::numeric_limits<float>::infinity());
+	for (unsigned int i = 0; i < numImages; i++) {
+		if (validImages[i] == 0) continue;
+		const float3& bmin = imageBounds[3 * i];
+		const float3& bmax = imageBounds[3 * i + 1];
+		if (bmin.x > bmax.x) continue; //no valid depth
+		Box b;
+		b.bmin = bmin - make_float3(distThresh);
+		b.bmax = bmax + make_float3(distThresh);
+		b.dir = imageBounds[3 * i + 2];
+		b.image = i;
+		boxes.push_back(b);
+		sceneMin = fminf(sceneMin, b.bmin);
+		sceneMax = fmaxf(sceneMax, b.bmax);
+	}
+	if (boxes.size() < 2) return;
+
+	//sweep along the largest extent
+	const float3 extent = sceneMax - sceneMin;
+	const unsigned int axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+	auto coord = [axis](const float3& v) { return axis == 0 ? v.x : (axis == 1 ? v.y : v.z); };
+	std::sort(boxes.begin(), boxes.end(), [&coord](const Box& a, const Box& b) { return coord(a.bmin) < coord(b.bmin); });
+
+	const float cosThresh = cosMaxAngle - 1e-4f; //slack for the rounding difference to computeAngleDiff; the GPU test is exact
+	std::vector<unsigned int> active;
+	for (unsigned int b = 0; b < (unsigned int)boxes.size(); b++) {
+		const Box& box = boxes[b];
+		const float start = coord(box.bmin);
+		active.erase(std::remove_if(active.begin(), active.end(), [&](unsigned int a) { return coord(boxes[a].bmax) < start; }), active.end());
+		for (unsigned int a : active) {
+			const Box& other = boxes[a];
+			if (other.bmax.x < box.bmin.x || box.bmax.x < other.bmin.x ||
+				other.bmax.y < box.bmin.y || box.bmax.y < other.bmin.y ||
+				other.bmax.z < box.bmin.z || box.bmax.z < other.bmin.z) continue;
+			if (dot(other.dir, box.dir) < cosThresh) continue;
+			pairs.push_back(make_uint2(std::min(box.image, other.image), std::max(box.image, other.image)));
+		}
+		active.push_back(b);
+	}
+	std::sort(pairs.begin(), pairs.end(), [](const uint2& a, const uint2& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+}
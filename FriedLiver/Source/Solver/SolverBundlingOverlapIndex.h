@@ -0,0 +1,21 @@
+#pragma once
+
+#ifndef _SOLVER_OVERLAP_INDEX_
+#define _SOLVER_OVERLAP_INDEX_
+
+#include <cutil_math.h>
+#include <vector>
+
+//! broad phase of the dense overlap check (FindImageImageCorr_Kernel): instead of testing all N(N-1)/2 image pairs, only pairs whose world space
+//! bounds (of the cached depth, grown by the correspondence distance threshold) intersect and whose viewing directions are close enough are proposed.
+//! conservative: a dense correspondence needs a source point within distThresh of a target point, i.e. intersecting grown bounds
+class SolverBundlingOverlapIndex
+{
+public:
+	//! per image bounds min, bounds max and viewing direction (3 entries per image; empty bounds: min > max); cosMaxAngle as in computeAngleDiff.
+	//! sweep and prune over the axis of the largest extent; the pairs (i, j) have i < j
+	static void findCandidatePairs(const std::vector<float3>& imageBounds, const std::vector<int>& validImages, unsigned int numImages,
+		float distThresh, float cosMaxAngle, std::vector<uint2>& pairs);
+};
+
+#endif
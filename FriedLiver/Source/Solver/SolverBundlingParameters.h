@@ -28,6 +28,10 @@ struct SolverParameters
 	float weightDenseDepth;	
 	float weightDenseColor;
 	bool useDense;
+
+	unsigned int preconditioner;	// PRECONDITIONER_* (SolverBundlingPreconditioner.h)
+	float linearTolerance;			// > 0: the PCG stops once |r| <= linearTolerance * |r_0| (nLinIterations is the upper bound)
+	float energyTolerance;			// > 0: GN stops once the energy (sparse + dense) changes by less than energyTolerance (relative) in an iteration
 };
 
 #endif
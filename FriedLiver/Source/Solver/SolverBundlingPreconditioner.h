@@ -0,0 +1,85 @@
+#pragma once
+
+#ifndef _SOLVER_PRECONDITIONER_
+#define _SOLVER_PRECONDITIONER_
+
+#include <cutil_math.h>
+
+////////////////////////////////////////
+// PCG preconditioners (s_solverPreconditioner)
+////////////////////////////////////////
+
+#define PRECONDITIONER_JACOBI 0					// per axis diagonal of the unweighted sparse J^T J (d_precondionerRot / d_precondionerTrans)
+#define PRECONDITIONER_BLOCK_JACOBI 1			// inverse of the 6x6 diagonal block of each image (weighted sparse + dense)
+#define PRECONDITIONER_INCOMPLETE_CHOLESKY 2	// block IC(0) on the image pair pattern (CPUSolverBundling only)
+
+#define PRECONDITIONER_MIN_DIAG 0.000001f		// rows with a smaller diagonal have no terms and get a unit diagonal (as the Jacobi preconditioner)
+#define PRECONDITIONER_DAMPING 0.0001f			// relative diagonal shift: rank deficient blocks (e.g. a single matched pair) stay positive definite
+
+//! in place cholesky factor of a symmetric positive definite 6x6 block (row major, only the lower triangle is read and written); false on a non-positive pivot
+__inline__ __host__ __device__ bool choleskyBlock6(float* L)
+{
+	for (unsigned int j = 0; j < 6; j++) {
+		float d = L[j * 6 + j];
+		for (unsigned int k = 0; k < j; k++) d -= L[j * 6 + k] * L[j * 6 + k];
+		if (!(d > 0.0f)) return false;
+		d = sqrtf(d);
+		L[j * 6 + j] = d;
+		for (unsigned int i = j + 1; i < 6; i++) {
+			float s = L[i * 6 + j];
+			for (unsigned int k = 0; k < j; k++) s -= L[i * 6 + k] * L[j * 6 + k];
+			L[i * 6 + j] = s / d;
+		}
+	}
+	return true;
+}
+
+//! v = L^-1 v
+__inline__ __host__ __device__ void solveLowerBlock6(const float* L, float* v)
+{
+	for (unsigned int i = 0; i < 6; i++) {
+		float s = v[i];
+		for (unsigned int k = 0; k < i; k++) s -= L[i * 6 + k] * v[k];
+		v[i] = s / L[i * 6 + i];
+	}
+}
+
+//! v = L^-T v
+__inline__ __host__ __device__ void solveUpperBlock6(const float* L, float* v)
+{
+	for (int i = 5; i >= 0; i--) {
+		float s = v[i];
+		for (unsigned int k = i + 1; k < 6; k++) s -= L[k * 6 + i] * v[k];
+		v[i] = s / L[i * 6 + i];
+	}
+}
+
+//! factors a diagonal block of J^T J for the block Jacobi preconditioner (unit diagonal for empty rows, damped); falls back to the diagonal if the
+//! factorization breaks down
+__inline__ __host__ __device__ void factorPreconditionerBlock(float* block)
+{
+	float diag[6];
+	for (unsigned int r = 0; r < 6; r++) {
+		const float d = block[r * 6 + r];
+		diag[r] = (d > PRECONDITIONER_MIN_DIAG) ? d * (1.0f + PRECONDITIONER_DAMPING) : 1.0f;
+		block[r * 6 + r] = diag[r];
+	}
+	if (!choleskyBlock6(block)) {
+		for (unsigned int r = 0; r < 6; r++) {
+			for (unsigned int c = 0; c < r; c++) block[r * 6 + c] = 0.0f;
+			block[r * 6 + r] = sqrtf(diag[r]);
+		}
+	}
+}
+
+//! z = (L L^T)^-1 r of a factored block
+__inline__ __host__ __device__ void applyPreconditionerBlock(const float* L, const float3& rTrans, const float3& rRot, float3& zTrans, float3& zRot)
+{
+	float v[6] = { rTrans.x, rTrans.y, rTrans.z, rRot.x, rRot.y, rRot.z };
+	solveLowerBlock6(L, v);
+	solveUpperBlock6(L, v);
+	zTrans = make_float3(v[0], v[1], v[2]);
+	zRot = make_float3(v[3], v[4], v[5]);
+}
+
+#endif
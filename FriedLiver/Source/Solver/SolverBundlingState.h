@@ -24,7 +24,7 @@ struct SolverInput
 	unsigned int denseDepthWidth;
 	unsigned int denseDepthHeight;
 	float4 intrinsics;				//TODO constant buffer for this + siftimagemanger stuff?
-	unsigned int maxNumDenseImPairs;
+	unsigned int maxNumDenseImPairs;	// capacity of the overlapping image pairs (and the dense JtJ blocks)
 	float2 colorFocalLength; //color camera params (actually same as depthIntrinsics...)
 
 	const float* weightsSparse;
@@ -61,6 +61,7 @@ struct SolverState
 	
 	float3*	d_precondionerRot;			// Preconditioner for linear system
 	float3*	d_precondionerTrans;		// Preconditioner for linear system
+	float*	d_precondionerBlocks;		// Block Jacobi preconditioner: cholesky factor of the 6x6 diagonal block per image
 
 	float*	d_sumResidual;				// sum of the squared residuals //debug
 
@@ -76,7 +77,10 @@ struct SolverState
 	}
 
 	// for dense depth term
-	float* d_denseJtJ;
+	float* d_denseJtJDiag;				// block sparse JtJ (see SolverBundlingDenseBlocks.h): diagonal blocks per image
+	float* d_denseJtJOffDiag;			// off-diagonal blocks per overlapping image pair
+	int* d_denseJtJRowOffsets;			// rows of the off-diagonal blocks (numberOfImages + 1 offsets into d_denseJtJRowPairs)
+	int* d_denseJtJRowPairs;			// pair indices per row
 	float* d_denseJtr;
 	float* d_denseCorrCounts;
 
@@ -85,6 +89,8 @@ struct SolverState
 
 	uint2* d_denseOverlappingImages;
 	int* d_numDenseOverlappingImages;
+	float3* d_denseImageBounds;			// per image: world space bounds min, max of the cached depth and viewing direction
+	uint2* d_denseCandidatePairs;		// overlap candidates of SolverBundlingOverlapIndex (maxNumDenseImPairs per launch)
 
 	//!!!DEBUGGING
 	int* d_corrCount;
@@ -0,0 +1,137 @@
+#pragma once
+
+/************************************************************************/
+/* Fixed-size pool of worker threads for the CPU code paths            */
+/************************************************************************/
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+class ThreadPool {
+public:
+	//! numThreads == 0 uses all hardware threads
+	ThreadPool(unsigned int numThreads = 0) {
+		if (numThreads == 0) numThreads = std::max(1u, std::thread::hardware_concurrency());
+		m_bStop = false;
+		for (unsigned int i = 0; i < numThreads; i++) {
+			m_workers.push_back(std::thread(&ThreadPool::workerFunc, this));
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_cvTask.notify_all();
+		for (auto& t : m_workers) {
+			if (t.joinable()) t.join();
+		}
+	}
+
+	unsigned int getNumThreads() const {
+		return (unsigned int)m_workers.size();
+	}
+
+	//! queues a task; the returned future becomes ready once it has run
+	template<typename F>
+	std::future<void> enqueue(F f) {
+		auto task = std::make_shared<std::packaged_task<void()>>(f);
+		std::future<void> res = task->get_future();
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_tasks.push_back([task]() { (*task)(); });
+		}
+		m_cvTask.notify_one();
+		return res;
+	}
+
+	//! calls f(i) for all i in [begin, end) and blocks until all calls have returned; the calling thread participates, so nested calls cannot dead-lock
+	template<typename F>
+	void parallelFor(unsigned int begin, unsigned int end, F f, unsigned int grainSize = 1) {
+		if (end <= begin) return;
+		grainSize = std::max(grainSize, 1u);
+		const unsigned int numChunks = (end - begin + grainSize - 1) / grainSize;
+		if (numChunks == 1 || m_workers.empty()) {
+			for (unsigned int i = begin; i < end; i++) f(i);
+			return;
+		}
+
+		struct State {
+			std::function<void(unsigned int)> func;
+			unsigned int begin, end, grainSize, numChunks;
+			std::atomic<unsigned int> nextChunk;
+			std::atomic<unsigned int> numChunksDone;
+			std::mutex mutex;
+			std::condition_variable cvDone;
+		};
+		auto state = std::make_shared<State>();
+		state->func = f;
+		state->begin = begin;	state->end = end;
+		state->grainSize = grainSize;	state->numChunks = numChunks;
+		state->nextChunk = 0;	state->numChunksDone = 0;
+
+		auto runChunks = [](State* s) {
+			while (true) {
+				const unsigned int c = s->nextChunk++;
+				if (c >= s->numChunks) break;
+				const unsigned int first = s->begin + c * s->grainSize;
+				const unsigned int last = std::min(first + s->grainSize, s->end);
+				for (unsigned int i = first; i < last; i++) s->func(i);
+				if (++s->numChunksDone == s->numChunks) {
+					std::unique_lock<std::mutex> lock(s->mutex);
+					s->cvDone.notify_all();
+				}
+			}
+		};
+
+		const unsigned int numHelpers = std::min(numChunks - 1, getNumThreads());
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (unsigned int i = 0; i < numHelpers; i++) {
+				m_tasks.push_back([state, runChunks]() { runChunks(state.get()); });
+			}
+		}
+		m_cvTask.notify_all();
+
+		runChunks(state.get());
+
+		std::unique_lock<std::mutex> lock(state->mutex);
+		while (state->numChunksDone < numChunks) state->cvDone.wait(lock);
+	}
+
+	//! process-wide pool; the first call fixes the number of threads
+	static ThreadPool& get(unsigned int numThreads = 0) {
+		static ThreadPool s(numThreads);
+		return s;
+	}
+
+private:
+	void workerFunc() {
+		while (true) {
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (!m_bStop && m_tasks.empty()) m_cvTask.wait(lock);
+				if (m_bStop && m_tasks.empty()) return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread>			m_workers;
+	std::deque<std::function<void()>>	m_tasks;
+	std::mutex							m_mutex;
+	std::condition_variable				m_cvTask;
+	bool								m_bStop;
+};
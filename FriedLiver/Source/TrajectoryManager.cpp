@@ -3,6 +3,7 @@
 
 #include "TrajectoryManager.h"     
 #include "GlobalAppState.h"
+#include "BundlerCheckpoint.h"
 
 
 TrajectoryManager::TrajectoryManager(unsigned int numMaxImage)
@@ -188,6 +189,87 @@ unsigned int TrajectoryManager::getNumActiveOperations() const
 		(unsigned int)m_toReIntegrateList.size();
 }
 
+void TrajectoryManager::saveCheckpoint(CheckpointBuffer& buffer)
+{
+	m_mutexUpdateTransforms.lock();
+
+	auto toIndices = [&](const std::list<TrajectoryFrame*>& frames) {
+		std::vector<unsigned int> indices;
+		for (const TrajectoryFrame* f : frames) indices.push_back((unsigned int)(f - m_frames.data()));
+		return indices;
+	};
+	std::vector<unsigned int> types(m_numAddedFrames), frameIndices(m_numAddedFrames), sortIndices(m_framesSort.size());
+	std::vector<mat4f> integratedTransforms(m_numAddedFrames);
+	std::vector<float> dists(m_numAddedFrames);
+	for (unsigned int i = 0; i < m_numAddedFrames; i++) {
+		types[i] = (unsigned int)m_frames[i].type;
+		frameIndices[i] = m_frames[i].frameIdx;
+		integratedTransforms[i] = m_frames[i].integratedTransform;
+		dists[i] = m_frames[i].dist;
+	}
+	for (size_t i = 0; i < m_framesSort.size(); i++) sortIndices[i] = (unsigned int)(m_framesSort[i] - m_frames.data());
+
+	buffer.write(m_numAddedFrames);
+	buffer.write(m_numOptimizedFrames);
+	buffer.writeVector(types);
+	buffer.writeVector(frameIndices);
+	buffer.writeVector(integratedTransforms);
+	buffer.writeVector(dists);
+	buffer.writeVector(std::vector<mat4f>(m_optmizedTransforms.begin(), m_optmizedTransforms.begin() + m_numAddedFrames));
+	buffer.writeVector(sortIndices);
+	buffer.writeVector(toIndices(m_toDeIntegrateList));
+	buffer.writeVector(toIndices(m_toIntegrateList));
+	buffer.writeVector(toIndices(m_toReIntegrateList));
+
+	m_mutexUpdateTransforms.unlock();
+}
+
+void TrajectoryManager::loadCheckpoint(CheckpointBuffer& buffer)
+{
+	unsigned int numAddedFrames = 0, numOptimizedFrames = 0;
+	std::vector<unsigned int> types, frameIndices, sortIndices, deIntegrate, integrate, reIntegrate;
+	std::vector<mat4f> integratedTransforms, optimizedTransforms;
+	std::vector<float> dists;
+	buffer.read(numAddedFrames);
+	buffer.read(numOptimizedFrames);
+	buffer.readVector(types);
+	buffer.readVector(frameIndices);
+	buffer.readVector(integratedTransforms);
+	buffer.readVector(dists);
+	buffer.readVector(optimizedTransforms);
+	buffer.readVector(sortIndices);
+	buffer.readVector(deIntegrate);
+	buffer.readVector(integrate);
+	buffer.readVector(reIntegrate);
+	if (numAddedFrames > m_frames.size() || types.size() != numAddedFrames || optimizedTransforms.size() != numAddedFrames) throw MLIB_EXCEPTION("invalid trajectory checkpoint");
+	for (const std::vector<unsigned int>* indices : { &sortIndices, &deIntegrate, &integrate, &reIntegrate }) {
+		for (unsigned int idx : *indices) {
+			if (idx >= m_frames.size()) throw MLIB_EXCEPTION("invalid trajectory checkpoint");
+		}
+	}
+
+	m_mutexUpdateTransforms.lock();
+	m_numAddedFrames = numAddedFrames;
+	m_numOptimizedFrames = numOptimizedFrames;
+	for (unsigned int i = 0; i < numAddedFrames; i++) {
+		m_frames[i].type = (TrajectoryFrame::TYPE)types[i];
+		m_frames[i].frameIdx = frameIndices[i];
+		m_frames[i].integratedTransform = integratedTransforms[i];
+		m_frames[i].dist = dists[i];
+		m_optmizedTransforms[i] = optimizedTransforms[i];
+	}
+	auto toFrames = [&](const std::vector<unsigned int>& indices, std::list<TrajectoryFrame*>& frames) {
+		frames.clear();
+		for (unsigned int idx : indices) frames.push_back(&m_frames[idx]);
+	};
+	m_framesSort.clear();
+	for (unsigned int idx : sortIndices) m_framesSort.push_back(&m_frames[idx]);
+	toFrames(deIntegrate, m_toDeIntegrateList);
+	toFrames(integrate, m_toIntegrateList);
+	toFrames(reIntegrate, m_toReIntegrateList);
+	m_mutexUpdateTransforms.unlock();
+}
+
 void TrajectoryManager::invalidateFrame(unsigned int frameIdx)
 {
 	if (m_frames[frameIdx].type == TrajectoryFrame::Invalid) return;
@@ -4,6 +4,8 @@
 #include "CUDAImageManager.h"
 #include "PoseHelper.h"
 
+class CheckpointBuffer;
+
 class TrajectoryManager {
 public:
 	struct TrajectoryFrame {
@@ -46,6 +48,10 @@ public:
 	unsigned int getNumAddedFrames() const;
 	unsigned int getNumActiveOperations() const;
 
+	//! added frames, optimized transforms and the update lists (OnlineBundler session checkpoints)
+	void saveCheckpoint(CheckpointBuffer& buffer);
+	void loadCheckpoint(CheckpointBuffer& buffer);
+
 
 	void getOptimizedTransforms(std::vector<mat4f>& transforms) {
 		m_mutexUpdateTransforms.lock();